@@ -4,10 +4,13 @@ Fast memory allocation layer above standard malloc.
 These are meant to inexpensively allocate buffers for string operations.
 
 They are thread-safe, fast, with canary values used (in debug mode) to ensure
-memory is correctly freed and written to.
+memory is correctly freed and written to. Each thread keeps a small cache of
+free blocks, in front of a list shared by all threads, so most allocations don't
+take the lock.
 
 If you need to perform recursive operations then use malloc/free. Releasing
-these buffers does not free the underlying memory to be used by other programs.
+these buffers does not free the underlying memory to be used by other programs;
+alloc_trim does, for the free blocks not cached by the threads.
 */
 
 #include "config.h"
@@ -17,6 +20,7 @@ these buffers does not free the underlying memory to be used by other programs.
 #include <omp.h>
 
 #include "flog.h"
+#include "mem_usage.h"
 #include "types.h"
 
 typedef struct __mem_link_ {
@@ -28,10 +32,23 @@ typedef struct __mem_link_ {
 #define TAIL_USED 253
 #define TAIL_FREE 254
 
+#if MATILDA_RELEASE_MODE
+#define BLOCK_SIZ MAX_PAGE_SIZ
+#else
+#define BLOCK_SIZ (MAX_PAGE_SIZ + 2)
+#endif
+
+/* maximum number of free blocks kept by each thread */
+#define THREAD_CACHE_SIZ 8
+
 static mem_link * queue = NULL;
 static omp_lock_t queue_lock;
 static bool queue_inited = false;
 
+static void * thread_cache[THREAD_CACHE_SIZ];
+static u8 thread_cache_count = 0;
+#pragma omp threadprivate(thread_cache, thread_cache_count)
+
 #if !MATILDA_RELEASE_MODE
 static u16 concurrent_allocs = 0;
 #define WARN_CONCURRENT_ALLOCS 16
@@ -58,34 +75,40 @@ void * alloc()
 {
     void * ret = NULL;
 
-    omp_set_lock(&queue_lock);
-
 #if !MATILDA_RELEASE_MODE
-    concurrent_allocs++;
-    if(concurrent_allocs >= WARN_CONCURRENT_ALLOCS)
+    u16 allocs;
+    #pragma omp atomic capture
+    allocs = ++concurrent_allocs;
+    if(allocs >= WARN_CONCURRENT_ALLOCS)
     {
         fprintf(stderr, "alloc: suspicious memory allocations number (%u)\n",
-            concurrent_allocs);
+            allocs);
     }
 #endif
 
-    if(queue != NULL)
+    if(thread_cache_count > 0)
+        ret = thread_cache[--thread_cache_count];
+    else
     {
-        ret = queue;
-        queue = queue->next;
+        omp_set_lock(&queue_lock);
+        if(queue != NULL)
+        {
+            ret = queue;
+            queue = queue->next;
+        }
+        omp_unset_lock(&queue_lock);
     }
-    omp_unset_lock(&queue_lock);
 
     if(ret == NULL){
 #if MATILDA_RELEASE_MODE
-        ret = malloc(MAX_PAGE_SIZ);
+        ret = malloc(BLOCK_SIZ);
         if(ret == NULL)
         {
             fprintf(stderr, "alloc: out of memory exception\n");
             exit(EXIT_FAILURE);
         }
 #else
-        u8 * buf = malloc(MAX_PAGE_SIZ + 2);
+        u8 * buf = malloc(BLOCK_SIZ);
         if(buf == NULL)
         {
             fprintf(stderr, "alloc: out of memory exception\n");
@@ -98,6 +121,7 @@ void * alloc()
 
         ret = buf + 1;
 #endif
+        mem_usage_add(MEM_SCRATCH, BLOCK_SIZ);
     }
 
     /*
@@ -140,12 +164,50 @@ s, rolling block releasing or writes past bounds (2)\n");
     s[MAX_PAGE_SIZ] = TAIL_FREE;
 #endif
 
+#if !MATILDA_RELEASE_MODE
+    #pragma omp atomic
+    --concurrent_allocs;
+#endif
+
+    if(thread_cache_count < THREAD_CACHE_SIZ)
+    {
+        thread_cache[thread_cache_count++] = ptr;
+        return;
+    }
+
     omp_set_lock(&queue_lock);
     mem_link * l = (mem_link *)ptr;
     l->next = queue;
     queue = l;
-#if !MATILDA_RELEASE_MODE
-    --concurrent_allocs;
-#endif
     omp_unset_lock(&queue_lock);
 }
+
+/*
+Frees the blocks of the list shared by all threads, returning their memory to
+the system.
+Thread-safe.
+RETURNS number of bytes freed
+*/
+u64 alloc_trim()
+{
+    omp_set_lock(&queue_lock);
+    mem_link * l = queue;
+    queue = NULL;
+    omp_unset_lock(&queue_lock);
+
+    u64 freed = 0;
+    while(l != NULL)
+    {
+        mem_link * next = l->next;
+#if MATILDA_RELEASE_MODE
+        free(l);
+#else
+        free(((u8 *)l) - 1);
+#endif
+        freed += BLOCK_SIZ;
+        l = next;
+    }
+
+    mem_usage_add(MEM_SCRATCH, -((d64)freed));
+    return freed;
+}
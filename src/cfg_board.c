@@ -26,12 +26,17 @@ unless explicitly said so.
 #include <string.h>
 #include <assert.h>
 #include <omp.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #include "alloc.h"
 #include "board.h"
 #include "cfg_board.h"
 #include "flog.h"
+#include "mem_usage.h"
 #include "move.h"
+#include "pat12.h"
 #include "types.h"
 #include "zobrist.h"
 
@@ -45,38 +50,74 @@ extern bool border_left[TOTAL_BOARD_SIZ];
 extern bool border_right[TOTAL_BOARD_SIZ];
 extern bool border_top[TOTAL_BOARD_SIZ];
 extern bool border_bottom[TOTAL_BOARD_SIZ];
-extern u8 active_bits_in_byte[256];
 
 /* from zobrist */
 extern u16 iv_3x3[TOTAL_BOARD_SIZ][TOTAL_BOARD_SIZ][3];
 extern u16 initial_3x3_hash[TOTAL_BOARD_SIZ];
+extern move far_neighbors[TOTAL_BOARD_SIZ][4];
+extern u8 far_shifts[TOTAL_BOARD_SIZ][4];
+extern u8 far_neighbors_count[TOTAL_BOARD_SIZ];
+extern u8 initial_far_hash[TOTAL_BOARD_SIZ];
 
-static group * saved_nodes[MAXIMUM_NUM_THREADS];
+/*
+Groups are allocated for each thread in chunks of GROUP_POOL_CHUNK contiguous
+groups; freed groups are kept in a per thread list, in thread-private memory.
+The chunks are only returned to the system by cfg_board_trim_pool, when all of
+their groups are free.
+*/
+#define GROUP_POOL_CHUNK 64
 
-static group * alloc_group()
+static group * saved_nodes = NULL;
+#pragma omp threadprivate(saved_nodes)
+
+/* all chunks of groups allocated */
+static group ** pool_chunks = NULL;
+static u32 pool_chunks_count = 0;
+static u32 pool_chunks_capacity = 0;
+
+static void grow_group_pool()
 {
-    int thread = omp_get_thread_num();
-    group * ret;
-    if(saved_nodes[thread] != NULL)
+    group * chunk = (group *)malloc(sizeof(group) * GROUP_POOL_CHUNK);
+    if(chunk == NULL)
+        flog_crit("cfg", "system out of memory");
+
+    #pragma omp critical(group_pool_chunks)
     {
-        ret = saved_nodes[thread];
-        saved_nodes[thread] = saved_nodes[thread]->next;
+        if(pool_chunks_count == pool_chunks_capacity)
+        {
+            pool_chunks_capacity = MAX(pool_chunks_capacity * 2, 64);
+            pool_chunks = (group **)realloc(pool_chunks, pool_chunks_capacity *
+                sizeof(group *));
+            if(pool_chunks == NULL)
+                flog_crit("cfg", "system out of memory");
+        }
+        pool_chunks[pool_chunks_count++] = chunk;
     }
-    else
+    mem_usage_add(MEM_GROUPS, sizeof(group) * GROUP_POOL_CHUNK);
+
+    /* keep the list in address order */
+    for(u16 i = GROUP_POOL_CHUNK; i > 0; --i)
     {
-        ret = (group *)malloc(sizeof(group));
-        if(ret == NULL)
-            flog_crit("cfg", "system out of memory");
+        chunk[i - 1].next = saved_nodes;
+        saved_nodes = &chunk[i - 1];
     }
+}
+
+static group * alloc_group()
+{
+    if(saved_nodes == NULL)
+        grow_group_pool();
+
+    group * ret = saved_nodes;
+    saved_nodes = ret->next;
     return ret;
 }
 
 static void just_delloc_group(
     group * g
 ){
-    int thread = omp_get_thread_num();
-    g->next = saved_nodes[thread];
-    saved_nodes[thread] = g;
+    g->next = saved_nodes;
+    saved_nodes = g;
 }
 
 static void delloc_group(
@@ -93,9 +134,30 @@ static void delloc_group(
             g->unique_groups_idx;
     }
 
-    int thread = omp_get_thread_num();
-    g->next = saved_nodes[thread];
-    saved_nodes[thread] = g;
+    /* kept until the play is undone */
+    if(cb->undo != NULL)
+    {
+        assert(cb->undo->freed_count < MAX_PLAY_FREED_GROUPS);
+        cb->undo->freed[cb->undo->freed_count++] = g;
+        return;
+    }
+
+    g->next = saved_nodes;
+    saved_nodes = g;
+}
+
+/*
+Copies the contents of a group, but only the neighbors and stones in use.
+*/
+static void copy_group(
+    group * restrict dst,
+    const group * restrict src
+){
+    memcpy(dst, src, ((char *)&src->neighbors[src->neighbors_count]) -
+        ((char *)src));
+    dst->stones.count = src->stones.count;
+    memcpy(dst->stones.coord, src->stones.coord, src->stones.count *
+        sizeof(move));
 }
 
 static void pos_set_occupied(
@@ -143,6 +205,9 @@ static void pos_set_occupied(
             cb->hash[n] += iv_3x3[n][m][idx];
         }
     }
+
+    for(u8 k = 0; k < far_neighbors_count[m]; ++k)
+        cb->far_hash[far_neighbors[m][k]] += cb->p[m] << far_shifts[m][k];
 }
 
 static void pos_set_free(
@@ -189,6 +254,9 @@ static void pos_set_free(
             cb->hash[n] ^= iv_3x3[n][m][cb->p[m] - 1];
         }
     }
+
+    for(u8 k = 0; k < far_neighbors_count[m]; ++k)
+        cb->far_hash[far_neighbors[m][k]] ^= cb->p[m] << far_shifts[m][k];
 }
 
 static void add_neighbor(
@@ -206,13 +274,11 @@ static void add_liberty(
     group * g,
     move m
 ){
-    u8 mask = (1 << (m % 8));
-    if((g->ls[m / 8] & mask) == 0)
+    u64 mask = LIB_BIT(m);
+    if((g->ls[m / 64] & mask) == 0)
     {
-        g->ls[m / 8] |= mask;
+        g->ls[m / 64] |= mask;
         g->liberties++;
-        if(m < g->liberties_min_coord)
-            g->liberties_min_coord = m;
     }
 }
 
@@ -220,19 +286,15 @@ static void add_liberty_unchecked(
     group * g,
     move m
 ){
-    u8 mask = (1 << (m % 8));
-    g->ls[m / 8] |= mask;
+    g->ls[m / 64] |= LIB_BIT(m);
     g->liberties++;
-    if(m < g->liberties_min_coord)
-        g->liberties_min_coord = m;
 }
 
 static void rem_liberty_unchecked(
     group * g,
     move m
 ){
-    u8 mask = (1 << (m % 8));
-    g->ls[m / 8] &= ~mask;
+    g->ls[m / 64] &= ~LIB_BIT(m);
     g->liberties--;
 }
 
@@ -281,15 +343,12 @@ static void unite_groups(
     }
 
     u8 new_lib_count = 0;
-    for(u8 i = 0; i < LIB_BITMAP_SIZ; ++i)
+    for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
     {
         to_keep->ls[i] |= to_replace->ls[i];
-        new_lib_count += active_bits_in_byte[to_keep->ls[i]];
+        new_lib_count += __builtin_popcountll(to_keep->ls[i]);
     }
     to_keep->liberties = new_lib_count;
-
-    if(to_replace->liberties_min_coord < to_keep->liberties_min_coord)
-        to_keep->liberties_min_coord = to_replace->liberties_min_coord;
     delloc_group(cb, to_replace);
 }
 
@@ -308,8 +367,7 @@ static void add_stone(
     cb->g[m] = alloc_group();
     cb->g[m]->is_black = is_black;
     cb->g[m]->liberties = 0;
-    memset(cb->g[m]->ls, 0, LIB_BITMAP_SIZ);
-    cb->g[m]->liberties_min_coord = TOTAL_BOARD_SIZ;
+    memset(cb->g[m]->ls, 0, sizeof(cb->g[m]->ls));
     cb->g[m]->neighbors_count = 0;
     cb->g[m]->stones.count = 1;
     cb->g[m]->stones.coord[0] = m;
@@ -451,6 +509,7 @@ void cfg_init_board(
     cb->last_played = cb->last_eaten = NONE;
 
     memcpy(cb->hash, initial_3x3_hash, TOTAL_BOARD_SIZ * sizeof(u16));
+    memcpy(cb->far_hash, initial_far_hash, TOTAL_BOARD_SIZ);
     memset(cb->black_neighbors4, 0, TOTAL_BOARD_SIZ);
     memset(cb->white_neighbors4, 0, TOTAL_BOARD_SIZ);
     memset(cb->black_neighbors8, 0, TOTAL_BOARD_SIZ);
@@ -458,6 +517,7 @@ void cfg_init_board(
     memset(cb->g, 0, TOTAL_BOARD_SIZ * sizeof(group *));
     cb->empty.count = 0;
     cb->unique_groups_count = 0;
+    cb->undo = NULL;
 
     for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
     {
@@ -478,6 +538,7 @@ void cfg_from_board(
 ){
     memcpy(dst, src, sizeof(board));
     memcpy(dst->hash, initial_3x3_hash, TOTAL_BOARD_SIZ * sizeof(u16));
+    memcpy(dst->far_hash, initial_far_hash, TOTAL_BOARD_SIZ);
     memset(dst->black_neighbors4, 0, TOTAL_BOARD_SIZ);
     memset(dst->white_neighbors4, 0, TOTAL_BOARD_SIZ);
     memset(dst->black_neighbors8, 0, TOTAL_BOARD_SIZ);
@@ -485,6 +546,7 @@ void cfg_from_board(
     memset(dst->g, 0, TOTAL_BOARD_SIZ * sizeof(group *));
     dst->empty.count = 0;
     dst->unique_groups_count = 0;
+    dst->undo = NULL;
 
     for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
         if(src->p[m] == EMPTY)
@@ -509,6 +571,7 @@ void cfg_board_clone(
     memcpy(dst, src, sizeof(cfg_board) - (TOTAL_BOARD_SIZ * sizeof(group
         *)));
     memset(dst->g, 0, TOTAL_BOARD_SIZ * sizeof(group *));
+    dst->undo = NULL;
 
     for(u8 i = 0; i < src->unique_groups_count; ++i)
     {
@@ -516,7 +579,7 @@ void cfg_board_clone(
         group * g = alloc_group();
         group * s = src->g[src->unique_groups[i]];
         assert(s->unique_groups_idx == i);
-        memcpy(g, s, ((char *)&s->neighbors[s->neighbors_count]) - ((char *)s));
+        copy_group(g, s);
         /* replace hard links to group information */
         for(move j = 0; j < g->stones.count; ++j)
         {
@@ -623,8 +686,8 @@ static void cfg_board_kill_group3(
     cfg_board * cb,
     group * g,
     u8 own,
-    bool stones_removed[TOTAL_BOARD_SIZ],
-    u8 rem_nei_libs[LIB_BITMAP_SIZ]
+    move_seq * stones_removed,
+    u64 rem_nei_libs[LIB_BITMAP_WORDS]
 ){
     move id = g->stones.coord[0];
 
@@ -635,7 +698,8 @@ static void cfg_board_kill_group3(
         pos_set_free(cb, m, g->is_black);
         cb->p[m] = EMPTY;
         cb->g[m] = NULL;
-        stones_removed[m] = true;
+        stones_removed->coord[stones_removed->count] = m;
+        stones_removed->count++;
         add_liberties_to_neighbors(cb, m, own);
 
         cb->empty.coord[cb->empty.count] = m;
@@ -645,7 +709,7 @@ static void cfg_board_kill_group3(
     for(u8 i = 0; i < g->neighbors_count; ++i)
     {
         group * nei = cb->g[g->neighbors[i]];
-        for(u8 i = 0; i < LIB_BITMAP_SIZ; ++i)
+        for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
             rem_nei_libs[i] |= nei->ls[i];
         for(u8 j = 0; j < nei->neighbors_count; ++j)
             if(nei->neighbors[j] == id)
@@ -659,6 +723,176 @@ static void cfg_board_kill_group3(
     delloc_group(cb, g);
 }
 
+/*
+Removes a position from the list of empty intersections.
+*/
+static void remove_empty(
+    cfg_board * cb,
+    move m
+){
+    for(move k = 0; k < cb->empty.count; ++k)
+        if(cb->empty.coord[k] == m)
+        {
+            if(cb->undo != NULL)
+                cb->undo->empty_idx = k;
+            cb->empty.count--;
+            cb->empty.coord[k] = cb->empty.coord[cb->empty.count];
+            break;
+        }
+}
+
+/*
+Saves a copy of group g in the journal, if not saved already.
+RETURNS index of the group in the journal
+*/
+static u8 journal_group(
+    cfg_undo * u,
+    group * g
+){
+    for(u8 i = 0; i < u->saved_count; ++i)
+        if(u->saved[i] == g)
+            return i;
+
+    u->saved[u->saved_count] = g;
+    u->copies[u->saved_count] = alloc_group();
+    copy_group(u->copies[u->saved_count], g);
+    return u->saved_count++;
+}
+
+static bool journal_has_group(
+    const cfg_undo * u,
+    const group * g
+){
+    for(u8 i = 0; i < u->saved_count; ++i)
+        if(u->saved[i] == g)
+            return true;
+    return false;
+}
+
+/*
+Starts journaling the next play, of the player is_black at m (or PASS); which
+must then be made with just_play, just_play2, just_play3 or just_pass. The play
+can then be undone with cfg_board_undo, which must be done before the board is
+changed again by other means, or freed; plays journaled later must be undone
+first.
+*/
+void cfg_board_journal(
+    cfg_board * cb,
+    bool is_black,
+    move m,
+    cfg_undo * u
+){
+    assert(cb->undo == NULL);
+
+    u->m = m;
+    u->is_black = is_black;
+    u->last_eaten = cb->last_eaten;
+    u->last_played = cb->last_played;
+    u->saved_count = 0;
+    u->captures_count = 0;
+    u->freed_count = 0;
+    cb->undo = u;
+
+    if(m == PASS)
+        return;
+
+    assert(is_board_move(m));
+    assert(cb->p[m] == EMPTY);
+
+    u->unique_groups_count = cb->unique_groups_count;
+    memcpy(u->unique_groups, cb->unique_groups, cb->unique_groups_count *
+        sizeof(move));
+
+    /*
+    The play changes the groups adjacent to it; the neighbors of those of the
+    same color, as they are merged; and the neighbors of those captured.
+    */
+    for(u8 k = 0; k < neighbors_side[m].count; ++k)
+    {
+        group * n = cb->g[neighbors_side[m].coord[k]];
+        if(n != NULL)
+            journal_group(u, n);
+    }
+
+    u8 adjacent = u->saved_count;
+    for(u8 i = 0; i < adjacent; ++i)
+    {
+        group * n = u->saved[i];
+        if(n->is_black != is_black)
+        {
+            if(n->liberties > 1)
+                continue;
+            u->captures[u->captures_count++] = i;
+        }
+
+        for(u8 j = 0; j < n->neighbors_count; ++j)
+            journal_group(u, cb->g[n->neighbors[j]]);
+    }
+}
+
+/*
+Undoes a journaled play, restoring the board exactly as it was before it.
+*/
+void cfg_board_undo(
+    cfg_board * cb,
+    const cfg_undo * u
+){
+    assert(cb->undo == NULL);
+
+    cb->last_eaten = u->last_eaten;
+    cb->last_played = u->last_played;
+
+    if(u->m == PASS)
+        return;
+
+    move m = u->m;
+
+    /* the group created by the play, whether merged or not, is not saved */
+    if(!journal_has_group(u, cb->g[m]))
+        just_delloc_group(cb->g[m]);
+    for(u8 i = 0; i < u->freed_count; ++i)
+        if(!journal_has_group(u, u->freed[i]))
+            just_delloc_group(u->freed[i]);
+
+    cb->empty.coord[cb->empty.count] = cb->empty.coord[u->empty_idx];
+    cb->empty.coord[u->empty_idx] = m;
+    cb->empty.count++;
+
+    pos_set_free(cb, m, u->is_black);
+    cb->p[m] = EMPTY;
+    cb->g[m] = NULL;
+
+    for(u8 i = 0; i < u->captures_count; ++i)
+    {
+        const group * g = u->copies[u->captures[i]];
+        u8 own = g->is_black ? BLACK_STONE : WHITE_STONE;
+        for(move j = 0; j < g->stones.count; ++j)
+        {
+            move n = g->stones.coord[j];
+            cb->p[n] = own;
+            pos_set_occupied(cb, g->is_black, n);
+        }
+        cb->empty.count -= g->stones.count;
+    }
+
+    for(u8 i = 0; i < u->saved_count; ++i)
+    {
+        group * g = u->saved[i];
+        copy_group(g, u->copies[i]);
+        just_delloc_group(u->copies[i]);
+        for(move j = 0; j < g->stones.count; ++j)
+            cb->g[g->stones.coord[j]] = g;
+    }
+
+    cb->unique_groups_count = u->unique_groups_count;
+    memcpy(cb->unique_groups, u->unique_groups, u->unique_groups_count *
+        sizeof(move));
+    for(u8 i = 0; i < cb->unique_groups_count; ++i)
+        cb->g[cb->unique_groups[i]]->unique_groups_idx = i;
+
+    assert(verify_cfg_board(cb));
+}
+
 /*
 Apply a passing turn.
 */
@@ -667,6 +901,7 @@ void just_pass(
 ){
     cb->last_played = PASS;
     cb->last_eaten = NONE;
+    cb->undo = NULL;
 }
 
 /*
@@ -743,14 +978,8 @@ void just_play(
         cb->last_eaten = NONE;
     cb->last_played = m;
 
-    /* Remove position from list of empty intersections */
-    for(move k = 0; k < cb->empty.count; ++k)
-        if(cb->empty.coord[k] == m)
-        {
-            cb->empty.count--;
-            cb->empty.coord[k] = cb->empty.coord[cb->empty.count];
-            break;
-        }
+    remove_empty(cb, m);
+    cb->undo = NULL;
 }
 
 /*
@@ -830,29 +1059,23 @@ void just_play2(
         cb->last_eaten = NONE;
     cb->last_played = m;
 
-    /* Remove position from list of empty intersections */
-    for(move k = 0; k < cb->empty.count; ++k)
-        if(cb->empty.coord[k] == m)
-        {
-            cb->empty.count--;
-            cb->empty.coord[k] = cb->empty.coord[cb->empty.count];
-            break;
-        }
+    remove_empty(cb, m);
+    cb->undo = NULL;
 }
 
 /*
 Assume play is legal and update the structure, capturing accordingly. Also
-updates a stone difference and fills a matrix of captured stones and a bitmap of
-liberties of neighbors of the captured groups. Does NOT clear the matrix and
-bitmap.
+updates a stone difference, appends the stones captured to a list and fills a
+bitmap of liberties of neighbors of the captured groups. Does NOT clear the list
+and bitmap.
 */
 void just_play3(
     cfg_board * cb,
     bool is_black,
     move m,
     d16 * stone_difference,
-    bool stones_removed[TOTAL_BOARD_SIZ],
-    u8 rem_nei_libs[LIB_BITMAP_SIZ]
+    move_seq * stones_removed,
+    u64 rem_nei_libs[LIB_BITMAP_WORDS]
 ){
     assert(verify_cfg_board(cb));
     assert(is_board_move(m));
@@ -922,14 +1145,8 @@ void just_play3(
     d16 stone_diff = 1 + captures;
     *stone_difference += is_black ? stone_diff : -stone_diff;
 
-    /* Remove position from list of empty intersections */
-    for(move k = 0; k < cb->empty.count; ++k)
-        if(cb->empty.coord[k] == m)
-        {
-            cb->empty.count--;
-            cb->empty.coord[k] = cb->empty.coord[cb->empty.count];
-            break;
-        }
+    remove_empty(cb, m);
+    cb->undo = NULL;
     assert(verify_cfg_board(cb));
 }
 
@@ -938,10 +1155,10 @@ static void add_group_liberties(
     const group * restrict src
 ){
     u8 new_lib_count = 0;
-    for(u8 i = 0; i < LIB_BITMAP_SIZ; ++i)
+    for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
     {
         dst->ls[i] |= src->ls[i];
-        new_lib_count += active_bits_in_byte[dst->ls[i]];
+        new_lib_count += __builtin_popcountll(dst->ls[i]);
     }
     dst->liberties = new_lib_count;
 }
@@ -1018,6 +1235,51 @@ move get_ko_play(
     return NONE;
 }
 
+/*
+Classifies all empty intersections at once, by the counts of their neighbors
+alone and for both players. Marks in safe the intersections with at least two
+empty neighbors: they can't be eyes or in ko, and playing there is legal and
+leaves at least two liberties. The other empty intersections need group
+reasoning, with safe_to_play or libs_after_play.
+*/
+void cfg_classify_empty(
+    const cfg_board * cb,
+    u64 safe[LIB_BITMAP_WORDS]
+){
+    memset(safe, 0, LIB_BITMAP_WORDS * sizeof(u64));
+    move m = 0;
+
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i three = _mm256_set1_epi8(3);
+    for(; m + 32 <= TOTAL_BOARD_SIZ; m += 32)
+    {
+        __m256i empty = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)
+            (cb->p + m)), zero);
+        __m256i stones = _mm256_add_epi8(_mm256_loadu_si256((const __m256i *)
+            (cb->black_neighbors4 + m)), _mm256_loadu_si256((const __m256i *)
+            (cb->white_neighbors4 + m)));
+        __m256i occupied = _mm256_add_epi8(stones, _mm256_loadu_si256(
+            (const __m256i *)(out_neighbors4 + m)));
+
+        u32 s = (u32)_mm256_movemask_epi8(_mm256_and_si256(empty,
+            _mm256_cmpgt_epi8(three, occupied)));
+        /* m is a multiple of 32, so the 32 bits are in the same word */
+        safe[m / 64] |= ((u64)s) << (m % 64);
+    }
+#endif
+
+    for(; m < TOTAL_BOARD_SIZ; ++m)
+    {
+        if(cb->p[m] != EMPTY)
+            continue;
+
+        u8 stones = cb->black_neighbors4[m] + cb->white_neighbors4[m];
+        if(stones + out_neighbors4[m] < 3)
+            safe[m / 64] |= LIB_BIT(m);
+    }
+}
+
 /*
 Calculates the liberties after playing and the number of stones captured.
 Does not test ko.
@@ -1043,8 +1305,7 @@ u8 libs_after_play(
     /* warning: some fields are not initialized because they're not used */
     group g;
     g.liberties = 0;
-    g.liberties_min_coord = TOTAL_BOARD_SIZ;
-    memset(g.ls, 0, LIB_BITMAP_SIZ);
+    memset(g.ls, 0, sizeof(g.ls));
     add_liberty_unchecked(&g, m);
 
     /* list of same color neighbors */
@@ -1133,11 +1394,11 @@ u8 libs_after_play(
     /*
     Backup neighbor groups before being modified
     */
-    u8 neighbor_bak_ls[4][LIB_BITMAP_SIZ];
+    u64 neighbor_bak_ls[4][LIB_BITMAP_WORDS];
     u8 neighbor_bak_libs[4];
     for(u8 k = 0; k < neighbors_n; ++k)
     {
-        memcpy(neighbor_bak_ls[k], neighbors[k]->ls, LIB_BITMAP_SIZ);
+        memcpy(neighbor_bak_ls[k], neighbors[k]->ls, sizeof(neighbors[k]->ls));
         neighbor_bak_libs[k] = neighbors[k]->liberties;
     }
 
@@ -1234,7 +1495,7 @@ u8 libs_after_play(
     for(u8 k = 0; k < neighbors_n; ++k)
     {
         add_group_liberties(&g, neighbors[k]);
-        memcpy(neighbors[k]->ls, neighbor_bak_ls[k], LIB_BITMAP_SIZ);
+        memcpy(neighbors[k]->ls, neighbor_bak_ls[k], sizeof(neighbors[k]->ls));
         neighbors[k]->liberties = neighbor_bak_libs[k];
     }
 
@@ -1270,8 +1531,7 @@ u8 safe_to_play2(
     /* warning: some fields are not initialized because they're not used */
     group g;
     g.liberties = 0;
-    g.liberties_min_coord = TOTAL_BOARD_SIZ;
-    memset(g.ls, 0, LIB_BITMAP_SIZ);
+    memset(g.ls, 0, sizeof(g.ls));
     add_liberty_unchecked(&g, m);
 
     u8 probable_libs = 0;
@@ -1456,8 +1716,7 @@ u8 safe_to_play(
     /* warning: some fields are not initialized because they're not used */
     group g;
     g.liberties = 0;
-    g.liberties_min_coord = TOTAL_BOARD_SIZ;
-    memset(g.ls, 0, LIB_BITMAP_SIZ);
+    memset(g.ls, 0, sizeof(g.ls));
     add_liberty_unchecked(&g, m);
 
     u8 probable_libs = 0;
@@ -1857,6 +2116,86 @@ void cfg_board_free(
         just_delloc_group(cb->g[cb->unique_groups[i]]);
 }
 
+static int compare_chunks(
+    const void * a,
+    const void * b
+){
+    uintptr_t x = (uintptr_t)*((group * const *)a);
+    uintptr_t y = (uintptr_t)*((group * const *)b);
+    return (x > y) - (x < y);
+}
+
+/*
+RETURNS the index of the chunk of a group, in pool_chunks sorted by address
+*/
+static u32 chunk_of(
+    const group * g
+){
+    u32 lo = 0;
+    u32 hi = pool_chunks_count - 1;
+    while(lo < hi)
+    {
+        u32 mid = (lo + hi + 1) / 2;
+        if((uintptr_t)pool_chunks[mid] <= (uintptr_t)g)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+/*
+Returns to the system the chunks of groups whose groups are all in the lists of
+free groups of the threads of a parallel region, removing them from the lists.
+Chunks with groups in use, or kept by threads outside of the region, are kept.
+Must not be called while boards are being used by other threads.
+RETURNS number of bytes freed
+*/
+u64 cfg_board_trim_pool()
+{
+    if(pool_chunks_count == 0)
+        return 0;
+
+    qsort(pool_chunks, pool_chunks_count, sizeof(group *), compare_chunks);
+    u8 * listed = (u8 *)calloc(pool_chunks_count, sizeof(u8));
+    if(listed == NULL)
+        flog_crit("cfg", "system out of memory");
+
+    #pragma omp parallel
+    {
+        for(group * g = saved_nodes; g != NULL; g = g->next)
+        {
+            u32 i = chunk_of(g);
+            #pragma omp atomic
+            listed[i]++;
+        }
+
+        #pragma omp barrier
+
+        group ** link = &saved_nodes;
+        while(*link != NULL)
+            if(listed[chunk_of(*link)] == GROUP_POOL_CHUNK)
+                *link = (*link)->next;
+            else
+                link = &(*link)->next;
+    }
+
+    u32 kept = 0;
+    for(u32 i = 0; i < pool_chunks_count; ++i)
+        if(listed[i] == GROUP_POOL_CHUNK)
+            free(pool_chunks[i]);
+        else
+            pool_chunks[kept++] = pool_chunks[i];
+
+    u64 freed = ((u64)(pool_chunks_count - kept)) * sizeof(group) *
+        GROUP_POOL_CHUNK;
+    pool_chunks_count = kept;
+    free(listed);
+
+    mem_usage_add(MEM_GROUPS, -((d64)freed));
+    return freed;
+}
+
 /*
 Print structure information for debugging.
 */
@@ -2008,14 +2347,6 @@ bool verify_cfg_board(
                 return false;
             }
 
-            if(g->liberties > 0 && g->liberties_min_coord >= BOARD_SIZ *
-                BOARD_SIZ)
-            {
-                fprintf(stderr,
-                    "error: verify_cfg_board: illegal value of 1st liberty\n");
-                return false;
-            }
-
             if(g->stones.count == 0)
             {
                 fprintf(stderr,
@@ -2101,6 +2432,14 @@ bool verify_cfg_board(
             return false;
         }
 
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+        if(PAT12_CODE(cb, m) != pat12_from_board(cb->p, m))
+        {
+            fprintf(stderr,
+                "error: verify_cfg_board: 12-point pattern mismatch\n");
+            return false;
+        }
+
     return true;
 }
 
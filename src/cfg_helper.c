@@ -26,7 +26,6 @@ extern bool border_left[TOTAL_BOARD_SIZ];
 extern bool border_right[TOTAL_BOARD_SIZ];
 extern bool border_top[TOTAL_BOARD_SIZ];
 extern bool border_bottom[TOTAL_BOARD_SIZ];
-extern u8 active_bits_in_byte[256];
 
 
 /*
@@ -38,15 +37,9 @@ move get_1st_liberty(
 ){
     assert(g->liberties > 0);
 
-    for(u8 i = 0; i < LIB_BITMAP_SIZ; ++i)
+    for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
         if(g->ls[i])
-        {
-            u8 j;
-            for(j = 0; j < 7; ++j)
-                if(g->ls[i] & (1 << j))
-                    break;
-            return i * 8 + j;
-        }
+            return i * 64 + __builtin_ctzll(g->ls[i]);
 
     flog_crit("cfg", "CFG group has no liberties");
     exit(EXIT_FAILURE); /* this is unnecessary but mutes erroneous complaints */
@@ -63,14 +56,20 @@ move get_next_liberty(
     move start /* exclusive */
 ){
     ++start;
-    for(move m = start; m < TOTAL_BOARD_SIZ; ++m)
+    if(start >= TOTAL_BOARD_SIZ)
+        return NONE;
+
+    /* clear the bits before start in its word */
+    u8 i = start / 64;
+    u64 w = g->ls[i] & ~(LIB_BIT(start) - 1);
+    while(w == 0)
     {
-        u8 mask = (1 << (m % 8));
-        if(g->ls[m / 8] & mask)
-            return m;
+        if(++i == LIB_BITMAP_WORDS)
+            return NONE;
+        w = g->ls[i];
     }
 
-    return NONE;
+    return i * 64 + __builtin_ctzll(w);
 }
 
 
@@ -204,7 +203,7 @@ bool groups_same_liberties(
     const group * restrict g1,
     const group * restrict g2
 ){
-    return memcmp(g1->ls, g2->ls, LIB_BITMAP_SIZ) == 0;
+    return memcmp(g1->ls, g2->ls, sizeof(g1->ls)) == 0;
 }
 
 /*
@@ -215,7 +214,7 @@ bool groups_share_liberties(
     const group * restrict g1,
     const group * restrict g2
 ){
-    for(u8 i = 0; i < LIB_BITMAP_SIZ; ++i)
+    for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
         if((g1->ls[i] & g2->ls[i]) > 0)
             return true;
     return false;
@@ -230,7 +229,7 @@ u8 groups_shared_liberties(
     const group * restrict g2
 ){
     u8 ret = 0;
-    for(u8 i = 0; i < LIB_BITMAP_SIZ; ++i)
-        ret += active_bits_in_byte[g1->ls[i] & g2->ls[i]];
+    for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
+        ret += __builtin_popcountll(g1->ls[i] & g2->ls[i]);
     return ret;
 }
@@ -0,0 +1,658 @@
+/*
+Cluster search: several Matilda processes, usually in different machines,
+searching the same position at the same time, for root parallelization beyond
+the cores and memory of one machine.
+
+One process, the coordinator, plays; the others are workers started with
+--cluster_worker, listening on a TCP port. When the coordinator starts a timed
+search it sends the position to the workers, that search it with their own
+seeds, threads and transpositions tables until told to stop. Every
+CLUSTER_EXCHANGE_INTERVAL milliseconds the workers report the statistics of the
+plays of their root, and the visits made since their previous report are merged
+into the root of the coordinator; so its time management and the play chosen
+from its out_board take all of them into account. Only the root is shared; the
+deeper trees of each process are independent.
+
+The protocol is line based, with the plays as internal coordinates. From the
+coordinator:
+
+search <id> <seed> <b|w> <komi> <dynamic komi> <milliseconds> <points> <last
+    played> <last eaten>
+stop <id>
+
+And from the workers, the first report of a search, right as it starts, being
+the base from which the visits of the following ones are counted:
+
+stats <id> <final 0|1> <count> [<play> <visits> <quality>]...
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "alloc.h"
+#include "board.h"
+#include "cluster.h"
+#include "engine.h"
+#include "flog.h"
+#include "mcts.h"
+#include "randg.h"
+#include "timem.h"
+#include "types.h"
+
+/* the longest report has less than 24 characters per play */
+#define CLUSTER_LINE_SIZ (16 * 1024)
+
+/*
+Milliseconds between the tests of the workers for the coordinator asking them to
+stop searching.
+*/
+#define STOP_POLL_INTERVAL 5
+
+/* index of the statistics of a play, PASS included */
+#define PLAY_IDX(M) ((M) == PASS ? TOTAL_BOARD_SIZ : (M))
+
+extern d16 komi;
+extern d16 dynamic_komi;
+
+/*
+Connection with the input received and not yet consumed.
+*/
+typedef struct __cluster_conn_ {
+    int fd; /* -1 if closed */
+    u32 len;
+    char in[CLUSTER_LINE_SIZ];
+} cluster_conn;
+
+/*
+Worker, as seen by the coordinator, with the last statistics it reported of its
+root, by play.
+*/
+typedef struct __remote_worker_ {
+    cluster_conn conn;
+    char address[256];
+    bool searching; /* the final report was not received yet */
+    bool has_base; /* the first report was received */
+    u32 visits[TOTAL_BOARD_SIZ + 1];
+    float quality[TOTAL_BOARD_SIZ + 1];
+} remote_worker;
+
+static char in_line[CLUSTER_LINE_SIZ];
+static char out_line[CLUSTER_LINE_SIZ];
+
+/* coordinator state */
+static remote_worker * workers[CLUSTER_MAX_WORKERS];
+static u16 workers_count = 0;
+static u32 search_id = 0;
+static u32 search_merged_visits;
+
+/* worker state */
+static cluster_conn coordinator;
+static u32 coordinator_search_id;
+static u64 next_report;
+
+
+/*
+Extracts the next complete line of a connection, without the line break, to
+dst; reading from it, waiting at most timeout milliseconds (-1 for no limit) for
+more input while there is no complete line.
+RETURNS 1 if a line was read, 0 if there is none yet, -1 if the connection was
+closed or failed
+*/
+static d8 read_line(
+    cluster_conn * c,
+    char * dst,
+    int timeout
+){
+    while(1)
+    {
+        char * nl = memchr(c->in, '\n', c->len);
+        if(nl != NULL)
+        {
+            u32 l = nl - c->in;
+            memcpy(dst, c->in, l);
+            dst[l] = 0;
+            c->len -= l + 1;
+            memmove(c->in, nl + 1, c->len);
+            return 1;
+        }
+
+        if(c->len == CLUSTER_LINE_SIZ)
+            return -1;
+
+        struct pollfd pfd;
+        pfd.fd = c->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int r = poll(&pfd, 1, timeout);
+        if(r == 0)
+            return 0;
+        if(r < 0)
+            return -1;
+
+        ssize_t n = recv(c->fd, c->in + c->len, CLUSTER_LINE_SIZ - c->len, 0);
+        if(n <= 0)
+            return -1;
+        c->len += n;
+    }
+}
+
+/*
+RETURNS true if all of line was sent
+*/
+static bool send_line(
+    int fd,
+    const char * line
+){
+    size_t len = strlen(line);
+    size_t sent = 0;
+    while(sent < len)
+    {
+        ssize_t n = send(fd, line + sent, len - sent, MSG_NOSIGNAL);
+        if(n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+static void set_no_delay(
+    int fd
+){
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/*
+RETURNS the socket connected to the host and port, or -1 on failure
+*/
+static int connect_to(
+    const char * host,
+    const char * port
+){
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo * res;
+    if(getaddrinfo(host, port, &hints, &res) != 0)
+        return -1;
+
+    int fd = -1;
+    for(struct addrinfo * a = res; a != NULL; a = a->ai_next)
+    {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if(fd == -1)
+            continue;
+        if(connect(fd, a->ai_addr, a->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if(fd != -1)
+        set_no_delay(fd);
+    return fd;
+}
+
+/*
+Connects to the workers listed, as comma separated host:port addresses, that
+will search with the following timed searches. Workers that can't be reached
+are ignored, with a warning.
+RETURNS number of workers connected
+*/
+u16 cluster_connect(
+    const char * addresses
+){
+    char * buf = alloc();
+    char * s = alloc();
+    snprintf(buf, MAX_PAGE_SIZ, "%s", addresses);
+
+    char * saveptr;
+    for(char * addr = strtok_r(buf, ",", &saveptr); addr != NULL; addr =
+        strtok_r(NULL, ",", &saveptr))
+    {
+        if(workers_count == CLUSTER_MAX_WORKERS)
+        {
+            flog_warn("clst", "too many cluster workers; ignoring the rest");
+            break;
+        }
+
+        char * sep = strrchr(addr, ':');
+        if(sep == NULL || sep == addr || sep[1] == 0 || strlen(addr) >= 256)
+        {
+            snprintf(s, MAX_PAGE_SIZ, "illegal worker address %s", addr);
+            flog_warn("clst", s);
+            continue;
+        }
+
+        *sep = 0;
+        int fd = connect_to(addr, sep + 1);
+        *sep = ':';
+        if(fd == -1)
+        {
+            snprintf(s, MAX_PAGE_SIZ, "could not connect to worker %s", addr);
+            flog_warn("clst", s);
+            continue;
+        }
+
+        remote_worker * w = malloc(sizeof(remote_worker));
+        if(w == NULL)
+            flog_crit("clst", "system out of memory");
+
+        w->conn.fd = fd;
+        w->conn.len = 0;
+        snprintf(w->address, 256, "%s", addr);
+        w->searching = false;
+        workers[workers_count++] = w;
+
+        snprintf(s, MAX_PAGE_SIZ, "connected to worker %s", addr);
+        flog_info("clst", s);
+    }
+
+    release(s);
+    release(buf);
+    return workers_count;
+}
+
+static void drop_worker(
+    remote_worker * w
+){
+    close(w->conn.fd);
+    w->conn.fd = -1;
+    w->searching = false;
+
+    char * s = alloc();
+    snprintf(s, MAX_PAGE_SIZ, "lost connection to worker %s", w->address);
+    flog_warn("clst", s);
+    release(s);
+}
+
+/*
+Parses a report of a worker of the current search, adding the visits made since
+its previous report, and the sum of their qualities, to n and w.
+*/
+static void merge_report(
+    remote_worker * wk,
+    const char * line,
+    u32 n[TOTAL_BOARD_SIZ + 1],
+    double w[TOTAL_BOARD_SIZ + 1]
+){
+    u32 id;
+    u32 final;
+    u32 count;
+    int off;
+    if(sscanf(line, "stats %u %u %u%n", &id, &final, &count, &off) != 3 ||
+        count > TOTAL_BOARD_SIZ + 1)
+    {
+        flog_warn("clst", "illegal report from worker");
+        return;
+    }
+    if(id != search_id)
+        return;
+
+    const char * s = line + off;
+    for(u32 i = 0; i < count; ++i)
+    {
+        u32 m;
+        u32 visits;
+        float quality;
+        if(sscanf(s, "%u %u %f%n", &m, &visits, &quality, &off) != 3 || (m >=
+            TOTAL_BOARD_SIZ && m != PASS))
+        {
+            flog_warn("clst", "illegal report from worker");
+            break;
+        }
+        s += off;
+
+        u16 idx = PLAY_IDX(m);
+        if(wk->has_base && visits > wk->visits[idx])
+        {
+            n[idx] += visits - wk->visits[idx];
+            w[idx] += ((double)quality) * visits - ((double)wk->quality[idx]) *
+                wk->visits[idx];
+        }
+        wk->visits[idx] = visits;
+        wk->quality[idx] = quality;
+    }
+
+    wk->has_base = true;
+    if(final)
+        wk->searching = false;
+}
+
+/*
+Exchange function of the coordinator: merges the visits the workers reported
+since the last call and, when the search ends, stops the workers and waits for
+their last reports.
+*/
+static bool coordinator_exchange(
+    const root_stats * own,
+    root_stats * merged,
+    bool final
+){
+    (void)own;
+    u32 n[TOTAL_BOARD_SIZ + 1];
+    double w[TOTAL_BOARD_SIZ + 1];
+    memset(n, 0, sizeof(n));
+    memset(w, 0, sizeof(w));
+
+    if(final)
+    {
+        snprintf(out_line, CLUSTER_LINE_SIZ, "stop %u\n", search_id);
+        for(u16 i = 0; i < workers_count; ++i)
+            if(workers[i]->searching && !send_line(workers[i]->conn.fd,
+                out_line))
+                drop_worker(workers[i]);
+    }
+
+    u64 deadline = current_time_in_millis() + CLUSTER_FINAL_WAIT;
+    for(u16 i = 0; i < workers_count; ++i)
+    {
+        remote_worker * wk = workers[i];
+        while(wk->searching)
+        {
+            int timeout = 0;
+            if(final)
+            {
+                u64 now = current_time_in_millis();
+                timeout = now < deadline ? (int)(deadline - now) : 0;
+            }
+
+            d8 r = read_line(&wk->conn, in_line, timeout);
+            if(r == -1)
+                drop_worker(wk);
+            if(r != 1)
+                break;
+            merge_report(wk, in_line, n, w);
+        }
+
+        if(final && wk->searching)
+        {
+            wk->searching = false;
+            char * s = alloc();
+            snprintf(s, MAX_PAGE_SIZ, "worker %s did not report in time",
+                wk->address);
+            flog_warn("clst", s);
+            release(s);
+        }
+    }
+
+    merged->count = 0;
+    for(u16 idx = 0; idx < TOTAL_BOARD_SIZ + 1; ++idx)
+        if(n[idx] > 0)
+        {
+            search_merged_visits += n[idx];
+            double q = w[idx] / n[idx];
+            merged->m[merged->count] = idx == TOTAL_BOARD_SIZ ? PASS : idx;
+            merged->visits[merged->count] = n[idx];
+            merged->quality[merged->count] = MAX(0.0, MIN(1.0, q));
+            merged->count++;
+        }
+
+    if(final)
+    {
+        mcts_set_root_exchange(0, NULL);
+        char * s = alloc();
+        snprintf(s, MAX_PAGE_SIZ, "merged %u visits of the cluster workers",
+            search_merged_visits);
+        flog_info("clst", s);
+        release(s);
+    }
+    return false;
+}
+
+/*
+Starts the search of board b, by is_black, by the workers connected, until at
+most max_stop_time; they are stopped when the next timed search, of the same
+position, ends, and their statistics merged into its root. Does nothing if
+there are no workers.
+*/
+void cluster_search_start(
+    const board * b,
+    bool is_black,
+    u64 max_stop_time
+){
+    if(workers_count == 0)
+        return;
+
+    ++search_id;
+    u64 now = current_time_in_millis();
+    u64 time_available = max_stop_time > now ? max_stop_time - now : 0;
+
+    char points[TOTAL_BOARD_SIZ + 1];
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+        points[m] = '0' + b->p[m];
+    points[TOTAL_BOARD_SIZ] = 0;
+
+    u32 seed = (u32)current_nanoseconds();
+    bool searching = false;
+    for(u16 i = 0; i < workers_count; ++i)
+    {
+        remote_worker * w = workers[i];
+        if(w->conn.fd == -1)
+            continue;
+
+        /* odd multiplier, so the seeds are all different */
+        snprintf(out_line, CLUSTER_LINE_SIZ, "search %u %u %c %d %d %lu %s %u \
+%u\n", search_id, seed + (i + 1) * 2654435761U, is_black ? 'b' : 'w', komi,
+            dynamic_komi, (unsigned long)time_available, points, b->last_played,
+            b->last_eaten);
+        if(!send_line(w->conn.fd, out_line))
+        {
+            drop_worker(w);
+            continue;
+        }
+
+        w->searching = true;
+        w->has_base = false;
+        memset(w->visits, 0, sizeof(w->visits));
+        searching = true;
+    }
+
+    search_merged_visits = 0;
+
+    if(searching)
+        mcts_set_root_exchange(CLUSTER_EXCHANGE_INTERVAL, coordinator_exchange);
+}
+
+/*
+Exchange function of the workers: reports the statistics of the root, every
+CLUSTER_EXCHANGE_INTERVAL milliseconds and when the search starts and ends, and
+stops the search when asked to.
+*/
+static bool worker_exchange(
+    const root_stats * own,
+    root_stats * merged,
+    bool final
+){
+    (void)merged;
+    if(coordinator.fd == -1)
+        return true;
+
+    u64 now = current_time_in_millis();
+    if(final || now >= next_report)
+    {
+        next_report = now + CLUSTER_EXCHANGE_INTERVAL;
+
+        u32 idx = snprintf(out_line, CLUSTER_LINE_SIZ, "stats %u %u %u",
+            coordinator_search_id, final ? 1 : 0, own->count);
+        for(u16 i = 0; i < own->count; ++i)
+            idx += snprintf(out_line + idx, CLUSTER_LINE_SIZ - idx, " %u %u \
+%.5f", own->m[i], own->visits[i], own->quality[i]);
+        snprintf(out_line + idx, CLUSTER_LINE_SIZ - idx, "\n");
+
+        if(!send_line(coordinator.fd, out_line))
+        {
+            close(coordinator.fd);
+            coordinator.fd = -1;
+            return true;
+        }
+    }
+
+    if(final)
+        return false;
+
+    char * expected = alloc();
+    snprintf(expected, MAX_PAGE_SIZ, "stop %u", coordinator_search_id);
+    bool stop = false;
+    while(!stop)
+    {
+        d8 r = read_line(&coordinator, in_line, 0);
+        if(r == -1)
+        {
+            close(coordinator.fd);
+            coordinator.fd = -1;
+            stop = true;
+        }
+        if(r != 1)
+            break;
+        stop = strcmp(in_line, expected) == 0;
+    }
+    release(expected);
+    return stop;
+}
+
+/*
+Searches the position of a search request of the coordinator.
+*/
+static void worker_search(
+    const char * line
+){
+    u32 id;
+    u32 seed;
+    char color;
+    int k;
+    int dk;
+    unsigned long time_available;
+    u32 last_played;
+    u32 last_eaten;
+    int off;
+
+    bool ok = sscanf(line, "search %u %u %c %d %d %lu %n", &id, &seed, &color,
+        &k, &dk, &time_available, &off) == 6 && (color == 'b' || color == 'w');
+
+    board b;
+    for(move m = 0; ok && m < TOTAL_BOARD_SIZ; ++m)
+    {
+        char c = line[off + m];
+        if(c < '0' + EMPTY || c > '0' + WHITE_STONE)
+            ok = false;
+        b.p[m] = c - '0';
+    }
+
+    ok = ok && sscanf(line + off + TOTAL_BOARD_SIZ, " %u %u", &last_played,
+        &last_eaten) == 2 && last_played <= PASS && last_eaten <= PASS;
+    if(!ok)
+    {
+        flog_warn("clst", "illegal search request from coordinator");
+        return;
+    }
+
+    b.last_played = last_played;
+    b.last_eaten = last_eaten;
+    komi = k;
+    dynamic_komi = dk;
+    rand_seed(seed);
+    coordinator_search_id = id;
+    bool is_black = color == 'b';
+
+    opt_turn_maintenance(&b, is_black);
+
+    /* the coordinator manages the time; it stops the search */
+    u64 stop_time = current_time_in_millis() + time_available;
+    next_report = 0;
+    out_board out_b;
+    mcts_set_root_exchange(STOP_POLL_INTERVAL, worker_exchange);
+    evaluate_position_timed(&b, is_black, &out_b, stop_time, stop_time,
+        stop_time);
+    mcts_set_root_exchange(0, NULL);
+}
+
+/*
+Main function for the cluster worker mode: listens on a TCP port for a
+coordinator, and searches the positions it sends, one connection at a time.
+Does not return.
+*/
+void cluster_worker(
+    u16 port
+){
+    /* the coordinator consults its opening books before searching */
+    set_use_of_opening_book(false);
+
+    char * s = alloc();
+    snprintf(s, MAX_PAGE_SIZ, "%u", port);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    struct addrinfo * res;
+    if(getaddrinfo(NULL, s, &hints, &res) != 0)
+        flog_crit("clst", "could not resolve the worker address");
+
+    int listen_fd = -1;
+    for(struct addrinfo * a = res; a != NULL; a = a->ai_next)
+    {
+        listen_fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if(listen_fd == -1)
+            continue;
+
+        int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if(bind(listen_fd, a->ai_addr, a->ai_addrlen) == 0 && listen(listen_fd,
+            1) == 0)
+            break;
+        close(listen_fd);
+        listen_fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if(listen_fd == -1)
+        flog_crit("clst", "could not listen on the worker port");
+
+    snprintf(s, MAX_PAGE_SIZ, "cluster worker listening on port %u", port);
+    flog_info("clst", s);
+
+    while(1)
+    {
+        coordinator.fd = accept(listen_fd, NULL, NULL);
+        if(coordinator.fd == -1)
+            continue;
+
+        set_no_delay(coordinator.fd);
+        coordinator.len = 0;
+        flog_info("clst", "coordinator connected");
+
+        while(coordinator.fd != -1)
+        {
+            d8 r = read_line(&coordinator, in_line, -1);
+            if(r != 1)
+            {
+                close(coordinator.fd);
+                coordinator.fd = -1;
+                break;
+            }
+
+            if(strncmp(in_line, "search ", 7) == 0)
+                worker_search(in_line);
+            else if(strncmp(in_line, "stop ", 5) != 0)
+                flog_warn("clst", "unknown request from coordinator");
+        }
+
+        flog_info("clst", "coordinator disconnected");
+    }
+}
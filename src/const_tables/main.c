@@ -0,0 +1,311 @@
+/*
+Generate the tables of constants that depend only on the board size, that are
+otherwise computed at startup, as C source files: gen/constant_tables.c and
+gen/constant_tables.h. Should be run from the src/ directory, after which
+Matilda must be compiled again.
+
+The tables are only used if they were generated for the board size in use.
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+
+#include "alloc.h"
+#include "board.h"
+#include "constants.h"
+#include "flog.h"
+#include "move.h"
+#include "types.h"
+#include "zobrist.h"
+
+
+extern u8 out_neighbors8[TOTAL_BOARD_SIZ];
+extern u8 out_neighbors4[TOTAL_BOARD_SIZ];
+extern move_seq neighbors_side[TOTAL_BOARD_SIZ];
+extern move_seq neighbors_diag[TOTAL_BOARD_SIZ];
+extern move_seq neighbors_3x3[TOTAL_BOARD_SIZ];
+extern bool border_left[TOTAL_BOARD_SIZ];
+extern bool border_right[TOTAL_BOARD_SIZ];
+extern bool border_top[TOTAL_BOARD_SIZ];
+extern bool border_bottom[TOTAL_BOARD_SIZ];
+extern u8 distances_to_border[TOTAL_BOARD_SIZ];
+extern move_seq nei_dst_3[TOTAL_BOARD_SIZ];
+extern move_seq nei_dst_4[TOTAL_BOARD_SIZ];
+extern bool black_eye[65536];
+extern bool white_eye[65536];
+extern u8 black_eye_shapes[65536];
+extern u8 white_eye_shapes[65536];
+
+extern u16 iv_3x3[TOTAL_BOARD_SIZ][TOTAL_BOARD_SIZ][3];
+extern u16 initial_3x3_hash[TOTAL_BOARD_SIZ];
+extern move far_neighbors[TOTAL_BOARD_SIZ][4];
+extern u8 far_shifts[TOTAL_BOARD_SIZ][4];
+extern u8 far_neighbors_count[TOTAL_BOARD_SIZ];
+extern u8 initial_far_hash[TOTAL_BOARD_SIZ];
+
+
+#define GEN_DIRNAME "gen"
+#define HEADER_FILENAME GEN_DIRNAME "/constant_tables.h"
+#define SOURCE_FILENAME GEN_DIRNAME "/constant_tables.c"
+
+static FILE * fp;
+static u16 column;
+
+/*
+Writes a token of an initializer, wrapping the lines at 80 columns.
+*/
+static void write_token(
+    const char * token
+){
+    u16 len = strlen(token);
+    if(column + len + 1 > 80)
+    {
+        fprintf(fp, "\n   ");
+        column = 3;
+    }
+    fprintf(fp, " %s", token);
+    column += len + 1;
+}
+
+static void write_value(
+    u32 value,
+    bool last
+){
+    char buf[16];
+    snprintf(buf, 16, last ? "%u" : "%u,", value);
+    write_token(buf);
+}
+
+static void start_table(
+    const char * declaration
+){
+    fprintf(fp, "%s =\n{", declaration);
+    column = 1;
+}
+
+static void end_table()
+{
+    fprintf(fp, "\n};\n\n");
+}
+
+static void write_u8_table(
+    const char * declaration,
+    const u8 * values,
+    u32 count
+){
+    start_table(declaration);
+    for(u32 i = 0; i < count; ++i)
+        write_value(values[i], i + 1 == count);
+    end_table();
+}
+
+static void write_u16_table(
+    const char * declaration,
+    const u16 * values,
+    u32 count
+){
+    start_table(declaration);
+    for(u32 i = 0; i < count; ++i)
+        write_value(values[i], i + 1 == count);
+    end_table();
+}
+
+/*
+Only the true positions are written.
+*/
+static void write_bool_table(
+    const char * declaration,
+    const bool * values,
+    u32 count
+){
+    char buf[32];
+    start_table(declaration);
+    for(u32 i = 0; i < count; ++i)
+        if(values[i])
+        {
+            snprintf(buf, 32, "[%u] = true,", i);
+            write_token(buf);
+        }
+    end_table();
+}
+
+static void write_move_seq_table(
+    const char * declaration,
+    const move_seq * values
+){
+    start_table(declaration);
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+    {
+        const move_seq * s = &values[m];
+        write_token("{");
+        if(s->count == 0)
+            write_token("0");
+        else
+        {
+            write_value(s->count, false);
+            write_token("{");
+            for(move k = 0; k < s->count; ++k)
+                write_value(s->coord[k], k + 1 == s->count);
+            write_token("}");
+        }
+        write_token(m + 1 == TOTAL_BOARD_SIZ ? "}" : "},");
+    }
+    end_table();
+}
+
+static void write_far_tables()
+{
+    start_table("move far_neighbors[TOTAL_BOARD_SIZ][4]");
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+    {
+        write_token("{");
+        for(u8 k = 0; k < 4; ++k)
+            write_value(far_neighbors[m][k], k == 3);
+        write_token(m + 1 == TOTAL_BOARD_SIZ ? "}" : "},");
+    }
+    end_table();
+
+    start_table("u8 far_shifts[TOTAL_BOARD_SIZ][4]");
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+    {
+        write_token("{");
+        for(u8 k = 0; k < 4; ++k)
+            write_value(far_shifts[m][k], k == 3);
+        write_token(m + 1 == TOTAL_BOARD_SIZ ? "}" : "},");
+    }
+    end_table();
+}
+
+/*
+Only the nonzero entries are written.
+*/
+static void write_iv_3x3_table()
+{
+    char buf[64];
+    start_table("u16 iv_3x3[TOTAL_BOARD_SIZ][TOTAL_BOARD_SIZ][3]");
+    for(move a = 0; a < TOTAL_BOARD_SIZ; ++a)
+        for(move b = 0; b < TOTAL_BOARD_SIZ; ++b)
+        {
+            const u16 * v = iv_3x3[a][b];
+            if(v[0] == 0 && v[1] == 0 && v[2] == 0)
+                continue;
+            snprintf(buf, 64, "[%u][%u] = { %u, %u, %u },", a, b, v[0], v[1],
+                v[2]);
+            write_token(buf);
+        }
+    end_table();
+}
+
+static void open_file(
+    const char * filename
+){
+    fp = fopen(filename, "w");
+    if(fp == NULL)
+    {
+        fprintf(stderr, "error: couldn't open %s for writing\n", filename);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void close_file()
+{
+    if(ferror(fp))
+    {
+        fprintf(stderr, "error: write failed\n");
+        exit(EXIT_FAILURE);
+    }
+    fclose(fp);
+}
+
+int main(
+    int argc,
+    char * argv[]
+){
+    if(argc > 1)
+    {
+        printf("Usage: %s\n", argv[0]);
+        printf("Writes %s and %s for %ux%u, in the current directory.\n",
+            SOURCE_FILENAME, HEADER_FILENAME, BOARD_SIZ, BOARD_SIZ);
+        exit(EXIT_SUCCESS);
+    }
+
+    alloc_init();
+    flog_config_modes(LOG_MODE_ERROR | LOG_MODE_WARN);
+    flog_config_destinations(LOG_DEST_STDF);
+
+    board_constants_compute();
+    zobrist_tables_compute();
+
+    if(mkdir(GEN_DIRNAME, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "error: couldn't create %s\n", GEN_DIRNAME);
+        exit(EXIT_FAILURE);
+    }
+
+    open_file(HEADER_FILENAME);
+    fprintf(fp, "/*\nBoard size that the tables of constant_tables.c were \
+generated for, by\ngen_constant_tables. Found before inc/constant_tables.h, \
+as gen/ is searched\nfirst. If it is not the board size in use the tables \
+are computed at startup\ninstead.\n\nThis file is overwritten by \
+gen_constant_tables.\n*/\n\n#ifndef MATILDA_CONSTANT_TABLES_H\n#define \
+MATILDA_CONSTANT_TABLES_H\n\n#define CONSTANT_TABLES_SIZ %u\n\n#endif\n",
+        BOARD_SIZ);
+    close_file();
+
+    open_file(SOURCE_FILENAME);
+    fprintf(fp, "/*\nTables of constants that depend only on the board size, \
+already initialized,\nfor the board size CONSTANT_TABLES_SIZ. Used instead of \
+computing them at\nstartup if it is the board size in use.\n\nThis file is \
+overwritten by gen_constant_tables.\n*/\n\n#include \"config.h\"\n\n#include \
+\"constant_tables.h\"\n#include \"move.h\"\n#include \"types.h\"\n\n#if \
+CONSTANT_TABLES_SIZ == BOARD_SIZ\n\n");
+
+    write_u8_table("u8 out_neighbors8[TOTAL_BOARD_SIZ]", out_neighbors8,
+        TOTAL_BOARD_SIZ);
+    write_u8_table("u8 out_neighbors4[TOTAL_BOARD_SIZ]", out_neighbors4,
+        TOTAL_BOARD_SIZ);
+    write_move_seq_table("move_seq neighbors_side[TOTAL_BOARD_SIZ]",
+        neighbors_side);
+    write_move_seq_table("move_seq neighbors_diag[TOTAL_BOARD_SIZ]",
+        neighbors_diag);
+    write_move_seq_table("move_seq neighbors_3x3[TOTAL_BOARD_SIZ]",
+        neighbors_3x3);
+    write_bool_table("bool border_left[TOTAL_BOARD_SIZ]", border_left,
+        TOTAL_BOARD_SIZ);
+    write_bool_table("bool border_right[TOTAL_BOARD_SIZ]", border_right,
+        TOTAL_BOARD_SIZ);
+    write_bool_table("bool border_top[TOTAL_BOARD_SIZ]", border_top,
+        TOTAL_BOARD_SIZ);
+    write_bool_table("bool border_bottom[TOTAL_BOARD_SIZ]", border_bottom,
+        TOTAL_BOARD_SIZ);
+    write_u8_table("u8 distances_to_border[TOTAL_BOARD_SIZ]",
+        distances_to_border, TOTAL_BOARD_SIZ);
+    write_move_seq_table("move_seq nei_dst_3[TOTAL_BOARD_SIZ]", nei_dst_3);
+    write_move_seq_table("move_seq nei_dst_4[TOTAL_BOARD_SIZ]", nei_dst_4);
+    write_bool_table("bool black_eye[65536]", black_eye, 65536);
+    write_bool_table("bool white_eye[65536]", white_eye, 65536);
+    write_u8_table("u8 black_eye_shapes[65536]", black_eye_shapes, 65536);
+    write_u8_table("u8 white_eye_shapes[65536]", white_eye_shapes, 65536);
+
+    write_iv_3x3_table();
+    write_u16_table("u16 initial_3x3_hash[TOTAL_BOARD_SIZ]", initial_3x3_hash,
+        TOTAL_BOARD_SIZ);
+    write_far_tables();
+    write_u8_table("u8 far_neighbors_count[TOTAL_BOARD_SIZ]",
+        far_neighbors_count, TOTAL_BOARD_SIZ);
+    write_u8_table("u8 initial_far_hash[TOTAL_BOARD_SIZ]", initial_far_hash,
+        TOTAL_BOARD_SIZ);
+
+    fprintf(fp, "#endif\n");
+    close_file();
+
+    fprintf(stderr, "Written %s and %s for %ux%u\n", SOURCE_FILENAME,
+        HEADER_FILENAME, BOARD_SIZ, BOARD_SIZ);
+    return EXIT_SUCCESS;
+}
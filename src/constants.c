@@ -3,6 +3,7 @@ Initialization of game wide constants based on board size.
 
 To use declare as external:
 d16 komi;
+d16 dynamic_komi;
 u8 out_neighbors8[TOTAL_BOARD_SIZ];
 u8 out_neighbors4[TOTAL_BOARD_SIZ];
 move_seq neighbors_side[TOTAL_BOARD_SIZ];
@@ -15,7 +16,13 @@ bool border_bottom[TOTAL_BOARD_SIZ];
 u8 distances_to_border[TOTAL_BOARD_SIZ];
 move_seq nei_dst_3[TOTAL_BOARD_SIZ];
 move_seq nei_dst_4[TOTAL_BOARD_SIZ];
-u8 active_bits_in_byte[256];
+bool black_eye[65536];
+bool white_eye[65536];
+u8 black_eye_shapes[65536];
+u8 white_eye_shapes[65536];
+
+If the tables were generated for the board size in use, by gen_constant_tables,
+they are defined already initialized in gen/constant_tables.c instead.
 */
 
 #include "config.h"
@@ -24,12 +31,21 @@ u8 active_bits_in_byte[256];
 #include <string.h>
 
 #include "board.h"
+#include "constant_tables.h"
+#include "constants.h"
 #include "flog.h"
 #include "pat3.h"
 #include "move.h"
 #include "types.h"
 
+/* board size the tables were generated for, or 0 */
+const u8 constant_tables_size = CONSTANT_TABLES_SIZ;
+
 d16 komi = DEFAULT_KOMI;
+/* added to the komi by the scoring of the searches */
+d16 dynamic_komi = 0;
+
+#if CONSTANT_TABLES_SIZ != BOARD_SIZ
 u8 out_neighbors8[TOTAL_BOARD_SIZ];
 u8 out_neighbors4[TOTAL_BOARD_SIZ];
 move_seq neighbors_side[TOTAL_BOARD_SIZ];
@@ -43,24 +59,32 @@ u8 distances_to_border[TOTAL_BOARD_SIZ];
 move_seq nei_dst_3[TOTAL_BOARD_SIZ];
 move_seq nei_dst_4[TOTAL_BOARD_SIZ];
 
-u8 active_bits_in_byte[256];
 bool black_eye[65536];
 bool white_eye[65536];
+u8 black_eye_shapes[65536];
+u8 white_eye_shapes[65536];
+#else
+/* generated by gen_constant_tables, in gen/constant_tables.c */
+extern u8 out_neighbors8[TOTAL_BOARD_SIZ];
+extern u8 out_neighbors4[TOTAL_BOARD_SIZ];
+extern move_seq neighbors_side[TOTAL_BOARD_SIZ];
+extern move_seq neighbors_diag[TOTAL_BOARD_SIZ];
+extern move_seq neighbors_3x3[TOTAL_BOARD_SIZ];
+extern bool border_left[TOTAL_BOARD_SIZ];
+extern bool border_right[TOTAL_BOARD_SIZ];
+extern bool border_top[TOTAL_BOARD_SIZ];
+extern bool border_bottom[TOTAL_BOARD_SIZ];
+extern u8 distances_to_border[TOTAL_BOARD_SIZ];
+extern move_seq nei_dst_3[TOTAL_BOARD_SIZ];
+extern move_seq nei_dst_4[TOTAL_BOARD_SIZ];
+extern bool black_eye[65536];
+extern bool white_eye[65536];
+extern u8 black_eye_shapes[65536];
+extern u8 white_eye_shapes[65536];
+#endif
 
 static bool board_constants_inited = false;
 
-static u8 count_bits(u8 v)
-{
-    u8 bits = 0;
-    while(v > 0)
-    {
-        if((v & 1) == 1)
-            ++bits;
-        v /= 2;
-    }
-    return bits;
-}
-
 /*
 An eye is a point that may eventually become untakeable (without playing
 at the empty intersection itself). Examples:
@@ -144,6 +168,55 @@ static u8 _white_neighbors8(
     return ret;
 }
 
+static u8 _out_neighbors8(
+    u8 p[3][3]
+){
+    u8 ret = _out_neighbors4(p);
+    if(p[0][0] == ILLEGAL)
+        ++ret;
+    if(p[2][0] == ILLEGAL)
+        ++ret;
+    if(p[0][2] == ILLEGAL)
+        ++ret;
+    if(p[2][2] == ILLEGAL)
+        ++ret;
+    return ret;
+}
+
+/*
+RETURNS the eye shape flags of an empty point for a player, with own4 and own8
+sides and neighbors of the player or out of the board, opp4 and opp8 of the
+opponent and out4 and out8 out of the board
+*/
+static u8 eye_shape_flags(
+    u8 own4,
+    u8 own8,
+    u8 opp4,
+    u8 opp8,
+    u8 out4,
+    u8 out8
+){
+    u8 ret = 0;
+    if(own8 > out8 && opp8 == 0)
+    {
+        if(own4 < 3 && own8 == own4 + 4)
+            ret |= EYE_SHAPE_NAKADE3;
+        if(own4 < 2 && own8 == own4 + 3)
+            ret |= EYE_SHAPE_NAKADE5;
+    }
+    if(own4 == 3 && ((out4 == 0 && opp8 < 2) || (out4 > 0 && opp8 == 0)))
+        ret |= EYE_SHAPE_END;
+    if(own4 == 2 && opp8 == 0 && own8 == 4)
+        ret |= EYE_SHAPE_CORNER;
+    if(opp4 == 0 && own4 == 3 && own8 >= 6)
+        ret |= own8 >= 7 ? EYE_SHAPE_2PT | EYE_SHAPE_2PT_SOLID : EYE_SHAPE_2PT;
+    if(own8 == 5)
+        ret |= EYE_SHAPE_4PT;
+    if(out4 == 0 && own4 == 2 && own8 == 4)
+        ret |= EYE_SHAPE_4PT_WEAK;
+    return ret;
+}
+
 static void init_eye_table()
 {
     u8 dst[3][3];
@@ -165,16 +238,24 @@ static void init_eye_table()
             white_eye[i] = (_white_neighbors4(dst) + _out_neighbors4(dst) == 4)
                 && (_black_neighbors8(dst) == 0);
         }
+
+        u8 out4 = _out_neighbors4(dst);
+        u8 out8 = _out_neighbors8(dst);
+        black_eye_shapes[i] = eye_shape_flags(_black_neighbors4(dst) + out4,
+            _black_neighbors8(dst) + out8, _white_neighbors4(dst),
+            _white_neighbors8(dst), out4, out8);
+        white_eye_shapes[i] = eye_shape_flags(_white_neighbors4(dst) + out4,
+            _white_neighbors8(dst) + out8, _black_neighbors4(dst),
+            _black_neighbors8(dst), out4, out8);
     }
 }
 
 /*
-Initialize a series of constants based on the board size in use.
+Computes the constants based on the board size in use, even if they were
+compiled in already.
 */
-void board_constants_init()
+void board_constants_compute()
 {
-    if(board_constants_inited)
-        return;
     board_constants_inited = true;
 
     /* Adjacent neighbor positions */
@@ -235,9 +316,6 @@ void board_constants_init()
         - 1, 0)] = out_neighbors8[coord_to_move(0, BOARD_SIZ - 1)] =
         out_neighbors8[coord_to_move(BOARD_SIZ - 1, BOARD_SIZ - 1)] = 5;
 
-    for(u16 i = 0; i < 256; ++i)
-        active_bits_in_byte[i] = count_bits(i);
-
     for(u8 i = 0; i < BOARD_SIZ; ++i)
         for(u8 j = 0; j < BOARD_SIZ; ++j)
             distances_to_border[coord_to_move(i, j)] = DISTANCE_TO_BORDER(i, j);
@@ -247,3 +325,18 @@ void board_constants_init()
 
     init_eye_table();
 }
+
+/*
+Initialize a series of constants based on the board size in use.
+*/
+void board_constants_init()
+{
+    if(board_constants_inited)
+        return;
+
+#if CONSTANT_TABLES_SIZ == BOARD_SIZ
+    board_constants_inited = true;
+#else
+    board_constants_compute();
+#endif
+}
@@ -0,0 +1,223 @@
+/*
+Binary data pack: a single file, NxN.pack in the data folder, with the data
+otherwise parsed and expanded at startup already in the layout used in memory,
+in sections that belong to the modules that use them. The file is mapped
+read-only, so nothing is copied while loading and its pages are shared between
+Matilda processes.
+
+The pack is generated from the data files by gen_data_pack. Each section keeps
+a fingerprint of the files it was generated from, and is only used while they
+are unchanged; otherwise the files are read as usual.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "alloc.h"
+#include "board.h"
+#include "data_pack.h"
+#include "engine.h"
+#include "flog.h"
+#include "mem_usage.h"
+#include "types.h"
+
+#define DATA_PACK_MAGIC "MTLDPACK"
+
+/* sections start at multiples of this */
+#define SECTION_ALIGNMENT 64
+
+typedef struct __data_pack_header_ {
+    char magic[8];
+    u32 version;
+    u32 board_siz;
+    u64 offsets[DATA_PACK_SECTIONS];
+    u64 sizes[DATA_PACK_SECTIONS];
+    u32 fingerprints[DATA_PACK_SECTIONS];
+} data_pack_header;
+
+static bool data_pack_disabled = false;
+static bool data_pack_inited = false;
+static const u8 * data_pack = NULL;
+
+
+/*
+Prevents the data pack from being used, so the data files are read instead.
+Must be called before the first data is read.
+*/
+void data_pack_disable()
+{
+    data_pack_disabled = true;
+}
+
+static bool valid_header(
+    const data_pack_header * h,
+    u64 file_size
+){
+    if(memcmp(h->magic, DATA_PACK_MAGIC, 8) != 0)
+        return false;
+    if(h->version != DATA_PACK_VERSION || h->board_siz != BOARD_SIZ)
+        return false;
+
+    for(u8 i = 0; i < DATA_PACK_SECTIONS; ++i)
+        if(h->offsets[i] % SECTION_ALIGNMENT != 0 || h->offsets[i] > file_size
+            || h->sizes[i] > file_size - h->offsets[i])
+            return false;
+
+    return true;
+}
+
+static void data_pack_init()
+{
+    data_pack_inited = true;
+    if(data_pack_disabled)
+        return;
+
+    char * filename = alloc();
+    snprintf(filename, MAX_PAGE_SIZ, "%s%ux%u.pack", data_folder(), BOARD_SIZ,
+        BOARD_SIZ);
+
+    int fd = open(filename, O_RDONLY);
+    if(fd == -1)
+    {
+        release(filename);
+        return;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(data_pack_header))
+    {
+        close(fd);
+        char * s = alloc();
+        snprintf(s, MAX_PAGE_SIZ, "ignoring invalid %s", filename);
+        flog_warn("pack", s);
+        release(s);
+        release(filename);
+        return;
+    }
+
+    void * mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        char * s = alloc();
+        snprintf(s, MAX_PAGE_SIZ, "could not map %s", filename);
+        flog_warn("pack", s);
+        release(s);
+        release(filename);
+        return;
+    }
+
+    if(!valid_header((const data_pack_header *)mapping, st.st_size))
+    {
+        munmap(mapping, st.st_size);
+        char * s = alloc();
+        snprintf(s, MAX_PAGE_SIZ, "ignoring %s: invalid or for a different \
+version or board size", filename);
+        flog_warn("pack", s);
+        release(s);
+        release(filename);
+        return;
+    }
+
+    /* mapped for the lifetime of the process */
+    data_pack = (const u8 *)mapping;
+    mem_usage_add(MEM_DATA_PACK, st.st_size);
+
+    char * s = alloc();
+    snprintf(s, MAX_PAGE_SIZ, "mapped %s (%lu bytes)", filename,
+        (unsigned long)st.st_size);
+    flog_info("pack", s);
+    release(s);
+    release(filename);
+}
+
+/*
+Maps the data pack of the board size in use, on the first call, and looks up
+one of its sections, generated from the files with the fingerprint specified.
+RETURNS pointer to the section contents, 8-byte aligned, or NULL if there is no
+usable data pack or the section is empty or out of date
+*/
+const void * data_pack_section(
+    u8 id,
+    u32 fingerprint,
+    u64 * size
+){
+    /* the opening book may be read in the background */
+    #pragma omp critical(data_pack_init)
+    if(!data_pack_inited)
+        data_pack_init();
+
+    if(data_pack == NULL || id >= DATA_PACK_SECTIONS)
+        return NULL;
+
+    const data_pack_header * h = (const data_pack_header *)data_pack;
+    if(h->sizes[id] == 0)
+        return NULL;
+
+    if(h->fingerprints[id] != fingerprint)
+    {
+        char * s = alloc();
+        snprintf(s, MAX_PAGE_SIZ, "section %u of the data pack is out of \
+date; run gen_data_pack again", id);
+        flog_warn("pack", s);
+        release(s);
+        return NULL;
+    }
+
+    *size = h->sizes[id];
+    return data_pack + h->offsets[id];
+}
+
+/*
+Writes a data pack with the contents of each section and the fingerprint of the
+files it was generated from; empty sections have size 0.
+RETURNS true if written successfully
+*/
+bool data_pack_write(
+    const char * filename,
+    const void * const contents[DATA_PACK_SECTIONS],
+    const u64 sizes[DATA_PACK_SECTIONS],
+    const u32 fingerprints[DATA_PACK_SECTIONS]
+){
+    data_pack_header h;
+    memset(&h, 0, sizeof(data_pack_header));
+    memcpy(h.magic, DATA_PACK_MAGIC, 8);
+    h.version = DATA_PACK_VERSION;
+    h.board_siz = BOARD_SIZ;
+
+    u64 offset = sizeof(data_pack_header);
+    for(u8 i = 0; i < DATA_PACK_SECTIONS; ++i)
+    {
+        offset = ((offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT) *
+            SECTION_ALIGNMENT;
+        h.offsets[i] = offset;
+        h.sizes[i] = sizes[i];
+        h.fingerprints[i] = fingerprints[i];
+        offset += sizes[i];
+    }
+
+    FILE * fp = fopen(filename, "wb");
+    if(fp == NULL)
+        return false;
+
+    fwrite(&h, sizeof(data_pack_header), 1, fp);
+    u64 written = sizeof(data_pack_header);
+    for(u8 i = 0; i < DATA_PACK_SECTIONS; ++i)
+    {
+        for(; written < h.offsets[i]; ++written)
+            fputc(0, fp);
+        if(sizes[i] > 0)
+            fwrite(contents[i], sizes[i], 1, fp);
+        written += sizes[i];
+    }
+
+    bool ok = !ferror(fp);
+    return fclose(fp) == 0 && ok;
+}
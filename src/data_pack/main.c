@@ -0,0 +1,83 @@
+/*
+Generate the data pack file, NxN.pack in the data folder, from the data files
+for the board size in use: the Zobrist table, the 3x3 patterns and their
+weights, the 12-point pattern weights and the opening book. Matilda then maps it
+instead of reading them, for as long as they are unchanged.
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "alloc.h"
+#include "constants.h"
+#include "data_pack.h"
+#include "engine.h"
+#include "flog.h"
+#include "opening_book.h"
+#include "pat12.h"
+#include "pat3.h"
+#include "types.h"
+#include "zobrist.h"
+
+
+int main(
+    int argc,
+    char * argv[]
+){
+    if(argc > 1)
+    {
+        printf("Usage: %s\n", argv[0]);
+        printf("Writes %ux%u.pack in the data folder, from the data files.\n",
+            BOARD_SIZ, BOARD_SIZ);
+        exit(EXIT_SUCCESS);
+    }
+
+    alloc_init();
+    flog_config_modes(LOG_MODE_ERROR | LOG_MODE_WARN);
+    flog_config_destinations(LOG_DEST_STDF);
+
+    assert_data_folder_exists();
+    data_pack_disable();
+
+    board_constants_init();
+    zobrist_init();
+    pat3_init();
+    pat12_init();
+    opening_book_init();
+
+    void * contents[DATA_PACK_SECTIONS];
+    u64 sizes[DATA_PACK_SECTIONS] = { 0 };
+    u32 fingerprints[DATA_PACK_SECTIONS] = { 0 };
+    contents[DATA_PACK_ZOBRIST] = zobrist_pack_section(
+        &sizes[DATA_PACK_ZOBRIST], &fingerprints[DATA_PACK_ZOBRIST]);
+    contents[DATA_PACK_PAT3] = pat3_pack_section(&sizes[DATA_PACK_PAT3],
+        &fingerprints[DATA_PACK_PAT3]);
+    contents[DATA_PACK_PAT12] = pat12_pack_section(&sizes[DATA_PACK_PAT12],
+        &fingerprints[DATA_PACK_PAT12]);
+    contents[DATA_PACK_OPENING_BOOK] = opening_book_pack_section(
+        &sizes[DATA_PACK_OPENING_BOOK], &fingerprints[DATA_PACK_OPENING_BOOK]);
+
+    char * filename = alloc();
+    snprintf(filename, MAX_PAGE_SIZ, "%s%ux%u.pack", data_folder(), BOARD_SIZ,
+        BOARD_SIZ);
+
+    if(!data_pack_write(filename, (const void * const *)contents, sizes,
+        fingerprints))
+    {
+        fprintf(stderr, "error: couldn't write %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    u64 total = 0;
+    for(u8 i = 0; i < DATA_PACK_SECTIONS; ++i)
+    {
+        total += sizes[i];
+        free(contents[i]);
+    }
+
+    printf("Wrote %s (%lu bytes of data)\n", filename, (unsigned long)total);
+    release(filename);
+    return EXIT_SUCCESS;
+}
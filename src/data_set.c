@@ -5,9 +5,12 @@ A data set file is defined as 4 bytes (unsigned int) indicating the
 number of training cases, followed by the elements of struct
 training_example type.
 
-The examples are stored unique and invariant of flips and rotations, when
-loaded via the data_set_load function they are fliped and rotated to increase
-the data set size.
+The examples are stored unique and invariant of flips and rotations. The file
+is mapped to memory, not copied, and only an index of the examples and their
+distinct flips and rotations is kept; the flips and rotations are applied when
+the examples are read with data_set_get. Data sets larger than the memory
+available can be read in passes over chunks of the file, with
+data_set_shuffle_chunks.
 */
 
 #include "config.h"
@@ -17,16 +20,33 @@ the data set size.
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "alloc.h"
+#include "board.h"
 #include "data_set.h"
 #include "engine.h"
 #include "flog.h"
+#include "matrix.h"
+#include "mem_usage.h"
 #include "randg.h"
 #include "types.h"
 
+/*
+Index entries are the position of the example in the file followed by 3 bits
+of the reduction method to apply, minus one.
+*/
+#define INDEX_EXAMPLE(E) ((E) >> 3)
+#define INDEX_METHOD(E) ((d8)(((E) & 7) + 1))
+
 static u32 data_set_size;
-static training_example ** data_set = NULL;
+static u64 * data_set = NULL;
+static u64 data_set_bytes = 0; /* of data_set */
+static const training_example * examples = NULL;
+
 
 /*
 Shuffle all first num entries.
@@ -40,7 +60,7 @@ void data_set_shuffle(
     u32 i;
     for(i = num - 1; i > 0; --i){
         u32 j = rand_u32(i + 1);
-        training_example * tmp = data_set[i];
+        u64 tmp = data_set[i];
         data_set[i] = data_set[j];
         data_set[j] = tmp;
     }
@@ -55,6 +75,66 @@ void data_set_shuffle_all()
     data_set_shuffle(data_set_size);
 }
 
+static int compare_entries(
+    const void * a,
+    const void * b
+){
+    u64 e1 = *((const u64 *)a);
+    u64 e2 = *((const u64 *)b);
+    return e1 < e2 ? -1 : (e1 > e2 ? 1 : 0);
+}
+
+/*
+Shuffle the data set in chunks of consecutive examples of the file: the order
+of the chunks and of the entries within each chunk, so a pass over the data set
+only reads one chunk of the file at a time.
+*/
+void data_set_shuffle_chunks(
+    u32 chunk_size
+){
+    assert(chunk_size > 0);
+
+    /* back to the order of the file */
+    qsort(data_set, data_set_size, sizeof(u64), compare_entries);
+
+    u32 chunks = (data_set_size + chunk_size - 1) / chunk_size;
+    u32 * order = (u32 *)malloc(chunks * sizeof(u32));
+    u64 * shuffled = (u64 *)malloc(data_set_size * sizeof(u64));
+    if(order == NULL || shuffled == NULL)
+        flog_crit("dset", "system out of memory\n");
+
+    for(u32 i = 0; i < chunks; ++i)
+        order[i] = i;
+    for(u32 i = chunks - 1; i > 0; --i){
+        u32 j = rand_u32(i + 1);
+        u32 tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    u32 insert = 0;
+    for(u32 c = 0; c < chunks; ++c){
+        u32 start = order[c] * chunk_size;
+        u32 size = MIN(chunk_size, data_set_size - start);
+        u64 * dst = shuffled + insert;
+        memcpy(dst, data_set + start, size * sizeof(u64));
+        for(u32 i = size - 1; i > 0; --i){
+            u32 j = rand_u32(i + 1);
+            u64 tmp = dst[i];
+            dst[i] = dst[j];
+            dst[j] = tmp;
+        }
+        insert += size;
+    }
+
+    free(data_set);
+    free(order);
+    data_set = shuffled;
+    mem_usage_add(MEM_DATA_SET, ((d64)data_set_size) * sizeof(u64) -
+        data_set_bytes);
+    data_set_bytes = ((u64)data_set_size) * sizeof(u64);
+}
+
 /*
 Read a data set and shuffle it.
 RETURNS table set size (number of cases)
@@ -76,70 +156,71 @@ u32 data_set_load2(
     char * filename = alloc();
     snprintf(filename, MAX_PAGE_SIZ, "%s%dx%d.ds", data_folder(), BOARD_SIZ,
         BOARD_SIZ);
-    FILE * fp = fopen(filename, "rb");
+    int fd = open(filename, O_RDONLY);
     release(filename);
-    if(fp == NULL)
+    if(fd == -1)
         flog_crit("dset", "could not open file for reading\n");
 
-    u32 ds_elems;
-    size_t r = fread(&ds_elems, sizeof(u32), 1, fp);
-    if(r != 1)
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(u32))
         flog_crit("dset", "communication failure\n");
+
+    void * mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+        flog_crit("dset", "could not map file\n");
+
+    u32 ds_elems = *((const u32 *)mapping);
     assert(ds_elems > 0);
+    if(sizeof(u32) + (u64)ds_elems * sizeof(training_example) >
+        (u64)st.st_size)
+        flog_crit("dset", "file is truncated\n");
 
     ds_elems = MIN(ds_elems, max);
+    examples = (const training_example *)((const u8 *)mapping + sizeof(u32));
 
-    data_set = (training_example **)malloc(sizeof(training_example *) * ds_elems
-        * 8);
+    data_set = (u64 *)malloc(sizeof(u64) * ds_elems * 8);
     if(data_set == NULL)
         flog_crit("dset", "system out of memory\n");
+    data_set_bytes = sizeof(u64) * ds_elems * 8;
+    /* the mapping of the file is counted too, although shared */
+    mem_usage_add(MEM_DATA_SET, data_set_bytes + st.st_size);
+
+    /* the file is read once in order while indexing */
+    posix_madvise(mapping, st.st_size, POSIX_MADV_SEQUENTIAL);
 
     u32 insert = 0;
     u32 i;
     for(i = 0; i < ds_elems; ++i){
-        data_set[insert] = (training_example *)malloc(sizeof(training_example));
-        if(data_set[insert] == NULL)
-            flog_crit("dset", "system out of memory (1)\n");
-
-        r = fread(data_set[insert], sizeof(training_example), 1, fp);
-        assert(r == 1);
-        u32 base_insert = insert;
-        ++insert;
+        data_set[insert++] = ((u64)i) << 3;
 
         /*
         Generate more (0-7) cases from reduced ones
         */
-        board tmp;
+        board tmp[8];
+        memcpy(&tmp[0].p, &examples[i].p, TOTAL_BOARD_SIZ);
+        u8 distinct = 1;
         for(d8 r = 2; r < 9; ++r){
-            memcpy(&tmp.p, &data_set[base_insert]->p, TOTAL_BOARD_SIZ);
-            tmp.last_played = tmp.last_eaten = NONE;
-            reduce_fixed(&tmp, r);
+            memcpy(&tmp[distinct].p, &examples[i].p, TOTAL_BOARD_SIZ);
+            tmp[distinct].last_played = tmp[distinct].last_eaten = NONE;
+            reduce_fixed(&tmp[distinct], r);
 
             bool repeated = false;
-            for(u32 j = base_insert; j < insert; ++j)
-                if(memcmp(&tmp.p, &data_set[j]->p, TOTAL_BOARD_SIZ) == 0){
+            for(u8 j = 0; j < distinct; ++j)
+                if(memcmp(&tmp[distinct].p, &tmp[j].p, TOTAL_BOARD_SIZ) == 0){
                     repeated = true;
                     break;
                 }
             if(repeated)
                 continue;
 
-            data_set[insert] = (training_example *)malloc(
-                sizeof(training_example));
-            if(data_set[insert] == NULL)
-                flog_crit("dset", "system out of memory (2)\n");
-
-            memcpy(&data_set[insert]->p, &tmp.p, TOTAL_BOARD_SIZ);
-
-            data_set[insert]->m = data_set[base_insert]->m;
-            data_set[insert]->m = reduce_move(data_set[insert]->m, r);
-            ++insert;
+            ++distinct;
+            data_set[insert++] = (((u64)i) << 3) | (u64)(r - 1);
         }
-
-        data_set_size = insert;
     }
+    data_set_size = insert;
 
-    fclose(fp);
+    posix_madvise(mapping, st.st_size, POSIX_MADV_NORMAL);
 
     data_set_shuffle_all();
 
@@ -153,10 +234,27 @@ u32 data_set_load2(
 }
 
 /*
-Get a specific data set element by position.
+Get a specific data set element by position, with its flip or rotation applied.
 */
-training_example * data_set_get(
+void data_set_get(
+    training_example * dst,
     u32 pos
 ){
-    return data_set[pos];
+    assert(pos < data_set_size);
+    u64 e = data_set[pos];
+    const training_example * src = &examples[INDEX_EXAMPLE(e)];
+    d8 method = INDEX_METHOD(e);
+
+    if(method == NOREDUCE)
+    {
+        memcpy(dst, src, sizeof(training_example));
+        return;
+    }
+
+    board tmp;
+    memcpy(&tmp.p, &src->p, TOTAL_BOARD_SIZ);
+    tmp.last_played = tmp.last_eaten = NONE;
+    reduce_fixed(&tmp, method);
+    memcpy(&dst->p, &tmp.p, TOTAL_BOARD_SIZ);
+    dst->m = reduce_move(src->m, method);
 }
@@ -19,13 +19,20 @@ OXXOOXXO
 OOXXX.XO
 .OOOOXXO
 ....OOOO
+
+The eye shapes found around each empty intersection only depend on the nearby
+stones, so they are kept per thread from the previous estimation and only
+found again near the intersections that changed since. Consecutive estimations
+are usually of states of the same tree, a few plays apart.
 */
 
 #include "config.h"
 
 #include <assert.h>
+#include <string.h>
 
 #include "cfg_board.h"
+#include "move.h"
 #include "tactical.h"
 #include "types.h"
 
@@ -36,6 +43,37 @@ extern bool border_right[TOTAL_BOARD_SIZ];
 extern bool border_top[TOTAL_BOARD_SIZ];
 extern bool border_bottom[TOTAL_BOARD_SIZ];
 
+/* shapes found at an empty intersection */
+#define SHAPE_BLACK_EYE 0x0001
+#define SHAPE_WHITE_EYE 0x0002
+#define SHAPE_BLACK_2PT 0x0004
+#define SHAPE_WHITE_2PT 0x0008
+#define SHAPE_BLACK_2PT_FORCING 0x0010
+#define SHAPE_WHITE_2PT_FORCING 0x0020
+#define SHAPE_BLACK_4PT 0x0040
+#define SHAPE_WHITE_4PT 0x0080
+#define SHAPE_BLACK_4PT_FORCING 0x0100
+#define SHAPE_WHITE_4PT_FORCING 0x0200
+#define SHAPE_CORNER_LIBERTY 0x0400
+#define SHAPE_VERTICAL_BAMBOO 0x0800
+#define SHAPE_HORIZONTAL_BAMBOO 0x1000
+#define SHAPE_SHELTERED 0x2000
+#define SHAPE_KOSUMI1 0x4000
+#define SHAPE_KOSUMI2 0x8000
+
+#define SHAPE(IS_BLACK, S) ((IS_BLACK) ? SHAPE_BLACK_##S : SHAPE_WHITE_##S)
+
+/* distance up to which the shapes of an intersection depend on the stones */
+#define SHAPE_RADIUS 3
+/* above this many changed intersections all shapes are found again */
+#define SHAPE_MAX_CHANGES 24
+
+static bool shapes_valid = false;
+static u8 shapes_p[TOTAL_BOARD_SIZ];
+static u16 shapes[TOTAL_BOARD_SIZ];
+static u8 shapes_nakade[TOTAL_BOARD_SIZ];
+#pragma omp threadprivate(shapes_valid, shapes_p, shapes, shapes_nakade)
+
 static group * dragon_head(
     group * g
 ){
@@ -78,6 +116,141 @@ static void disqualify_square(
     }
 }
 
+static u16 find_shapes(
+    const cfg_board * cb,
+    move m,
+    u8 * nakade
+){
+    *nakade = 0;
+    if(cb->p[m] != EMPTY)
+        return 0;
+
+    u16 ret = 0;
+    bool can_have_forcing_move;
+
+    if(is_eye(cb, true, m))
+        ret |= SHAPE_BLACK_EYE;
+    if(is_eye(cb, false, m))
+        ret |= SHAPE_WHITE_EYE;
+
+    can_have_forcing_move = false;
+    if(is_2pt_eye(cb, true, m, &can_have_forcing_move))
+        ret |= SHAPE_BLACK_2PT | (can_have_forcing_move ?
+            SHAPE_BLACK_2PT_FORCING : 0);
+    can_have_forcing_move = false;
+    if(is_2pt_eye(cb, false, m, &can_have_forcing_move))
+        ret |= SHAPE_WHITE_2PT | (can_have_forcing_move ?
+            SHAPE_WHITE_2PT_FORCING : 0);
+
+    can_have_forcing_move = false;
+    if(is_4pt_eye(cb, true, m, &can_have_forcing_move))
+        ret |= SHAPE_BLACK_4PT | (can_have_forcing_move ?
+            SHAPE_BLACK_4PT_FORCING : 0);
+    can_have_forcing_move = false;
+    if(is_4pt_eye(cb, false, m, &can_have_forcing_move))
+        ret |= SHAPE_WHITE_4PT | (can_have_forcing_move ?
+            SHAPE_WHITE_4PT_FORCING : 0);
+
+    *nakade = is_nakade(cb, m);
+
+    if(is_corner_liberty(cb, true, m) || is_corner_liberty(cb, false, m))
+        ret |= SHAPE_CORNER_LIBERTY;
+
+    if(is_vertical_bamboo_joint(cb, m))
+        ret |= SHAPE_VERTICAL_BAMBOO;
+    if(is_horizontal_bamboo_joint(cb, m))
+        ret |= SHAPE_HORIZONTAL_BAMBOO;
+
+    if(sheltered_liberty(cb, m))
+        ret |= SHAPE_SHELTERED;
+
+    if(is_kosumi1(cb, m))
+        ret |= SHAPE_KOSUMI1;
+    if(is_kosumi2(cb, m))
+        ret |= SHAPE_KOSUMI2;
+
+    return ret;
+}
+
+/*
+Brings the shapes up to date with the board, finding them again only around
+the intersections that changed since they were last found.
+*/
+static void update_shapes(
+    const cfg_board * cb
+){
+    move changed[SHAPE_MAX_CHANGES];
+    u16 changed_count = 0;
+
+    if(shapes_valid)
+        for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+            if(cb->p[m] != shapes_p[m])
+            {
+                if(changed_count == SHAPE_MAX_CHANGES)
+                {
+                    shapes_valid = false;
+                    break;
+                }
+                changed[changed_count++] = m;
+            }
+
+    if(!shapes_valid)
+    {
+        for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+            shapes[m] = find_shapes(cb, m, &shapes_nakade[m]);
+        memcpy(shapes_p, cb->p, TOTAL_BOARD_SIZ);
+        shapes_valid = true;
+        return;
+    }
+
+    if(changed_count == 0)
+        return;
+
+    bool dirty[TOTAL_BOARD_SIZ];
+    memset(dirty, false, TOTAL_BOARD_SIZ);
+
+    for(u16 k = 0; k < changed_count; ++k)
+    {
+        u8 x;
+        u8 y;
+        move_to_coord(changed[k], &x, &y);
+        d8 x0 = x - SHAPE_RADIUS;
+        d8 y0 = y - SHAPE_RADIUS;
+        for(d8 i = x0 < 0 ? 0 : x0; i <= x + SHAPE_RADIUS && i < BOARD_SIZ;
+            ++i)
+            for(d8 j = y0 < 0 ? 0 : y0; j <= y + SHAPE_RADIUS && j <
+                BOARD_SIZ; ++j)
+            {
+                move m = coord_to_move(i, j);
+                if(!dirty[m])
+                {
+                    dirty[m] = true;
+                    shapes[m] = find_shapes(cb, m, &shapes_nakade[m]);
+                }
+            }
+    }
+
+    memcpy(shapes_p, cb->p, TOTAL_BOARD_SIZ);
+}
+
+/*
+Checks the shapes kept up to date by the calling thread, for the board of its
+last eye count, against the shapes found again for the whole board cb.
+RETURNS true if they are the same
+*/
+bool verify_shapes(
+    const cfg_board * cb
+){
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+    {
+        u8 nakade;
+        if(find_shapes(cb, m, &nakade) != shapes[m] || nakade !=
+            shapes_nakade[m])
+            return false;
+    }
+    return true;
+}
+
 /*
 Produce counts of eyes for every group in the board, plus updates the viability
 of playing at each position and whether such plays are nakade, from the
@@ -98,10 +271,13 @@ void estimate_eyes(
         g->next = NULL;
     }
 
+    update_shapes(cb);
+    assert(verify_shapes(cb));
+
     for(move k = 0; k < cb->empty.count; ++k)
     {
         move m = cb->empty.coord[k];
-        bool can_have_forcing_move;
+        u16 s = shapes[m];
 
         if(!viable[m] || !play_okay[m])
             continue;
@@ -109,7 +285,7 @@ void estimate_eyes(
         /*
         Eye shapes
         */
-        if(is_eye(cb, is_black, m))
+        if(s & SHAPE(is_black, EYE))
         {
             group * g = border_left[m] ? cb->g[m + RIGHT] : cb->g[m + LEFT];
             dragon_head(g)->eyes++;
@@ -118,7 +294,7 @@ void estimate_eyes(
             continue;
         }
 
-        if(is_eye(cb, !is_black, m))
+        if(s & SHAPE(!is_black, EYE))
         {
             group * g = border_left[m] ? cb->g[m + RIGHT] : cb->g[m + LEFT];
             dragon_head(g)->eyes++;
@@ -128,19 +304,19 @@ void estimate_eyes(
         /*
         2-point eye shapes
         */
-        if(is_2pt_eye(cb, is_black, m, &can_have_forcing_move))
+        if(s & SHAPE(is_black, 2PT))
         {
             group * g = get_closest_group(cb, m);
             dragon_head(g)->eyes++;
 
             play_okay[m + RIGHT] = false;
             play_okay[m + BOTTOM] = false;
-            if(!can_have_forcing_move)
+            if(!(s & SHAPE(is_black, 2PT_FORCING)))
                 play_okay[m] = false;
             continue;
         }
 
-        if(is_2pt_eye(cb, !is_black, m, &can_have_forcing_move))
+        if(s & SHAPE(!is_black, 2PT))
         {
             group * g = get_closest_group(cb, m);
             dragon_head(g)->eyes++;
@@ -154,7 +330,7 @@ void estimate_eyes(
         Don't play in own and opponent big fours
         One of the plays is allowed to be used as a forcing move.
         */
-        if(is_4pt_eye(cb, is_black, m, &can_have_forcing_move))
+        if(s & SHAPE(is_black, 4PT))
         {
             group * gs[4];
             u8 gsc = 0;
@@ -176,7 +352,7 @@ void estimate_eyes(
                 play_okay[m] = false;
                 play_okay[m + RIGHT] = false;
                 play_okay[m + BOTTOM] = false;
-                if(!can_have_forcing_move)
+                if(!(s & SHAPE(is_black, 4PT_FORCING)))
                     play_okay[m + RIGHT + BOTTOM] = false;
             }
             else
@@ -184,12 +360,12 @@ void estimate_eyes(
                 play_okay[m + RIGHT] = false;
                 play_okay[m + BOTTOM] = false;
                 play_okay[m + RIGHT + BOTTOM] = false;
-                if(!can_have_forcing_move)
+                if(!(s & SHAPE(is_black, 4PT_FORCING)))
                     play_okay[m] = false;
             }
             continue;
         }
-        if(is_4pt_eye(cb, !is_black, m, &can_have_forcing_move))
+        if(s & SHAPE(!is_black, 4PT))
         {
             group * gs[4];
             u8 gsc = 0;
@@ -225,7 +401,7 @@ void estimate_eyes(
         Nakade
         */
         u8 nk;
-        if((nk = is_nakade(cb, m)) > 0)
+        if((nk = shapes_nakade[m]) > 0)
         {
             group * gs[4];
             u8 gsc = 0;
@@ -253,13 +429,13 @@ void estimate_eyes(
             continue;
         }
 
-        if(is_corner_liberty(cb, true, m) || is_corner_liberty(cb, false, m))
+        if(s & SHAPE_CORNER_LIBERTY)
             play_okay[m] = false;
 
         /*
         Bamboo joints
         */
-        if(is_vertical_bamboo_joint(cb, m))
+        if(s & SHAPE_VERTICAL_BAMBOO)
         {
             group * g1 = cb->g[m + TOP];
             group * g2 = cb->g[m + BOTTOM];
@@ -267,7 +443,7 @@ void estimate_eyes(
                 unite_dragons(g1, g2);
         }
         else
-            if(is_horizontal_bamboo_joint(cb, m))
+            if(s & SHAPE_HORIZONTAL_BAMBOO)
             {
                 group * g1 = cb->g[m + LEFT];
                 group * g2 = cb->g[m + RIGHT];
@@ -310,7 +486,8 @@ void estimate_eyes(
         if(!viable[m] || !play_okay[m])
             continue;
 
-        if(sheltered_liberty(cb, m) && !is_eye(cb, !is_black, m))
+        if((shapes[m] & SHAPE_SHELTERED) && !(shapes[m] & SHAPE(!is_black,
+            EYE)))
         {
             group * gs[4];
             u8 fn = 0;
@@ -364,7 +541,7 @@ void estimate_eyes(
         /*
         Kosumi
         */
-        if(is_kosumi1(cb, m))
+        if(shapes[m] & SHAPE_KOSUMI1)
         {
             group * g1 = dragon_head(cb->g[m + RIGHT]);
             group * g2 = dragon_head(cb->g[m + BOTTOM]);
@@ -376,7 +553,7 @@ void estimate_eyes(
                     g2->borrowed_eyes = g1->eyes;
             }
         }
-        if(is_kosumi2(cb, m))
+        if(shapes[m] & SHAPE_KOSUMI2)
         {
             group * g1 = dragon_head(cb->g[m + LEFT]);
             group * g2 = dragon_head(cb->g[m + BOTTOM]);
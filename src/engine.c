@@ -14,19 +14,79 @@ maintenance if needed.
 #include "alloc.h"
 #include "board.h"
 #include "cfg_board.h"
+#include "cluster.h"
 #include "flog.h"
 #include "game_record.h"
+#include "latency.h"
 #include "mcts.h"
+#include "mem_usage.h"
 #include "opening_book.h"
+#include "playout.h"
+#include "scoring.h"
 #include "stringm.h"
 #include "transpositions.h"
+#include "timem.h"
 #include "types.h"
 #include "version.h"
+#include "zobrist.h"
+
+/*
+Between-turn maintenance done while thinking in the opponent turn is split in
+steps of this many buckets, between which it can be interrupted.
+*/
+#define MAINTENANCE_STEP_BUCKETS 65536
+
+/*
+Simulations of the search made to estimate the ownership of the points of a
+position that was not searched yet.
+*/
+#define OWNERSHIP_SIMULATIONS 2000
+
+/*
+Simulations of the search made for each play of the cleanup phase of a game.
+*/
+#define CLEANUP_SIMULATIONS 1000
+
+/*
+Ownership by the player, from -1 to 1, above which the stones of the opponent
+are captured in the cleanup phase of a game; the searches are short, so stones
+owned by a slim majority of their playouts are left alone.
+*/
+#define CLEANUP_DEAD_OWNERSHIP 0.5
+
+/*
+Smallest memory limit, in MiB, the transpositions table is lowered to, to fit
+the memory budget; and by how much more than its limit the budget must allow
+for it to be raised again, in 1/16ths of the limit.
+*/
+#define MIN_BUDGET_TT_MBS 16
+#define BUDGET_RAISE_MARGIN 1
 
 static bool use_opening_book = true;
 
+/* memory budget of the whole program, in bytes; 0 for unlimited */
+static u64 memory_budget = 0;
+/* memory limit of the transpositions table requested, and set to fit */
+static u64 requested_tt_mbs = 0;
+static u64 fitted_tt_mbs = 0;
+static bool budget_warned = false;
+
+extern bool pl_light_playouts;
+extern move_seq neighbors_side[TOTAL_BOARD_SIZ];
+extern d16 dynamic_komi;
+extern u64 max_size_in_mbs;
+
 bool tt_requires_maintenance = false; /* set after MCTS start/resume call */
 
+/* state of the last between-turn maintenance */
+static u64 maintained_hash = 0;
+static bool maintained_is_black = false;
+static u32 maintenance_freed_states;
+static u64 maintenance_mem_before;
+
+/* states in use after the last pondering, until the opponent replies */
+static u32 pondered_states = 0;
+
 
 static char _data_folder[MAX_PATH_SIZ] = DEFAULT_DATA_PATH;
 
@@ -104,9 +164,225 @@ void set_use_of_opening_book(
     use_opening_book = use_ob;
 }
 
+/*
+Set whether the following searches use light playouts -- uniformly random, only
+avoiding playing in own eyes -- instead of heavy playouts. Light playouts are
+much faster, and weaker, and are meant for when the number of playouts matters
+more than their quality.
+*/
+void set_light_playouts(
+    bool light
+){
+    pl_light_playouts = light;
+}
+
+/*
+Sets the memory budget of the whole program, in MiB, or 0 for none. Before each
+search the free lists of the allocators are trimmed if the memory held is over
+the budget, and the memory limit of the transpositions table is lowered so the
+table fits the rest of the budget; or raised back, up to the limit set for it.
+*/
+void set_memory_budget(
+    u64 mbs
+){
+    memory_budget = mbs * 1048576;
+    requested_tt_mbs = max_size_in_mbs;
+    fitted_tt_mbs = max_size_in_mbs;
+    budget_warned = false;
+}
+
+/*
+Keeps the memory of the program within the budget, if set, before searching the
+subtree of board b, played by is_black: from which the states over a lowered
+limit of the transpositions table are pruned, until the memory allocated for
+them, with the chunks of plays left unused released, fits.
+*/
+static void fit_memory_budget(
+    const board * b,
+    bool is_black
+){
+    if(memory_budget == 0)
+        return;
+
+    /* a limit changed by other means is the one requested */
+    if(max_size_in_mbs != fitted_tt_mbs)
+        requested_tt_mbs = max_size_in_mbs;
+
+    /* the tables of buckets grow with the limit of the table */
+    double tables_ratio = ((double)tt_tables_memory()) / (max_size_in_mbs *
+        1048576);
+    u64 tt_memory = (u64)(requested_tt_mbs * 1048576 * (1.0 + tables_ratio));
+
+    if(mem_usage_total() + tt_memory > memory_budget)
+    {
+        u64 freed = alloc_trim() + cfg_board_trim_pool();
+        if(freed > 0)
+        {
+            char * s = alloc();
+            char * s2 = alloc();
+            format_mem_size(s2, freed);
+            snprintf(s, MAX_PAGE_SIZ, "trimmed free lists (%s)", s2);
+            flog_info("engn", s);
+            release(s2);
+            release(s);
+        }
+    }
+
+    u64 others = mem_usage_total();
+    u64 available = memory_budget > others ? (u64)((memory_budget - others) /
+        (1.0 + tables_ratio)) / 1048576 : 0;
+    if(available < MIN_BUDGET_TT_MBS && !budget_warned)
+    {
+        budget_warned = true;
+        flog_warn("engn", "memory budget too small for the transpositions \
+table");
+    }
+
+    u64 mbs = MIN(requested_tt_mbs, MAX(available, MIN_BUDGET_TT_MBS));
+
+    /* only raised by a margin, so the limit doesn't change on every search */
+    bool raise = mbs > max_size_in_mbs && (mbs == requested_tt_mbs || mbs * 16
+        >= max_size_in_mbs * (16 + BUDGET_RAISE_MARGIN));
+    if(mbs < max_size_in_mbs || raise)
+    {
+        tt_resize(mbs);
+        /* the states over the new limit are pruned now, not mid-search, and
+        the chunks of plays left unused released */
+        tt_trim_plays();
+        while(tt_memory_allocated() >= mbs * 1048576 && tt_prune(b, is_black)
+            > 0)
+            tt_trim_plays();
+    }
+    fitted_tt_mbs = max_size_in_mbs;
+}
+
+/*
+Produces a textual description of the memory use of the program, and of its
+budget, up to MAX_PAGE_SIZ characters.
+*/
+void memory_usage_to_string(
+    char * dst
+){
+    char * s = alloc();
+    char * s2 = alloc();
+
+    u32 idx = 0;
+    if(memory_budget > 0)
+    {
+        format_mem_size(s, memory_budget);
+        idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx, "budget: %s\n", s);
+    }
+
+    format_mem_size(s, tt_memory_in_use());
+    format_mem_size(s2, max_size_in_mbs * 1048576);
+    idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
+        "transpositions table: %s of %s\n", s, s2);
+    format_mem_size(s, tt_tables_memory());
+    idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
+        "transpositions table buckets: %s\n", s);
+    idx += mem_usage_to_string(dst + idx, MAX_PAGE_SIZ - idx);
+
+    format_mem_size(s, tt_memory_allocated() + tt_tables_memory() +
+        mem_usage_total());
+    snprintf(dst + idx, MAX_PAGE_SIZ - idx, "total: %s", s);
+
+    release(s2);
+    release(s);
+}
+
+static void freed_mem_message(
+    u32 states,
+    u64 bytes
+){
+    if(states == 0)
+        return;
+
+    char * s = alloc();
+    char * s2 = alloc();
+
+    format_mem_size(s2, bytes);
+    snprintf(s, MAX_PAGE_SIZ, "freed %u states (%s)", states, s2);
+    flog_info("engn", s);
+
+    release(s2);
+    release(s);
+}
+
+static void reuse_message(
+    u32 states,
+    u32 kept_states,
+    u32 reply_visits,
+    u32 visits
+){
+    if(states == 0 || visits == 0)
+        return;
+
+    char * s = alloc();
+    snprintf(s, MAX_PAGE_SIZ, "pondering reused %u of %u states (%.1f%%) and %\
+u of %u visits (%.1f%%)", MIN(kept_states, states), states, MIN(kept_states,
+        states) * 100.0 / states, reply_visits, visits, reply_visits * 100.0 /
+        visits);
+    flog_info("engn", s);
+    release(s);
+}
+
+/*
+Continues the between-turn maintenance in progress, if any, for at most the next
+buckets buckets of the transpositions table.
+RETURNS true if there is no maintenance in progress
+*/
+static bool continue_maintenance(
+    u32 buckets
+){
+    if(!tt_clean_unreachable_pending())
+        return true;
+
+    maintenance_freed_states += tt_clean_unreachable_step(buckets);
+    if(tt_clean_unreachable_pending())
+        return false;
+
+    freed_mem_message(maintenance_freed_states, maintenance_mem_before -
+        tt_memory_in_use());
+    return true;
+}
+
+/*
+Starts the between-turn maintenance, if required, to free the states not
+reachable from state b played by is_black. A maintenance in progress is finished
+first.
+*/
+static void start_maintenance(
+    const board * b,
+    bool is_black
+){
+    continue_maintenance(UINT32_MAX);
+
+    /* how much of the pondering is kept, once the opponent replied */
+    u32 reply_visits;
+    u32 visits;
+    if(pondered_states > 0 && mcts_pondered_reply(b, is_black, &reply_visits,
+        &visits))
+    {
+        reuse_message(pondered_states, tt_subtree_states(b, is_black),
+            reply_visits, visits);
+        pondered_states = 0;
+    }
+
+    if(!tt_requires_maintenance)
+        return;
+
+    maintenance_freed_states = 0;
+    maintenance_mem_before = tt_memory_in_use();
+    tt_clean_unreachable_start(b, is_black);
+    tt_requires_maintenance = false;
+    maintained_hash = zobrist_new_hash(b);
+    maintained_is_black = is_black;
+}
+
 /*
 Evaluates the position given the time available to think, by using a number of
-strategies in succession.
+strategies in succession. The search may be extended up to max_stop_time if it
+is unstable. The cluster workers connected, if any, search the position too.
 RETURNS true if a play or pass is suggested instead of resigning
 */
 bool evaluate_position_timed(
@@ -114,25 +390,83 @@ bool evaluate_position_timed(
     bool is_black,
     out_board * out_b,
     u64 stop_time,
-    u64 early_stop_time
+    u64 early_stop_time,
+    u64 max_stop_time
 ){
     if(use_opening_book)
     {
         board tmp;
         memcpy(&tmp, b, sizeof(board));
         d8 reduction = reduce_auto(&tmp, true);
-        if(opening_book(out_b, &tmp))
+        bool found = opening_book(out_b, &tmp);
+        latency_mark(LAT_OPENING_BOOK);
+        if(found)
         {
             out_board_revert_reduce(out_b, reduction);
             return true;
         }
     }
 
-    bool ret = mcts_start_timed(out_b, b, is_black, stop_time, early_stop_time);
+    /* searches can't run while states are being freed */
+    continue_maintenance(UINT32_MAX);
+    fit_memory_budget(b, is_black);
+    latency_mark(LAT_MAINTENANCE);
+    cluster_search_start(b, is_black, max_stop_time);
+    bool ret = mcts_start_timed(out_b, b, is_black, stop_time, early_stop_time,
+        max_stop_time);
+    latency_mark(LAT_SEARCH);
     tt_requires_maintenance = true;
     return ret;
 }
 
+/*
+Evaluates count positions, each with its own player and number of simulations,
+in order, sharing the transpositions table: the trees of the positions are kept
+for the following ones, that may reach them, and the states not reachable from
+the next position are only freed when the table is half full, instead of after
+every position. has_play[i] is set to true if a play or pass is suggested for
+position i instead of resigning.
+*/
+void evaluate_positions_sims(
+    u32 count,
+    const board b[],
+    const bool is_black[],
+    const u32 simulations[],
+    out_board out_b[],
+    bool has_play[]
+){
+    continue_maintenance(UINT32_MAX);
+    if(count > 0)
+        fit_memory_budget(&b[0], is_black[0]);
+
+    for(u32 i = 0; i < count; ++i)
+    {
+        if(use_opening_book)
+        {
+            board tmp;
+            memcpy(&tmp, &b[i], sizeof(board));
+            d8 reduction = reduce_auto(&tmp, is_black[i]);
+            if(opening_book(&out_b[i], &tmp))
+            {
+                out_board_revert_reduce(&out_b[i], reduction);
+                has_play[i] = true;
+                continue;
+            }
+        }
+
+        if(tt_memory_in_use() >= max_size_in_mbs * 1048576 / 2)
+        {
+            tt_requires_maintenance = true;
+            start_maintenance(&b[i], is_black[i]);
+            continue_maintenance(UINT32_MAX);
+        }
+
+        has_play[i] = mcts_start_sims(&out_b[i], &b[i], is_black[i],
+            simulations[i], 0);
+        tt_requires_maintenance = true;
+    }
+}
+
 /*
 Evaluates the position with the number of simulations available.
 RETURNS true if a play or pass is suggested instead of resigning
@@ -148,56 +482,230 @@ bool evaluate_position_sims(
         board tmp;
         memcpy(&tmp, b, sizeof(board));
         d8 reduction = reduce_auto(&tmp, is_black);
-        if(opening_book(out_b, &tmp))
+        bool found = opening_book(out_b, &tmp);
+        latency_mark(LAT_OPENING_BOOK);
+        if(found)
         {
             out_board_revert_reduce(out_b, reduction);
             return true;
         }
     }
 
-    bool ret = mcts_start_sims(out_b, b, is_black, simulations);
+    /* searches can't run while states are being freed */
+    continue_maintenance(UINT32_MAX);
+    fit_memory_budget(b, is_black);
+    latency_mark(LAT_MAINTENANCE);
+    bool ret = mcts_start_sims(out_b, b, is_black, simulations, 0);
+    latency_mark(LAT_SEARCH);
     tt_requires_maintenance = true;
     return ret;
 }
 
 /*
-Evaluate the position for a short amount of time, ignoring the quality matrix
-produced.
+Estimates the ownership of the points of board b, from -1 for points owned by
+white to 1 for points owned by black, from the playouts of the searches already
+made of the position. A short search is made first if there were none.
 */
-void evaluate_in_background(
+void estimate_ownership(
+    const board * b,
+    bool is_black,
+    float owner[TOTAL_BOARD_SIZ]
+){
+    if(mcts_ownership(b, owner))
+        return;
+
+    /* searches can't run while states are being freed */
+    continue_maintenance(UINT32_MAX);
+    out_board out_b;
+    mcts_start_sims(&out_b, b, is_black, OWNERSHIP_SIMULATIONS, 0);
+    tt_requires_maintenance = true;
+
+    if(!mcts_ownership(b, owner))
+        memset(owner, 0, TOTAL_BOARD_SIZ * sizeof(float));
+}
+
+/*
+Marks the stones of board b that are estimated dead: owned by the opponent at
+the end of most playouts.
+*/
+void estimate_dead_stones(
+    const board * b,
+    bool is_black,
+    bool dead[TOTAL_BOARD_SIZ]
+){
+    float owner[TOTAL_BOARD_SIZ];
+    estimate_ownership(b, is_black, owner);
+
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+        dead[m] = (b->p[m] == BLACK_STONE && owner[m] < 0.0) || (b->p[m] ==
+            WHITE_STONE && owner[m] > 0.0);
+}
+
+/*
+Scores board b by area, after removing the stones estimated dead.
+RETURNS positive score for a black win; negative for a white win; 0 for a draw
+*/
+d16 estimate_final_score(
     const board * b,
     bool is_black
 ){
-    mcts_resume(b, is_black);
+    bool dead[TOTAL_BOARD_SIZ];
+    estimate_dead_stones(b, is_black, dead);
+
+    u8 p[TOTAL_BOARD_SIZ];
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+        p[m] = dead[m] ? EMPTY : b->p[m];
+
+    return score_stones_and_area(p);
+}
+
+/*
+Evaluates the position in the cleanup phase of a game, with a short search of up
+to CLEANUP_SIMULATIONS, stopped at stop_time if not 0; its playouts also
+estimate which stones are dead.
+*/
+void evaluate_position_cleanup(
+    const board * b,
+    bool is_black,
+    out_board * out_b,
+    u64 stop_time
+){
+    /* searches can't run while states are being freed */
+    continue_maintenance(UINT32_MAX);
+    fit_memory_budget(b, is_black);
+    latency_mark(LAT_MAINTENANCE);
+    mcts_start_sims(out_b, b, is_black, CLEANUP_SIMULATIONS, stop_time);
+    latency_mark(LAT_SEARCH);
     tt_requires_maintenance = true;
 }
 
-static void freed_mem_message(
-    u32 states
+/*
+Chooses the play of the cleanup phase of a game, when the only goal left is to
+capture the stones of the opponent clearly owned by the player: the best play of
+the evaluation on a liberty of a dead group. Passes once there are no such
+stones, or no legal plays on their liberties, so the cleanup doesn't go on
+filling the board.
+RETURNS the move selected, or a pass
+*/
+move select_cleanup_play(
+    const out_board * evaluation,
+    const board * b,
+    bool is_black,
+    const game_record * gr
 ){
-    if(states == 0)
-        return;
+    float owner[TOTAL_BOARD_SIZ];
+    estimate_ownership(b, is_black, owner);
+
+    /* the liberties of the dead stones of the opponent */
+    out_board targets;
+    memcpy(&targets, evaluation, sizeof(out_board));
+    memset(targets.tested, false, sizeof(targets.tested));
+    targets.pass = -1.0;
+    u8 opponent = is_black ? WHITE_STONE : BLACK_STONE;
+    bool dead_stones = false;
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+    {
+        if(b->p[m] != opponent || (is_black ? owner[m] : -owner[m]) <=
+            CLEANUP_DEAD_OWNERSHIP)
+            continue;
 
-    char * s = alloc();
-    char * s2 = alloc();
+        dead_stones = true;
+        for(u8 k = 0; k < neighbors_side[m].count; ++k)
+        {
+            move n = neighbors_side[m].coord[k];
+            if(b->p[n] == EMPTY)
+                targets.tested[n] = evaluation->tested[n];
+        }
+    }
 
-    format_mem_size(s2, states * sizeof(tt_stats));
-    snprintf(s, MAX_PAGE_SIZ, "freed %u states (%s)", states, s2);
-    flog_info("engn", s);
+    if(!dead_stones)
+        return PASS;
 
-    release(s2);
-    release(s);
+    return select_play(&targets, is_black, gr);
+}
+
+/*
+Evaluate the position until stop_requested returns true, ignoring the quality
+matrix produced. The between-turn maintenance is performed first, in steps, so
+it is not paid when the next turn starts. May return early if the search can't
+go on. If pondering, is_black is the opponent and the simulations are
+concentrated on its most likely replies; the share of them kept is logged once
+it replies.
+*/
+void evaluate_in_background(
+    const board * b,
+    bool is_black,
+    bool (* stop_requested)(),
+    bool pondering
+){
+    if(!tt_clean_unreachable_pending())
+        start_maintenance(b, is_black);
+
+    while(!continue_maintenance(MAINTENANCE_STEP_BUCKETS))
+        if(stop_requested())
+            return;
+
+    mcts_resume(b, is_black, stop_requested, pondering);
+    if(pondering)
+        pondered_states = tt_states_in_use();
+
+    /* the states created are all reachable from b unless b changed */
+    if(maintained_hash != zobrist_new_hash(b) || maintained_is_black !=
+        is_black)
+        tt_requires_maintenance = true;
+}
+
+/*
+Saves the search information of the subtree of board b, played by is_black, to
+a file, so the search can be resumed later, also by another process.
+RETURNS number of states saved, or 0 on failure
+*/
+u32 save_search_tree(
+    const board * b,
+    bool is_black,
+    const char * filename
+){
+    /* the tree can't be read while states are being freed */
+    continue_maintenance(UINT32_MAX);
+    return tt_export_subtree(b, is_black, filename);
+}
+
+/*
+Replaces the search information with that of a file written by
+save_search_tree, so searches of its positions resume from it.
+RETURNS number of states loaded, or 0 on failure
+*/
+u32 load_search_tree(
+    const char * filename
+){
+    continue_maintenance(UINT32_MAX);
+    u32 states = tt_import_subtree(filename);
+    /* the tree may not be of the current position */
+    tt_requires_maintenance = true;
+    return states;
 }
 
 /*
 Inform that we are currently between matches and proceed with the maintenance
-that is suitable at the moment.
+that is suitable at the moment. The dynamic komi is reset.
 */
 void new_match_maintenance()
 {
+    dynamic_komi = 0;
+    playout_clear_replies();
+    continue_maintenance(UINT32_MAX);
+
+    /* the trees of the other games sharing the table are kept */
+    if(tt_kept_roots() > 0)
+    {
+        tt_requires_maintenance = true;
+        return;
+    }
+
+    u64 mem_before = tt_memory_in_use();
     u32 freed = tt_clean_all();
     tt_requires_maintenance = false;
-    freed_mem_message(freed);
+    freed_mem_message(freed, mem_before - tt_memory_in_use());
 }
 
 /*
@@ -209,12 +717,8 @@ void opt_turn_maintenance(
     const board * b,
     bool is_black
 ){
-    if(tt_requires_maintenance)
-    {
-        u32 freed = tt_clean_unreachable(b, is_black);
-        tt_requires_maintenance = false;
-        freed_mem_message(freed);
-    }
+    start_maintenance(b, is_black);
+    continue_maintenance(UINT32_MAX);
 }
 
 /*
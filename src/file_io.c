@@ -15,6 +15,7 @@ Functions for file input/output.
 #include <errno.h>
 
 #include "alloc.h"
+#include "crc32.h"
 #include "engine.h"
 #include "flog.h"
 #include "types.h"
@@ -176,58 +177,94 @@ static bool ends_in(
 }
 
 
-static u32 allocated;
-static u32 filenames_found;
-static u32 _max_files;
-
-static void _recurse_find_files(
-    const char * root,
+static u32 _for_each_file(
+    char path[MAX_PATH_SIZ],
+    u32 path_len,
     const char * extension,
-    char ** filenames
+    void (* found)(const char * filename, void * arg),
+    void * arg
 ){
     DIR * dir;
     struct dirent * entry;
-    if(!(dir = opendir(root)))
-        return;
-    while(filenames_found <= _max_files && (entry = readdir(dir)) != NULL)
+    if(!(dir = opendir(path)))
+        return 0;
+
+    u32 files_found = 0;
+    while((entry = readdir(dir)) != NULL)
     {
         if(entry->d_name[0] == '.') /* ignore special and hidden files */
             continue;
-        u32 strl = strlen(root) + strlen(entry->d_name) + 2;
-        if(strl >= MAX_PATH_SIZ)
+        u32 name_len = strlen(entry->d_name);
+        if(path_len + name_len + 2 >= MAX_PATH_SIZ)
             flog_crit("file", "path too long");
 
+        memcpy(path + path_len, entry->d_name, name_len + 1);
+
         if(!ends_in(entry->d_name, extension)) /* try following as if folder */
         {
-            char * path = (char *)malloc(strl);
-            if(path == NULL)
-                flog_crit("file", "find files: system out of memory");
-
-            snprintf(path, strl, "%s%s/", root, entry->d_name);
-            _recurse_find_files(path, extension, filenames);
-            free(path);
+            path[path_len + name_len] = '/';
+            path[path_len + name_len + 1] = 0;
+            files_found += _for_each_file(path, path_len + name_len + 1,
+                extension, found, arg);
         }
         else
         {
-            allocated += strl;
-            filenames[filenames_found] = (char *)malloc(strl);
-            if(filenames[filenames_found] == NULL)
-                flog_crit("file", "find files: system out of memory");
-
-            snprintf(filenames[filenames_found], strl, "%s%s", root,
-                entry->d_name);
-            filenames_found++;
-            if(filenames_found > _max_files)
-            {
-                char * s = alloc();
-                snprintf(s, MAX_PAGE_SIZ,
-                    "maximum number of files (%u) reached", _max_files);
-                flog_crit("file", s);
-                release(s);
-            }
+            found(path, arg);
+            ++files_found;
         }
     }
+    path[path_len] = 0;
     closedir(dir);
+    return files_found;
+}
+
+/*
+Searches for the files ending with the text present in extension, and calls
+found with the relative path of each as soon as it is found; the path is only
+valid during the call. No file names are kept, so there is no limit to the
+number of files.
+RETURNS number of files found
+*/
+u32 for_each_file(
+    const char * root,
+    const char * extension,
+    void (* found)(const char * filename, void * arg),
+    void * arg
+){
+    char path[MAX_PATH_SIZ];
+    u32 root_len = strlen(root);
+    if(root_len >= MAX_PATH_SIZ)
+        flog_crit("file", "path too long");
+    memcpy(path, root, root_len + 1);
+    return _for_each_file(path, root_len, extension, found, arg);
+}
+
+typedef struct __file_list_ {
+    char ** filenames;
+    u32 filenames_found;
+    u32 max_files;
+} file_list;
+
+static void add_to_file_list(
+    const char * filename,
+    void * arg
+){
+    file_list * list = (file_list *)arg;
+    if(list->filenames_found == list->max_files)
+    {
+        char * s = alloc();
+        snprintf(s, MAX_PAGE_SIZ, "maximum number of files (%u) reached",
+            list->max_files);
+        flog_crit("file", s);
+        release(s);
+    }
+
+    u32 strl = strlen(filename) + 1;
+    char * copy = (char *)malloc(strl);
+    if(copy == NULL)
+        flog_crit("file", "find files: system out of memory");
+    memcpy(copy, filename, strl);
+    list->filenames[list->filenames_found++] = copy;
 }
 
 /*
@@ -242,8 +279,28 @@ u32 recurse_find_files(
     char ** filenames,
     u32 max_files
 ){
-    filenames_found = 0;
-    _max_files = max_files;
-    _recurse_find_files(root, extension, filenames);
-    return filenames_found;
+    file_list list;
+    list.filenames = filenames;
+    list.filenames_found = 0;
+    list.max_files = max_files;
+    for_each_file(root, extension, add_to_file_list, &list);
+    return list.filenames_found;
+}
+
+/*
+Fingerprint of the name, size and modification time of a file, to detect that
+it changed without reading it.
+RETURNS fingerprint, or 0 if the file does not exist
+*/
+u32 file_fingerprint(
+    const char * filename
+){
+    struct stat st;
+    if(stat(filename, &st) != 0)
+        return 0;
+
+    u64 v[2];
+    v[0] = (u64)st.st_size;
+    v[1] = (u64)st.st_mtime;
+    return crc32(filename, strlen(filename)) ^ crc32(v, sizeof(v));
 }
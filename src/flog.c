@@ -7,6 +7,11 @@ actively hurts the performance.
 
 Writing to files is synchronous (with fsync) to avoid loss of data in case of
 crashes, but it is impossible to guarantee this in all cases.
+
+With LOG_BUFFERED_WRITES the messages are instead appended to a memory buffer,
+and written to file by flog_flush, which is called between commands, when the
+buffer is full, on exit and after critical and warning messages -- these are
+still synchronous. So the searching threads don't wait for the disk.
 */
 
 #include "config.h"
@@ -41,10 +46,16 @@ static u16 log_mode = (LOG_MODE_ERROR | LOG_MODE_WARN | LOG_MODE_PROT |
     LOG_MODE_INFO | LOG_MODE_DEBUG);
 static u16 log_dest = LOG_DEST_STDF;
 
+#if LOG_BUFFERED_WRITES
+static char log_buffer[LOG_BUFFER_SIZ];
+static u32 log_buffered = 0;
+#endif
+
 /*
 For non-default values for build_info
 */
 extern u64 max_size_in_mbs;
+extern const u8 constant_tables_size;
 extern double prior_stone_scale_factor;
 extern u16 prior_even;
 extern u16 prior_nakade;
@@ -58,11 +69,15 @@ extern u16 prior_line3;
 extern u16 prior_empty;
 extern u16 prior_corner;
 extern double rave_equiv;
+extern double virtual_loss;
+extern u16 leaf_playouts;
+extern bool pl_light_playouts;
 extern u16 pl_skip_saving;
 extern u16 pl_skip_nakade;
 extern u16 pl_skip_pattern;
 extern u16 pl_skip_capture;
 extern u16 pl_ban_self_atari;
+extern u16 pl_skip_lgr;
 extern d16 komi;
 
 static void open_log_file();
@@ -70,7 +85,8 @@ static void open_log_file();
 static void flog(
     const char * severity,
     const char * context,
-    const char * msg
+    const char * msg,
+    bool sync
 );
 
 /*
@@ -108,7 +124,7 @@ void flog_config_modes(
                     idx += snprintf(s + idx, MAX_PAGE_SIZ - idx, "dbug,");
                 s[idx - 1] = 0;
             }
-            flog(NULL, NULL, s);
+            flog(NULL, NULL, s, false);
             release(s);
             return;
         }
@@ -117,7 +133,8 @@ void flog_config_modes(
     {
         if(log_file != -1)
         {
-            flog(NULL, NULL, "logging disabled");
+            flog(NULL, NULL, "logging disabled", false);
+            flog_flush();
             close(log_file);
         }
         log_file = -1;
@@ -149,10 +166,38 @@ static bool multiline(
     return !(t == NULL || t == s + (strlen(s) - 1));
 }
 
+#if LOG_BUFFERED_WRITES
+/*
+Must be called inside the flog_buffer critical section.
+*/
+static void write_log_buffer()
+{
+    if(log_buffered > 0 && log_file != -1)
+        write(log_file, log_buffer, log_buffered);
+    log_buffered = 0;
+}
+#endif
+
+/*
+Writes the messages buffered to the log file, if any.
+*/
+void flog_flush()
+{
+#if LOG_BUFFERED_WRITES
+    #pragma omp critical(flog_buffer)
+    write_log_buffer();
+#endif
+}
+
+/*
+With LOG_BUFFERED_WRITES the message is only written to file immediately, and
+synced, if sync is true.
+*/
 static void flog(
     const char * severity,
     const char * context,
-    const char * msg
+    const char * msg,
+    bool sync
 ){
     if(!log_dest)
         return;
@@ -182,8 +227,23 @@ static void flog(
     {
         open_log_file();
         u32 len = strlen(s);
+#if LOG_BUFFERED_WRITES
+        #pragma omp critical(flog_buffer)
+        {
+            if(log_buffered + len > LOG_BUFFER_SIZ)
+                write_log_buffer();
+            memcpy(log_buffer + log_buffered, s, len);
+            log_buffered += len;
+            if(sync)
+            {
+                write_log_buffer();
+                fsync(log_file);
+            }
+        }
+#else
         write(log_file, s, len);
         fsync(log_file);
+#endif
     }
 
     if(log_dest & LOG_DEST_STDF)
@@ -208,6 +268,9 @@ static void open_log_file()
             log_dest &= ~LOG_DEST_FILE;
             return;
         }
+#if LOG_BUFFERED_WRITES
+        atexit(flog_flush);
+#endif
 
         char * s = alloc();
 
@@ -231,7 +294,7 @@ static void open_log_file()
             s[idx - 1] = 0;
         }
 
-        flog(NULL, NULL, s);
+        flog(NULL, NULL, s, false);
         release(s);
     }
 }
@@ -261,6 +324,9 @@ void build_info(
 
     idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx, "Board size: %ux%u\n",
         BOARD_SIZ, BOARD_SIZ);
+    idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx, "Constant tables: %s\n",
+        constant_tables_size == BOARD_SIZ ? "compiled in" :
+        "computed at startup");
 
     char * kstr = alloc();
     komi_to_string(kstr, komi);
@@ -287,6 +353,8 @@ void build_info(
         "Transpositions table memory: %s\n", s);
     release(s);
 
+    idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx, "Playouts: %s\n",
+        pl_light_playouts ? "light" : "heavy");
     if(pl_skip_saving)
         idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
             "  Chance of skipping save: %u/128\n", pl_skip_saving);
@@ -302,6 +370,11 @@ void build_info(
     if(pl_ban_self_atari)
         idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
             "  Chance of prohibiting self-atari: %u/128\n", pl_ban_self_atari);
+    idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
+        "  Last good reply: %s\n", YN(PL_LAST_GOOD_REPLY));
+    if(PL_LAST_GOOD_REPLY && pl_skip_lgr)
+        idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
+            "  Chance of skipping last good reply: %u/128\n", pl_skip_lgr);
     idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
         "  Use pattern weights: %s\n", YN(USE_PATTERN_WEIGHTS));
     idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
@@ -338,12 +411,19 @@ void build_info(
     idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx, "Max UCT depth: %u\n",
         MAX_UCT_DEPTH);
     idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
-        "UCT expansion delay: %u\n", UCT_EXPANSION_DELAY);
+        "UCT expansion delay: %u (up to %u with memory use)\n",
+        UCT_EXPANSION_DELAY, UCT_EXPANSION_DELAY_MAX);
+    idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
+        "UCT virtual loss: %.2f\n", virtual_loss);
+    idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
+        "UCT playouts per leaf: %u\n", leaf_playouts);
     idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
         "Playout depth over number of empty points: %u\n",
         MAX_PLAYOUT_DEPTH_OVER_EMPTY);
     idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
         "Mercy threshold: %u stones\n", MERCY_THRESHOLD);
+    idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
+        "Adaptive playout cutoffs: %s\n", YN(PL_ADAPTIVE_CUTOFFS));
 
     idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx,
         "Constant latency compensation: %u ms\n", LATENCY_COMPENSATION);
@@ -377,8 +457,8 @@ void flog_crit(
 ){
     if((log_mode & LOG_MODE_ERROR) != 0)
     {
-        flog("crit", ctx, msg);
-        flog(NULL, NULL, "execution aborted due to program panic");
+        flog("crit", ctx, msg, true);
+        flog(NULL, NULL, "execution aborted due to program panic", true);
     }
     else
         fprintf(stderr, "execution aborted due to program panic\n");
@@ -395,7 +475,7 @@ void flog_warn(
     const char * msg
 ){
     if((log_mode & LOG_MODE_WARN) != 0)
-        flog("warn", ctx, msg);
+        flog("warn", ctx, msg, true);
 }
 
 
@@ -407,7 +487,7 @@ void flog_prot(
     const char * msg
 ){
     if((log_mode & LOG_MODE_PROT) != 0)
-        flog("prot", ctx, msg);
+        flog("prot", ctx, msg, false);
 }
 
 
@@ -419,7 +499,7 @@ void flog_info(
     const char * msg
 ){
     if((log_mode & LOG_MODE_INFO) != 0)
-        flog("info", ctx, msg);
+        flog("info", ctx, msg, false);
 }
 
 
@@ -431,5 +511,5 @@ void flog_debug(
     const char * msg
 ){
     if((log_mode & LOG_MODE_DEBUG) != 0)
-        flog("dbug", ctx, msg);
+        flog("dbug", ctx, msg, false);
 }
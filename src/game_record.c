@@ -27,9 +27,7 @@ http://www.weddslist.com/kgs/past/superko.html
 #include "state_changes.h"
 #include "stringm.h"
 #include "types.h"
-
-static board current_game_bak;
-static bool current_game_bak_set = false;
+#include "zobrist.h"
 
 static void apply_handicap_stones(
     board * b,
@@ -39,6 +37,58 @@ static void apply_handicap_stones(
         just_play_slow(b, true, gr->handicap_stones.coord[i]);
 }
 
+/*
+Adds the position of index idx in hashes to the set of positions.
+*/
+static void add_to_hash_set(
+    game_record * gr,
+    u16 idx
+){
+    u32 key = (u32)(gr->hashes[idx] & (GAME_HASH_SET_SIZ - 1));
+    while(gr->hash_set[key] != 0)
+        key = (key + 1) & (GAME_HASH_SET_SIZ - 1);
+    gr->hash_set[key] = idx + 1;
+}
+
+/*
+Advances the current state with the play of turn turn, and records the
+resulting position.
+*/
+static void advance_state(
+    game_record * gr,
+    u16 turn,
+    bool is_black
+){
+    if(is_board_move(gr->moves[turn]))
+        just_play_slow(&gr->state, is_black, gr->moves[turn]);
+    else
+        pass(&gr->state);
+
+    gr->hashes[turn + 1] = zobrist_new_hash(&gr->state);
+    pack_matrix(gr->packed[turn + 1], gr->state.p);
+    add_to_hash_set(gr, turn + 1);
+}
+
+/*
+Recomputes the current state and the positions of the game from its plays.
+*/
+static void rebuild_positions(
+    game_record * gr
+){
+    memset(gr->hash_set, 0, sizeof(gr->hash_set));
+    first_game_state(&gr->state, gr);
+    gr->hashes[0] = zobrist_new_hash(&gr->state);
+    pack_matrix(gr->packed[0], gr->state.p);
+    add_to_hash_set(gr, 0);
+
+    bool is_black = first_player_color(gr);
+    for(u16 i = 0; i < gr->turns; ++i)
+    {
+        advance_state(gr, i, is_black);
+        is_black = !is_black;
+    }
+}
+
 /*
 Clear the entire game record including handicap stones.
 */
@@ -50,7 +100,7 @@ void clear_game_record(
     gr->handicap_stones.count = 0;
     gr->turns = 0;
     gr->finished = gr->resignation = gr->timeout = gr->player_names_set = false;
-    current_game_bak_set = false;
+    rebuild_positions(gr);
 }
 
 /*
@@ -63,11 +113,11 @@ void add_play(
     move m
 ){
     gr->moves[gr->turns] = m;
+    advance_state(gr, gr->turns, current_player_color(gr));
     gr->turns++;
     if(gr->turns == MAX_GAME_LENGTH)
         flog_crit("gr", "the maximum number of plays has been reached");
     gr->finished = false;
-    current_game_bak_set = false;
 }
 
 /*
@@ -182,49 +232,62 @@ void fprint_game_record(
 }
 
 /*
-Returns whether a play is a superko violation. Does not test other legality
-restrictions.
-RETURNS true if illegal by positional superko.
+Tests whether a position, of stones p and Zobrist hash hash, has occurred in the
+game. The stones are only compared if the hash is found. Is meant for searches.
+RETURNS true if the position has occurred
 */
-bool test_superko(
+bool position_in_game_record(
     const game_record * gr,
-    bool is_black,
-    move m
+    u64 hash,
+    const u8 p[TOTAL_BOARD_SIZ]
 ){
-    board tmp;
-    first_game_state(&tmp, gr);
-
-    board current_state;
-    current_game_state(&current_state, gr);
+    u8 packed[PACKED_BOARD_SIZ];
+    bool is_packed = false;
 
-    /*
-    State after playing
-    */
-    just_play_slow(&current_state, is_black, m);
-
-    bool captured = false;
-
-    bool is_b = first_player_color(gr);
-    for(u16 i = 0; i < gr->turns; ++i)
+    u32 key = (u32)(hash & (GAME_HASH_SET_SIZ - 1));
+    for(; gr->hash_set[key] != 0; key = (key + 1) & (GAME_HASH_SET_SIZ - 1))
     {
-        if(is_board_move(gr->moves[i]))
-        {
-            u16 caps;
-            just_play_slow2(&tmp, is_b, gr->moves[i], &caps);
-            if(caps > 0)
-                captured = true;
+        u16 idx = gr->hash_set[key] - 1;
+        if(gr->hashes[idx] != hash)
+            continue;
 
-            if(captured && memcmp(tmp.p, current_state.p, TOTAL_BOARD_SIZ) == 0)
-                return true;
+        if(!is_packed)
+        {
+            pack_matrix(packed, p);
+            is_packed = true;
         }
-        else
-            pass(&tmp);
-        is_b = !is_b;
+        if(memcmp(gr->packed[idx], packed, PACKED_BOARD_SIZ) == 0)
+            return true;
     }
-
     return false;
 }
 
+/*
+RETURNS the Zobrist hash of the stones of the current position
+*/
+u64 current_game_hash(
+    const game_record * gr
+){
+    return gr->hashes[gr->turns];
+}
+
+/*
+Returns whether a play is a superko violation. Does not test other legality
+restrictions. The position after playing is looked up in the set of positions
+of the game, and only compared in full if its hash is found.
+RETURNS true if illegal by positional superko.
+*/
+bool test_superko(
+    const game_record * gr,
+    bool is_black,
+    move m
+){
+    board after;
+    memcpy(&after, &gr->state, sizeof(board));
+    just_play_slow(&after, is_black, m);
+    return position_in_game_record(gr, zobrist_new_hash(&after), after.p);
+}
+
 /*
 Tests if a play is legal including ko and superko.
 Group suicides are prohibited.
@@ -362,27 +425,25 @@ bool undo_last_play(
     if(gr->turns == 0)
         return false;
 
-    board tmp;
-    first_game_state(&tmp, gr);
-
-    gr->turns--;
-
-    bool is_black = first_player_color(gr);
-    for(u16 i = 0; i < gr->turns; ++i)
-    {
-        if(is_board_move(gr->moves[i]))
-            just_play_slow(&tmp, is_black, gr->moves[i]);
-        else
-            pass(&tmp);
-        is_black = !is_black;
-    }
-
+    truncate_game_record(gr, gr->turns - 1);
     gr->finished = false;
-
-    current_game_bak_set = false;
     return true;
 }
 
+/*
+Drops the plays after the first turns plays, if there are more.
+*/
+void truncate_game_record(
+    game_record * gr,
+    u16 turns
+){
+    if(turns >= gr->turns)
+        return;
+
+    gr->turns = turns;
+    rebuild_positions(gr);
+}
+
 /*
 Adds a handicap stone to a yet-to-start game.
 RETURNS true if stone was added
@@ -403,7 +464,7 @@ bool add_handicap_stone(
 
     gr->handicap_stones.coord[gr->handicap_stones.count] = m;
     gr->handicap_stones.count++;
-    current_game_bak_set = false;
+    rebuild_positions(gr);
     return true;
 }
 
@@ -414,24 +475,7 @@ void current_game_state(
     board * dst,
     const game_record * src
 ){
-    if(!current_game_bak_set)
-    {
-        clear_board(&current_game_bak);
-        apply_handicap_stones(&current_game_bak, src);
-
-        bool is_black = first_player_color(src);
-        for(u16 i = 0; i < src->turns; ++i)
-        {
-            if(is_board_move(src->moves[i]))
-                just_play_slow(&current_game_bak, is_black, src->moves[i]);
-            else
-                pass(&current_game_bak);
-            is_black = !is_black;
-        }
-        current_game_bak_set = true;
-    }
-
-    memcpy(dst, &current_game_bak, sizeof(board));
+    memcpy(dst, &src->state, sizeof(board));
 }
 
 /*
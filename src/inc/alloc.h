@@ -4,10 +4,13 @@ Fast memory allocation layer above standard malloc.
 These are meant to inexpensively allocate buffers for string operations.
 
 They are thread-safe, fast, with canary values used (in debug mode) to ensure
-memory is correctly freed and written to.
+memory is correctly freed and written to. Each thread keeps a small cache of
+free blocks, in front of a list shared by all threads, so most allocations don't
+take the lock.
 
 If you need to perform recursive operations then use malloc/free. Releasing
-these buffers does not free the underlying memory to be used by other programs.
+these buffers does not free the underlying memory to be used by other programs;
+alloc_trim does, for the free blocks not cached by the threads.
 */
 
 #ifndef MATILDA_ALLOC_H
@@ -15,6 +18,8 @@ these buffers does not free the underlying memory to be used by other programs.
 
 #include "config.h"
 
+#include "types.h"
+
 /*
 Initiate the safe allocation functions.
 */
@@ -35,4 +40,12 @@ void release(
     void * ptr
 );
 
+/*
+Frees the blocks of the list shared by all threads, returning their memory to
+the system.
+Thread-safe.
+RETURNS number of bytes freed
+*/
+u64 alloc_trim();
+
 #endif
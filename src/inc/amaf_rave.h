@@ -13,6 +13,7 @@ visited by black and WHITE_STONE for first visited by white.
 #include "config.h"
 
 #include "board.h"
+#include "cfg_board.h"
 #include "types.h"
 #include "transpositions.h"
 
@@ -44,36 +45,42 @@ Use 0 to turn off.
 */
 #define CRITICALITY_THRESHOLD 450
 
+/*
+Number of the visits of a play just before CRITICALITY_THRESHOLD its
+criticality is measured from; the earlier ones, most of the plays of each
+descent, don't update it. Use CRITICALITY_THRESHOLD to measure it from the
+first visit.
+*/
+#define CRITICALITY_SAMPLES 150
+
+#if CRITICALITY_SAMPLES > CRITICALITY_THRESHOLD
+#error CRITICALITY_SAMPLES must not exceed CRITICALITY_THRESHOLD
+#endif
+
 
 
 /*
 Calculation of the RAVE value of a state transition.
-RETURNS overall value of play (x,y)
+RETURNS overall value of play of index k
 */
 double uct1_rave(
-    const tt_play * play
+    const tt_stats * stats,
+    move k
 );
 
 /*
 Batch update of all transitions that were visited anytime after the current
-state (if visited first by the player).
+state (if visited first by the player), over a number of simulations. The
+points first played by the player in any of them are marked in first_set; for
+each of those points, first_n is the number of simulations where it was first
+played by the player, and first_wins how many of those the player won. Only the
+plays of the points marked are visited.
 */
 void update_amaf_stats(
     tt_stats * stats,
-    const u8 traversed[TOTAL_BOARD_SIZ],
-    bool is_black,
-    double z
-);
-
-/*
-Batch update of all transitions that were visited anytime after the current
-state (if visited first by the player).
-This version only adds losses -- it is meant to be used when a draw occurs.
-*/
-void update_amaf_stats2(
-    tt_stats * stats,
-    const u8 traversed[TOTAL_BOARD_SIZ],
-    bool is_black
+    const u64 first_set[LIB_BITMAP_WORDS],
+    const u16 first_n[TOTAL_BOARD_SIZ],
+    const u16 first_wins[TOTAL_BOARD_SIZ]
 );
 
 #endif
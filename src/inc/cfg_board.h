@@ -9,7 +9,9 @@ linked; i.e. changes in one don't reflect in the other.
 Building and destroying (freeing) a cfg_board are costly operations that should
 be used only if the cfg_board will be used in playing many turns. cfg_board
 structures are partially dynamically created and as such cannot be simply
-memcpied to reuse the same starting game point. Undo is also not supported.
+memcpied to reuse the same starting game point. A play can be journaled, with
+cfg_board_journal, to later be undone exactly with cfg_board_undo; which is much
+cheaper than cloning the board to try a play.
 
 Freed cfg_board information is kept in cache for fast access in the future; it
 is best to first free previous instances before creating new ones, thus limiting
@@ -28,7 +30,12 @@ explicitly said so.
 #include "move.h"
 #include "types.h"
 
-#define LIB_BITMAP_SIZ (TOTAL_BOARD_SIZ / 8 + 1)
+/*
+Liberties are kept in bitmaps of 64 bit words; position m is bit m % 64 of word
+m / 64.
+*/
+#define LIB_BITMAP_WORDS (TOTAL_BOARD_SIZ / 64 + 1)
+#define LIB_BIT(m) (((u64)1) << ((m) % 64))
 
 #define MAX_GROUPS (((BOARD_SIZ / 2) + 1) * BOARD_SIZ)
 
@@ -39,16 +46,46 @@ typedef struct __group_ {
     bool is_black;
     u8 unique_groups_idx;
     u8 liberties;
-    u8 ls[LIB_BITMAP_SIZ];
-    move liberties_min_coord;
-    move_seq stones; /* stone 0 if used as representative */
-    u8 neighbors_count;
-    move neighbors[MAX_NEIGHBORS]; /* move id of neighbors */
+    u64 ls[LIB_BITMAP_WORDS];
     u8 eyes;
     u8 borrowed_eyes;
     struct __group_ * next;
+    u8 neighbors_count;
+    move neighbors[MAX_NEIGHBORS]; /* move id of neighbors */
+    /*
+    Kept last, so cloning a group only copies the stones and neighbors in use.
+    */
+    move_seq stones; /* stone 0 if used as representative */
 } group;
 
+/*
+Maximum number of groups captured or merged by a single play.
+*/
+#define MAX_PLAY_FREED_GROUPS 4
+
+/*
+Journal of a play, with what is needed to undo it: copies of the groups the play
+modifies, from before the play, and the fields of the board it changes that
+cannot be recomputed. The Zobrist hash and stone difference updated by
+just_play2 and just_play3 are not recorded.
+*/
+typedef struct __cfg_undo_ {
+    move m;
+    bool is_black;
+    move last_eaten;
+    move last_played;
+    move empty_idx; /* index of m in the list of empty positions */
+    u8 unique_groups_count;
+    move unique_groups[MAX_GROUPS];
+    u8 saved_count;
+    group * saved[MAX_GROUPS]; /* groups modified by the play */
+    group * copies[MAX_GROUPS]; /* and their contents before it */
+    u8 captures_count;
+    u8 captures[4]; /* indexes in saved of the groups captured */
+    u8 freed_count;
+    group * freed[MAX_PLAY_FREED_GROUPS];
+} cfg_undo;
+
 /*
 unique_groups stores IDs of groups, which are the value of a stone that belongs
 to that group, and the g field specifies the group that possesses a certain
@@ -59,6 +96,7 @@ typedef struct __cfg_board_ {
     move last_eaten;
     move last_played;
     u16 hash[TOTAL_BOARD_SIZ]; /* hash of the 3x3 neighborhoods */
+    u8 far_hash[TOTAL_BOARD_SIZ]; /* and of the rest of 12-point patterns */
     move_seq empty; /* free positions of the board */
     u8 black_neighbors4[TOTAL_BOARD_SIZ]; /* stones in the neighborhood */
     u8 white_neighbors4[TOTAL_BOARD_SIZ];
@@ -66,6 +104,7 @@ typedef struct __cfg_board_ {
     u8 white_neighbors8[TOTAL_BOARD_SIZ];
     u8 unique_groups_count;
     move unique_groups[MAX_GROUPS];
+    cfg_undo * undo; /* journal of the next play, or NULL */
     group * g[TOTAL_BOARD_SIZ]; /* CFG stone groups or NULL if empty */
 } cfg_board;
 
@@ -103,6 +142,28 @@ void cfg_board_clone(
     const cfg_board * restrict src
 );
 
+/*
+Starts journaling the next play, of the player is_black at m (or PASS); which
+must then be made with just_play, just_play2, just_play3 or just_pass. The play
+can then be undone with cfg_board_undo, which must be done before the board is
+changed again by other means, or freed; plays journaled later must be undone
+first.
+*/
+void cfg_board_journal(
+    cfg_board * cb,
+    bool is_black,
+    move m,
+    cfg_undo * u
+);
+
+/*
+Undoes a journaled play, restoring the board exactly as it was before it.
+*/
+void cfg_board_undo(
+    cfg_board * cb,
+    const cfg_undo * u
+);
+
 /*
 Apply a passing turn.
 */
@@ -134,17 +195,17 @@ void just_play2(
 
 /*
 Assume play is legal and update the structure, capturing accordingly. Also
-updates a stone difference and fills a matrix of captured stones and a bitmap of
-liberties of neighbors of the captured groups. Does NOT clear the matrix and
-bitmap.
+updates a stone difference, appends the stones captured to a list and fills a
+bitmap of liberties of neighbors of the captured groups. Does NOT clear the list
+and bitmap.
 */
 void just_play3(
     cfg_board * cb,
     bool is_black,
     move m,
     d16 * stone_difference,
-    bool stones_removed[TOTAL_BOARD_SIZ],
-    u8 rem_nei_libs[LIB_BITMAP_SIZ]
+    move_seq * stones_removed,
+    u64 rem_nei_libs[LIB_BITMAP_WORDS]
 );
 
 /*
@@ -165,6 +226,18 @@ move get_ko_play(
     const cfg_board * cb
 );
 
+/*
+Classifies all empty intersections at once, by the counts of their neighbors
+alone and for both players. Marks in safe the intersections with at least two
+empty neighbors: they can't be eyes or in ko, and playing there is legal and
+leaves at least two liberties. The other empty intersections need group
+reasoning, with safe_to_play or libs_after_play.
+*/
+void cfg_classify_empty(
+    const cfg_board * cb,
+    u64 safe[LIB_BITMAP_WORDS]
+);
+
 /*
 Calculates the liberties after playing and the number of stones captured.
 Does not test ko.
@@ -237,6 +310,15 @@ void cfg_board_free(
     cfg_board * cb
 );
 
+/*
+Returns to the system the chunks of groups whose groups are all in the lists of
+free groups of the threads of a parallel region, removing them from the lists.
+Chunks with groups in use, or kept by threads outside of the region, are kept.
+Must not be called while boards are being used by other threads.
+RETURNS number of bytes freed
+*/
+u64 cfg_board_trim_pool();
+
 /*
 Print structure information for debugging.
 */
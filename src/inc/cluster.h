@@ -0,0 +1,70 @@
+/*
+Cluster search: several Matilda processes, usually in different machines,
+searching the same position at the same time, for root parallelization beyond
+the cores and memory of one machine.
+
+One process, the coordinator, plays; the others are workers started with
+--cluster_worker, listening on a TCP port. When the coordinator starts a timed
+search it sends the position to the workers, that search it with their own
+seeds, threads and transpositions tables until told to stop. Every
+CLUSTER_EXCHANGE_INTERVAL milliseconds the workers report the statistics of the
+plays of their root, and the visits made since their previous report are merged
+into the root of the coordinator; so its time management and the play chosen
+from its out_board take all of them into account. Only the root is shared; the
+deeper trees of each process are independent.
+*/
+
+#ifndef MATILDA_CLUSTER_H
+#define MATILDA_CLUSTER_H
+
+#include "config.h"
+
+#include "board.h"
+#include "types.h"
+
+#define CLUSTER_MAX_WORKERS 32
+
+/*
+Milliseconds between the reports of the root statistics of the workers.
+*/
+#define CLUSTER_EXCHANGE_INTERVAL 200
+
+/*
+Maximum milliseconds the coordinator waits for the last report of the workers
+when its search ends.
+*/
+#define CLUSTER_FINAL_WAIT 250
+
+
+/*
+Connects to the workers listed, as comma separated host:port addresses, that
+will search with the following timed searches. Workers that can't be reached
+are ignored, with a warning.
+RETURNS number of workers connected
+*/
+u16 cluster_connect(
+    const char * addresses
+);
+
+/*
+Starts the search of board b, by is_black, by the workers connected, until at
+most max_stop_time; they are stopped when the next timed search, of the same
+position, ends, and their statistics merged into its root. Does nothing if
+there are no workers.
+*/
+void cluster_search_start(
+    const board * b,
+    bool is_black,
+    u64 max_stop_time
+);
+
+/*
+Main function for the cluster worker mode: listens on a TCP port for a
+coordinator, and searches the positions it sends, one connection at a time.
+Does not return.
+*/
+void cluster_worker(
+    u16 port
+);
+
+#endif
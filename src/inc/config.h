@@ -13,8 +13,11 @@ the default value.
 Board/goban size given by the length of one side.
 
 EXPECTED: 5, 7, 9, 11, 13, 15, 17, 19 or 21
+Can also be given at compile time, as make multisize does.
 */
+#ifndef BOARD_SIZ
 #define BOARD_SIZ 19
+#endif
 
 /*
 Default komidashi used, multiplied by 2 to give an integer number.
@@ -73,7 +76,7 @@ Select the number of threads to be used by OpenMP.
 The value 0 means automatic, which should be equal to the number of real cores
 plus hyperthreaded.
 
-EXPECTED: 0 to 64
+EXPECTED: 0 to MAXIMUM_NUM_THREADS
 */
 #define DEFAULT_NUM_THREADS 0
 
@@ -81,22 +84,38 @@ EXPECTED: 0 to 64
 /*
 Hard limit on number of threads. This is used just for initialization, not for
 limiting dynamic number of OpenMP threads (which, by the way, are disabled).
-Just set a very high number.
+The state of each thread is only allocated for the threads in use, so it can be
+set well above the number of cores.
 
-EXPECTED: 1 to 64
+EXPECTED: 1 to 1024
 */
-#define MAXIMUM_NUM_THREADS 8
+#define MAXIMUM_NUM_THREADS 1024
 
 
 /*
-Set how many visits are needed before expanding a new state in MCTS. If the
-program is running out of memory mid-turn consider increasing this value.
+Set how many visits are needed before expanding a new state in MCTS.
 Tuned with CLOP in 9x9 with 10k playouts/turn in self-play for 34k games.
 
 EXPECTED: 0 to 10
 */
 #define UCT_EXPANSION_DELAY 5
 
+/*
+The expansion delay of the new states rises with the memory in use by the
+transpositions table, from UCT_EXPANSION_PRESSURE_START of the limit, up to
+UCT_EXPANSION_DELAY_MAX visits when it is full; so long searches keep expanding
+the most visited part of the tree instead of running out of memory. It falls to
+no delay for the states UCT_EXPANSION_ROOT_DEPTH plays or less from the root,
+and to half the tuned delay for the children of states with
+UCT_EXPANSION_HOT_VISITS simulations or more.
+
+EXPECTED: UCT_EXPANSION_DELAY to 127, 0.0 to 1.0, 0 to 10 and 1 or more
+*/
+#define UCT_EXPANSION_DELAY_MAX 64
+#define UCT_EXPANSION_PRESSURE_START 0.5
+#define UCT_EXPANSION_ROOT_DEPTH 2
+#define UCT_EXPANSION_HOT_VISITS 1024
+
 
 /*
 Set the default time, in milliseconds, to be used to think per turn.
@@ -189,6 +208,11 @@ functions: fdopen, strtok_r, rand_r, fsync
 #error Error: illegal UCT expansion delay value.
 #endif
 
+#if UCT_EXPANSION_DELAY_MAX < UCT_EXPANSION_DELAY || \
+    UCT_EXPANSION_DELAY_MAX > 127
+#error Error: illegal UCT maximum expansion delay value.
+#endif
+
 #if MAXIMUM_NUM_THREADS < 1
 #error Error: illegal maximum number of threads (< 1).
 #endif
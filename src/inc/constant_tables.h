@@ -0,0 +1,14 @@
+/*
+Placeholder for when the tables of constants were not generated: the tables are
+computed at startup instead.
+
+gen_constant_tables writes gen/constant_tables.h, with the board size they were
+generated for, which is found before this file as gen/ is searched first.
+*/
+
+#ifndef MATILDA_CONSTANT_TABLES_H
+#define MATILDA_CONSTANT_TABLES_H
+
+#define CONSTANT_TABLES_SIZ 0
+
+#endif
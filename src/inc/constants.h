@@ -15,7 +15,9 @@ bool border_bottom[TOTAL_BOARD_SIZ];
 u8 distances_to_border[TOTAL_BOARD_SIZ];
 move_seq nei_dst_3[TOTAL_BOARD_SIZ];
 move_seq nei_dst_4[TOTAL_BOARD_SIZ];
-u8 active_bits_in_byte[256];
+
+If the tables were generated for the board size in use, by gen_constant_tables,
+they are defined already initialized in gen/constant_tables.c instead.
 */
 
 #ifndef MATILDA_CONSTANTS_H
@@ -23,10 +25,38 @@ u8 active_bits_in_byte[256];
 
 #include "config.h"
 
+/*
+Eye shape flags of an empty point for a player, by the code of its 3x3
+neighborhood, in black_eye_shapes and white_eye_shapes. Own neighbors include
+the points out of the board.
+*/
+/* center of a straight or bent three, pyramid four or crossed five */
+#define EYE_SHAPE_NAKADE3 1
+/* center of a bulky five or rabbity six */
+#define EYE_SHAPE_NAKADE5 2
+/* end of an eye space: three sides own, too few opponent diagonals to cut */
+#define EYE_SHAPE_END 4
+/* corner of a bulky five or rabbity six: two sides and diagonals own */
+#define EYE_SHAPE_CORNER 8
+/* point of a 2-point eye: three sides own and six or more neighbors own */
+#define EYE_SHAPE_2PT 16
+/* and seven neighbors own */
+#define EYE_SHAPE_2PT_SOLID 32
+/* point of a 4-point squared eye with all other neighbors own */
+#define EYE_SHAPE_4PT 64
+/* away from the border, with two sides and one diagonal other neighbor own */
+#define EYE_SHAPE_4PT_WEAK 128
+
 
 /*
 Initialize a series of constants based on the board size in use.
 */
 void board_constants_init();
 
+/*
+Computes the constants based on the board size in use, even if they were
+compiled in already.
+*/
+void board_constants_compute();
+
 #endif
@@ -0,0 +1,61 @@
+/*
+Binary data pack: a single file, NxN.pack in the data folder, with the data
+otherwise parsed and expanded at startup already in the layout used in memory,
+in sections that belong to the modules that use them. The file is mapped
+read-only, so nothing is copied while loading and its pages are shared between
+Matilda processes.
+
+The pack is generated from the data files by gen_data_pack. Each section keeps
+a fingerprint of the files it was generated from, and is only used while they
+are unchanged; otherwise the files are read as usual.
+*/
+
+#ifndef MATILDA_DATA_PACK_H
+#define MATILDA_DATA_PACK_H
+
+#include "config.h"
+
+#include "types.h"
+
+#define DATA_PACK_VERSION 3
+
+/* section identifiers */
+#define DATA_PACK_ZOBRIST 0
+#define DATA_PACK_PAT3 1
+#define DATA_PACK_PAT12 2
+#define DATA_PACK_OPENING_BOOK 3
+
+#define DATA_PACK_SECTIONS 4
+
+
+/*
+Prevents the data pack from being used, so the data files are read instead.
+Must be called before the first data is read.
+*/
+void data_pack_disable();
+
+/*
+Maps the data pack of the board size in use, on the first call, and looks up
+one of its sections, generated from the files with the fingerprint specified.
+RETURNS pointer to the section contents, 8-byte aligned, or NULL if there is no
+usable data pack or the section is empty or out of date
+*/
+const void * data_pack_section(
+    u8 id,
+    u32 fingerprint,
+    u64 * size
+);
+
+/*
+Writes a data pack with the contents of each section and the fingerprint of the
+files it was generated from; empty sections have size 0.
+RETURNS true if written successfully
+*/
+bool data_pack_write(
+    const char * filename,
+    const void * const contents[DATA_PACK_SECTIONS],
+    const u64 sizes[DATA_PACK_SECTIONS],
+    const u32 fingerprints[DATA_PACK_SECTIONS]
+);
+
+#endif
@@ -5,9 +5,12 @@ A data set file is defined as 4 bytes (unsigned int) indicating the
 number of training cases, followed by the elements of struct
 training_example type.
 
-The examples are stored unique and invariant of flips and rotations, when
-loaded via the data_set_load function they are fliped and rotated to increase
-the data set size.
+The examples are stored unique and invariant of flips and rotations. The file
+is mapped to memory, not copied, and only an index of the examples and their
+distinct flips and rotations is kept; the flips and rotations are applied when
+the examples are read with data_set_get. Data sets larger than the memory
+available can be read in passes over chunks of the file, with
+data_set_shuffle_chunks.
 */
 
 #ifndef MATILDA_DATA_SET_H
@@ -38,6 +41,15 @@ Fisher–Yates shuffle.
 */
 void data_set_shuffle_all();
 
+/*
+Shuffle the data set in chunks of consecutive examples of the file: the order
+of the chunks and of the entries within each chunk, so a pass over the data set
+only reads one chunk of the file at a time.
+*/
+void data_set_shuffle_chunks(
+    u32 chunk_size
+);
+
 /*
 Read a data set and shuffle it.
 RETURNS table set size (number of cases)
@@ -53,9 +65,10 @@ u32 data_set_load2(
 );
 
 /*
-Get a specific data set element by position.
+Get a specific data set element by position, with its flip or rotation applied.
 */
-training_example * data_set_get(
+void data_set_get(
+    training_example * dst,
     u32 pos
 );
 
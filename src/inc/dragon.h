@@ -41,5 +41,14 @@ void estimate_eyes(
     bool play_okay[TOTAL_BOARD_SIZ],
     u8 in_nakade[TOTAL_BOARD_SIZ]
 );
+/*
+Checks the shapes kept up to date by the calling thread, for the board of its
+last eye count, against the shapes found again for the whole board cb.
+RETURNS true if they are the same
+*/
+bool verify_shapes(
+    const cfg_board * cb
+);
+
 
 #endif
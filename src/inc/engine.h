@@ -11,6 +11,7 @@ maintenance if needed.
 
 #include "types.h"
 #include "board.h"
+#include "game_record.h"
 
 
 /*
@@ -51,9 +52,38 @@ void set_use_of_opening_book(
     bool use_ob
 );
 
+/*
+Set whether the following searches use light playouts -- uniformly random, only
+avoiding playing in own eyes -- instead of heavy playouts. Light playouts are
+much faster, and weaker, and are meant for when the number of playouts matters
+more than their quality.
+*/
+void set_light_playouts(
+    bool light
+);
+
+/*
+Sets the memory budget of the whole program, in MiB, or 0 for none. Before each
+search the free lists of the allocators are trimmed if the memory held is over
+the budget, and the memory limit of the transpositions table is lowered so the
+table fits the rest of the budget; or raised back, up to the limit set for it.
+*/
+void set_memory_budget(
+    u64 mbs
+);
+
+/*
+Produces a textual description of the memory use of the program, and of its
+budget, up to MAX_PAGE_SIZ characters.
+*/
+void memory_usage_to_string(
+    char * dst
+);
+
 /*
 Evaluates the position given the time available to think, by using a number of
-strategies in succession.
+strategies in succession. The search may be extended up to max_stop_time if it
+is unstable. The cluster workers connected, if any, search the position too.
 RETURNS true if a play or pass is suggested instead of resigning
 */
 bool evaluate_position_timed(
@@ -61,7 +91,8 @@ bool evaluate_position_timed(
     bool is_black,
     out_board * out_b,
     u64 stop_time,
-    u64 early_stop_time
+    u64 early_stop_time,
+    u64 max_stop_time
 );
 
 /*
@@ -76,17 +107,117 @@ bool evaluate_position_sims(
 );
 
 /*
-Evaluate the position for a short amount of time, ignoring the quality matrix
-produced.
+Evaluates count positions, each with its own player and number of simulations,
+in order, sharing the transpositions table: the trees of the positions are kept
+for the following ones, that may reach them, and the states not reachable from
+the next position are only freed when the table is half full, instead of after
+every position. has_play[i] is set to true if a play or pass is suggested for
+position i instead of resigning.
 */
-void evaluate_in_background(
+void evaluate_positions_sims(
+    u32 count,
+    const board b[],
+    const bool is_black[],
+    const u32 simulations[],
+    out_board out_b[],
+    bool has_play[]
+);
+
+/*
+Estimates the ownership of the points of board b, from -1 for points owned by
+white to 1 for points owned by black, from the playouts of the searches already
+made of the position. A short search is made first if there were none.
+*/
+void estimate_ownership(
+    const board * b,
+    bool is_black,
+    float owner[TOTAL_BOARD_SIZ]
+);
+
+/*
+Marks the stones of board b that are estimated dead: owned by the opponent at
+the end of most playouts.
+*/
+void estimate_dead_stones(
+    const board * b,
+    bool is_black,
+    bool dead[TOTAL_BOARD_SIZ]
+);
+
+/*
+Scores board b by area, after removing the stones estimated dead.
+RETURNS positive score for a black win; negative for a white win; 0 for a draw
+*/
+d16 estimate_final_score(
     const board * b,
     bool is_black
 );
 
+/*
+Evaluates the position in the cleanup phase of a game, with a short search of up
+to CLEANUP_SIMULATIONS, stopped at stop_time if not 0; its playouts also
+estimate which stones are dead.
+*/
+void evaluate_position_cleanup(
+    const board * b,
+    bool is_black,
+    out_board * out_b,
+    u64 stop_time
+);
+
+/*
+Chooses the play of the cleanup phase of a game, when the only goal left is to
+capture the stones of the opponent clearly owned by the player: the best play of
+the evaluation on a liberty of a dead group. Passes once there are no such
+stones, or no legal plays on their liberties, so the cleanup doesn't go on
+filling the board.
+RETURNS the move selected, or a pass
+*/
+move select_cleanup_play(
+    const out_board * evaluation,
+    const board * b,
+    bool is_black,
+    const game_record * gr
+);
+
+/*
+Evaluate the position until stop_requested returns true, ignoring the quality
+matrix produced. The between-turn maintenance is performed first, in steps, so
+it is not paid when the next turn starts. May return early if the search can't
+go on. If pondering, is_black is the opponent and the simulations are
+concentrated on its most likely replies; the share of them kept is logged once
+it replies.
+*/
+void evaluate_in_background(
+    const board * b,
+    bool is_black,
+    bool (* stop_requested)(),
+    bool pondering
+);
+
+/*
+Saves the search information of the subtree of board b, played by is_black, to
+a file, so the search can be resumed later, also by another process.
+RETURNS number of states saved, or 0 on failure
+*/
+u32 save_search_tree(
+    const board * b,
+    bool is_black,
+    const char * filename
+);
+
+/*
+Replaces the search information with that of a file written by
+save_search_tree, so searches of its positions resume from it.
+RETURNS number of states loaded, or 0 on failure
+*/
+u32 load_search_tree(
+    const char * filename
+);
+
 /*
 Inform that we are currently between matches and proceed with the maintenance
-that is suitable at the moment.
+that is suitable at the moment. The dynamic komi is reset.
 */
 void new_match_maintenance();
 
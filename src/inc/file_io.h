@@ -42,6 +42,20 @@ d32 read_ascii_file(
     const char * filename
 );
 
+/*
+Searches for the files ending with the text present in extension, and calls
+found with the relative path of each as soon as it is found; the path is only
+valid during the call. No file names are kept, so there is no limit to the
+number of files.
+RETURNS number of files found
+*/
+u32 for_each_file(
+    const char * root,
+    const char * extension,
+    void (* found)(const char * filename, void * arg),
+    void * arg
+);
+
 /*
 Searches for and allocates the space needed for the relative path to the files
 found ending with the text present in extension.
@@ -55,4 +69,13 @@ u32 recurse_find_files(
     u32 max_files
 );
 
+/*
+Fingerprint of the name, size and modification time of a file, to detect that
+it changed without reading it.
+RETURNS fingerprint, or 0 if the file does not exist
+*/
+u32 file_fingerprint(
+    const char * filename
+);
+
 #endif
@@ -7,6 +7,11 @@ actively hurts the performance.
 
 Writing to files is synchronous (with fsync) to avoid loss of data in case of
 crashes, but it is impossible to guarantee this in all cases.
+
+With LOG_BUFFERED_WRITES the messages are instead appended to a memory buffer,
+and written to file by flog_flush, which is called between commands, when the
+buffer is full, on exit and after critical and warning messages -- these are
+still synchronous. So the searching threads don't wait for the disk.
 */
 
 
@@ -35,6 +40,12 @@ crashes, but it is impossible to guarantee this in all cases.
 
 #define DEFAULT_LOG_DESTS (LOG_DEST_STDF | LOG_DEST_FILE)
 
+/*
+Buffer the messages written to file instead of writing and syncing each one.
+*/
+#define LOG_BUFFERED_WRITES 1
+#define LOG_BUFFER_SIZ (64 * 1024)
+
 /*
 Sets the logging messages that are written to file based on a mask of the
 combination of available message types. See flog.h for more information.
@@ -50,6 +61,11 @@ void flog_config_destinations(
     u16 new_dest
 );
 
+/*
+Writes the messages buffered to the log file, if any.
+*/
+void flog_flush();
+
 /*
 Obtain a textual description of the capabilities and configuration options of
 matilda. This mostly concerns compile time constants.
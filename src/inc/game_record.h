@@ -26,12 +26,30 @@ http://www.weddslist.com/kgs/past/superko.html
 
 #define MAX_PLAYER_NAME_SIZ 32
 
+/*
+Size of the set of the positions of a game, by Zobrist hash; a power of two of
+at least twice the number of positions.
+*/
+#define GAME_HASH_SET_SIZ 8192
+
+#if GAME_HASH_SET_SIZ < 2 * (MAX_GAME_LENGTH + 1)
+#error Error: game hash set too small for the maximum game length.
+#endif
+
 typedef struct __game_record_ {
     char black_name[MAX_PLAYER_NAME_SIZ];
     char white_name[MAX_PLAYER_NAME_SIZ];
     move_seq handicap_stones;
     move moves[MAX_GAME_LENGTH];
-    u16 hashes[MAX_GAME_LENGTH];
+    /*
+    Zobrist hashes of the stones of the first position and after each play, and
+    their set by hash, with open addressing; of indexes in hashes plus one, 0 if
+    empty. The stones of the positions are kept packed, to tell collisions apart.
+    */
+    u64 hashes[MAX_GAME_LENGTH + 1];
+    u16 hash_set[GAME_HASH_SET_SIZ];
+    u8 packed[MAX_GAME_LENGTH + 1][PACKED_BOARD_SIZ];
+    board state; /* the current state */
     u16 turns;
     bool player_names_set;
     bool finished;
@@ -89,9 +107,28 @@ void fprint_game_record(
     const game_record * gr
 );
 
+/*
+Tests whether a position, of stones p and Zobrist hash hash, has occurred in the
+game. The stones are only compared if the hash is found. Is meant for searches.
+RETURNS true if the position has occurred
+*/
+bool position_in_game_record(
+    const game_record * gr,
+    u64 hash,
+    const u8 p[TOTAL_BOARD_SIZ]
+);
+
+/*
+RETURNS the Zobrist hash of the stones of the current position
+*/
+u64 current_game_hash(
+    const game_record * gr
+);
+
 /*
 Returns whether a play is a superko violation. Does not test other legality
-restrictions.
+restrictions. The position after playing is looked up in the set of positions
+of the game, and only compared in full if its hash is found.
 RETURNS true if illegal by positional superko.
 */
 bool test_superko(
@@ -142,6 +179,14 @@ bool undo_last_play(
     game_record * gr
 );
 
+/*
+Drops the plays after the first turns plays, if there are more.
+*/
+void truncate_game_record(
+    game_record * gr,
+    u16 turns
+);
+
 /*
 Adds a handicap stone to a yet-to-start game.
 Clears the game finished information from the game record if present.
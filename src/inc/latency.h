@@ -0,0 +1,71 @@
+/*
+Accounting of the latency of the answers to the GTP genmove commands, from the
+command being received to its answer being flushed, by stage. The stages are
+marked in sequence by the thread serving the commands; the time since the
+previous mark is added to the stage marked. The samples of the last
+LATENCY_WINDOW genmoves are kept for their percentiles.
+
+Marks made while no command is being timed, like those of the searches in the
+opponent's turn, are ignored.
+*/
+
+#ifndef MATILDA_LATENCY_H
+#define MATILDA_LATENCY_H
+
+#include "config.h"
+
+#include "types.h"
+
+/* stages of the answer to a genmove */
+#define LAT_COMMAND 0 /* parsing, game record, clocks and time allotment */
+#define LAT_MAINTENANCE 1 /* freeing of states and memory budget */
+#define LAT_OPENING_BOOK 2
+#define LAT_ROOT 3 /* cluster start, root lookup, CFG board and expansion */
+#define LAT_SEARCH 4
+#define LAT_OUTPUT 5 /* choice of play and answer written and flushed */
+#define LAT_LOGGING 6
+
+#define LATENCY_STAGES 7
+
+/*
+Number of the last genmoves kept for the percentiles.
+*/
+#define LATENCY_WINDOW 1024
+
+
+/*
+Starts timing a command received at time mark received, in nanoseconds.
+*/
+void latency_start(
+    u64 received
+);
+
+/*
+Adds the time since the previous mark of the command being timed to a stage.
+*/
+void latency_mark(
+    u8 stage
+);
+
+/*
+Marks the command being timed as a genmove, to be kept when it ends.
+*/
+void latency_keep();
+
+/*
+Ends timing the command, keeping its sample if it was a genmove, and logging
+its stages.
+*/
+void latency_end();
+
+/*
+Produces a textual description of the percentiles of the latency of the last
+genmoves, in total and by stage, one per line, up to siz characters.
+RETURNS number of characters written
+*/
+u32 latency_to_string(
+    char * dst,
+    u32 siz
+);
+
+#endif
@@ -20,6 +20,7 @@ It can also record the average final score, for the purpose of score estimation.
 #include "config.h"
 
 #include "board.h"
+#include "game_record.h"
 #include "types.h"
 
 /*
@@ -35,14 +36,186 @@ positive.
 #define UCT_CAN_STOP_EARLY true
 #define UCT_EARLY_WINRATE 0.90
 
+/*
+Whether the time of a play is managed by the stability of the search: it stops
+after the early stop time if the most visited play can no longer be overtaken;
+and it is extended beyond the stop time while the play of best quality is not
+the most visited, or the second most visited has at least
+UCT_UNSTABLE_VISITS_RATIO of the visits of the first. Time saved in easy plays
+remains in the clock for the harder ones.
+
+EXPECTED: 0 or 1
+*/
+#define UCT_STABILITY_TIME_MANAGEMENT 1
+#define UCT_UNSTABLE_VISITS_RATIO 0.8
+
 /*
 How overwhelming a pass quality must be to be played even if not the top ranked.
 */
 #define JUST_PASS_WINRATE 0.90
 
+/*
+Dynamic komi, if enabled: part of the lead of the player is given away while its
+winrate is over DYNAMIC_KOMI_HIGH, and taken back while under DYNAMIC_KOMI_LOW;
+up to DYNAMIC_KOMI_MAX, doubled.
+*/
+#define DYNAMIC_KOMI_HIGH 0.75
+#define DYNAMIC_KOMI_LOW 0.45
+#define DYNAMIC_KOMI_MAX ((TOTAL_BOARD_SIZ / 12) * 2)
+
 
 #define MAX_UCT_DEPTH ((TOTAL_BOARD_SIZ * 2) / 3)
 
+/*
+Statistics of the plays of the root of a search: the visits and mean MC quality
+of each play, exchanged with the searches of the same position in other
+processes (see cluster.h).
+*/
+typedef struct __root_stats_ {
+    u16 count;
+    move m[TOTAL_BOARD_SIZ + 1];
+    u32 visits[TOTAL_BOARD_SIZ + 1];
+    float quality[TOTAL_BOARD_SIZ + 1];
+} root_stats;
+
+/*
+Whether the play statistics are updated, while descending the tree and in
+backpropagation, without setting the states locks. Visit counters are updated
+atomically and qualities with relaxed updates, that may very rarely lose a
+sample under contention. The locks of the states are then only set to expand
+them.
+
+EXPECTED: 0 or 1
+*/
+#define UCT_LOCKLESS_UPDATES 1
+
+/*
+Default magnitude of the virtual loss, in lost simulations, of each thread
+currently traversing a play. It is applied only while the simulation is in
+flight and removed on backpropagation, so it only has effect with more than one
+thread. Can be changed with the tunable virtual_loss.
+
+EXPECTED: 0.0 to 10.0
+*/
+#define UCT_VIRTUAL_LOSS 1.0
+
+/*
+Default number of playouts made from each leaf reached by a descent of the tree.
+The playouts are made from copies of the leaf board and their results are
+backpropagated at once, so the costs of the descent, lookups and updates of the
+tree are divided by all of them. Each playout still counts as a simulation. Can
+be changed with the tunable leaf_playouts.
+
+EXPECTED: 1 to 64
+*/
+#define UCT_LEAF_PLAYOUTS 1
+
+/*
+Whether the qualities of the plays of a state, to select the play to follow, are
+computed in batches of 8 plays with AVX2 instructions, in single precision.
+Plays with enough visits for criticality are still evaluated one at a time.
+Only has effect if compiled for a processor with AVX2 and with AMAF/RAVE.
+
+EXPECTED: 0 or 1
+*/
+#define UCT_SIMD_SELECTION 1
+
+/*
+Whether the descents prefetch the state the play selected leads to, if already
+linked: its header as soon as the play is selected, and the statistics of its
+plays once the play is made on the board; so the cache misses of the next step
+are overlapped with the work of the current one, instead of stalling on each.
+
+EXPECTED: 0 or 1
+*/
+#define UCT_PREFETCH 1
+
+/*
+Whether the plays of the states are progressively widened: once the priors of a
+state are added its plays are ranked, and only the best ranked are considered
+for selection, and evaluated. The first UCT_WIDENING_MIN_PLAYS are considered
+right away, and one more each time the visits of the state reach
+UCT_WIDENING_BASE times a power of UCT_WIDENING_GROWTH; each the play of best
+quality, mostly its prior, of those not considered yet. Only the plays
+considered at the root are candidates for the play chosen. Can be changed with
+the tunables widening_min_plays, widening_base and widening_growth.
+
+EXPECTED: 0 or 1
+*/
+#define UCT_PROGRESSIVE_WIDENING 1
+#define UCT_WIDENING_MIN_PLAYS 8
+#define UCT_WIDENING_BASE 40
+#define UCT_WIDENING_GROWTH 1.4
+
+/*
+Whether the outcomes known, from plays ending the game by two passes, are
+propagated up the tree like in minimax (MCTS-solver): a state is won if one of
+its plays is, and lost if all of them are and they are all of its legal plays;
+states whose plays leave out own eyes, the first line or pass are never proven
+lost. Proven lost plays are not selected and proven won plays always are; the
+descent stops at proven states, with a playout, and timed searches stop once the
+root is proven. Superko losses are not proven, since they depend on the descent
+and on the game record, undone with the tree kept. Not used with dynamic komi.
+
+EXPECTED: 0 or 1
+*/
+#define UCT_SOLVER 1
+
+/*
+Whether the MC quality of the plays leading to states shared by transposition
+is derived from the statistics of the states: before selecting a play of a
+state, the plays considered that lead to a state visited more often than the
+play itself, by other paths, take the mean result of all the simulations
+through it. So the descents from each parent profit from the simulations of the
+others.
+
+EXPECTED: 0 or 1
+*/
+#define UCT_TRANSPOSITION_BACKUP 1
+
+/*
+Number of the most likely replies of the opponent the simulations of pondering
+are concentrated on, once the root has UCT_PONDER_MIN_VISITS visits: the most
+visited plays of the root, each followed in proportion to its visits when the
+pondering started. More simulations are then spent under the play the opponent
+will probably make, and kept after it. 0 for pondering like a normal search.
+
+EXPECTED: 0 to 16
+*/
+#define UCT_PONDER_REPLIES 4
+#define UCT_PONDER_MIN_VISITS 256
+
+/*
+Whether states are expanded in two steps: the plays are listed, with only the
+even game prior, and the state is published as expanded; only then the tactical
+analysis and remaining priors are computed and added to the plays, without
+holding the lock of the state. Other threads reaching the state don't wait for
+the whole prior computation, but may descend through it before the priors are
+added.
+
+EXPECTED: 0 or 1
+*/
+#define UCT_DEFERRED_PRIORS 1
+
+/*
+Number of states whose priors are computed together, if batched; see
+mcts_set_batched_priors.
+
+EXPECTED: 2 to 64
+*/
+#define UCT_PRIOR_BATCH_SIZE 16
+
+/*
+Whether the time spent by each thread in the phases of the simulations --
+selection, transpositions table lookup, expansion, playout and backpropagation
+-- is measured, and the lookups of the transpositions table and their lock
+waits are counted. The statistics of the last timed search can be consulted
+with mcts_last_search_stats.
+
+EXPECTED: 0 or 1
+*/
+#define MCTS_SEARCH_STATS 1
+
 
 
 
@@ -51,12 +224,79 @@ Initiate MCTS dependencies.
 */
 void mcts_init();
 
+/*
+Sets whether searches are reproducible: run by a single thread, with the RNG
+reset to seeds derived from seed before each search limited by simulations. From
+the same tree, a search for the same number of simulations then produces the
+same tree; its fingerprint is logged when the search finishes.
+*/
+void mcts_set_deterministic(
+    bool enabled,
+    u32 seed
+);
+
+/*
+Sets whether the deferred priors of expanded states are queued, from all
+threads, and computed in batches by the thread that completes each batch. The
+other threads carry on descending the tree while a batch is being computed. This
+is the entry point for prior evaluators that are more efficient over many states
+at once, like neural networks; with the hand-tuned priors it only adds the cost
+of copying the boards. Queued priors are computed by the end of each search.
+Needs UCT_DEFERRED_PRIORS; off by default.
+*/
+void mcts_set_batched_priors(
+    bool enabled
+);
+
+/*
+Sets whether the komi used by the searches is adjusted between searches: while
+the player searching is winning by a large margin part of its lead is given
+away, by the dynamic komi, so the playouts keep telling good plays from bad
+ones. The dynamic komi is reset between matches.
+*/
+void mcts_set_dynamic_komi(
+    bool enabled
+);
+
+/*
+Sets the game whose positions the following searches may not repeat, by
+positional superko, besides the positions repeated in the tree; or none if gr is
+NULL. Is only used while the position searched is the last of the game.
+*/
+void mcts_set_game_history(
+    const game_record * gr
+);
+
+/*
+Sets a function to be called by the timed and resumed searches every interval
+milliseconds, with the candidate plays of the root in the lz-analyze format; or
+stops the reports if report is NULL.
+*/
+void mcts_set_analysis(
+    u32 interval,
+    void (* report)(const char *)
+);
+
+/*
+Sets a function to be called by the master thread of the timed searches every
+interval milliseconds, and once more when they end, with the statistics of the
+visited plays of the root in own. The function may fill merged with the visits
+of plays of the same position made elsewhere since its last call, and their mean
+quality, which are then added to the root; and returns true to stop the search.
+Stops the calls if exchange is NULL.
+*/
+void mcts_set_root_exchange(
+    u32 interval,
+    bool (* exchange)(const root_stats * own, root_stats * merged, bool final)
+);
+
 /*
 Performs a MCTS in at least the available time.
 
-The search may end early if the estimated win rate is very one sided, in which
-case the play selected is a pass. The search is also interrupted if memory runs
-out.
+The search may end early if the estimated win rate is very one sided, or if the
+most visited play can no longer be overtaken. It may be extended, up to the
+maximum stop time, if the best play is unstable. If memory runs out the least
+visited branches of the tree are pruned and the search goes on.
 RETURNS true if a play or pass is suggested instead of resigning
 */
 bool mcts_start_timed(
@@ -64,11 +304,13 @@ bool mcts_start_timed(
     const board * b,
     bool is_black,
     u64 stop_time,
-    u64 early_stop_time
+    u64 early_stop_time,
+    u64 max_stop_time
 );
 
 /*
-Performs a MCTS for the selected number of simulations.
+Performs a MCTS for the selected number of simulations, or until stop_time if
+not 0, whichever comes first.
 
 The search is interrupted if memory runs out.
 RETURNS true if a play or pass is suggested instead of resigning
@@ -77,7 +319,8 @@ bool mcts_start_sims(
     out_board * out_b,
     const board * b,
     bool is_black,
-    u32 simulations
+    u32 simulations,
+    u64 stop_time
 );
 
 /*
@@ -87,18 +330,60 @@ run out of memory.
 void reset_mcts_can_resume();
 
 /*
-Continue a previous MCTS.
+Continue a previous MCTS, until stop_requested returns true. The function is
+tested between simulations, so it should be fast. If memory runs out the tree is
+pruned and the search goes on; unless nothing could be freed, in which case it
+returns early. If pondering, is_black is the opponent and the simulations are
+concentrated on its most likely replies (see UCT_PONDER_REPLIES).
 */
 void mcts_resume(
     const board * b,
-    bool is_black
+    bool is_black,
+    bool (* stop_requested)(),
+    bool pondering
 );
 
 /*
-Execute a 1 second MCTS and return the number of simulations ran.
+Tests whether board b, with is_black to play, follows a reply to the last
+position pondered, and forgets that position if so.
+RETURNS whether it does, with the visits pondering added to the reply and to all
+the plays of the position pondered
+*/
+bool mcts_pondered_reply(
+    const board * b,
+    bool is_black,
+    u32 * reply_visits,
+    u32 * visits
+);
+
+/*
+Produces a textual description of the statistics of the phases of the last
+timed search, up to MAX_PAGE_SIZ characters.
+*/
+void mcts_last_search_stats(
+    char * dst
+);
+
+/*
+Estimates the ownership of the points of board b, from the final positions of
+the playouts of the searches already made of it: from -1 for points always owned
+by white to 1 for points always owned by black. The position is compared by its
+stones only.
+RETURNS false if the position has not been searched
+*/
+bool mcts_ownership(
+    const board * b,
+    float owner[TOTAL_BOARD_SIZ]
+);
+
+/*
+Execute a MCTS from a state for the time available, for benchmarking, and return
+the number of simulations ran. The search is interrupted if memory runs out.
 RETURNS simulations number
 */
 u32 mcts_benchmark(
+    const board * b,
+    bool is_black,
     u32 time_available /* in milliseconds */
 );
 
@@ -0,0 +1,60 @@
+/*
+Accounting of the memory used by the program outside of the transpositions
+table, by category: each allocator adds the bytes it takes from the system and
+subtracts the ones it gives back, so the memory held, including the free lists
+the allocators keep, can be reported and kept within a budget (see
+set_memory_budget). The transpositions table keeps its own accounting.
+*/
+
+#ifndef MATILDA_MEM_USAGE_H
+#define MATILDA_MEM_USAGE_H
+
+#include "config.h"
+
+#include "types.h"
+
+/* categories of memory use */
+#define MEM_GROUPS 0 /* pool of the groups of the CFG boards */
+#define MEM_SCRATCH 1 /* buffers of alloc */
+#define MEM_THREAD_STATES 2
+#define MEM_PATTERNS 3
+#define MEM_OPENING_BOOK 4
+#define MEM_DATA_SET 5
+#define MEM_DATA_PACK 6 /* mapped read-only, shared between processes */
+
+#define MEM_CATEGORIES 7
+
+
+/*
+Adds a number of bytes, negative if given back, to the memory use of a
+category.
+Thread-safe.
+*/
+void mem_usage_add(
+    u8 category,
+    d64 bytes
+);
+
+/*
+RETURNS the memory in use by a category, in bytes
+*/
+u64 mem_usage(
+    u8 category
+);
+
+/*
+RETURNS the memory in use by all categories, in bytes
+*/
+u64 mem_usage_total();
+
+/*
+Produces a textual description of the memory use of each category that uses
+any, one per line, up to siz characters.
+RETURNS number of characters written
+*/
+u32 mem_usage_to_string(
+    char * dst,
+    u32 siz
+);
+
+#endif
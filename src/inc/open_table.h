@@ -0,0 +1,92 @@
+/*
+Implementation of a generic hash table with open addressing
+
+The elements are copied into the table itself, in a contiguous array probed
+linearly, so inserting does not allocate per element and lookups do not follow
+pointers; the hash of each element is kept beside it, so most probes do not
+call the comparison function. The table grows to keep its load under 3/4, so
+pointers to its elements are only valid until the next insertion.
+
+Use instead of hash_table for large numbers of small elements.
+*/
+
+#ifndef MATILDA_OPEN_TABLE_H
+#define MATILDA_OPEN_TABLE_H
+
+#include "config.h"
+
+#include "types.h"
+
+typedef struct __open_table_ {
+    u32 capacity; /* power of two */
+    u8 shift;
+    u32 elem_size;
+    u32 elements;
+    u32 * hashes; /* 0 if the slot is empty */
+    u8 * slots;
+    u32 (* hash_func)(const void *);
+    int (* cmp_func)(const void *, const void *);
+} open_table;
+
+
+
+/*
+Creates an open addressing hash table for use with types of elem_size
+comparable by the functions provided, with space reserved for the number of
+elements specified.
+RETURNS generic hash table instance
+*/
+open_table * open_table_create(
+    u32 expected_elements,
+    u32 elem_size,
+    u32 (* hash_function)(const void *),
+    int (* compare_function)(const void *, const void *)
+);
+
+/*
+Grows the table, if needed, so the number of elements specified fits without
+further growth.
+*/
+void open_table_reserve(
+    open_table * ot,
+    u32 elements
+);
+
+/*
+Find and returns a value by comparing it with another instance of the type.
+RETURNS existing instance in the table or NULL
+*/
+void * open_table_find(
+    const open_table * ot,
+    const void * elem
+);
+
+/*
+Inserts a copy of the value in the table, unless an equal value exists; sets
+inserted, if not NULL, to whether it was inserted.
+RETURNS the instance in the table, new or existing
+*/
+void * open_table_insert(
+    open_table * ot,
+    const void * elem,
+    bool * inserted
+);
+
+/*
+Free the table and the elements stored in it.
+*/
+void open_table_destroy(
+    open_table * ot
+);
+
+/*
+Allocates the necessary memory and exports pointers to the elements to an
+array, returning it. The array is one position longer to fit in a NULL
+sentinel value. The pointers are valid while the table is not changed.
+RETURNS allocated array with data
+*/
+void ** open_table_export_to_array(
+    const open_table * ot
+);
+
+#endif
@@ -33,10 +33,38 @@ void board_to_ob_rule(
 );
 
 /*
-Discover and read opening book files.
+Reads an opening book file, adding its rules to those already known, unless
+already present.
+RETURNS false if the file could not be read
+*/
+bool opening_book_read(
+    const char * filename
+);
+
+/*
+Discover and read opening book files. If they are being read in the background
+waits for it to finish instead.
 */
 void opening_book_init();
 
+/*
+Discover and read opening book files in a background thread, so the program can
+do other work meanwhile; they are waited for by the first call to
+opening_book_init or opening_book. Reads them immediately if the thread could
+not be started. The board constants must have been initialized.
+*/
+void opening_book_init_background();
+
+/*
+Contents of the opening book section of a data pack, with the rules read by
+opening_book_init; and the fingerprint of the file read.
+RETURNS newly allocated section contents, or NULL if no rules were read
+*/
+void * opening_book_pack_section(
+    u64 * size,
+    u32 * fingerprint
+);
+
 /*
 Match an opening rule and return it encoded in the board.
 RETURNS true if rule found
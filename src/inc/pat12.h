@@ -0,0 +1,102 @@
+/*
+Functions that support the use of 12-point diamond patterns: the 3x3
+neighborhood of a play plus the four intersections at distance two in line,
+learned from game records with the weights of how often the play was selected.
+
+The life of these patterns is as follow:
+ * The pattern of each empty intersection is kept up to date by the CFG board,
+ as its 3x3 hash followed by the codification of the four outer intersections,
+ so reading it costs nothing.
+
+ * On startup the NxN.pat12 weights file is read, if present. Each pattern is
+ flipped and rotated and stored, from the perspective of black, in an open
+ addressed hash table. Lookups for white invert the colors first.
+*/
+
+#ifndef MATILDA_PAT12_H
+#define MATILDA_PAT12_H
+
+#include "config.h"
+
+#include "types.h"
+#include "board.h"
+#include "cfg_board.h"
+#include "pat3.h"
+
+/*
+Number of intersections of a pattern, and of bits of its codification, 2 bits
+per intersection.
+*/
+#define PAT12_POINTS 12
+#define PAT12_BITS (PAT12_POINTS * 2)
+
+/*
+Minimum weight of a pattern, in the scale of the weights of 3x3 patterns, for
+the play to be given the 3x3 pattern prior when expanding a state. Corresponds
+to the play being selected 10% of the times the pattern is found.
+*/
+#define PAT12_PRIOR_WEIGHT ((65535 / 10) / WEIGHT_SCALE)
+
+/*
+Pattern of intersection m of a CFG board.
+*/
+#define PAT12_CODE(CB, M) ((((u32)(CB)->hash[M]) << 8) | (CB)->far_hash[M])
+
+
+/*
+Reads the 12-point pattern weights file, if present, and expands all patterns
+into their rotations and flips.
+*/
+void pat12_init();
+
+/*
+RETURNS whether 12-point pattern weights were read
+*/
+bool pat12_in_use();
+
+/*
+Contents of the 12-point patterns section of a data pack, after pat12_init; and
+the fingerprint of the file read.
+RETURNS newly allocated section contents, or NULL if no weights were read
+*/
+void * pat12_pack_section(
+    u64 * size,
+    u32 * fingerprint
+);
+
+/*
+Lookup of pattern weight for the specified player.
+RETURNS pattern weight or 0 if not found
+*/
+u16 pat12_find(
+    u32 value,
+    bool is_black
+);
+
+/*
+Rotate and flip the pattern to its unique representative, the lowest value of
+all its forms.
+RETURNS pattern value reduced
+*/
+u32 pat12_reduce_auto(
+    u32 value
+);
+
+/*
+Invert stone colors.
+RETURNS pattern value with colors inverted
+*/
+u32 pat12_invert(
+    u32 value
+);
+
+/*
+Codifies the pattern of intersection m of a board, with board safety.
+RETURNS pattern value
+*/
+u32 pat12_from_board(
+    const u8 p[TOTAL_BOARD_SIZ],
+    move m
+);
+
+#endif
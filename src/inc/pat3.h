@@ -50,6 +50,15 @@ u16 pat3_find(
     bool is_black
 );
 
+/*
+Pattern weights for the specified player, indexed directly by pattern value; so
+loops over many patterns of the same player can skip calling pat3_find.
+RETURNS table of 65536 pattern weights, 0 if not found
+*/
+const u16 * pat3_weights(
+    bool is_black
+);
+
 /*
 Rotate and flip the pattern to its unique representative.
 Avoid using, is not optimized.
@@ -96,4 +105,14 @@ patternable configurations.
 */
 void pat3_init();
 
+/*
+Contents of the 3x3 patterns section of a data pack, after pat3_init: the
+tables of weights of black and white; and the fingerprint of the files read.
+RETURNS newly allocated section contents
+*/
+void * pat3_pack_section(
+    u64 * size,
+    u32 * fingerprint
+);
+
 #endif
@@ -8,11 +8,12 @@ The move selection policy uses the following restrictions:
     3. No plays ending in self-atari except if forming a single stone group
     (throw-in)
 And chooses a play based on (by order of importance):
-    1. Nakade
-    2. Capture
-    3. Avoid capture
-    4. Handcrafted 3x3 patterns
-    5. Random play
+    1. Avoid capture
+    2. Last good reply (see PL_LAST_GOOD_REPLY)
+    3. Nakade (disabled)
+    4. Capture
+    5. Handcrafted 3x3 patterns, or 12-point patterns where known
+    6. Random play
 */
 
 #ifndef MATILDA_PLAYOUT_H
@@ -28,6 +29,32 @@ And chooses a play based on (by order of importance):
 
 #define MERCY_THRESHOLD (TOTAL_BOARD_SIZ / 5)
 
+/*
+Whether the mercy threshold and the depth limit over the empty points of the
+heavy playouts are tightened during each search, by steps of 1/8 and down to a
+half and a quarter of the above. A step is taken when, of PL_ADAPTIVE_SAMPLES
+playouts of a thread that reach the tighter cutoff, no more than
+PL_ADAPTIVE_MAX_CHANGED in 1000 end with another winner than the one they had
+at it.
+
+EXPECTED: 0 or 1
+*/
+#define PL_ADAPTIVE_CUTOFFS 1
+#define PL_ADAPTIVE_SAMPLES 2048
+#define PL_ADAPTIVE_MAX_CHANGED 10
+
+/* ways playouts end */
+#define PL_END_PASSES 0
+#define PL_END_MERCY 1
+#define PL_END_DEPTH 2
+
+#define PL_END_REASONS 3
+
+/* plays of each bucket of the histogram of the lengths of the playouts */
+#define PL_LENGTH_BUCKET 8
+#define PL_LENGTH_BUCKETS ((MAX_PLAYOUT_DEPTH_OVER_EMPTY + TOTAL_BOARD_SIZ + \
+    PL_LENGTH_BUCKET) / PL_LENGTH_BUCKET)
+
 
 /*
 Probability of skipping a check in parts of 128 (instead of 100 for performance
@@ -49,6 +76,17 @@ Tuned with CLOP in 9x9 with 10k playouts/turn in self-play for 34k games.
 #define PL_SKIP_NAKADE   0
 #define PL_BAN_SELF_ATARI 43
 #endif
+#define PL_SKIP_LGR      64
+
+/*
+Whether the heavy playouts play the last good reply of the player, shared by all
+threads, after saving from capture and before the other heuristics: to the last
+two plays (LGR-2), or else to the last play (LGR-1). The replies of the winner
+of each playout are kept, and those of the loser forgotten (LGRF).
+
+EXPECTED: 0 or 1
+*/
+#define PL_LAST_GOOD_REPLY 1
 
 
 /*
@@ -59,7 +97,21 @@ Cache state bits (must fit in 1 byte)
 #define CACHE_PLAY_SAFE       4 /* if has 2 or more liberties after playing */
 #define CACHE_PLAY_SELF_ATARI 8 /* if play is self-atari */
 
-
+/*
+Play status cache of a player. The positions marked dirty are also kept in a
+list, so only they are recalculated; a position is in the list if and only if
+it is marked dirty. The positions marked legal are kept in a set, so a random
+legal play is drawn without scanning the board; legal_idx is the index of each
+position in the set.
+*/
+typedef struct __play_cache_ {
+    u8 status[TOTAL_BOARD_SIZ];
+    move dirty_count;
+    move dirty[TOTAL_BOARD_SIZ];
+    move legal_count;
+    move legal[TOTAL_BOARD_SIZ];
+    move legal_idx[TOTAL_BOARD_SIZ];
+} play_cache;
 
 
 /*
@@ -75,5 +127,70 @@ d16 playout_heavy_amaf(
     u8 traversed[TOTAL_BOARD_SIZ]
 );
 
+/*
+Make a light playout and returns whether black wins.
+Plays uniformly at random, only avoiding illegal plays and playing in own eyes.
+Uses the same depth limit and mercy threshold of the heavy playouts. Also
+updates AMAF transitions information.
+RETURNS the final score
+*/
+d16 playout_light_amaf(
+    cfg_board * cb,
+    bool is_black,
+    u8 traversed[TOTAL_BOARD_SIZ]
+);
+
+/*
+Make a playout with the policy selected, heavy or light, and returns whether
+black wins. Also updates AMAF transitions information.
+RETURNS the final score
+*/
+d16 playout_amaf(
+    cfg_board * cb,
+    bool is_black,
+    u8 traversed[TOTAL_BOARD_SIZ]
+);
+
+/*
+Initializes a play status cache for the position, marking all empty positions
+as needing to be recalculated; like at the start of a playout.
+*/
+void playout_cache_init(
+    play_cache * c,
+    const cfg_board * cb
+);
+
+/*
+Selects the play of a heavy playout for the position, with a play status cache
+initialized for it by playout_cache_init.
+RETURNS the play selected, or PASS if there are no more plays
+*/
+move playout_select_play(
+    cfg_board * cb,
+    bool is_black,
+    play_cache * c
+);
+
+/*
+Forgets the last good replies of the playouts.
+*/
+void playout_clear_replies();
+
+/*
+Clears the statistics of the lengths and ends of the heavy playouts, and
+restores their cutoffs; at the start of each search.
+*/
+void playout_stats_reset();
+
+/*
+Produces a textual description of the heavy playouts since the statistics
+were reset: how they ended, percentiles of their lengths and their cutoffs.
+RETURNS number of characters written
+*/
+u32 playout_stats_to_string(
+    char * dst,
+    u32 siz
+);
+
 
 #endif
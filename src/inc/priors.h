@@ -46,6 +46,16 @@ Tuned with CLOP in 9x9 with 10k playouts/turn in self-play for 34k games.
 #define PRIOR_PASS      130
 #define PRIOR_STARTING   76 /* starting point like around the hoshi */
 
+/*
+Information gathered while listing the plays of a new state that is needed to
+compute their priors afterwards.
+*/
+typedef struct __deferred_priors_ {
+    bool play_okay[TOTAL_BOARD_SIZ];
+    u8 in_nakade[TOTAL_BOARD_SIZ];
+    u8 libs[TOTAL_BOARD_SIZ];
+} deferred_priors;
+
 /*
 Initializes a game state structure with prior values and AMAF/LGRF/Criticality
 information.
@@ -56,6 +66,35 @@ void init_new_state(
     bool is_black
 );
 
+/*
+Lists the plays of a new state, excluding playing in own eyes, ko violations,
+suicides and the first line away from other stones; and sets them to the state
+with only the even game prior, plus the pass prior, marking whether they are
+all of its legal plays. The information needed to compute the remaining priors
+is kept in dp.
+*/
+void init_new_state_plays(
+    tt_stats * stats,
+    cfg_board * cb,
+    bool is_black,
+    deferred_priors * dp
+);
+
+/*
+Computes the priors of the plays of a state, listed by init_new_state_plays,
+other than the even game and pass priors already set. For each play of the state,
+by the same order, the wins and visits to add are stored in the mc_q and mc_n
+fields of deltas. The board must not have changed since the plays were listed.
+Does not change the state.
+*/
+void compute_deferred_priors(
+    const tt_stats * stats,
+    cfg_board * cb,
+    bool is_black,
+    const deferred_priors * dp,
+    tt_prior deltas[MAX_PLAYS_COUNT]
+);
+
 #if PRIOR_EVEN == 0
 #error Error: MCTS prior weights: even heuristic weight cannot be zero.
 #endif
@@ -3,6 +3,10 @@ Non-cryptographic random number generation functions
 
 Reminder: maximums are exclusive for integer functions and inclusive (and very
 unlikely) for floating point functions.
+
+Each thread generates with xoshiro128**, in RAND_LANES interleaved streams that
+are advanced together, so the compiler vectorizes them, filling a buffer of
+RAND_BUFFER_SIZ numbers at a time that the functions then draw from.
 */
 
 
@@ -25,7 +29,15 @@ Initiate the seeds for the different thread RNG.
 void rand_init();
 
 /*
-Fast and well distributed 16-bit RNG based on the glibc mixed LCG.
+Sets the seeds for the different thread RNG, all derived from a single seed, so
+the same sequences of numbers are generated again.
+*/
+void rand_seed(
+    u32 seed
+);
+
+/*
+Fast and well distributed 16-bit RNG.
 RETURNS pseudo random 16-bit number
 */
 u16 rand_u16(
@@ -33,7 +45,7 @@ u16 rand_u16(
 );
 
 /*
-Slow alternative for 32-bit. Avoid using.
+Fast and well distributed 32-bit RNG.
 RETURNS pseudo random 32-bit number
 */
 u32 rand_u32(
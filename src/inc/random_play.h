@@ -22,6 +22,16 @@ move random_play(
     bool is_black
 );
 
+/*
+Select random legal play that is not inside an eye of the player, drawing from
+the empty intersections until one is found.
+RETURNS play or PASS if there are none
+*/
+move random_play_eyeless(
+    const cfg_board * cb,
+    bool is_black
+);
+
 /*
 Select random legal play.
 */
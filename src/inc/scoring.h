@@ -63,4 +63,16 @@ d16 score_stones_and_area(
     const u8 p[TOTAL_BOARD_SIZ]
 );
 
+/*
+Scoring by counting stones and surrounded area, like score_stones_and_area, but
+from the CFG representation. Empty intersections surrounded by stones of a
+single color are scored from their neighbor counts, without search; only
+regions of more than one empty intersection are flood filled. Is used by the
+searches, so the dynamic komi is added to the komi.
+RETURNS positive score for a black win; negative for a white win; 0 for a draw
+*/
+d16 score_stones_and_area2(
+    const cfg_board * cb
+);
+
 #endif
@@ -3,6 +3,11 @@ Functions related to reading and writing SGF FF[4] files.
 http://www.red-bean.com/sgf/
 
 Play variations and annotations/commentary are ignored.
+
+For reading large numbers of games, as the offline tools do, the functions of
+sgf_collection map the file to memory and parse the main line of each game in
+place, without intermediate copies; the file may also be an SGF collection of
+several games.
 */
 
 #ifndef MATILDA_SGF_H
@@ -14,6 +19,12 @@ Play variations and annotations/commentary are ignored.
 #include "board.h"
 #include "game_record.h"
 
+typedef struct __sgf_collection_ {
+    const char * data;
+    u64 size;
+    u64 pos;
+    u32 games_skipped;
+} sgf_collection;
 
 
 /*
@@ -75,4 +86,33 @@ bool import_game_from_sgf2(
     u32 buf_siz
 );
 
+/*
+Opens an SGF file, possibly a collection of several games, for reading its
+games with import_next_game_from_sgf. The file is mapped to memory and parsed
+in place.
+RETURNS false if the file could not be opened
+*/
+bool open_sgf_collection(
+    sgf_collection * sc,
+    const char * filename
+);
+
+/*
+Closes an SGF file opened with open_sgf_collection.
+*/
+void close_sgf_collection(
+    sgf_collection * sc
+);
+
+/*
+Reads the main line of the next game of the SGF file, where the first
+variation of each node is followed. Games that cannot be read, or are for a
+different board size, are skipped and counted in games_skipped.
+RETURNS true if another game was read
+*/
+bool import_next_game_from_sgf(
+    game_record * gr,
+    sgf_collection * sc
+);
+
 #endif
@@ -18,6 +18,16 @@ purpose of eye counting.
 #include "types.h"
 
 
+/*
+Set to cache the results of the 1-2 liberty solvers for killing and saving
+groups, per thread. Readings are keyed by the contents of the area around the
+group and only kept if they did not leave it, so sibling and transposed states
+reuse the readings of the groups they did not change.
+
+EXPECTED: 0 or 1
+*/
+#define USE_TACTICAL_CACHE 1
+
 
 /*
 An eye is a point that may eventually become untakeable (without playing
@@ -237,5 +247,11 @@ void can_be_saved_all(
     move * plays
 );
 
+/*
+Empties the cache of readings of the 1-2 liberty solvers of the calling thread,
+if USE_TACTICAL_CACHE.
+*/
+void tactical_cache_clear();
+
 
 #endif
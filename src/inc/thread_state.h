@@ -0,0 +1,55 @@
+/*
+Memory for the state of each thread, allocated at runtime for the threads that
+use it instead of statically for the maximum number of threads.
+
+The state of a thread is allocated and zeroed by the thread itself, on its first
+use, so with the first-touch memory policy of the system it is placed in the
+memory node of the core running it; which only holds if the threads are bound to
+cores, for instance with OMP_PROC_BIND=true. Each state is aligned and padded to
+cache lines, so the states of different threads don't false share.
+*/
+
+#ifndef MATILDA_THREAD_STATE_H
+#define MATILDA_THREAD_STATE_H
+
+#include "config.h"
+
+#include <stddef.h>
+
+#include "types.h"
+
+/*
+States of a kind, of each thread; declare with THREAD_STATES(type).
+*/
+typedef struct __thread_states_ {
+    size_t siz;
+    void * states[MAXIMUM_NUM_THREADS];
+} thread_states;
+
+#define THREAD_STATES(type) { sizeof(type), { NULL } }
+
+
+/*
+RETURNS the state of the calling thread, allocated by it on its first use and
+zeroed
+*/
+void * thread_state(
+    thread_states * ts
+);
+
+/*
+RETURNS the state of the thread of number t, or NULL if it has never used it
+*/
+void * thread_state_of(
+    const thread_states * ts,
+    u16 t
+);
+
+/*
+Zeroes the states of all threads. Not thread-safe.
+*/
+void thread_states_clear(
+    thread_states * ts
+);
+
+#endif
@@ -23,6 +23,12 @@ is the objective.
 
 #define EXPECTED_GAME_LENGTH ((TOTAL_BOARD_SIZ * 2) / 3)
 
+/*
+By how much the time of a play can be extended, when the search is unstable,
+over the time normally given. Can't exceed the time remaining in the period.
+*/
+#define TIME_EXTENSION_FACTOR 2.0
+
 
 typedef struct __time_system_ {
     bool can_timeout;
@@ -51,6 +57,17 @@ u32 calc_time_to_play(
     u16 turns_played
 );
 
+/*
+Calculate the maximum time that can be used in a play, if the search needs to
+be extended, based on a Canadian byo-yomi time system. Also compensates for
+network latency.
+RETURNS maximum time available in milliseconds
+*/
+u32 calc_max_time_to_play(
+    time_system * ts,
+    u16 turns_played
+);
+
 /*
 Set the complete Canadian byo-yomi time system.
 */
@@ -18,6 +18,13 @@ RETURNS time in milliseconds
 */
 u64 current_time_in_millis();
 
+/*
+Returns a current time mark with nanosecond precision, for measuring short
+intervals. Will be monotonic if supported by the system. Is thread-safe.
+RETURNS time in nanoseconds
+*/
+u64 current_time_in_nanos();
+
 /*
 Returns the current nanoseconds count from the system clock. Is not monotonic.
 RETURNS nanoseconds
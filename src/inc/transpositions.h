@@ -1,8 +1,9 @@
 /*
 Transpositions table and tree implementation.
 
-Doesn't assume states are in reduced form. States contain full information and
-are compared after the hash (collisions are impossible). Zobrist hashing with 64
+Doesn't assume states are in reduced form. States contain full information, with
+the board packed in 2 bits per position, and are compared after the hash
+(collisions are impossible). Zobrist hashing with 64
 bits is used. Clean-up is available only between turns or between games.
 
 Please note there is no separate 'UCT state information' file. It is mostly
@@ -11,6 +12,13 @@ interweaved with the transpositions table.
 The table is actually two tables, one for each player. Mixing their statistics
 is illegal. The nodes statistics are from the perspective of the respective
 table color.
+
+The memory limit covers both states and their plays; since each expanded state
+only stores the plays it has, the same memory holds many more states.
+
+The states of positions with few stones, found in the descents, are stored in a
+canonical orientation so the symmetric variants of the opening share them; see
+TT_SYMMETRY_MAX_STONES.
 */
 
 #ifndef MATILDA_TRANSPOSITIONS_H
@@ -32,15 +40,106 @@ allowed when there are few plays possible.
 */
 #define MAX_PLAYS_COUNT TOTAL_BOARD_SIZ
 
+/*
+Number of locks guarding the buckets of each table. Buckets are assigned to
+locks in a round robin fashion, so concurrent lookups only serialize when they
+hit buckets of the same stripe.
+
+EXPECTED: 1 to number of buckets; a power of two with TT_CLUSTER_BUCKETS
+*/
+#define TT_LOCK_STRIPES 1024
+
+/*
+Maximum number of states whose subtrees can be kept besides the one of the
+position being searched; see tt_set_kept_roots.
+*/
+#define TT_MAX_KEPT_ROOTS 16
+
+/*
+Whether the memory limit is reserved at once, on initialization, as a single
+slab that states and plays are then carved from; instead of allocating each
+state separately as needed. The slab is backed by huge pages where available.
+Allocation falls back to the system allocator if the slab is ever used up.
+
+EXPECTED: 0 or 1
+*/
+#define TT_USE_SLAB 1
+
+/*
+Whether the slab memory is touched on initialization, so page faults are not
+paid during the first searches. This makes the whole memory limit resident from
+the start.
+
+EXPECTED: 0 or 1
+*/
+#define TT_PREFAULT_SLAB 0
+
+/*
+Whether the buckets of the tables are clusters the size of a cache line, each
+with the hashes of a few states and pointers to them, instead of chains of
+states. The number of clusters is a power of two, so hashes are masked instead
+of divided, and a lookup reads a single cluster before reaching the state it
+finds, without following the states of a chain. A full cluster keeps its other
+states in the next clusters of its lock stripe; each table has room for half
+of the states of the memory limit. The clusters take 13 to 26 bytes per state of
+the limit, outside of it, against 8 of the chains.
+
+EXPECTED: 0 or 1
+*/
+#define TT_CLUSTER_BUCKETS 1
+
+/*
+Maximum number of stones of the positions stored in a canonical orientation
+during the descents, so all their flipped and rotated variants share the same
+state and subtree. The orientation of the other states is inherited from their
+parent, so the plays of every state can be followed whatever variant reached
+it. The plays of a state are in its orientation; see tt_reduction. Set to 0 to
+store all states as they are played.
+*/
+#define TT_SYMMETRY_MAX_STONES 8
+
+/*
+The statistics of the plays of a state are split in two. The fields read on
+every play selection -- MC and AMAF visits and qualities -- are kept in separate
+contiguous arrays, with single precision qualities, so selecting among hundreds
+of plays streams through only a few cache lines. The remaining, colder, fields
+of each play are kept apart in a tt_play.
+
+The play of index i of a state is described by plays[i], mc_n[i], mc_q[i],
+amaf_n[i], amaf_q[i] and vl_n[i]; all arrays are in the same memory block, owned
+by the transpositions table. vl_n counts the simulations currently traversing
+the play, which have not been backpropagated yet (virtual losses).
+
+The block also maps positions to plays, so the AMAF statistics of the plays of
+the positions played in a simulation are updated without looking at the others:
+plays_set is a bitmap of the positions of the plays other than pass, and
+plays_by_position the indexes of those plays by ascending position; the play of
+a position m in plays_set has the index in plays_by_position of the number of
+positions before m in plays_set.
+
+With progressive widening only the first widened plays of plays_by_prior are
+considered for selection, or all if widened is 0; visits counts the
+simulations backpropagated through the state.
+
+The plays and states whose outcome is known, from the end of the game being
+reached, are marked as proven (MCTS-solver): a play is won or lost for the
+player that makes it, and a state for the player to play. proven_plays is set
+once any play of the state is proven; plays_complete if its plays are all of its
+legal plays, pass included, which a state must have to be proven lost.
+*/
+#define PROVEN_NONE 0
+#define PROVEN_WIN 1
+#define PROVEN_LOSS 2
+
 typedef struct __tt_play_ {
     move m;
-    u32 mc_n;
-    u32 amaf_n;
-    double mc_q;
-    double amaf_q;
+    u8 proven;
     /* Criticality */
-    double owner_winning;
-    double color_owning;
+    float owner_winning;
+    float color_owning;
+    /* mean final score of the playouts, doubled, from the table color */
+    float score_mean;
+    u32 score_n;
     void * next_stats;
     struct __tt_play_ * lgrf1_reply;
 } tt_play;
@@ -48,16 +147,55 @@ typedef struct __tt_play_ {
 
 typedef struct __tt_stats_ {
     u64 zobrist_hash;
-    u8 p[TOTAL_BOARD_SIZ];
+    u8 p[PACKED_BOARD_SIZ]; // 2 bits per position, see pack_matrix
     move last_eaten_passed; // position of last single stone eaten or NONE/PASS
     u8 maintenance_mark;
     d8 expansion_delay;
     move plays_count;
-    tt_play plays[MAX_PLAYS_COUNT];
+    move widened;
+    /* simulations through the state, and wins of the player to play */
+    u32 visits;
+    float wins;
+    u8 proven;
+    bool proven_plays;
+    bool plays_complete;
+    /* exactly plays_count of each, or NULL if not expanded */
+    u32 * mc_n;
+    float * mc_q;
+    u32 * amaf_n;
+    float * amaf_q;
+    u16 * vl_n;
+    u64 * plays_set;
+    move * plays_by_position;
+    move * plays_by_prior;
+    tt_play * plays;
     omp_lock_t lock;
     struct __tt_stats_ * next;
 } tt_stats;
 
+/*
+Initial statistics of a play, used when expanding a state.
+*/
+typedef struct __tt_prior_ {
+    move m;
+    u32 mc_n;
+    u32 amaf_n;
+    double mc_q;
+    double amaf_q;
+} tt_prior;
+
+/*
+Counters of the lookups of states, summed over all threads; only kept if
+MCTS_SEARCH_STATS is enabled.
+*/
+typedef struct __tt_lookup_stats_ {
+    u64 lookups;
+    u64 hits;
+    u64 memory_exhausted; /* lookups that found no memory for a new state */
+    u64 lock_contentions; /* locks found already set */
+    u64 lock_wait_ns; /* time spent waiting on them */
+} tt_lookup_stats;
+
 
 /*
 Initialize the transpositions table structures.
@@ -65,29 +203,149 @@ Initialize the transpositions table structures.
 void tt_init();
 
 /*
-Looks up a previously stored state, or generates a new one. No assumptions are
-made about whether the board state is in reduced form already. Never fails. If
-the memory is full it allocates a new state regardless. If the state is found
-and returned it's OpenMP lock is first set. Thread-safe.
-RETURNS the state information
+Looks up a previously stored state of a root position, or generates a new one,
+in the orientation it is stored in (see tt_reduction): the canonical one for
+few stones, otherwise the one it was reached in, if found. Never fails. If the
+memory is full it allocates a new state regardless. If the state is found and
+returned it's OpenMP lock is first set. Must not be used while searches are
+running.
+RETURNS the state information, and the reduction method that transforms the
+board into its orientation
 */
 tt_stats * tt_lookup_create(
     const board * b,
     bool is_black,
-    u64 hash
+    d8 * reduction
 );
 
 /*
-Looks up a previously stored state, or generates a new one. No assumptions are
-made about whether the board state is in reduced form already. If the limit on
-states has been met the function returns NULL. If the state is found and
-returned it's OpenMP lock is first set. Thread-safe.
+Looks up a previously stored state, or generates a new one, for the board
+transformed by a reduction method. If the limit on states has been met, or
+there is no room left for the state in its lock stripe, the function returns
+NULL. If the state is found and returned it's OpenMP lock is first set.
+Thread-safe; only lookups to buckets of the same lock stripe are serialized.
 RETURNS the state information or NULL
 */
 tt_stats * tt_lookup_null(
     const cfg_board * cb,
     bool is_black,
-    u64 hash
+    u64 hash,
+    d8 reduction
+);
+
+/*
+Finds the orientation the state of a position is stored in, in a descent: the
+canonical one if it has at most TT_SYMMETRY_MAX_STONES stones, otherwise the
+one of its parent state.
+RETURNS reduction method that transforms the board into the orientation of its
+state
+*/
+d8 tt_reduction(
+    const cfg_board * cb,
+    d8 parent_reduction
+);
+
+/*
+RETURNS the move transformed by a reduction method; pass and none are kept
+*/
+move tt_reduce_move(
+    move m,
+    d8 reduction
+);
+
+/*
+RETURNS the move reverted from a reduction method; pass and none are kept
+*/
+move tt_revert_move(
+    move m,
+    d8 reduction
+);
+
+/*
+Sets the plays of a state being expanded, from their initial statistics. The
+plays are stored in memory owned by the transpositions table, in a block of the
+size class of their number. The state must not have plays yet and must have its
+lock set.
+Thread-safe.
+*/
+void tt_set_plays(
+    tt_stats * stats,
+    const tt_prior priors[],
+    move plays_count
+);
+
+/*
+Sets the states whose subtrees are also kept, besides the one specified, when
+freeing states with tt_clean_unreachable_start and tt_prune; so the table can be
+shared by the searches of several games. Not thread-safe.
+*/
+void tt_set_kept_roots(
+    const board roots[],
+    const bool is_black[],
+    u16 count
+);
+
+/*
+RETURNS the number of states whose subtrees are also kept
+*/
+u16 tt_kept_roots();
+
+/*
+Frees the states of the least visited branches of the subtree started at state
+b, and all states outside of it, so a search that ran out of memory can go on.
+The subtrees of the states also kept are pruned the same way. The visits
+threshold is raised until a significant part of the states in use is freed. Not
+thread-safe.
+RETURNS number of states freed.
+*/
+u32 tt_prune(
+    const board * b,
+    bool is_black
+);
+
+/*
+Releases the chunks of plays without blocks in use, dropping their blocks from
+the free lists; the chunks carved from a slab are kept as spares, with their
+pages returned to the system. Not thread-safe.
+RETURNS the memory of plays released, in bytes
+*/
+u64 tt_trim_plays();
+
+/*
+Starts freeing the states outside of the subtree started at state b, and of the
+states also kept; the states are then freed by calls to
+tt_clean_unreachable_step. A cleaning already in
+progress is finished first. Not thread-safe; there must not be searches running
+until the cleaning is complete.
+*/
+void tt_clean_unreachable_start(
+    const board * b,
+    bool is_black
+);
+
+/*
+Continues freeing the states outside of the subtree of the cleaning in progress,
+in at most the next buckets buckets of each table. Not thread-safe.
+RETURNS number of states freed.
+*/
+u32 tt_clean_unreachable_step(
+    u32 buckets
+);
+
+/*
+RETURNS true if a cleaning of unreachable states is in progress
+*/
+bool tt_clean_unreachable_pending();
+
+/*
+Counts the states of the subtree started at state b, the ones a cleaning from it
+would keep, without freeing any. There must not be a cleaning in progress. Not
+thread-safe.
+RETURNS number of states, or 0 if the state was not found
+*/
+u32 tt_subtree_states(
+    const board * b,
+    bool is_black
 );
 
 /*
@@ -104,6 +362,82 @@ Frees all game states and resets counters.
 */
 u32 tt_clean_all();
 
+/*
+Changes the memory limit of the table, in MiB, keeping the states in use. The
+states are rehashed into tables with a number of buckets fit for the new limit.
+Raising the limit reserves more memory; lowering it returns the memory not yet
+used by states and plays, while the states over the limit are only freed by the
+next prunings. Not thread-safe.
+*/
+void tt_resize(
+    u64 mbs
+);
+
+/*
+RETURNS the memory currently used by states and their plays, in bytes
+*/
+u64 tt_memory_in_use();
+
+/*
+RETURNS the memory used by states and allocated for the chunks of their plays,
+free blocks of plays included, in bytes
+*/
+u64 tt_memory_allocated();
+
+/*
+RETURNS the memory of the tables of buckets, besides the memory limit of the
+states and their plays, in bytes
+*/
+u64 tt_tables_memory();
+
+/*
+RETURNS the number of states currently in use
+*/
+u32 tt_states_in_use();
+
+/*
+Produces a fingerprint of the contents of the transpositions table: the states
+in use, by order of bucket, and the statistics of their plays. Is meant for
+comparing the trees of reproducible searches. Not thread-safe.
+RETURNS fingerprint of the states in use
+*/
+u64 tt_fingerprint();
+
+/*
+Writes the subtree started at state b to a file, as a compact snapshot that can
+be read back by tt_import_subtree, also by another process. Not thread-safe.
+RETURNS number of states written, or 0 if the state was not found or the file
+could not be written
+*/
+u32 tt_export_subtree(
+    const board * b,
+    bool is_black,
+    const char * filename
+);
+
+/*
+Replaces the contents of the table with a subtree written by tt_export_subtree.
+The states are read breadth-first until the memory limit is reached, so the
+states nearest the root are kept. Not thread-safe.
+RETURNS number of states read, or 0 if the file could not be read or is for a
+different board size or komi
+*/
+u32 tt_import_subtree(
+    const char * filename
+);
+
+/*
+Resets the counters of lookups of all threads.
+*/
+void tt_reset_lookup_stats();
+
+/*
+Sums the counters of lookups of all threads, since they were last reset.
+*/
+void tt_get_lookup_stats(
+    tt_lookup_stats * dst
+);
+
 /*
 Mostly for debugging -- log the current memory status of the transpositions
 table to stderr and log file.
@@ -24,4 +24,9 @@ if with a lot of commentary.
 #define MAX_PAGE_SIZ (4 * 1024 - 32)        /* 4 KiB */
 #define MAX_FILE_SIZ (4 * 1024 * 1024 - 64) /* 4 MiB */
 
+/*
+Assumed size of a CPU cache line, used to pad data shared between threads.
+*/
+#define CACHE_LINE_SIZ 64
+
 #endif
@@ -15,6 +15,22 @@ Initiate the internal Zobrist table from an external file.
 */
 void zobrist_init();
 
+/*
+Computes the tables of 3x3 and 12-point pattern hashing, even if they were
+compiled in already.
+*/
+void zobrist_tables_compute();
+
+/*
+Contents of the Zobrist section of a data pack, after zobrist_init; and the
+fingerprint of the file read.
+RETURNS newly allocated section contents
+*/
+void * zobrist_pack_section(
+    u64 * size,
+    u32 * fingerprint
+);
+
 /*
 Generate the Zobrist hash of a board state from scratch.
 RETURNS Zobrist hash
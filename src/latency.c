@@ -0,0 +1,175 @@
+/*
+Accounting of the latency of the answers to the GTP genmove commands, from the
+command being received to its answer being flushed, by stage. The stages are
+marked in sequence by the thread serving the commands; the time since the
+previous mark is added to the stage marked. The samples of the last
+LATENCY_WINDOW genmoves are kept for their percentiles.
+
+Marks made while no command is being timed, like those of the searches in the
+opponent's turn, are ignored.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "flog.h"
+#include "latency.h"
+#include "timem.h"
+#include "types.h"
+
+static const char * stage_names[LATENCY_STAGES] =
+{
+    "command",
+    "maintenance",
+    "opening book",
+    "root",
+    "search",
+    "output",
+    "logging"
+};
+
+/* command being timed */
+static bool timing = false;
+static bool keep = false;
+static u64 started;
+static u64 last_mark;
+static u64 stage_ns[LATENCY_STAGES];
+
+/* microseconds of the last genmoves, by stage and in total last */
+static u32 samples[LATENCY_WINDOW][LATENCY_STAGES + 1];
+static u32 samples_count = 0;
+static u32 next_sample = 0;
+
+
+/*
+Starts timing a command received at time mark received, in nanoseconds.
+*/
+void latency_start(
+    u64 received
+){
+    timing = true;
+    keep = false;
+    started = received;
+    last_mark = received;
+    memset(stage_ns, 0, sizeof(stage_ns));
+}
+
+/*
+Adds the time since the previous mark of the command being timed to a stage.
+*/
+void latency_mark(
+    u8 stage
+){
+    if(!timing)
+        return;
+
+    u64 now = current_time_in_nanos();
+    stage_ns[stage] += now - last_mark;
+    last_mark = now;
+}
+
+/*
+Marks the command being timed as a genmove, to be kept when it ends.
+*/
+void latency_keep()
+{
+    keep = timing;
+}
+
+static u32 to_micros(
+    u64 ns
+){
+    u64 us = ns / 1000;
+    return us < UINT32_MAX ? (u32)us : UINT32_MAX;
+}
+
+/*
+Ends timing the command, keeping its sample if it was a genmove, and logging
+its stages.
+*/
+void latency_end()
+{
+    if(!timing)
+        return;
+
+    timing = false;
+    if(!keep)
+        return;
+
+    u32 * sample = samples[next_sample];
+    for(u8 i = 0; i < LATENCY_STAGES; ++i)
+        sample[i] = to_micros(stage_ns[i]);
+    sample[LATENCY_STAGES] = to_micros(last_mark - started);
+
+    next_sample = (next_sample + 1) % LATENCY_WINDOW;
+    if(samples_count < LATENCY_WINDOW)
+        ++samples_count;
+
+    char * s = alloc();
+    u32 idx = snprintf(s, MAX_PAGE_SIZ, "answered in %.1f ms (",
+        sample[LATENCY_STAGES] / 1000.0);
+    for(u8 i = 0; i < LATENCY_STAGES; ++i)
+        idx += snprintf(s + idx, MAX_PAGE_SIZ - idx, "%s%s %.1f ms", i == 0 ?
+            "" : ", ", stage_names[i], sample[i] / 1000.0);
+    snprintf(s + idx, MAX_PAGE_SIZ - idx, ")");
+    flog_info("gtp", s);
+    release(s);
+}
+
+static int compare_micros(
+    const void * a,
+    const void * b
+){
+    u32 e1 = *((const u32 *)a);
+    u32 e2 = *((const u32 *)b);
+    return e1 < e2 ? -1 : (e1 > e2 ? 1 : 0);
+}
+
+/*
+RETURNS the value of the percentile p of the sorted values
+*/
+static double percentile(
+    const u32 sorted[],
+    u32 count,
+    u8 p
+){
+    u32 i = (count * p + 99) / 100;
+    return sorted[i == 0 ? 0 : i - 1] / 1000.0;
+}
+
+/*
+Produces a textual description of the percentiles of the latency of the last
+genmoves, in total and by stage, one per line, up to siz characters.
+RETURNS number of characters written
+*/
+u32 latency_to_string(
+    char * dst,
+    u32 siz
+){
+    if(samples_count == 0)
+        return snprintf(dst, siz, "no genmove yet");
+
+    u32 sorted[LATENCY_WINDOW];
+    u32 idx = snprintf(dst, siz, "last %u genmoves, in ms (p50 p90 p99 max)",
+        samples_count);
+    for(u8 i = 0; i <= LATENCY_STAGES && idx < siz; ++i)
+    {
+        /* the total first */
+        u8 stage = i == 0 ? LATENCY_STAGES : i - 1;
+
+        for(u32 j = 0; j < samples_count; ++j)
+            sorted[j] = samples[j][stage];
+        qsort(sorted, samples_count, sizeof(u32), compare_micros);
+
+        idx += snprintf(dst + idx, siz - idx, "\n%s: %.1f %.1f %.1f %.1f",
+            stage == LATENCY_STAGES ? "total" : stage_names[stage],
+            percentile(sorted, samples_count, 50), percentile(sorted,
+            samples_count, 90), percentile(sorted, samples_count, 99),
+            sorted[samples_count - 1] / 1000.0);
+    }
+    return MIN(idx, siz);
+}
@@ -0,0 +1,137 @@
+/*
+Matilda MCTS benchmark suite
+
+Searches the current position of each SGF file of a folder, for a fixed time,
+with an increasing number of threads up to the number of threads available. The
+RNG seeds are reset before each search and each position is first searched once
+as warm-up, so the results of different builds in the same system can be
+compared. Reports the simulations and states created per second and the memory
+used by each search; and the simulations per second of all positions by number
+of threads.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#include "board.h"
+#include "file_io.h"
+#include "flog.h"
+#include "game_record.h"
+#include "mcts.h"
+#include "randg.h"
+#include "sgf.h"
+#include "timem.h"
+#include "transpositions.h"
+#include "types.h"
+
+#define BENCHMARK_MAX_POSITIONS 64
+#define BENCHMARK_SEED 1
+#define BENCHMARK_WARM_UP_TIME 2000 /* in milliseconds */
+#define BENCHMARK_SEARCH_TIME 5000 /* in milliseconds */
+
+static int compare_filenames(
+    const void * a,
+    const void * b
+){
+    return strcmp(*((char * const *)a), *((char * const *)b));
+}
+
+/*
+RETURNS the next number of threads of the sweep, or 0 if finished
+*/
+static u16 next_num_threads(
+    u16 num_threads,
+    u16 max_threads
+){
+    if(num_threads >= max_threads)
+        return 0;
+    return MIN(num_threads * 2, max_threads);
+}
+
+/*
+Runs the benchmark suite on the SGF files found in the folder.
+*/
+void main_benchmark(
+    const char * folder
+){
+    char path[MAX_PATH_SIZ];
+    u32 len = snprintf(path, MAX_PATH_SIZ, "%s", folder);
+    if(len > 0 && len < MAX_PATH_SIZ - 1 && path[len - 1] != '/')
+        snprintf(path + len, MAX_PATH_SIZ - len, "/");
+
+    char * filenames[BENCHMARK_MAX_POSITIONS + 1];
+    u32 positions = recurse_find_files(path, ".sgf", filenames,
+        BENCHMARK_MAX_POSITIONS);
+    if(positions == 0)
+    {
+        fprintf(stderr, "no SGF files found in %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    qsort(filenames, positions, sizeof(char *), compare_filenames);
+
+    game_record * gr = malloc(sizeof(game_record));
+    if(gr == NULL)
+        flog_crit("bnch", "system out of memory");
+
+    u16 max_threads = omp_get_max_threads();
+    u32 total_sims[MAXIMUM_NUM_THREADS + 1];
+    u64 total_time[MAXIMUM_NUM_THREADS + 1];
+    memset(total_sims, 0, sizeof(total_sims));
+    memset(total_time, 0, sizeof(total_time));
+
+    fprintf(stderr, "%-32s %7s %12s %12s %10s\n", "position", "threads",
+        "sims/s", "states/s", "MiB");
+
+    for(u32 i = 0; i < positions; ++i)
+    {
+        if(!import_game_from_sgf(gr, filenames[i]))
+        {
+            fprintf(stderr, "%-32s skipped\n", filenames[i] + strlen(path));
+            continue;
+        }
+
+        board b;
+        current_game_state(&b, gr);
+        bool is_black = current_player_color(gr);
+
+        tt_clean_all();
+        rand_seed(BENCHMARK_SEED);
+        omp_set_num_threads(max_threads);
+        mcts_benchmark(&b, is_black, BENCHMARK_WARM_UP_TIME);
+
+        for(u16 t = 1; t > 0; t = next_num_threads(t, max_threads))
+        {
+            tt_clean_all();
+            rand_seed(BENCHMARK_SEED);
+            omp_set_num_threads(t);
+
+            u64 start_time = current_time_in_millis();
+            u32 sims = mcts_benchmark(&b, is_black, BENCHMARK_SEARCH_TIME);
+            u64 elapsed = MAX(current_time_in_millis() - start_time, 1);
+
+            total_sims[t] += sims;
+            total_time[t] += elapsed;
+
+            fprintf(stderr, "%-32s %7u %12.1f %12.1f %10.1f\n", filenames[i] +
+                strlen(path), t, (sims * 1000.0) / elapsed,
+                (tt_states_in_use() * 1000.0) / elapsed,
+                tt_memory_in_use() / 1048576.0);
+        }
+    }
+
+    for(u16 t = 1; t > 0; t = next_num_threads(t, max_threads))
+        if(total_time[t] > 0)
+            fprintf(stderr, "%-32s %7u %12.1f\n", "all", t, (total_sims[t] *
+                1000.0) / total_time[t]);
+
+    tt_clean_all();
+    omp_set_num_threads(max_threads);
+
+    free(gr);
+    for(u32 i = 0; i < positions; ++i)
+        free(filenames[i]);
+}
@@ -23,9 +23,15 @@ GTP_README.
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <time.h>
 #include <string.h>
+#include <poll.h>
+#include <signal.h>
 #include <sys/select.h> /* fd_set in macOS */
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <omp.h>
 
 #include "alloc.h"
 #include "board.h"
@@ -33,6 +39,8 @@ GTP_README.
 #include "file_io.h"
 #include "flog.h"
 #include "game_record.h"
+#include "latency.h"
+#include "mcts.h"
 #include "opening_book.h"
 #include "pts_file.h"
 #include "randg.h"
@@ -47,8 +55,15 @@ GTP_README.
 #include "types.h"
 #include "version.h"
 
+/* the positions of the other sessions are kept in the transpositions table */
+#define MAX_GTP_SESSIONS (TT_MAX_KEPT_ROOTS + 1)
+
+/* characters of each turn of a game review, and of the prefix of an answer */
+#define REVIEW_LINE_SIZ 64
+#define ANSWER_PREFIX_SIZ 32
 
 extern d16 komi;
+extern d16 dynamic_komi;
 
 const char * supported_commands[] =
 {
@@ -73,9 +88,19 @@ const char * supported_commands[] =
     "komi",
     "list_commands",
     "loadsgf",
+    "lz-analyze",
     "mtld-game_info",
+    "mtld-genmove_latency",
     "mtld-last_evaluation",
+    "mtld-load_tree",
+    "mtld-memory_usage",
+    "mtld-ownership",
+    "mtld-playout_policy",
     "mtld-review_game",
+    "mtld-save_tree",
+    "mtld-search_stats",
+    "mtld-set_memory",
+    "mtld-set_threads",
     "mtld-time_left",
     "name",
     "place_free_handicap",
@@ -101,6 +126,8 @@ extern game_record current_game;
 extern time_system current_clock_black;
 extern time_system current_clock_white;
 extern u32 limit_by_playouts;
+extern u64 max_size_in_mbs;
+extern bool pl_light_playouts;
 extern char * sentinel_file;
 
 static bool out_on_time_warning = false;
@@ -116,6 +143,19 @@ static u64 request_received_mark;
 
 static out_board last_out_board;
 
+/*
+Server mode state: the session being served ends after a quit command or a
+failed write; the input tested while thinking is that of every session.
+*/
+static bool server_mode = false;
+static bool session_ended = false;
+static bool session_has_line = false;
+static struct pollfd server_fds[MAX_GTP_SESSIONS + 1];
+static u16 server_fds_count = 0;
+
+/* program arguments, for switching to the engine of another board size */
+static char ** program_argv = NULL;
+
 extern clock_t start_cpu_time;
 
 static void update_player_names()
@@ -142,6 +182,17 @@ static void update_player_names()
     return;
 }
 
+/*
+In server mode a client that went away only ends its own session.
+*/
+static void write_failed()
+{
+    if(server_mode)
+        session_ended = true;
+    else
+        flog_crit("gtp", "failed to write to comm. file descriptor");
+}
+
 static void gtp_error(
     FILE * fp,
     int id,
@@ -155,7 +206,7 @@ static void gtp_error(
 
     size_t w = fwrite(buf, 1, strlen(buf), fp);
     if(w != strlen(buf))
-        flog_crit("gtp", "failed to write to comm. file descriptor");
+        write_failed();
 
     fflush(fp);
 
@@ -168,30 +219,41 @@ static void gtp_answer(
     int id,
     const char * s
 ){
-    char * buf = alloc();
+    /* long answers, like game reviews, don't fit in a page */
+    size_t siz = (s == NULL ? 0 : strlen(s)) + ANSWER_PREFIX_SIZ;
+    bool paged = (siz <= MAX_PAGE_SIZ);
+    char * buf = paged ? alloc() : malloc(siz);
+    if(buf == NULL)
+        flog_crit("gtp", "system out of memory");
+    if(paged)
+        siz = MAX_PAGE_SIZ;
+
     if(s == NULL || strlen(s) == 0)
     {
         if(id == -1)
-            snprintf(buf, MAX_PAGE_SIZ, "= \n\n");
+            snprintf(buf, siz, "= \n\n");
         else
-            snprintf(buf, MAX_PAGE_SIZ, "=%d\n\n", id);
+            snprintf(buf, siz, "=%d\n\n", id);
     }
     else
     {
         if(id == -1)
-            snprintf(buf, MAX_PAGE_SIZ, "= %s\n\n", s);
+            snprintf(buf, siz, "= %s\n\n", s);
         else
-            snprintf(buf, MAX_PAGE_SIZ, "=%d %s\n\n", id, s);
+            snprintf(buf, siz, "=%d %s\n\n", id, s);
     }
 
     size_t w = fwrite(buf, 1, strlen(buf), fp);
     if(w != strlen(buf))
-        flog_crit("gtp", "failed to write to comm. file descriptor");
+        write_failed();
 
     fflush(fp);
 
     flog_prot("gtp", buf);
-    release(buf);
+    if(paged)
+        release(buf);
+    else
+        free(buf);
 }
 
 static void gtp_protocol_version(
@@ -255,70 +317,127 @@ static void gtp_list_commands(
 }
 
 /*
-Review all previous plays in the selected time in seconds per turn. Receives
-time to think in seconds.
-RETURNS text description
+Reviews the game played so far, searching each position under either a time
+per turn or a total time budget, shared by the positions still to search so the
+time saved by early stops goes to the following ones. Forward, the tree of the
+play made is kept for the next position; backward, the trees of the positions
+later in the game are reused by the earlier ones, that reach them.
 */
 static void gtp_review_game(
     FILE * fp,
     int id,
-    const char * timestr /* in seconds */
+    u16 argc,
+    char * argv[]
 ){
     u32 seconds;
-    if(!parse_uint(&seconds, timestr) || seconds < 1)
+    if(!parse_uint(&seconds, argv[0]) || seconds < 1)
     {
         gtp_error(fp, id, "syntax error");
         return;
     }
 
+    bool total = false;
+    bool backward = false;
+    for(u16 i = 1; i < argc; ++i)
+        if(strcmp(argv[i], "total") == 0)
+            total = true;
+        else if(strcmp(argv[i], "backward") == 0)
+            backward = true;
+        else
+        {
+            gtp_error(fp, id, "syntax error");
+            return;
+        }
+
     new_match_maintenance();
 
-    char * buf = alloc();
-    u32 idx = 0;
+    u16 turns = current_game.turns;
+    board * states = malloc(sizeof(board) * (turns + 1));
+    move * best = malloc(sizeof(move) * (turns + 1));
+    double * actual_q = malloc(sizeof(double) * (turns + 1));
+    double * best_q = malloc(sizeof(double) * (turns + 1));
+    if(states == NULL || best == NULL || actual_q == NULL || best_q == NULL)
+        flog_crit("gtp", "system out of memory");
+
+    bool first_is_black = first_player_color(&current_game);
+    first_game_state(&states[0], &current_game);
+    for(u16 t = 0; t < turns; ++t)
+    {
+        memcpy(&states[t + 1], &states[t], sizeof(board));
+        just_play_slow(&states[t + 1], first_is_black == (t % 2 == 0),
+            current_game.moves[t]);
+    }
 
+    u64 deadline = current_time_in_millis() + ((u64)seconds) * 1000;
     out_board out_b;
-    board b;
-    first_game_state(&b, &current_game);
-    bool is_black = first_player_color(&current_game);
 
-    for(u16 t = 0; t < current_game.turns; ++t)
+    for(u16 i = 0; i < turns; ++i)
     {
+        u16 t = backward ? turns - 1 - i : i;
+        bool is_black = first_is_black == (t % 2 == 0);
+
         u64 curr_time = current_time_in_millis();
-        u64 stop_time = curr_time + seconds * 1000;
-        u64 early_stop_time = curr_time + seconds * 500;
-        evaluate_position_timed(&b, is_black, &out_b, stop_time,
-            early_stop_time);
+        u64 time_to_play = ((u64)seconds) * 1000;
+        if(total)
+            time_to_play = deadline > curr_time ? (deadline - curr_time) /
+                (turns - i) : 0;
+        u64 stop_time = curr_time + time_to_play;
+        u64 early_stop_time = curr_time + time_to_play / 2;
+        evaluate_position_timed(&states[t], is_black, &out_b, stop_time,
+            early_stop_time, stop_time);
 
-        move best = select_play_fast(&out_b);
         move actual = current_game.moves[t];
-        char * s = alloc();
+        best[t] = select_play_fast(&out_b);
+        actual_q[t] = is_board_move(actual) ? out_b.value[actual] : 0.0;
+        best_q[t] = is_board_move(best[t]) ? out_b.value[best[t]] : 0.0;
+
+        /* the states of the siblings of the play made are no longer needed */
+        if(!backward)
+            opt_turn_maintenance(&states[t + 1], !is_black);
+    }
+
+    u32 buf_siz = ((u32)turns) * REVIEW_LINE_SIZ + 1;
+    char * buf = malloc(buf_siz);
+    if(buf == NULL)
+        flog_crit("gtp", "system out of memory");
+    buf[0] = 0;
+    char * s = alloc();
+    u32 idx = 0;
+    for(u16 t = 0; t < turns && idx < buf_siz; ++t)
+    {
+        char color = first_is_black == (t % 2 == 0) ? 'B' : 'W';
+        move actual = current_game.moves[t];
         if(is_board_move(actual))
         {
             coord_to_alpha_num(s, actual);
-            idx += snprintf(buf + idx, 4 * 1024 - idx,
-                "%u: (%c) Actual: %s (%.3f)", t, is_black ? 'B' : 'W', s,
-                out_b.value[actual]);
+            idx += snprintf(buf + idx, buf_siz - idx,
+                "%u: (%c) Actual: %s (%.3f)", t, color, s, actual_q[t]);
         }
         else
-            idx += snprintf(buf + idx, 4 * 1024 - idx,
-                "%u: (%c) Actual: pass", t, is_black ? 'B' : 'W');
+            idx += snprintf(buf + idx, buf_siz - idx,
+                "%u: (%c) Actual: pass", t, color);
 
-        if(is_board_move(best))
+        if(idx >= buf_siz)
+            break;
+
+        if(is_board_move(best[t]))
         {
-            coord_to_alpha_num(s, best);
-            idx += snprintf(buf + idx, 4 * 1024 - idx, " Best: %s (%.3f)\n", s,
-                out_b.value[best]);
+            coord_to_alpha_num(s, best[t]);
+            idx += snprintf(buf + idx, buf_siz - idx, " Best: %s (%.3f)\n",
+                s, best_q[t]);
         }
         else
-            idx += snprintf(buf + idx, 4 * 1024 - idx, " Best: pass\n");
-        release(s);
-        opt_turn_maintenance(&b, is_black);
-        just_play_slow(&b, is_black, actual);
-        is_black = !is_black;
+            idx += snprintf(buf + idx, buf_siz - idx, " Best: pass\n");
     }
+    release(s);
+
+    free(best_q);
+    free(actual_q);
+    free(best);
+    free(states);
 
     gtp_answer(fp, id, buf);
-    release(buf);
+    free(buf);
 }
 
 static void gtp_quit(
@@ -326,6 +445,11 @@ static void gtp_quit(
     int id
 ){
     gtp_answer(fp, id, NULL);
+    if(server_mode)
+    {
+        session_ended = true;
+        return;
+    }
     exit(EXIT_SUCCESS);
 }
 
@@ -391,6 +515,127 @@ static void gtp_kgs_game_over(
     close_if_sentinel_found();
 }
 
+/*
+Switches to the engine built for another board size by make multisize, named
+matilda-NxN and found next to this program or in the path, executing it in
+place of this process with the same arguments. It starts by answering the
+boardsize command. The game is cleared, as with any board size change, and the
+settings changed over GTP restart from the program arguments.
+RETURNS only if there is no engine for the size or in server mode
+*/
+static void switch_board_size(
+    FILE * fp,
+    int id,
+    u32 size
+){
+    if(server_mode || program_argv == NULL)
+        return;
+
+    char * path = alloc();
+    const char * dir_end = strrchr(program_argv[0], '/');
+    if(dir_end == NULL)
+        snprintf(path, MAX_PAGE_SIZ, "matilda-%ux%u", size, size);
+    else
+        snprintf(path, MAX_PAGE_SIZ, "%.*smatilda-%ux%u",
+            (int)(dir_end - program_argv[0] + 1), program_argv[0], size, size);
+
+    if(dir_end != NULL && access(path, X_OK) != 0)
+    {
+        release(path);
+        return;
+    }
+
+    /*
+    The same arguments, without those of a previous switch, followed by the
+    settings that may have changed over GTP, that override them.
+    */
+    u16 argc = 0;
+    while(program_argv[argc] != NULL)
+        ++argc;
+    char ** argv = malloc((argc + 13) * sizeof(char *));
+    if(argv == NULL)
+        flog_crit("gtp", "system out of memory");
+
+    u16 n = 0;
+    for(u16 i = 0; i < argc; ++i)
+    {
+        if(strcmp(program_argv[i], "--answer_boardsize") == 0 && i < argc - 1)
+        {
+            ++i;
+            continue;
+        }
+        argv[n++] = program_argv[i];
+    }
+    char id_str[16];
+    snprintf(id_str, 16, "%d", id);
+    argv[n++] = "--answer_boardsize";
+    argv[n++] = id_str;
+
+    char komi_str[16];
+    snprintf(komi_str, 16, "%.1f", komi / 2.0);
+    argv[n++] = "--komi";
+    argv[n++] = komi_str;
+
+    /* a clock without any time can't be given as an argument */
+    char time_str[64];
+    const time_system * ts = &current_clock_black;
+    if(!time_system_overriden && limit_by_playouts == 0 && (ts->main_time > 0
+        || ts->byo_yomi_time > 0))
+    {
+        if(ts->main_time == 0 && ts->byo_yomi_time > 0 && ts->byo_yomi_stones
+            == 0)
+            snprintf(time_str, 64, "infinite");
+        else if(ts->byo_yomi_time == 0)
+            snprintf(time_str, 64, "%ums", ts->main_time);
+        else if(ts->main_time == 0)
+            snprintf(time_str, 64, "0+%ux%ums/%u", ts->byo_yomi_periods,
+                ts->byo_yomi_time, ts->byo_yomi_stones);
+        else
+            snprintf(time_str, 64, "%ums+%ux%ums/%u", ts->main_time,
+                ts->byo_yomi_periods, ts->byo_yomi_time, ts->byo_yomi_stones);
+        argv[n++] = "--time";
+        argv[n++] = time_str;
+    }
+
+    char threads_str[16];
+    snprintf(threads_str, 16, "%d", omp_get_max_threads());
+    argv[n++] = "--threads";
+    argv[n++] = threads_str;
+
+    char memory_str[24];
+    snprintf(memory_str, 24, "%" PRIu64, max_size_in_mbs);
+    argv[n++] = "--memory";
+    argv[n++] = memory_str;
+
+    argv[n++] = "--playout_policy";
+    argv[n++] = pl_light_playouts ? "light" : "heavy";
+    argv[n] = NULL;
+
+    char * s = alloc();
+    snprintf(s, MAX_PAGE_SIZ, "switching to %s", path);
+    flog_info("gtp", s);
+    release(s);
+    flog_flush();
+
+    /* the new engine expects the GTP output as standard output */
+    fflush(fp);
+    if(dup2(fileno(fp), STDOUT_FILENO) != -1)
+    {
+        if(dir_end == NULL)
+            execvp(path, argv);
+        else
+            execv(path, argv);
+        close(STDOUT_FILENO);
+    }
+
+    s = alloc();
+    snprintf(s, MAX_PAGE_SIZ, "could not execute %s", path);
+    flog_warn("gtp", s);
+    release(s);
+    free(argv);
+    release(path);
+}
+
 static void gtp_boardsize(
     FILE * fp,
     int id,
@@ -411,10 +656,12 @@ static void gtp_boardsize(
 
     if(ns != BOARD_SIZ)
     {
+        switch_board_size(fp, id, ns);
         gtp_error(fp, id, "unacceptable size");
 
         fprintf(stderr, "board size cannot be changed on runtime; please edit t\
-he master header file and recompile matilda\n");
+he master header file and recompile matilda, or build the engines of other \
+sizes with make multisize\n");
         char * s = alloc();
         snprintf(s, MAX_PAGE_SIZ, "requested board size change to %ux%u", ns,
             ns);
@@ -447,7 +694,13 @@ static void gtp_komi(
     }
     gtp_answer(fp, id, NULL);
 
-    komi = (d16)(komid * 2.0);
+    d16 new_komi2 = (d16)(komid * 2.0);
+    if(new_komi2 != komi)
+    {
+        komi = new_komi2;
+        /* the outcomes proven by the searches depend on the komi */
+        new_match_maintenance();
+    }
 }
 
 static void gtp_play(
@@ -503,14 +756,16 @@ static void gtp_play(
 }
 
 /*
-Generic genmove functions that fulfills the needs of the GTP.
+Generic genmove functions that fulfills the needs of the GTP. In the cleanup
+phase of a game the play is chosen by a short search, to capture the dead
+stones of the opponent, and never resigns or passes while there are any.
 */
 static void generic_genmove(
     FILE * fp,
     int id,
     const char * color,
     bool commit_game_changes,
-    bool allow_pass_when_winning
+    bool cleanup
 ){
     bool is_black;
     if(!parse_color(&is_black, color))
@@ -519,6 +774,7 @@ static void generic_genmove(
         return;
     }
 
+    latency_keep();
     char * buf = alloc();
     out_board out_b;
 
@@ -553,7 +809,9 @@ static void generic_genmove(
     */
     if(resign_on_timeout && curr_clock->timed_out)
     {
+        latency_mark(LAT_COMMAND);
         gtp_answer(fp, id, "resign");
+        latency_mark(LAT_OUTPUT);
 
         if(!out_on_time_warning)
         {
@@ -574,8 +832,26 @@ static void generic_genmove(
     }
 
     bool has_play;
-    if(limit_by_playouts > 0)
+    if(cleanup)
     {
+        /* the short search still keeps to the time available */
+        u64 stop_time = 0;
+        if(limit_by_playouts == 0)
+        {
+            time_to_play = calc_time_to_play(curr_clock,
+                stone_count(current_state.p));
+            if(time_to_play != UINT32_MAX)
+                stop_time = request_received_mark + time_to_play;
+        }
+
+        latency_mark(LAT_COMMAND);
+        evaluate_position_cleanup(&current_state, is_black, &out_b,
+            stop_time);
+        has_play = true;
+    }
+    else if(limit_by_playouts > 0)
+    {
+        latency_mark(LAT_COMMAND);
         has_play = evaluate_position_sims(&current_state, is_black, &out_b,
             limit_by_playouts);
     }
@@ -596,9 +872,12 @@ static void generic_genmove(
 
         u64 stop_time = request_received_mark + time_to_play;
         u64 early_stop_time = request_received_mark + (time_to_play / 3);
+        u64 max_stop_time = request_received_mark +
+            calc_max_time_to_play(curr_clock, stones);
 
+        latency_mark(LAT_COMMAND);
         has_play = evaluate_position_timed(&current_state, is_black, &out_b,
-            stop_time, early_stop_time);
+            stop_time, early_stop_time, max_stop_time);
     }
 
     memcpy(&last_out_board, &out_b, sizeof(out_board));
@@ -609,7 +888,10 @@ static void generic_genmove(
         /*
         A play or pass is suggested.
         */
-        if(allow_pass_when_winning && out_b.pass >= JUST_PASS_WINRATE)
+        if(cleanup)
+            m = select_cleanup_play(&out_b, &current_state, is_black,
+                &current_game);
+        else if(out_b.pass >= JUST_PASS_WINRATE)
             m = PASS;
         else
             m = select_play(&out_b, is_black, &current_game);
@@ -626,6 +908,7 @@ static void generic_genmove(
         else
         {
             gtp_answer(fp, id, "resign");
+            latency_mark(LAT_OUTPUT);
 
             snprintf(buf, MAX_PAGE_SIZ, "matilda playing as %s (%c) resigns\n",
                 is_black ? "black" : "white", is_black ? BLACK_STONE_CHAR :
@@ -648,6 +931,7 @@ static void generic_genmove(
 
     coord_to_gtp_vertex(buf, m);
     gtp_answer(fp, id, buf);
+    latency_mark(LAT_OUTPUT);
 
     if(commit_game_changes)
     {
@@ -664,6 +948,7 @@ static void generic_genmove(
         */
         add_play_out_of_order(&current_game, is_black, m);
     }
+    latency_mark(LAT_COMMAND);
 
     release(buf);
 }
@@ -673,7 +958,7 @@ static void gtp_genmove(
     int id,
     const char * color
 ){
-    generic_genmove(fp, id, color, true, true);
+    generic_genmove(fp, id, color, true, false);
 }
 
 static void gtp_genmove_cleanup(
@@ -681,7 +966,7 @@ static void gtp_genmove_cleanup(
     int id,
     const char * color
 ){
-    generic_genmove(fp, id, color, true, false);
+    generic_genmove(fp, id, color, true, true);
 }
 
 static void gtp_reg_genmove(
@@ -689,7 +974,7 @@ static void gtp_reg_genmove(
     int id,
     const char * color
 ){
-    generic_genmove(fp, id, color, false, true);
+    generic_genmove(fp, id, color, false, false);
 }
 
 static void gtp_echo(
@@ -1043,33 +1328,41 @@ static void gtp_final_status_list(
     int id,
     const char * status
 ){
-    if(strcmp(status, "alive") == 0)
+    if(strcmp(status, "seki") == 0)
     {
-        char * buf = alloc();
-        char * mstr = alloc();
-        d32 idx = 0;
-
-        board current_state;
-        current_game_state(&current_state, &current_game);
-        for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
-        {
-            coord_to_alpha_num(mstr, m);
-            idx += snprintf(buf + idx, MAX_PAGE_SIZ - idx, "%s\n",
-                mstr);
-        }
-        gtp_answer(fp, id, buf);
-        release(mstr);
-        release(buf);
+        gtp_answer(fp, id, NULL);
         return;
     }
 
-    if(strcmp(status, "dead") == 0 || strcmp(status, "seki") == 0)
+    bool alive = strcmp(status, "alive") == 0;
+    if(!alive && strcmp(status, "dead") != 0)
     {
-        gtp_answer(fp, id, NULL);
+        gtp_error(fp, id, "syntax error");
         return;
     }
 
-    gtp_error(fp, id, "syntax error");
+    board current_state;
+    current_game_state(&current_state, &current_game);
+    bool dead[TOTAL_BOARD_SIZ];
+    estimate_dead_stones(&current_state, current_player_color(&current_game),
+        dead);
+
+    char * buf = alloc();
+    char * mstr = alloc();
+    buf[0] = 0;
+    d32 idx = 0;
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+        if(current_state.p[m] != EMPTY && dead[m] != alive)
+        {
+            coord_to_alpha_num(mstr, m);
+            idx += snprintf(buf + idx, MAX_PAGE_SIZ - idx, "%s\n", mstr);
+        }
+    /* without the last line break */
+    if(idx > 0)
+        buf[idx - 1] = 0;
+    gtp_answer(fp, id, buf);
+    release(mstr);
+    release(buf);
 }
 
 static void gtp_gomill_describe_engine(
@@ -1163,13 +1456,192 @@ static void gtp_last_evaluation(
     release(s);
 }
 
+static void gtp_ownership(
+    FILE * fp,
+    int id
+){
+    board current_state;
+    current_game_state(&current_state, &current_game);
+    float owner[TOTAL_BOARD_SIZ];
+    estimate_ownership(&current_state, current_player_color(&current_game),
+        owner);
+
+    char * s = alloc();
+    u16 idx = 0;
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+    {
+        if((m % BOARD_SIZ) == 0)
+            idx += snprintf(s + idx, MAX_PAGE_SIZ - idx, "\n");
+        idx += snprintf(s + idx, MAX_PAGE_SIZ - idx, " %5.2f", owner[m]);
+    }
+    gtp_answer(fp, id, s);
+    release(s);
+}
+
+static void gtp_save_tree(
+    FILE * fp,
+    int id,
+    const char * filename
+){
+    if(!validate_filename(filename))
+    {
+        gtp_error(fp, id, "illegal file name");
+        return;
+    }
+
+    char * buf = alloc();
+    snprintf(buf, MAX_PAGE_SIZ, "%s%s", data_folder(), filename);
+
+    board current_state;
+    current_game_state(&current_state, &current_game);
+    u32 states = save_search_tree(&current_state,
+        current_player_color(&current_game), buf);
+    if(states == 0)
+        gtp_error(fp, id, "could not save tree");
+    else
+    {
+        snprintf(buf, MAX_PAGE_SIZ, "%u", states);
+        gtp_answer(fp, id, buf);
+    }
+
+    release(buf);
+}
+
+static void gtp_load_tree(
+    FILE * fp,
+    int id,
+    const char * filename
+){
+    if(!validate_filename(filename))
+    {
+        gtp_error(fp, id, "illegal file name");
+        return;
+    }
+
+    char * buf = alloc();
+    snprintf(buf, MAX_PAGE_SIZ, "%s%s", data_folder(), filename);
+
+    u32 states = load_search_tree(buf);
+    if(states == 0)
+        gtp_error(fp, id, "could not load tree");
+    else
+    {
+        snprintf(buf, MAX_PAGE_SIZ, "%u", states);
+        gtp_answer(fp, id, buf);
+    }
+
+    release(buf);
+}
+
+static void gtp_search_stats(
+    FILE * fp,
+    int id
+){
+    char * s = alloc();
+    s[0] = '\n';
+    mcts_last_search_stats(s + 1);
+    gtp_answer(fp, id, s);
+    release(s);
+}
+
+static void gtp_memory_usage(
+    FILE * fp,
+    int id
+){
+    char * s = alloc();
+    char * s2 = alloc();
+    memory_usage_to_string(s2);
+    snprintf(s, MAX_PAGE_SIZ, "\n%s", s2);
+    gtp_answer(fp, id, s);
+    release(s2);
+    release(s);
+}
+
+static void gtp_genmove_latency(
+    FILE * fp,
+    int id
+){
+    char * s = alloc();
+    s[0] = '\n';
+    latency_to_string(s + 1, MAX_PAGE_SIZ - 1);
+    gtp_answer(fp, id, s);
+    release(s);
+}
+
+static void gtp_set_memory(
+    FILE * fp,
+    int id,
+    const char * mbs
+){
+    u32 v;
+    if(!parse_uint(&v, mbs) || v < 2)
+    {
+        gtp_error(fp, id, "syntax error");
+        return;
+    }
+
+    tt_resize(v);
+
+    /* the states over the new limit are pruned now, not mid-search */
+    bool is_black = current_player_color(&current_game);
+    board current_state;
+    current_game_state(&current_state, &current_game);
+    while(tt_memory_in_use() >= ((u64)v) * 1048576 &&
+        tt_prune(&current_state, is_black) > 0)
+        ;
+
+    gtp_answer(fp, id, NULL);
+}
+
+static void gtp_set_threads(
+    FILE * fp,
+    int id,
+    const char * threads
+){
+    u32 v;
+    if(!parse_uint(&v, threads) || v > MAXIMUM_NUM_THREADS)
+    {
+        gtp_error(fp, id, "syntax error");
+        return;
+    }
+
+    if(v == 0)
+        v = MIN(omp_get_num_procs(), MAXIMUM_NUM_THREADS);
+    omp_set_num_threads(v);
+
+    char * s = alloc();
+    snprintf(s, MAX_PAGE_SIZ, "%u", v);
+    gtp_answer(fp, id, s);
+    release(s);
+}
+
+static void gtp_playout_policy(
+    FILE * fp,
+    int id,
+    const char * policy
+){
+    if(strcmp(policy, "heavy") == 0)
+        set_light_playouts(false);
+    else
+        if(strcmp(policy, "light") == 0)
+            set_light_playouts(true);
+        else
+        {
+            gtp_error(fp, id, "syntax error");
+            return;
+        }
+
+    gtp_answer(fp, id, NULL);
+}
+
 static void gtp_final_score(
     FILE * fp,
     int id
 ){
     board current_state;
     current_game_state(&current_state, &current_game);
-    d16 score = score_stones_and_area(current_state.p);
+    d16 score = estimate_final_score(&current_state,
+        current_player_color(&current_game));
 
     current_game.finished = true;
     current_game.final_score = score;
@@ -1316,7 +1788,7 @@ static void gtp_loadsgf(
 
     gtp_answer(fp, id, NULL);
 
-    tmp.turns = MIN(tmp.turns, move_until - 1);
+    truncate_game_record(&tmp, MIN(tmp.turns, move_until - 1));
 
     memcpy(&current_game, &tmp, sizeof(game_record));
 
@@ -1359,15 +1831,487 @@ static void gtp_printsgf(
 }
 
 /*
-Main function for GTP mode - performs command selction.
+Tests, without blocking, whether there is input to be read from the standard
+input; errors are reported as input available, to be caught when reading. In
+server mode any session or new connection with input counts.
+RETURNS true if there is input available
+*/
+static bool input_available()
+{
+    if(server_mode)
+        return session_has_line || poll(server_fds, server_fds_count, 0) != 0;
+
+    fd_set readfs;
+    FD_ZERO(&readfs);
+    FD_SET(STDIN_FILENO, &readfs);
+    struct timeval tm;
+    tm.tv_sec = 0;
+    tm.tv_usec = 0;
+
+    return select(STDIN_FILENO + 1, &readfs, NULL, NULL, &tm) != 0;
+}
+
+static FILE * analysis_fp;
+
+static void print_analysis(
+    const char * info
+){
+    fprintf(analysis_fp, "%s\n", info);
+    fflush(analysis_fp);
+}
+
+/*
+Searches the position until the next command arrives, printing the candidate
+plays every interval centiseconds, as lz-analyze of Leela Zero. The arguments
+are the optional color to play and the interval, optionally preceded by the
+keyword interval.
+*/
+static void gtp_lz_analyze(
+    FILE * fp,
+    int id,
+    u16 argc,
+    char ** argv
+){
+    bool is_black = current_player_color(&current_game);
+    u32 interval = 100;
+
+    for(u16 i = 0; i < argc; ++i)
+    {
+        if(parse_color(&is_black, argv[i]) || strcmp(argv[i], "interval") == 0)
+            continue;
+
+        if(!parse_uint(&interval, argv[i]))
+        {
+            gtp_error(fp, id, "syntax error");
+            return;
+        }
+    }
+
+    board current_state;
+    current_game_state(&current_state, &current_game);
+    if(current_game.turns > 0 && current_player_color(&current_game) !=
+        is_black)
+    {
+        current_state.last_played = NONE;
+        current_state.last_eaten = NONE;
+    }
+
+    /* the answer is ended by an empty line when the next command arrives */
+    if(id == -1)
+        fprintf(fp, "=\n");
+    else
+        fprintf(fp, "=%d\n", id);
+    fflush(fp);
+
+    analysis_fp = fp;
+    mcts_set_analysis(MAX(interval, 1) * 10, print_analysis);
+    evaluate_in_background(&current_state, is_black, input_available, false);
+    mcts_set_analysis(0, NULL);
+
+    fprintf(fp, "\n");
+    fflush(fp);
+}
+
+/*
+Parses and executes a GTP command, answering to fp.
+*/
+static void run_command(
+    FILE * out_fp,
+    char * line
+){
+    line = strtok(line, "#");
+    if(line == NULL)
+        return;
+
+    line = trim(line);
+    if(line == NULL)
+        return;
+
+    flog_prot("gtp", line);
+
+    char * save_ptr;
+    char * id = strtok_r(line, " |", &save_ptr);
+    d32 idn;
+    char * cmd;
+    if(parse_int(&idn, id))
+        cmd = strtok_r(NULL, " |", &save_ptr);
+    else
+    {
+        cmd = id;
+        id = NULL;
+        idn = -1;
+    }
+
+    if(cmd == NULL)
+        return;
+
+    u16 argc = 0;
+    char * args[TOTAL_BOARD_SIZ];
+    for(u16 i = 0; i < TOTAL_BOARD_SIZ; ++i)
+    {
+        args[i] = strtok_r(NULL, " |", &save_ptr);
+        if(args[i] == NULL)
+        {
+            ++i;
+            for(; i < TOTAL_BOARD_SIZ; ++i)
+                args[i] = NULL;
+            break;
+        }
+        ++argc;
+    }
+
+lbl_parse_command:
+    /*
+    Commands more commonly used should be parsed first:
+    */
+    if(argc == 2 && strcmp(cmd, "play") == 0)
+    {
+        gtp_play(out_fp, idn, args[0], args[1], false);
+        return;
+    }
+
+    if(argc == 1 && strcmp(cmd, "genmove") == 0)
+    {
+        gtp_genmove(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc == 3 && strcmp(cmd, "time_left") == 0)
+    {
+        gtp_time_left_seconds(out_fp, idn, args[0], args[1], args[2]);
+        return;
+    }
+
+    if(argc == 1 && strcmp(cmd, "reg_genmove") == 0)
+    {
+        gtp_reg_genmove(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "clear_board") == 0)
+    {
+        gtp_clear_board(out_fp, idn);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "kgs-game_over") == 0)
+    {
+        gtp_kgs_game_over(out_fp, idn);
+        return;
+    }
+
+    if(argc <= 1 && strcmp(cmd, "komi") == 0)
+    {
+        gtp_komi(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc == 1 && strcmp(cmd, "kgs-genmove_cleanup") == 0)
+    {
+        gtp_genmove_cleanup(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc == 1 && strcmp(cmd, "final_status_list") == 0)
+    {
+        gtp_final_status_list(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc == 3 && strcmp(cmd, "mtld-time_left") == 0)
+    {
+        gtp_time_left_millis(out_fp, idn, args[0], args[1], args[2]);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "undo") == 0)
+    {
+        gtp_undo(out_fp, idn, NULL);
+        return;
+    }
+
+    if(argc <= 1 && strcmp(cmd, "gg-undo") == 0)
+    {
+        gtp_undo(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "protocol_version") == 0)
+    {
+        gtp_protocol_version(out_fp, idn);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "name") == 0)
+    {
+        gtp_name(out_fp, idn);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "version") == 0)
+    {
+        gtp_version(out_fp, idn);
+        return;
+    }
+
+    if(argc == 1 && strcmp(cmd, "known_command") == 0)
+    {
+        gtp_known_command(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc == 0 && (strcmp(cmd, "list_commands") == 0 || strcmp(cmd,
+        "help") == 0))
+    {
+        gtp_list_commands(out_fp, idn);
+        return;
+    }
+
+    if(argc <= 1 && strcmp(cmd, "boardsize") == 0)
+    {
+        gtp_boardsize(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "showboard") == 0)
+    {
+        gtp_showboard(out_fp, idn);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "final_score") == 0)
+    {
+        gtp_final_score(out_fp, idn);
+        return;
+    }
+
+    if(argc >= 1 && argc <= 3 && strcmp(cmd, "mtld-review_game") == 0)
+    {
+        gtp_review_game(out_fp, idn, argc, args);
+        return;
+    }
+
+    if(argc == 1 && strcmp(cmd, "place_free_handicap") == 0)
+    {
+        gtp_place_free_handicap(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc > 1 && strcmp(cmd, "set_free_handicap") == 0)
+    {
+        gtp_set_free_handicap(out_fp, idn, argc, args);
+        return;
+    }
+
+    if(argc == 3 && strcmp(cmd, "time_settings") == 0)
+    {
+        gtp_time_settings(out_fp, idn, args[0], args[1], args[2]);
+        return;
+    }
+
+    if(argc > 1 && argc < 5 && strcmp(cmd, "kgs-time_settings") == 0)
+    {
+        gtp_kgs_time_settings(out_fp, idn, args[0], args[1], args[2],
+            args[3]);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "cputime") == 0)
+    {
+        gtp_cputime(out_fp, idn);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "gomill-cpu_time") == 0)
+    {
+        gtp_cputime(out_fp, idn);
+        return;
+    }
+
+    if(strcmp(cmd, "echo") == 0)
+    {
+        gtp_echo(out_fp, idn, argc, args, false);
+        return;
+    }
+
+    if(strcmp(cmd, "echo_err") == 0)
+    {
+        gtp_echo(out_fp, idn, argc, args, true);
+        return;
+    }
+
+    if(argc < 4 && strcmp(cmd, "lz-analyze") == 0)
+    {
+        gtp_lz_analyze(out_fp, idn, argc, args);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "mtld-ownership") == 0)
+    {
+        gtp_ownership(out_fp, idn);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "mtld-last_evaluation") == 0)
+    {
+        gtp_last_evaluation(out_fp, idn);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "mtld-memory_usage") == 0)
+    {
+        gtp_memory_usage(out_fp, idn);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "mtld-search_stats") == 0)
+    {
+        gtp_search_stats(out_fp, idn);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "mtld-genmove_latency") == 0)
+    {
+        gtp_genmove_latency(out_fp, idn);
+        return;
+    }
+
+    if(argc == 1 && strcmp(cmd, "mtld-save_tree") == 0)
+    {
+        gtp_save_tree(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc == 1 && strcmp(cmd, "mtld-load_tree") == 0)
+    {
+        gtp_load_tree(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc == 1 && strcmp(cmd, "mtld-set_memory") == 0)
+    {
+        gtp_set_memory(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc == 1 && strcmp(cmd, "mtld-set_threads") == 0)
+    {
+        gtp_set_threads(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc == 1 && strcmp(cmd, "mtld-playout_policy") == 0)
+    {
+        gtp_playout_policy(out_fp, idn, args[0]);
+        return;
+    }
+
+    if((argc == 1 || argc == 2) && strcmp(cmd, "loadsgf") == 0)
+    {
+        gtp_loadsgf(out_fp, idn, args[0], args[1]);
+        return;
+    }
+
+    if(argc <= 1 && strcmp(cmd, "printsgf") == 0)
+    {
+        gtp_printsgf(out_fp, idn, args[0]);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "clear_cache") == 0)
+    {
+        gtp_clear_cache(out_fp, idn);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "mtld-game_info") == 0)
+    {
+        gtp_game_info(out_fp, idn);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "gomill-describe_engine") == 0)
+    {
+        gtp_gomill_describe_engine(out_fp, idn);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "quit") == 0)
+    {
+        gtp_quit(out_fp, idn);
+        return;
+    }
+
+    if(argc == 0 && strcmp(cmd, "exit") == 0)
+    {
+        gtp_quit(out_fp, idn);
+        return;
+    }
+
+
+    const char * best_dst_str = NULL;
+    u16 best_dst_val = 0;
+    bool command_exists = false;
+    u16 i = 0;
+    while(supported_commands[i] != NULL)
+    {
+        if(strcmp(cmd, supported_commands[i]) == 0)
+        {
+            command_exists = true;
+            break;
+        }
+        else
+        {
+            u16 lev_dst = levenshtein_dst(supported_commands[i], cmd);
+            if(best_dst_str == NULL || lev_dst < best_dst_val)
+            {
+                best_dst_str = supported_commands[i];
+                best_dst_val = lev_dst;
+            }
+        }
+        ++i;
+    }
+
+    if(command_exists)
+    {
+        fprintf(stderr, "warning: command '%s' exists but the parameter lis\
+t is wrong; please check the documentation\n", cmd);
+        gtp_error(out_fp, idn, "syntax error");
+    }
+    else
+    {
+        if(best_dst_val < 2){
+            strcpy(cmd, best_dst_str);
+            goto lbl_parse_command;
+        }
+        if(best_dst_val < 4)
+            fprintf(stderr, "warning: command '%s' does not exist; did you \
+mean '%s'?\n", cmd, best_dst_str);
+        else
+            fprintf(stderr, "warning: command '%s' does not exist; run \"he\
+lp\" for a list of available commands\n", cmd);
+
+        gtp_error(out_fp, idn, "unknown command");
+    }
+}
+
+/*
+Main function for GTP mode - performs command selction.
 
 Thinking in opponents turns should be disabled for most matches. It doesn't
 limit itself, so it will keep using the MCTS if used previously until the
 opponent plays or memory runs out.
+
+The program arguments are kept for switching to the engine of another board
+size. After such a switch the boardsize command is answered first, with the id
+boardsize_id, unless it is -2.
 */
 void main_gtp(
-    bool think_in_opt_turn
+    bool think_in_opt_turn,
+    char * argv[],
+    int boardsize_id
 ){
+    program_argv = argv;
     load_hoshi_points();
     tt_init();
 
@@ -1383,41 +2327,44 @@ void main_gtp(
         flog_crit("gtp", "file descriptor duplication failure (1)");
 
     close(STDOUT_FILENO);
+    fcntl(_out_fp, F_SETFD, FD_CLOEXEC);
     out_fp = fdopen(_out_fp, "w");
     if(out_fp == NULL)
         flog_crit("gtp", "file descriptor duplication failure (2)");
 
+    /*
+    Unbuffered, so no commands are read ahead: they would be missed by the test
+    of input available and lost when switching engines.
+    */
+    setvbuf(stdin, NULL, _IONBF, 0);
+
     clear_out_board(&last_out_board);
     clear_game_record(&current_game);
+    mcts_set_game_history(&current_game);
+
+    if(boardsize_id != -2)
+        gtp_answer(out_fp, boardsize_id, NULL);
 
-    fd_set readfs;
-    memset(&readfs, 0, sizeof(fd_set));
     char * in_buf = alloc();
 
     while(1)
     {
+        flog_flush();
+        latency_mark(LAT_LOGGING);
+        latency_end();
+
         bool is_black = current_player_color(&current_game);
 
         board current_state;
         current_game_state(&current_state, &current_game);
 
-        if(think_in_opt_turn)
+        /* think until a command arrives, on the replies to our play */
+        if(think_in_opt_turn && !input_available())
         {
-            do{
-                FD_ZERO(&readfs);
-                FD_SET(STDIN_FILENO, &readfs);
-                struct timeval tm;
-                tm.tv_sec = 0;
-                tm.tv_usec = 2000;
-
-                int ready = select(STDIN_FILENO + 1, &readfs, NULL, NULL, &tm);
-                if(ready == -1)
-                    flog_crit("gtp", "standard input file descriptor closed");
-                if(ready == 0) /* nothing to read */
-                    evaluate_in_background(&current_state, is_black);
-                else
-                    break;
-            }while(1);
+            bool pondering = has_genmoved_as_black != has_genmoved_as_white &&
+                has_genmoved_as_black != is_black;
+            evaluate_in_background(&current_state, is_black, input_available,
+                pondering);
         }
 
         opt_turn_maintenance(&current_state, is_black);
@@ -1425,322 +2372,316 @@ void main_gtp(
 
         char * line = fgets(in_buf, MAX_PAGE_SIZ, stdin);
         request_received_mark = current_time_in_millis();
+        latency_start(current_time_in_nanos());
         if(line == NULL)
             flog_crit("gtp", "standard input file descriptor closed");
 
-        line = strtok(line, "#");
-        if(line == NULL)
-            continue;
-
-        line = trim(line);
-        if(line == NULL)
-            continue;
-
-        flog_prot("gtp", line);
-
-        char * save_ptr;
-        char * id = strtok_r(line, " |", &save_ptr);
-        d32 idn;
-        char * cmd;
-        if(parse_int(&idn, id))
-            cmd = strtok_r(NULL, " |", &save_ptr);
-        else
-        {
-            cmd = id;
-            id = NULL;
-            idn = -1;
-        }
-
-        if(cmd == NULL)
-            continue;
-
-        u16 argc = 0;
-        char * args[TOTAL_BOARD_SIZ];
-        for(u16 i = 0; i < TOTAL_BOARD_SIZ; ++i)
-        {
-            args[i] = strtok_r(NULL, " |", &save_ptr);
-            if(args[i] == NULL)
-            {
-                ++i;
-                for(; i < TOTAL_BOARD_SIZ; ++i)
-                    args[i] = NULL;
-                break;
-            }
-            ++argc;
-        }
-
-lbl_parse_command:
-        /*
-        Commands more commonly used should be parsed first:
-        */
-        if(argc == 2 && strcmp(cmd, "play") == 0)
-        {
-            gtp_play(out_fp, idn, args[0], args[1], false);
-            continue;
-        }
-
-        if(argc == 1 && strcmp(cmd, "genmove") == 0)
-        {
-            gtp_genmove(out_fp, idn, args[0]);
-            continue;
-        }
-
-        if(argc == 3 && strcmp(cmd, "time_left") == 0)
-        {
-            gtp_time_left_seconds(out_fp, idn, args[0], args[1], args[2]);
-            continue;
-        }
-
-        if(argc == 1 && strcmp(cmd, "reg_genmove") == 0)
-        {
-            gtp_reg_genmove(out_fp, idn, args[0]);
-            continue;
-        }
-
-        if(argc == 0 && strcmp(cmd, "clear_board") == 0)
-        {
-            gtp_clear_board(out_fp, idn);
-            continue;
-        }
-
-        if(argc == 0 && strcmp(cmd, "kgs-game_over") == 0)
-        {
-            gtp_kgs_game_over(out_fp, idn);
-            continue;
-        }
-
-        if(argc <= 1 && strcmp(cmd, "komi") == 0)
-        {
-            gtp_komi(out_fp, idn, args[0]);
-            continue;
-        }
+        run_command(out_fp, line);
+    }
+}
 
-        if(argc == 1 && strcmp(cmd, "kgs-genmove_cleanup") == 0)
-        {
-            gtp_genmove_cleanup(out_fp, idn, args[0]);
-            continue;
-        }
+/*
+State of a session of server mode. The state of the session being served is in
+the usual variables while its commands are executed.
+*/
+typedef struct __gtp_session_ {
+    int fd;
+    FILE * fp;
+    char in_buf[MAX_PAGE_SIZ];
+    u32 in_len;
+    game_record game;
+    time_system clock_black;
+    time_system clock_white;
+    d16 komi;
+    d16 dynamic_komi;
+    bool has_genmoved_as_black;
+    bool has_genmoved_as_white;
+    bool out_on_time_warning;
+    out_board last_out_board;
+} gtp_session;
+
+static void session_enter(
+    const gtp_session * s
+){
+    memcpy(&current_game, &s->game, sizeof(game_record));
+    memcpy(&current_clock_black, &s->clock_black, sizeof(time_system));
+    memcpy(&current_clock_white, &s->clock_white, sizeof(time_system));
+    komi = s->komi;
+    dynamic_komi = s->dynamic_komi;
+    has_genmoved_as_black = s->has_genmoved_as_black;
+    has_genmoved_as_white = s->has_genmoved_as_white;
+    out_on_time_warning = s->out_on_time_warning;
+    memcpy(&last_out_board, &s->last_out_board, sizeof(out_board));
+}
 
-        if(argc == 1 && strcmp(cmd, "final_status_list") == 0)
-        {
-            gtp_final_status_list(out_fp, idn, args[0]);
-            continue;
-        }
+static void session_leave(
+    gtp_session * s
+){
+    memcpy(&s->game, &current_game, sizeof(game_record));
+    memcpy(&s->clock_black, &current_clock_black, sizeof(time_system));
+    memcpy(&s->clock_white, &current_clock_white, sizeof(time_system));
+    s->komi = komi;
+    s->dynamic_komi = dynamic_komi;
+    s->has_genmoved_as_black = has_genmoved_as_black;
+    s->has_genmoved_as_white = has_genmoved_as_white;
+    s->out_on_time_warning = out_on_time_warning;
+    memcpy(&s->last_out_board, &last_out_board, sizeof(out_board));
+}
 
-        if(argc == 3 && strcmp(cmd, "mtld-time_left") == 0)
-        {
-            gtp_time_left_millis(out_fp, idn, args[0], args[1], args[2]);
-            continue;
-        }
+/*
+Executes the complete lines in the input buffer of a session, keeping the
+positions of the other sessions in the transpositions table.
+RETURNS false if the session has ended
+*/
+static bool session_run_lines(
+    gtp_session * sessions[],
+    u16 count,
+    u16 idx
+){
+    gtp_session * s = sessions[idx];
 
-        if(argc == 0 && strcmp(cmd, "undo") == 0)
+    board roots[TT_MAX_KEPT_ROOTS];
+    bool is_black[TT_MAX_KEPT_ROOTS];
+    u16 roots_count = 0;
+    for(u16 i = 0; i < count; ++i)
+        if(i != idx)
         {
-            gtp_undo(out_fp, idn, NULL);
-            continue;
+            current_game_state(&roots[roots_count], &sessions[i]->game);
+            is_black[roots_count] = current_player_color(&sessions[i]->game);
+            ++roots_count;
         }
 
-        if(argc <= 1 && strcmp(cmd, "gg-undo") == 0)
-        {
-            gtp_undo(out_fp, idn, args[0]);
-            continue;
-        }
+    tt_set_kept_roots(roots, is_black, roots_count);
+    session_enter(s);
+    session_ended = false;
 
-        if(argc == 0 && strcmp(cmd, "protocol_version") == 0)
+    char * line = alloc();
+    while(!session_ended)
+    {
+        char * end = memchr(s->in_buf, '\n', s->in_len);
+        if(end == NULL)
         {
-            gtp_protocol_version(out_fp, idn);
-            continue;
+            if(s->in_len < MAX_PAGE_SIZ - 1)
+                break;
+            /* overlong lines are executed truncated */
+            end = s->in_buf + s->in_len - 1;
         }
 
-        if(argc == 0 && strcmp(cmd, "name") == 0)
-        {
-            gtp_name(out_fp, idn);
-            continue;
-        }
+        u32 len = (end - s->in_buf) + 1;
+        memcpy(line, s->in_buf, len);
+        line[len] = 0;
+        memmove(s->in_buf, s->in_buf + len, s->in_len - len);
+        s->in_len -= len;
+        session_has_line = memchr(s->in_buf, '\n', s->in_len) != NULL;
 
-        if(argc == 0 && strcmp(cmd, "version") == 0)
-        {
-            gtp_version(out_fp, idn);
-            continue;
-        }
+        /* the freeing of the states of the previous turn delays the answer */
+        request_received_mark = current_time_in_millis();
+        latency_start(current_time_in_nanos());
 
-        if(argc == 1 && strcmp(cmd, "known_command") == 0)
-        {
-            gtp_known_command(out_fp, idn, args[0]);
-            continue;
-        }
+        bool black_to_play = current_player_color(&current_game);
+        board current_state;
+        current_game_state(&current_state, &current_game);
+        opt_turn_maintenance(&current_state, black_to_play);
+        reset_mcts_can_resume();
+        latency_mark(LAT_MAINTENANCE);
 
-        if(argc == 0 && (strcmp(cmd, "list_commands") == 0 || strcmp(cmd,
-            "help") == 0))
-        {
-            gtp_list_commands(out_fp, idn);
-            continue;
-        }
+        run_command(s->fp, line);
+        flog_flush();
+        latency_mark(LAT_LOGGING);
+        latency_end();
+    }
+    release(line);
+    session_has_line = false;
 
-        if(argc <= 1 && strcmp(cmd, "boardsize") == 0)
-        {
-            gtp_boardsize(out_fp, idn, args[0]);
-            continue;
-        }
+    session_leave(s);
+    tt_set_kept_roots(NULL, NULL, 0);
+    return !session_ended;
+}
 
-        if(argc == 0 && strcmp(cmd, "showboard") == 0)
-        {
-            gtp_showboard(out_fp, idn);
-            continue;
-        }
+/*
+Main function for GTP server mode. Listens on a Unix domain socket, hosting
+each connection as an independent GTP session with its own game, clocks and
+komi. Commands of the sessions are executed one at a time, sharing the threads
+and the transpositions table; the trees of the games of the other sessions are
+kept while one session searches, and its own tree is kept for its next turn.
+*/
+void main_gtp_server(
+    const char * path
+){
+    load_hoshi_points();
+    tt_init();
 
-        if(argc == 0 && strcmp(cmd, "final_score") == 0)
-        {
-            gtp_final_score(out_fp, idn);
-            continue;
-        }
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listen_fd == -1)
+        flog_crit("gtp", "socket creation failed");
 
-        if(argc == 1 && strcmp(cmd, "mtld-review_game") == 0)
-        {
-            gtp_review_game(out_fp, idn, args[0]);
-            continue;
-        }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path))
+        flog_crit("gtp", "socket path too long");
+    strcpy(addr.sun_path, path);
 
-        if(argc == 1 && strcmp(cmd, "place_free_handicap") == 0)
-        {
-            gtp_place_free_handicap(out_fp, idn, args[0]);
-            continue;
-        }
+    unlink(path);
+    if(bind(listen_fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un))
+        != 0 || listen(listen_fd, MAX_GTP_SESSIONS) != 0)
+        flog_crit("gtp", "could not listen on the server socket");
 
-        if(argc > 1 && strcmp(cmd, "set_free_handicap") == 0)
-        {
-            gtp_set_free_handicap(out_fp, idn, argc, args);
-            continue;
-        }
+    /* writing to a client that went away fails the write instead */
+    signal(SIGPIPE, SIG_IGN);
+    server_mode = true;
 
-        if(argc == 3 && strcmp(cmd, "time_settings") == 0)
-        {
-            gtp_time_settings(out_fp, idn, args[0], args[1], args[2]);
-            continue;
-        }
+    char * s = alloc();
+    snprintf(s, MAX_PAGE_SIZ, "matilda now running over GTP as a server at %s",
+        path);
+    flog_info("gtp", s);
+    build_info(s);
+    flog_debug("gtp", s);
+    release(s);
 
-        if(argc > 1 && argc < 5 && strcmp(cmd, "kgs-time_settings") == 0)
-        {
-            gtp_kgs_time_settings(out_fp, idn, args[0], args[1], args[2],
-                args[3]);
-            continue;
-        }
+    /* state of new sessions */
+    gtp_session defaults;
+    memset(&defaults, 0, sizeof(gtp_session));
+    clear_game_record(&current_game);
+    clear_out_board(&last_out_board);
+    session_leave(&defaults);
+    mcts_set_game_history(&current_game);
 
-        if(argc == 0 && strcmp(cmd, "cputime") == 0)
-        {
-            gtp_cputime(out_fp, idn);
-            continue;
-        }
+    gtp_session * sessions[MAX_GTP_SESSIONS];
+    u16 count = 0;
 
-        if(argc == 0 && strcmp(cmd, "gomill-cpu_time") == 0)
-        {
-            gtp_cputime(out_fp, idn);
-            continue;
-        }
+    while(1)
+    {
+        flog_flush();
 
-        if(strcmp(cmd, "echo") == 0)
+        server_fds[0].fd = listen_fd;
+        server_fds[0].events = POLLIN;
+        for(u16 i = 0; i < count; ++i)
         {
-            gtp_echo(out_fp, idn, argc, args, false);
-            continue;
+            server_fds[i + 1].fd = sessions[i]->fd;
+            server_fds[i + 1].events = POLLIN;
         }
+        server_fds_count = count + 1;
 
-        if(strcmp(cmd, "echo_err") == 0)
-        {
-            gtp_echo(out_fp, idn, argc, args, true);
+        if(poll(server_fds, server_fds_count, -1) == -1)
             continue;
-        }
 
-        if(argc == 0 && strcmp(cmd, "mtld-last_evaluation") == 0)
+        if(server_fds[0].revents & POLLIN)
         {
-            gtp_last_evaluation(out_fp, idn);
-            continue;
+            int fd = accept(listen_fd, NULL, NULL);
+            if(fd != -1 && count == MAX_GTP_SESSIONS)
+            {
+                flog_warn("gtp", "connection refused: too many sessions");
+                close(fd);
+            }
+            else if(fd != -1)
+            {
+                gtp_session * n = (gtp_session *)malloc(sizeof(gtp_session));
+                if(n == NULL)
+                    flog_crit("gtp", "system out of memory");
+                memcpy(n, &defaults, sizeof(gtp_session));
+                n->fd = fd;
+                n->fp = fdopen(fd, "w");
+                if(n->fp == NULL)
+                    flog_crit("gtp", "file descriptor duplication failure");
+                sessions[count] = n;
+                ++count;
+                flog_info("gtp", "session started");
+            }
         }
 
-        if((argc == 1 || argc == 2) && strcmp(cmd, "loadsgf") == 0)
+        u16 polled = server_fds_count - 1;
+        for(u16 i = polled; i > 0; --i)
         {
-            gtp_loadsgf(out_fp, idn, args[0], args[1]);
-            continue;
-        }
+            u16 idx = i - 1;
+            if(server_fds[i].revents == 0)
+                continue;
 
-        if(argc <= 1 && strcmp(cmd, "printsgf") == 0)
-        {
-            gtp_printsgf(out_fp, idn, args[0]);
-            continue;
-        }
+            gtp_session * ss = sessions[idx];
+            ssize_t r = read(ss->fd, ss->in_buf + ss->in_len, MAX_PAGE_SIZ - 1
+                - ss->in_len);
 
-        if(argc == 0 && strcmp(cmd, "clear_cache") == 0)
-        {
-            gtp_clear_cache(out_fp, idn);
-            continue;
-        }
+            if(r > 0)
+            {
+                ss->in_len += r;
+                if(session_run_lines(sessions, count, idx))
+                    continue;
+            }
 
-        if(argc == 0 && strcmp(cmd, "mtld-game_info") == 0)
-        {
-            gtp_game_info(out_fp, idn);
-            continue;
+            fclose(ss->fp);
+            free(ss);
+            sessions[idx] = sessions[count - 1];
+            --count;
+            flog_info("gtp", "session ended");
         }
+    }
+}
 
-        if(argc == 0 && strcmp(cmd, "gomill-describe_engine") == 0)
-        {
-            gtp_gomill_describe_engine(out_fp, idn);
-            continue;
-        }
+/*
+Main function for GTP client mode. Relays the standard input and output to and
+from a GTP server listening at the socket path, so the program can be started
+as usual by GTP controllers while sharing a server process.
+*/
+void main_gtp_connect(
+    const char * path
+){
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if(fd == -1 || connect(fd, (struct sockaddr *)&addr,
+        sizeof(struct sockaddr_un)) != 0)
+    {
+        fprintf(stderr, "could not connect to the server at %s\n", path);
+        exit(EXIT_FAILURE);
+    }
 
-        if(argc == 0 && strcmp(cmd, "quit") == 0)
-        {
-            gtp_quit(out_fp, idn);
-            continue;
-        }
+    char * buf = alloc();
+    struct pollfd fds[2];
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = fd;
+    fds[1].events = POLLIN;
 
-        if(argc == 0 && strcmp(cmd, "exit") == 0)
+    while(poll(fds, 2, -1) > 0)
+    {
+        for(u8 i = 0; i < 2; ++i)
         {
-            gtp_quit(out_fp, idn);
-            continue;
-        }
+            if(fds[i].revents == 0)
+                continue;
 
-
-        const char * best_dst_str = NULL;
-        u16 best_dst_val = 0;
-        bool command_exists = false;
-        u16 i = 0;
-        while(supported_commands[i] != NULL)
-        {
-            if(strcmp(cmd, supported_commands[i]) == 0)
+            ssize_t r = read(fds[i].fd, buf, MAX_PAGE_SIZ);
+            if(r <= 0)
             {
-                command_exists = true;
-                break;
-            }
-            else
-            {
-                u16 lev_dst = levenshtein_dst(supported_commands[i], cmd);
-                if(best_dst_str == NULL || lev_dst < best_dst_val)
+                /* the server ends the session when input ends */
+                if(i == 0)
                 {
-                    best_dst_str = supported_commands[i];
-                    best_dst_val = lev_dst;
+                    shutdown(fd, SHUT_WR);
+                    fds[0].fd = -1;
+                    continue;
                 }
+                release(buf);
+                close(fd);
+                return;
             }
-            ++i;
-        }
 
-        if(command_exists)
-        {
-            fprintf(stderr, "warning: command '%s' exists but the parameter lis\
-t is wrong; please check the documentation\n", cmd);
-            gtp_error(out_fp, idn, "syntax error");
-        }
-        else
-        {
-            if(best_dst_val < 2){
-                strcpy(cmd, best_dst_str);
-                goto lbl_parse_command;
+            int dst = (i == 0) ? fd : STDOUT_FILENO;
+            for(ssize_t w = 0; w < r;)
+            {
+                ssize_t ww = write(dst, buf + w, r - w);
+                if(ww <= 0)
+                {
+                    release(buf);
+                    close(fd);
+                    return;
+                }
+                w += ww;
             }
-            if(best_dst_val < 4)
-                fprintf(stderr, "warning: command '%s' does not exist; did you \
-mean '%s'?\n", cmd, best_dst_str);
-            else
-                fprintf(stderr, "warning: command '%s' does not exist; run \"he\
-lp\" for a list of available commands\n", cmd);
-
-            gtp_error(out_fp, idn, "unknown command");
         }
     }
+
+    release(buf);
+    close(fd);
 }
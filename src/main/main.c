@@ -16,6 +16,7 @@ Also deals with updating some internal parameters at startup time.
 #include "alloc.h"
 #include "board.h"
 #include "cfg_board.h"
+#include "cluster.h"
 #include "constants.h"
 #include "engine.h"
 #include "flog.h"
@@ -44,6 +45,7 @@ char * sentinel_file = NULL;
 clock_t start_cpu_time;
 
 extern u64 max_size_in_mbs;
+extern d16 komi;
 
 /*
 For tuning
@@ -64,11 +66,17 @@ extern u16 prior_bad_play;
 extern u16 prior_pass;
 extern u16 prior_starting_point;
 extern double rave_equiv;
+extern double virtual_loss;
+extern u16 leaf_playouts;
+extern u16 widening_min_plays;
+extern u16 widening_base;
+extern double widening_growth;
 extern u16 pl_skip_saving;
 extern u16 pl_skip_nakade;
 extern u16 pl_skip_pattern;
 extern u16 pl_skip_capture;
 extern u16 pl_ban_self_atari;
+extern u16 pl_skip_lgr;
 extern u16 expansion_delay;
 static u16 _dummy; /* used for testing CLOP */
 
@@ -95,11 +103,17 @@ const void * tunable[] =
     "i", "prior_pass", &prior_pass,
     "i", "prior_starting_point", &prior_starting_point,
     "f", "rave_equiv", &rave_equiv,
+    "f", "virtual_loss", &virtual_loss,
+    "i", "leaf_playouts", &leaf_playouts,
+    "i", "widening_min_plays", &widening_min_plays,
+    "i", "widening_base", &widening_base,
+    "f", "widening_growth", &widening_growth,
     "i", "pl_skip_saving", &pl_skip_saving,
     "i", "pl_skip_nakade", &pl_skip_nakade,
     "i", "pl_skip_pattern", &pl_skip_pattern,
     "i", "pl_skip_capture", &pl_skip_capture,
     "i", "pl_ban_self_atari", &pl_ban_self_atari,
+    "i", "pl_skip_lgr", &pl_skip_lgr,
     "i", "expansion_delay", &expansion_delay,
     "i", "dummy", &_dummy,
 
@@ -108,9 +122,13 @@ const void * tunable[] =
     NULL
 };
 
+/*
+Sets the value of an internal parameter, or if apply is false only validates it.
+*/
 static void set_parameter(
     const char * name,
-    const char * value
+    const char * value,
+    bool apply
 ){
     for(u16 i = 0; tunable[i] != NULL; i += 3)
     {
@@ -134,7 +152,8 @@ static void set_parameter(
             }
 
             u16 * svar = ((u16 * )tunable[i + 2]);
-            *svar = val;
+            if(apply)
+                *svar = val;
             return;
         }
         if(type[0] == 'f')
@@ -149,7 +168,8 @@ static void set_parameter(
             }
 
             double * svar = ((double * )tunable[i + 2]);
-            *svar = val;
+            if(apply)
+                *svar = val;
             return;
         }
 
@@ -167,20 +187,45 @@ static void set_parameter(
 }
 
 void main_gtp(
-    bool think_in_opt_turn
+    bool think_in_opt_turn,
+    char * argv[],
+    int boardsize_id
 );
 
 void main_text(
     bool is_black
 );
 
+void main_benchmark(
+    const char * folder
+);
+
+void main_gtp_server(
+    const char * path
+);
+
+void main_gtp_connect(
+    const char * path
+);
+
+void main_self_play(
+    u32 games,
+    u16 concurrent,
+    void (* player_init)(u8)
+);
+
 static void startup(
     bool opening_books_enabled,
     d16 desired_num_threads
 ){
     assert_data_folder_exists();
+    /*
+    The opening book is by far the slowest to read, so it is read in the
+    background while the rest is initialized and the first commands served.
+    */
+    board_constants_init();
     if(opening_books_enabled)
-        opening_book_init();
+        opening_book_init_background();
     mcts_init();
     load_handicap_points();
     load_hoshi_points();
@@ -199,6 +244,30 @@ static void startup(
     omp_set_dynamic(0);
 }
 
+/* program arguments and settings for the self-play player processes */
+static int self_play_argc;
+static char ** self_play_argv;
+static bool self_play_opening_books;
+static d16 self_play_num_threads;
+
+/*
+Initiates a self-play player process, with the internal parameters of the
+player.
+*/
+static void self_play_player_init(
+    u8 player
+){
+    const char * flag = (player == 0) ? "--set_first" : "--set_second";
+    for(int i = 1; i < self_play_argc - 2; ++i)
+        if(strcmp(self_play_argv[i], flag) == 0)
+        {
+            set_parameter(self_play_argv[i + 1], self_play_argv[i + 2], true);
+            i += 2;
+        }
+
+    startup(self_play_opening_books, self_play_num_threads);
+}
+
 static void usage()
 {
         fprintf(stderr, "\033[1mUSAGE\033[0m\n");
@@ -233,6 +302,13 @@ drawn positions with\n        lost positions, and resign when actually winning.\
 he match. The keyword\n        argument can be resign or pass. By default Matil\
 da resigns on text mode\n        and passes on GTP mode.\n\n");
 
+        fprintf(stderr, "        \033[1m--playout_policy <keyword>\033[0m\n\n\
+");
+        fprintf(stderr, "        Select the playouts used by the MCTS. The keyw\
+ord argument can be heavy or\n        light. Light playouts are uniformly rando\
+m, only avoiding playing in own\n        eyes; they are much faster but weaker.\
+ By default heavy playouts are\n        used.\n\n");
+
         fprintf(stderr, "        \033[1m--resign_on_timeout\033[0m\n\n");
         fprintf(stderr, "        Resign if the program believes to have lost on\
  time.\n\n");
@@ -261,6 +337,15 @@ he opponents turn.\n\n");
         fprintf(stderr, "        \033[1m--disable_opening_books\033[0m\n\n");
         fprintf(stderr, "        Disable the use of opening books.\n\n");
 
+        fprintf(stderr, "        \033[1m--komi <value>\033[0m\n\n");
+        fprintf(stderr, "        Set the komi, like the GTP komi command. Exam\
+ple: 6.5.\n\n");
+
+        fprintf(stderr, "        \033[1m--dynamic_komi\033[0m\n\n");
+        fprintf(stderr, "        Give away part of the lead to the opponent in \
+the komi used by the\n        searches while winning by a large margin, so the \
+playouts still tell\n        good plays from bad ones.\n\n");
+
         fprintf(stderr, "        \033[1m-l, --log <mask>\033[0m\n\n");
         fprintf(stderr, "        Set the message types to log to file and print\
  to the standard error\n        file descriptor. The available modes are:\n\n  \
@@ -280,6 +365,12 @@ tions are:\n\n          o - Standard error file descriptor\n          f - File \
 nspositions table, in\n        MiB. The default is %u MiB.\n\n",
             DEFAULT_UCT_MEMORY);
 
+        fprintf(stderr, "        \033[1m--memory_budget <number>\033[0m\n\n");
+        fprintf(stderr, "        Limit the memory held by the whole program, in\
+ MiB. The free lists\n        of the allocators are trimmed when over it, and \
+the memory for the\n        transpositions table is lowered to fit the rest.\
+ See also --memory.\n\n");
+
         fprintf(stderr, "        \033[1m--save_all\033[0m\n\n");
         fprintf(stderr, "        Save all finished games to the data folder as \
 SGF.\n\n");
@@ -289,22 +380,80 @@ SGF.\n\n");
 rn instead of limited by\n        time. Cannot be used with time related flags.\
 \n\n");
 
+        fprintf(stderr, "        \033[1m--deterministic <seed>\033[0m\n\n");
+        fprintf(stderr, "        Make the searches reproducible, for comparing \
+builds: they are run in\n        a single thread and the RNG is reset with the s\
+eed before each search. Logs\n        a fingerprint of the tree after each searc\
+h. Requires --playouts.\n\n");
+
         fprintf(stderr, "        \033[1m--threads <number>\033[0m\n\n");
         fprintf(stderr, "        Override the number of OpenMP threads to use. \
 The default is the total\n        number of normal plus hyperthreaded CPU cores\
-.\n\n");
+. On NUMA systems bind the\n        threads to cores, with OMP_PROC_BIND=true, s\
+o the memory of each\n        thread is kept in the node of its core.\n\n");
 
         fprintf(stderr, "        \033[1m--benchmark\033[0m\n\n");
         fprintf(stderr, "        Run a two minute benchmark of the system, retu\
 rning a linear measure of\n        MCTS performance (number of simulations per \
 second.\n\n");
 
+        fprintf(stderr, "        \033[1m--benchmark_suite <folder>\033[0m\n\n");
+        fprintf(stderr, "        Run a benchmark of the MCTS on the positions of \
+the SGF files in the\n        folder, with fixed RNG seeds, for an increasing num\
+ber of threads up to\n        the number of threads available. Prints the simul\
+ations and states per\n        second and memory used by each search.\n\n");
+
+        fprintf(stderr, "        \033[1m--self_play <games> <concurrent>\033[0m\
+\n\n");
+        fprintf(stderr, "        Play a number of games between two players, a \
+number of them at the\n        same time, alternating colors. Each player searc\
+hes in its own process,\n        with its own transpositions table. The games a\
+re written to the data\n        folder as SGF, and a summary of the results is \
+printed. Use with\n        --playouts or time settings, and with --set_first an\
+d --set_second.\n\n");
+
+        fprintf(stderr, "        \033[1m--set_first <name> <value>\033[0m\n\n");
+        fprintf(stderr, "        \033[1m--set_second <name> <value>\033[0m\n\n\
+");
+        fprintf(stderr, "        For optimization. Set the value of an internal\
+ parameter of only\n        the first or second player in --self_play.\n\n");
+
         fprintf(stderr, "        \033[1m--sentinel <filename>\033[0m\n\n");
         fprintf(stderr, "        Close the program after a game if the file is \
 found, deleting the file.\n        Use to interrupt online play without annoyin\
 g human players. Is\n        executed after commands kgs-game_over and final_sc\
 ore, and after a\n        genmove resignation.\n\n");
 
+        fprintf(stderr, "        \033[1m--server <socket path>\033[0m\n\n");
+        fprintf(stderr, "        Run as a GTP server listening on a Unix domai\
+n socket, with an\n        independent game for each connection. The games sha\
+re the threads and\n        the transpositions table, and are searched one at \
+a time.\n\n");
+
+        fprintf(stderr, "        \033[1m--connect <socket path>\033[0m\n\n");
+        fprintf(stderr, "        Play over GTP by relaying the standard input a\
+nd output to a program\n        started with --server, instead of searching in\
+ this process.\n\n");
+
+        fprintf(stderr, "        \033[1m--cluster <host:port>[,<host:port>...]\
+\033[0m\n\n");
+        fprintf(stderr, "        Search also with the programs started with --c\
+luster_worker at the\n        addresses given, usually in other machines. They\
+ search the same\n        position during the timed searches, and the statist\
+ics of the plays of\n        their roots are merged periodically into the root\
+ of this program,\n        that chooses the play.\n\n");
+
+        fprintf(stderr, "        \033[1m--cluster_worker <port>\033[0m\n\n");
+        fprintf(stderr, "        Run as a cluster worker listening for a progra\
+m started with --cluster\n        on a TCP port, searching the positions it se\
+nds. Must be built with the\n        same board size. Use with --threads and --\
+memory.\n\n");
+
+        fprintf(stderr, "        \033[1m--answer_boardsize <id>\033[0m\n\n");
+        fprintf(stderr, "        Answer a GTP boardsize command with the id giv\
+en, or -1 for none,\n        on startup. Used when switching to the engine of \
+another board size.\n\n");
+
         fprintf(stderr, "        \033[1m--set <name> <value>\033[0m\n\n");
         fprintf(stderr, "        For optimization. Set the value of an internal\
  parameter.\n\n");
@@ -341,12 +490,22 @@ int main(
 
     bool color_set = false;
     bool time_related_set = false;
+    bool deterministic_set = false;
     bool human_player_color = true;
     bool think_in_opt_turn = false;
     bool opening_books_enabled = true;
     set_time_per_turn(&current_clock_black, DEFAULT_TIME_PER_TURN);
     set_time_per_turn(&current_clock_white, DEFAULT_TIME_PER_TURN);
     d16 desired_num_threads = DEFAULT_NUM_THREADS;
+    u32 self_play_games = 0;
+    u16 self_play_concurrent = 0;
+    bool self_play_sets = false;
+    const char * server_path = NULL;
+    const char * connect_path = NULL;
+    const char * cluster_addresses = NULL;
+    d32 cluster_worker_port = 0;
+    u64 memory_budget_mbs = 0;
+    int boardsize_id = -2;
 
     for(int i = 1; i < argc; ++i)
     {
@@ -486,10 +645,35 @@ int main(
             continue;
         }
 
+        if(strcmp(argv[i], "--memory_budget") == 0 && i < argc - 1)
+        {
+            args_understood += 2;
+            d32 v;
+            if(!parse_int(&v, argv[i + 1]) || v < 2)
+            {
+                fprintf(stderr, "illegal format for --memory_budget argument\n");
+                exit(EXIT_FAILURE);
+            }
+
+            memory_budget_mbs = v;
+            ++i;
+            continue;
+        }
+
         if(strcmp(argv[i], "--set") == 0 && i < argc - 2)
         {
             args_understood += 3;
-            set_parameter(argv[i + 1], argv[i + 2]);
+            set_parameter(argv[i + 1], argv[i + 2], true);
+            i += 2;
+            continue;
+        }
+
+        if((strcmp(argv[i], "--set_first") == 0 || strcmp(argv[i],
+            "--set_second") == 0) && i < argc - 2)
+        {
+            args_understood += 3;
+            set_parameter(argv[i + 1], argv[i + 2], false);
+            self_play_sets = true;
             i += 2;
             continue;
         }
@@ -543,22 +727,34 @@ int main(
 
             startup(false, desired_num_threads);
 
+            board b;
+            clear_board(&b);
+
             /*
             Perform a larger initial MCTS just to allocate memory so all
             next runs are made in more similar pre-allocated memory
             conditions.
             */
-            mcts_benchmark(14 * 1000);
+            mcts_benchmark(&b, true, 14 * 1000);
 
             u32 sims = 0;
             for(u8 i = 0; i < 12; ++i)
             {
                 tt_clean_all() ;
-                sims += mcts_benchmark(10 * 1000);
+                sims += mcts_benchmark(&b, true, 10 * 1000);
             }
             fprintf(stderr, "%u\n", sims / 120);
             return EXIT_SUCCESS;
         }
+
+        if(strcmp(argv[i], "--benchmark_suite") == 0 && i < argc - 1)
+        {
+            args_understood += 2;
+
+            startup(false, desired_num_threads);
+            main_benchmark(argv[i + 1]);
+            return EXIT_SUCCESS;
+        }
     }
 
     for(int i = 1; i < argc; ++i)
@@ -697,6 +893,63 @@ int main(
             continue;
         }
 
+        if(strcmp(argv[i], "--self_play") == 0 && i < argc - 2)
+        {
+            args_understood += 3;
+            u32 games;
+            u32 concurrent;
+            if(!parse_uint(&games, argv[i + 1]) || games == 0 ||
+                !parse_uint(&concurrent, argv[i + 2]) || concurrent == 0 ||
+                concurrent > UINT16_MAX)
+            {
+                fprintf(stderr, "illegal format for --self_play arguments\n");
+                exit(EXIT_FAILURE);
+            }
+
+            self_play_games = games;
+            self_play_concurrent = concurrent;
+            i += 2;
+            continue;
+        }
+
+        if(strcmp(argv[i], "--deterministic") == 0 && i < argc - 1)
+        {
+            args_understood += 2;
+            d32 v;
+            if(!parse_int(&v, argv[i + 1]) || v < 0)
+            {
+                fprintf(stderr, "format error in RNG seed\n");
+                exit(EXIT_FAILURE);
+            }
+
+            deterministic_set = true;
+            mcts_set_deterministic(true, v);
+            ++i;
+            continue;
+        }
+
+        if(strcmp(argv[i], "--komi") == 0 && i < argc - 1)
+        {
+            args_understood += 2;
+            double v;
+            if(!parse_float(&v, argv[i + 1]))
+            {
+                fprintf(stderr, "illegal format for --komi argument\n");
+                exit(EXIT_FAILURE);
+            }
+
+            komi = (d16)(v * 2.0);
+            ++i;
+            continue;
+        }
+
+        if(strcmp(argv[i], "--dynamic_komi") == 0)
+        {
+            args_understood += 1;
+            mcts_set_dynamic_komi(true);
+            continue;
+        }
+
         if(strcmp(argv[i], "--disable_opening_books") == 0)
         {
             args_understood += 1;
@@ -714,10 +967,84 @@ int main(
             ++i;
             continue;
         }
+
+        if(strcmp(argv[i], "--server") == 0 && i < argc - 1)
+        {
+            args_understood += 2;
+            server_path = argv[i + 1];
+            ++i;
+            continue;
+        }
+
+        if(strcmp(argv[i], "--connect") == 0 && i < argc - 1)
+        {
+            args_understood += 2;
+            connect_path = argv[i + 1];
+            ++i;
+            continue;
+        }
+
+        if(strcmp(argv[i], "--cluster") == 0 && i < argc - 1)
+        {
+            args_understood += 2;
+            cluster_addresses = argv[i + 1];
+            ++i;
+            continue;
+        }
+
+        if(strcmp(argv[i], "--cluster_worker") == 0 && i < argc - 1)
+        {
+            args_understood += 2;
+            if(!parse_int(&cluster_worker_port, argv[i + 1]) ||
+                cluster_worker_port < 1 || cluster_worker_port > 65535)
+            {
+                fprintf(stderr,
+                    "illegal format for --cluster_worker argument\n");
+                exit(EXIT_FAILURE);
+            }
+
+            ++i;
+            continue;
+        }
+
+        if(strcmp(argv[i], "--answer_boardsize") == 0 && i < argc - 1)
+        {
+            args_understood += 2;
+            d32 v;
+            if(!parse_int(&v, argv[i + 1]) || v < -1)
+            {
+                fprintf(stderr,
+                    "illegal format for --answer_boardsize argument\n");
+                exit(EXIT_FAILURE);
+            }
+
+            boardsize_id = v;
+            ++i;
+            continue;
+        }
     }
 
     for(int i = 1; i < argc - 1; ++i)
     {
+        if(strcmp(argv[i], "--playout_policy") == 0)
+        {
+            args_understood += 2;
+            if(strcmp(argv[i + 1], "heavy") == 0)
+                set_light_playouts(false);
+            else
+                if(strcmp(argv[i + 1], "light") == 0)
+                    set_light_playouts(true);
+                else
+                {
+                    fprintf(stderr,
+                        "illegal format for --playout_policy argument\n");
+                    exit(EXIT_FAILURE);
+                }
+
+            ++i;
+            continue;
+        }
+
         if(strcmp(argv[i], "--losing") == 0)
         {
             args_understood += 2;
@@ -757,6 +1084,49 @@ usage instructions.\n");
         exit(EXIT_FAILURE);
     }
 
+    if((server_path != NULL || connect_path != NULL) && !use_gtp)
+    {
+        fprintf(stderr, "--server or --connect set outside of GTP mode\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(boardsize_id != -2 && (!use_gtp || server_path != NULL || connect_path
+        != NULL))
+    {
+        fprintf(stderr, "--answer_boardsize set outside of GTP mode or with \
+--server or --connect\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(server_path != NULL && (connect_path != NULL || think_in_opt_turn ||
+        self_play_games > 0))
+    {
+        fprintf(stderr, "--server flag set with --connect, --think_in_opt_time \
+or --self_play\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(cluster_worker_port > 0 && (cluster_addresses != NULL || server_path !=
+        NULL || connect_path != NULL || self_play_games > 0))
+    {
+        fprintf(stderr, "--cluster_worker flag set with --cluster, --server, --\
+connect or --self_play\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(cluster_addresses != NULL && (connect_path != NULL || self_play_games >
+        0))
+    {
+        fprintf(stderr, "--cluster flag set with --connect or --self_play\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(connect_path != NULL)
+    {
+        main_gtp_connect(connect_path);
+        return EXIT_SUCCESS;
+    }
+
     if(use_gtp && color_set)
     {
         fprintf(stderr, "--color option set outside of text mode\n");
@@ -769,6 +1139,25 @@ usage instructions.\n");
         exit(EXIT_FAILURE);
     }
 
+    if(deterministic_set && limit_by_playouts == 0)
+    {
+        fprintf(stderr, "--deterministic flag set without --playouts\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(self_play_sets && self_play_games == 0)
+    {
+        fprintf(stderr,
+            "--set_first or --set_second set without --self_play\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(deterministic_set && self_play_games > 0)
+    {
+        fprintf(stderr, "--deterministic flag set with --self_play\n");
+        exit(EXIT_FAILURE);
+    }
+
 
     /*
     Warnings for compile time options
@@ -782,10 +1171,31 @@ usage instructions.\n");
         flog_warn("init",
             "MCTS using a constant number of simulations per turn");
 
+    set_memory_budget(memory_budget_mbs);
+
+    if(self_play_games > 0)
+    {
+        self_play_argc = argc;
+        self_play_argv = argv;
+        self_play_opening_books = opening_books_enabled;
+        self_play_num_threads = desired_num_threads;
+        main_self_play(self_play_games, self_play_concurrent,
+            self_play_player_init);
+        return EXIT_SUCCESS;
+    }
+
     startup(opening_books_enabled, desired_num_threads);
 
-    if(use_gtp)
-        main_gtp(think_in_opt_turn);
+    if(cluster_worker_port > 0)
+        cluster_worker(cluster_worker_port);
+
+    if(cluster_addresses != NULL && cluster_connect(cluster_addresses) == 0)
+        flog_warn("init", "no cluster worker could be reached");
+
+    if(server_path != NULL)
+        main_gtp_server(server_path);
+    else if(use_gtp)
+        main_gtp(think_in_opt_turn, argv, boardsize_id);
     else
         main_text(human_player_color);
 
@@ -0,0 +1,514 @@
+/*
+Matilda self-play match runner
+
+Plays a number of games between two players that differ in the values of the
+internal parameters, a number of them at the same time. The players alternate
+colors, resign when losing, and the games are written as SGF to the data folder.
+One line is printed per game and a summary of the results at the end, to the
+standard output file descriptor.
+
+Each game is refereed by its own process, and each of its players is a process
+of its own as well, so the players search with independent transpositions tables
+and parameters. The plays are exchanged through pipes. The processes are forked
+before MCTS is initialized, because a process can't use OpenMP after forking
+from one that already did; the data files are then read by each player, but they
+are mostly mapped from the data pack and shared.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "alloc.h"
+#include "board.h"
+#include "engine.h"
+#include "flog.h"
+#include "game_record.h"
+#include "mcts.h"
+#include "scoring.h"
+#include "sgf.h"
+#include "time_ctrl.h"
+#include "timem.h"
+#include "types.h"
+
+/* messages from the referee to the players */
+#define SP_NEW_GAME 0
+#define SP_PLAY 1
+#define SP_GENMOVE 2 /* answered with the play, or NONE to resign */
+#define SP_SCORE 3 /* answered with the score estimate */
+
+typedef struct __sp_message_ {
+    u8 type;
+    move m;
+    d16 score;
+} sp_message;
+
+typedef struct __sp_player_ {
+    pid_t pid;
+    int to_fd;
+    int from_fd;
+} sp_player;
+
+/* sent by the referees to the main process; small enough to be atomic */
+typedef struct __sp_result_ {
+    u32 game;
+    bool first_is_black;
+    bool finished;
+    d16 final_score;
+} sp_result;
+
+extern time_system current_clock_black;
+extern u32 limit_by_playouts;
+
+static const char * player_names[2] = { "first", "second" };
+
+
+static void write_fully(
+    int fd,
+    const void * buf,
+    u32 size
+){
+    const u8 * p = (const u8 *)buf;
+    while(size > 0)
+    {
+        ssize_t w = write(fd, p, size);
+        if(w == -1 && errno == EINTR)
+            continue;
+        if(w <= 0)
+            flog_crit("self", "write to self-play process failed");
+        p += w;
+        size -= w;
+    }
+}
+
+/*
+RETURNS false if the other end was closed
+*/
+static bool read_fully(
+    int fd,
+    void * buf,
+    u32 size
+){
+    u8 * p = (u8 *)buf;
+    while(size > 0)
+    {
+        ssize_t r = read(fd, p, size);
+        if(r == -1 && errno == EINTR)
+            continue;
+        if(r <= 0)
+            return false;
+        p += r;
+        size -= r;
+    }
+    return true;
+}
+
+/*
+Selects the play of the player in the game, as in text mode.
+RETURNS the play, or NONE to resign
+*/
+static move player_genmove(
+    const game_record * gr,
+    time_system * clock
+){
+    board b;
+    current_game_state(&b, gr);
+    bool is_black = current_player_color(gr);
+    out_board out_b;
+
+    bool has_play;
+    u64 curr_time = current_time_in_millis();
+    if(limit_by_playouts > 0)
+        has_play = evaluate_position_sims(&b, is_black, &out_b,
+            limit_by_playouts);
+    else
+    {
+        u16 stones = stone_count(b.p);
+        u32 milliseconds = calc_time_to_play(clock, stones);
+        u32 max_milliseconds = calc_max_time_to_play(clock, stones);
+
+        u64 stop_time = curr_time + milliseconds;
+        u64 early_stop_time = curr_time + (milliseconds / 4);
+        u64 max_stop_time = curr_time + max_milliseconds;
+        has_play = evaluate_position_timed(&b, is_black, &out_b, stop_time,
+            early_stop_time, max_stop_time);
+    }
+    advance_clock(clock, current_time_in_millis() - curr_time);
+
+    if(!has_play)
+        return NONE;
+
+    if(out_b.pass >= JUST_PASS_WINRATE)
+        return PASS;
+    return select_play(&out_b, is_black, gr);
+}
+
+/*
+Body of a player process; answers the messages of the referee until it closes
+the pipe.
+*/
+static void run_player(
+    u8 player,
+    int in_fd,
+    int out_fd,
+    void (* player_init)(u8)
+){
+    player_init(player);
+
+    time_system clock;
+    memcpy(&clock, &current_clock_black, sizeof(time_system));
+
+    game_record * gr = malloc(sizeof(game_record));
+    if(gr == NULL)
+        flog_crit("self", "system out of memory");
+    clear_game_record(gr);
+    mcts_set_game_history(gr);
+
+    sp_message msg;
+    while(read_fully(in_fd, &msg, sizeof(sp_message)))
+    {
+        board b;
+
+        switch(msg.type)
+        {
+            case SP_NEW_GAME:
+                clear_game_record(gr);
+                new_match_maintenance();
+                reset_clock(&clock);
+                break;
+            case SP_PLAY:
+                add_play(gr, msg.m);
+                current_game_state(&b, gr);
+                opt_turn_maintenance(&b, current_player_color(gr));
+                break;
+            case SP_GENMOVE:
+                msg.m = player_genmove(gr, &clock);
+                if(msg.m != NONE)
+                    add_play(gr, msg.m);
+                write_fully(out_fd, &msg, sizeof(sp_message));
+                break;
+            case SP_SCORE:
+                current_game_state(&b, gr);
+                msg.score = estimate_final_score(&b, current_player_color(gr));
+                write_fully(out_fd, &msg, sizeof(sp_message));
+                break;
+            default:
+                flog_crit("self", "illegal self-play message");
+        }
+
+        /* while the opponent is thinking */
+        flog_flush();
+    }
+
+    free(gr);
+    exit(EXIT_SUCCESS);
+}
+
+static void spawn_player(
+    sp_player players[2],
+    u8 player,
+    void (* player_init)(u8)
+){
+    sp_player * p = &players[player];
+    int to_player[2];
+    int from_player[2];
+    if(pipe(to_player) != 0 || pipe(from_player) != 0)
+        flog_crit("self", "could not create pipes");
+
+    fflush(stdout);
+    flog_flush();
+    pid_t pid = fork();
+    if(pid == -1)
+        flog_crit("self", "could not create player process");
+
+    if(pid == 0)
+    {
+        close(to_player[1]);
+        close(from_player[0]);
+        /* so the other player sees the pipes closed by the referee */
+        for(u8 i = 0; i < player; ++i)
+        {
+            close(players[i].to_fd);
+            close(players[i].from_fd);
+        }
+        run_player(player, to_player[0], from_player[1], player_init);
+    }
+
+    close(to_player[0]);
+    close(from_player[1]);
+    p->pid = pid;
+    p->to_fd = to_player[1];
+    p->from_fd = from_player[0];
+}
+
+static void send_message(
+    const sp_player * p,
+    u8 type,
+    move m
+){
+    sp_message msg;
+    msg.type = type;
+    msg.m = m;
+    msg.score = 0;
+    write_fully(p->to_fd, &msg, sizeof(sp_message));
+}
+
+static void receive_message(
+    const sp_player * p,
+    sp_message * msg
+){
+    if(!read_fully(p->from_fd, msg, sizeof(sp_message)))
+        flog_crit("self", "player process terminated unexpectedly");
+}
+
+/*
+Plays a game to the end, with each player being asked in turn for its play.
+Games ended by passing are scored by both players, and are left without result
+if they disagree on the winner.
+*/
+static void play_game(
+    game_record * gr,
+    sp_player players[2],
+    bool first_is_black
+){
+    const sp_player * black = &players[first_is_black ? 0 : 1];
+    const sp_player * white = &players[first_is_black ? 1 : 0];
+
+    clear_game_record(gr);
+    snprintf(gr->black_name, MAX_PLAYER_NAME_SIZ, "%s",
+        player_names[first_is_black ? 0 : 1]);
+    snprintf(gr->white_name, MAX_PLAYER_NAME_SIZ, "%s",
+        player_names[first_is_black ? 1 : 0]);
+    gr->player_names_set = true;
+
+    send_message(black, SP_NEW_GAME, NONE);
+    send_message(white, SP_NEW_GAME, NONE);
+
+    bool is_black = true;
+    bool passed = false;
+    sp_message msg;
+
+    while(gr->turns < MAX_GAME_LENGTH - 1)
+    {
+        const sp_player * p = is_black ? black : white;
+        const sp_player * opponent = is_black ? white : black;
+
+        send_message(p, SP_GENMOVE, NONE);
+        receive_message(p, &msg);
+
+        if(msg.m == NONE)
+        {
+            gr->finished = true;
+            gr->resignation = true;
+            gr->final_score = is_black ? -1 : 1;
+            return;
+        }
+
+        add_play(gr, msg.m);
+        send_message(opponent, SP_PLAY, msg.m);
+
+        if(msg.m == PASS && passed)
+            break;
+
+        passed = (msg.m == PASS);
+        is_black = !is_black;
+    }
+
+    send_message(black, SP_SCORE, NONE);
+    receive_message(black, &msg);
+    d16 black_score = msg.score;
+    send_message(white, SP_SCORE, NONE);
+    receive_message(white, &msg);
+    d16 white_score = msg.score;
+
+    if((black_score > 0 && white_score > 0) || (black_score < 0 &&
+        white_score < 0))
+    {
+        gr->finished = true;
+        gr->final_score = (black_score + white_score) / 2;
+        if(gr->final_score == 0)
+            gr->final_score = black_score;
+    }
+}
+
+/*
+Body of a referee process; plays every concurrent-th game starting with the
+first specified, and reports the results to the main process.
+*/
+static void run_referee(
+    u32 first_game,
+    u32 games,
+    u16 concurrent,
+    int results_fd,
+    void (* player_init)(u8)
+){
+    sp_player players[2];
+    spawn_player(players, 0, player_init);
+    spawn_player(players, 1, player_init);
+
+    game_record * gr = malloc(sizeof(game_record));
+    if(gr == NULL)
+        flog_crit("self", "system out of memory");
+
+    char * filename = alloc();
+    char * s = alloc();
+
+    for(u32 game = first_game; game < games; game += concurrent)
+    {
+        bool first_is_black = (game % 2) == 0;
+        play_game(gr, players, first_is_black);
+
+        if(!export_game_as_sgf_auto_named(gr, filename))
+            snprintf(filename, MAX_PAGE_SIZ, "(not written)");
+
+        if(!gr->finished)
+            snprintf(s, MAX_PAGE_SIZ, "no result");
+        else
+            if(gr->resignation)
+                snprintf(s, MAX_PAGE_SIZ, "%c+R", gr->final_score > 0 ? 'B' :
+                    'W');
+            else
+                score_to_string(s, gr->final_score);
+
+        fprintf(stdout, "game %u: %s (B) vs %s (W) %s, %u turns, %s\n",
+            game + 1, gr->black_name, gr->white_name, s, gr->turns, filename);
+        fflush(stdout);
+
+        sp_result res;
+        memset(&res, 0, sizeof(sp_result));
+        res.game = game;
+        res.first_is_black = first_is_black;
+        res.finished = gr->finished;
+        res.final_score = gr->final_score;
+        write_fully(results_fd, &res, sizeof(sp_result));
+    }
+
+    release(s);
+    release(filename);
+    free(gr);
+
+    for(u8 i = 0; i < 2; ++i)
+    {
+        close(players[i].to_fd);
+        close(players[i].from_fd);
+    }
+    int status;
+    bool ok = true;
+    for(u8 i = 0; i < 2; ++i)
+        if(waitpid(players[i].pid, &status, 0) == -1 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != EXIT_SUCCESS)
+            ok = false;
+
+    exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/*
+Plays the games between the two players, a number of them at the same time,
+and prints a summary of the results. The players are initiated in their own
+processes by player_init, that receives the player number (0 or 1).
+*/
+void main_self_play(
+    u32 games,
+    u16 concurrent,
+    void (* player_init)(u8)
+){
+    concurrent = MIN(concurrent, games);
+
+    int results[2];
+    if(pipe(results) != 0)
+        flog_crit("self", "could not create pipes");
+
+    fprintf(stdout, "playing %u games, %u at a time\n", games, concurrent);
+    fflush(stdout);
+
+    pid_t * referees = malloc(sizeof(pid_t) * concurrent);
+    if(referees == NULL)
+        flog_crit("self", "system out of memory");
+
+    flog_flush();
+    for(u16 i = 0; i < concurrent; ++i)
+    {
+        referees[i] = fork();
+        if(referees[i] == -1)
+            flog_crit("self", "could not create referee process");
+
+        if(referees[i] == 0)
+        {
+            close(results[0]);
+            run_referee(i, games, concurrent, results[1], player_init);
+        }
+    }
+    close(results[1]);
+
+    u32 played = 0;
+    u32 unfinished = 0;
+    u32 black_wins = 0;
+    u32 first_wins = 0;
+    u32 first_wins_as_black = 0;
+    u32 first_games_as_black = 0;
+    u32 first_wins_as_white = 0;
+    u32 first_games_as_white = 0;
+
+    sp_result res;
+    while(read_fully(results[0], &res, sizeof(sp_result)))
+    {
+        ++played;
+        if(!res.finished)
+        {
+            ++unfinished;
+            continue;
+        }
+
+        bool black_won = res.final_score > 0;
+        bool first_won = (black_won == res.first_is_black);
+        black_wins += black_won;
+        first_wins += first_won;
+        if(res.first_is_black)
+        {
+            ++first_games_as_black;
+            first_wins_as_black += first_won;
+        }
+        else
+        {
+            ++first_games_as_white;
+            first_wins_as_white += first_won;
+        }
+    }
+    close(results[0]);
+
+    bool ok = true;
+    for(u16 i = 0; i < concurrent; ++i)
+    {
+        int status;
+        if(waitpid(referees[i], &status, 0) == -1 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != EXIT_SUCCESS)
+            ok = false;
+    }
+    free(referees);
+
+    u32 decided = played - unfinished;
+    double win_rate = decided > 0 ? ((double)first_wins) / decided : 0.0;
+    double error = decided > 0 ? sqrt(win_rate * (1.0 - win_rate) / decided) :
+        0.0;
+
+    fprintf(stdout, "\ngames played: %u (%u without result)\n", played,
+        unfinished);
+    fprintf(stdout, "first player wins: %u (%.1f%% +- %.1f%%)\n", first_wins,
+        win_rate * 100.0, error * 100.0);
+    fprintf(stdout, "first player wins as black: %u/%u\n", first_wins_as_black,
+        first_games_as_black);
+    fprintf(stdout, "first player wins as white: %u/%u\n", first_wins_as_white,
+        first_games_as_white);
+    fprintf(stdout, "black wins: %u/%u\n", black_wins, decided);
+    fflush(stdout);
+
+    if(!ok || played < games)
+        flog_crit("self", "self-play processes terminated unexpectedly");
+}
@@ -107,22 +107,22 @@ static void text_genmove(
     current_game_state(&current_state, &current_game);
 
     u16 stones = stone_count(current_state.p);
-    u32 milliseconds;
-    if(is_black)
-        milliseconds = calc_time_to_play(&current_clock_black, stones);
-    else
-        milliseconds = calc_time_to_play(&current_clock_white, stones);
+    time_system * clock = is_black ? &current_clock_black :
+        &current_clock_white;
+    u32 milliseconds = calc_time_to_play(clock, stones);
+    u32 max_milliseconds = calc_max_time_to_play(clock, stones);
 
     u64 curr_time = current_time_in_millis();
     u64 stop_time = curr_time + milliseconds;
     u64 early_stop_time = curr_time + (milliseconds / 4);
+    u64 max_stop_time = curr_time + max_milliseconds;
     bool has_play;
     if(limit_by_playouts > 0)
         has_play = evaluate_position_sims(&current_state, is_black, &out_b,
             limit_by_playouts);
     else
         has_play = evaluate_position_timed(&current_state, is_black, &out_b,
-            stop_time, early_stop_time);
+            stop_time, early_stop_time, max_stop_time);
 
     if(!has_play)
     {
@@ -233,11 +233,14 @@ signation.\n\n", s);
     load_hoshi_points();
 
     clear_game_record(&current_game);
+    mcts_set_game_history(&current_game);
     update_names(human_player_color);
 
     char * buf = alloc();
     while(1)
     {
+        flog_flush();
+
         passed = false;
         resigned = false;
 
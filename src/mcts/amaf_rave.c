@@ -11,8 +11,11 @@ visited by black and WHITE_STONE for first visited by white.
 
 #include <stdlib.h>
 #include <math.h>
+#include <omp.h>
 
 #include "amaf_rave.h"
+#include "cfg_board.h"
+#include "mcts.h"
 #include "types.h"
 
 /*
@@ -22,75 +25,77 @@ double rave_equiv = RAVE_MSE_EQUIV;
 
 /*
 Calculation of the RAVE value of a state transition.
-RETURNS overall value of play (x,y)
+RETURNS overall value of play of index k
 */
 double uct1_rave(
-    const tt_play * play
+    const tt_stats * stats,
+    move k
 ){
+    u32 mc_n = stats->mc_n[k];
+    double mc_q = stats->mc_q[k];
     u32 n_amaf_s_a;
     double q_amaf_s_a;
 
-    if(CRITICALITY_THRESHOLD > 0 && play->mc_n >= CRITICALITY_THRESHOLD)
+    if(CRITICALITY_THRESHOLD > 0 && mc_n >= CRITICALITY_THRESHOLD)
     {
+        const tt_play * play = &stats->plays[k];
         double c_pachi = play->owner_winning - (2.0 * play->color_owning *
-            play->mc_q - play->color_owning - play->mc_q + 1.0);
-        double crit_n = fabs(c_pachi) * play->amaf_n;
+            mc_q - play->color_owning - mc_q + 1.0);
+        double crit_n = fabs(c_pachi) * stats->amaf_n[k];
 
-        n_amaf_s_a = play->amaf_n + crit_n;
+        n_amaf_s_a = stats->amaf_n[k] + crit_n;
         if(c_pachi <= 0.0)
-            q_amaf_s_a = play->amaf_q;
+            q_amaf_s_a = stats->amaf_q[k];
         else
-            q_amaf_s_a = ((play->amaf_q * play->amaf_n) + crit_n) / n_amaf_s_a;
+            q_amaf_s_a = ((stats->amaf_q[k] * stats->amaf_n[k]) + crit_n) /
+                n_amaf_s_a;
     }
     else
     {
-        n_amaf_s_a = play->amaf_n;
-        q_amaf_s_a = play->amaf_q;
+        n_amaf_s_a = stats->amaf_n[k];
+        q_amaf_s_a = stats->amaf_q[k];
     }
 
     /* RAVE minimum MSE schedule */
-    double b = n_amaf_s_a / (play->mc_n + n_amaf_s_a + (play->mc_n *
-        n_amaf_s_a) / rave_equiv);
+    double b = n_amaf_s_a / (mc_n + n_amaf_s_a + (mc_n * n_amaf_s_a) /
+        rave_equiv);
 
-    return (1.0 - b) * play->mc_q + b * q_amaf_s_a;
+    return (1.0 - b) * mc_q + b * q_amaf_s_a;
 }
 
 /*
 Batch update of all transitions that were visited anytime after the current
-state (if visited first by the player).
+state (if visited first by the player), over a number of simulations. The
+points first played by the player in any of them are marked in first_set; for
+each of those points, first_n is the number of simulations where it was first
+played by the player, and first_wins how many of those the player won. Only the
+plays of the points marked are visited.
 */
 void update_amaf_stats(
     tt_stats * stats,
-    const u8 traversed[TOTAL_BOARD_SIZ],
-    bool is_black,
-    double z
+    const u64 first_set[LIB_BITMAP_WORDS],
+    const u16 first_n[TOTAL_BOARD_SIZ],
+    const u16 first_wins[TOTAL_BOARD_SIZ]
 ){
-    for(u16 k = 0; k < stats->plays_count; ++k)
-        if(stats->plays[k].m != PASS && traversed[stats->plays[k].m] != EMPTY &&
-            (traversed[stats->plays[k].m] == BLACK_STONE) == is_black)
+    move ranked = 0;
+    for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
+    {
+        u64 plays = stats->plays_set[i];
+        for(u64 w = plays & first_set[i]; w != 0; w &= w - 1)
         {
-            stats->plays[k].amaf_n++;
-            stats->plays[k].amaf_q += ((z - stats->plays[k].amaf_q) /
-                stats->plays[k].amaf_n);
-        }
-}
+            u8 bit = __builtin_ctzll(w);
+            move m = i * 64 + bit;
+            move k = stats->plays_by_position[ranked + __builtin_popcountll(
+                plays & (LIB_BIT(bit) - 1))];
 
-/*
-Batch update of all transitions that were visited anytime after the current
-state (if visited first by the player).
-This version only adds losses -- it is meant to be used when a draw occurs.
-*/
-void update_amaf_stats2(
-    tt_stats * stats,
-    const u8 traversed[TOTAL_BOARD_SIZ],
-    bool is_black
-){
-    for(u16 k = 0; k < stats->plays_count; ++k)
-        if(stats->plays[k].m != PASS && traversed[stats->plays[k].m] != EMPTY &&
-            (traversed[stats->plays[k].m] == BLACK_STONE) == is_black)
-        {
-            stats->plays[k].amaf_n++;
-            stats->plays[k].amaf_q -= (stats->plays[k].amaf_q /
-                stats->plays[k].amaf_n);
+            u32 dn = first_n[m];
+            u32 n;
+#if UCT_LOCKLESS_UPDATES
+            #pragma omp atomic capture
+#endif
+            n = stats->amaf_n[k] += dn;
+            stats->amaf_q[k] += (first_wins[m] - stats->amaf_q[k] * dn) / n;
         }
+        ranked += __builtin_popcountll(plays);
+    }
 }
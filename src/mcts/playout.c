@@ -8,15 +8,17 @@ The move selection policy uses the following restrictions:
     3. No plays ending in self-atari except if forming a single stone group
     (throw-in)
 And chooses a play based on (by order of importance):
-    1. Nakade
-    2. Capture
-    3. Avoid capture
-    4. Handcrafted 3x3 patterns
-    5. Random play
+    1. Avoid capture
+    2. Last good reply (see PL_LAST_GOOD_REPLY)
+    3. Nakade (disabled)
+    4. Capture
+    5. Handcrafted 3x3 patterns, or 12-point patterns where known
+    6. Random play
 */
 
 #include "config.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -24,12 +26,15 @@ And chooses a play based on (by order of importance):
 #include "board.h"
 #include "cfg_board.h"
 #include "hash_table.h"
+#include "pat12.h"
 #include "pat3.h"
 #include "playout.h"
+#include "random_play.h"
 #include "randg.h"
 #include "scoring.h"
 #include "state_changes.h"
 #include "tactical.h"
+#include "thread_state.h"
 #include "types.h"
 
 u16 pl_skip_saving = PL_SKIP_SAVING;
@@ -37,24 +42,146 @@ u16 pl_skip_nakade = PL_SKIP_NAKADE;
 u16 pl_skip_pattern = PL_SKIP_PATTERN;
 u16 pl_skip_capture = PL_SKIP_CAPTURE;
 u16 pl_ban_self_atari = PL_BAN_SELF_ATARI;
+u16 pl_skip_lgr = PL_SKIP_LGR;
+bool pl_light_playouts = false;
+
+#if PL_LAST_GOOD_REPLY
+/*
+Last good replies of each player to the last play, and to the last two plays,
+shared by all threads; plus one, or 0 if none.
+*/
+static u16 lgr1[2][TOTAL_BOARD_SIZ];
+static u16 lgr2[2][TOTAL_BOARD_SIZ][TOTAL_BOARD_SIZ];
+#endif
+
+/*
+Statistics of the heavy playouts of the search, of each thread: how they ended
+and their lengths, and the playouts that reached the next tighter cutoffs and
+how many of them ended with another winner.
+*/
+typedef struct __playout_stats_ {
+    u32 ends[PL_END_REASONS];
+    u32 lengths[PL_LENGTH_BUCKETS];
+#if PL_ADAPTIVE_CUTOFFS
+    u32 mercy_samples;
+    u32 mercy_changed;
+    u32 depth_samples;
+    u32 depth_changed;
+#endif
+} playout_stats;
+
+static thread_states playout_stats_of_threads = THREAD_STATES(playout_stats);
+
+/*
+Cutoffs of the heavy playouts in use, shared by all threads.
+*/
+static d16 mercy_threshold = MERCY_THRESHOLD;
+static u16 depth_over_empty = MAX_PLAYOUT_DEPTH_OVER_EMPTY;
 
 extern move_seq neighbors_3x3[TOTAL_BOARD_SIZ];
 
+/*
+Minimum number of dirty positions for classifying the whole board at once.
+*/
+#define BATCH_CLASSIFY_MIN_DIRTY 32
+
 /*
 For mercy Threshold
 */
 extern d16 komi;
+extern d16 dynamic_komi;
+
+/*
+Sets the status of a position, keeping the set of legal positions updated.
+*/
+static void set_status(
+    play_cache * c,
+    move m,
+    u8 status
+){
+    if((c->status[m] ^ status) & CACHE_PLAY_LEGAL)
+    {
+        if(status & CACHE_PLAY_LEGAL)
+        {
+            c->legal_idx[m] = c->legal_count;
+            c->legal[c->legal_count++] = m;
+        }
+        else
+        {
+            move last = c->legal[--c->legal_count];
+            c->legal[c->legal_idx[m]] = last;
+            c->legal_idx[last] = c->legal_idx[m];
+        }
+    }
+    c->status[m] = status;
+}
+
+#if !MATILDA_RELEASE_MODE
+/*
+RETURNS true if the set of legal positions holds exactly the positions marked
+legal, and they are all empty
+*/
+static bool verify_play_cache(
+    const play_cache * c,
+    const cfg_board * cb
+){
+    move legal = 0;
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+        if(c->status[m] & CACHE_PLAY_LEGAL)
+        {
+            if(cb->p[m] != EMPTY || c->legal[c->legal_idx[m]] != m)
+                return false;
+            ++legal;
+        }
+    return legal == c->legal_count;
+}
+#endif
+
+/*
+Marks all empty positions as needing to be recalculated.
+*/
+static void cache_init(
+    play_cache * c,
+    const cfg_board * cb
+){
+    memset(c->status, 0, TOTAL_BOARD_SIZ);
+    c->legal_count = 0;
+    for(move k = 0; k < cb->empty.count; ++k)
+    {
+        move m = cb->empty.coord[k];
+        c->status[m] = CACHE_PLAY_DIRTY;
+        c->dirty[k] = m;
+    }
+    c->dirty_count = cb->empty.count;
+}
+
+static void mark_dirty(
+    play_cache * c1,
+    play_cache * c2,
+    move m
+){
+    if((c1->status[m] & CACHE_PLAY_DIRTY) == 0)
+    {
+        set_status(c1, m, CACHE_PLAY_DIRTY);
+        c1->dirty[c1->dirty_count++] = m;
+    }
+    if((c2->status[m] & CACHE_PLAY_DIRTY) == 0)
+    {
+        set_status(c2, m, CACHE_PLAY_DIRTY);
+        c2->dirty[c2->dirty_count++] = m;
+    }
+}
 
 static void invalidate_cache_of_the_past(
     const cfg_board * cb,
-    u8 c1[TOTAL_BOARD_SIZ],
-    u8 c2[TOTAL_BOARD_SIZ]
+    play_cache * c1,
+    play_cache * c2
 ){
     /*
     Positions previously illegal because of possible ko
     */
     if(is_board_move(cb->last_eaten))
-        c1[cb->last_eaten] = c2[cb->last_eaten] = CACHE_PLAY_DIRTY;
+        mark_dirty(c1, c2, cb->last_eaten);
 }
 
 /*
@@ -66,16 +193,20 @@ positions marked captured
 */
 static void invalidate_cache_after_play(
     const cfg_board * cb,
-    u8 c1[TOTAL_BOARD_SIZ],
-    u8 c2[TOTAL_BOARD_SIZ],
-    bool stones_captured[TOTAL_BOARD_SIZ],
-    u8 libs_of_nei_of_captured[LIB_BITMAP_SIZ]
+    play_cache * c1,
+    play_cache * c2,
+    const move_seq * stones_captured,
+    u64 libs_of_nei_of_captured[LIB_BITMAP_WORDS]
 ){
     assert(is_board_move(cb->last_played));
 
     move m = cb->last_played;
-    /* Position just played at is certain to be illegal */
-    c1[m] = c2[m] = 0;
+    /*
+    Position just played at is certain to be illegal; if still in the list of
+    dirty positions it is cleared when the list is processed.
+    */
+    set_status(c1, m, c1->status[m] & CACHE_PLAY_DIRTY);
+    set_status(c2, m, c2->status[m] & CACHE_PLAY_DIRTY);
 
     /*
     Invalidate corners
@@ -88,65 +219,158 @@ static void invalidate_cache_after_play(
     if(x > 0)
     {
         if(y > 0)
-            c1[m + LEFT + TOP] = c2[m + LEFT + TOP] = CACHE_PLAY_DIRTY;
+            mark_dirty(c1, c2, m + LEFT + TOP);
 
         if(y < BOARD_SIZ - 1)
-            c1[m + LEFT + BOTTOM] = c2[m + LEFT + BOTTOM] = CACHE_PLAY_DIRTY;
+            mark_dirty(c1, c2, m + LEFT + BOTTOM);
 
     }
     if(x < BOARD_SIZ - 1)
     {
         if(y > 0)
-            c1[m + RIGHT + TOP] = c2[m + RIGHT + TOP] = CACHE_PLAY_DIRTY;
+            mark_dirty(c1, c2, m + RIGHT + TOP);
 
         if(y < BOARD_SIZ - 1)
-            c1[m + RIGHT + BOTTOM] = c2[m + RIGHT + BOTTOM] = CACHE_PLAY_DIRTY;
+            mark_dirty(c1, c2, m + RIGHT + BOTTOM);
     }
 
     /* Mix liberties of neighbors of eaten stones and new group */
-    for(u8 i = 0; i < LIB_BITMAP_SIZ; ++i)
+    for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
         libs_of_nei_of_captured[i] |= cb->g[m]->ls[i];
 
     /* Mix liberties of neighbors of new group */
     for(u8 n = 0; n < cb->g[m]->neighbors_count; ++n)
     {
         group * g = cb->g[cb->g[m]->neighbors[n]];
-        for(u8 i = 0; i < LIB_BITMAP_SIZ; ++i)
+        for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
             libs_of_nei_of_captured[i] |= g->ls[i];
     }
 
+    /* Dirty positions eaten */
+    for(move k = 0; k < stones_captured->count; ++k)
+        mark_dirty(c1, c2, stones_captured->coord[k]);
+
+    /* Dirty liberties */
+    for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
+        for(u64 w = libs_of_nei_of_captured[i]; w != 0; w &= w - 1)
+            mark_dirty(c1, c2, i * 64 + __builtin_ctzll(w));
+}
+
 
-    /* Dirty liberties and positions eaten */
-    for(m = 0; m < TOTAL_BOARD_SIZ; ++m)
+#if PL_LAST_GOOD_REPLY
+/*
+RETURNS the last good reply of the player to the last two plays, or else to the
+last play; or NONE
+*/
+static move last_good_reply(
+    bool is_black,
+    move prev2,
+    move prev
+){
+    if(!is_board_move(prev))
+        return NONE;
+
+    u16 r;
+    if(is_board_move(prev2))
     {
-        if(stones_captured[m])
-        {
-            c1[m] = c2[m] = CACHE_PLAY_DIRTY;
-            continue;
-        }
+        #pragma omp atomic read
+        r = lgr2[is_black][prev2][prev];
+        if(r > 0)
+            return r - 1;
+    }
+    #pragma omp atomic read
+    r = lgr1[is_black][prev];
+    return r > 0 ? r - 1 : NONE;
+}
 
-        u8 mask = (1 << (m % 8));
-        if(libs_of_nei_of_captured[m / 8] & mask)
-            c1[m] = c2[m] = CACHE_PLAY_DIRTY;
+/*
+Sets or forgets a last good reply, if changed.
+*/
+static void set_reply(
+    u16 * reply,
+    move m,
+    bool good
+){
+    u16 old;
+    #pragma omp atomic read
+    old = *reply;
+    if(good && old != m + 1)
+    {
+        #pragma omp atomic write
+        *reply = m + 1;
+    }
+    else if(!good && old == m + 1)
+    {
+        #pragma omp atomic write
+        *reply = 0;
     }
 }
 
+/*
+Updates the last good replies with the plays of a playout, plays_count starting
+with is_black after prev2 and prev, for its final score: the replies of the
+winner are kept, and those of the loser forgotten.
+*/
+static void update_replies(
+    bool is_black,
+    move prev2,
+    move prev,
+    const move plays[],
+    u16 plays_count,
+    d16 score
+){
+    if(score == 0)
+        return;
+
+    bool black_won = score > 0;
+    for(u16 i = 0; i < plays_count; ++i)
+    {
+        move m = plays[i];
+        if(is_board_move(m) && is_board_move(prev))
+        {
+            bool good = is_black == black_won;
+            set_reply(&lgr1[is_black][prev], m, good);
+            if(is_board_move(prev2))
+                set_reply(&lgr2[is_black][prev2][prev], m, good);
+        }
+        prev2 = prev;
+        prev = m;
+        is_black = !is_black;
+    }
+}
+#endif
 
 /*
 Selects the next play of a heavy playout - MoGo style.
-Uses a cache of play statuses that is updated as needed.
+Uses a cache of play statuses that is updated as needed. The play before the
+last is prev2, or NONE if unknown.
 */
 static move heavy_select_play(
     cfg_board * cb,
     bool is_black,
-    u8 cache[TOTAL_BOARD_SIZ]
+    play_cache * c,
+    move prev2
 ){
     move ko = get_ko_play(cb);
+    u8 * cache = c->status;
 
-    for(u16 k = 0; k < cb->empty.count; ++k)
+    /*
+    When many positions are dirty, like at the start of a playout, most are
+    settled at once by the neighbor counts of the whole board.
+    */
+    u64 safe[LIB_BITMAP_WORDS];
+    bool batch = c->dirty_count >= BATCH_CLASSIFY_MIN_DIRTY;
+    if(batch)
+        cfg_classify_empty(cb, safe);
+
+    for(move k = 0; k < c->dirty_count; ++k)
     {
-        move m = cb->empty.coord[k];
-        if(cache[m] & CACHE_PLAY_DIRTY)
+        move m = c->dirty[k];
+        if(batch && (safe[m / 64] & LIB_BIT(m)))
+            set_status(c, m, CACHE_PLAY_LEGAL | CACHE_PLAY_SAFE);
+        else if(cb->p[m] != EMPTY)
+            set_status(c, m, 0);
+        else
         {
             u8 libs;
             if(!is_eye(cb, is_black, m) && ko != m &&
@@ -161,24 +385,25 @@ static move heavy_select_play(
                     (!is_black && cb->white_neighbors4[m] > 0)))
                 {
                     if(rand_u16(128) < pl_ban_self_atari)
-                        cache[m] = 0;
+                        set_status(c, m, 0);
                     else
-                        cache[m] = CACHE_PLAY_LEGAL;
+                        set_status(c, m, CACHE_PLAY_LEGAL);
                     continue;
                 }
 
-                cache[m] = CACHE_PLAY_LEGAL;
-
-                if(libs > 1)
-                    cache[m] |= CACHE_PLAY_SAFE;
+                set_status(c, m, libs > 1 ? CACHE_PLAY_LEGAL | CACHE_PLAY_SAFE
+                    : CACHE_PLAY_LEGAL);
             }
             else
             {
-                cache[m] = 0; /* not dirty and not legal either */
+                /* not dirty and not legal either */
+                set_status(c, m, 0);
                 continue;
             }
         }
     }
+    c->dirty_count = 0;
+    assert(verify_play_cache(c, cb));
 
     u16 candidate_plays = 0;
     /* x2 because the same liberties can appear repeated when adding neighbor
@@ -241,6 +466,16 @@ static move heavy_select_play(
         }
     }
 
+#if PL_LAST_GOOD_REPLY
+    if(rand_u16(128) >= pl_skip_lgr)
+    {
+        move m = last_good_reply(is_black, prev2, cb->last_played);
+        if(is_board_move(m) && (cache[m] & CACHE_PLAY_SAFE))
+            return m;
+    }
+#else
+    (void)prev2;
+#endif
 
 #if 0
     /*
@@ -313,14 +548,23 @@ static move heavy_select_play(
     if(rand_u16(128) >= pl_skip_pattern && is_board_move(cb->last_played))
     {
         /*
-        Match 3x3 patterns in 8 neighbor intersections
+        Match 3x3 patterns in 8 neighbor intersections; the larger 12-point
+        patterns take precedence where known
         */
+        const u16 * pattern_weights = pat3_weights(is_black);
+        bool use_pat12 = pat12_in_use();
         for(move k = 0; k < neighbors_3x3[cb->last_played].count; ++k)
         {
             move m = neighbors_3x3[cb->last_played].coord[k];
             if(cache[m] & CACHE_PLAY_SAFE)
             {
-                u16 w = pat3_find(cb->hash[m], is_black);
+                u16 w = pattern_weights[cb->hash[m]];
+                if(use_pat12)
+                {
+                    u16 w12 = pat12_find(PAT12_CODE(cb, m), is_black);
+                    if(w12 != 0)
+                        w = w12;
+                }
                 if(w != 0)
                 {
                     weights[candidate_plays] = w;
@@ -345,20 +589,8 @@ static move heavy_select_play(
     /*
     Play random legal play
     */
-    for(u16 k = 0; k < cb->empty.count; ++k)
-    {
-        move m = cb->empty.coord[k];
-        if(cache[m] & CACHE_PLAY_LEGAL)
-        {
-            candidate_play[candidate_plays] = m;
-            ++candidate_plays;
-        }
-    }
-    if(candidate_plays > 0)
-    {
-        u16 p = rand_u16(candidate_plays);
-        return candidate_play[p];
-    }
+    if(c->legal_count > 0)
+        return c->legal[rand_u16(c->legal_count)];
 
     /*
         Pass
@@ -367,6 +599,83 @@ static move heavy_select_play(
 }
 
 
+#if PL_ADAPTIVE_CUTOFFS
+/*
+Counts a playout of the thread that reached a tighter cutoff, and whether it
+ended with another winner than the one it had at the cutoff.
+RETURNS whether the cutoff should be tightened, once per PL_ADAPTIVE_SAMPLES
+playouts of the thread
+*/
+static bool sample_cutoff(
+    u32 * samples,
+    u32 * changed,
+    bool changed_winner
+){
+    if(changed_winner)
+        (*changed)++;
+    if(++(*samples) != PL_ADAPTIVE_SAMPLES)
+        return false;
+
+    u32 c = *changed;
+    *samples = 0;
+    *changed = 0;
+    return c * 1000 <= PL_ADAPTIVE_MAX_CHANGED * PL_ADAPTIVE_SAMPLES;
+}
+
+/*
+RETURNS the cutoff one step tighter, or 0 if at the floor
+*/
+static u16 tighter_cutoff(
+    u16 cutoff,
+    u16 original,
+    u16 floor
+){
+    u16 step = MAX(original / 8, 1);
+    return cutoff >= floor + step ? cutoff - step : 0;
+}
+
+/*
+Counts a heavy playout, that ended with black winning or not, towards
+tightening the mercy threshold and depth limit.
+*/
+static void adapt_cutoffs(
+    playout_stats * ps,
+    bool mercy_reached,
+    bool mercy_black,
+    bool depth_reached,
+    bool depth_black,
+    bool black_won
+){
+    if(mercy_reached && sample_cutoff(&ps->mercy_samples, &ps->mercy_changed,
+        mercy_black != black_won))
+    {
+        d16 t;
+        #pragma omp atomic read
+        t = mercy_threshold;
+        t = tighter_cutoff(t, MERCY_THRESHOLD, MERCY_THRESHOLD / 2);
+        if(t > 0)
+        {
+            #pragma omp atomic write
+            mercy_threshold = t;
+        }
+    }
+    if(depth_reached && sample_cutoff(&ps->depth_samples, &ps->depth_changed,
+        depth_black != black_won))
+    {
+        u16 d;
+        #pragma omp atomic read
+        d = depth_over_empty;
+        d = tighter_cutoff(d, MAX_PLAYOUT_DEPTH_OVER_EMPTY,
+            MAX_PLAYOUT_DEPTH_OVER_EMPTY / 4);
+        if(d > 0)
+        {
+            #pragma omp atomic write
+            depth_over_empty = d;
+        }
+    }
+}
+#endif
+
 /*
 Make a heavy playout and returns whether black wins.
 Does not play in own proper eyes or self-ataris except for possible throw-ins.
@@ -380,57 +689,223 @@ d16 playout_heavy_amaf(
     u8 traversed[TOTAL_BOARD_SIZ]
 ){
     assert(verify_cfg_board(cb));
-    u16 depth_max = MAX_PLAYOUT_DEPTH_OVER_EMPTY + cb->empty.count +
-    rand_u16(2);
+    d16 threshold;
+    u16 over_empty;
+    #pragma omp atomic read
+    threshold = mercy_threshold;
+    #pragma omp atomic read
+    over_empty = depth_over_empty;
+    u16 depth_max = over_empty + cb->empty.count + rand_u16(2);
     /* stones are counted as 2 units in matilda */
-    d16 diff = stone_diff(cb->p) - komi / 2;
-
-    u8 b_cache[TOTAL_BOARD_SIZ];
-    u8 w_cache[TOTAL_BOARD_SIZ];
-    memset(b_cache, CACHE_PLAY_DIRTY, TOTAL_BOARD_SIZ);
-    memset(w_cache, CACHE_PLAY_DIRTY, TOTAL_BOARD_SIZ);
-    bool stones_captured[TOTAL_BOARD_SIZ];
-    u8 libs_of_nei_of_captured[LIB_BITMAP_SIZ];
+    d16 diff = stone_diff(cb->p) - (komi + dynamic_komi) / 2;
+
+    play_cache b_cache;
+    play_cache w_cache;
+    cache_init(&b_cache, cb);
+    cache_init(&w_cache, cb);
+    move_seq stones_captured;
+    u64 libs_of_nei_of_captured[LIB_BITMAP_WORDS];
+    bool mercy = false;
+
+    u16 plays_count = 0;
+#if PL_LAST_GOOD_REPLY
+    /* the plays of the playout, for the last good replies */
+    move plays[MAX_PLAYOUT_DEPTH_OVER_EMPTY + TOTAL_BOARD_SIZ + 2];
+    bool first_is_black = is_black;
+    move first_prev = cb->last_played;
+#endif
+    move prev2 = NONE;
+    u8 end = PL_END_DEPTH;
+
+#if PL_ADAPTIVE_CUTOFFS
+    /* the cutoffs one step tighter, and the winner when they were reached */
+    d16 tighter_threshold = tighter_cutoff(threshold, MERCY_THRESHOLD,
+        MERCY_THRESHOLD / 2);
+    u16 tighter_over_empty = tighter_cutoff(over_empty,
+        MAX_PLAYOUT_DEPTH_OVER_EMPTY, MAX_PLAYOUT_DEPTH_OVER_EMPTY / 4);
+    u16 tighter_depth = tighter_over_empty == 0 ? 0 : tighter_over_empty +
+        cb->empty.count;
+    bool mercy_reached = false;
+    bool mercy_black = false;
+    bool depth_reached = false;
+    bool depth_black = false;
+#endif
 
     while(--depth_max)
     {
-        move m = heavy_select_play(cb, is_black, is_black ? b_cache : w_cache);
+#if PL_ADAPTIVE_CUTOFFS
+        if(plays_count == tighter_depth && !depth_reached)
+        {
+            depth_reached = true;
+            depth_black = score_stones_and_area2(cb) > 0;
+        }
+#endif
+        move m = heavy_select_play(cb, is_black, is_black ? &b_cache :
+            &w_cache, prev2);
         assert(verify_cfg_board(cb));
+        prev2 = cb->last_played;
 
         if(m == PASS) /* only passes when there are no more plays */
         {
             if(cb->last_played == PASS)
+            {
+                end = PL_END_PASSES;
                 break;
-            invalidate_cache_of_the_past(cb, b_cache, w_cache);
+            }
+            invalidate_cache_of_the_past(cb, &b_cache, &w_cache);
             just_pass(cb);
+#if PL_LAST_GOOD_REPLY
+            plays[plays_count] = PASS;
+#endif
+            ++plays_count;
             assert(verify_cfg_board(cb));
         }
         else
         {
             assert(is_board_move(m));
 
-            invalidate_cache_of_the_past(cb, b_cache, w_cache);
+            invalidate_cache_of_the_past(cb, &b_cache, &w_cache);
 
-            memset(stones_captured, 0, TOTAL_BOARD_SIZ);
-            memset(libs_of_nei_of_captured, 0, LIB_BITMAP_SIZ);
+            stones_captured.count = 0;
+            memset(libs_of_nei_of_captured, 0,
+                sizeof(libs_of_nei_of_captured));
 
-            just_play3(cb, is_black, m, &diff, stones_captured,
+            just_play3(cb, is_black, m, &diff, &stones_captured,
                 libs_of_nei_of_captured);
 
             assert(verify_cfg_board(cb));
             if(traversed[m] == EMPTY)
                 traversed[m] = is_black ? BLACK_STONE : WHITE_STONE;
-            if(abs(diff) > MERCY_THRESHOLD)
-                return diff;
-            invalidate_cache_after_play(cb, b_cache, w_cache, stones_captured,
-                libs_of_nei_of_captured);
+#if PL_LAST_GOOD_REPLY
+            plays[plays_count] = m;
+#endif
+            ++plays_count;
+#if PL_ADAPTIVE_CUTOFFS
+            if(tighter_threshold > 0 && !mercy_reached && abs(diff) >
+                tighter_threshold)
+            {
+                mercy_reached = true;
+                mercy_black = diff > 0;
+            }
+#endif
+            if(abs(diff) > threshold)
+            {
+                mercy = true;
+                end = PL_END_MERCY;
+                break;
+            }
+            invalidate_cache_after_play(cb, &b_cache, &w_cache,
+                &stones_captured, libs_of_nei_of_captured);
             assert(verify_cfg_board(cb));
         }
 
         is_black = !is_black;
     }
 
-    return score_stones_and_area(cb->p);
+    d16 score = mercy ? diff * 2 : score_stones_and_area2(cb);
+
+    playout_stats * ps = thread_state(&playout_stats_of_threads);
+    ps->ends[end]++;
+    ps->lengths[plays_count / PL_LENGTH_BUCKET]++;
+#if PL_ADAPTIVE_CUTOFFS
+    adapt_cutoffs(ps, mercy_reached, mercy_black, depth_reached, depth_black,
+        score > 0);
+#endif
+
+#if PL_LAST_GOOD_REPLY
+    update_replies(first_is_black, NONE, first_prev, plays, plays_count,
+        score);
+#endif
+    return score;
+}
+
+/*
+Make a light playout and returns whether black wins.
+Plays uniformly at random, only avoiding illegal plays and playing in own eyes.
+Uses the same depth limit and mercy threshold of the heavy playouts. Also
+updates AMAF transitions information.
+RETURNS the final score
+*/
+d16 playout_light_amaf(
+    cfg_board * cb,
+    bool is_black,
+    u8 traversed[TOTAL_BOARD_SIZ]
+){
+    assert(verify_cfg_board(cb));
+    u16 depth_max = MAX_PLAYOUT_DEPTH_OVER_EMPTY + cb->empty.count +
+    rand_u16(2);
+    /* stones are counted as 2 units in matilda */
+    d16 diff = stone_diff(cb->p) - (komi + dynamic_komi) / 2;
+
+    move_seq stones_captured;
+    u64 ignored_libs[LIB_BITMAP_WORDS];
+    memset(ignored_libs, 0, sizeof(ignored_libs));
+
+    while(--depth_max)
+    {
+        move m = random_play_eyeless(cb, is_black);
+
+        if(m == PASS) /* only passes when there are no more plays */
+        {
+            if(cb->last_played == PASS)
+                break;
+            just_pass(cb);
+        }
+        else
+        {
+            stones_captured.count = 0;
+            just_play3(cb, is_black, m, &diff, &stones_captured,
+                ignored_libs);
+
+            if(traversed[m] == EMPTY)
+                traversed[m] = is_black ? BLACK_STONE : WHITE_STONE;
+            if(abs(diff) > MERCY_THRESHOLD)
+                return diff * 2;
+        }
+
+        is_black = !is_black;
+    }
+
+    return score_stones_and_area2(cb);
+}
+
+/*
+Make a playout with the policy selected, heavy or light, and returns whether
+black wins. Also updates AMAF transitions information.
+RETURNS the final score
+*/
+d16 playout_amaf(
+    cfg_board * cb,
+    bool is_black,
+    u8 traversed[TOTAL_BOARD_SIZ]
+){
+    if(pl_light_playouts)
+        return playout_light_amaf(cb, is_black, traversed);
+    return playout_heavy_amaf(cb, is_black, traversed);
+}
+
+/*
+Initializes a play status cache for the position, marking all empty positions
+as needing to be recalculated; like at the start of a playout.
+*/
+void playout_cache_init(
+    play_cache * c,
+    const cfg_board * cb
+){
+    cache_init(c, cb);
+}
+
+/*
+Selects the play of a heavy playout for the position, with a play status cache
+initialized for it by playout_cache_init.
+RETURNS the play selected, or PASS if there are no more plays
+*/
+move playout_select_play(
+    cfg_board * cb,
+    bool is_black,
+    play_cache * c
+){
+    return heavy_select_play(cb, is_black, c, NONE);
 }
 
 /*
@@ -441,14 +916,14 @@ void playout_as_strategy(
     out_board * out_b
 ){
     pat3_init();
+    pat12_init();
     cfg_board cb;
     cfg_from_board(&cb, b);
 
-    u8 ignored_cache[TOTAL_BOARD_SIZ];
-    memset(ignored_cache, CACHE_PLAY_DIRTY, TOTAL_BOARD_SIZ);
-
     /* only passes when there are no more plays */
-    move m = heavy_select_play(&cb, true, ignored_cache);
+    play_cache c;
+    playout_cache_init(&c, &cb);
+    move m = playout_select_play(&cb, true, &c);
 
     clear_out_board(out_b);
     if(m == PASS)
@@ -459,3 +934,84 @@ void playout_as_strategy(
     }
 }
 
+/*
+Forgets the last good replies of the playouts.
+*/
+void playout_clear_replies()
+{
+#if PL_LAST_GOOD_REPLY
+    memset(lgr1, 0, sizeof(lgr1));
+    memset(lgr2, 0, sizeof(lgr2));
+#endif
+}
+
+/*
+Clears the statistics of the lengths and ends of the heavy playouts, and
+restores their cutoffs; at the start of each search.
+*/
+void playout_stats_reset()
+{
+    thread_states_clear(&playout_stats_of_threads);
+    mercy_threshold = MERCY_THRESHOLD;
+    depth_over_empty = MAX_PLAYOUT_DEPTH_OVER_EMPTY;
+}
+
+/*
+RETURNS the length, in plays, below which are p percent of the count playouts
+*/
+static u16 length_percentile(
+    const u32 lengths[PL_LENGTH_BUCKETS],
+    u32 count,
+    u8 p
+){
+    u64 target = ((u64)count * p + 99) / 100;
+    u64 seen = 0;
+    for(u16 i = 0; i < PL_LENGTH_BUCKETS; ++i)
+    {
+        seen += lengths[i];
+        if(seen >= target)
+            return (i + 1) * PL_LENGTH_BUCKET;
+    }
+    return PL_LENGTH_BUCKETS * PL_LENGTH_BUCKET;
+}
+
+/*
+Produces a textual description of the heavy playouts since the statistics
+were reset: how they ended, percentiles of their lengths and their cutoffs.
+RETURNS number of characters written
+*/
+u32 playout_stats_to_string(
+    char * dst,
+    u32 siz
+){
+    u32 ends[PL_END_REASONS];
+    u32 lengths[PL_LENGTH_BUCKETS];
+    memset(ends, 0, sizeof(ends));
+    memset(lengths, 0, sizeof(lengths));
+    for(u16 t = 0; t < MAXIMUM_NUM_THREADS; ++t)
+    {
+        const playout_stats * ps = thread_state_of(&playout_stats_of_threads,
+            t);
+        if(ps == NULL)
+            continue;
+        for(u8 i = 0; i < PL_END_REASONS; ++i)
+            ends[i] += ps->ends[i];
+        for(u16 i = 0; i < PL_LENGTH_BUCKETS; ++i)
+            lengths[i] += ps->lengths[i];
+    }
+
+    u32 count = ends[PL_END_PASSES] + ends[PL_END_MERCY] + ends[PL_END_DEPTH];
+    if(count == 0)
+        return snprintf(dst, siz, "no heavy playouts");
+
+    u32 idx = snprintf(dst, siz, "heavy playouts: %u, ended by passes/mercy/d\
+epth %.1f/%.1f/%.1f%%", count, ends[PL_END_PASSES] * 100.0 / count,
+        ends[PL_END_MERCY] * 100.0 / count, ends[PL_END_DEPTH] * 100.0 /
+        count);
+    idx += snprintf(dst + idx, siz - idx, ", length p10/p50/p90 %u/%u/%u, merc\
+y threshold %d, depth limit empty+%u", length_percentile(lengths, count,
+        10), length_percentile(lengths, count, 50), length_percentile(lengths,
+        count, 90),
+        mercy_threshold, depth_over_empty);
+    return MIN(idx, siz);
+}
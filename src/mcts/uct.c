@@ -7,8 +7,14 @@ Cutoff playouts are rated. Playouts are cut short with a mercy threshold (like
 pachi, orego and others).
 Initilizes expanded states with prior values.
 Last-good-reply with forgetting (LGRF1) is also used.
-A virtual loss is also added on play traversion, that is later corrected if
-needed.
+A virtual loss, of configurable magnitude, is also added to the plays being
+traversed by other threads; it is tracked apart from the statistics and removed
+on backpropagation. Play statistics are updated without locks (see
+UCT_LOCKLESS_UPDATES); the states locks are only used for expansion.
+The time spent in each phase of the simulations can be measured (see
+MCTS_SEARCH_STATS).
+Several playouts can be made from each leaf and backpropagated at once (see
+UCT_LEAF_PLAYOUTS).
 
 MCTS can be resumed on demand by a few extra simulations at a time.
 It can also record the average final score, for the purpose of score estimation.
@@ -29,8 +35,12 @@ It can also record the average final score, for the purpose of score estimation.
 #include "cfg_board.h"
 #include "constants.h"
 #include "flog.h"
+#include "game_record.h"
+#include "latency.h"
+#include "matrix.h"
 #include "mcts.h"
 #include "move.h"
+#include "pat12.h"
 #include "pat3.h"
 #include "playout.h"
 #include "priors.h"
@@ -40,17 +50,31 @@ It can also record the average final score, for the purpose of score estimation.
 #include "state_changes.h"
 #include "stringm.h"
 #include "timem.h"
+#include "thread_state.h"
 #include "transpositions.h"
 #include "types.h"
 #include "zobrist.h"
 
+#if UCT_SIMD_SELECTION && USE_AMAF_RAVE && defined(__AVX2__)
+#define SIMD_SELECTION 1
+#include <immintrin.h>
+#else
+#define SIMD_SELECTION 0
+#endif
+
 /* from board_constants */
 extern u8 distances_to_border[TOTAL_BOARD_SIZ];
 extern move_seq nei_dst_3[TOTAL_BOARD_SIZ];
+extern move_seq neighbors_side[TOTAL_BOARD_SIZ];
+
+/* from amaf_rave */
+extern double rave_equiv;
+extern d16 komi;
+extern d16 dynamic_komi;
+extern u16 expansion_delay;
 
 static bool ran_out_of_memory;
 static bool search_stop;
-static u16 max_depths[MAXIMUM_NUM_THREADS];
 
 /*
 Whether a MCTS can be started on background. Is disabled if memory runs out, and
@@ -58,7 +82,197 @@ needs to be reset before testing again if can be run.
 */
 static bool mcts_can_resume = true;
 
+#if MCTS_SEARCH_STATS
+/*
+Phases of a simulation, for the statistics of the search.
+*/
+#define PHASE_SELECTION 0
+#define PHASE_LOOKUP 1
+#define PHASE_EXPANSION 2
+#define PHASE_PLAYOUT 3
+#define PHASE_BACKPROP 4
+#define SEARCH_PHASES 5
+
+static const char * phase_names[SEARCH_PHASES] =
+{
+    "selection",
+    "lookup",
+    "expansion",
+    "playout",
+    "backpropagation"
+};
+
+/*
+Statistics of the simulations of each thread, kept in the state of the thread so
+they are updated without synchronization.
+*/
+typedef struct __search_thread_stats_ {
+    u64 phase_ns[SEARCH_PHASES];
+    u64 phase_start;
+    u32 expansions;
+    u32 out_of_memory; /* simulations that found no memory for a new state */
+} search_thread_stats;
+
+/* statistics of the calling thread, set when it joins a search */
+static search_thread_stats * own_stats;
+#pragma omp threadprivate(own_stats)
+
+/*
+Statistics of the last timed search, summed over all threads.
+*/
+static bool last_search_valid = false;
+static u64 last_search_ns[SEARCH_PHASES];
+static u64 last_search_elapsed; /* in milliseconds */
+static u32 last_search_simulations;
+static u32 last_search_expansions;
+static u32 last_search_out_of_memory;
+static u32 last_search_prunings;
+static tt_lookup_stats last_search_lookups;
+
+#define START_PHASES() (own_stats->phase_start = current_time_in_nanos())
+#define END_PHASE(P) end_phase(P)
+#define COUNT_EVENT(F) (own_stats->F++)
+#else
+#define START_PHASES() ((void)0)
+#define END_PHASE(P) ((void)0)
+#define COUNT_EVENT(F) ((void)0)
+#endif
+
+
+
+/*
+Magnitude of the virtual loss, in lost simulations per thread traversing a play.
+*/
+double virtual_loss = UCT_VIRTUAL_LOSS;
+
+/*
+Number of playouts made from each leaf of the tree.
+*/
+u16 leaf_playouts = UCT_LEAF_PLAYOUTS;
+
+/*
+Progressive widening: plays considered right away, and visits of a state for
+the first play more and growth of the visits for each of the following.
+*/
+u16 widening_min_plays = UCT_WIDENING_MIN_PLAYS;
+u16 widening_base = UCT_WIDENING_BASE;
+double widening_growth = UCT_WIDENING_GROWTH;
+
+#if UCT_PROGRESSIVE_WIDENING
+/* visits of a state needed to consider more than each number of its plays */
+static u32 widening_visits[MAX_PLAYS_COUNT + 1];
+#endif
+
+/*
+Results of the playouts made from a leaf, merged to be backpropagated at once;
+draws count as losses for both colors. Arrays are indexed by color (true for
+black) and point. For each point: the playouts where it was first played by
+each color and how many of those that color won, with the points first played
+by each color also marked in bitmaps; and the decisive playouts that ended with
+it owned by each color and how many of those its owner won; and, in area, the
+playouts that ended with it as area of black, as a stone or eye, minus the ones
+as area of white. The final scores, doubled and from the perspective of black,
+are summed.
+*/
+typedef struct __leaf_results_ {
+    u16 playouts;
+    u16 wins[2];
+    d32 score;
+    u64 first_set[2][LIB_BITMAP_WORDS];
+    u16 first_n[2][TOTAL_BOARD_SIZ];
+    u16 first_wins[2][TOTAL_BOARD_SIZ];
+    u16 owned[2][TOTAL_BOARD_SIZ];
+    u16 owner_wins[TOTAL_BOARD_SIZ];
+    d16 area[TOTAL_BOARD_SIZ];
+} leaf_results;
+
+/*
+State of each thread in the searches: the deepest descent made since the last
+reset and the ownership of the points in the final positions of the playouts of
+the searches of the last position searched; the playouts that ended with each
+point as area of black minus the ones as area of white.
+*/
+typedef struct __search_thread_ {
+    u16 max_depth;
+    u32 ownership_playouts;
+    d32 ownership[TOTAL_BOARD_SIZ];
+#if MCTS_SEARCH_STATS
+    search_thread_stats stats;
+#endif
+} search_thread;
+
+static thread_states search_threads = THREAD_STATES(search_thread);
+
+/* position of the ownership kept */
+static u8 ownership_p[TOTAL_BOARD_SIZ];
+
+static bool deterministic = false;
+static u32 deterministic_seed;
+
+/*
+Periodic analysis reports of the timed and resumed searches, in the lz-analyze
+format: up to ANALYSIS_MAX_PLAYS of the most visited plays of the root, with
+their principal variations of up to ANALYSIS_PV_DEPTH plays.
+*/
+#define ANALYSIS_MAX_PLAYS 10
+#define ANALYSIS_PV_DEPTH 12
+
+/*
+Positions of the game played until the position searched, for superko
+detection; only used while the position searched is the last of the game.
+*/
+static const game_record * game_history = NULL;
+static const game_record * search_history = NULL;
+
+static bool dynamic_komi_enabled = false;
+
+static u32 analysis_interval = 0; /* in milliseconds */
+static void (* analysis_report)(const char *) = NULL;
+
+static u32 exchange_interval = 0; /* in milliseconds */
+static bool (* root_exchange)(const root_stats *, root_stats *, bool) = NULL;
 
+#if UCT_PONDER_REPLIES > 0
+/*
+Replies followed from the root while pondering, as indexes of its plays, with
+their shares of the simulations and their visits when the pondering started;
+none if not pondering.
+*/
+static move ponder_replies_count = 0;
+static move ponder_replies[UCT_PONDER_REPLIES];
+static double ponder_shares[UCT_PONDER_REPLIES];
+static u32 ponder_start_n[UCT_PONDER_REPLIES];
+#endif
+
+/*
+Last position pondered, and the visits added by pondering to each of its plays,
+by move with the pass last.
+*/
+static bool pondered_valid = false;
+static board pondered_board;
+static bool pondered_is_black;
+static u32 pondered_visits[TOTAL_BOARD_SIZ + 1];
+
+#if UCT_DEFERRED_PRIORS
+static bool batched_priors = false;
+
+typedef struct __prior_request_ {
+    tt_stats * stats;
+    cfg_board cb;
+    bool is_black;
+    deferred_priors dp;
+} prior_request;
+
+typedef struct __prior_batch_ {
+    prior_request requests[UCT_PRIOR_BATCH_SIZE];
+    u16 count;
+    bool busy; /* being computed */
+} prior_batch;
+
+static prior_batch prior_batches[2];
+static u8 filling_batch = 0;
+static omp_lock_t prior_batches_lock;
+#endif
 
 static bool uct_inited = false;
 /*
@@ -73,251 +287,2054 @@ void mcts_init()
     board_constants_init();
     zobrist_init();
     pat3_init();
+    pat12_init();
     tt_init();
     load_starting_points();
+#if UCT_DEFERRED_PRIORS
+    omp_init_lock(&prior_batches_lock);
+#endif
+#if UCT_PROGRESSIVE_WIDENING
+    double visits = widening_base;
+    for(move w = 0; w <= MAX_PLAYS_COUNT; ++w)
+        if(w < MAX(widening_min_plays, 1))
+            widening_visits[w] = 0;
+        else
+        {
+            widening_visits[w] = visits < UINT32_MAX ? (u32)visits :
+                UINT32_MAX;
+            visits *= widening_growth;
+        }
+#endif
 
     uct_inited = true;
 }
 
 
 
-static void select_play(
-    tt_stats * stats,
-    tt_play ** play
+#if MCTS_SEARCH_STATS
+/*
+Adds the time since the end of the previous phase, of the current simulation of
+the calling thread, to the phase.
+*/
+static void end_phase(
+    u8 phase
+){
+    u64 now = current_time_in_nanos();
+    own_stats->phase_ns[phase] += now - own_stats->phase_start;
+    own_stats->phase_start = now;
+}
+#endif
+
+#if SIMD_SELECTION
+/*
+Quality of a play for selection in single precision, lowered by its virtual
+losses; by the same operations, in the same order, as the batches of
+play_selection_values so equal statistics have the same quality.
+RETURNS quality of play of index k
+*/
+static float play_selection_value(
+    const tt_stats * stats,
+    move k,
+    float inv_equiv,
+    float vl
 ){
-    if(*play != NULL && (*play)->lgrf1_reply != NULL)
+    float n = stats->mc_n[k];
+    float v;
+#if CRITICALITY_THRESHOLD > 0
+    if(stats->mc_n[k] >= CRITICALITY_THRESHOLD)
+        v = uct1_rave(stats, k);
+    else
+#endif
     {
-        *play = (*play)->lgrf1_reply;
-        return;
+        float q = stats->mc_q[k];
+        float an = stats->amaf_n[k];
+        float b = an / (n + an + n * an * inv_equiv);
+        v = q + b * (stats->amaf_q[k] - q);
+    }
+
+    if(stats->vl_n[k] > 0 && vl > 0.0f)
+        v = (v * n) / (n + stats->vl_n[k] * vl);
+    return v;
+}
+
+/*
+Computes the qualities of all the plays of a state for selection, lowered by
+their virtual losses, 8 plays at a time. Plays with enough visits for
+criticality, and the plays left over, are computed by play_selection_value.
+*/
+static void play_selection_values(
+    const tt_stats * stats,
+    float values[MAX_PLAYS_COUNT]
+){
+    float inv_equiv = 1.0 / rave_equiv;
+    float vl = virtual_loss;
+    __m256 inv_equiv8 = _mm256_set1_ps(inv_equiv);
+    __m256 vl8 = _mm256_set1_ps(vl);
+    __m256 zero8 = _mm256_setzero_ps();
+#if CRITICALITY_THRESHOLD > 0
+    __m256 crit8 = _mm256_set1_ps(CRITICALITY_THRESHOLD);
+#endif
+
+    move k = 0;
+    for(; k + 8 <= stats->plays_count; k += 8)
+    {
+        __m256 n = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)
+            (stats->mc_n + k)));
+        __m256 q = _mm256_loadu_ps(stats->mc_q + k);
+        __m256 an = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)
+            (stats->amaf_n + k)));
+        __m256 aq = _mm256_loadu_ps(stats->amaf_q + k);
+
+        /* RAVE minimum MSE schedule */
+        __m256 den = _mm256_add_ps(_mm256_add_ps(n, an),
+            _mm256_mul_ps(_mm256_mul_ps(n, an), inv_equiv8));
+        __m256 b = _mm256_div_ps(an, den);
+        __m256 v = _mm256_add_ps(q, _mm256_mul_ps(b, _mm256_sub_ps(aq, q)));
+
+        /* virtual losses */
+        if(vl > 0.0f)
+        {
+            __m256 vl_n = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(
+                _mm_loadu_si128((const __m128i *)(stats->vl_n + k))));
+            __m256 lowered = _mm256_div_ps(_mm256_mul_ps(v, n),
+                _mm256_add_ps(n, _mm256_mul_ps(vl_n, vl8)));
+            v = _mm256_blendv_ps(v, lowered, _mm256_cmp_ps(vl_n, zero8,
+                _CMP_GT_OQ));
+        }
+
+        _mm256_storeu_ps(values + k, v);
+
+#if CRITICALITY_THRESHOLD > 0
+        int critical = _mm256_movemask_ps(_mm256_cmp_ps(n, crit8,
+            _CMP_GE_OQ));
+        for(move i = 0; critical != 0; ++i, critical >>= 1)
+            if(critical & 1)
+                values[k + i] = play_selection_value(stats, k + i, inv_equiv,
+                    vl);
+#endif
+    }
+
+    for(; k < stats->plays_count; ++k)
+        values[k] = play_selection_value(stats, k, inv_equiv, vl);
+}
+#endif
+
+/*
+Selects the play to follow from a state, preferring the last good reply to the
+play that led to it, if any and not being traversed by other threads. Plays
+being traversed have their quality lowered by their virtual losses. Proven won
+plays are always selected, and proven lost ones never, unless all are.
+RETURNS index of the play selected
+*/
+static move select_uct_play(
+    const tt_stats * stats,
+    const tt_play * last_play
+){
+#if UCT_SOLVER
+    bool proven_plays = stats->proven_plays && stats->proven != PROVEN_LOSS;
+#else
+    bool proven_plays = false;
+#endif
+
+    if(last_play != NULL && last_play->lgrf1_reply != NULL)
+    {
+        move k = last_play->lgrf1_reply - stats->plays;
+        if(stats->vl_n[k] == 0 && !(proven_plays && stats->plays[k].proven ==
+            PROVEN_LOSS))
+            return k;
     }
 
-    tt_play * best_plays[TOTAL_BOARD_SIZ];
+    move best_plays[TOTAL_BOARD_SIZ];
     double best_q = -1.0;
     u16 equal_quality_plays = 0;
 
-    for(move k = 0; k < stats->plays_count; ++k)
+    /* the plays considered, the first of plays_by_prior if widened */
+    move considered = stats->plays_count;
+#if UCT_PROGRESSIVE_WIDENING
+    move widened = stats->widened;
+    if(widened > 0)
+        considered = widened;
+#endif
+    bool ranked = considered < stats->plays_count;
+
+#if SIMD_SELECTION
+    float values[MAX_PLAYS_COUNT];
+    float inv_equiv = 1.0 / rave_equiv;
+    float vl = virtual_loss;
+    if(!ranked)
+        play_selection_values(stats, values);
+#endif
+
+    for(move i = 0; i < considered; ++i)
     {
+        move k = ranked ? stats->plays_by_prior[i] : i;
+        if(proven_plays)
+        {
+            u8 proven = stats->plays[k].proven;
+            if(proven == PROVEN_WIN)
+                return k;
+            if(proven == PROVEN_LOSS)
+                continue;
+        }
+#if SIMD_SELECTION
+        double uct_q = ranked ? play_selection_value(stats, k, inv_equiv, vl) :
+            values[k];
+#else
 #if USE_AMAF_RAVE
-        double play_q = uct1_rave(&stats->plays[k]);
+        double play_q = uct1_rave(stats, k);
 #else
-        double play_q = stats->plays[k].mc_q;
+        double play_q = stats->mc_q[k];
 #endif
 
         double uct_q = play_q;
+        u16 vl_n = stats->vl_n[k];
+        if(vl_n > 0 && virtual_loss > 0.0)
+        {
+            double n = stats->mc_n[k];
+            uct_q = (uct_q * n) / (n + vl_n * virtual_loss);
+        }
+#endif
         if(uct_q > best_q){
-            best_plays[0] = &stats->plays[k];
+            best_plays[0] = k;
             equal_quality_plays = 1;
             best_q = uct_q;
         }
         else
             if(uct_q == best_q)
             {
-                best_plays[equal_quality_plays] = &stats->plays[k];
+                best_plays[equal_quality_plays] = k;
                 ++equal_quality_plays;
             }
     }
 
     if(equal_quality_plays == 1)
-    {
-        *play = best_plays[0];
-        return;
-    }
+        return best_plays[0];
 
     if(equal_quality_plays > 1)
     {
         u16 p = rand_u16(equal_quality_plays);
-        *play = best_plays[p];
-        return;
+        return best_plays[p];
     }
 
+    /* all plays considered are proven lost */
+    if(proven_plays)
+        return ranked ? stats->plays_by_prior[considered] : stats->plays_count -
+            1;
+
     flog_crit("mcts", "play selection exception");
+    return 0;
 }
 
-static d16 mcts_expansion(
-    cfg_board * cb,
-    bool is_black,
-    tt_stats * stats,
-    u8 traversed[TOTAL_BOARD_SIZ]
+#if UCT_PONDER_REPLIES > 0
+/*
+Selects the reply to follow from the root while pondering: the one furthest
+behind its share of the simulations, of those not proven lost.
+RETURNS index of the play selected, or -1 if none
+*/
+static d16 select_ponder_reply(
+    const tt_stats * stats
 ){
-    stats->expansion_delay--;
-    if(stats->expansion_delay == -1)
-        init_new_state(stats, cb, is_black);
-    omp_unset_lock(&stats->lock);
-    d16 outcome = playout_heavy_amaf(cb, is_black, traversed);
+    d16 best = -1;
+    double best_behind = 0.0;
+    for(move i = 0; i < ponder_replies_count; ++i)
+    {
+        move k = ponder_replies[i];
+#if UCT_SOLVER
+        if(stats->plays[k].proven == PROVEN_LOSS)
+            continue;
+#endif
+        double behind = ((double)stats->mc_n[k] + stats->vl_n[k] -
+            ponder_start_n[i]) / ponder_shares[i];
+        if(best == -1 || behind < best_behind)
+        {
+            best = k;
+            best_behind = behind;
+        }
+    }
+    return best;
+}
+#endif
+
+/*
+Sets and unsets the lock of a state for updating its play statistics, unless
+they are updated without locks.
+*/
+#if UCT_LOCKLESS_UPDATES
+#define LOCK_FOR_UPDATE(S) ((void)(S))
+#define UNLOCK_FOR_UPDATE(S) ((void)(S))
+#else
+#define LOCK_FOR_UPDATE(S) omp_set_lock(&(S)->lock)
+#define UNLOCK_FOR_UPDATE(S) omp_unset_lock(&(S)->lock)
+#endif
+
+/*
+Sets and unsets the lock of a state for widening its plays, unless already set
+for updating its play statistics.
+*/
+#if UCT_LOCKLESS_UPDATES
+#define LOCK_FOR_WIDENING(S) omp_set_lock(&(S)->lock)
+#define UNLOCK_FOR_WIDENING(S) omp_unset_lock(&(S)->lock)
+#else
+#define LOCK_FOR_WIDENING(S) ((void)(S))
+#define UNLOCK_FOR_WIDENING(S) ((void)(S))
+#endif
 
-    return outcome;
+#if UCT_PROGRESSIVE_WIDENING
+/*
+Considers for selection as many plays of a state as its visits allow; each the
+play of best MC quality, mostly its prior, of those not considered yet. Expects
+the lock of the state to be set.
+*/
+static void widen_plays(
+    tt_stats * stats
+){
+    move * order = stats->plays_by_prior;
+    move w = stats->widened;
+    while(w < stats->plays_count && stats->visits >= widening_visits[w])
+    {
+        move best = w;
+        for(move i = w + 1; i < stats->plays_count; ++i)
+            if(stats->mc_q[order[i]] > stats->mc_q[order[best]])
+                best = i;
+
+        move k = order[best];
+        order[best] = order[w];
+        order[w] = k;
+        ++w;
+    }
+    /* the plays must be ranked before they are seen as considered */
+    #pragma omp flush
+    stats->widened = w;
 }
 
-static d16 mcts_selection(
-    cfg_board * cb,
-    u64 zobrist_hash,
-    bool is_black
+/*
+RETURNS whether a state already widened has the visits to consider more plays
+*/
+static bool needs_widening(
+    const tt_stats * stats
 ){
+    move w = stats->widened;
+    return w > 0 && w < stats->plays_count && stats->visits >=
+        widening_visits[w];
+}
+#endif
 
-    d16 depth = 6;
-    tt_stats * stats[MAX_UCT_DEPTH + 6];
-    tt_play * plays[MAX_UCT_DEPTH + 7];
-    /* for testing superko */
-    stats[0] = stats[1] = stats[2] = stats[3] = stats[4] = stats[5] = NULL;
+/*
+Marks a play as being traversed, until the simulation result is backpropagated;
+so other threads are discouraged from following it (virtual loss).
+*/
+static void add_virtual_loss(
+    tt_stats * stats,
+    move k
+){
+#if UCT_LOCKLESS_UPDATES
+    #pragma omp atomic
+#endif
+    stats->vl_n[k]++;
+}
 
-    u8 traversed[TOTAL_BOARD_SIZ];
-    memset(traversed, EMPTY, TOTAL_BOARD_SIZ);
+/*
+Removes the virtual loss of a play and updates its MC statistics with the
+results of dn simulations, of which dw were won.
+*/
+static void add_results(
+    tt_stats * stats,
+    move k,
+    u16 dw,
+    u16 dn
+){
+#if UCT_LOCKLESS_UPDATES
+    u32 n;
+    #pragma omp atomic capture
+    n = stats->mc_n[k] += dn;
+    float inc = (dw - stats->mc_q[k] * dn) / n;
+    #pragma omp atomic
+    stats->mc_q[k] += inc;
+    #pragma omp atomic
+    stats->vl_n[k]--;
+#else
+    stats->mc_n[k] += dn;
+    stats->mc_q[k] += (dw - stats->mc_q[k] * dn) / stats->mc_n[k];
+    stats->vl_n[k]--;
+#endif
+}
 
-    d16 outcome;
-    tt_stats * curr_stats = NULL;
-    tt_play * play = NULL;
+#if UCT_PROGRESSIVE_WIDENING || UCT_TRANSPOSITION_BACKUP
+/*
+Adds the results of dn simulations through a state, of which dw were won, to
+its statistics.
+*/
+static void add_visits(
+    tt_stats * stats,
+    float dw,
+    u32 dn
+){
+#if UCT_LOCKLESS_UPDATES
+    #pragma omp atomic
+    stats->visits += dn;
+    #pragma omp atomic
+    stats->wins += dw;
+#else
+    stats->visits += dn;
+    stats->wins += dw;
+#endif
+}
+#endif
 
-    while(1)
-    {
-        if(depth >= MAX_UCT_DEPTH + 6)
-        {
-            outcome = score_stones_and_area(cb->p);
-            break;
-        }
+#if UCT_TRANSPOSITION_BACKUP
+/*
+Derives the MC quality of the plays of a state considered for selection, that
+lead to states visited more often than the play itself, from the mean result of
+all the simulations through those states.
+*/
+static void backup_transpositions(
+    tt_stats * stats
+){
+    move considered = stats->plays_count;
+#if UCT_PROGRESSIVE_WIDENING
+    move widened = stats->widened;
+    if(widened > 0)
+        considered = widened;
+#endif
+    bool ranked = considered < stats->plays_count;
 
-        if(curr_stats == NULL)
-        {
-            curr_stats = tt_lookup_null(cb, is_black, zobrist_hash);
+    for(move i = 0; i < considered; ++i)
+    {
+        move k = ranked ? stats->plays_by_prior[i] : i;
+        const tt_stats * next_stats = stats->plays[k].next_stats;
+        if(next_stats == NULL)
+            continue;
 
-            if(curr_stats == NULL)
-            {
-                if(!ran_out_of_memory)
-                {
-                    ran_out_of_memory = true;
-                    search_stop = true;
-                }
-                outcome = playout_heavy_amaf(cb, is_black, traversed);
-                break;
-            }
-            else
-            {
-                if(play != NULL)
-                    play->next_stats = curr_stats;
-            }
-        }
-        else
-            omp_set_lock(&curr_stats->lock);
+        u32 visits;
+        float wins;
+        #pragma omp atomic read
+        visits = next_stats->visits;
+        if(visits <= stats->mc_n[k])
+            continue;
+        #pragma omp atomic read
+        wins = next_stats->wins;
 
-        /* Positional superko detection */
-        if(is_board_move(cb->last_played) &&
-            (stats[depth - 2] == curr_stats ||
-            stats[depth - 3] == curr_stats ||
-            stats[depth - 4] == curr_stats ||
-            stats[depth - 5] == curr_stats ||
-            stats[depth - 6] == curr_stats))
-        {
-            omp_unset_lock(&curr_stats->lock);
-            /* loss for player that committed superko */
-            outcome = is_black ? 1 : -1;
-            break;
-        }
+#if UCT_LOCKLESS_UPDATES
+        #pragma omp atomic write
+#endif
+        stats->mc_q[k] = 1.0f - wins / visits;
+    }
+}
+#endif
 
-        if(curr_stats->expansion_delay >= 0)
-        {
-            /* already unsets lock */
-            outcome = mcts_expansion(cb, is_black, curr_stats, traversed);
-            break;
-        }
+/*
+Lowers the expansion delay of a state not expanded yet, at distance plays from
+the root, and child of parent or NULL if the root; which is locked.
+*/
+static void lower_expansion_delay(
+    tt_stats * stats,
+    u16 distance,
+    const tt_stats * parent
+){
+    if(stats->expansion_delay <= 0)
+        return;
 
-        select_play(curr_stats, &play);
+    if(distance <= UCT_EXPANSION_ROOT_DEPTH)
+        stats->expansion_delay = 0;
+#if UCT_PROGRESSIVE_WIDENING || UCT_TRANSPOSITION_BACKUP
+    else if(parent != NULL && parent->visits >= UCT_EXPANSION_HOT_VISITS)
+        stats->expansion_delay = MIN(stats->expansion_delay,
+            expansion_delay / 2);
+#else
+    (void)parent;
+#endif
+}
 
-        play->mc_n++;
-        play->mc_q -= play->mc_q / play->mc_n;
-        omp_unset_lock(&curr_stats->lock);
+#if UCT_PREFETCH
+/*
+Starts loading the header of a state into the cache.
+*/
+static void prefetch_state(
+    const tt_stats * stats
+){
+    for(u16 i = 0; i < sizeof(tt_stats); i += 64)
+        __builtin_prefetch(((const char *)stats) + i);
+}
 
-        if(play->m == PASS)
-        {
-            if(cb->last_played == PASS)
-            {
-                outcome = score_stones_and_area(cb->p);
-                break;
-            }
-            just_pass(cb);
-        }
-        else
-        {
-            just_play2(cb, is_black, play->m, &zobrist_hash);
-        }
+/*
+Starts loading the statistics read on play selection of a state into the cache;
+the first lines of each array, the rest usually following by the hardware
+prefetcher.
+*/
+static void prefetch_plays(
+    const tt_stats * stats
+){
+    if(stats->plays_count == 0)
+        return;
+    __builtin_prefetch(stats->mc_n);
+    __builtin_prefetch(stats->mc_q);
+    __builtin_prefetch(stats->amaf_n);
+    __builtin_prefetch(stats->amaf_q);
+    __builtin_prefetch(stats->vl_n);
+}
+#endif
 
-        plays[depth] = play;
+#if UCT_SOLVER
+/*
+Proves a state won if its play of index k is proven won, or lost if all of its
+plays are proven lost and no legal play was left out of them.
+*/
+static void update_proven(
+    tt_stats * stats,
+    move k
+){
+    stats->proven_plays = true;
+    if(stats->plays[k].proven == PROVEN_WIN)
+    {
+        stats->proven = PROVEN_WIN;
+        return;
+    }
+
+    if(!stats->plays_complete)
+        return;
+    for(move i = 0; i < stats->plays_count; ++i)
+        if(stats->plays[i].proven != PROVEN_LOSS)
+            return;
+    stats->proven = PROVEN_LOSS;
+}
+#endif
+
+/*
+RETURNS the value of the play of index k of the root for the out board: its
+quality, or 1 or 0 if proven won or lost, unless all plays are lost
+*/
+static double root_play_value(
+    const tt_stats * stats,
+    move k,
+    double quality
+){
+#if UCT_SOLVER
+    if(stats->proven != PROVEN_LOSS)
+    {
+        if(stats->plays[k].proven == PROVEN_WIN)
+            return 1.0;
+        if(stats->plays[k].proven == PROVEN_LOSS)
+            return 0.0;
+    }
+#else
+    (void)stats;
+    (void)k;
+#endif
+    return quality;
+}
+
+/*
+Fills the out board with the values of the plays of the root, reverted from the
+reduction it is stored in. If the root is widened only the plays considered for
+selection are marked tested, so plays never searched are not chosen by their
+prior and AMAF statistics alone.
+*/
+static void root_to_out_board(
+    out_board * out_b,
+    const tt_stats * stats,
+    d8 reduction
+){
+    clear_out_board(out_b);
+    out_b->pass = UCT_RESIGN_WINRATE;
+
+    move considered = stats->plays_count;
+#if UCT_PROGRESSIVE_WIDENING
+    if(stats->widened > 0)
+        considered = stats->widened;
+#endif
+    bool ranked = considered < stats->plays_count;
+
+    for(move i = 0; i < considered; ++i)
+    {
+        move k = ranked ? stats->plays_by_prior[i] : i;
+        move m = tt_revert_move(stats->plays[k].m, reduction);
+        if(m == PASS)
+        {
+            out_b->pass = root_play_value(stats, k, stats->mc_q[k]);
+        }
+        else
+        {
+            out_b->tested[m] = true;
+#if USE_AMAF_RAVE
+            out_b->value[m] = root_play_value(stats, k, uct1_rave(stats, k));
+#else
+            out_b->value[m] = root_play_value(stats, k, stats->mc_q[k]);
+#endif
+        }
+    }
+}
+
+/*
+Adds the result of a simulation to the results of a leaf, as if it happened
+times times. The final board is p and the points played in the playout are
+marked in traversed, or traversed is NULL if there was no playout.
+*/
+static void add_leaf_result(
+    leaf_results * r,
+    const u8 p[TOTAL_BOARD_SIZ],
+    const u8 traversed[TOTAL_BOARD_SIZ],
+    d16 outcome,
+    u16 times
+){
+    r->playouts += times;
+    r->score += ((d32)outcome) * times;
+    bool black_won = outcome > 0;
+    if(outcome != 0)
+        r->wins[black_won] += times;
+
+    if(traversed != NULL)
+        for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+            if(traversed[m] != EMPTY)
+            {
+                bool b = traversed[m] == BLACK_STONE;
+                r->first_set[b][m / 64] |= LIB_BIT(m);
+                r->first_n[b][m] += times;
+                if(outcome != 0 && b == black_won)
+                    r->first_wins[b][m] += times;
+            }
+
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+    {
+        u8 owner = p[m];
+        if(owner == EMPTY)
+        {
+            /* eye of a single color */
+            owner = p[neighbors_side[m].coord[0]];
+            for(u8 k = 1; k < neighbors_side[m].count; ++k)
+                if(p[neighbors_side[m].coord[k]] != owner)
+                {
+                    owner = EMPTY;
+                    break;
+                }
+            if(owner != EMPTY)
+                r->area[m] += owner == BLACK_STONE ? times : -times;
+            continue;
+        }
+
+        bool b = owner == BLACK_STONE;
+        r->area[m] += b ? times : -times;
+        if(outcome != 0)
+        {
+            r->owned[b][m] += times;
+            if(b == black_won)
+                r->owner_wins[m] += times;
+        }
+    }
+}
+
+/*
+Makes the playouts of a leaf, all but the last from copies of the leaf board,
+and adds their results.
+*/
+static void leaf_playouts_amaf(
+    cfg_board * cb,
+    bool is_black,
+    u16 playouts,
+    leaf_results * r
+){
+    u8 traversed[TOTAL_BOARD_SIZ];
+
+    for(u16 i = 1; i < playouts; ++i)
+    {
+        cfg_board tmp;
+        cfg_board_clone(&tmp, cb);
+        memset(traversed, EMPTY, TOTAL_BOARD_SIZ);
+        d16 outcome = playout_amaf(&tmp, is_black, traversed);
+        add_leaf_result(r, tmp.p, traversed, outcome, 1);
+        cfg_board_free(&tmp);
+    }
+
+    memset(traversed, EMPTY, TOTAL_BOARD_SIZ);
+    d16 outcome = playout_amaf(cb, is_black, traversed);
+    add_leaf_result(r, cb->p, traversed, outcome, 1);
+}
+
+#if UCT_DEFERRED_PRIORS
+/*
+Adds the priors computed after the state was expanded to its plays, that may
+already be being updated by other threads.
+*/
+static void add_deferred_priors(
+    tt_stats * stats,
+    const tt_prior deltas[MAX_PLAYS_COUNT]
+){
+    LOCK_FOR_UPDATE(stats);
+    for(move k = 0; k < stats->plays_count; ++k)
+    {
+        u32 dn = deltas[k].mc_n;
+        if(dn == 0)
+            continue;
+
+        float dw = deltas[k].mc_q;
+        u32 n;
+#if UCT_LOCKLESS_UPDATES
+        #pragma omp atomic capture
+#endif
+        n = stats->mc_n[k] += dn;
+        stats->mc_q[k] += (dw - stats->mc_q[k] * dn) / n;
+#if UCT_LOCKLESS_UPDATES
+        #pragma omp atomic capture
+#endif
+        n = stats->amaf_n[k] += dn;
+        stats->amaf_q[k] += (dw - stats->amaf_q[k] * dn) / n;
+    }
+#if UCT_PROGRESSIVE_WIDENING
+    LOCK_FOR_WIDENING(stats);
+    widen_plays(stats);
+    UNLOCK_FOR_WIDENING(stats);
+#endif
+    UNLOCK_FOR_UPDATE(stats);
+}
+
+static void compute_and_add_priors(
+    tt_stats * stats,
+    cfg_board * cb,
+    bool is_black,
+    const deferred_priors * dp
+){
+    tt_prior deltas[MAX_PLAYS_COUNT];
+    compute_deferred_priors(stats, cb, is_black, dp, deltas);
+    add_deferred_priors(stats, deltas);
+}
+
+/*
+Computes the priors of all states of a batch, adds them to the states and
+empties the batch.
+*/
+static void compute_prior_batch(
+    prior_batch * b
+){
+    for(u16 i = 0; i < b->count; ++i)
+    {
+        prior_request * r = &b->requests[i];
+        compute_and_add_priors(r->stats, &r->cb, r->is_black, &r->dp);
+        cfg_board_free(&r->cb);
+    }
+    b->count = 0;
+}
+
+/*
+Queues the computation of the priors of a state just expanded. If the batch is
+completed it is computed by the calling thread, while the other threads start
+filling the other batch. If that one is still being computed the priors are
+computed right away instead.
+*/
+static void queue_deferred_priors(
+    tt_stats * stats,
+    cfg_board * cb,
+    bool is_black,
+    const deferred_priors * dp
+){
+    omp_set_lock(&prior_batches_lock);
+    prior_batch * b = &prior_batches[filling_batch];
+    if(b->busy)
+    {
+        omp_unset_lock(&prior_batches_lock);
+        compute_and_add_priors(stats, cb, is_black, dp);
+        return;
+    }
+
+    prior_request * r = &b->requests[b->count];
+    b->count++;
+    r->stats = stats;
+    cfg_board_clone(&r->cb, cb);
+    r->is_black = is_black;
+    memcpy(&r->dp, dp, sizeof(deferred_priors));
+
+    bool full = (b->count == UCT_PRIOR_BATCH_SIZE);
+    if(full)
+    {
+        b->busy = true;
+        filling_batch = 1 - filling_batch;
+    }
+    omp_unset_lock(&prior_batches_lock);
+
+    if(full)
+    {
+        compute_prior_batch(b);
+        omp_set_lock(&prior_batches_lock);
+        b->busy = false;
+        omp_unset_lock(&prior_batches_lock);
+    }
+}
+
+/*
+Computes the priors still queued. Must not be called during a search.
+*/
+static void flush_prior_batches()
+{
+    for(u8 i = 0; i < 2; ++i)
+        compute_prior_batch(&prior_batches[i]);
+}
+#endif
+
+/*
+Produces the board transformed by a reduction method.
+*/
+static void reduce_cfg_board(
+    cfg_board * dst,
+    const cfg_board * src,
+    d8 reduction
+){
+    board b;
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+        b.p[tt_reduce_move(m, reduction)] = src->p[m];
+    b.last_played = tt_reduce_move(src->last_played, reduction);
+    b.last_eaten = tt_reduce_move(src->last_eaten, reduction);
+    cfg_from_board(dst, &b);
+}
+
+/*
+Expects the lock of the state to be set; unsets it. The plays are found in the
+orientation of the state.
+*/
+static void mcts_expansion(
+    cfg_board * cb,
+    bool is_black,
+    tt_stats * stats,
+    d8 reduction,
+    u16 playouts,
+    leaf_results * r
+){
+    END_PHASE(PHASE_SELECTION);
+    cfg_board reduced;
+    cfg_board * scb = cb;
+#if UCT_DEFERRED_PRIORS
+    bool expanded = false;
+    deferred_priors dp;
+    if(stats->expansion_delay == 0)
+    {
+        if(reduction != NOREDUCE)
+        {
+            reduce_cfg_board(&reduced, cb, reduction);
+            scb = &reduced;
+        }
+        init_new_state_plays(stats, scb, is_black, &dp);
+        /* the plays must be visible before the state is seen as expanded */
+        #pragma omp flush
+        COUNT_EVENT(expansions);
+        expanded = true;
+    }
+    stats->expansion_delay--;
+    omp_unset_lock(&stats->lock);
+
+    if(expanded)
+    {
+        if(batched_priors)
+            queue_deferred_priors(stats, scb, is_black, &dp);
+        else
+            compute_and_add_priors(stats, scb, is_black, &dp);
+    }
+#else
+    if(stats->expansion_delay == 0)
+    {
+        if(reduction != NOREDUCE)
+        {
+            reduce_cfg_board(&reduced, cb, reduction);
+            scb = &reduced;
+        }
+        init_new_state(stats, scb, is_black);
+#if UCT_PROGRESSIVE_WIDENING
+        widen_plays(stats);
+#endif
+        /* the plays must be visible before the state is seen as expanded */
+        #pragma omp flush
+        COUNT_EVENT(expansions);
+    }
+    stats->expansion_delay--;
+    omp_unset_lock(&stats->lock);
+#endif
+    if(scb != cb)
+        cfg_board_free(&reduced);
+    END_PHASE(PHASE_EXPANSION);
+    leaf_playouts_amaf(cb, is_black, playouts, r);
+    END_PHASE(PHASE_PLAYOUT);
+}
+
+/*
+RETURNS true if the state was already visited in the descent, in the same
+orientation
+*/
+static bool state_in_descent(
+    tt_stats * const stats[],
+    const d8 reductions[],
+    d16 depth,
+    const tt_stats * s,
+    d8 reduction
+){
+    for(d16 d = depth - 2; d >= 6; --d)
+        if(stats[d] == s && reductions[d] == reduction)
+            return true;
+    return false;
+}
+
+/*
+Transforms the AMAF results of a simulation by a reduction method, to the
+orientation of a state.
+*/
+static void reduce_amaf_results(
+    u64 dst_set[LIB_BITMAP_WORDS],
+    u16 dst_n[TOTAL_BOARD_SIZ],
+    u16 dst_wins[TOTAL_BOARD_SIZ],
+    const u64 src_set[LIB_BITMAP_WORDS],
+    const u16 src_n[TOTAL_BOARD_SIZ],
+    const u16 src_wins[TOTAL_BOARD_SIZ],
+    d8 reduction
+){
+    memset(dst_set, 0, LIB_BITMAP_WORDS * sizeof(u64));
+    for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
+        for(u64 w = src_set[i]; w != 0; w &= w - 1)
+        {
+            move m = i * 64 + __builtin_ctzll(w);
+            move n = tt_reduce_move(m, reduction);
+            dst_set[n / 64] |= LIB_BIT(n);
+            dst_n[n] = src_n[m];
+            dst_wins[n] = src_wins[m];
+        }
+}
+
+/*
+Descends the tree to a leaf, makes playouts playouts from it and backpropagates
+their results, which are also stored in r.
+RETURNS the depth reached
+*/
+static d16 mcts_selection(
+    cfg_board * cb,
+    u64 zobrist_hash,
+    bool is_black,
+    d8 root_reduction,
+    u16 playouts,
+    leaf_results * r
+){
+
+    d16 depth = 6;
+    tt_stats * stats[MAX_UCT_DEPTH + 6];
+    tt_play * plays[MAX_UCT_DEPTH + 7];
+    move plays_idx[MAX_UCT_DEPTH + 6];
+    /* orientation of each state; the root's is found by tt_lookup_create */
+    d8 reductions[MAX_UCT_DEPTH + 6];
+    d8 reduction = root_reduction;
+    /* the first positions are unused */
+    stats[0] = stats[1] = stats[2] = stats[3] = stats[4] = stats[5] = NULL;
+
+    memset(r, 0, sizeof(leaf_results));
+
+    d16 outcome = 0;
+    tt_stats * curr_stats = NULL;
+    tt_play * play = NULL;
+
+    while(1)
+    {
+        if(depth >= MAX_UCT_DEPTH + 6)
+        {
+            outcome = score_stones_and_area2(cb);
+            break;
+        }
+
+        if(curr_stats == NULL)
+        {
+            END_PHASE(PHASE_SELECTION);
+            curr_stats = tt_lookup_null(cb, is_black, zobrist_hash,
+                reduction);
+            END_PHASE(PHASE_LOOKUP);
+
+            if(curr_stats == NULL)
+            {
+                if(!ran_out_of_memory)
+                    ran_out_of_memory = true;
+                COUNT_EVENT(out_of_memory);
+                leaf_playouts_amaf(cb, is_black, playouts, r);
+                END_PHASE(PHASE_PLAYOUT);
+                break;
+            }
+            else
+            {
+                if(play != NULL)
+                    play->next_stats = curr_stats;
+                lower_expansion_delay(curr_stats, depth - 6, depth > 6 ?
+                    stats[depth - 1] : NULL);
+            }
+#if UCT_LOCKLESS_UPDATES
+            omp_unset_lock(&curr_stats->lock);
+#endif
+        }
+        else
+            LOCK_FOR_UPDATE(curr_stats);
+
+        /* Positional superko detection, in the descent and in the game */
+        if(is_board_move(cb->last_played) && (state_in_descent(stats,
+            reductions, depth, curr_stats, reduction) || (depth > 6 &&
+            search_history != NULL && position_in_game_record(search_history,
+            zobrist_hash, cb->p))))
+        {
+            UNLOCK_FOR_UPDATE(curr_stats);
+            /* loss for player that committed superko */
+            outcome = is_black ? 1 : -1;
+            break;
+        }
+
+#if UCT_SOLVER
+        /* the outcome of proven states is known; only playout from them */
+        if(depth > 6 && curr_stats->proven != PROVEN_NONE)
+        {
+            UNLOCK_FOR_UPDATE(curr_stats);
+            END_PHASE(PHASE_SELECTION);
+            leaf_playouts_amaf(cb, is_black, playouts, r);
+            END_PHASE(PHASE_PLAYOUT);
+            break;
+        }
+#endif
+
+#if UCT_LOCKLESS_UPDATES
+        if(curr_stats->expansion_delay >= 0)
+        {
+            omp_set_lock(&curr_stats->lock);
+            if(curr_stats->expansion_delay >= 0)
+            {
+                /* already unsets lock */
+                mcts_expansion(cb, is_black, curr_stats, reduction, playouts,
+                    r);
+                break;
+            }
+            omp_unset_lock(&curr_stats->lock);
+        }
+        else
+        {
+            #pragma omp flush
+        }
+#else
+        if(curr_stats->expansion_delay >= 0)
+        {
+            /* already unsets lock */
+            mcts_expansion(cb, is_black, curr_stats, reduction, playouts, r);
+            break;
+        }
+#endif
+
+#if UCT_PROGRESSIVE_WIDENING
+        if(needs_widening(curr_stats))
+        {
+            LOCK_FOR_WIDENING(curr_stats);
+            widen_plays(curr_stats);
+            UNLOCK_FOR_WIDENING(curr_stats);
+        }
+#endif
+#if UCT_TRANSPOSITION_BACKUP
+        backup_transpositions(curr_stats);
+#endif
+
+#if UCT_PONDER_REPLIES > 0
+        d16 reply = depth == 6 && ponder_replies_count > 0 ?
+            select_ponder_reply(curr_stats) : -1;
+        move k = reply >= 0 ? (move)reply : select_uct_play(curr_stats, play);
+#else
+        move k = select_uct_play(curr_stats, play);
+#endif
+        play = &curr_stats->plays[k];
+#if UCT_PREFETCH
+        tt_stats * next_stats = play->next_stats;
+        if(next_stats != NULL)
+            prefetch_state(next_stats);
+#endif
+
+        add_virtual_loss(curr_stats, k);
+        UNLOCK_FOR_UPDATE(curr_stats);
+
+        bool game_over = false;
+        if(play->m == PASS)
+        {
+            if(cb->last_played == PASS)
+                game_over = true;
+            else
+                just_pass(cb);
+        }
+        else
+        {
+            just_play2(cb, is_black, tt_revert_move(play->m, reduction),
+                &zobrist_hash);
+        }
+#if UCT_PREFETCH
+        if(next_stats != NULL)
+            prefetch_plays(next_stats);
+#endif
+
+        plays[depth] = play;
+        plays_idx[depth] = k;
         stats[depth] = curr_stats;
+        reductions[depth] = reduction;
         ++depth;
+
+        if(game_over)
+        {
+            outcome = score_stones_and_area2(cb);
+#if UCT_SOLVER
+            if(outcome != 0 && !dynamic_komi_enabled)
+                play->proven = (outcome > 0) == is_black ? PROVEN_WIN :
+                    PROVEN_LOSS;
+#endif
+            is_black = !is_black;
+            break;
+        }
+
         curr_stats = play->next_stats;
+        reduction = tt_reduction(cb, reduction);
         is_black = !is_black;
     }
 
-    if(outcome == 0)
-    {
-        for(d16 k = depth - 1; k >= 6; --k)
-        {
-            is_black = !is_black;
-            move m = plays[k]->m;
-            omp_set_lock(&stats[k]->lock);
+    /* descents ended without playout */
+    if(r->playouts == 0)
+        add_leaf_result(r, cb->p, NULL, outcome, playouts);
+
+    END_PHASE(PHASE_SELECTION);
+
+    plays[depth] = NULL;
+    for(d16 k = depth - 1; k >= 6; --k)
+    {
+        is_black = !is_black;
+        tt_stats * s = stats[k];
+        move idx = plays_idx[k];
+        move m = tt_revert_move(plays[k]->m, reductions[k]);
+        u16 wins = r->wins[is_black];
+
+        LOCK_FOR_UPDATE(s);
+        /* MC sampling */
+        add_results(s, idx, wins, r->playouts);
+#if UCT_PROGRESSIVE_WIDENING || UCT_TRANSPOSITION_BACKUP
+        add_visits(s, wins, r->playouts);
+#endif
+
+        /* AMAF/RAVE */
+        if(m != PASS)
+        {
+            r->first_set[is_black][m / 64] |= LIB_BIT(m);
+            r->first_n[is_black][m] = r->playouts;
+            r->first_wins[is_black][m] = wins;
+            r->first_set[!is_black][m / 64] &= ~LIB_BIT(m);
+            r->first_n[!is_black][m] = 0;
+            r->first_wins[!is_black][m] = 0;
+        }
+        if(reductions[k] == NOREDUCE)
+            update_amaf_stats(s, r->first_set[is_black],
+                r->first_n[is_black], r->first_wins[is_black]);
+        else
+        {
+            u64 first_set[LIB_BITMAP_WORDS];
+            u16 first_n[TOTAL_BOARD_SIZ];
+            u16 first_wins[TOTAL_BOARD_SIZ];
+            reduce_amaf_results(first_set, first_n, first_wins,
+                r->first_set[is_black], r->first_n[is_black],
+                r->first_wins[is_black], reductions[k]);
+            update_amaf_stats(s, first_set, first_n, first_wins);
+        }
+
+        /* LGRF */
+        if(r->wins[!is_black] * 2 > r->playouts)
+            plays[k]->lgrf1_reply = plays[k + 1];
+        else
+            plays[k]->lgrf1_reply = NULL;
+
+        /* Mean final score */
+        d32 score = is_black ? r->score : -r->score;
+        plays[k]->score_n += r->playouts;
+        plays[k]->score_mean += (score - plays[k]->score_mean * r->playouts) /
+            plays[k]->score_n;
+
+#if CRITICALITY_THRESHOLD > 0
+        /* Criticality, the mean of the visits since it is measured */
+        u32 crit_n = s->mc_n[idx];
+        if(crit_n > CRITICALITY_THRESHOLD - CRITICALITY_SAMPLES && m != PASS)
+        {
+            crit_n -= CRITICALITY_THRESHOLD - CRITICALITY_SAMPLES;
+            u16 owned = r->owned[true][m] + r->owned[false][m];
+            if(owned > 0)
+            {
+                plays[k]->owner_winning += (r->owner_wins[m] -
+                    plays[k]->owner_winning * owned) / crit_n;
+                plays[k]->color_owning += (r->owned[is_black][m] -
+                    plays[k]->color_owning * owned) / crit_n;
+            }
+        }
+#endif
+
+#if UCT_SOLVER
+        /* a play is won if the state it leads to is lost, and vice versa */
+        const tt_stats * next = plays[k]->next_stats;
+        if(plays[k]->proven == PROVEN_NONE && next != NULL && next->proven !=
+            PROVEN_NONE)
+            plays[k]->proven = next->proven == PROVEN_WIN ? PROVEN_LOSS :
+                PROVEN_WIN;
+        if(plays[k]->proven != PROVEN_NONE && s->proven == PROVEN_NONE)
+            update_proven(s, idx);
+#endif
+
+        UNLOCK_FOR_UPDATE(s);
+    }
+
+    END_PHASE(PHASE_BACKPROP);
+    return depth;
+}
+
+/*
+Sets whether searches are reproducible: run by a single thread, with the RNG
+reset to seeds derived from seed before each search limited by simulations. From
+the same tree, a search for the same number of simulations then produces the
+same tree; its fingerprint is logged when the search finishes.
+*/
+void mcts_set_deterministic(
+    bool enabled,
+    u32 seed
+){
+    deterministic = enabled;
+    deterministic_seed = seed;
+}
+
+/*
+Sets whether the deferred priors of expanded states are queued, from all
+threads, and computed in batches by the thread that completes each batch. The
+other threads carry on descending the tree while a batch is being computed. This
+is the entry point for prior evaluators that are more efficient over many states
+at once, like neural networks; with the hand-tuned priors it only adds the cost
+of copying the boards. Queued priors are computed by the end of each search.
+Needs UCT_DEFERRED_PRIORS; off by default.
+*/
+void mcts_set_batched_priors(
+    bool enabled
+){
+#if UCT_DEFERRED_PRIORS
+    batched_priors = enabled;
+#else
+    if(enabled)
+        flog_warn("uct", "batched priors need deferred priors");
+#endif
+}
+
+/*
+Frees the least visited branches of the tree after a search ran out of memory,
+logging how many states were freed.
+RETURNS true if the search can go on
+*/
+static bool prune_tree(
+    const board * b,
+    bool is_black
+){
+    u32 freed = tt_prune(b, is_black);
+    char * s = alloc();
+    snprintf(s, MAX_PAGE_SIZ, "search ran out of memory; pruned %u states",
+        freed);
+    flog_info("uct", s);
+    release(s);
+
+    return freed > 0;
+}
+
+/*
+Minimum interval, in milliseconds, between tests of the stability of the root
+plays.
+*/
+#define STABILITY_TEST_INTERVAL 10
+
+/*
+Limits and results of a search run by all threads.
+*/
+typedef struct __search_control_ {
+    u64 start_time;
+    u64 stop_time; /* 0 if not limited by time */
+    u64 early_stop_time; /* 0 if it can't stop early */
+    u64 max_stop_time; /* not after stop_time if it can't be extended */
+    const tt_stats * root; /* for time management; NULL if not used */
+    d8 root_reduction; /* orientation of the state of the root */
+    const cfg_board * root_board; /* position searched, set by run_search */
+    bool is_black;
+    u32 max_simulations; /* 0 if not limited by simulations */
+    bool stop_on_memory_exhausted;
+    bool (* stop_requested)(); /* NULL if the search can't be interrupted */
+    u64 next_stability_test;
+    u64 next_analysis;
+    tt_stats * exchanged_root; /* merged with other searches; NULL if not */
+    u64 next_exchange;
+    u32 simulations;
+    u32 wins;
+    u32 losses;
+    u32 draws;
+    d64 score; /* sum of the final scores, from the perspective of black */
+    bool stopped_by_time;
+    bool stopped_early;
+    bool extended;
+} search_control;
+
+static void init_search_control(
+    search_control * ctl
+){
+    memset(ctl, 0, sizeof(search_control));
+    ctl->root_reduction = NOREDUCE;
+}
+
+/*
+Finds the two most visited plays of a state, and the play of best quality.
+*/
+static void root_play_ranking(
+    const tt_stats * stats,
+    u32 * first_n,
+    u32 * second_n,
+    move * most_visited,
+    move * best_quality
+){
+    *first_n = *second_n = 0;
+    *most_visited = *best_quality = 0;
+    double best_q = -1.0;
+
+    for(move k = 0; k < stats->plays_count; ++k)
+    {
+        u32 n = stats->mc_n[k];
+        if(n > *first_n)
+        {
+            *second_n = *first_n;
+            *first_n = n;
+            *most_visited = k;
+        }
+        else
+            if(n > *second_n)
+                *second_n = n;
+
+#if USE_AMAF_RAVE
+        double q = uct1_rave(stats, k);
+#else
+        double q = stats->mc_q[k];
+#endif
+        if(q > best_q)
+        {
+            best_q = q;
+            *best_quality = k;
+        }
+    }
+}
+
+/*
+Tests whether the most visited play can no longer be overtaken, even if all
+simulations still to be run until the stop time went to the second one, given
+the rate of simulations so far.
+RETURNS true if the lead in visits of the most visited play is safe
+*/
+static bool visits_lead_is_safe(
+    const search_control * ctl,
+    u64 curr_time
+){
+    if(curr_time <= ctl->start_time || curr_time >= ctl->stop_time)
+        return false;
+
+    u32 first_n;
+    u32 second_n;
+    move most_visited;
+    move best_quality;
+    root_play_ranking(ctl->root, &first_n, &second_n, &most_visited,
+        &best_quality);
+    if(most_visited != best_quality)
+        return false;
+
+    double sims_left = ((double)ctl->simulations) * (ctl->stop_time -
+        curr_time) / (curr_time - ctl->start_time);
+    return first_n - second_n > sims_left;
+}
+
+#if UCT_STABILITY_TIME_MANAGEMENT
+/*
+Tests whether the search is unstable: the play of best quality is not the most
+visited, or the two most visited plays are close.
+RETURNS true if the search should be extended
+*/
+static bool search_is_unstable(
+    const search_control * ctl
+){
+    u32 first_n;
+    u32 second_n;
+    move most_visited;
+    move best_quality;
+    root_play_ranking(ctl->root, &first_n, &second_n, &most_visited,
+        &best_quality);
+
+    return most_visited != best_quality || second_n >= first_n *
+        UCT_UNSTABLE_VISITS_RATIO;
+}
+#endif
+
+/*
+Sets whether the komi used by the searches is adjusted between searches: while
+the player searching is winning by a large margin part of its lead is given
+away, by the dynamic komi, so the playouts keep telling good plays from bad
+ones. The dynamic komi is reset between matches.
+*/
+void mcts_set_dynamic_komi(
+    bool enabled
+){
+    dynamic_komi_enabled = enabled;
+    if(!enabled)
+        dynamic_komi = 0;
+}
+
+/*
+Sets the game whose positions the following searches may not repeat, by
+positional superko, besides the positions repeated in the tree; or none if gr is
+NULL. Is only used while the position searched is the last of the game.
+*/
+void mcts_set_game_history(
+    const game_record * gr
+){
+    game_history = gr;
+}
+
+/*
+Sets a function to be called by the timed and resumed searches every interval
+milliseconds, with the candidate plays of the root in the lz-analyze format; or
+stops the reports if report is NULL.
+*/
+void mcts_set_analysis(
+    u32 interval,
+    void (* report)(const char *)
+){
+    analysis_interval = interval;
+    analysis_report = report;
+}
+
+/*
+Sets a function to be called by the master thread of the timed searches every
+interval milliseconds, and once more when they end, with the statistics of the
+visited plays of the root in own. The function may fill merged with the visits
+of plays of the same position made elsewhere since its last call, and their mean
+quality, which are then added to the root; and returns true to stop the search.
+Stops the calls if exchange is NULL.
+*/
+void mcts_set_root_exchange(
+    u32 interval,
+    bool (* exchange)(const root_stats * own, root_stats * merged, bool final)
+){
+    exchange_interval = interval;
+    root_exchange = exchange;
+}
+
+/*
+RETURNS the index of the most visited play of a state, that was visited at least
+once, and not excluded; or -1 if there is none
+*/
+static d32 most_visited_play(
+    const tt_stats * stats,
+    const bool excluded[TOTAL_BOARD_SIZ + 1]
+){
+    const tt_play * plays = stats->plays;
+    if(plays == NULL)
+        return -1;
+
+    d32 best = -1;
+    u32 best_n = 0;
+    for(move k = 0; k < stats->plays_count; ++k)
+    {
+        if(plays[k].next_stats == NULL || (excluded != NULL &&
+            excluded[plays[k].m == PASS ? TOTAL_BOARD_SIZ : plays[k].m]))
+            continue;
+
+        u32 n = stats->mc_n[k];
+        if(n > best_n)
+        {
+            best_n = n;
+            best = k;
+        }
+    }
+    return best;
+}
+
+/*
+Reports the most visited plays of the root, read without stopping the other
+threads, so the statistics of a play may be slightly out of sync. The principal
+variations are replayed to revert their plays from the orientation of each
+state.
+*/
+static void report_analysis(
+    const search_control * ctl
+){
+    const tt_stats * root = ctl->root;
+    char * s = alloc();
+    char * mstr = alloc();
+    u32 idx = 0;
+    bool excluded[TOTAL_BOARD_SIZ + 1];
+    memset(excluded, false, sizeof(excluded));
+
+    /* the start of the entry of a play has less than 128 characters */
+    for(u16 order = 0; order < ANALYSIS_MAX_PLAYS && idx < MAX_PAGE_SIZ - 128;
+        ++order)
+    {
+        d32 k = most_visited_play(root, excluded);
+        if(k == -1)
+            break;
+
+        const tt_play * play = &root->plays[k];
+        excluded[play->m == PASS ? TOTAL_BOARD_SIZ : play->m] = true;
+
+        move m = tt_revert_move(play->m, ctl->root_reduction);
+        coord_to_gtp_vertex(mstr, m);
+        idx += snprintf(s + idx, MAX_PAGE_SIZ - idx,
+            "%sinfo move %s visits %u winrate %u order %u pv %s", order > 0 ?
+            " " : "", mstr, root->mc_n[k], (u32)(root->mc_q[k] * 10000.0 +
+            0.5), order, mstr);
+
+        cfg_board cb;
+        cfg_board_clone(&cb, ctl->root_board);
+        bool is_black = ctl->is_black;
+        d8 reduction = ctl->root_reduction;
+        const tt_stats * stats = (const tt_stats *)play->next_stats;
+        for(u16 depth = 1; depth < ANALYSIS_PV_DEPTH && stats != NULL &&
+            idx < MAX_PAGE_SIZ - 8; ++depth)
+        {
+            d32 j = most_visited_play(stats, NULL);
+            if(j == -1)
+                break;
+
+            if(m == PASS)
+                just_pass(&cb);
+            else
+                just_play(&cb, is_black, m);
+            is_black = !is_black;
+            reduction = tt_reduction(&cb, reduction);
+            m = tt_revert_move(stats->plays[j].m, reduction);
+
+            coord_to_gtp_vertex(mstr, m);
+            idx += snprintf(s + idx, MAX_PAGE_SIZ - idx, " %s", mstr);
+            stats = (const tt_stats *)stats->plays[j].next_stats;
+        }
+        cfg_board_free(&cb);
+    }
+
+    if(idx > 0)
+        analysis_report(s);
+
+    release(mstr);
+    release(s);
+}
+
+/*
+Exchanges the statistics of the plays of the root with the function set, adding
+the visits received, and their mean quality, to the plays of the root. During
+the search the root is updated as by the other threads.
+RETURNS true if the search should stop
+*/
+static bool exchange_root_stats(
+    const search_control * ctl,
+    bool final
+){
+    tt_stats * root = ctl->exchanged_root;
+    root_stats * own = malloc(sizeof(root_stats));
+    root_stats * merged = malloc(sizeof(root_stats));
+    if(own == NULL || merged == NULL)
+        flog_crit("uct", "system out of memory");
+
+    own->count = 0;
+    for(move k = 0; k < root->plays_count; ++k)
+        if(root->mc_n[k] > 0)
+        {
+            own->m[own->count] = tt_revert_move(root->plays[k].m,
+                ctl->root_reduction);
+            own->visits[own->count] = root->mc_n[k];
+            own->quality[own->count] = root->mc_q[k];
+            own->count++;
+        }
+
+    merged->count = 0;
+    bool stop = root_exchange(own, merged, final);
+
+    for(u16 i = 0; i < merged->count; ++i)
+    {
+        u32 dn = merged->visits[i];
+        if(dn == 0)
+            continue;
+
+        for(move k = 0; k < root->plays_count; ++k)
+        {
+            if(tt_revert_move(root->plays[k].m, ctl->root_reduction) !=
+                merged->m[i])
+                continue;
+
+            float dw = merged->quality[i] * dn;
+            LOCK_FOR_UPDATE(root);
+#if UCT_LOCKLESS_UPDATES
+            u32 n;
+            #pragma omp atomic capture
+            n = root->mc_n[k] += dn;
+            float inc = (dw - root->mc_q[k] * dn) / n;
+            #pragma omp atomic
+            root->mc_q[k] += inc;
+#else
+            root->mc_n[k] += dn;
+            root->mc_q[k] += (dw - root->mc_q[k] * dn) / root->mc_n[k];
+#endif
+#if UCT_PROGRESSIVE_WIDENING || UCT_TRANSPOSITION_BACKUP
+            add_visits(root, dw, dn);
+#endif
+            UNLOCK_FOR_UPDATE(root);
+            break;
+        }
+    }
+
+    free(merged);
+    free(own);
+    return stop;
+}
+
+/*
+Tests whether a search should stop because of its time limits or because it was
+requested; only called by the master thread. With time management by stability
+the search may also stop once its result can't change, or be extended up to the
+maximum stop time while it is unstable.
+*/
+static void test_search_time(
+    search_control * ctl
+){
+    if(ctl->stop_requested != NULL && ctl->stop_requested())
+    {
+        search_stop = true;
+        return;
+    }
+
+    u64 curr_time = current_time_in_millis();
+
+    if(analysis_report != NULL && ctl->root != NULL && curr_time >=
+        ctl->next_analysis)
+    {
+        ctl->next_analysis = curr_time + analysis_interval;
+        report_analysis(ctl);
+    }
+
+    if(ctl->exchanged_root != NULL && curr_time >= ctl->next_exchange)
+    {
+        ctl->next_exchange = curr_time + exchange_interval;
+        if(exchange_root_stats(ctl, false))
+        {
+            ctl->stopped_by_time = true;
+            search_stop = true;
+            return;
+        }
+    }
+
+    bool test_stability = false;
+#if UCT_STABILITY_TIME_MANAGEMENT
+    if(ctl->root != NULL && curr_time >= ctl->next_stability_test)
+    {
+        test_stability = true;
+        ctl->next_stability_test = curr_time + STABILITY_TEST_INTERVAL;
+    }
+#endif
+
+    if(ctl->stop_time > 0 && curr_time >= ctl->stop_time)
+    {
+#if UCT_STABILITY_TIME_MANAGEMENT
+        if(ctl->root != NULL && curr_time < ctl->max_stop_time)
+        {
+            /* tested at once when reaching the stop time */
+            if(ctl->extended && !test_stability)
+                return;
+            if(search_is_unstable(ctl))
+            {
+                ctl->extended = true;
+                return;
+            }
+        }
+#endif
+
+        ctl->stopped_by_time = true;
+        search_stop = true;
+        return;
+    }
+
+#if UCT_CAN_STOP_EARLY
+    if(ctl->early_stop_time > 0 && curr_time >= ctl->early_stop_time)
+    {
+        double wr = ((double)ctl->wins) / ((double)(ctl->wins + ctl->losses));
+        if(wr >= UCT_EARLY_WINRATE || (test_stability &&
+            visits_lead_is_safe(ctl, curr_time)))
+        {
+            ctl->stopped_by_time = true;
+            ctl->stopped_early = true;
+            search_stop = true;
+        }
+    }
+#endif
+}
+
+/*
+RETURNS the deepest descent made by any thread since the depths were reset
+*/
+static u16 max_depth_reached()
+{
+    u16 ret = 0;
+    for(u16 t = 0; t < MAXIMUM_NUM_THREADS; ++t)
+    {
+        const search_thread * st = thread_state_of(&search_threads, t);
+        if(st != NULL)
+            ret = MAX(ret, st->max_depth);
+    }
+    return ret;
+}
+
+static void reset_max_depths()
+{
+    for(u16 t = 0; t < MAXIMUM_NUM_THREADS; ++t)
+    {
+        search_thread * st = thread_state_of(&search_threads, t);
+        if(st != NULL)
+            st->max_depth = 0;
+    }
+}
+
+/*
+Maximum number of plays of the game history the cached root is advanced by.
+*/
+#define ROOT_CACHE_MAX_PLAYS 8
+
+/*
+Root of the last search, with its Zobrist hash; kept so the following searches
+of the same position, or of one a few plays later in the game history, clone it
+instead of building it from the board.
+*/
+static cfg_board cached_root;
+static u64 cached_root_hash;
+static bool cached_root_is_black;
+static u16 cached_root_turns; /* of the game history; UINT16_MAX if not in it */
+static bool cached_root_valid = false;
+
+/*
+RETURNS whether a CFG board has the position of a board
+*/
+static bool same_position(
+    const cfg_board * cb,
+    const board * b
+){
+    return cb->last_played == b->last_played && cb->last_eaten ==
+        b->last_eaten && memcmp(cb->p, b->p, TOTAL_BOARD_SIZ) == 0;
+}
+
+/*
+Advances the cached root by the plays of the game history made after it.
+RETURNS whether the cached root is now the position b, with is_black to play
+*/
+static bool advance_cached_root(
+    const board * b,
+    bool is_black
+){
+    const game_record * gr = game_history;
+    if(gr == NULL || cached_root_turns >= gr->turns || gr->turns -
+        cached_root_turns > ROOT_CACHE_MAX_PLAYS)
+        return false;
+
+    bool c = cached_root_is_black;
+    for(u16 t = cached_root_turns; t < gr->turns; ++t)
+    {
+        move m = gr->moves[t];
+        if(m == PASS)
+            just_pass(&cached_root);
+        else
+        {
+            if(!is_board_move(m) || !can_play(&cached_root, c, m))
+                return false;
+            just_play2(&cached_root, c, m, &cached_root_hash);
+        }
+        c = !c;
+    }
+
+    cached_root_turns = gr->turns;
+    cached_root_is_black = c;
+    return c == is_black && same_position(&cached_root, b);
+}
+
+/*
+Prepares the CFG board of the root of a search of board b, by is_black, and its
+Zobrist hash; from the cached root when it is the same position or a few plays
+before it in the game history.
+*/
+static void prepare_root(
+    cfg_board * dst,
+    u64 * hash,
+    const board * b,
+    bool is_black
+){
+    bool cached = cached_root_valid && ((cached_root_is_black == is_black &&
+        same_position(&cached_root, b)) || advance_cached_root(b, is_black));
+    if(!cached)
+    {
+        if(cached_root_valid)
+            cfg_board_free(&cached_root);
+        cfg_from_board(&cached_root, b);
+        cached_root_hash = zobrist_new_hash(b);
+        cached_root_is_black = is_black;
+        cached_root_turns = (game_history != NULL &&
+            same_position(&cached_root, &game_history->state)) ?
+            game_history->turns : UINT16_MAX;
+        cached_root_valid = true;
+    }
+
+    cfg_board_clone(dst, &cached_root);
+    *hash = cached_root_hash;
+}
+
+/*
+Runs simulations from the initial state, in all threads, until the search is
+stopped by the limits of the control or, if requested, by running out of memory.
+Every thread runs simulations until the search is stopped, so all entry points
+share the same workers and stopping takes effect after the current simulations.
+Reproducible searches are run by the master thread only.
+*/
+static void run_search(
+    search_control * ctl,
+    const cfg_board * initial_cfg_board,
+    u64 start_zobrist_hash,
+    bool is_black
+){
+    ran_out_of_memory = false;
+    search_stop = false;
+    ctl->root_board = initial_cfg_board;
+    ctl->is_black = is_black;
+    u16 playouts = MAX(leaf_playouts, 1);
+    search_history = (game_history != NULL && current_game_hash(game_history)
+        == start_zobrist_hash) ? game_history : NULL;
+
+    /* ownership keeps being accumulated while the position is the same */
+    if(memcmp(ownership_p, initial_cfg_board->p, TOTAL_BOARD_SIZ) != 0)
+    {
+        memcpy(ownership_p, initial_cfg_board->p, TOTAL_BOARD_SIZ);
+        for(u16 t = 0; t < MAXIMUM_NUM_THREADS; ++t)
+        {
+            search_thread * st = thread_state_of(&search_threads, t);
+            if(st != NULL)
+            {
+                memset(st->ownership, 0, sizeof(st->ownership));
+                st->ownership_playouts = 0;
+            }
+        }
+    }
+
+    #pragma omp parallel if(!deterministic)
+    {
+        /* kept by the thread and merged when it leaves the search */
+        int thread = omp_get_thread_num();
+        search_thread * st = thread_state(&search_threads);
+        leaf_results r;
+        d32 * own = st->ownership;
+        u32 own_playouts = 0;
+        d16 max_depth = 0;
+#if MCTS_SEARCH_STATS
+        own_stats = &st->stats;
+#endif
+
+        while(!search_stop)
+        {
+            u32 sim;
+            #pragma omp atomic capture
+            {
+                sim = ctl->simulations;
+                ctl->simulations += playouts;
+            }
+            if(ctl->max_simulations > 0 && sim >= ctl->max_simulations)
+            {
+                search_stop = true;
+                break;
+            }
+            u16 n = playouts;
+            if(ctl->max_simulations > 0)
+                n = MIN(n, ctl->max_simulations - sim);
+
+            cfg_board cb;
+            cfg_board_clone(&cb, initial_cfg_board);
+            START_PHASES();
+            d16 depth = mcts_selection(&cb, start_zobrist_hash, is_black,
+                ctl->root_reduction, n, &r);
+            cfg_board_free(&cb);
+            max_depth = MAX(max_depth, depth);
+
+            u16 wins = r.wins[is_black];
+            u16 losses = r.wins[!is_black];
+            #pragma omp atomic
+            ctl->wins += wins;
+            #pragma omp atomic
+            ctl->losses += losses;
+            #pragma omp atomic
+            ctl->draws += r.playouts - wins - losses;
+            #pragma omp atomic
+            ctl->score += r.score;
+
+            own_playouts += r.playouts;
+            for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+                own[m] += r.area[m];
+
+            if(ran_out_of_memory && ctl->stop_on_memory_exhausted)
+                search_stop = true;
+#if UCT_SOLVER
+            /* the outcome of the root is known */
+            if(ctl->root != NULL && ctl->root->proven != PROVEN_NONE)
+                search_stop = true;
+#endif
+
+            if(thread == 0)
+                test_search_time(ctl);
+        }
+
+        st->ownership_playouts += own_playouts;
+        if(max_depth > st->max_depth)
+            st->max_depth = max_depth;
+    }
+
+#if UCT_DEFERRED_PRIORS
+    flush_prior_batches();
+#endif
+
+    /* simulations not started */
+    if(ctl->max_simulations > 0 && ctl->simulations > ctl->max_simulations)
+        ctl->simulations = ctl->max_simulations;
+    else
+        ctl->simulations = ctl->wins + ctl->losses + ctl->draws;
+}
+
+#if MCTS_SEARCH_STATS
+/*
+Resets the statistics of the simulations of all threads.
+*/
+static void reset_search_stats()
+{
+    for(u16 t = 0; t < MAXIMUM_NUM_THREADS; ++t)
+    {
+        search_thread * st = thread_state_of(&search_threads, t);
+        if(st != NULL)
+            memset(&st->stats, 0, sizeof(search_thread_stats));
+    }
+    tt_reset_lookup_stats();
+}
+
+/*
+Sums the statistics of all threads into those of the last timed search.
+*/
+static void aggregate_search_stats(
+    const search_control * ctl,
+    u32 prunings
+){
+    memset(last_search_ns, 0, sizeof(last_search_ns));
+    last_search_expansions = 0;
+    last_search_out_of_memory = 0;
+
+    for(u16 i = 0; i < MAXIMUM_NUM_THREADS; ++i)
+    {
+        const search_thread * st = thread_state_of(&search_threads, i);
+        if(st == NULL)
+            continue;
+        const search_thread_stats * ts = &st->stats;
+        for(u8 p = 0; p < SEARCH_PHASES; ++p)
+            last_search_ns[p] += ts->phase_ns[p];
+        last_search_expansions += ts->expansions;
+        last_search_out_of_memory += ts->out_of_memory;
+    }
+
+    last_search_elapsed = current_time_in_millis() - ctl->start_time;
+    last_search_simulations = ctl->simulations;
+    last_search_prunings = prunings;
+    tt_get_lookup_stats(&last_search_lookups);
+    last_search_valid = true;
+}
+#endif
+
+/*
+RETURNS the mean final score of the simulations of a search, in points, from the
+perspective of black
+*/
+static double mean_score(
+    const search_control * ctl
+){
+    u32 simulations = ctl->wins + ctl->losses + ctl->draws;
+    if(simulations == 0)
+        return 0.0;
+    return ((double)ctl->score) / ((double)simulations) / 2.0;
+}
+
+/*
+RETURNS whether the dynamic komi is against the player
+*/
+static bool dynamic_komi_against(
+    bool is_black
+){
+    return is_black ? dynamic_komi > 0 : dynamic_komi < 0;
+}
+
+/*
+Moves the dynamic komi after a search by is_black, of winrate wr and mean final
+score score, in points and from the perspective of black. While the player is
+winning by too much half of its lead is given away, so the playouts tell good
+plays from bad ones again; once it is not winning by much, half of the komi
+given away is taken back. The dynamic komi is in whole points, so draws stay as
+possible as with the komi.
+*/
+static void update_dynamic_komi(
+    bool is_black,
+    double wr,
+    double score
+){
+    if(!dynamic_komi_enabled)
+        return;
 
-            /* LGRF */
-            plays[k]->lgrf1_reply = NULL;
+    d16 before = dynamic_komi;
+    d16 lead = (d16)(is_black ? score : -score);
+    d16 given = is_black ? dynamic_komi : -dynamic_komi;
 
-            /* AMAF/RAVE */
-            if(m != PASS)
-                traversed[m] = is_black ? BLACK_STONE : WHITE_STONE;
-            update_amaf_stats2(stats[k], traversed, is_black);
-            omp_unset_lock(&stats[k]->lock);
-        }
-    }
+    if(wr > DYNAMIC_KOMI_HIGH && lead > 0)
+        given += (lead / 2) * 2;
     else
-    {
-        plays[depth] = NULL;
-        for(d16 k = depth - 1; k >= 6; --k)
-        {
-            is_black = !is_black;
-            move m = plays[k]->m;
-            double z = (is_black == (outcome > 0)) ? 1.0 : 0.0;
-
-            omp_set_lock(&stats[k]->lock);
-            /* MC sampling */
-            if(is_black == (outcome > 0))
-                plays[k]->mc_q += 1.0 / plays[k]->mc_n;
-
-            /* AMAF/RAVE */
-            if(m != PASS)
-                traversed[m] = is_black ? BLACK_STONE : WHITE_STONE;
-            update_amaf_stats(stats[k], traversed, is_black, z);
-
-            /* LGRF */
-            if(is_black == (outcome > 0))
-                plays[k]->lgrf1_reply = NULL;
-            else
-                plays[k]->lgrf1_reply = plays[k + 1];
+        if(wr < DYNAMIC_KOMI_LOW && given > 0)
+            given = ((given / 2) / 2) * 2;
 
-            /* Criticality */
-            if(m != PASS && cb->p[m] != EMPTY)
-            {
-                double winner_owns_coord = ((outcome > 0) == (cb->p[m] ==
-                    BLACK_STONE)) ? 1.0 : 0.0;
-                plays[k]->owner_winning += (winner_owns_coord -
-                    plays[k]->owner_winning) / plays[k]->mc_n;
-                double player_owns_coord = (is_black == (cb->p[m] ==
-                    BLACK_STONE)) ? 1.0 : 0.0;
-                plays[k]->color_owning += (player_owns_coord -
-                    plays[k]->color_owning) / plays[k]->mc_n;
-            }
+    given = MIN(given, DYNAMIC_KOMI_MAX);
+    dynamic_komi = is_black ? given : -given;
 
-            omp_unset_lock(&stats[k]->lock);
-        }
+    if(dynamic_komi != before)
+    {
+        char * s = alloc();
+        char * kstr = alloc();
+        komi_to_string(kstr, komi + dynamic_komi);
+        snprintf(s, MAX_PAGE_SIZ, "komi of the searches set to %s", kstr);
+        flog_info("uct", s);
+        release(kstr);
+        release(s);
     }
+}
 
-    if(depth > max_depths[omp_get_thread_num()])
-        max_depths[omp_get_thread_num()] = depth;
+/*
+Looks up the state of the root, in the orientation it is stored in, and
+expands it if it was not.
+RETURNS the state of the root, with its lock unset, and its orientation
+*/
+static tt_stats * lookup_root(
+    const board * b,
+    bool is_black,
+    cfg_board * initial_cfg_board,
+    d8 * reduction
+){
+    tt_stats * stats = tt_lookup_create(b, is_black, reduction);
+    omp_unset_lock(&stats->lock);
 
-    return outcome;
+    if(stats->expansion_delay != -1)
+    {
+        stats->expansion_delay = -1;
+        if(*reduction == NOREDUCE)
+            init_new_state(stats, initial_cfg_board, is_black);
+        else
+        {
+            cfg_board reduced;
+            reduce_cfg_board(&reduced, initial_cfg_board, *reduction);
+            init_new_state(stats, &reduced, is_black);
+            cfg_board_free(&reduced);
+        }
+    }
+    return stats;
 }
 
 /*
 Performs a MCTS in at least the available time.
 
-The search may end early if the estimated win rate is very one sided, in which
-case the play selected is a pass. The search is also interrupted if memory runs
-out.
+The search may end early if the estimated win rate is very one sided, or if the
+most visited play can no longer be overtaken. It may be extended, up to the
+maximum stop time, if the best play is unstable. If memory runs out the least
+visited branches of the tree are pruned and the search goes on.
 RETURNS true if a play or pass is suggested instead of resigning
 */
 bool mcts_start_timed(
@@ -325,98 +2342,73 @@ bool mcts_start_timed(
     const board * b,
     bool is_black,
     u64 stop_time,
-    u64 early_stop_time
+    u64 early_stop_time,
+    u64 max_stop_time
 ){
     mcts_init();
 
-    u64 start_zobrist_hash = zobrist_new_hash(b);
-    tt_stats * stats = tt_lookup_create(b, is_black,
-        start_zobrist_hash);
-    omp_unset_lock(&stats->lock);
-
+    u64 start_zobrist_hash;
     cfg_board initial_cfg_board;
-    cfg_from_board(&initial_cfg_board, b);
-
-    if(stats->expansion_delay != -1)
-    {
-        stats->expansion_delay = -1;
-        init_new_state(stats, &initial_cfg_board, is_black);
-    }
-
-    memset(max_depths, 0, sizeof(u16) * MAXIMUM_NUM_THREADS);
-
-    u32 draws = 0;
-    u32 wins = 0;
-    u32 losses = 0;
-
-    ran_out_of_memory = false;
-    search_stop = false;
-    bool stopped_early_by_wr = false;
+    prepare_root(&initial_cfg_board, &start_zobrist_hash, b, is_black);
+
+    d8 reduction;
+    tt_stats * stats = lookup_root(b, is_black, &initial_cfg_board, &reduction);
+    latency_mark(LAT_ROOT);
+
+    reset_max_depths();
+    playout_stats_reset();
+
+    search_control ctl;
+    init_search_control(&ctl);
+    ctl.start_time = current_time_in_millis();
+    ctl.stop_time = stop_time;
+    ctl.early_stop_time = early_stop_time;
+    ctl.max_stop_time = max_stop_time;
+    ctl.root = stats;
+    ctl.root_reduction = reduction;
+    ctl.stop_on_memory_exhausted = true;
+    if(root_exchange != NULL)
+        ctl.exchanged_root = stats;
+
+#if MCTS_SEARCH_STATS
+    reset_search_stats();
+#endif
+    u32 prunings = 0;
 
-    #pragma omp parallel for
-    for(u32 sim = 0; sim < INT32_MAX; ++sim)
+    while(1)
     {
-        if(search_stop)
-        {
-            /* there is no way to simultaneously cancel all OMP threads */
-            sim = INT32_MAX;
-            continue;
-        }
+        run_search(&ctl, &initial_cfg_board, start_zobrist_hash, is_black);
+        if(!ran_out_of_memory)
+            break;
 
-        cfg_board cb;
-        cfg_board_clone(&cb, &initial_cfg_board);
-        d16 outcome = mcts_selection(&cb, start_zobrist_hash, is_black);
-        cfg_board_free(&cb);
-        if(outcome == 0)
+        if(ctl.stopped_by_time || !prune_tree(b, is_black))
         {
-            #pragma omp atomic
-            draws++;
-        }
-        else
-        {
-            if((outcome > 0) == is_black)
-            {
-                #pragma omp atomic
-                wins++;
-            }
-            else
-            {
-                #pragma omp atomic
-                losses++;
-            }
+            flog_warn("uct", "search ran out of memory");
+            break;
         }
+        ++prunings;
+    }
+#if UCT_SOLVER
+    if(stats->proven != PROVEN_NONE)
+        flog_info("uct", stats->proven == PROVEN_WIN ? "position proven won" :
+            "position proven lost");
+#endif
 
-        if(omp_get_thread_num() == 0)
-        {
-            u64 curr_time = current_time_in_millis();
+    if(ctl.exchanged_root != NULL)
+        exchange_root_stats(&ctl, true);
 
-#if UCT_CAN_STOP_EARLY
-            if(curr_time >= early_stop_time)
-            {
-                if(curr_time >= stop_time)
-                    search_stop = true;
-                else
-                {
-                    double wr = ((double)wins) / ((double)(wins + losses));
-                    if(wr >= UCT_EARLY_WINRATE)
-                    {
-                        stopped_early_by_wr = true;
-                        search_stop = true;
-                    }
-                }
-            }
+#if MCTS_SEARCH_STATS
+    aggregate_search_stats(&ctl, prunings);
 #else
-            if(curr_time >= stop_time)
-                search_stop = true;
+    (void)prunings;
 #endif
-        }
-    }
 
-    if(ran_out_of_memory)
-        flog_warn("uct", "search ran out of memory");
+    u32 draws = ctl.draws;
+    u32 wins = ctl.wins;
+    u32 losses = ctl.losses;
 
     char * s = alloc();
-    if(stopped_early_by_wr)
+    if(ctl.stopped_early)
     {
         d64 diff = stop_time - current_time_in_millis();
         char * s2 = alloc();
@@ -425,62 +2417,60 @@ bool mcts_start_timed(
         release(s2);
         flog_info("uct", s);
     }
-
-    clear_out_board(out_b);
-    out_b->pass = UCT_RESIGN_WINRATE;
-    for(move k = 0; k < stats->plays_count; ++k)
+    if(ctl.extended)
     {
-        if(stats->plays[k].m == PASS)
-        {
-            out_b->pass = stats->plays[k].mc_q;
-        }
-        else
-        {
-            out_b->tested[stats->plays[k].m] = true;
-#if USE_AMAF_RAVE
-            out_b->value[stats->plays[k].m] = uct1_rave(&stats->plays[k]);
-#else
-            out_b->value[stats->plays[k].m] = stats->plays[k].mc_q;
-#endif
-        }
+        d64 diff = current_time_in_millis() - stop_time;
+        char * s2 = alloc();
+        format_nr_millis(s2, diff);
+        snprintf(s, MAX_PAGE_SIZ, "search extended by %s", s2);
+        release(s2);
+        flog_info("uct", s);
     }
 
-    u16 max_depth = max_depths[0];
-    for(u16 k = 1; k < MAXIMUM_NUM_THREADS; ++k)
-        if(max_depths[k] > max_depth)
-            max_depth = max_depths[k];
+    root_to_out_board(out_b, stats, reduction);
+
+    u16 max_depth = max_depth_reached();
     max_depth -= 6;
 
     u32 simulations = wins + losses;
     double wr = ((double)wins) / ((double)simulations);
+    double score = mean_score(&ctl);
 
     if(draws > 0)
     {
         simulations += draws;
         snprintf(s, MAX_PAGE_SIZ,
-            "search finished (sims=%u, depth=%u, wr=%.2f, draws=%u)\n",
-            simulations, max_depth, wr, draws);
+            "search finished (sims=%u, depth=%u, wr=%.2f, score=%.1f, draws=%u)\
+\n", simulations, max_depth, wr, score, draws);
     }
     else
     {
         snprintf(s, MAX_PAGE_SIZ,
-            "search finished (sims=%u, depth=%u, wr=%.2f)\n", simulations,
-            max_depth, wr);
+            "search finished (sims=%u, depth=%u, wr=%.2f, score=%.1f)\n",
+            simulations, max_depth, wr, score);
     }
     flog_info("uct", s);
+    u32 idx = playout_stats_to_string(s, MAX_PAGE_SIZ - 1);
+    snprintf(s + idx, MAX_PAGE_SIZ - idx, "\n");
+    flog_info("uct", s);
 
     release(s);
     cfg_board_free(&initial_cfg_board);
 
+    bool handicapped = dynamic_komi_against(is_black);
+    update_dynamic_komi(is_black, wr, score);
+
     /* prevent resignation unless we have played very few simulations */
-    if(simulations >= UCT_RESIGN_PLAYOUTS && wr < UCT_RESIGN_WINRATE)
+    if(simulations >= UCT_RESIGN_PLAYOUTS && wr < UCT_RESIGN_WINRATE &&
+        !handicapped)
         return false;
 
     return true;
 }
 
 /*
-Performs a MCTS for the selected number of simulations.
+Performs a MCTS for the selected number of simulations, or until stop_time if
+not 0, whichever comes first.
 
 The search is interrupted if memory runs out.
 RETURNS true if a play or pass is suggested instead of resigning
@@ -489,112 +2479,86 @@ bool mcts_start_sims(
     out_board * out_b,
     const board * b,
     bool is_black,
-    u32 simulations
+    u32 simulations,
+    u64 stop_time
 ){
     mcts_init();
 
-    u64 start_zobrist_hash = zobrist_new_hash(b);
-    tt_stats * stats = tt_lookup_create(b, is_black,
-        start_zobrist_hash);
-    omp_unset_lock(&stats->lock);
-
+    u64 start_zobrist_hash;
     cfg_board initial_cfg_board;
-    cfg_from_board(&initial_cfg_board, b);
-
-    if(stats->expansion_delay != -1)
-    {
-        stats->expansion_delay = -1;
-        init_new_state(stats, &initial_cfg_board, is_black);
-    }
-
-    memset(max_depths, 0, sizeof(u16) * MAXIMUM_NUM_THREADS);
+    prepare_root(&initial_cfg_board, &start_zobrist_hash, b, is_black);
 
-    u32 draws = 0;
-    u32 wins = 0;
-    u32 losses = 0;
+    d8 reduction;
+    tt_stats * stats = lookup_root(b, is_black, &initial_cfg_board, &reduction);
+    latency_mark(LAT_ROOT);
 
-    ran_out_of_memory = false;
-    search_stop = false;
+    reset_max_depths();
+    playout_stats_reset();
 
-    #pragma omp parallel for
-    for(u32 sim = 0; sim < simulations; ++sim)
+    if(deterministic)
     {
-        cfg_board cb;
-        cfg_board_clone(&cb, &initial_cfg_board);
-        d16 outcome = mcts_selection(&cb, start_zobrist_hash, is_black);
-        cfg_board_free(&cb);
-        if(outcome == 0)
-        {
-            #pragma omp atomic
-            draws++;
-        }
-        else
-        {
-            if((outcome > 0) == is_black)
-            {
-                #pragma omp atomic
-                wins++;
-            }
-            else
-            {
-                #pragma omp atomic
-                losses++;
-            }
-        }
+        rand_seed(deterministic_seed);
+        playout_clear_replies();
     }
 
+    search_control ctl;
+    init_search_control(&ctl);
+    ctl.root_reduction = reduction;
+    ctl.max_simulations = simulations;
+    ctl.start_time = current_time_in_millis();
+    ctl.stop_time = stop_time;
+    run_search(&ctl, &initial_cfg_board, start_zobrist_hash, is_black);
+    simulations = ctl.simulations;
+
+    u32 draws = ctl.draws;
+    u32 wins = ctl.wins;
+    u32 losses = ctl.losses;
 
     if(ran_out_of_memory)
         flog_warn("uct", "search ran out of memory");
 
     char * s = alloc();
 
-    clear_out_board(out_b);
-    out_b->pass = UCT_RESIGN_WINRATE;
-    for(move k = 0; k < stats->plays_count; ++k)
-    {
-        if(stats->plays[k].m == PASS)
-        {
-            out_b->pass = stats->plays[k].mc_q;
-        }
-        else
-        {
-            out_b->tested[stats->plays[k].m] = true;
-#if USE_AMAF_RAVE
-            out_b->value[stats->plays[k].m] = uct1_rave(&stats->plays[k]);
-#else
-            out_b->value[stats->plays[k].m] = stats->plays[k].mc_q;
-#endif
-        }
-    }
+    root_to_out_board(out_b, stats, reduction);
 
-    u16 max_depth = max_depths[0];
-    for(u16 k = 1; k < MAXIMUM_NUM_THREADS; ++k)
-        if(max_depths[k] > max_depth)
-            max_depth = max_depths[k];
+    u16 max_depth = max_depth_reached();
 
     double wr;
+    double score = mean_score(&ctl);
 
     if(draws > 0)
     {
         wr = ((double)wins) / ((double)(wins + losses));
         snprintf(s, MAX_PAGE_SIZ,
-            "search finished (sims=%u, depth=%u, wr=%.2f, draws=%u)\n",
-            simulations, max_depth, wr, draws);
+            "search finished (sims=%u, depth=%u, wr=%.2f, score=%.1f, draws=%u)\
+\n", simulations, max_depth, wr, score, draws);
     }
     else
     {
         wr = ((double)wins) / ((double)simulations);
         snprintf(s, MAX_PAGE_SIZ,
-            "search finished (sims=%u, depth=%u, wr=%.2f)\n", simulations,
-            max_depth, wr);
+            "search finished (sims=%u, depth=%u, wr=%.2f, score=%.1f)\n",
+            simulations, max_depth, wr, score);
     }
     flog_info("uct", s);
+    u32 idx = playout_stats_to_string(s, MAX_PAGE_SIZ - 1);
+    snprintf(s + idx, MAX_PAGE_SIZ - idx, "\n");
+    flog_info("uct", s);
+
+    if(deterministic)
+    {
+        snprintf(s, MAX_PAGE_SIZ, "tree fingerprint %016" PRIx64,
+            tt_fingerprint());
+        flog_info("uct", s);
+    }
 
     release(s);
     cfg_board_free(&initial_cfg_board);
 
-    if(wr < UCT_RESIGN_WINRATE)
+    bool handicapped = dynamic_komi_against(is_black);
+    update_dynamic_komi(is_black, wr, score);
+
+    if(wr < UCT_RESIGN_WINRATE && !handicapped)
         return false;
 
     return true;
@@ -610,117 +2574,302 @@ void reset_mcts_can_resume()
 }
 
 /*
-Continue a previous MCTS.
+Starts pondering the root of board b, played by is_black and stored in the
+orientation of reduction: the visits of its plays are kept, to count those
+added, and the most visited ones are chosen as the replies to follow.
+*/
+static void start_pondering(
+    const tt_stats * root,
+    d8 reduction,
+    const board * b,
+    bool is_black,
+    u32 start_visits[TOTAL_BOARD_SIZ + 1]
+){
+    /* pondered again after an interruption, the visits added are kept */
+    if(!pondered_valid || pondered_is_black != is_black || !board_are_equal(
+        &pondered_board, b))
+    {
+        memcpy(&pondered_board, b, sizeof(board));
+        pondered_is_black = is_black;
+        memset(pondered_visits, 0, sizeof(pondered_visits));
+        pondered_valid = true;
+    }
+
+    u32 total = 0;
+    memset(start_visits, 0, (TOTAL_BOARD_SIZ + 1) * sizeof(u32));
+    for(move k = 0; k < root->plays_count; ++k)
+    {
+        move m = tt_revert_move(root->plays[k].m, reduction);
+        start_visits[m == PASS ? TOTAL_BOARD_SIZ : m] = root->mc_n[k];
+        total += root->mc_n[k];
+    }
+
+#if UCT_PONDER_REPLIES > 0
+    ponder_replies_count = 0;
+    if(total < UCT_PONDER_MIN_VISITS)
+        return;
+
+    /* insertion of the most visited plays, by decreasing visits */
+    for(move k = 0; k < root->plays_count; ++k)
+    {
+        u32 n = root->mc_n[k];
+        if(n == 0 || (ponder_replies_count == UCT_PONDER_REPLIES && n <=
+            ponder_start_n[UCT_PONDER_REPLIES - 1]))
+            continue;
+
+        move i = MIN(ponder_replies_count, UCT_PONDER_REPLIES - 1);
+        for(; i > 0 && ponder_start_n[i - 1] < n; --i)
+        {
+            ponder_replies[i] = ponder_replies[i - 1];
+            ponder_start_n[i] = ponder_start_n[i - 1];
+        }
+        ponder_replies[i] = k;
+        ponder_start_n[i] = n;
+        if(ponder_replies_count < UCT_PONDER_REPLIES)
+            ++ponder_replies_count;
+    }
+
+    u32 replies_n = 0;
+    for(move i = 0; i < ponder_replies_count; ++i)
+        replies_n += ponder_start_n[i];
+    char * s = alloc();
+    char * s2 = alloc();
+    u32 idx = snprintf(s, MAX_PAGE_SIZ, "pondering the replies");
+    for(move i = 0; i < ponder_replies_count; ++i)
+    {
+        ponder_shares[i] = ((double)ponder_start_n[i]) / replies_n;
+        coord_to_alpha_num(s2, tt_revert_move(root->plays[ponder_replies[i]].m,
+            reduction));
+        idx += snprintf(s + idx, MAX_PAGE_SIZ - idx, " %s (%.0f%%)", s2,
+            ponder_shares[i] * 100.0);
+    }
+    flog_debug("uct", s);
+    release(s2);
+    release(s);
+#endif
+}
+
+/*
+Stops pondering the root, stored in the orientation of reduction, adding the
+visits of its plays since the pondering started to the position pondered.
+*/
+static void stop_pondering(
+    const tt_stats * root,
+    d8 reduction,
+    const u32 start_visits[TOTAL_BOARD_SIZ + 1]
+){
+#if UCT_PONDER_REPLIES > 0
+    ponder_replies_count = 0;
+#endif
+    for(move k = 0; k < root->plays_count; ++k)
+    {
+        move m = tt_revert_move(root->plays[k].m, reduction);
+        u16 i = m == PASS ? TOTAL_BOARD_SIZ : m;
+        if(root->mc_n[k] > start_visits[i])
+            pondered_visits[i] += root->mc_n[k] - start_visits[i];
+    }
+}
+
+/*
+Tests whether board b, with is_black to play, follows a reply to the last
+position pondered, and forgets that position if so.
+RETURNS whether it does, with the visits pondering added to the reply and to all
+the plays of the position pondered
+*/
+bool mcts_pondered_reply(
+    const board * b,
+    bool is_black,
+    u32 * reply_visits,
+    u32 * visits
+){
+    if(!pondered_valid || pondered_is_black == is_black)
+        return false;
+
+    board tmp;
+    memcpy(&tmp, &pondered_board, sizeof(board));
+    move m = b->last_played;
+    if(m == PASS)
+        pass(&tmp);
+    else
+        if(!is_board_move(m) || !attempt_play_slow(&tmp, pondered_is_black, m))
+            return false;
+
+    if(!board_are_equal(&tmp, b))
+        return false;
+
+    *reply_visits = pondered_visits[m == PASS ? TOTAL_BOARD_SIZ : m];
+    *visits = 0;
+    for(move i = 0; i < TOTAL_BOARD_SIZ + 1; ++i)
+        *visits += pondered_visits[i];
+    pondered_valid = false;
+    return true;
+}
+
+/*
+Continue a previous MCTS, until stop_requested returns true. The function is
+tested between simulations, so it should be fast. If memory runs out the tree is
+pruned and the search goes on; unless nothing could be freed, in which case it
+returns early. If pondering, is_black is the opponent and the simulations are
+concentrated on its most likely replies (see UCT_PONDER_REPLIES).
 */
 void mcts_resume(
     const board * b,
-    bool is_black
+    bool is_black,
+    bool (* stop_requested)(),
+    bool pondering
 ){
     if(!mcts_can_resume)
         return;
 
     mcts_init();
 
-    u64 stop_time = current_time_in_millis() + 50;
-    ran_out_of_memory = false;
-    search_stop = false;
+    u64 start_zobrist_hash;
+    cfg_board initial_cfg_board;
+    prepare_root(&initial_cfg_board, &start_zobrist_hash, b, is_black);
 
-    u64 start_zobrist_hash = zobrist_new_hash(b);
+    d8 reduction;
+    tt_stats * stats = lookup_root(b, is_black, &initial_cfg_board, &reduction);
 
-    cfg_board initial_cfg_board;
-    cfg_from_board(&initial_cfg_board, b);
+    search_control ctl;
+    init_search_control(&ctl);
+    ctl.stop_on_memory_exhausted = true;
+    ctl.stop_requested = stop_requested;
+    ctl.root = stats;
+    ctl.root_reduction = reduction;
 
-    #pragma omp parallel for
-    for(u32 sim = 0; sim < INT32_MAX; ++sim)
-    {
-        if(search_stop)
-        {
-            /* there is no way to simultaneously cancel all OMP threads */
-            sim = INT32_MAX;
-            continue;
-        }
+    u32 start_visits[TOTAL_BOARD_SIZ + 1];
+    if(pondering)
+        start_pondering(stats, reduction, b, is_black, start_visits);
 
-        cfg_board cb;
-        cfg_board_clone(&cb, &initial_cfg_board);
-        mcts_selection(&cb, start_zobrist_hash, is_black);
-        cfg_board_free(&cb);
+    while(1)
+    {
+        run_search(&ctl, &initial_cfg_board, start_zobrist_hash, is_black);
+        if(!ran_out_of_memory || stop_requested())
+            break;
 
-        if(omp_get_thread_num() == 0)
+        if(!prune_tree(b, is_black))
         {
-            u64 curr_time = current_time_in_millis();
-            if(curr_time >= stop_time)
-                search_stop = true;
+            mcts_can_resume = false;
+            break;
         }
     }
 
-    if(ran_out_of_memory)
-        mcts_can_resume = false;
+    if(pondering)
+        stop_pondering(stats, reduction, start_visits);
 
     cfg_board_free(&initial_cfg_board);
 }
 
 /*
-Execute a 1 second MCTS and return the number of simulations ran.
-RETURNS simulations number
+Produces a textual description of the statistics of the phases of the last
+timed search, up to MAX_PAGE_SIZ characters.
 */
-u32 mcts_benchmark(
-    u32 time_available /* in milliseconds */
+void mcts_last_search_stats(
+    char * dst
 ){
-    mcts_init();
-    board b;
-    clear_board(&b);
-
-    u64 curr_time = current_time_in_millis();
-    u64 stop_time = curr_time + time_available;
+#if MCTS_SEARCH_STATS
+    if(!last_search_valid)
+    {
+        snprintf(dst, MAX_PAGE_SIZ, "no timed search yet");
+        return;
+    }
 
-    u64 start_zobrist_hash = zobrist_new_hash(&b);
-    tt_stats * stats = tt_lookup_create(&b, true,
-        start_zobrist_hash);
-    omp_unset_lock(&stats->lock);
+    u64 total_ns = 0;
+    for(u8 p = 0; p < SEARCH_PHASES; ++p)
+        total_ns += last_search_ns[p];
+    u32 sims = MAX(last_search_simulations, 1);
+
+    u32 idx = snprintf(dst, MAX_PAGE_SIZ, "simulations: %u in %" PRIu64
+        " ms\n", last_search_simulations, last_search_elapsed);
+    for(u8 p = 0; p < SEARCH_PHASES; ++p)
+        idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx, "%s: %.1f%% (%.1f us"
+            " per simulation)\n", phase_names[p], total_ns == 0 ? 0.0 :
+            (100.0 * last_search_ns[p]) / total_ns,
+            (last_search_ns[p] / 1000.0) / sims);
+    idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx, "expansions: %u\n",
+        last_search_expansions);
+
+    const tt_lookup_stats * ls = &last_search_lookups;
+    idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx, "lookups: %" PRIu64
+        " (%.1f%% hits)\n", ls->lookups, ls->lookups == 0 ? 0.0 : (100.0 *
+        ls->hits) / ls->lookups);
+    idx += snprintf(dst + idx, MAX_PAGE_SIZ - idx, "contended locks: %"
+        PRIu64 " (%.3f ms waited)\n", ls->lock_contentions, ls->lock_wait_ns /
+        1000000.0);
+    snprintf(dst + idx, MAX_PAGE_SIZ - idx, "out of memory: %u simulations, %u"
+        " prunings", last_search_out_of_memory, last_search_prunings);
+#else
+    snprintf(dst, MAX_PAGE_SIZ, "search statistics disabled");
+#endif
+}
 
-    cfg_board initial_cfg_board;
-    cfg_from_board(&initial_cfg_board, &b);
+/*
+Estimates the ownership of the points of board b, from the final positions of
+the playouts of the searches already made of it: from -1 for points always owned
+by white to 1 for points always owned by black. The position is compared by its
+stones only.
+RETURNS false if the position has not been searched
+*/
+bool mcts_ownership(
+    const board * b,
+    float owner[TOTAL_BOARD_SIZ]
+){
+    if(memcmp(ownership_p, b->p, TOTAL_BOARD_SIZ) != 0)
+        return false;
 
-    if(stats->expansion_delay != -1)
+    u32 playouts = 0;
+    d32 sum[TOTAL_BOARD_SIZ];
+    memset(sum, 0, sizeof(sum));
+    for(u16 t = 0; t < MAXIMUM_NUM_THREADS; ++t)
     {
-        stats->expansion_delay = -1;
-        init_new_state(stats, &initial_cfg_board, true);
+        const search_thread * st = thread_state_of(&search_threads, t);
+        if(st == NULL)
+            continue;
+        playouts += st->ownership_playouts;
+        for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+            sum[m] += st->ownership[m];
     }
+    if(playouts == 0)
+        return false;
 
-    memset(max_depths, 0, sizeof(u16) * MAXIMUM_NUM_THREADS);
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+        owner[m] = ((float)sum[m]) / playouts;
+    return true;
+}
 
-    bool search_stop = false;
-    u32 simulations = 0;
+/*
+Execute a MCTS from a state for the time available, for benchmarking, and return
+the number of simulations ran. The search is interrupted if memory runs out.
+RETURNS simulations number
+*/
+u32 mcts_benchmark(
+    const board * b,
+    bool is_black,
+    u32 time_available /* in milliseconds */
+){
+    mcts_init();
 
-    // TODO do a longer initial run to initialize state
-    #pragma omp parallel for
-    for(u32 sim = 0; sim < INT32_MAX; ++sim)
-    {
-        if(search_stop)
-        {
-            /* there is no way to simultaneously cancel all OMP threads */
-            sim = INT32_MAX;
-            continue; // TODO change to break
-        }
+    u64 curr_time = current_time_in_millis();
+    u64 stop_time = curr_time + time_available;
 
-        cfg_board cb;
-        cfg_board_clone(&cb, &initial_cfg_board);
-        mcts_selection(&cb, start_zobrist_hash, true);
-        cfg_board_free(&cb);
+    u64 start_zobrist_hash;
+    cfg_board initial_cfg_board;
+    prepare_root(&initial_cfg_board, &start_zobrist_hash, b, is_black);
 
-        #pragma omp atomic
-        simulations++;
+    d8 reduction;
+    lookup_root(b, is_black, &initial_cfg_board, &reduction);
 
-        if(omp_get_thread_num() == 0)
-        {
-            u64 curr_time = current_time_in_millis();
+    reset_max_depths();
+    playout_stats_reset();
 
-            if(curr_time >= stop_time)
-                search_stop = true;
-        }
-    }
+    search_control ctl;
+    init_search_control(&ctl);
+    ctl.root_reduction = reduction;
+    ctl.stop_time = stop_time;
+    ctl.stop_on_memory_exhausted = true;
+    run_search(&ctl, &initial_cfg_board, start_zobrist_hash, is_black);
 
     cfg_board_free(&initial_cfg_board);
 
-    return simulations;
+    return ctl.simulations;
 }
@@ -12,6 +12,7 @@ UCT expanded states initialization.
 #include "cfg_board.h"
 #include "dragon.h"
 #include "move.h"
+#include "pat12.h"
 #include "pat3.h"
 #include "priors.h"
 #include "pts_file.h"
@@ -85,50 +86,34 @@ static u16 stones_in_manhattan_dst3(
 }
 
 static void stats_add_play_tmp(
-    tt_stats * stats,
+    tt_prior plays[MAX_PLAYS_COUNT],
+    move * plays_count,
     move m,
     u32 mc_w, /* wins */
     u32 mc_v /* visits */
 ){
-    u32 idx = stats->plays_count++;
-    stats->plays[idx].m = m;
-    stats->plays[idx].mc_q = mc_w;
-    stats->plays[idx].mc_n = mc_v;
-
-    stats->plays[idx].next_stats = NULL;
-
-    /* LGRF */
-    stats->plays[idx].lgrf1_reply = NULL;
-
-    /* Criticality */
-    stats->plays[idx].owner_winning = 0.5;
-    stats->plays[idx].color_owning = 0.5;
+    u32 idx = (*plays_count)++;
+    plays[idx].m = m;
+    plays[idx].mc_q = mc_w;
+    plays[idx].mc_n = mc_v;
 }
 
 /*
 Heuristic-MC
 
-Copying the MC prior values to AMAF and initializing other fields
+Copying the MC prior values to AMAF
 */
 static void stats_add_play_final(
-    tt_stats * stats,
+    tt_prior plays[MAX_PLAYS_COUNT],
+    move * plays_count,
     move m,
     double mc_q, /* quality */
     u32 mc_v /* visits */
 ){
-    u32 idx = stats->plays_count++;
-    stats->plays[idx].m = m;
-    stats->plays[idx].amaf_q = stats->plays[idx].mc_q = mc_q;
-    stats->plays[idx].amaf_n = stats->plays[idx].mc_n = mc_v;
-
-    stats->plays[idx].next_stats = NULL;
-
-    /* LGRF */
-    stats->plays[idx].lgrf1_reply = NULL;
-
-    /* Criticality */
-    stats->plays[idx].owner_winning = 0.5;
-    stats->plays[idx].color_owning = 0.5;
+    u32 idx = (*plays_count)++;
+    plays[idx].m = m;
+    plays[idx].amaf_q = plays[idx].mc_q = mc_q;
+    plays[idx].amaf_n = plays[idx].mc_n = mc_v;
 }
 
 static bool lib2_self_atari(
@@ -147,44 +132,19 @@ static bool lib2_self_atari(
 }
 
 /*
-Priors values with heuristic MC-RAVE
-
-Initiates the MCTS and AMAF statistics with the values from an external
-heuristic.
-Also marks playable positions, excluding playing in own eyes and ko violations,
-with at least one visit.
+Tactical analysis of attack/defense of unsettled groups; marks the plays that
+save groups of the player and that capture groups of the opponent, weighted by
+the size of the groups.
 */
-void init_new_state(
-    tt_stats * stats,
+static void tactical_analysis(
     cfg_board * cb,
-    bool is_black
+    bool is_black,
+    u16 saving_play[TOTAL_BOARD_SIZ],
+    u16 capturable[TOTAL_BOARD_SIZ]
 ){
-    bool near_last_play[TOTAL_BOARD_SIZ];
-    if(is_board_move(cb->last_played))
-        mark_near_pos(near_last_play, cb, cb->last_played);
-    else
-        memset(near_last_play, false, TOTAL_BOARD_SIZ);
-
-    u8 in_nakade[TOTAL_BOARD_SIZ];
-    memset(in_nakade, 0, TOTAL_BOARD_SIZ);
-
-    bool viable[TOTAL_BOARD_SIZ];
-    memset(viable, true, TOTAL_BOARD_SIZ);
-
-    bool play_okay[TOTAL_BOARD_SIZ];
-    memset(play_okay, true, TOTAL_BOARD_SIZ);
-
-    estimate_eyes(cb, is_black, viable, play_okay, in_nakade);
-
-    u16 saving_play[TOTAL_BOARD_SIZ];
     memset(saving_play, 0, TOTAL_BOARD_SIZ * sizeof(u16));
-
-    u16 capturable[TOTAL_BOARD_SIZ];
     memset(capturable, 0, TOTAL_BOARD_SIZ * sizeof(u16));
 
-    /*
-    Tactical analysis of attack/defense of unsettled groups.
-    */
     for(u8 i = 0; i < cb->unique_groups_count; ++i)
     {
         group * g = cb->g[cb->unique_groups[i]];
@@ -213,23 +173,53 @@ void init_new_state(
             }
         }
     }
+}
+
+/*
+Lists the plays of a new state, excluding playing in own eyes, ko violations,
+suicides and the first line away from other stones; and sets them to the state
+with only the even game prior, plus the pass prior, marking whether they are
+all of its legal plays. The information needed to compute the remaining priors
+is kept in dp.
+*/
+void init_new_state_plays(
+    tt_stats * stats,
+    cfg_board * cb,
+    bool is_black,
+    deferred_priors * dp
+){
+    u8 * in_nakade = dp->in_nakade;
+    memset(in_nakade, 0, TOTAL_BOARD_SIZ);
+
+    bool viable[TOTAL_BOARD_SIZ];
+    memset(viable, true, TOTAL_BOARD_SIZ);
+
+    bool * play_okay = dp->play_okay;
+    memset(play_okay, true, TOTAL_BOARD_SIZ);
 
-    u8 libs_after_playing[TOTAL_BOARD_SIZ];
-    memset(libs_after_playing, 0, TOTAL_BOARD_SIZ);
+    estimate_eyes(cb, is_black, viable, play_okay, in_nakade);
 
     move ko = get_ko_play(cb);
-    stats->plays_count = 0;
+    tt_prior plays[MAX_PLAYS_COUNT];
+    move plays_count = 0;
+    bool plays_complete = true;
 
     for(move k = 0; k < cb->empty.count; ++k)
     {
         move m = cb->empty.coord[k];
+        move _ignored;
 
         /*
         Don't play intersections disqualified because of a better, nearby nakade
         or because they are eyes
         */
         if(!viable[m])
+        {
+            if(plays_complete && ko != m && libs_after_play(cb, is_black, m,
+                &_ignored) > 0)
+                plays_complete = false;
             continue;
+        }
 
         /*
         Ko violation
@@ -237,7 +227,6 @@ void init_new_state(
         if(ko == m)
             continue;
 
-        move _ignored;
         u8 libs = libs_after_play(cb, is_black, m, &_ignored);
 
         /*
@@ -246,18 +235,96 @@ void init_new_state(
         if(libs == 0)
             continue;
 
-        libs_after_playing[m] = libs;
+        /*
+        Do not play in the first line, away from other stones, at all
+        */
+        if(distances_to_border[m] == 0 && stones_in_manhattan_dst3(cb, m) == 0)
+        {
+            plays_complete = false;
+            continue;
+        }
+
+        dp->libs[m] = libs;
 
         /*
         Even game heuristic
         */
-        u32 mc_w = prior_even;
-        u32 mc_v = prior_even * 2;
+        stats_add_play_tmp(plays, &plays_count, m, prior_even, prior_even * 2);
+    }
+
+    /*
+    Transform win/visits into quality/visits statistics and copy MC to
+    AMAF/RAVE statistics
+    */
+    for(u16 i = 0; i < plays_count; ++i)
+    {
+        tt_prior * play = &plays[i];
+        play->amaf_q = play->mc_q = play->mc_q / play->mc_n;
+        play->amaf_n = play->mc_n;
+    }
+
+    /*
+    Add pass simulation
+    */
+    if(cb->empty.count < TOTAL_BOARD_SIZ / 2 ||
+        plays_count < TOTAL_BOARD_SIZ / 8)
+    {
+        stats_add_play_final(plays, &plays_count, PASS, UCT_RESIGN_WINRATE,
+            prior_pass);
+    }
+    else
+        plays_complete = false;
+
+    stats->plays_complete = plays_complete;
+    tt_set_plays(stats, plays, plays_count);
+}
+
+/*
+Computes the priors of the plays of a state, listed by init_new_state_plays,
+other than the even game and pass priors already set. For each play of the state,
+by the same order, the wins and visits to add are stored in the mc_q and mc_n
+fields of deltas. The board must not have changed since the plays were listed.
+Does not change the state.
+*/
+void compute_deferred_priors(
+    const tt_stats * stats,
+    cfg_board * cb,
+    bool is_black,
+    const deferred_priors * dp,
+    tt_prior deltas[MAX_PLAYS_COUNT]
+){
+    bool near_last_play[TOTAL_BOARD_SIZ];
+    if(is_board_move(cb->last_played))
+        mark_near_pos(near_last_play, cb, cb->last_played);
+    else
+        memset(near_last_play, false, TOTAL_BOARD_SIZ);
+
+    u16 saving_play[TOTAL_BOARD_SIZ];
+    u16 capturable[TOTAL_BOARD_SIZ];
+    tactical_analysis(cb, is_black, saving_play, capturable);
+    const u16 * pattern_weights = pat3_weights(is_black);
+    bool use_pat12 = pat12_in_use();
+
+    for(move k = 0; k < stats->plays_count; ++k)
+    {
+        move m = stats->plays[k].m;
+        deltas[k].m = m;
+        u32 mc_w = 0;
+        u32 mc_v = 0;
+
+        if(m == PASS)
+        {
+            deltas[k].mc_q = 0.0;
+            deltas[k].mc_n = 0;
+            continue;
+        }
+
+        u8 libs = dp->libs[m];
 
         /*
         Avoid typically poor plays like eye shape
         */
-        if(!play_okay[m])
+        if(!dp->play_okay[m])
             mc_v += prior_bad_play;
         else
         {
@@ -281,12 +348,12 @@ void init_new_state(
         /*
         Nakade
         */
-        if(in_nakade[m] > 0)
+        if(dp->in_nakade[m] > 0)
         {
             group * g = get_closest_group(cb, m);
             if(g->eyes < 2) /* nakade eye shape is already an eye */
             {
-                u16 b = (u16)powf(in_nakade[m], prior_stone_scale_factor);
+                u16 b = (u16)powf(dp->in_nakade[m], prior_stone_scale_factor);
                 mc_w += prior_nakade + b;
                 mc_v += prior_nakade + b;
             }
@@ -313,9 +380,16 @@ void init_new_state(
         }
 
         /*
-        3x3 patterns
+        3x3 patterns, or 12-point patterns where known
         */
-        if(libs > 1 && pat3_find(cb->hash[m], is_black) != 0)
+        bool pattern = pattern_weights[cb->hash[m]] != 0;
+        if(use_pat12)
+        {
+            u16 w12 = pat12_find(PAT12_CODE(cb, m), is_black);
+            if(w12 != 0)
+                pattern = w12 >= PAT12_PRIOR_WEIGHT;
+        }
+        if(libs > 1 && pattern)
         {
             mc_w += prior_pat3;
             mc_v += prior_pat3;
@@ -340,9 +414,6 @@ void init_new_state(
             u8 dst_border = distances_to_border[m];
             switch(dst_border)
             {
-                case 0:
-                    // Do not play there at all
-                    continue;
                 case 1:
                     mc_v += prior_line2;
                     break;
@@ -371,27 +442,38 @@ void init_new_state(
             mc_v += prior_corner;
         }
 
-
-        stats_add_play_tmp(stats, m, mc_w, mc_v);
+        deltas[k].mc_q = mc_w;
+        deltas[k].mc_n = mc_v;
     }
+}
 
-    /*
-    Transform win/visits into quality/visits statistics and copy MC to
-    AMAF/RAVE statistics
-    */
-    for(u16 i = 0; i < stats->plays_count; ++i)
-    {
-        tt_play * play = &stats->plays[i];
-        play->amaf_q = play->mc_q = play->mc_q / play->mc_n;
-        play->amaf_n = play->mc_n;
-    }
+/*
+Priors values with heuristic MC-RAVE
 
-    /*
-    Add pass simulation
-    */
-    if(cb->empty.count < TOTAL_BOARD_SIZ / 2 ||
-        stats->plays_count < TOTAL_BOARD_SIZ / 8)
+Initiates the MCTS and AMAF statistics with the values from an external
+heuristic.
+Also marks playable positions, excluding playing in own eyes and ko violations,
+with at least one visit.
+*/
+void init_new_state(
+    tt_stats * stats,
+    cfg_board * cb,
+    bool is_black
+){
+    deferred_priors dp;
+    init_new_state_plays(stats, cb, is_black, &dp);
+
+    tt_prior deltas[MAX_PLAYS_COUNT];
+    compute_deferred_priors(stats, cb, is_black, &dp, deltas);
+
+    for(move k = 0; k < stats->plays_count; ++k)
     {
-        stats_add_play_final(stats, PASS, UCT_RESIGN_WINRATE, prior_pass);
+        if(deltas[k].mc_n == 0)
+            continue;
+
+        u32 n = stats->mc_n[k] + deltas[k].mc_n;
+        double q = (stats->mc_q[k] * stats->mc_n[k] + deltas[k].mc_q) / n;
+        stats->mc_n[k] = stats->amaf_n[k] = n;
+        stats->mc_q[k] = stats->amaf_q[k] = q;
     }
 }
@@ -0,0 +1,90 @@
+/*
+Accounting of the memory used by the program outside of the transpositions
+table, by category: each allocator adds the bytes it takes from the system and
+subtracts the ones it gives back, so the memory held, including the free lists
+the allocators keep, can be reported and kept within a budget (see
+set_memory_budget). The transpositions table keeps its own accounting.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+
+#include "alloc.h"
+#include "mem_usage.h"
+#include "stringm.h"
+#include "types.h"
+
+static d64 in_use[MEM_CATEGORIES];
+
+static const char * category_names[MEM_CATEGORIES] =
+{
+    "board groups",
+    "scratch buffers",
+    "thread states",
+    "patterns",
+    "opening book",
+    "data set",
+    "data pack (mapped)"
+};
+
+
+/*
+Adds a number of bytes, negative if given back, to the memory use of a
+category.
+Thread-safe.
+*/
+void mem_usage_add(
+    u8 category,
+    d64 bytes
+){
+    #pragma omp atomic
+    in_use[category] += bytes;
+}
+
+/*
+RETURNS the memory in use by a category, in bytes
+*/
+u64 mem_usage(
+    u8 category
+){
+    d64 ret;
+    #pragma omp atomic read
+    ret = in_use[category];
+    return ret > 0 ? (u64)ret : 0;
+}
+
+/*
+RETURNS the memory in use by all categories, in bytes
+*/
+u64 mem_usage_total()
+{
+    u64 ret = 0;
+    for(u8 i = 0; i < MEM_CATEGORIES; ++i)
+        ret += mem_usage(i);
+    return ret;
+}
+
+/*
+Produces a textual description of the memory use of each category that uses
+any, one per line, up to siz characters.
+RETURNS number of characters written
+*/
+u32 mem_usage_to_string(
+    char * dst,
+    u32 siz
+){
+    char * s = alloc();
+    u32 idx = 0;
+    for(u8 i = 0; i < MEM_CATEGORIES && idx < siz; ++i)
+    {
+        u64 bytes = mem_usage(i);
+        if(bytes == 0)
+            continue;
+
+        format_mem_size(s, bytes);
+        idx += snprintf(dst + idx, siz - idx, "%s: %s\n", category_names[i], s);
+    }
+    release(s);
+    return MIN(idx, siz);
+}
@@ -0,0 +1,595 @@
+/*
+Microbenchmarks of the board and playout primitives.
+
+Times each primitive over a fixed set of positions: the current positions of the
+SGF files of a folder, with the plays and states derived from them by a fixed
+RNG seed. Each primitive is first run for a warm-up period, and then for a
+number of repetitions of fixed duration; the time per operation of each
+repetition is measured and the median, minimum and maximum are reported, with
+the operations per second of the median. Only the operations themselves are
+timed, not the preparation of the boards they use.
+
+The results are printed as a table, or as tab-separated values with --tsv for
+comparison between builds by scripts.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#include "alloc.h"
+#include "board.h"
+#include "cfg_board.h"
+#include "engine.h"
+#include "file_io.h"
+#include "flog.h"
+#include "matrix.h"
+#include "game_record.h"
+#include "mcts.h"
+#include "pat3.h"
+#include "playout.h"
+#include "randg.h"
+#include "scoring.h"
+#include "sgf.h"
+#include "stringm.h"
+#include "tactical.h"
+#include "timem.h"
+#include "transpositions.h"
+#include "types.h"
+#include "zobrist.h"
+
+#define BENCH_MAX_POSITIONS 64
+#define BENCH_SEED 1
+#define BENCH_WARM_UP_TIME 200 /* in milliseconds */
+#define BENCH_REPETITION_TIME 250 /* in milliseconds */
+#define BENCH_REPETITIONS 7
+#define BENCH_MAX_REPETITIONS 100
+
+/* plays of the sequence played by just_play2 */
+#define BENCH_PLAYS 32
+/* boards cloned or converted, and calls made, per timed batch */
+#define BENCH_BATCH 16
+/* states looked up by tt_lookup_null */
+#define BENCH_STATES 16
+
+typedef struct __bench_position_ {
+    char * name;
+    board b;
+    cfg_board cb;
+    bool is_black;
+    u64 hash;
+    move plays[BENCH_PLAYS];
+    u16 plays_count;
+    cfg_board children[BENCH_STATES];
+    u64 children_hashes[BENCH_STATES];
+    d8 children_reductions[BENCH_STATES];
+    u16 children_count;
+} bench_position;
+
+/*
+Runs a batch of operations of a primitive over a position.
+RETURNS the nanoseconds taken by the operations, with their number in ops
+*/
+typedef u64 (* bench_function)(bench_position * pos, u32 * ops);
+
+typedef struct __bench_primitive_ {
+    const char * name;
+    bench_function run;
+} bench_primitive;
+
+/* keeps the results of the operations from being optimized away */
+static volatile u64 sink;
+
+static cfg_board batch_boards[BENCH_BATCH];
+static play_cache batch_caches[BENCH_BATCH];
+
+
+static u64 bench_just_play2(
+    bench_position * pos,
+    u32 * ops
+){
+    cfg_board cb;
+    cfg_board_clone(&cb, &pos->cb);
+    u64 hash = pos->hash;
+    bool is_black = pos->is_black;
+
+    u64 start = current_time_in_nanos();
+    for(u16 i = 0; i < pos->plays_count; ++i)
+    {
+        just_play2(&cb, is_black, pos->plays[i], &hash);
+        is_black = !is_black;
+    }
+    u64 elapsed = current_time_in_nanos() - start;
+
+    sink += hash;
+    cfg_board_free(&cb);
+    *ops = pos->plays_count;
+    return elapsed;
+}
+
+static u64 bench_cfg_board_clone(
+    bench_position * pos,
+    u32 * ops
+){
+    u64 start = current_time_in_nanos();
+    for(u16 i = 0; i < BENCH_BATCH; ++i)
+        cfg_board_clone(&batch_boards[i], &pos->cb);
+    u64 elapsed = current_time_in_nanos() - start;
+
+    for(u16 i = 0; i < BENCH_BATCH; ++i)
+        cfg_board_free(&batch_boards[i]);
+    *ops = BENCH_BATCH;
+    return elapsed;
+}
+
+static u64 bench_cfg_from_board(
+    bench_position * pos,
+    u32 * ops
+){
+    u64 start = current_time_in_nanos();
+    for(u16 i = 0; i < BENCH_BATCH; ++i)
+        cfg_from_board(&batch_boards[i], &pos->b);
+    u64 elapsed = current_time_in_nanos() - start;
+
+    for(u16 i = 0; i < BENCH_BATCH; ++i)
+        cfg_board_free(&batch_boards[i]);
+    *ops = BENCH_BATCH;
+    return elapsed;
+}
+
+static u64 bench_heavy_select_play(
+    bench_position * pos,
+    u32 * ops
+){
+    for(u16 i = 0; i < BENCH_BATCH; ++i)
+        playout_cache_init(&batch_caches[i], &pos->cb);
+
+    u64 start = current_time_in_nanos();
+    for(u16 i = 0; i < BENCH_BATCH; ++i)
+        sink += playout_select_play(&pos->cb, pos->is_black,
+            &batch_caches[i]);
+    u64 elapsed = current_time_in_nanos() - start;
+
+    *ops = BENCH_BATCH;
+    return elapsed;
+}
+
+static u64 bench_pat3_find(
+    bench_position * pos,
+    u32 * ops
+){
+    const cfg_board * cb = &pos->cb;
+    u64 sum = 0;
+
+    u64 start = current_time_in_nanos();
+    for(move k = 0; k < cb->empty.count; ++k)
+    {
+        move m = cb->empty.coord[k];
+        sum += pat3_find(cb->hash[m], true);
+        sum += pat3_find(cb->hash[m], false);
+    }
+    u64 elapsed = current_time_in_nanos() - start;
+
+    sink += sum;
+    *ops = cb->empty.count * 2;
+    return elapsed;
+}
+
+static u64 bench_safe_to_play(
+    bench_position * pos,
+    u32 * ops
+){
+    cfg_board * cb = &pos->cb;
+    u64 sum = 0;
+
+    u64 start = current_time_in_nanos();
+    for(move k = 0; k < cb->empty.count; ++k)
+        sum += safe_to_play(cb, pos->is_black, cb->empty.coord[k]);
+    u64 elapsed = current_time_in_nanos() - start;
+
+    sink += sum;
+    *ops = cb->empty.count;
+    return elapsed;
+}
+
+static u64 bench_score_stones_and_area(
+    bench_position * pos,
+    u32 * ops
+){
+    d32 sum = 0;
+
+    u64 start = current_time_in_nanos();
+    for(u16 i = 0; i < BENCH_BATCH; ++i)
+        sum += score_stones_and_area(pos->b.p);
+    u64 elapsed = current_time_in_nanos() - start;
+
+    sink += sum;
+    *ops = BENCH_BATCH;
+    return elapsed;
+}
+
+static u64 bench_zobrist_new_hash(
+    bench_position * pos,
+    u32 * ops
+){
+    u64 sum = 0;
+
+    u64 start = current_time_in_nanos();
+    for(u16 i = 0; i < BENCH_BATCH; ++i)
+        sum += zobrist_new_hash(&pos->b);
+    u64 elapsed = current_time_in_nanos() - start;
+
+    sink += sum;
+    *ops = BENCH_BATCH;
+    return elapsed;
+}
+
+/*
+Looks up states already in the transpositions table, as in most steps of a
+descent, and releases their locks; the states are created by the warm-up.
+*/
+static u64 bench_tt_lookup_null(
+    bench_position * pos,
+    u32 * ops
+){
+    bool is_black = !pos->is_black;
+
+    u64 start = current_time_in_nanos();
+    for(u16 i = 0; i < pos->children_count; ++i)
+    {
+        tt_stats * s = tt_lookup_null(&pos->children[i], is_black,
+            pos->children_hashes[i], pos->children_reductions[i]);
+        if(s != NULL)
+            omp_unset_lock(&s->lock);
+    }
+    u64 elapsed = current_time_in_nanos() - start;
+
+    *ops = pos->children_count;
+    return elapsed;
+}
+
+static u64 bench_rand_u16(
+    bench_position * pos,
+    u32 * ops
+){
+    u16 max = pos->cb.empty.count;
+    u32 sum = 0;
+
+    u64 start = current_time_in_nanos();
+    for(u16 i = 0; i < BENCH_BATCH * 16; ++i)
+        sum += rand_u16(max);
+    u64 elapsed = current_time_in_nanos() - start;
+
+    sink += sum;
+    *ops = BENCH_BATCH * 16;
+    return elapsed;
+}
+
+static const bench_primitive primitives[] = {
+    { "just_play2", bench_just_play2 },
+    { "cfg_board_clone", bench_cfg_board_clone },
+    { "cfg_from_board", bench_cfg_from_board },
+    { "heavy_select_play", bench_heavy_select_play },
+    { "pat3_find", bench_pat3_find },
+    { "safe_to_play", bench_safe_to_play },
+    { "score_stones_and_area", bench_score_stones_and_area },
+    { "zobrist_new_hash", bench_zobrist_new_hash },
+    { "tt_lookup_null", bench_tt_lookup_null },
+    { "rand_u16", bench_rand_u16 },
+    { NULL, NULL }
+};
+
+
+/*
+Fills the legal plays of the player that are not in its own eyes.
+RETURNS number of plays
+*/
+static u16 candidate_plays(
+    const cfg_board * cb,
+    bool is_black,
+    move plays[TOTAL_BOARD_SIZ]
+){
+    u16 count = 0;
+    for(move k = 0; k < cb->empty.count; ++k)
+    {
+        move m = cb->empty.coord[k];
+        if(can_play(cb, is_black, m) && !is_eye(cb, is_black, m))
+            plays[count++] = m;
+    }
+    return count;
+}
+
+/*
+Derives the plays and states used by the primitives from the position.
+*/
+static void prepare_position(
+    bench_position * pos
+){
+    cfg_from_board(&pos->cb, &pos->b);
+    pos->hash = zobrist_new_hash(&pos->b);
+
+    rand_seed(BENCH_SEED);
+    move plays[TOTAL_BOARD_SIZ];
+
+    /* a sequence of random plays, of alternating players */
+    cfg_board cb;
+    cfg_board_clone(&cb, &pos->cb);
+    bool is_black = pos->is_black;
+    pos->plays_count = 0;
+    while(pos->plays_count < BENCH_PLAYS)
+    {
+        u16 count = candidate_plays(&cb, is_black, plays);
+        if(count == 0)
+            break;
+        move m = plays[rand_u16(count)];
+        just_play(&cb, is_black, m);
+        pos->plays[pos->plays_count++] = m;
+        is_black = !is_black;
+    }
+    cfg_board_free(&cb);
+
+    /* positions after random plays of the player to play */
+    u16 count = candidate_plays(&pos->cb, pos->is_black, plays);
+    pos->children_count = 0;
+    while(pos->children_count < BENCH_STATES && count > 0)
+    {
+        u16 idx = rand_u16(count);
+        move m = plays[idx];
+        plays[idx] = plays[--count];
+
+        cfg_board * child = &pos->children[pos->children_count];
+        u64 hash = pos->hash;
+        cfg_board_clone(child, &pos->cb);
+        just_play2(child, pos->is_black, m, &hash);
+        pos->children_hashes[pos->children_count] = hash;
+        pos->children_reductions[pos->children_count] = tt_reduction(child,
+            NOREDUCE);
+        pos->children_count++;
+    }
+}
+
+static void free_position(
+    bench_position * pos
+){
+    cfg_board_free(&pos->cb);
+    for(u16 i = 0; i < pos->children_count; ++i)
+        cfg_board_free(&pos->children[i]);
+    free(pos->name);
+}
+
+static int compare_filenames(
+    const void * a,
+    const void * b
+){
+    return strcmp(*((char * const *)a), *((char * const *)b));
+}
+
+static int compare_doubles(
+    const void * a,
+    const void * b
+){
+    double da = *((const double *)a);
+    double db = *((const double *)b);
+    return (da > db) - (da < db);
+}
+
+/*
+Runs the primitive for the warm-up period and then for the repetitions.
+RETURNS false if it has no operations for the position, otherwise true with the
+nanoseconds per operation of each repetition in ascending order
+*/
+static bool measure(
+    const bench_primitive * bp,
+    bench_position * pos,
+    u16 repetitions,
+    u32 repetition_time,
+    double ns_per_op[BENCH_MAX_REPETITIONS]
+){
+    u32 ops;
+    u64 end = current_time_in_millis() + BENCH_WARM_UP_TIME;
+    do
+    {
+        bp->run(pos, &ops);
+        if(ops == 0)
+            return false;
+    }
+    while(current_time_in_millis() < end);
+
+    for(u16 r = 0; r < repetitions; ++r)
+    {
+        u64 total_ns = 0;
+        u64 total_ops = 0;
+        end = current_time_in_millis() + repetition_time;
+        do
+        {
+            total_ns += bp->run(pos, &ops);
+            total_ops += ops;
+        }
+        while(current_time_in_millis() < end);
+
+        ns_per_op[r] = ((double)total_ns) / total_ops;
+    }
+
+    qsort(ns_per_op, repetitions, sizeof(double), compare_doubles);
+    return true;
+}
+
+int main(
+    int argc,
+    char * argv[]
+){
+    const char * folder = "benchmark/";
+    const char * only = NULL;
+    bool tsv = false;
+    u16 repetitions = BENCH_REPETITIONS;
+    u32 repetition_time = BENCH_REPETITION_TIME;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--tsv") == 0)
+        {
+            tsv = true;
+            continue;
+        }
+        if(i < argc - 1 && strcmp(argv[i], "--repetitions") == 0)
+        {
+            d32 a;
+            if(!parse_int(&a, argv[i + 1]) || a < 1 || a >
+                BENCH_MAX_REPETITIONS)
+                goto lbl_usage;
+            ++i;
+            repetitions = a;
+            continue;
+        }
+        if(i < argc - 1 && strcmp(argv[i], "--time") == 0)
+        {
+            d32 a;
+            if(!parse_int(&a, argv[i + 1]) || a < 1)
+                goto lbl_usage;
+            ++i;
+            repetition_time = a;
+            continue;
+        }
+        if(i < argc - 1 && strcmp(argv[i], "--primitive") == 0)
+        {
+            ++i;
+            only = argv[i];
+            continue;
+        }
+        if(i == argc - 1 && argv[i][0] != '-')
+        {
+            folder = argv[i];
+            continue;
+        }
+
+lbl_usage:
+        printf("Usage: %s [options] [folder]\n", argv[0]);
+        printf("Times the board and playout primitives over the positions of \
+the SGF files of\nthe folder. (default: %s)\n", folder);
+        printf("Options:\n");
+        printf("--primitive name - Only time the primitive with this name.\n");
+        printf("--repetitions number - Number of timed repetitions. (default: \
+%u)\n", BENCH_REPETITIONS);
+        printf("--time number - Duration of each repetition in milliseconds. \
+(default: %u)\n", BENCH_REPETITION_TIME);
+        printf("--tsv - Print the results as tab-separated values.\n");
+        printf("Primitives:");
+        for(u16 j = 0; primitives[j].name != NULL; ++j)
+            printf(" %s", primitives[j].name);
+        printf("\n");
+        exit(EXIT_SUCCESS);
+    }
+
+    if(only != NULL)
+    {
+        bool found = false;
+        for(u16 j = 0; primitives[j].name != NULL; ++j)
+            found |= (strcmp(primitives[j].name, only) == 0);
+        if(!found)
+        {
+            fprintf(stderr, "error: unknown primitive %s\n", only);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    alloc_init();
+    flog_config_modes(LOG_MODE_ERROR | LOG_MODE_WARN);
+    flog_config_destinations(LOG_DEST_STDF);
+
+    assert_data_folder_exists();
+    mcts_init();
+    omp_set_num_threads(1);
+
+    char path[MAX_PATH_SIZ];
+    u32 len = snprintf(path, MAX_PATH_SIZ, "%s", folder);
+    if(len > 0 && len < MAX_PATH_SIZ - 1 && path[len - 1] != '/')
+        snprintf(path + len, MAX_PATH_SIZ - len, "/");
+
+    char * filenames[BENCH_MAX_POSITIONS + 1];
+    u32 files = recurse_find_files(path, ".sgf", filenames,
+        BENCH_MAX_POSITIONS);
+    if(files == 0)
+    {
+        fprintf(stderr, "error: no SGF files found in %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    qsort(filenames, files, sizeof(char *), compare_filenames);
+
+    bench_position * positions = malloc(files * sizeof(bench_position));
+    game_record * gr = malloc(sizeof(game_record));
+    if(positions == NULL || gr == NULL)
+    {
+        fprintf(stderr, "error: system out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    u32 positions_count = 0;
+    for(u32 i = 0; i < files; ++i)
+    {
+        if(!import_game_from_sgf(gr, filenames[i]))
+        {
+            fprintf(stderr, "%s skipped\n", filenames[i] + strlen(path));
+            free(filenames[i]);
+            continue;
+        }
+
+        bench_position * pos = &positions[positions_count++];
+        pos->name = filenames[i];
+        current_game_state(&pos->b, gr);
+        pos->is_black = current_player_color(gr);
+        prepare_position(pos);
+    }
+    free(gr);
+
+    if(tsv)
+        printf("primitive\tposition\trepetitions\tns_op_median\tns_op_min\t\
+ns_op_max\tops_s\n");
+    else
+        printf("%-22s %-24s %12s %12s %12s %14s\n", "primitive", "position",
+            "ns/op", "min", "max", "ops/s");
+
+    double ns_per_op[BENCH_MAX_REPETITIONS];
+    for(u16 j = 0; primitives[j].name != NULL; ++j)
+    {
+        if(only != NULL && strcmp(primitives[j].name, only) != 0)
+            continue;
+
+        for(u32 i = 0; i < positions_count; ++i)
+        {
+            bench_position * pos = &positions[i];
+            const char * name = pos->name + strlen(path);
+            tt_clean_all();
+
+            if(!measure(&primitives[j], pos, repetitions, repetition_time,
+                ns_per_op))
+            {
+                if(!tsv)
+                    printf("%-22s %-24s %12s\n", primitives[j].name, name,
+                        "n/a");
+                continue;
+            }
+
+            double median = ns_per_op[repetitions / 2];
+            double min = ns_per_op[0];
+            double max = ns_per_op[repetitions - 1];
+            if(tsv)
+                printf("%s\t%s\t%u\t%.3f\t%.3f\t%.3f\t%.1f\n",
+                    primitives[j].name, name, repetitions, median, min, max,
+                    1000000000.0 / median);
+            else
+                printf("%-22s %-24s %12.1f %12.1f %12.1f %14.0f\n",
+                    primitives[j].name, name, median, min, max, 1000000000.0 /
+                    median);
+            fflush(stdout);
+        }
+    }
+
+    tt_clean_all();
+    for(u32 i = 0; i < positions_count; ++i)
+        free_position(&positions[i]);
+    free(positions);
+    return EXIT_SUCCESS;
+}
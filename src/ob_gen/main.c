@@ -5,6 +5,7 @@ Application for the production of Fuego book from SGF game collections.
 #include "config.h"
 
 #include <unistd.h>
+#include <omp.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -25,14 +26,30 @@ Application for the production of Fuego book from SGF game collections.
 #include "timem.h"
 
 
-#define MAX_FILES 500000
-#define TABLE_BUCKETS 4957
+/* buckets per shard of the table */
+#define TABLE_BUCKETS (1 << 16)
 
-static char * filenames[MAX_FILES];
+/*
+The table of positions is split in shards, by hash, each with its own lock, so
+the game records can be read in parallel.
+*/
+#define TABLE_SHARDS 64
+
+static hash_table * tables[TABLE_SHARDS];
+static omp_lock_t table_locks[TABLE_SHARDS];
 
 static d32 ob_depth = BOARD_SIZ;
 static d32 minimum_turns = (BOARD_SIZ + 1);
 static d32 minimum_samples = (BOARD_SIZ / 2);
+static bool no_print = false;
+
+static u32 files_read = 0;
+static u32 games_used = 0;
+static u32 plays_used = 0;
+static u32 ob_rules = 0;
+
+static game_record * thread_gr = NULL;
+#pragma omp threadprivate(thread_gr)
 
 typedef struct __simple_state_transition_ {
     u8 p[PACKED_BOARD_SIZ];
@@ -72,7 +89,6 @@ static u64 get_total_count(
 Exports internal OB table to simple OB format in file.
 */
 static void export_table_as_ob(
-    hash_table * table,
     u32 min_samples
 ){
     char * str = alloc();
@@ -92,76 +108,249 @@ static void export_table_as_ob(
     u32 skipped = 0;
     u32 exported = 0;
 
-    simple_state_transition ** ssts =
-        (simple_state_transition **)hash_table_export_to_array(table);
-
-    for(u32 idx = 0; ssts[idx]; ++idx)
+    for(u32 shard = 0; shard < TABLE_SHARDS; ++shard)
     {
-        simple_state_transition * h = ssts[idx];
+        simple_state_transition ** ssts = (simple_state_transition **)
+            hash_table_export_to_array(tables[shard]);
 
-        u32 total_count = get_total_count(h);
-        if(total_count < min_samples)
+        for(u32 idx = 0; ssts[idx]; ++idx)
         {
-            ++skipped;
-            continue;
+            simple_state_transition * h = ssts[idx];
+
+            u32 total_count = get_total_count(h);
+            if(total_count < min_samples)
+            {
+                ++skipped;
+                continue;
+            }
+
+            u32 best_count = 0;
+            move best = NONE;
+            for(move i = 0; i < TOTAL_BOARD_SIZ; ++i)
+                if(h->count[i] > best_count)
+                {
+                    best_count = h->count[i];
+                    best = i;
+                }
+
+            if(best == NONE)
+            {
+                fprintf(stderr, "error: unexpected absence of samples\n");
+                release(str);
+                exit(EXIT_FAILURE);
+            }
+
+            if(best_count <= total_count / 2)
+            {
+                ++skipped;
+                continue;
+            }
+
+            u8 p[TOTAL_BOARD_SIZ];
+            unpack_matrix(p, h->p);
+
+            board_to_ob_rule(str, p, best);
+            size_t w = fwrite(str, strlen(str), 1, fp);
+            if(w != 1)
+            {
+                fprintf(stderr, "error: write failed\n");
+                release(str);
+                exit(EXIT_FAILURE);
+            }
+
+            ++exported;
         }
 
-        u32 best_count = 0;
-        move best = NONE;
-        for(move i = 0; i < TOTAL_BOARD_SIZ; ++i)
-            if(h->count[i] > best_count)
+        free(ssts);
+    }
+
+    release(str);
+    fclose(fp);
+
+    printf("Exported %u unique rules; %u were disqualified for not enough sampl\
+es or majority representative\n", exported, skipped);
+}
+
+/*
+Counts the plays of the winner of the game up to the maximum depth, per
+position. Safe to use concurrently.
+*/
+static void learn_from_game(
+    const game_record * gr,
+    u32 * plays_used,
+    u32 * new_states
+){
+    board b;
+    clear_board(&b);
+
+    bool winner_is_black = gr->final_score > 0;
+    bool is_black = false;
+    for(d16 k = 0; k < MIN(ob_depth, gr->turns); ++k)
+    {
+        is_black = !is_black;
+        move m = gr->moves[k];
+
+        /* Stop at the first play that is a pass */
+        if(!is_board_move(m))
+            break;
+
+        u16 caps;
+        u8 libs = libs_after_play_slow(&b, is_black, m, &caps);
+        if(libs < 1 || caps > 0)
+            break;
+
+        if(is_black != winner_is_black)
+        {
+            if(!attempt_play_slow(&b, is_black, m))
             {
-                best_count = h->count[i];
-                best = i;
+                fprintf(stderr, "\rerror: file contains illegal plays\n");
+                exit(EXIT_FAILURE);
             }
+            continue;
+        }
 
-        if(best == NONE)
+        (*plays_used)++;
+
+        board b2;
+        memcpy(&b2, &b, sizeof(board));
+
+        if(!attempt_play_slow(&b, is_black, m))
         {
-            fprintf(stderr, "error: unexpected absence of samples\n");
-            release(str);
+            fprintf(stderr, "\rerror: file contains illegal plays\n");
             exit(EXIT_FAILURE);
         }
 
-        if(best_count <= total_count / 2)
+        d8 reduction = reduce_auto(&b2, is_black);
+        m = reduce_move(m, reduction);
+
+        simple_state_transition stmp;
+        memset(&stmp, 0, sizeof(simple_state_transition));
+        pack_matrix(stmp.p, b2.p);
+        stmp.hash = crc32(stmp.p, PACKED_BOARD_SIZ);
+
+        u32 shard = stmp.hash % TABLE_SHARDS;
+        omp_set_lock(&table_locks[shard]);
+
+        simple_state_transition * entry =
+            (simple_state_transition *)hash_table_find(tables[shard],
+            &stmp);
+
+        if(entry == NULL) /* new state */
         {
-            ++skipped;
-            continue;
+            simple_state_transition * entry = (simple_state_transition
+                *)malloc(sizeof(simple_state_transition));
+            if(entry == NULL)
+            {
+                fprintf(stderr, "\rerror: new sst: system out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+            memset(entry, 0, sizeof(simple_state_transition));
+            memcpy(entry->p, stmp.p, PACKED_BOARD_SIZ);
+            entry->hash = stmp.hash;
+            entry->count[m] = 1;
+
+            hash_table_insert(tables[shard], entry);
+            (*new_states)++;
         }
+        else /* reusing state */
+            entry->count[m]++;
 
-        u8 p[TOTAL_BOARD_SIZ];
-        unpack_matrix(p, h->p);
+        omp_unset_lock(&table_locks[shard]);
+    }
+}
 
-        board_to_ob_rule(str, p, best);
-        size_t w = fwrite(str, strlen(str), 1, fp);
-        if(w != 1)
+/*
+Learns from the games of a file; called from the task of the file.
+*/
+static void read_games(
+    const char * filename
+){
+    if(thread_gr == NULL)
+    {
+        thread_gr = malloc(sizeof(game_record));
+        if(thread_gr == NULL)
         {
-            fprintf(stderr, "error: write failed\n");
-            release(str);
+            fprintf(stderr, "error: system out of memory\n");
             exit(EXIT_FAILURE);
         }
+    }
+    game_record * gr = thread_gr;
 
-        ++exported;
+    u32 fid;
+    #pragma omp atomic capture
+    fid = ++files_read;
+
+    sgf_collection sc;
+    if(!open_sgf_collection(&sc, filename))
+    {
+        if(!no_print)
+            printf("%u: %s skipped\n", fid, filename);
+        return;
     }
 
-    size_t w = fwrite(str, strlen(str), 1, fp);
-    release(str);
-    if(w != 1)
+    u32 games = 0;
+    u32 plays = 0;
+    u32 rules = 0;
+    while(import_next_game_from_sgf(gr, &sc))
+    {
+        if(gr->turns < minimum_turns ||
+            /* Ignore handicap matches */
+            gr->handicap_stones.count > 0 ||
+            /* Only use winner plays so ignore games without score */
+            gr->final_score == 0)
+        {
+            if(!no_print)
+                printf("%u: %s skipped\n", fid, filename);
+            continue;
+        }
+
+        ++games;
+        if(!no_print)
+            printf("%u: %s (%u)\n", fid, filename, gr->turns);
+
+        learn_from_game(gr, &plays, &rules);
+    }
+
+    if(sc.games_skipped > 0 && !no_print)
+        printf("%u: %s %u skipped\n", fid, filename, sc.games_skipped);
+    close_sgf_collection(&sc);
+
+    #pragma omp atomic
+    games_used += games;
+    #pragma omp atomic
+    plays_used += plays;
+    #pragma omp atomic
+    ob_rules += rules;
+}
+
+/*
+Starts a task for reading a file found, while the search continues.
+*/
+static void queue_file(
+    const char * filename,
+    void * arg
+){
+    (void)arg;
+    u32 len = strlen(filename) + 1;
+    char * copy = malloc(len);
+    if(copy == NULL)
     {
-        fprintf(stderr, "error: write failed\n");
+        fprintf(stderr, "error: system out of memory\n");
         exit(EXIT_FAILURE);
     }
-    fclose(fp);
+    memcpy(copy, filename, len);
 
-    printf("Exported %u unique rules; %u were disqualified for not enough sampl\
-es or majority representative\n", exported, skipped);
+    #pragma omp task firstprivate(copy)
+    {
+        read_games(copy);
+        free(copy);
+    }
 }
 
 int main(
     int argc,
     char * argv[]
 ){
-    bool no_print = false;
-
     for(int i = 1; i < argc; ++i)
     {
         if(i < argc - 1 && strcmp(argv[i], "--max_depth") == 0)
@@ -217,148 +406,35 @@ d. (default: %u)\n", minimum_samples);
     assert_data_folder_exists();
 
     char * ts = alloc();
-    timestamp(ts);
-
 
+    timestamp(ts);
     printf("%s: Creating table...\n", ts);
-    hash_table * table = hash_table_create(TABLE_BUCKETS,
-        sizeof(simple_state_transition), hash_function, compare_function);
+    for(u32 shard = 0; shard < TABLE_SHARDS; ++shard)
+    {
+        tables[shard] = hash_table_create(TABLE_BUCKETS,
+            sizeof(simple_state_transition), hash_function, compare_function);
+        omp_init_lock(&table_locks[shard]);
+    }
 
+    timestamp(ts);
+    printf("%s: 1/2 Thinking (%s*.sgf)\n", ts, data_folder());
 
+    u32 filenames_found = 0;
 
-    u32 games_used = 0;
-    u32 plays_used = 0;
-    u32 ob_rules = 0;
-
-    timestamp(ts);
-    printf("%s: Searching game record files (%s*.sgf)...\n", ts,
-        data_folder());
-    u32 filenames_found = recurse_find_files(data_folder(), ".sgf",
-        filenames, MAX_FILES);
+    /*
+    One thread searches the files while the others read the files found
+    */
+    #pragma omp parallel
+    #pragma omp single
+    filenames_found = for_each_file(data_folder(), ".sgf", queue_file, NULL);
 
     if(filenames_found == 0)
         printf("No SGF files found.\n");
     else
-        printf("Found %u SGF files.\n", filenames_found);
-
-    timestamp(ts);
-    printf("%s: 1/2 Thinking\n", ts);
-
-    char * buf = malloc(MAX_FILE_SIZ);
-    game_record * gr = malloc(sizeof(game_record));
-
-    for(u32 fid = 0; fid < filenames_found; ++fid)
-    {
-        if(!no_print)
-            printf("%u/%u: %s", fid + 1, filenames_found, filenames[fid]);
-
-        if(!import_game_from_sgf2(gr, filenames[fid], buf, MAX_FILE_SIZ))
-        {
-            if(!no_print)
-                printf(" skipped\n");
-            continue;
-        }
-
-        if(gr->turns < minimum_turns){
-            if(!no_print)
-                printf(" skipped\n");
-            continue;
-        }
+        printf("\nFound %u SGF files; %u games and %u plays used.\n",
+            filenames_found, games_used, plays_used);
 
-        /* Ignore handicap matches */
-        if(gr->handicap_stones.count > 0)
-        {
-            if(!no_print)
-                printf(" skipped\n");
-            continue;
-        }
-
-        /* Only use winner plays so ignore games without score */
-        if(gr->final_score == 0)
-        {
-            if(!no_print)
-                printf(" skipped\n");
-            continue;
-        }
-
-        board b;
-        clear_board(&b);
-
-        ++games_used;
-        if(!no_print)
-            printf(" (%u)\n", gr->turns);
-
-        bool winner_is_black = gr->final_score > 0;
-        bool is_black = false;
-        for(d16 k = 0; k < MIN(ob_depth, gr->turns); ++k)
-        {
-            is_black = !is_black;
-            move m = gr->moves[k];
-
-            /* Stop at the first play that is a pass */
-            if(!is_board_move(m))
-                break;
-
-            u16 caps;
-            u8 libs = libs_after_play_slow(&b, is_black, m, &caps);
-            if(libs < 1 || caps > 0)
-                break;
-
-            if(is_black != winner_is_black)
-            {
-                if(!attempt_play_slow(&b, is_black, m))
-                {
-                    fprintf(stderr, "\rerror: file contains illegal plays\n");
-                    exit(EXIT_FAILURE);
-                }
-                continue;
-            }
-
-            ++plays_used;
-
-            board b2;
-            memcpy(&b2, &b, sizeof(board));
-
-            if(!attempt_play_slow(&b, is_black, m))
-            {
-                fprintf(stderr, "\rerror: file contains illegal plays\n");
-                exit(EXIT_FAILURE);
-            }
-
-            d8 reduction = reduce_auto(&b2, is_black);
-            m = reduce_move(m, reduction);
-
-            simple_state_transition stmp;
-            memset(&stmp, 0, sizeof(simple_state_transition));
-            pack_matrix(stmp.p, b2.p);
-            stmp.hash = crc32(stmp.p, PACKED_BOARD_SIZ);
-
-            simple_state_transition * entry =
-                (simple_state_transition *)hash_table_find(table, &stmp);
-
-            if(entry == NULL) /* new state */
-            {
-                simple_state_transition * entry = (simple_state_transition
-                    *)malloc(sizeof(simple_state_transition));
-                if(entry == NULL)
-                {
-                    fprintf(stderr, "\rerror: new sst: system out of memory\n");
-                    exit(EXIT_FAILURE);
-                }
-                memset(entry, 0, sizeof(simple_state_transition));
-                memcpy(entry->p, stmp.p, PACKED_BOARD_SIZ);
-                entry->hash = stmp.hash;
-                entry->count[m] = 1;
-
-                hash_table_insert(table, entry);
-                ++ob_rules;
-            }
-            else /* reusing state */
-                entry->count[m]++;
-        }
-    }
-
-    printf("\n\n");
+    printf("\n");
 
     if(ob_rules == 0)
     {
@@ -369,9 +445,13 @@ d. (default: %u)\n", minimum_samples);
     timestamp(ts);
     printf("%s: 2/2 Exporting as opening book...\n", ts);
 
-    export_table_as_ob(table, minimum_samples);
+    export_table_as_ob(minimum_samples);
 
-    hash_table_destroy(table, true);
+    for(u32 shard = 0; shard < TABLE_SHARDS; ++shard)
+    {
+        hash_table_destroy(tables[shard], true);
+        omp_destroy_lock(&table_locks[shard]);
+    }
 
     timestamp(ts);
     printf("%s: Job done.\n", ts);
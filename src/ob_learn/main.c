@@ -15,6 +15,11 @@ same directory.
 #include <time.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <omp.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "alloc.h"
 #include "board.h"
@@ -23,8 +28,8 @@ same directory.
 #include "engine.h"
 #include "file_io.h"
 #include "flog.h"
-#include "hash_table.h"
 #include "mcts.h"
+#include "open_table.h"
 #include "opening_book.h"
 #include "randg.h"
 #include "sgf.h"
@@ -36,14 +41,19 @@ same directory.
 
 
 
-#define MAX_FILES 500000
-#define TABLE_BUCKETS 4957
+/* initial size of the table of states */
+#define EXPECTED_STATES 4096
 
+/* states evaluated together when limited by simulations */
+#define BATCH_STATES 64
 
-static char * filenames[MAX_FILES];
+
+extern u64 max_size_in_mbs;
 
 static u32 secs_per_turn = 60;
+static u32 simulations = 0;
 static d32 ob_depth = TOTAL_BOARD_SIZ / 2;
+static u32 workers = 1;
 
 typedef struct __simple_state_transition_ {
     u8 p[PACKED_BOARD_SIZ];
@@ -51,11 +61,23 @@ typedef struct __simple_state_transition_ {
     u32 hash;
 } simple_state_transition;
 
+/*
+Game states being loaded, while the game record files are found.
+*/
+typedef struct __game_states_ {
+    open_table * table;
+    game_record * gr;
+    u32 files_read;
+    u32 games_used;
+    u32 unique_states;
+    bool no_print;
+} game_states;
+
 
 static u32 hash_function(
-    void * o
+    const void * o
 ){
-    simple_state_transition * s = (simple_state_transition *)o;
+    const simple_state_transition * s = (const simple_state_transition *)o;
     return s->hash;
 }
 
@@ -78,8 +100,240 @@ static int sort_cmp_function(
 }
 
 
+/*
+Writes the best play of the evaluation of a state to the output file, unless it
+is a pass.
+RETURNS true if a rule was written
+*/
+static bool write_best_play(
+    board * b,
+    out_board * out_b,
+    int fd
+){
+    char * str = alloc();
+    char * ts = alloc();
+
+    out_b->pass = -1.0;
+    move best = select_play_fast(out_b);
+    bool ret = is_board_move(best);
+
+    if(!ret)
+    {
+        timestamp(ts);
+        printf("%s: Best play is a pass.\n", ts);
+    }
+    else
+    {
+        board_to_ob_rule(str, b->p, best);
+
+        timestamp(ts);
+        printf("%s", str);
+
+        ssize_t w = write(fd, str, strlen(str));
+        if(w == -1)
+        {
+            fprintf(stderr, "error: write failed\n");
+            exit(EXIT_FAILURE);
+        }
+        sync();
+    }
+
+    release(ts);
+    release(str);
+    return ret;
+}
+
+/*
+Evaluates the states of a batch by simulations, sharing the transpositions
+table, and writes their best plays to the output file.
+*/
+static void evaluate_batch(
+    u32 count,
+    board b[BATCH_STATES],
+    int fd
+){
+    static bool is_black[BATCH_STATES];
+    static u32 sims[BATCH_STATES];
+    static out_board out_b[BATCH_STATES];
+    static bool has_play[BATCH_STATES];
+
+    for(u32 i = 0; i < count; ++i)
+    {
+        is_black[i] = true;
+        sims[i] = simulations;
+    }
+    evaluate_positions_sims(count, b, is_black, sims, out_b, has_play);
+
+    for(u32 i = 0; i < count; ++i)
+        write_best_play(&b[i], &out_b[i], fd);
+}
+
+/*
+Evaluates the states of the worker specified, every one in the number of
+workers, in order of popularity; and writes the best play of each to the output
+file. When limited by simulations the states are evaluated in batches.
+RETURNS number of states evaluated
+*/
+static u32 evaluate_states(
+    simple_state_transition ** ssts,
+    u32 states,
+    u32 worker,
+    int fd
+){
+    char * ts = alloc();
+
+    static board batch[BATCH_STATES];
+    u32 batch_count = 0;
+    board b;
+    clear_board(&b);
+    out_board out_b;
+
+    u32 evaluated = 0;
+
+    for(u32 idx = worker; idx < states; idx += workers)
+    {
+        simple_state_transition * sst = ssts[idx];
+
+        timestamp(ts);
+        printf("%s: State %u (%u samples)...\n", ts, idx + 1,
+            sst->popularity);
+
+        evaluated++;
+        unpack_matrix(b.p, sst->p);
+        b.last_eaten = b.last_played = NONE;
+        if(opening_book(&out_b, &b))
+        {
+            timestamp(ts);
+            printf("%s: State already present in opening books.\n", ts);
+            continue;
+        }
+
+        if(simulations > 0)
+        {
+            memcpy(&batch[batch_count++], &b, sizeof(board));
+            if(batch_count == BATCH_STATES)
+            {
+                evaluate_batch(batch_count, batch, fd);
+                batch_count = 0;
+            }
+            continue;
+        }
+
+        u64 curr_time = current_time_in_millis();
+        u32 given = secs_per_turn * 1000;
+        u64 stop_time = curr_time + given;
+        u64 early_stop_time = curr_time + given / 3;
+        mcts_start_timed(&out_b, &b, true, stop_time, early_stop_time,
+            stop_time);
+
+        if(write_best_play(&b, &out_b, fd))
+            tt_clean_all();
+    }
+
+    if(batch_count > 0)
+        evaluate_batch(batch_count, batch, fd);
+
+    release(ts);
+    return evaluated;
+}
+
+/*
+Adds the states of the opening of a game to the table.
+*/
+static void add_game_states(
+    open_table * table,
+    const game_record * gr,
+    u32 * unique_states
+){
+    board b;
+    clear_board(&b);
+    bool is_black = true;
+
+    d16 k;
+    for(k = 0; k < MIN(ob_depth, gr->turns); ++k)
+    {
+        move m = gr->moves[k];
+
+        /* Stop at the first play that is either a capture or pass */
+        if(!is_board_move(m))
+            break;
+
+        u16 caps;
+        u8 libs = libs_after_play_slow(&b, is_black, m, &caps);
+        if(libs < 1 || caps > 0)
+            break;
+
+        board b2;
+        memcpy(&b2, &b, sizeof(board));
+
+        if(!attempt_play_slow(&b, is_black, m))
+        {
+            fprintf(stderr, "\rerror: file contains illegal plays\n");
+            exit(EXIT_FAILURE);
+        }
+
+        reduce_auto(&b2, true);
+
+        simple_state_transition stmp;
+        memset(&stmp, 0, sizeof(simple_state_transition));
+        pack_matrix(stmp.p, b2.p);
+        stmp.hash = crc32(stmp.p, PACKED_BOARD_SIZ);
+        bool inserted;
+        simple_state_transition * entry =
+            (simple_state_transition *)open_table_insert(table, &stmp,
+            &inserted);
+        entry->popularity++;
+        if(inserted) /* new state */
+            ++(*unique_states);
+
+        is_black = !is_black;
+    }
+}
+
+/*
+Adds the states of the openings of the games of a file found.
+*/
+static void read_games(
+    const char * filename,
+    void * arg
+){
+    game_states * gs = (game_states *)arg;
+    game_record * gr = gs->gr;
+    u32 fid = ++gs->files_read;
+
+    sgf_collection sc;
+    if(!open_sgf_collection(&sc, filename))
+    {
+        if(!gs->no_print)
+            printf("%u: %s skipped\n", fid, filename);
+        return;
+    }
+
+    while(import_next_game_from_sgf(gr, &sc))
+    {
+        /* Ignore handicap matches */
+        if(gr->handicap_stones.count > 0)
+        {
+            if(!gs->no_print)
+                printf("%u: %s skipped\n", fid, filename);
+            continue;
+        }
+
+        ++gs->games_used;
+        if(!gs->no_print)
+            printf("%u: %s (%u)\n", fid, filename, gr->turns);
+
+        add_game_states(gs->table, gr, &gs->unique_states);
+    }
+
+    if(sc.games_skipped > 0 && !gs->no_print)
+        printf("%u: %s %u skipped\n", fid, filename, sc.games_skipped);
+    close_sgf_collection(&sc);
+}
+
 int main(int argc, char * argv[]){
     bool no_print = false;
+    const char * resume_filename = NULL;
 
     for(int i = 1; i < argc; ++i){
         if(i < argc - 1 && strcmp(argv[i], "--time") == 0){
@@ -90,10 +344,35 @@ int main(int argc, char * argv[]){
             secs_per_turn = a;
             continue;
         }
+        if(i < argc - 1 && strcmp(argv[i], "--simulations") == 0){
+            u32 a;
+            if(!parse_uint(&a, argv[i + 1]) || a < 1)
+                goto lbl_usage;
+            ++i;
+            simulations = a;
+            continue;
+        }
         if(strcmp(argv[i], "--no_print") == 0){
             no_print = true;
             continue;
         }
+        if(strcmp(argv[i], "--light_playouts") == 0){
+            set_light_playouts(true);
+            continue;
+        }
+        if(i < argc - 1 && strcmp(argv[i], "--workers") == 0){
+            u32 a;
+            if(!parse_uint(&a, argv[i + 1]) || a < 1 || a > MAXIMUM_NUM_THREADS)
+                goto lbl_usage;
+            ++i;
+            workers = a;
+            continue;
+        }
+        if(i < argc - 1 && strcmp(argv[i], "--resume") == 0){
+            ++i;
+            resume_filename = argv[i];
+            continue;
+        }
         if(i < argc - 1 && strcmp(argv[i], "--max_depth") == 0){
             u32 a;
             if(!parse_uint(&a, argv[i + 1]) || a < 1)
@@ -108,9 +387,16 @@ lbl_usage:
         printf("Options:\n");
         printf("--max_depth number - Maximum turn depth of the openings. (defau\
 lt: %u)\n", ob_depth);
+        printf("--light_playouts - Use light playouts, faster but weaker.\n");
         printf("--no_print - Do not print SGF filenames.\n");
         printf("--time number - Time spent per rule, in seconds. (default: %u)\\
 n", secs_per_turn);
+        printf("--simulations number - Simulations per rule, instead of a tim\
+e; the states are evaluated in batches.\n");
+        printf("--workers number - States evaluated at the same time, by separ\
+ate processes. (default: 1)\n");
+        printf("--resume filename - Skip the states with rules in a previous ou\
+tput file.\n");
         exit(EXIT_SUCCESS);
     }
 
@@ -123,120 +409,54 @@ n", secs_per_turn);
     assert_data_folder_exists();
     board_constants_init();
     zobrist_init();
-    tt_init();
+
+    if(resume_filename != NULL)
+    {
+        char * filename = alloc();
+        snprintf(filename, MAX_PAGE_SIZ, "%s%s", data_folder(),
+            resume_filename);
+        opening_book_init();
+        if(!opening_book_read(filename))
+        {
+            fprintf(stderr, "error: could not read %s\n", filename);
+            exit(EXIT_FAILURE);
+        }
+        release(filename);
+    }
 
     char * str = alloc();
     char * ts = alloc();
     timestamp(ts);
     printf("%s: Creating table...\n", ts);
-    hash_table * table = hash_table_create(TABLE_BUCKETS,
+    open_table * table = open_table_create(EXPECTED_STATES,
         sizeof(simple_state_transition), hash_function, compare_function);
 
-    u32 games_used = 0;
-    u32 unique_states = 0;
+    game_states gs;
+    memset(&gs, 0, sizeof(game_states));
+    gs.table = table;
+    gs.gr = malloc(sizeof(game_record));
+    gs.no_print = no_print;
+    if(gs.gr == NULL)
+    {
+        fprintf(stderr, "error: system out of memory\n");
+        exit(EXIT_FAILURE);
+    }
 
     timestamp(ts);
-    printf("%s: Searching game record files (%s*.sgf)...\n", ts,
-        data_folder());
-    u32 filenames_found = recurse_find_files(data_folder(), ".sgf",
-        filenames, MAX_FILES);
+    printf("%s: Loading game states (%s*.sgf)\n", ts, data_folder());
+
+    u32 filenames_found = for_each_file(data_folder(), ".sgf", read_games,
+        &gs);
+    free(gs.gr);
+
     if(filenames_found == 0)
         printf("No SGF files found.\n");
     else
-        printf("Found %u SGF files.\n", filenames_found);
-
-    timestamp(ts);
-    printf("%s: Loading game states\n", ts);
-
-    char * buf = malloc(MAX_FILE_SIZ);
-    game_record * gr = malloc(sizeof(game_record));
-
-    for(u32 fid = 0; fid < filenames_found; ++fid)
-    {
-        if(!no_print)
-            printf("%u/%u: %s", fid + 1, filenames_found, filenames[fid]);
-
-        if(!import_game_from_sgf2(gr, filenames[fid], buf, MAX_FILE_SIZ))
-        {
-            if(!no_print)
-                printf(" skipped\n");
-            continue;
-        }
-
-        /* Ignore handicap matches */
-        if(gr->handicap_stones.count > 0)
-        {
-            if(!no_print)
-                printf(" skipped\n");
-            continue;
-        }
-
-        board b;
-        clear_board(&b);
-        bool is_black = true;
-
-        ++games_used;
-        if(!no_print)
-            printf(" (%u)\n", gr->turns);
-
-        d16 k;
-        for(k = 0; k < MIN(ob_depth, gr->turns); ++k)
-        {
-            move m = gr->moves[k];
-
-            /* Stop at the first play that is either a capture or pass */
-            if(!is_board_move(m))
-                break;
-
-            u16 caps;
-            u8 libs = libs_after_play_slow(&b, is_black, m, &caps);
-            if(libs < 1 || caps > 0)
-                break;
-
-            board b2;
-            memcpy(&b2, &b, sizeof(board));
-
-            if(!attempt_play_slow(&b, is_black, m))
-            {
-                fprintf(stderr, "\rerror: file contains illegal plays\n");
-                exit(EXIT_FAILURE);
-            }
-
-            reduce_auto(&b2, true);
+        printf("\nFound %u SGF files.\n", filenames_found);
 
-            simple_state_transition stmp;
-            memset(&stmp, 0, sizeof(simple_state_transition));
-            pack_matrix(stmp.p, b2.p);
-            stmp.hash = crc32(stmp.p, PACKED_BOARD_SIZ);
-            simple_state_transition * entry =
-                (simple_state_transition *)hash_table_find(table, &stmp);
-
-            if(entry == NULL) /* new state */
-            {
-                entry = (simple_state_transition *)malloc(
-                    sizeof(simple_state_transition));
-                if(entry == NULL){
-                    fprintf(stderr, "\rerror: new sst: system out of memory\n");
-                    exit(EXIT_FAILURE);
-                }
-                memset(entry, 0, sizeof(simple_state_transition));
-                memcpy(entry->p, stmp.p, PACKED_BOARD_SIZ);
-                entry->hash = stmp.hash;
-                entry->popularity = 1;
-
-                hash_table_insert(table, entry);
-                ++unique_states;
-            }
-            else
-                entry->popularity++;
-
-            is_black = !is_black;
-        }
-    }
-
-
-    printf("\nFound %u unique game states from %u games.\n", unique_states,
-        games_used);
+    u32 unique_states = gs.unique_states;
+    printf("Found %u unique game states from %u games.\n", unique_states,
+        gs.games_used);
     if(unique_states == 0)
     {
         release(ts);
@@ -247,7 +467,7 @@ n", secs_per_turn);
 
 
     simple_state_transition ** ssts =
-        (simple_state_transition **)hash_table_export_to_array(table);
+        (simple_state_transition **)open_table_export_to_array(table);
 
     qsort(ssts, unique_states, sizeof(simple_state_transition *),
         sort_cmp_function);
@@ -263,69 +483,79 @@ n", secs_per_turn);
         exit(EXIT_FAILURE);
     }
 
+    /* shared by the workers */
+    fcntl(fd, F_SETFL, O_APPEND);
+
     timestamp(ts);
     printf("%s: Created output file %s\n", ts, log_filename);
     release(log_filename);
 
-    board b;
-    clear_board(&b);
-    out_board out_b;
-
     u32 evaluated = 0;
     sync();
+    fflush(stdout);
 
-    for(u32 idx = 0; ssts[idx]; ++idx)
+    if(workers == 1)
     {
-        simple_state_transition * sst = ssts[idx];
-
-
-        timestamp(ts);
-        printf("%s: State %u (%u samples)...\n", ts, idx + 1, sst->popularity);
-
-        evaluated++;
-        unpack_matrix(b.p, sst->p);
-        b.last_eaten = b.last_played = NONE;
-        if(opening_book(&out_b, &b))
+        tt_init();
+        evaluated = evaluate_states(ssts, unique_states, 0, fd);
+    }
+    else
+    {
+        /*
+        The MCTS state is global to the process, so the states are evaluated
+        concurrently by worker processes, each with a share of the threads and
+        memory. They are forked before the first OpenMP parallel region.
+        */
+        u32 threads = MAX(1, omp_get_max_threads() / workers);
+        max_size_in_mbs = MAX(1, max_size_in_mbs / workers);
+
+        /* the workers write their numbers of states evaluated to the pipe */
+        int counts[2];
+        if(pipe(counts) == -1)
         {
-            timestamp(ts);
-            printf("%s: State already present in opening books.\n", ts);
-            continue;
+            fprintf(stderr, "error: pipe failed\n");
+            exit(EXIT_FAILURE);
         }
 
-        u64 curr_time = current_time_in_millis();
-        u32 given = secs_per_turn * 1000;
-        u64 stop_time = curr_time + given;
-        u64 early_stop_time = curr_time + given / 3;
-        mcts_start_timed(&out_b, &b, true, stop_time, early_stop_time);
-
-        out_b.pass = -1.0;
-        move best = select_play_fast(&out_b);
-
-        if(!is_board_move(best))
+        for(u32 worker = 0; worker < workers; ++worker)
         {
-            timestamp(ts);
-            printf("%s: Best play is a pass.\n", ts);
-            continue;
+            pid_t pid = fork();
+            if(pid == -1)
+            {
+                fprintf(stderr, "error: fork failed\n");
+                exit(EXIT_FAILURE);
+            }
+            if(pid == 0)
+            {
+                omp_set_num_threads(threads);
+                rand_reinit();
+                tt_init();
+                u32 count = evaluate_states(ssts, unique_states, worker, fd);
+                if(write(counts[1], &count, sizeof(u32)) != sizeof(u32))
+                    exit(EXIT_FAILURE);
+                exit(EXIT_SUCCESS);
+            }
         }
-        tt_clean_all();
+        close(counts[1]);
 
-        board_to_ob_rule(str, b.p, best);
-
-        timestamp(ts);
-        printf("%s", str);
+        int status;
+        while(wait(&status) > 0)
+            if(!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+            {
+                fprintf(stderr, "error: worker process failed\n");
+                exit(EXIT_FAILURE);
+            }
 
-        ssize_t w = write(fd, str, strlen(str));
-        if(w == -1)
-        {
-            fprintf(stderr, "error: write failed\n");
-            exit(EXIT_FAILURE);
-        }
-        sync();
+        u32 count;
+        while(read(counts[0], &count, sizeof(u32)) == sizeof(u32))
+            evaluated += count;
+        close(counts[0]);
     }
+
     close(fd);
     printf("Evaluated %u unique states.\n", evaluated);
 
-    hash_table_destroy(table, true);
+    open_table_destroy(table);
 
     timestamp(ts);
     printf("%s: Job done.\n", ts);
@@ -0,0 +1,212 @@
+/*
+Implementation of a generic hash table with open addressing
+
+The elements are copied into the table itself, in a contiguous array probed
+linearly, so inserting does not allocate per element and lookups do not follow
+pointers; the hash of each element is kept beside it, so most probes do not
+call the comparison function. The table grows to keep its load under 3/4, so
+pointers to its elements are only valid until the next insertion.
+
+Use instead of hash_table for large numbers of small elements.
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "flog.h"
+#include "open_table.h"
+#include "types.h"
+
+#define MIN_CAPACITY 16
+
+/* Fibonacci hashing, so clustered hash values are spread over the table */
+#define SLOT_OF(OT, H) ((u32)(((H) * 2654435769U) >> (OT)->shift))
+
+
+static u32 stored_hash(
+    const open_table * ot,
+    const void * elem
+){
+    u32 hash = ot->hash_func(elem);
+    return hash == 0 ? 1 : hash;
+}
+
+static void allocate_slots(
+    open_table * ot,
+    u32 capacity
+){
+    ot->capacity = capacity;
+    ot->shift = 32;
+    while(capacity > 1)
+    {
+        --ot->shift;
+        capacity /= 2;
+    }
+
+    ot->hashes = (u32 *)calloc(ot->capacity, sizeof(u32));
+    ot->slots = (u8 *)malloc((u64)ot->capacity * ot->elem_size);
+    if(ot->hashes == NULL || ot->slots == NULL)
+        flog_crit("ot", "could not allocate table memory");
+}
+
+static void * place(
+    open_table * ot,
+    u32 hash,
+    const void * elem
+){
+    u32 mask = ot->capacity - 1;
+    u32 i = SLOT_OF(ot, hash);
+    while(ot->hashes[i] != 0)
+        i = (i + 1) & mask;
+
+    ot->hashes[i] = hash;
+    void * slot = ot->slots + (u64)i * ot->elem_size;
+    memcpy(slot, elem, ot->elem_size);
+    return slot;
+}
+
+/*
+Creates an open addressing hash table for use with types of elem_size
+comparable by the functions provided, with space reserved for the number of
+elements specified.
+RETURNS generic hash table instance
+*/
+open_table * open_table_create(
+    u32 expected_elements,
+    u32 elem_size,
+    u32 (* hash_function)(const void *),
+    int (* compare_function)(const void *, const void *)
+){
+    assert(elem_size > 0);
+    assert(hash_function != NULL);
+    assert(compare_function != NULL);
+
+    open_table * ot = (open_table *)malloc(sizeof(open_table));
+    if(ot == NULL)
+        flog_crit("ot", "could not allocate table memory");
+
+    ot->elem_size = elem_size;
+    ot->elements = 0;
+    ot->hash_func = hash_function;
+    ot->cmp_func = compare_function;
+    allocate_slots(ot, MIN_CAPACITY);
+    open_table_reserve(ot, expected_elements);
+    return ot;
+}
+
+/*
+Grows the table, if needed, so the number of elements specified fits without
+further growth.
+*/
+void open_table_reserve(
+    open_table * ot,
+    u32 elements
+){
+    assert(ot != NULL);
+
+    u64 capacity = ot->capacity;
+    while((u64)elements * 4 > capacity * 3)
+        capacity *= 2;
+    if(capacity == ot->capacity)
+        return;
+    if(capacity > (1U << 31))
+        flog_crit("ot", "table too large");
+
+    u32 old_capacity = ot->capacity;
+    u32 * old_hashes = ot->hashes;
+    u8 * old_slots = ot->slots;
+
+    allocate_slots(ot, (u32)capacity);
+    for(u32 i = 0; i < old_capacity; ++i)
+        if(old_hashes[i] != 0)
+            place(ot, old_hashes[i], old_slots + (u64)i * ot->elem_size);
+
+    free(old_hashes);
+    free(old_slots);
+}
+
+/*
+Find and returns a value by comparing it with another instance of the type.
+RETURNS existing instance in the table or NULL
+*/
+void * open_table_find(
+    const open_table * ot,
+    const void * elem
+){
+    assert(ot != NULL);
+    assert(elem != NULL);
+
+    u32 hash = stored_hash(ot, elem);
+    u32 mask = ot->capacity - 1;
+    for(u32 i = SLOT_OF(ot, hash); ot->hashes[i] != 0; i = (i + 1) & mask)
+    {
+        void * slot = ot->slots + (u64)i * ot->elem_size;
+        if(ot->hashes[i] == hash && ot->cmp_func(slot, elem) == 0)
+            return slot;
+    }
+    return NULL;
+}
+
+/*
+Inserts a copy of the value in the table, unless an equal value exists; sets
+inserted, if not NULL, to whether it was inserted.
+RETURNS the instance in the table, new or existing
+*/
+void * open_table_insert(
+    open_table * ot,
+    const void * elem,
+    bool * inserted
+){
+    void * found = open_table_find(ot, elem);
+    if(inserted != NULL)
+        *inserted = (found == NULL);
+    if(found != NULL)
+        return found;
+
+    open_table_reserve(ot, ot->elements + 1);
+    ot->elements++;
+    return place(ot, stored_hash(ot, elem), elem);
+}
+
+/*
+Free the table and the elements stored in it.
+*/
+void open_table_destroy(
+    open_table * ot
+){
+    assert(ot != NULL);
+
+    free(ot->hashes);
+    free(ot->slots);
+    free(ot);
+}
+
+/*
+Allocates the necessary memory and exports pointers to the elements to an
+array, returning it. The array is one position longer to fit in a NULL
+sentinel value. The pointers are valid while the table is not changed.
+RETURNS allocated array with data
+*/
+void ** open_table_export_to_array(
+    const open_table * ot
+){
+    assert(ot != NULL);
+
+    void ** ret = (void **)malloc((ot->elements + 1) * sizeof(void *));
+    if(ret == NULL)
+        flog_crit("ot", "could not allocate table memory");
+
+    u32 curr_elem = 0;
+    for(u32 i = 0; i < ot->capacity; ++i)
+        if(ot->hashes[i] != 0)
+            ret[curr_elem++] = ot->slots + (u64)i * ot->elem_size;
+    ret[curr_elem] = NULL;
+
+    if(curr_elem != ot->elements)
+        flog_crit("ot", "unexpected number of elements exported");
+
+    return ret;
+}
@@ -4,6 +4,7 @@ Strategy that makes use of an opening book.
 
 #include "config.h"
 
+#include <pthread.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,9 +16,11 @@ Strategy that makes use of an opening book.
 #include "alloc.h"
 #include "board.h"
 #include "crc32.h"
+#include "data_pack.h"
 #include "engine.h"
 #include "file_io.h"
 #include "flog.h"
+#include "mem_usage.h"
 #include "opening_book.h"
 #include "primes.h"
 #include "pts_file.h"
@@ -25,17 +28,103 @@ Strategy that makes use of an opening book.
 #include "stringm.h"
 #include "types.h"
 
+/*
+Layout of the data pack section: a header followed by the hashes of the rules,
+in ascending order, padded to a multiple of 8 bytes; and then the rules in the
+same order. Rules with the same hash are ordered by position.
+*/
+typedef struct __ob_pack_header_ {
+    u32 entries;
+    u32 unused;
+} ob_pack_header;
+
+typedef struct __ob_pack_entry_ {
+    move play;
+    u8 p[PACKED_BOARD_SIZ];
+} ob_pack_entry;
+
+/* for sorting the rules when generating the section */
+typedef struct __ob_sort_entry_ {
+    u32 hash;
+    const ob_entry * e;
+} ob_sort_entry;
+
 static ob_entry ** ob_trans_table;
 static bool attempted_discover_ob = false;
+static bool reading_in_background = false;
+static pthread_t background_reader;
 static u32 ob_rules = 0;
 static u32 nr_buckets = 0;
 
+/* rules read from the data pack instead, if not NULL */
+static const ob_pack_header * ob_pack = NULL;
+static const u32 * ob_pack_hashes = NULL;
+static const ob_pack_entry * ob_pack_entries = NULL;
+
 #define MAX_RULE_TOKENS (TOTAL_BOARD_SIZ + TOTAL_BOARD_SIZ / 2)
 
+static u64 pack_hashes_size(
+    u32 entries
+){
+    return ((entries * sizeof(u32) + 7) / 8) * 8;
+}
+
+/*
+Interpolation search over the hashes, which are uniformly distributed, followed
+by a comparison of the positions with the same hash.
+*/
+static move ob_get_packed_play(
+    u32 hash,
+    const u8 p[PACKED_BOARD_SIZ]
+){
+    const u32 * hashes = ob_pack_hashes;
+    u32 entries = ob_pack->entries;
+    if(entries == 0 || hash < hashes[0] || hash > hashes[entries - 1])
+        return NONE;
+
+    u32 lo = 0;
+    u32 hi = entries - 1;
+    u32 i;
+    while(1)
+    {
+        if(hashes[hi] == hashes[lo])
+            i = lo;
+        else
+            i = lo + (u32)(((u64)(hash - hashes[lo]) * (hi - lo)) /
+                (hashes[hi] - hashes[lo]));
+
+        if(hashes[i] == hash)
+            break;
+        if(hashes[i] < hash)
+            lo = i + 1;
+        else
+            hi = i - 1;
+        if(lo > hi || hash < hashes[lo] || hash > hashes[hi])
+            return NONE;
+    }
+
+    while(i > 0 && hashes[i - 1] == hash)
+        --i;
+    for(; i < entries && hashes[i] == hash; ++i)
+        if(memcmp(ob_pack_entries[i].p, p, PACKED_BOARD_SIZ) == 0)
+            return ob_pack_entries[i].play;
+    return NONE;
+}
+
 static move ob_get_play(
     u32 hash,
     const u8 p[PACKED_BOARD_SIZ]
 ){
+    if(ob_pack != NULL)
+    {
+        move m = ob_get_packed_play(hash, p);
+        if(m != NONE)
+            return m;
+    }
+
+    if(ob_trans_table == NULL)
+        return NONE;
+
     ob_entry * h = ob_trans_table[hash % nr_buckets];
     while(h != NULL)
     {
@@ -178,6 +267,7 @@ static bool process_opening_book_line(
     ob_entry * obe = malloc(sizeof(ob_entry));
     if(obe == NULL)
         flog_crit("ob", "system out of memory");
+    mem_usage_add(MEM_OPENING_BOOK, sizeof(ob_entry));
 
     obe->hash = hash;
     memcpy(obe->p, packed_board, PACKED_BOARD_SIZ);
@@ -187,30 +277,25 @@ static bool process_opening_book_line(
 }
 
 /*
-Discover and read opening book files.
+Reads an opening book file, adding its rules to those already known, unless
+already present.
+RETURNS false if the file could not be read
 */
-void opening_book_init()
-{
-    if(attempted_discover_ob)
-        return;
-
-    attempted_discover_ob = true;
-
-    nr_buckets = get_prime_near(BOARD_SIZ * BOARD_SIZ * BOARD_SIZ * 2);
-
-    /*
-    Allocate O.B. hash table
-    */
-    ob_trans_table = (ob_entry **)calloc(nr_buckets, sizeof(ob_entry *));
+bool opening_book_read(
+    const char * filename
+){
     if(ob_trans_table == NULL)
-        flog_crit("ob", "system out of memory");
-
-    /*
-    Read .ob file
-    */
-    char * filename = alloc();
-    snprintf(filename, MAX_PAGE_SIZ, "%s%ux%u.ob", data_folder(), BOARD_SIZ,
-        BOARD_SIZ);
+    {
+        nr_buckets = get_prime_near(BOARD_SIZ * BOARD_SIZ * BOARD_SIZ * 2);
+
+        /*
+        Allocate O.B. hash table
+        */
+        ob_trans_table = (ob_entry **)calloc(nr_buckets, sizeof(ob_entry *));
+        if(ob_trans_table == NULL)
+            flog_crit("ob", "system out of memory");
+        mem_usage_add(MEM_OPENING_BOOK, nr_buckets * sizeof(ob_entry *));
+    }
 
     char * buffer = malloc(MAX_FILE_SIZ);
     if(buffer == NULL)
@@ -223,8 +308,8 @@ void opening_book_init()
         snprintf(s, MAX_PAGE_SIZ, "could not read %s", filename);
         flog_warn("ob", s);
         release(s);
-        release(filename);
-        return;
+        free(buffer);
+        return false;
     }
 
     u32 rules_saved = 0;
@@ -241,14 +326,163 @@ void opening_book_init()
         ++rules_found;
     }
 
-    ob_rules = rules_saved;
+    ob_rules += rules_saved;
 
     char * s = alloc();
-    snprintf(s, MAX_PAGE_SIZ, "read %s (%u/%u rules)", filename, rules_saved, rules_found);
+    snprintf(s, MAX_PAGE_SIZ, "read %s (%u/%u rules)", filename, rules_saved,
+        rules_found);
     flog_info("ob", s);
     release(s);
-    release(filename);
     free(buffer);
+    return true;
+}
+
+static void discover_opening_books()
+{
+    char * filename = alloc();
+    snprintf(filename, MAX_PAGE_SIZ, "%s%ux%u.ob", data_folder(), BOARD_SIZ,
+        BOARD_SIZ);
+
+    u64 packed_size;
+    const ob_pack_header * h = (const ob_pack_header *)data_pack_section(
+        DATA_PACK_OPENING_BOOK, file_fingerprint(filename), &packed_size);
+    if(h != NULL && packed_size >= sizeof(ob_pack_header) && packed_size ==
+        sizeof(ob_pack_header) + pack_hashes_size(h->entries) +
+        (u64)h->entries * sizeof(ob_pack_entry))
+    {
+        ob_pack = h;
+        ob_pack_hashes = (const u32 *)(h + 1);
+        ob_pack_entries = (const ob_pack_entry *)((const u8 *)ob_pack_hashes +
+            pack_hashes_size(h->entries));
+        ob_rules = h->entries;
+
+        char * s = alloc();
+        snprintf(s, MAX_PAGE_SIZ, "read data pack (%u rules)", ob_rules);
+        flog_info("ob", s);
+        release(s);
+        release(filename);
+        return;
+    }
+
+    opening_book_read(filename);
+    release(filename);
+}
+
+/*
+Discover and read opening book files. If they are being read in the background
+waits for it to finish instead.
+*/
+void opening_book_init()
+{
+    if(reading_in_background)
+    {
+        pthread_join(background_reader, NULL);
+        reading_in_background = false;
+        return;
+    }
+
+    if(attempted_discover_ob)
+        return;
+
+    attempted_discover_ob = true;
+    discover_opening_books();
+}
+
+static void * background_discover(
+    void * arg
+){
+    (void)arg;
+    discover_opening_books();
+    return NULL;
+}
+
+/*
+Discover and read opening book files in a background thread, so the program can
+do other work meanwhile; they are waited for by the first call to
+opening_book_init or opening_book. Reads them immediately if the thread could
+not be started. The board constants must have been initialized.
+*/
+void opening_book_init_background()
+{
+    if(attempted_discover_ob)
+        return;
+
+    attempted_discover_ob = true;
+    if(pthread_create(&background_reader, NULL, background_discover, NULL) ==
+        0)
+        reading_in_background = true;
+    else
+        discover_opening_books();
+}
+
+static int sort_pack_entries(
+    const void * a,
+    const void * b
+){
+    const ob_sort_entry * e1 = (const ob_sort_entry *)a;
+    const ob_sort_entry * e2 = (const ob_sort_entry *)b;
+    if(e1->hash != e2->hash)
+        return e1->hash < e2->hash ? -1 : 1;
+    return memcmp(e1->e->p, e2->e->p, PACKED_BOARD_SIZ);
+}
+
+/*
+Contents of the opening book section of a data pack, with the rules read by
+opening_book_init; and the fingerprint of the file read.
+RETURNS newly allocated section contents, or NULL if no rules were read
+*/
+void * opening_book_pack_section(
+    u64 * size,
+    u32 * fingerprint
+){
+    if(ob_rules == 0)
+        return NULL;
+
+    u32 entries = ob_pack != NULL ? ob_pack->entries : ob_rules;
+    *size = sizeof(ob_pack_header) + pack_hashes_size(entries) +
+        (u64)entries * sizeof(ob_pack_entry);
+    ob_pack_header * h = (ob_pack_header *)calloc(1, *size);
+    if(h == NULL)
+        flog_crit("ob", "system out of memory");
+
+    if(ob_pack != NULL)
+        memcpy(h, ob_pack, *size);
+    else
+    {
+        ob_sort_entry * sorted = (ob_sort_entry *)malloc(ob_rules *
+            sizeof(ob_sort_entry));
+        if(sorted == NULL)
+            flog_crit("ob", "system out of memory");
+
+        u32 i = 0;
+        for(u32 b = 0; b < nr_buckets; ++b)
+            for(ob_entry * e = ob_trans_table[b]; e != NULL; e = e->next)
+            {
+                sorted[i].hash = e->hash;
+                sorted[i].e = e;
+                ++i;
+            }
+        qsort(sorted, ob_rules, sizeof(ob_sort_entry), sort_pack_entries);
+
+        h->entries = ob_rules;
+        u32 * hashes = (u32 *)(h + 1);
+        ob_pack_entry * entries = (ob_pack_entry *)((u8 *)hashes +
+            pack_hashes_size(ob_rules));
+        for(i = 0; i < ob_rules; ++i)
+        {
+            hashes[i] = sorted[i].hash;
+            entries[i].play = sorted[i].e->play;
+            memcpy(entries[i].p, sorted[i].e->p, PACKED_BOARD_SIZ);
+        }
+        free(sorted);
+    }
+
+    char * filename = alloc();
+    snprintf(filename, MAX_PAGE_SIZ, "%s%ux%u.ob", data_folder(), BOARD_SIZ,
+        BOARD_SIZ);
+    *fingerprint = file_fingerprint(filename);
+    release(filename);
+    return h;
 }
 
 /*
@@ -0,0 +1,378 @@
+/*
+Functions that support the use of 12-point diamond patterns: the 3x3
+neighborhood of a play plus the four intersections at distance two in line,
+learned from game records with the weights of how often the play was selected.
+
+The life of these patterns is as follow:
+ * The pattern of each empty intersection is kept up to date by the CFG board,
+ as its 3x3 hash followed by the codification of the four outer intersections,
+ so reading it costs nothing.
+
+ * On startup the NxN.pat12 weights file is read, if present. Each pattern is
+ flipped and rotated and stored, from the perspective of black, in an open
+ addressed hash table. Lookups for white invert the colors first.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "alloc.h"
+#include "board.h"
+#include "data_pack.h"
+#include "engine.h"
+#include "file_io.h"
+#include "flog.h"
+#include "mem_usage.h"
+#include "move.h"
+#include "pat12.h"
+#include "pat3.h"
+#include "stringm.h"
+#include "types.h"
+
+/*
+Offsets of the intersections of a pattern, in the order they are codified from
+the most significant bits; the first eight are the 3x3 neighborhood, in the
+order of its hash.
+*/
+const d8 pat12_offsets[PAT12_POINTS][2] =
+{
+    { -1, -1 }, { -1, 0 }, { -1, 1 },
+    { 0, -1 }, { 0, 1 },
+    { 1, -1 }, { 1, 0 }, { 1, 1 },
+    { -2, 0 }, { 0, -2 }, { 0, 2 }, { 2, 0 }
+};
+
+#define EMPTY_KEY 0xffffffff
+
+static bool pat12_inited = false;
+
+/*
+Keys are patterns from the perspective of black, or EMPTY_KEY; they are either
+read from the weights file or from the data pack section.
+*/
+static const u32 * table_keys = NULL;
+static const u16 * table_weights = NULL;
+static u32 table_mask = 0;
+static u8 table_shift = 0;
+static u32 table_elements = 0;
+
+static u32 table_slot(
+    u32 value
+){
+    return (value * 2654435761U) >> table_shift;
+}
+
+/*
+Layout of the data pack section, followed by the keys and weights tables.
+*/
+typedef struct __pat12_pack_header_ {
+    u32 slots;
+    u32 elements;
+    u32 shift;
+    u32 unused;
+} pat12_pack_header;
+
+static void table_insert(
+    u32 * keys,
+    u16 * weights,
+    u32 value,
+    u16 weight
+){
+    u32 i = table_slot(value);
+    while(keys[i] != EMPTY_KEY)
+    {
+        if(keys[i] == value)
+            return;
+        i = (i + 1) & table_mask;
+    }
+    keys[i] = value;
+    weights[i] = weight;
+    table_elements++;
+}
+
+/*
+Lookup of pattern weight for the specified player.
+RETURNS pattern weight or 0 if not found
+*/
+u16 pat12_find(
+    u32 value,
+    bool is_black
+){
+    if(table_keys == NULL)
+        return 0;
+
+    if(!is_black)
+        value = pat12_invert(value);
+
+    u32 i = table_slot(value);
+    while(table_keys[i] != EMPTY_KEY)
+    {
+        if(table_keys[i] == value)
+            return table_weights[i];
+        i = (i + 1) & table_mask;
+    }
+    return 0;
+}
+
+/*
+RETURNS whether 12-point pattern weights were read
+*/
+bool pat12_in_use()
+{
+    return table_keys != NULL;
+}
+
+static u8 offset_index(
+    d8 dx,
+    d8 dy
+){
+    for(u8 k = 0; k < PAT12_POINTS; ++k)
+        if(pat12_offsets[k][0] == dx && pat12_offsets[k][1] == dy)
+            return k;
+
+    flog_crit("pat12", "pattern offset not found");
+    return 0;
+}
+
+/*
+Applies one of the 8 symmetries of the square to a pattern: bit 0 of symmetry
+transposes it, bit 1 flips it vertically and bit 2 horizontally.
+RETURNS pattern value transformed
+*/
+static u32 transform(
+    u32 value,
+    u8 symmetry
+){
+    u32 ret = 0;
+    for(u8 k = 0; k < PAT12_POINTS; ++k)
+    {
+        d8 dx = pat12_offsets[k][0];
+        d8 dy = pat12_offsets[k][1];
+        if(symmetry & 1)
+        {
+            d8 t = dx;
+            dx = dy;
+            dy = t;
+        }
+        if(symmetry & 2)
+            dx = -dx;
+        if(symmetry & 4)
+            dy = -dy;
+
+        u32 point = (value >> (PAT12_BITS - 2 - 2 * k)) & 3;
+        ret |= point << (PAT12_BITS - 2 - 2 * offset_index(dx, dy));
+    }
+    return ret;
+}
+
+/*
+Rotate and flip the pattern to its unique representative, the lowest value of
+all its forms.
+RETURNS pattern value reduced
+*/
+u32 pat12_reduce_auto(
+    u32 value
+){
+    u32 ret = value;
+    for(u8 s = 1; s < 8; ++s)
+    {
+        u32 t = transform(value, s);
+        if(t < ret)
+            ret = t;
+    }
+    return ret;
+}
+
+/*
+Invert stone colors.
+RETURNS pattern value with colors inverted
+*/
+u32 pat12_invert(
+    u32 value
+){
+    /* swaps black and white, while empty and the border stay the same */
+    return ((value & 0x555555) << 1) | ((value & 0xaaaaaa) >> 1);
+}
+
+/*
+Codifies the pattern of intersection m of a board, with board safety.
+RETURNS pattern value
+*/
+u32 pat12_from_board(
+    const u8 p[TOTAL_BOARD_SIZ],
+    move m
+){
+    u8 x;
+    u8 y;
+    move_to_coord(m, &x, &y);
+
+    u32 ret = 0;
+    for(u8 k = 0; k < PAT12_POINTS; ++k)
+    {
+        d8 i = x + pat12_offsets[k][0];
+        d8 j = y + pat12_offsets[k][1];
+        u32 point = ILLEGAL;
+        if(i >= 0 && j >= 0 && i < BOARD_SIZ && j < BOARD_SIZ)
+            point = p[coord_to_move(i, j)];
+        ret = (ret << 2) | point;
+    }
+    return ret;
+}
+
+static void read_pat12_weights(
+    char * buffer,
+    u32 lines
+){
+    /* at most 8 forms per pattern, at most half full */
+    u32 slots = 1;
+    table_shift = 32;
+    while(slots < lines * 16)
+    {
+        slots *= 2;
+        table_shift--;
+    }
+    table_mask = slots - 1;
+    u32 * keys = (u32 *)malloc(slots * sizeof(u32));
+    u16 * weights = (u16 *)malloc(slots * sizeof(u16));
+    if(keys == NULL || weights == NULL)
+        flog_crit("pat12", "system out of memory");
+    mem_usage_add(MEM_PATTERNS, slots * (sizeof(u32) + sizeof(u16)));
+    memset(keys, 0xff, slots * sizeof(u32));
+    table_keys = keys;
+    table_weights = weights;
+
+    char * line;
+    char * init_str = buffer;
+    char * save_ptr;
+    while((line = strtok_r(init_str, "\r\n", &save_ptr)) != NULL)
+    {
+        init_str = NULL;
+
+        line_cut_before(line, '#');
+        line = trim(line);
+        if(line == NULL)
+            continue;
+        u16 len = strlen(line);
+        if(len == 0)
+            continue;
+
+        char * save_ptr2;
+        char * word1 = strtok_r(line, " ", &save_ptr2);
+        if(word1 == NULL)
+            continue;
+        char * word2 = strtok_r(NULL, " ", &save_ptr2);
+        if(word2 == NULL)
+            continue;
+
+        long int tmp1 = strtol(word1, NULL, 16);
+        long int tmp2 = strtol(word2, NULL, 10);
+        if(tmp1 < 0 || tmp1 >= (1 << PAT12_BITS) || tmp2 < 0 || tmp2 > 65535)
+            continue;
+
+        /* weight scaling like for 3x3 patterns */
+        u16 weight = (u16)((tmp2 / WEIGHT_SCALE) + 1);
+
+        for(u8 s = 0; s < 8; ++s)
+            table_insert(keys, weights, transform((u32)tmp1, s), weight);
+    }
+}
+
+/*
+Reads the 12-point pattern weights file, if present, and expands all patterns
+into their rotations and flips.
+*/
+void pat12_init()
+{
+    if(pat12_inited)
+        return;
+    pat12_inited = true;
+
+    char * filename = alloc();
+    snprintf(filename, MAX_PAGE_SIZ, "%s%ux%u.pat12", data_folder(), BOARD_SIZ,
+        BOARD_SIZ);
+
+    u64 packed_size;
+    const pat12_pack_header * h = (const pat12_pack_header *)
+        data_pack_section(DATA_PACK_PAT12, file_fingerprint(filename),
+        &packed_size);
+    if(h != NULL && packed_size >= sizeof(pat12_pack_header) && h->slots > 0 &&
+        (h->slots & (h->slots - 1)) == 0 && packed_size ==
+        sizeof(pat12_pack_header) + (u64)h->slots * (sizeof(u32) + sizeof(u16)))
+    {
+        table_keys = (const u32 *)(h + 1);
+        table_weights = (const u16 *)(table_keys + h->slots);
+        table_mask = h->slots - 1;
+        table_shift = h->shift;
+        table_elements = h->elements;
+
+        char * s = alloc();
+        snprintf(s, MAX_PAGE_SIZ, "read data pack (%u expanded patterns)",
+            table_elements);
+        flog_info("pat12", s);
+        release(s);
+        release(filename);
+        return;
+    }
+
+    char * file_buf = (char *)malloc(MAX_FILE_SIZ);
+    if(file_buf == NULL)
+        flog_crit("pat12", "system out of memory");
+
+    d32 chars_read = read_ascii_file(file_buf, MAX_FILE_SIZ, filename);
+    if(chars_read >= 0)
+    {
+        u32 lines = 1;
+        for(d32 i = 0; i < chars_read; ++i)
+            if(file_buf[i] == '\n')
+                ++lines;
+
+        read_pat12_weights(file_buf, lines);
+
+        char * s = alloc();
+        snprintf(s, MAX_PAGE_SIZ, "read %s (%u expanded patterns)", filename,
+            table_elements);
+        flog_info("pat12", s);
+        release(s);
+    }
+
+    release(filename);
+    free(file_buf);
+}
+
+/*
+Contents of the 12-point patterns section of a data pack, after pat12_init; and
+the fingerprint of the file read.
+RETURNS newly allocated section contents, or NULL if no weights were read
+*/
+void * pat12_pack_section(
+    u64 * size,
+    u32 * fingerprint
+){
+    if(table_keys == NULL)
+        return NULL;
+
+    u32 slots = table_mask + 1;
+    *size = sizeof(pat12_pack_header) + slots * (sizeof(u32) + sizeof(u16));
+    pat12_pack_header * h = (pat12_pack_header *)malloc(*size);
+    if(h == NULL)
+        flog_crit("pat12", "system out of memory");
+
+    h->slots = slots;
+    h->elements = table_elements;
+    h->shift = table_shift;
+    h->unused = 0;
+    u32 * keys = (u32 *)(h + 1);
+    memcpy(keys, table_keys, slots * sizeof(u32));
+    memcpy(keys + slots, table_weights, slots * sizeof(u16));
+
+    char * filename = alloc();
+    snprintf(filename, MAX_PAGE_SIZ, "%s%ux%u.pat12", data_folder(), BOARD_SIZ,
+        BOARD_SIZ);
+    *fingerprint = file_fingerprint(filename);
+    release(filename);
+    return h;
+}
@@ -22,21 +22,26 @@ The life of these patterns is as follow:
 
 #include "alloc.h"
 #include "board.h"
+#include "data_pack.h"
 #include "engine.h"
 #include "file_io.h"
 #include "flog.h"
-#include "hash_table.h"
 #include "matrix.h"
+#include "mem_usage.h"
+#include "open_table.h"
 #include "pat3.h"
 #include "stringm.h"
 #include "types.h"
 
 
-static u16 b_pattern_table[65536];
-static u16 w_pattern_table[65536];
+static u16 b_table[65536];
+static u16 w_table[65536];
+/* either the tables above or the data pack section */
+static const u16 * b_pattern_table = b_table;
+static const u16 * w_pattern_table = w_table;
 static bool pat3_table_inited = false;
 
-static hash_table * weights_table = NULL;
+static open_table * weights_table = NULL;
 static u32 weights_found = 0;
 static u32 weights_not_found = 0;
 
@@ -89,10 +94,10 @@ static void pat3_insert(
     u16 weight
 ){
     /* patterns from blacks perspective */
-    b_pattern_table[value] = weight;
+    b_table[value] = weight;
 
     /* patterns from whites perspective */
-    w_pattern_table[value_inv] = weight;
+    w_table[value_inv] = weight;
 }
 
 /*
@@ -106,6 +111,17 @@ u16 pat3_find(
     return is_black ? b_pattern_table[value] : w_pattern_table[value];
 }
 
+/*
+Pattern weights for the specified player, indexed directly by pattern value; so
+loops over many patterns of the same player can skip calling pat3_find.
+RETURNS table of 65536 pattern weights, 0 if not found
+*/
+const u16 * pat3_weights(
+    bool is_black
+){
+    return is_black ? b_pattern_table : w_pattern_table;
+}
+
 static void flip(
     const u8 src[3][3],
     u8 dst[3][3]
@@ -314,7 +330,7 @@ static void multiply_and_store(
         u16 pattern = pat3_to_string((const u8 (*)[3])p);
         pat3 tmp;
         tmp.value = pattern;
-        pat3 * tmp2 = (pat3 *)hash_table_find(weights_table, &tmp);
+        pat3 * tmp2 = (pat3 *)open_table_find(weights_table, &tmp);
         if(tmp2 == NULL)
         {
             weight = (65535 / WEIGHT_SCALE);
@@ -442,9 +458,9 @@ static u32 read_pat3_file(
 }
 
 static u32 pat3_hash_function(
-    void * a
+    const void * a
 ){
-    pat3 * b = (pat3 *)a;
+    const pat3 * b = (const pat3 *)a;
     return b->value;
 }
 
@@ -452,15 +468,15 @@ static int pat3_compare_function(
     const void * a,
     const void * b
 ){
-    pat3 * f1 = (pat3 *)a;
-    pat3 * f2 = (pat3 *)b;
+    const pat3 * f1 = (const pat3 *)a;
+    const pat3 * f2 = (const pat3 *)b;
     return ((d32)(f2->value)) - ((d32)(f1->value));
 }
 
 static u32 read_patern_weights(
     char * buffer
 ){
-    weights_table = hash_table_create(1543, sizeof(pat3), pat3_hash_function,
+    weights_table = open_table_create(1543, sizeof(pat3), pat3_hash_function,
         pat3_compare_function);
 
     char * line;
@@ -496,16 +512,43 @@ static u32 read_patern_weights(
         tmp2 = (tmp2 / WEIGHT_SCALE) + 1;
         u16 weight = (u16)tmp2;
 
-        pat3 * p = malloc(sizeof(pat3));
-        p->value = pattern;
-        p->weight = weight;
-        if(!hash_table_exists(weights_table, p))
-            hash_table_insert_unique(weights_table, p);
+        pat3 p;
+        p.value = pattern;
+        p.weight = weight;
+        open_table_insert(weights_table, &p, NULL);
     }
 
     return weights_table->elements;
 }
 
+/*
+Fingerprint of the weights and patterns files read by pat3_init.
+*/
+static u32 sources_fingerprint()
+{
+    u32 ret = 0;
+
+    if(USE_PATTERN_WEIGHTS)
+    {
+        char * filename = alloc();
+        snprintf(filename, MAX_PAGE_SIZ, "%s%ux%u.weights", data_folder(),
+            BOARD_SIZ, BOARD_SIZ);
+        ret ^= file_fingerprint(filename);
+        release(filename);
+    }
+
+    char * pat3_filenames[128];
+    u32 files_found = recurse_find_files(data_folder(), ".pat3",
+        pat3_filenames, 128);
+    for(u32 i = 0; i < files_found; ++i)
+    {
+        ret ^= file_fingerprint(pat3_filenames[i]);
+        free(pat3_filenames[i]);
+    }
+
+    return ret;
+}
+
 /*
 Reads a .pat3 patterns file and expands all patterns into all possible and
 patternable configurations.
@@ -516,6 +559,17 @@ void pat3_init()
         return;
     pat3_table_inited = true;
 
+    u64 packed_size;
+    const u16 * packed = (const u16 *)data_pack_section(DATA_PACK_PAT3,
+        sources_fingerprint(), &packed_size);
+    if(packed != NULL && packed_size == sizeof(b_table) + sizeof(w_table))
+    {
+        b_pattern_table = packed;
+        w_pattern_table = packed + 65536;
+        flog_info("pat3", "read expanded patterns from data pack");
+        return;
+    }
+
     char * file_buf = (char *)malloc(MAX_FILE_SIZ);
     if(file_buf == NULL)
         flog_crit("pat3", "system out of memory");
@@ -571,6 +625,7 @@ void pat3_init()
     }
 
     free(file_buf);
+    mem_usage_add(MEM_PATTERNS, sizeof(b_table) + sizeof(w_table));
 
     if(USE_PATTERN_WEIGHTS && weights_table != NULL)
     {
@@ -578,11 +633,28 @@ void pat3_init()
             weights_found + weights_not_found);
         flog_info("pat3", buf);
 
-        hash_table_destroy(weights_table, true);
+        open_table_destroy(weights_table);
         weights_table = NULL;
     }
 
     release(buf);
 }
 
-
+/*
+Contents of the 3x3 patterns section of a data pack, after pat3_init: the
+tables of weights of black and white; and the fingerprint of the files read.
+RETURNS newly allocated section contents
+*/
+void * pat3_pack_section(
+    u64 * size,
+    u32 * fingerprint
+){
+    u16 * ret = (u16 *)malloc(sizeof(b_table) + sizeof(w_table));
+    if(ret == NULL)
+        flog_crit("pat3", "system out of memory");
+    memcpy(ret, b_pattern_table, sizeof(b_table));
+    memcpy(ret + 65536, w_pattern_table, sizeof(w_table));
+    *size = sizeof(b_table) + sizeof(w_table);
+    *fingerprint = sources_fingerprint();
+    return ret;
+}
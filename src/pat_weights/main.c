@@ -2,6 +2,12 @@
 Simple application for grading 3x3 patterns by frequency of selection in SGF
 records. The results are written to data/NxN.weights.new.
 
+With --pat12 the 12-point patterns are graded instead, for data/NxN.pat12.new.
+
+After replacing the weights file, run gen_data_pack so Matilda reads the
+patterns already expanded and weighted, from data/NxN.pack, instead of expanding
+them at startup.
+
 The number of appearances is not normalized. If a pattern appears multiple times
 it will be selected as winner or loser multiple times. In contrast with
 considering only unique patterns per state, this does not privilege patterns
@@ -15,6 +21,7 @@ maximum total on a 3x3 neighborship fits 16 bits.
 #include "config.h"
 
 #include <unistd.h>
+#include <omp.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -25,8 +32,9 @@ maximum total on a 3x3 neighborship fits 16 bits.
 #include "engine.h"
 #include "file_io.h"
 #include "flog.h"
-#include "hash_table.h"
 #include "move.h"
+#include "open_table.h"
+#include "pat12.h"
 #include "pat3.h"
 #include "randg.h"
 #include "sgf.h"
@@ -34,22 +42,20 @@ maximum total on a 3x3 neighborship fits 16 bits.
 #include "tactical.h"
 #include "timem.h"
 #include "types.h"
-
-
-#define MAX_FILES 500000
+#include "zobrist.h"
 
 
 typedef struct __pat3t_ {
-    u16 value;
+    u32 value;
     u32 wins;
     u32 appearances;
-    struct __pat3_ * next;
 } pat3t;
 
 
-static u32 pat3t_hash_function(void * a)
-{
-    pat3t * b = (pat3t *)a;
+static u32 pat3t_hash_function(
+    const void * a
+){
+    const pat3t * b = (const pat3t *)a;
     return b->value;
 }
 
@@ -57,39 +63,293 @@ static int pat3t_compare_function(
     const void * a,
     const void * b
 ){
-    pat3t * f1 = (pat3t *)a;
-    pat3t * f2 = (pat3t *)b;
+    const pat3t * f1 = (const pat3t *)a;
+    const pat3t * f2 = (const pat3t *)b;
     return ((d32)(f2->value)) - ((d32)(f1->value));
 }
 
-static char * filenames[MAX_FILES];
+/*
+Counts of wins and appearances of patterns, kept by each thread and merged at
+the end. 3x3 pattern values fit 16 bits and are counted in flat arrays; 12-point
+patterns in a hash table.
+*/
+typedef struct __pattern_counter_ {
+    u32 * wins;
+    u32 * appearances;
+    open_table * table;
+} pattern_counter;
+
+static bool use_pat12 = false;
+static bool no_print = false;
+
+static u32 files_read = 0;
+static u32 games_skipped = 0;
+static u32 games_used = 0;
+
+static pattern_counter own;
+static game_record * thread_gr;
+#pragma omp threadprivate(own, thread_gr)
 
-static u16 get_pattern(
+static u32 get_pattern(
     cfg_board * cb,
     move m
 ){
+    if(use_pat12)
+        return pat12_reduce_auto(PAT12_CODE(cb, m));
+
     u8 v[3][3];
     pat3_transpose(v, cb->p, m);
     pat3_reduce_auto(v);
     return pat3_to_string((const u8 (*)[3])v);
 }
 
+static void counter_init(
+    pattern_counter * c
+){
+    if(use_pat12)
+    {
+        c->wins = c->appearances = NULL;
+        c->table = open_table_create(1543, sizeof(pat3t), pat3t_hash_function,
+            pat3t_compare_function);
+    }
+    else
+    {
+        c->wins = (u32 *)calloc(65536, sizeof(u32));
+        c->appearances = (u32 *)calloc(65536, sizeof(u32));
+        if(c->wins == NULL || c->appearances == NULL)
+        {
+            fprintf(stderr, "error: system out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        c->table = NULL;
+    }
+}
+
+static void counter_add(
+    pattern_counter * c,
+    u32 pattern,
+    u32 wins,
+    u32 appearances
+){
+    if(!use_pat12)
+    {
+        c->wins[pattern] += wins;
+        c->appearances[pattern] += appearances;
+        return;
+    }
+
+    pat3t tmp;
+    tmp.value = pattern;
+    tmp.wins = 0;
+    tmp.appearances = 0;
+    pat3t * found = (pat3t *)open_table_insert(c->table, &tmp, NULL);
+
+    found->wins += wins;
+    found->appearances += appearances;
+}
+
+/*
+Adds the counts of src to dst and frees src.
+*/
+static void counter_merge(
+    pattern_counter * dst,
+    pattern_counter * src
+){
+    if(!use_pat12)
+    {
+        for(u32 i = 0; i < 65536; ++i)
+        {
+            dst->wins[i] += src->wins[i];
+            dst->appearances[i] += src->appearances[i];
+        }
+        free(src->wins);
+        free(src->appearances);
+        return;
+    }
+
+    pat3t ** table = (pat3t **)open_table_export_to_array(src->table);
+    for(u32 i = 0; table[i] != NULL; ++i)
+        counter_add(dst, table[i]->value, table[i]->wins,
+            table[i]->appearances);
+    free(table);
+    open_table_destroy(src->table);
+}
+
+/*
+Counts the patterns of the legal plays for each play of the winner, in the first
+two thirds of the game, and the patterns selected.
+*/
+static void learn_from_game(
+    const game_record * gr,
+    pattern_counter * c
+){
+    board b;
+    clear_board(&b);
+
+    bool winner_is_black = gr->final_score > 0;
+    bool is_black = false;
+
+    u16 total_turns = (gr->turns * 2) / 3;
+
+    for(d16 k = 0; k < total_turns; ++k)
+    {
+        is_black = !is_black;
+        move m = gr->moves[k];
+
+        if(m == PASS)
+            pass(&b);
+        else
+        {
+            if(is_black == winner_is_black)
+            {
+                cfg_board cb;
+                cfg_from_board(&cb, &b);
+
+                u32 winner_pattern = get_pattern(&cb, m);
+
+                for(move n = 0; n < TOTAL_BOARD_SIZ; ++n)
+                {
+                    if(cb.p[n] != EMPTY)
+                        continue;
+
+                    if(ko_violation(&cb, n))
+                        continue;
+
+                    bool captures;
+                    if(safe_to_play2(&cb, true, n, &captures) == 0)
+                        continue;
+
+                    u32 pattern = get_pattern(&cb, n);
+                    counter_add(c, pattern, pattern == winner_pattern ? 1 : 0,
+                        1);
+                }
+
+                cfg_board_free(&cb);
+            }
+            just_play_slow(&b, true, m);
+        }
+
+        invert_color(b.p);
+    }
+}
+
+static void write_pattern(
+    FILE * fp,
+    u32 value,
+    u32 wins,
+    u32 appearances
+){
+    char buf[64];
+    double weight = (((double)wins) / ((double)appearances)) * 65535.0;
+    snprintf(buf, 64, use_pat12 ? "%06x %5u %u\n" : "%04x %5u %u\n", value,
+        (u32)weight, appearances);
+    size_t w = fwrite(buf, strlen(buf), 1, fp);
+    if(w != 1)
+    {
+        fprintf(stderr, "error: write failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+Counts the patterns of the games of a file into the counter of the thread;
+called from the task of the file.
+*/
+static void read_games(
+    const char * filename
+){
+    game_record * gr = thread_gr;
+
+    u32 fid;
+    #pragma omp atomic capture
+    fid = ++files_read;
+
+    sgf_collection sc;
+    if(!open_sgf_collection(&sc, filename))
+    {
+        #pragma omp atomic
+        ++games_skipped;
+        if(!no_print)
+            printf("%u: %s skipped\n", fid, filename);
+        return;
+    }
+
+    u32 skipped = 0;
+    u32 used = 0;
+    while(import_next_game_from_sgf(gr, &sc))
+    {
+        if(/* Ignore handicap matches */
+            gr->handicap_stones.count > 0 ||
+            /* Only use winner plays so ignore games without score */
+            gr->final_score == 0)
+        {
+            ++skipped;
+            if(!no_print)
+                printf("%u: %s skipped\n", fid, filename);
+            continue;
+        }
+
+        ++used;
+        if(!no_print)
+            printf("%u: %s (%u)\n", fid, filename, gr->turns);
+
+        learn_from_game(gr, &own);
+    }
+
+    if(sc.games_skipped > 0 && !no_print)
+        printf("%u: %s %u skipped\n", fid, filename, sc.games_skipped);
+    skipped += sc.games_skipped;
+    close_sgf_collection(&sc);
+
+    #pragma omp atomic
+    games_skipped += skipped;
+    #pragma omp atomic
+    games_used += used;
+}
+
+/*
+Starts a task for reading a file found, while the search continues.
+*/
+static void queue_file(
+    const char * filename,
+    void * arg
+){
+    (void)arg;
+    u32 len = strlen(filename) + 1;
+    char * copy = malloc(len);
+    if(copy == NULL)
+    {
+        fprintf(stderr, "error: system out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(copy, filename, len);
+
+    #pragma omp task firstprivate(copy)
+    {
+        read_games(copy);
+        free(copy);
+    }
+}
+
 int main(
     int argc,
     char * argv[]
 ){
-    bool no_print = false;
-
     for(int i = 1; i < argc; ++i)
     {
         if(strcmp(argv[i], "--no_print") == 0){
             no_print = true;
             continue;
         }
+        if(strcmp(argv[i], "--pat12") == 0){
+            use_pat12 = true;
+            continue;
+        }
 
         printf("Usage: %s [options]\n", argv[0]);
         printf("Options:\n");
         printf("--no_print - Do not print SGF filenames.\n");
+        printf("--pat12 - Grade 12-point patterns instead.\n");
         exit(EXIT_SUCCESS);
     }
 
@@ -100,145 +360,69 @@ int main(
 
     assert_data_folder_exists();
     board_constants_init();
+    zobrist_init();
 
     char * ts = alloc();
 
-    fprintf(stderr, "Discovering game states\n");
-
-    u32 filenames_found = recurse_find_files(data_folder(), ".sgf",
-        filenames, MAX_FILES);
-    if(filenames_found == 0)
-    {
-        timestamp(ts);
-        fprintf(stderr, "%s: No SGF files found, exiting.\n", ts);
-        release(ts);
-        return EXIT_SUCCESS;
-    }
-    fprintf(stderr, "\nfound %u SGF files\n", filenames_found);
-
     timestamp(ts);
-    fprintf(stderr, "%s: 2/3 Extracting state plays\n", ts);
-
-    u32 games_skipped = 0;
-    u32 games_used = 0;
-    u32 unique_patterns = 0;
+    fprintf(stderr, "%s: 1/2 Extracting state plays (%s*.sgf)\n", ts,
+        data_folder());
 
-    hash_table * feature_table = hash_table_create(1543, sizeof(pat3t),
-        pat3t_hash_function, pat3t_compare_function);
+    pattern_counter counter;
+    counter_init(&counter);
 
-    char  * buf = malloc(MAX_FILE_SIZ);
-    game_record * gr = malloc(sizeof(game_record));
+    u32 filenames_found = 0;
 
-    for(u32 fid = 0; fid < filenames_found; ++fid)
+    #pragma omp parallel
     {
-        if(!no_print)
-            printf("%u/%u: %s", fid + 1, filenames_found, filenames[fid]);
-
-        if(!import_game_from_sgf2(gr, filenames[fid], buf, MAX_FILE_SIZ))
-        {
-            ++games_skipped;
-            if(!no_print)
-                printf(" skipped\n");
-            continue;
-        }
-
-        /* Ignore handicap matches */
-        if(gr->handicap_stones.count > 0)
+        counter_init(&own);
+        thread_gr = malloc(sizeof(game_record));
+        if(thread_gr == NULL)
         {
-            ++games_skipped;
-            if(!no_print)
-                printf(" skipped\n");
-            continue;
-        }
-
-        /* Only use winner plays so ignore games without score */
-        if(gr->final_score == 0)
-        {
-            ++games_skipped;
-            if(!no_print)
-                printf(" skipped\n");
-            continue;
+            fprintf(stderr, "error: system out of memory\n");
+            exit(EXIT_FAILURE);
         }
 
-        board b;
-        clear_board(&b);
+        /*
+        One thread searches the files while the others read the files found
+        */
+        #pragma omp single
+        filenames_found = for_each_file(data_folder(), ".sgf", queue_file,
+            NULL);
 
-        ++games_used;
-        if(!no_print)
-            printf(" (%u)\n", gr->turns);
-
-        bool winner_is_black = gr->final_score > 0;
-        bool is_black = false;
+        free(thread_gr);
 
-        u16 total_turns = (gr->turns * 2) / 3;
+        #pragma omp critical
+        counter_merge(&counter, &own);
+    }
 
-        for(d16 k = 0; k < total_turns; ++k)
-        {
-            is_black = !is_black;
-            move m = gr->moves[k];
+    if(filenames_found == 0)
+    {
+        timestamp(ts);
+        fprintf(stderr, "%s: No SGF files found, exiting.\n", ts);
+        release(ts);
+        return EXIT_SUCCESS;
+    }
+    fprintf(stderr, "\nfound %u SGF files\n", filenames_found);
 
-            if(m == PASS)
-                pass(&b);
-            else
-            {
-                if(is_black == winner_is_black)
-                {
-                    cfg_board cb;
-                    cfg_from_board(&cb, &b);
-
-                    u16 winner_pattern = get_pattern(&cb, m);
-
-                    for(move n = 0; n < TOTAL_BOARD_SIZ; ++n)
-                    {
-                        if(cb.p[n] != EMPTY)
-                            continue;
-
-                        if(ko_violation(&cb, n))
-                            continue;
-
-                        u8 libs;
-                        bool captures;
-                        if((libs = safe_to_play2(&cb, true, n, &captures))
-                            == 0)
-                            continue;
-
-                        u16 pattern = get_pattern(&cb, n);
-
-                        pat3t * found = hash_table_find(feature_table,
-                            &pattern);
-                        if(found == NULL)
-                        {
-                            found = malloc(sizeof(pat3t));
-                            found->value = pattern;
-                            found->wins = 0;
-                            found->appearances = 0;
-                            hash_table_insert_unique(feature_table, found);
-                            ++unique_patterns;
-                        }
-
-                        found->wins += (pattern == winner_pattern) ? 1 : 0;
-                        found->appearances++;
-                    }
-
-                    cfg_board_free(&cb);
-                }
-                just_play_slow(&b, true, m);
-            }
+    u32 unique_patterns = 0;
+    if(use_pat12)
+        unique_patterns = counter.table->elements;
+    else
+        for(u32 i = 0; i < 65536; ++i)
+            if(counter.appearances[i] > 0)
+                ++unique_patterns;
 
-            invert_color(b.p);
-        }
-    }
+    char * buf = alloc();
 
     fprintf(stderr, "Games used: %u Skipped: %u\nUnique patterns: %u\n",
         games_used, games_skipped, unique_patterns);
 
     timestamp(ts);
-    fprintf(stderr, "%s: 3/3 Exporting to file\n", ts);
+    fprintf(stderr, "%s: 2/2 Exporting to file\n", ts);
 
-    pat3t ** table = (pat3t **)hash_table_export_to_array(feature_table);
-
-    snprintf(buf, MAX_PAGE_SIZ, "%s%ux%u.weights.new", data_folder(),
-        BOARD_SIZ, BOARD_SIZ);
+    snprintf(buf, MAX_PAGE_SIZ, "%s%ux%u.%s.new", data_folder(), BOARD_SIZ,
+        BOARD_SIZ, use_pat12 ? "pat12" : "weights");
     FILE * fp = fopen(buf, "w");
     if(fp == NULL)
     {
@@ -250,24 +434,21 @@ int main(
     fprintf(fp, "# games used: %u skipped: %u\n# unique patterns: %u\n\n#Hex We\
 ight Count\n", games_used, games_skipped, unique_patterns);
 
-    while(*table != NULL)
+    if(use_pat12)
     {
-        pat3t * f = *table;
-        ++table;
-
-        double weight = (((double)(f->wins)) / ((double)(f->appearances))) *
-        65535.0;
-        snprintf(buf, 256, "%04x %5u %u\n", f->value, (u32)weight,
-            f->appearances);
-        size_t w = fwrite(buf, strlen(buf), 1, fp);
-        if(w != 1)
-        {
-            fprintf(stderr, "error: write failed\n");
-            exit(EXIT_FAILURE);
-        }
+        pat3t ** table = (pat3t **)open_table_export_to_array(counter.table);
+        for(u32 i = 0; table[i] != NULL; ++i)
+            write_pattern(fp, table[i]->value, table[i]->wins,
+                table[i]->appearances);
+        free(table);
     }
+    else
+        for(u32 i = 0; i < 65536; ++i)
+            if(counter.appearances[i] > 0)
+                write_pattern(fp, i, counter.wins[i], counter.appearances[i]);
 
     fclose(fp);
+    release(buf);
 
     return EXIT_SUCCESS;
 }
@@ -3,6 +3,10 @@ Non-cryptographic random number generation functions
 
 Reminder: maximums are exclusive for integer functions and inclusive (and very
 unlikely) for floating point functions.
+
+Each thread generates with xoshiro128**, in RAND_LANES interleaved streams that
+are advanced together, so the compiler vectorizes them, filling a buffer of
+RAND_BUFFER_SIZ numbers at a time that the functions then draw from.
 */
 
 #include "config.h"
@@ -16,9 +20,103 @@ unlikely) for floating point functions.
 #include "timem.h"
 #include "types.h"
 
+#define RAND_LANES 4
+#define RAND_BUFFER_SIZ 64
+
+/*
+Generator of a thread: the four words of state of the xoshiro128** streams, by
+lane, and the numbers generated not yet used.
+*/
+typedef struct __rand_thread_ {
+    u32 s[4][RAND_LANES];
+    u32 buffer[RAND_BUFFER_SIZ];
+    u32 next; /* index of the next number of the buffer */
+    u32 generation;
+} rand_thread;
+
+/*
+The seeds of the RNG of each thread are kept in state. Each thread generates from
+its own generator, in thread-private memory, so generating doesn't share cache
+lines between threads nor query OpenMP for the thread number; the generator is
+seeded again whenever the seeds are set again.
+*/
 static u32 state[MAXIMUM_NUM_THREADS];
+static u32 seeds_generation = 1;
+static rand_thread thread_rng;
+#pragma omp threadprivate(thread_rng)
+
 static bool rand_inited = false;
 
+/*
+RETURNS the next number of the SplitMix32 sequence of x, used for seeding
+*/
+static u32 splitmix32(
+    u32 * x
+){
+    u32 z = (*x += 0x9e3779b9U);
+    z = (z ^ (z >> 16)) * 0x85ebca6bU;
+    z = (z ^ (z >> 13)) * 0xc2b2ae35U;
+    return z ^ (z >> 16);
+}
+
+static u32 rotl(
+    u32 x,
+    u8 k
+){
+    return (x << k) | (x >> (32 - k));
+}
+
+/*
+Generates the next RAND_BUFFER_SIZ numbers of the streams of the generator.
+*/
+static void refill(
+    rand_thread * r
+){
+    for(u16 i = 0; i < RAND_BUFFER_SIZ; i += RAND_LANES)
+        for(u8 l = 0; l < RAND_LANES; ++l)
+        {
+            u32 s0 = r->s[0][l];
+            u32 s1 = r->s[1][l];
+            u32 s2 = r->s[2][l] ^ s0;
+            u32 s3 = r->s[3][l] ^ s1;
+            r->buffer[i + l] = rotl(s1 * 5, 7) * 9;
+            r->s[0][l] = s0 ^ s3;
+            r->s[1][l] = s1 ^ s2;
+            r->s[2][l] = s2 ^ (s1 << 9);
+            r->s[3][l] = rotl(s3, 11);
+        }
+    r->next = 0;
+}
+
+/*
+RETURNS the RNG of the calling thread
+*/
+static rand_thread * own_rng()
+{
+    rand_thread * r = &thread_rng;
+    if(r->generation != seeds_generation)
+    {
+        u32 x = state[omp_get_thread_num()];
+        for(u8 w = 0; w < 4; ++w)
+            for(u8 l = 0; l < RAND_LANES; ++l)
+                r->s[w][l] = splitmix32(&x);
+        r->next = RAND_BUFFER_SIZ;
+        r->generation = seeds_generation;
+    }
+    return r;
+}
+
+/*
+RETURNS the next pseudo random 32-bit number of the calling thread
+*/
+static u32 next_u32()
+{
+    rand_thread * r = own_rng();
+    if(r->next == RAND_BUFFER_SIZ)
+        refill(r);
+    return r->buffer[r->next++];
+}
+
 /*
 Initiate the seeds for the different thread RNG, again.
 */
@@ -44,12 +142,13 @@ void rand_reinit()
             ++i;
     }
 
-    for(u16 i = 0; i < MAXIMUM_NUM_THREADS; ++i)
+    for(u16 i = 0; i < MAXIMUM_NUM_THREADS && idx < MAX_PAGE_SIZ - 32; ++i)
         idx += snprintf(buf + idx, MAX_PAGE_SIZ - idx, "%u: %x\n", i, state[i]);
 
     flog_debug("rand", buf);
     release(buf);
 
+    seeds_generation++;
     rand_inited = true;
 }
 
@@ -66,26 +165,38 @@ void rand_init()
 }
 
 /*
-Fast and well distributed 16-bit RNG based on the glibc mixed LCG.
+Sets the seeds for the different thread RNG, all derived from a single seed, so
+the same sequences of numbers are generated again.
+*/
+void rand_seed(
+    u32 seed
+){
+    /* odd multiplier, so the seeds are all different */
+    for(u16 i = 0; i < MAXIMUM_NUM_THREADS; ++i)
+        state[i] = seed + i * 2654435761U;
+
+    seeds_generation++;
+    rand_inited = true;
+}
+
+/*
+Fast and well distributed 16-bit RNG.
 RETURNS pseudo random 16-bit number
 */
 u16 rand_u16(
     u16 max /* exclusive */
 ){
-    u32 s = state[omp_get_thread_num()];
-    state[omp_get_thread_num()] = ((s * 1103515245) + 12345) & 0x7fffffff;
-    return ((s & 0xffff) * ((u32)max)) >> 16;
+    return ((next_u32() >> 16) * ((u32)max)) >> 16;
 }
 
 /*
-Slow alternative for 32-bit. Avoid using.
+Fast and well distributed 32-bit RNG.
 RETURNS pseudo random 32-bit number
 */
 u32 rand_u32(
     u32 max /* exclusive */
 ){
-    double gen = (double)rand_r(&state[omp_get_thread_num()]);
-    return (gen * ((double)max)) / ((double)RAND_MAX);
+    return (((u64)next_u32()) * max) >> 32;
 }
 
 /*
@@ -95,18 +206,6 @@ RETURNS pseudo random IEEE 754 floating point
 float rand_float(
     float max /* inclusive */
 ){
-    /*
-    Adapted from the method used in Pachi (GPLv2), which is itself based on the
-    method described in www.rgba.org/articles/sfrand/sfrand.htm (proprietary
-    intelectual property). If you believe this may constitue a violation of
-    someones copyright please contact me immediatly (contact information
-    available in AUTHORS file attached).
-    */
-    u32 s = state[omp_get_thread_num()];
-    s *= 16807;
-    state[omp_get_thread_num()] = s;
-    union { u32 ul; float f; } p;
-    p.ul = ((s & 0x007fffff) - 1) | 0x3f800000;
-    float f = p.f - 1.0f;
-    return f * max;
+    /* 24 bits, as many as a float has */
+    return ((next_u32() >> 8) * (1.0f / 16777215.0f)) * max;
 }
@@ -47,6 +47,33 @@ move random_play(
     return PASS;
 }
 
+/*
+Select random legal play that is not inside an eye of the player, drawing from
+the empty intersections until one is found.
+RETURNS play or PASS if there are none
+*/
+move random_play_eyeless(
+    const cfg_board * cb,
+    bool is_black
+){
+    move candidates[TOTAL_BOARD_SIZ];
+    move count = cb->empty.count;
+    memcpy(candidates, cb->empty.coord, count * sizeof(move));
+
+    while(count > 0)
+    {
+        u16 i = rand_u16(count);
+        move m = candidates[i];
+        if(!is_eye(cb, is_black, m) && can_play(cb, is_black, m))
+            return m;
+
+        --count;
+        candidates[i] = candidates[count];
+    }
+
+    return PASS;
+}
+
 /*
 Select random legal play.
 */
@@ -20,6 +20,11 @@ Remember that in Matilda, scores and komi are always doubled to become integer.
 
 
 extern d16 komi;
+extern d16 dynamic_komi;
+
+/* from board_constants */
+extern u8 out_neighbors4[TOTAL_BOARD_SIZ];
+extern move_seq neighbors_side[TOTAL_BOARD_SIZ];
 
 /*
 Produces a textual representation of a Go match score., ex: B+3.5, 0
@@ -321,4 +326,89 @@ d16 score_stones_and_area(
     return r - komi;
 }
 
+/*
+Scoring by counting stones and surrounded area, like score_stones_and_area, but
+from the CFG representation. Empty intersections surrounded by stones of a
+single color are scored from their neighbor counts, without search; only
+regions of more than one empty intersection are flood filled. Is used by the
+searches, so the dynamic komi is added to the komi.
+RETURNS positive score for a black win; negative for a white win; 0 for a draw
+*/
+d16 score_stones_and_area2(
+    const cfg_board * cb
+){
+    d16 r = 0;
+    for(move i = 0; i < cb->unique_groups_count; ++i)
+    {
+        const group * g = cb->g[cb->unique_groups[i]];
+        if(g->is_black)
+            r += g->stones.count * 2;
+        else
+            r -= g->stones.count * 2;
+    }
 
+    bool regions_found = false;
+    for(move i = 0; i < cb->empty.count; ++i)
+    {
+        move m = cb->empty.coord[i];
+        u8 b = cb->black_neighbors4[m];
+        u8 w = cb->white_neighbors4[m];
+        if(b + w + out_neighbors4[m] < 4)
+            regions_found = true;
+        else
+            if(w == 0)
+                r += 2;
+            else
+                if(b == 0)
+                    r -= 2;
+    }
+
+    if(!regions_found)
+        return r - komi - dynamic_komi;
+
+    /* explored intersections array is only used for empty intersections */
+    bool explored[TOTAL_BOARD_SIZ];
+    memset(explored, false, TOTAL_BOARD_SIZ * sizeof(bool));
+    move region[TOTAL_BOARD_SIZ];
+
+    for(move i = 0; i < cb->empty.count; ++i)
+    {
+        move m = cb->empty.coord[i];
+        if(explored[m] || cb->black_neighbors4[m] + cb->white_neighbors4[m] +
+            out_neighbors4[m] == 4)
+            continue;
+
+        bool found_black = false;
+        bool found_white = false;
+        move region_size = 1;
+        region[0] = m;
+        explored[m] = true;
+
+        for(move j = 0; j < region_size; ++j)
+        {
+            move n = region[j];
+            found_black |= cb->black_neighbors4[n] > 0;
+            found_white |= cb->white_neighbors4[n] > 0;
+
+            for(u8 k = 0; k < neighbors_side[n].count; ++k)
+            {
+                move o = neighbors_side[n].coord[k];
+                if(cb->p[o] == EMPTY && !explored[o])
+                {
+                    explored[o] = true;
+                    region[region_size++] = o;
+                }
+            }
+        }
+
+        if(found_black != found_white) /* established region */
+        {
+            if(found_black)
+                r += region_size * 2;
+            else
+                r -= region_size * 2;
+        }
+    }
+
+    return r - komi - dynamic_komi;
+}
@@ -3,6 +3,11 @@ Functions related to reading and writing SGF FF[4] files.
 http://www.red-bean.com/sgf/
 
 Play variations and annotations/commentary are ignored.
+
+For reading large numbers of games, as the offline tools do, the functions of
+sgf_collection map the file to memory and parse the main line of each game in
+place, without intermediate copies; the file may also be an SGF collection of
+several games.
 */
 
 #include "config.h"
@@ -11,6 +16,11 @@ Play variations and annotations/commentary are ignored.
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "alloc.h"
 #include "board.h"
@@ -18,6 +28,7 @@ Play variations and annotations/commentary are ignored.
 #include "flog.h"
 #include "game_record.h"
 #include "scoring.h"
+#include "sgf.h"
 #include "state_changes.h"
 #include "stringm.h"
 #include "types.h"
@@ -51,6 +62,76 @@ static u8 guess_board_size(
     return 0;
 }
 
+static void parse_komi(
+    const char * s
+){
+    if(s[0] == 0)
+        return;
+
+    double komid;
+    if(!parse_float(&komid, s))
+    {
+        if(!komi_format_error)
+        {
+            komi_format_error = true;
+            flog_warn("sgff", "komi format error; current komi kept");
+        }
+    }
+    else
+    {
+        komi = (d16)(komid * 2.0);
+    }
+}
+
+static void parse_result(
+    const char * result,
+    bool * finished,
+    bool * resignation,
+    bool * timeout,
+    d16 * final_score
+){
+    *finished = false;
+    *resignation = false;
+    *timeout = false;
+    *final_score = 0;
+
+    if(result[0] == 0 || strcmp(result, "Void") == 0)
+        return;
+
+    *finished = true;
+    if(strcmp(result, "?") == 0 || strcmp(result, "Draw") == 0 ||
+        strcmp(result, "0") == 0 || strlen(result) <= 2)
+        return;
+
+    d16 sign = result[0] == 'B' ? 1 : -1;
+    result += 2;
+    if(result[0] == 'R')
+    {
+        *resignation = true;
+        *final_score = sign;
+    }
+    else
+        if(result[0] == 'T')
+        {
+            *timeout = true;
+            *final_score = sign;
+        }
+        else
+        {
+            double f;
+            if(!parse_float(&f, result))
+            {
+                if(!illegal_final_score_warned){
+                    illegal_final_score_warned = true;
+                    flog_warn("sgff", "illegal result format");
+                }
+                *finished = false;
+                return;
+            }
+            *final_score = (d32)(f * 2.0 * sign);
+        }
+}
+
 /*
 Writes a game record to a buffer of size length, to the best of the available
 information.
@@ -260,22 +341,7 @@ bool import_game_from_sgf2(
     Komi
     */
     str_between(tmp, buf, "KM[", "]");
-    if(tmp[0] != 0)
-    {
-        double komid;
-        if(!parse_float(&komid, tmp))
-        {
-            if(!komi_format_error)
-            {
-                komi_format_error = true;
-                flog_warn("sgff", "komi format error; current komi kept");
-            }
-        }
-        else
-        {
-            komi = (d16)(komid * 2.0);
-        }
-    }
+    parse_komi(tmp);
 
     /*
     Board size
@@ -338,91 +404,13 @@ tes");
     /*
     Result
     */
-    bool finished = false;
-    bool resignation = false;
-    bool timeout = false;
-    d16 final_score = 0;
+    bool finished;
+    bool resignation;
+    bool timeout;
+    d16 final_score;
 
-    char * result = tmp;
-    str_between(result, buf, "RE[", "]");
-
-    if(result[0] == 0 || strcmp(result, "Void") == 0)
-        gr->finished = false;
-    else
-        if(strcmp(result, "?") == 0 || strcmp(result, "Draw") == 0 ||
-            strcmp(result, "0") == 0)
-        {
-            finished = true;
-        }
-        else
-            if(result[0] == 'B')
-            {
-                finished = true;
-                if(strlen(result) > 2)
-                {
-                    result += 2;
-                    if(result[0] == 'R')
-                    {
-                        resignation = true;
-                        final_score = 1;
-                    }
-                    else
-                        if(result[0] == 'T')
-                        {
-                            timeout = true;
-                            final_score = 1;
-                        }
-                        else
-                        {
-                            double f;
-                            if(!parse_float(&f, result))
-                            {
-                                if(!illegal_final_score_warned){
-                                    illegal_final_score_warned = true;
-                                    flog_warn("sgff", "illegal result format");
-                                }
-                                finished = false;
-                                goto after_game_result;
-                            }
-                            final_score = (d32)(f * 2.0);
-                        }
-                }
-            }
-            else
-            {
-                finished = true;
-                if(strlen(result) > 2)
-                {
-                    result += 2;
-                    if(result[0] == 'R')
-                    {
-                        resignation = true;
-                        final_score = -1;
-                    }
-                    else
-                        if(result[0] == 'T')
-                        {
-                            timeout = true;
-                            final_score = -1;
-                        }
-                        else
-                        {
-                            double f;
-                            if(!parse_float(&f, result))
-                            {
-                                if(!illegal_final_score_warned){
-                                    illegal_final_score_warned = true;
-                                    flog_warn("sgff", "illegal result format");
-                                }
-                                finished = false;
-                                goto after_game_result;
-                            }
-                            final_score = (d32)(f * -2.0);
-                        }
-                }
-            }
-
-after_game_result:
+    str_between(tmp, buf, "RE[", "]");
+    parse_result(tmp, &finished, &resignation, &timeout, &final_score);
     release(tmp);
 
     /*
@@ -519,3 +507,332 @@ bool import_game_from_sgf(
 
     return ret;
 }
+
+/*
+Opens an SGF file, possibly a collection of several games, for reading its
+games with import_next_game_from_sgf. The file is mapped to memory and parsed
+in place.
+RETURNS false if the file could not be opened
+*/
+bool open_sgf_collection(
+    sgf_collection * sc,
+    const char * filename
+){
+    sc->data = NULL;
+    sc->size = 0;
+    sc->pos = 0;
+    sc->games_skipped = 0;
+
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if(fd == -1 || fstat(fd, &st) != 0)
+    {
+        if(fd != -1)
+            close(fd);
+        char * s = alloc();
+        snprintf(s, MAX_PAGE_SIZ, "could not open/read file %s", filename);
+        flog_warn("sgff", s);
+        release(s);
+        return false;
+    }
+
+    if(st.st_size > 0)
+    {
+        void * mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapping == MAP_FAILED)
+        {
+            close(fd);
+            char * s = alloc();
+            snprintf(s, MAX_PAGE_SIZ, "could not map file %s", filename);
+            flog_warn("sgff", s);
+            release(s);
+            return false;
+        }
+        posix_madvise(mapping, st.st_size, POSIX_MADV_SEQUENTIAL);
+        sc->data = (const char *)mapping;
+        sc->size = st.st_size;
+    }
+
+    close(fd);
+    return true;
+}
+
+/*
+Closes an SGF file opened with open_sgf_collection.
+*/
+void close_sgf_collection(
+    sgf_collection * sc
+){
+    if(sc->data != NULL)
+        munmap((void *)sc->data, sc->size);
+    sc->data = NULL;
+    sc->size = 0;
+}
+
+/*
+Copies a property value to a zero-terminated string, truncated if needed.
+*/
+static void copy_value(
+    char * dst,
+    u32 dst_siz,
+    const char * value,
+    u32 len
+){
+    len = MIN(len, dst_siz - 1);
+    memcpy(dst, value, len);
+    dst[len] = 0;
+}
+
+typedef struct __sgf_game_state_ {
+    bool valid;
+    bool size_declared;
+    bool format_declared;
+    u8 max_x;
+    bool finished;
+    bool resignation;
+    bool timeout;
+    d16 final_score;
+} sgf_game_state;
+
+static void read_property(
+    game_record * gr,
+    sgf_game_state * gs,
+    const char id[2],
+    const char * value,
+    u32 len
+){
+    char tmp[MAX_PLAYER_NAME_SIZ];
+
+    if((id[0] == 'B' || id[0] == 'W') && id[1] == 0)
+    {
+        if(gr->turns >= MAX_GAME_LENGTH)
+            return;
+
+        bool is_black = (id[0] == 'B');
+        if(len == 0)
+            add_play_out_of_order(gr, is_black, PASS);
+        else
+            if(len == 2)
+            {
+                u8 x = value[0] - 'a';
+                u8 y = value[1] - 'a';
+                if(x >= BOARD_SIZ || y >= BOARD_SIZ)
+                {
+                    if(!illegal_stone_placement_warned){
+                        illegal_stone_placement_warned = true;
+                        flog_warn("sgff", "play coordinate illegal");
+                    }
+                    gs->valid = false;
+                    return;
+                }
+                gs->max_x = MAX(gs->max_x, x);
+                add_play_out_of_order(gr, is_black, coord_to_move(x, y));
+            }
+        return;
+    }
+
+    if(id[1] == 0)
+        return;
+
+    if(id[0] == 'A' && id[1] == 'B')
+    {
+        /* only handicap stones placed before the first play */
+        if(gr->turns > 0 || len != 2)
+            return;
+
+        u8 x = value[0] - 'a';
+        u8 y = value[1] - 'a';
+        if(x >= BOARD_SIZ || y >= BOARD_SIZ)
+        {
+            if(!illegal_handicap_placement_warned){
+                illegal_handicap_placement_warned = true;
+                flog_warn("sgff", "handicap placement error (1)");
+            }
+            gs->valid = false;
+            return;
+        }
+        if(!add_handicap_stone(gr, coord_to_move(x, y)))
+        {
+            flog_warn("sgff", "handicap placement error (2)");
+            gs->valid = false;
+        }
+        return;
+    }
+
+    if(id[0] == 'G' && id[1] == 'M')
+    {
+        gs->format_declared = (len == 1 && value[0] == '1');
+        return;
+    }
+
+    if(id[0] == 'K' && id[1] == 'M')
+    {
+        copy_value(tmp, MAX_PLAYER_NAME_SIZ, value, len);
+        parse_komi(tmp);
+        return;
+    }
+
+    if(id[0] == 'S' && id[1] == 'Z')
+    {
+        gs->size_declared = true;
+        copy_value(tmp, MAX_PLAYER_NAME_SIZ, value, len);
+        if(strcmp(tmp, BOARD_SIZ_AS_STR) != 0)
+        {
+            if(!wrong_board_size_warned){
+                wrong_board_size_warned = true;
+                flog_warn("sgff", "wrong board size");
+            }
+            gs->valid = false;
+        }
+        return;
+    }
+
+    if(id[0] == 'P' && (id[1] == 'B' || id[1] == 'W'))
+    {
+        copy_value(id[1] == 'B' ? gr->black_name : gr->white_name,
+            MAX_PLAYER_NAME_SIZ, value, len);
+        gr->player_names_set = true;
+        return;
+    }
+
+    if(id[0] == 'R' && id[1] == 'E')
+    {
+        copy_value(tmp, MAX_PLAYER_NAME_SIZ, value, len);
+        parse_result(tmp, &gs->finished, &gs->resignation, &gs->timeout,
+            &gs->final_score);
+    }
+}
+
+/*
+Reads the main line of the next game of the SGF file, where the first
+variation of each node is followed. Games that cannot be read, or are for a
+different board size, are skipped and counted in games_skipped.
+RETURNS true if another game was read
+*/
+bool import_next_game_from_sgf(
+    game_record * gr,
+    sgf_collection * sc
+){
+    const char * data = sc->data;
+
+    while(1)
+    {
+        while(sc->pos < sc->size && data[sc->pos] != '(')
+            ++sc->pos;
+        if(sc->pos >= sc->size)
+            return false;
+
+        clear_game_record(gr);
+        sgf_game_state gs;
+        memset(&gs, 0, sizeof(sgf_game_state));
+        gs.valid = true;
+
+        u32 depth = 0;
+        bool main_line = true;
+        char id[2] = {0, 0};
+        u8 id_len = 0;
+        bool in_id = false;
+
+        while(sc->pos < sc->size)
+        {
+            char c = data[sc->pos];
+
+            if(c == '[')
+            {
+                u64 start = sc->pos + 1;
+                u64 end = start;
+                while(end < sc->size && data[end] != ']')
+                    end += (data[end] == '\\') ? 2 : 1;
+                if(end >= sc->size)
+                {
+                    sc->pos = sc->size;
+                    gs.valid = false;
+                    break;
+                }
+
+                if(main_line && gs.valid && id_len > 0 && id_len <= 2)
+                    read_property(gr, &gs, id, data + start, end - start);
+                sc->pos = end + 1;
+                in_id = false;
+                continue;
+            }
+
+            ++sc->pos;
+
+            if(c >= 'A' && c <= 'Z')
+            {
+                if(!in_id)
+                {
+                    in_id = true;
+                    id_len = 0;
+                    id[0] = id[1] = 0;
+                }
+                if(id_len < 2)
+                    id[id_len] = c;
+                ++id_len;
+                continue;
+            }
+
+            /* lowercase letters of FF[3] property names are ignored */
+            if(c >= 'a' && c <= 'z')
+                continue;
+
+            in_id = false;
+            if(c == '(')
+                ++depth;
+            else
+                if(c == ')')
+                {
+                    /* the main line ends at the first end of a variation */
+                    main_line = false;
+                    if(--depth == 0)
+                        break;
+                }
+                else
+                    if(c == ';')
+                        id_len = 0;
+        }
+
+        if(!gs.format_declared && !sgf_format_undeclared_warned)
+        {
+            sgf_format_undeclared_warned = true;
+            flog_warn("sgff", "GM[1] annotation not found");
+        }
+
+        if(gs.valid && !gs.size_declared)
+        {
+            if(!undeclared_board_size_warned)
+            {
+                undeclared_board_size_warned = true;
+                flog_warn("sgff", "board size not specified");
+            }
+
+            u8 board_size = gr->turns > 0 ? gs.max_x + 1 : 0;
+            if(board_size == 0 && !board_size_cant_be_guessed_warned)
+            {
+                board_size_cant_be_guessed_warned = true;
+                flog_warn("sgff", "board size can not be guessed from play coo\
+rdinates");
+            }
+            if(board_size != BOARD_SIZ && board_size + 1 != BOARD_SIZ)
+            {
+                if(!wrong_board_size_warned){
+                    wrong_board_size_warned = true;
+                    flog_warn("sgff", "wrong board size");
+                }
+                gs.valid = false;
+            }
+        }
+
+        if(gs.valid)
+        {
+            gr->finished = gs.finished;
+            gr->resignation = gs.resignation;
+            gr->timeout = gs.timeout;
+            gr->final_score = gs.final_score;
+            return true;
+        }
+
+        ++sc->games_skipped;
+    }
+}
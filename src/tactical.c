@@ -18,6 +18,7 @@ counting.
 
 #include "board.h"
 #include "cfg_board.h"
+#include "constants.h"
 #include "move.h"
 #include "state_changes.h"
 #include "tactical.h"
@@ -26,6 +27,7 @@ counting.
 
 extern u8 out_neighbors8[TOTAL_BOARD_SIZ];
 extern u8 out_neighbors4[TOTAL_BOARD_SIZ];
+extern move_seq neighbors_side[TOTAL_BOARD_SIZ];
 extern move_seq neighbors_3x3[TOTAL_BOARD_SIZ];
 
 extern bool border_left[TOTAL_BOARD_SIZ];
@@ -33,11 +35,42 @@ extern bool border_right[TOTAL_BOARD_SIZ];
 extern bool border_top[TOTAL_BOARD_SIZ];
 extern bool border_bottom[TOTAL_BOARD_SIZ];
 
-/* number of active bits for every byte combination */
-extern u8 active_bits_in_byte[256];
-
 extern bool black_eye[65536];
 extern bool white_eye[65536];
+extern u8 black_eye_shapes[65536];
+extern u8 white_eye_shapes[65536];
+
+#if USE_TACTICAL_CACHE
+
+/* entries per thread, must be a power of two */
+#define TACTICAL_CACHE_SIZ 4096
+#define TACTICAL_CACHE_MAX_PLAYS 6
+/* distance around the group that the reading is keyed by */
+#define READING_MARGIN 2
+
+#define READ_KILLING_PLAY 1
+#define READ_KILLING_ALL 2
+#define READ_SAVING_PLAY 3
+#define READ_SAVING_ALL 4
+
+typedef struct __reading_ {
+    u64 key; /* 0 for empty */
+    u8 plays_count;
+    move plays[TACTICAL_CACHE_MAX_PLAYS];
+} reading;
+
+static reading tactical_cache[TACTICAL_CACHE_SIZ];
+
+/* area the current reading is keyed by, and whether a play left it */
+static u8 box_x0;
+static u8 box_y0;
+static u8 box_x1;
+static u8 box_y1;
+static bool box_escaped;
+#pragma omp threadprivate(tactical_cache, box_x0, box_y0, box_x1, box_y1, \
+    box_escaped)
+
+#endif
 
 /*
 An eye is a point that may eventually become untakeable (without playing
@@ -95,90 +128,28 @@ bool is_2pt_eye(
     assert(is_board_move(m));
     *can_have_forcing_move = false;
 
-    if(is_black)
-    {
-        if(cb->white_neighbors4[m] > 0)
-            return false;
-        if(cb->black_neighbors4[m] + out_neighbors4[m] != 3)
-            return false;
-
-        bool strict = (out_neighbors4[m] > 0);
-        move m2;
-        if(!border_right[m] && cb->p[m + RIGHT] == EMPTY)
-            m2 = m + RIGHT;
-        else
-            if(!border_bottom[m] && cb->p[m + BOTTOM] == EMPTY)
-                m2 = m + BOTTOM;
-            else
-                return false;
-
-        strict |= (out_neighbors4[m2] > 0);
-
-        if(cb->black_neighbors4[m2] + out_neighbors4[m2] != 3)
-            return false;
+    const u8 * shapes = is_black ? black_eye_shapes : white_eye_shapes;
+    u8 s1 = shapes[cb->hash[m]];
+    if(!(s1 & EYE_SHAPE_2PT))
+        return false;
 
-        if(strict)
-        {
-            if(cb->black_neighbors8[m] + out_neighbors8[m] < 7)
-                return false;
-            if(cb->black_neighbors8[m2] + out_neighbors8[m2] < 7)
-                return false;
-        }
-        else
-        {
-            u8 nm1 = cb->black_neighbors8[m] + out_neighbors8[m];
-            if(nm1 < 6)
-                return false;
-            u8 nm2 = cb->black_neighbors8[m2] + out_neighbors8[m2];
-            if(nm2 < 6)
-                return false;
-            if(nm1 + nm2 == 12)
-                *can_have_forcing_move = true;
-        }
-    }
+    move m2;
+    if(!border_right[m] && cb->p[m + RIGHT] == EMPTY)
+        m2 = m + RIGHT;
     else
-    {
-        if(cb->black_neighbors4[m] > 0)
-            return false;
-        if(cb->white_neighbors4[m] + out_neighbors4[m] != 3)
-            return false;
-
-        bool strict = (out_neighbors4[m] > 0);
-        move m2;
-
-        if(!border_right[m] && cb->p[m + RIGHT] == EMPTY)
-            m2 = m + RIGHT;
+        if(!border_bottom[m] && cb->p[m + BOTTOM] == EMPTY)
+            m2 = m + BOTTOM;
         else
-            if(!border_bottom[m] && cb->p[m + BOTTOM] == EMPTY)
-                m2 = m + BOTTOM;
-            else
-                return false;
-
-        strict |= (out_neighbors4[m2] > 0);
-
-        if(cb->white_neighbors4[m2] + out_neighbors4[m2] != 3)
             return false;
 
-        if(strict)
-        {
-            if(cb->white_neighbors8[m] + out_neighbors8[m] < 7)
-                return false;
-            if(cb->white_neighbors8[m2] + out_neighbors8[m2] < 7)
-                return false;
-        }
-        else
-        {
-            u8 nm1 = cb->white_neighbors8[m] + out_neighbors8[m];
-            if(nm1 < 6)
-                return false;
-            u8 nm2 = cb->white_neighbors8[m2] + out_neighbors8[m2];
-            if(nm2 < 6)
-                return false;
-            if(nm1 + nm2 == 12)
-                *can_have_forcing_move = true;
-        }
-    }
+    u8 s2 = shapes[cb->hash[m2]];
+    if(!(s2 & EYE_SHAPE_2PT))
+        return false;
+
+    if(out_neighbors4[m] > 0 || out_neighbors4[m2] > 0)
+        return (s1 & s2 & EYE_SHAPE_2PT_SOLID) != 0;
 
+    *can_have_forcing_move = !((s1 | s2) & EYE_SHAPE_2PT_SOLID);
     return true;
 }
 
@@ -205,77 +176,31 @@ bool is_4pt_eye(
         BOTTOM + RIGHT] != EMPTY)
         return false;
 
+    const u8 * shapes = is_black ? black_eye_shapes : white_eye_shapes;
+    u8 s1 = shapes[cb->hash[m]];
+    u8 s2 = shapes[cb->hash[m + RIGHT]];
+    u8 s3 = shapes[cb->hash[m + BOTTOM]];
+    u8 s4 = shapes[cb->hash[m + BOTTOM + RIGHT]];
+
     if(out_neighbors4[m] == 0 && out_neighbors4[m + BOTTOM + RIGHT] == 0)
     {
-        if(is_black)
-        {
-            if(cb->black_neighbors4[m] != 2)
-                return false;
-            if(cb->black_neighbors4[m + RIGHT] != 2)
-                return false;
-            if(cb->black_neighbors4[m + BOTTOM] != 2)
-                return false;
-            if(cb->black_neighbors4[m + BOTTOM + RIGHT] != 2)
-                return false;
-
-            u8 sum = cb->black_neighbors8[m] + cb->black_neighbors8[m + RIGHT] +
-                cb->black_neighbors8[m + BOTTOM] + cb->black_neighbors8[m +
-                BOTTOM + RIGHT];
-
-            if(sum < 18)
-                return false;
-
-            *can_have_forcing_move = (sum == 18);
-        }
-        else
-        {
-            if(cb->white_neighbors4[m] != 2)
-                return false;
-            if(cb->white_neighbors4[m + RIGHT] != 2)
-                return false;
-            if(cb->white_neighbors4[m + BOTTOM] != 2)
-                return false;
-            if(cb->white_neighbors4[m + BOTTOM + RIGHT] != 2)
-                return false;
-
-            u8 sum = cb->white_neighbors8[m] + cb->white_neighbors8[m + RIGHT] +
-                cb->white_neighbors8[m + BOTTOM] + cb->white_neighbors8[m +
-                BOTTOM + RIGHT];
+        /* at most two points with one other neighbor, the forcing moves */
+        u8 mask = EYE_SHAPE_4PT | EYE_SHAPE_4PT_WEAK;
+        if(!(s1 & mask) || !(s2 & mask) || !(s3 & mask) || !(s4 & mask))
+            return false;
 
-            if(sum < 18)
-                return false;
+        u8 weak = ((s1 & EYE_SHAPE_4PT_WEAK) != 0) + ((s2 & EYE_SHAPE_4PT_WEAK)
+            != 0) + ((s3 & EYE_SHAPE_4PT_WEAK) != 0) + ((s4 &
+            EYE_SHAPE_4PT_WEAK) != 0);
+        if(weak > 2)
+            return false;
 
-            *can_have_forcing_move = (sum == 18);
-        }
+        *can_have_forcing_move = (weak == 2);
     }
     else
     {
-        if(is_black)
-        {
-            if(cb->black_neighbors8[m] + out_neighbors8[m] != 5)
-                return false;
-            if(cb->black_neighbors8[m + RIGHT] + out_neighbors8[m + RIGHT] != 5)
-                return false;
-            if(cb->black_neighbors8[m + BOTTOM] + out_neighbors8[m + BOTTOM] !=
-                5)
-                return false;
-            if(cb->black_neighbors8[m + BOTTOM + RIGHT] + out_neighbors8[m +
-                BOTTOM + RIGHT] != 5)
-                return false;
-        }
-        else
-        {
-            if(cb->white_neighbors8[m] + out_neighbors8[m] != 5)
-                return false;
-            if(cb->white_neighbors8[m + RIGHT] + out_neighbors8[m + RIGHT] != 5)
-                return false;
-            if(cb->white_neighbors8[m + BOTTOM] + out_neighbors8[m + BOTTOM] !=
-                5)
-                return false;
-            if(cb->white_neighbors8[m + BOTTOM + RIGHT] + out_neighbors8[m +
-                BOTTOM + RIGHT] != 5)
-                return false;
-        }
+        if(!(s1 & s2 & s3 & s4 & EYE_SHAPE_4PT))
+            return false;
         *can_have_forcing_move = false;
     }
 
@@ -452,351 +377,56 @@ u8 is_nakade(
 ){
     assert(is_board_move(m));
 
-    if((cb->black_neighbors8[m] > 0) == (cb->white_neighbors8[m] > 0))
-        return 0;
+    const u8 * shapes = black_eye_shapes;
+    u8 center = shapes[cb->hash[m]];
+    u8 on4 = cb->black_neighbors4[m] + out_neighbors4[m];
+    if(!(center & (EYE_SHAPE_NAKADE3 | EYE_SHAPE_NAKADE5)))
+    {
+        shapes = white_eye_shapes;
+        center = shapes[cb->hash[m]];
+        on4 = cb->white_neighbors4[m] + out_neighbors4[m];
+    }
 
-    if(cb->black_neighbors8[m] > 0){
-        u8 on4 = cb->black_neighbors4[m] + out_neighbors4[m];
-        u8 on8 = cb->black_neighbors8[m] + out_neighbors8[m];
-        if((on4 < 3) && (on8 == on4 + 4))
+    if(center & EYE_SHAPE_NAKADE3)
+    {
+        /*
+        Straight three, bent three, pyramid four or crossed five
+        */
+        for(u8 k = 0; k < neighbors_side[m].count; ++k)
         {
-            /*
-            Straight three, bent three, pyramid four or crossed five
-            */
-            if(!border_left[m] && cb->p[m + LEFT] == EMPTY)
-            {
-                if(cb->black_neighbors4[m + LEFT] + out_neighbors4[m + LEFT] !=
-                    3)
-                    return 0;
-                if((out_neighbors4[m + LEFT] == 0 && cb->white_neighbors8[m +
-                    LEFT] > 1) || (out_neighbors4[m + LEFT] > 0 &&
-                    cb->white_neighbors8[m + LEFT] > 0))
-                    return 0;
-            }
-            if(!border_right[m] && cb->p[m + RIGHT] == EMPTY)
-            {
-                if(cb->black_neighbors4[m + RIGHT] + out_neighbors4[m + RIGHT]
-                    != 3)
-                    return 0;
-                if((out_neighbors4[m + RIGHT] == 0 && cb->white_neighbors8[m +
-                    RIGHT] > 1) || (out_neighbors4[m + RIGHT] > 0 &&
-                    cb->white_neighbors8[m + RIGHT] > 0))
-                    return 0;
-            }
-            if(!border_top[m] && cb->p[m + TOP] == EMPTY)
-            {
-                if(cb->black_neighbors4[m + TOP] + out_neighbors4[m + TOP] != 3)
-                return 0;
-                    if((out_neighbors4[m + TOP] == 0 && cb->white_neighbors8[m +
-                        TOP] > 1) || (out_neighbors4[m + TOP] > 0 &&
-                        cb->white_neighbors8[m + TOP] > 0))
+            move n = neighbors_side[m].coord[k];
+            if(cb->p[n] == EMPTY && !(shapes[cb->hash[n]] & EYE_SHAPE_END))
                 return 0;
-            }
-            if(!border_bottom[m] && cb->p[m + BOTTOM] == EMPTY)
-            {
-                if(cb->black_neighbors4[m + BOTTOM] + out_neighbors4[m + BOTTOM]
-                    != 3)
-                    return 0;
-                if((out_neighbors4[m + BOTTOM] == 0 &&
-                    cb->white_neighbors8[m + BOTTOM] > 1) ||
-                    (out_neighbors4[m + BOTTOM] > 0 &&
-                    cb->white_neighbors8[m + BOTTOM] > 0))
-                    return 0;
-            }
-            return (4 - on4) * 4 + 4;
-        }
-        else
-        {
-            if(on4 < 2 && on8 == on4 + 3)
-            {
-                /*
-                Bulky five or rabbity six
-                */
-                u8 near_corner = 0;
-                if(!border_left[m] && cb->p[m + LEFT] == EMPTY)
-                {
-                    u8 n4 = cb->black_neighbors4[m + LEFT] + out_neighbors4[m +
-                        LEFT];
-                    if(n4 == 2)
-                    {
-                        ++near_corner;
-
-                        if(cb->white_neighbors8[m + LEFT] > 0)
-                            return 0;
-                        if(cb->black_neighbors8[m + LEFT] + out_neighbors8[m +
-                            LEFT] != 4)
-                            return 0;
-                    }
-                    else
-                    {
-                        if(n4 != 3)
-                            return 0;
-
-                        if((out_neighbors4[m + LEFT] == 0 &&
-                            cb->white_neighbors8[m + LEFT] > 1) ||
-                            (out_neighbors4[m + LEFT] > 0 &&
-                            cb->white_neighbors8[m + LEFT] > 0))
-                            return 0;
-                    }
-                }
-                if(!border_right[m] && cb->p[m + RIGHT] == EMPTY)
-                {
-                    u8 n4 = cb->black_neighbors4[m + RIGHT] + out_neighbors4[m +
-                        RIGHT];
-                    if(n4 == 2){
-                        ++near_corner;
-
-                        if(cb->white_neighbors8[m + RIGHT] > 0)
-                            return 0;
-                        if(cb->black_neighbors8[m + RIGHT] + out_neighbors8[m +
-                            RIGHT] != 4)
-                            return 0;
-                    }
-                    else
-                    {
-                        if(n4 != 3)
-                            return 0;
-
-                        if((out_neighbors4[m + RIGHT] == 0 &&
-                            cb->white_neighbors8[m + RIGHT] > 1) ||
-                            (out_neighbors4[m + RIGHT] > 0 &&
-                            cb->white_neighbors8[m + RIGHT] > 0))
-                            return 0;
-                    }
-                }
-                if(!border_top[m] && cb->p[m + TOP] == EMPTY)
-                {
-                    u8 n4 = cb->black_neighbors4[m + TOP] + out_neighbors4[m +
-                        TOP];
-                    if(n4 == 2)
-                    {
-                        if(near_corner == 2)
-                            return 0;
-                        ++near_corner;
-
-                        if(cb->white_neighbors8[m + TOP] > 0)
-                            return 0;
-                        if(cb->black_neighbors8[m + TOP] + out_neighbors8[m +
-                            TOP] != 4)
-                            return 0;
-                    }
-                    else
-                    {
-                        if(n4 != 3)
-                            return 0;
-
-                        if((out_neighbors4[m + TOP] == 0 &&
-                            cb->white_neighbors8[m + TOP] > 1) ||
-                            (out_neighbors4[m + TOP] > 0 &&
-                            cb->white_neighbors8[m + TOP] > 0))
-                            return 0;
-                    }
-                }
-                if(!border_bottom[m] && cb->p[m + BOTTOM] == EMPTY)
-                {
-                    u8 n4 = cb->black_neighbors4[m + BOTTOM] + out_neighbors4[m
-                        + BOTTOM];
-                    if(n4 == 2)
-                    {
-                        if(near_corner == 2)
-                            return 0;
-                        ++near_corner;
-
-                        if(cb->white_neighbors8[m + BOTTOM] > 0)
-                            return 0;
-                        if(cb->black_neighbors8[m + BOTTOM] + out_neighbors8[m +
-                            BOTTOM] != 4)
-                            return 0;
-                    }
-                    else
-                    {
-                        if(n4 != 3)
-                            return 0;
-
-                        if((out_neighbors4[m + BOTTOM] == 0 &&
-                            cb->white_neighbors8[m + BOTTOM] > 1) ||
-                            (out_neighbors4[m + BOTTOM] > 0 &&
-                            cb->white_neighbors8[m + BOTTOM] > 0))
-                            return 0;
-                    }
-                }
-
-                if(near_corner != 2)
-                    return 0;
-
-                return (5 - on4) * 5;
-            }
         }
+        return (4 - on4) * 4 + 4;
     }
-    else
+
+    if(center & EYE_SHAPE_NAKADE5)
     {
-        u8 on4 = cb->white_neighbors4[m] + out_neighbors4[m];
-        u8 on8 = cb->white_neighbors8[m] + out_neighbors8[m];
-        if((on4 < 3) && (on8 == on4 + 4))
+        /*
+        Bulky five or rabbity six
+        */
+        u8 near_corner = 0;
+        for(u8 k = 0; k < neighbors_side[m].count; ++k)
         {
-            /*
-            Straight three, bent three, pyramid four or crossed five
-            */
-            if(!border_left[m] && cb->p[m + LEFT] == EMPTY){
-                if(cb->white_neighbors4[m + LEFT] + out_neighbors4[m + LEFT] !=
-                    3)
-                    return 0;
-                if((out_neighbors4[m + LEFT] == 0 && cb->black_neighbors8[m +
-                    LEFT] > 1) || (out_neighbors4[m + LEFT] > 0 &&
-                    cb->black_neighbors8[m + LEFT] > 0))
-                    return 0;
-            }
-            if(!border_right[m] && cb->p[m + RIGHT] == EMPTY){
-                if(cb->white_neighbors4[m + RIGHT] + out_neighbors4[m + RIGHT]
-                    != 3)
-                    return 0;
-                if((out_neighbors4[m + RIGHT] == 0 && cb->black_neighbors8[m +
-                    RIGHT] > 1) || (out_neighbors4[m + RIGHT] > 0 &&
-                    cb->black_neighbors8[m + RIGHT] > 0))
-                    return 0;
-            }
-            if(!border_top[m] && cb->p[m + TOP] == EMPTY){
-                if(cb->white_neighbors4[m + TOP] + out_neighbors4[m + TOP] != 3)
-                    return 0;
-                if((out_neighbors4[m + TOP] == 0 && cb->black_neighbors8[m +
-                    TOP] > 1) || (out_neighbors4[m + TOP] > 0 &&
-                    cb->black_neighbors8[m + TOP] > 0))
-                    return 0;
-            }
-            if(!border_bottom[m] && cb->p[m + BOTTOM] == EMPTY){
-                if(cb->white_neighbors4[m + BOTTOM] + out_neighbors4[m + BOTTOM]
-                    != 3)
-                    return 0;
-                if((out_neighbors4[m + BOTTOM] == 0 && cb->black_neighbors8[m +
-                    BOTTOM] > 1) || (out_neighbors4[m + BOTTOM] > 0 &&
-                    cb->black_neighbors8[m + BOTTOM] > 0))
+            move n = neighbors_side[m].coord[k];
+            if(cb->p[n] != EMPTY)
+                continue;
+
+            u8 shape = shapes[cb->hash[n]];
+            if(shape & EYE_SHAPE_CORNER)
+                ++near_corner;
+            else
+                if(!(shape & EYE_SHAPE_END))
                     return 0;
-            }
-            return (4 - on4) * 4 + 4;
         }
-        else
-        {
-            if(on4 < 2 && on8 == on4 + 3)
-            {
-                /*
-                Bulky five or rabbity six
-                */
-                u8 near_corner = 0;
-                if(!border_left[m] && cb->p[m + LEFT] == EMPTY)
-                {
-                    u8 n4 = cb->white_neighbors4[m + LEFT] + out_neighbors4[m +
-                        LEFT];
-                    if(n4 == 2)
-                    {
-                        ++near_corner;
-
-                        if(cb->black_neighbors8[m + LEFT] > 0)
-                            return 0;
-                        if(cb->white_neighbors8[m + LEFT] + out_neighbors8[m +
-                            LEFT] != 4)
-                            return 0;
-                    }
-                    else
-                    {
-                        if(n4 != 3)
-                            return 0;
-
-                        if((out_neighbors4[m + LEFT] == 0 &&
-                            cb->black_neighbors8[m + LEFT] > 1) ||
-                            (out_neighbors4[m + LEFT] > 0 &&
-                            cb->black_neighbors8[m + LEFT] > 0))
-                            return 0;
-                    }
-                }
-                if(!border_right[m] && cb->p[m + RIGHT] == EMPTY)
-                {
-                    u8 n4 = cb->white_neighbors4[m + RIGHT] + out_neighbors4[m +
-                        RIGHT];
-                    if(n4 == 2)
-                    {
-                        ++near_corner;
-
-                        if(cb->black_neighbors8[m + RIGHT] > 0)
-                            return 0;
-                        if(cb->white_neighbors8[m + RIGHT] + out_neighbors8[m +
-                            RIGHT] != 4)
-                            return 0;
-                    }
-                    else
-                    {
-                        if(n4 != 3)
-                            return 0;
-
-                        if((out_neighbors4[m + RIGHT] == 0 &&
-                            cb->black_neighbors8[m + RIGHT] > 1) ||
-                            (out_neighbors4[m + RIGHT] > 0 &&
-                            cb->black_neighbors8[m + RIGHT] > 0))
-                            return 0;
-                    }
-                }
-                if(!border_top[m] && cb->p[m + TOP] == EMPTY){
-                    u8 n4 = cb->black_neighbors4[m + TOP] + out_neighbors4[m +
-                        TOP];
-                    if(n4 == 2)
-                    {
-                        if(near_corner == 2)
-                            return 0;
-                        ++near_corner;
 
-                        if(cb->black_neighbors8[m + TOP] > 0)
-                            return 0;
-                        if(cb->white_neighbors8[m + TOP] + out_neighbors8[m +
-                            TOP] != 4)
-                            return 0;
-                    }
-                    else
-                    {
-                        if(n4 != 3)
-                            return 0;
+        if(near_corner != 2)
+            return 0;
 
-                        if((out_neighbors4[m + TOP] == 0 &&
-                            cb->black_neighbors8[m + TOP] > 1) ||
-                            (out_neighbors4[m + TOP] > 0 &&
-                            cb->black_neighbors8[m + TOP] > 0))
-                            return 0;
-                    }
-                }
-                if(!border_bottom[m] && cb->p[m + BOTTOM] == EMPTY)
-                {
-                    u8 n4 = cb->black_neighbors4[m + BOTTOM] + out_neighbors4[m
-                        + BOTTOM];
-                    if(n4 == 2)
-                    {
-                        if(near_corner == 2)
-                            return 0;
-                        ++near_corner;
-
-                        if(cb->black_neighbors8[m + BOTTOM] > 0)
-                            return 0;
-                        if(cb->white_neighbors8[m + BOTTOM] + out_neighbors8[m +
-                            BOTTOM] != 4)
-                            return 0;
-                    }
-                    else
-                    {
-                        if(n4 != 3)
-                            return 0;
-
-                        if((out_neighbors4[m + BOTTOM] == 0 &&
-                            cb->black_neighbors8[m + BOTTOM] > 1) ||
-                            (out_neighbors4[m + BOTTOM] > 0 &&
-                            cb->black_neighbors8[m + BOTTOM] > 0))
-                            return 0;
-                    }
-                }
-
-                if(near_corner != 2)
-                    return 0;
-
-                return (5 - on4) * 5;
-            }
-        }
+        return (5 - on4) * 5;
     }
+
     return 0;
 }
 
@@ -822,20 +452,168 @@ void mark_near_pos(
 
     group * g = cb->g[m];
     if(g != NULL)
+        for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
+            for(u64 w = g->ls[i]; w != 0; w &= w - 1)
+                near_pos[i * 64 + __builtin_ctzll(w)] = true;
+}
+
+#if USE_TACTICAL_CACHE
+static u64 mix_key(
+    u64 h,
+    u8 v
+){
+    return (h ^ v) * 1099511628211ULL;
+}
+
+static bool in_box(
+    move m
+){
+    u8 x;
+    u8 y;
+    move_to_coord(m, &x, &y);
+    return x >= box_x0 && x <= box_x1 && y >= box_y0 && y <= box_y1;
+}
+
+/*
+Codifies the kind of reading, the group and the contents of the area around it:
+the stones, which of them are connected, the number of liberties of their groups
+and the ko point. Also sets the area as the one the reading is confined to.
+Readings that may depend on the liberties of weak groups outside of the area are
+not codified.
+RETURNS reading key, or 0 if the reading is not to be cached
+*/
+static u64 reading_key(
+    const cfg_board * cb,
+    const group * g,
+    u8 kind
+){
+    u8 x0 = BOARD_SIZ;
+    u8 y0 = BOARD_SIZ;
+    u8 x1 = 0;
+    u8 y1 = 0;
+    move first = g->stones.coord[0];
+    for(move k = 0; k < g->stones.count; ++k)
     {
-        u8 libs = g->liberties;
-        for(move n = g->liberties_min_coord; libs > 0; ++n)
+        move m = g->stones.coord[k];
+        if(m < first)
+            first = m;
+        u8 x;
+        u8 y;
+        move_to_coord(m, &x, &y);
+        x0 = x < x0 ? x : x0;
+        y0 = y < y0 ? y : y0;
+        x1 = x > x1 ? x : x1;
+        y1 = y > y1 ? y : y1;
+    }
+    box_x0 = x0 > READING_MARGIN ? x0 - READING_MARGIN : 0;
+    box_y0 = y0 > READING_MARGIN ? y0 - READING_MARGIN : 0;
+    box_x1 = x1 + READING_MARGIN < BOARD_SIZ ? x1 + READING_MARGIN : BOARD_SIZ -
+        1;
+    box_y1 = y1 + READING_MARGIN < BOARD_SIZ ? y1 + READING_MARGIN : BOARD_SIZ -
+        1;
+    box_escaped = false;
+
+    u64 h = 14695981039346656037ULL;
+    h = mix_key(h, kind);
+    h = mix_key(h, first & 0xff);
+    h = mix_key(h, first >> 8);
+    h = mix_key(h, box_x0);
+    h = mix_key(h, box_y0);
+    h = mix_key(h, box_x1);
+    h = mix_key(h, box_y1);
+
+    const group * seen[TOTAL_BOARD_SIZ];
+    u16 seen_count = 0;
+
+    for(u8 x = box_x0; x <= box_x1; ++x)
+        for(u8 y = box_y0; y <= box_y1; ++y)
         {
-            u8 mask = (1 << (n % 8));
-            if(g->ls[n / 8] & mask)
-            {
-                near_pos[n] = true;
-                --libs;
-            }
+            move m = coord_to_move(x, y);
+            u8 v = cb->p[m];
+            h = mix_key(h, v);
+            if(v == EMPTY)
+                continue;
+
+            const group * n = cb->g[m];
+            u16 label = 0;
+            while(label < seen_count && seen[label] != n)
+                ++label;
+            h = mix_key(h, label & 0xff);
+            h = mix_key(h, label >> 8);
+            if(label < seen_count)
+                continue;
+
+            seen[seen_count++] = n;
+            h = mix_key(h, n->liberties < 7 ? n->liberties : 7);
+            if(n->liberties <= 4)
+                for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
+                    for(u64 w = n->ls[i]; w != 0; w &= w - 1)
+                        if(!in_box(i * 64 + __builtin_ctzll(w)))
+                            return 0;
         }
+
+    move ko = get_ko_play(cb);
+    h = mix_key(h, ko == NONE ? 0xff : (ko & 0xff));
+    h = mix_key(h, ko == NONE ? 0xff : (ko >> 8));
+
+    return h == 0 ? 1 : h;
+}
+
+static reading * cache_entry(
+    u64 key
+){
+    return &tactical_cache[(key ^ (key >> 32)) & (TACTICAL_CACHE_SIZ - 1)];
+}
+
+/*
+Appends the plays of a cached reading to plays.
+RETURNS true if found
+*/
+static bool cache_find(
+    u64 key,
+    u16 * plays_count,
+    move * plays
+){
+    if(key == 0)
+        return false;
+
+    reading * r = cache_entry(key);
+    if(r->key != key)
+        return false;
+
+    for(u8 i = 0; i < r->plays_count; ++i)
+    {
+        plays[*plays_count] = r->plays[i];
+        (*plays_count)++;
     }
+    return true;
 }
 
+/*
+Stores a reading, unless it was not confined to its area.
+*/
+static void cache_store(
+    u64 key,
+    u16 plays_count,
+    const move * plays
+){
+    if(key == 0 || box_escaped || plays_count > TACTICAL_CACHE_MAX_PLAYS)
+        return;
+
+    reading * r = cache_entry(key);
+    r->key = key;
+    r->plays_count = plays_count;
+    memcpy(r->plays, plays, plays_count * sizeof(move));
+}
+
+static void check_box(
+    move m
+){
+    if(!in_box(m))
+        box_escaped = true;
+}
+#endif
+
 static bool can_be_killed2(
     cfg_board * b,
     move om,
@@ -843,6 +621,59 @@ static bool can_be_killed2(
     u32 depth
 );
 
+static bool can_be_killed3(
+    cfg_board * cb,
+    move om,
+    bool is_black,
+    u32 depth
+);
+
+/*
+Plays at m and tests whether the group at om can then be killed, with the
+opponent to play; the play is undone before returning.
+RETURNS true if the group can be killed
+*/
+static bool killed_after_defense(
+    cfg_board * cb,
+    bool is_black,
+    move m,
+    move om,
+    u32 depth
+){
+#if USE_TACTICAL_CACHE
+    check_box(m);
+#endif
+    cfg_undo u;
+    cfg_board_journal(cb, is_black, m, &u);
+    just_play(cb, is_black, m);
+    bool ret = can_be_killed3(cb, om, !is_black, depth);
+    cfg_board_undo(cb, &u);
+    return ret;
+}
+
+/*
+Plays at m and tests whether the group at om can then be killed, with its owner
+to play; the play is undone before returning.
+RETURNS true if the group can be killed
+*/
+static bool killed_after_attack(
+    cfg_board * cb,
+    bool is_black,
+    move m,
+    move om,
+    u32 depth
+){
+#if USE_TACTICAL_CACHE
+    check_box(m);
+#endif
+    cfg_undo u;
+    cfg_board_journal(cb, is_black, m, &u);
+    just_play(cb, is_black, m);
+    bool ret = can_be_killed2(cb, om, !is_black, depth);
+    cfg_board_undo(cb, &u);
+    return ret;
+}
+
 /*
 Attempt attack on group with 1 or 2 liberties.
 */
@@ -864,26 +695,14 @@ static bool can_be_killed3(
         return false; /* superko */
 
     move m = get_1st_liberty(g);
-    if(can_play(cb, is_black, m))
-    {
-        cfg_board tmp;
-        cfg_board_clone(&tmp, cb);
-        just_play(&tmp, is_black, m);
-        if(can_be_killed2(&tmp, om, !is_black, depth + 1))
-        {
-            cfg_board_free(&tmp);
-            return true;
-        }
-        cfg_board_free(&tmp);
-    }
+    if(can_play(cb, is_black, m) && killed_after_attack(cb, is_black, m, om,
+        depth + 1))
+        return true;
 
     m = get_next_liberty(g, m);
-    if(can_play(cb, is_black, m))
-    {
-        just_play(cb, is_black, m);
-        if(can_be_killed2(cb, om, !is_black, depth + 1))
-            return true;
-    }
+    if(can_play(cb, is_black, m) && killed_after_attack(cb, is_black, m, om,
+        depth + 1))
+        return true;
 
     return false;
 }
@@ -905,8 +724,6 @@ static bool can_be_killed2(
     if(depth >= BOARD_SIZ * 4)
         return false; /* superko */
 
-    cfg_board tmp;
-
     /* try a capture if possible */
     for(u16 k = 0; k < g->neighbors_count; ++k)
     {
@@ -914,54 +731,33 @@ static bool can_be_killed2(
         if(n->liberties == 1 && !groups_share_liberties(g, n))
         {
             move m = get_1st_liberty(n);
-            if(can_play(cb, is_black, m))
-            {
-                cfg_board_clone(&tmp, cb);
-                just_play(&tmp, is_black, m);
-                if(!can_be_killed3(&tmp, om, !is_black, depth + 1))
-                {
-                    cfg_board_free(&tmp);
-                    return false;
-                }
-                cfg_board_free(&tmp);
-            }
+            if(can_play(cb, is_black, m) && !killed_after_defense(cb, is_black,
+                m, om, depth + 1))
+                return false;
         }
     }
 
     /* try 1st liberty */
     move m = get_1st_liberty(g);
-    if(can_play(cb, is_black, m))
-    {
-        cfg_board_clone(&tmp, cb);
-        just_play(&tmp, is_black, m);
-        if(!can_be_killed3(&tmp, om, !is_black, depth + 1))
-        {
-            cfg_board_free(&tmp);
-            return false;
-        }
-        cfg_board_free(&tmp);
-    }
+    if(can_play(cb, is_black, m) && !killed_after_defense(cb, is_black, m, om,
+        depth + 1))
+        return false;
 
     if(g->liberties == 2)
     {
         m = get_next_liberty(g, m);
-        if(can_play(cb, is_black, m))
-        {
-            cfg_board_clone(&tmp, cb);
-            just_play(&tmp, is_black, m);
-            if(!can_be_killed3(&tmp, om, !is_black, depth + 1))
-            {
-                cfg_board_free(&tmp);
-                return false;
-            }
-            cfg_board_free(&tmp);
-        }
+        if(can_play(cb, is_black, m) && !killed_after_defense(cb, is_black, m,
+            om, depth + 1))
+            return false;
     }
 
     /* what about just passing/playing elsewhere? */
+    cfg_undo u;
+    cfg_board_journal(cb, is_black, PASS, &u);
     just_pass(cb);
-
-    return can_be_killed3(cb, om, !is_black, depth + 1);
+    bool ret = can_be_killed3(cb, om, !is_black, depth + 1);
+    cfg_board_undo(cb, &u);
+    return ret;
 }
 
 /*
@@ -984,52 +780,50 @@ move get_killing_play(
     if(g->liberties > 3)
         return NONE;
 
+#if USE_TACTICAL_CACHE
+    u64 key = reading_key(cb, g, READ_KILLING_PLAY);
+    move ret = NONE;
+    u16 found = 0;
+    if(cache_find(key, &found, &ret))
+        return ret;
+#else
+    move ret = NONE;
+#endif
+
     cfg_board tmp;
+    cfg_board_clone(&tmp, cb);
 
     /* attempt attack group */
     move m = get_1st_liberty(g);
-    if(can_play(cb, !g->is_black, m))
+    if(can_play(cb, !g->is_black, m) && killed_after_attack(&tmp,
+        !g->is_black, m, g->stones.coord[0], 0))
     {
-        cfg_board_clone(&tmp, cb);
-        just_play(&tmp, !g->is_black, m);
-        if(can_be_killed2(&tmp, g->stones.coord[0], g->is_black, 0))
-        {
-            cfg_board_free(&tmp);
-            return m;
-        }
-        cfg_board_free(&tmp);
+        ret = m;
+        goto get_killing_play_end;
     }
 
     m = get_next_liberty(g, m);
-    if(can_play(cb, !g->is_black, m))
+    if(can_play(cb, !g->is_black, m) && killed_after_attack(&tmp,
+        !g->is_black, m, g->stones.coord[0], 0))
     {
-        cfg_board_clone(&tmp, cb);
-        just_play(&tmp, !g->is_black, m);
-        if(can_be_killed2(&tmp, g->stones.coord[0], g->is_black, 0))
-        {
-            cfg_board_free(&tmp);
-            return m;
-        }
-        cfg_board_free(&tmp);
+        ret = m;
+        goto get_killing_play_end;
     }
 
     if(g->liberties == 3)
     {
         m = get_next_liberty(g, m);
-        if(can_play(cb, !g->is_black, m))
-        {
-            cfg_board_clone(&tmp, cb);
-            just_play(&tmp, !g->is_black, m);
-            if(can_be_killed2(&tmp, g->stones.coord[0], g->is_black, 0))
-            {
-                cfg_board_free(&tmp);
-                return m;
-            }
-            cfg_board_free(&tmp);
-        }
+        if(can_play(cb, !g->is_black, m) && killed_after_attack(&tmp,
+            !g->is_black, m, g->stones.coord[0], 0))
+            ret = m;
     }
 
-    return NONE;
+get_killing_play_end:
+    cfg_board_free(&tmp);
+#if USE_TACTICAL_CACHE
+    cache_store(key, 1, &ret);
+#endif
+    return ret;
 }
 
 
@@ -1060,50 +854,48 @@ void can_be_killed_all(
     if(g->liberties > 3)
         return;
 
+#if USE_TACTICAL_CACHE
+    u64 key = reading_key(cb, g, READ_KILLING_ALL);
+    if(cache_find(key, plays_count, plays))
+        return;
+    u16 first_play = *plays_count;
+#endif
+
     cfg_board tmp;
+    cfg_board_clone(&tmp, cb);
 
     /* attempt attack group */
     move m = get_1st_liberty(g);
-    if(can_play(cb, !g->is_black, m))
+    if(can_play(cb, !g->is_black, m) && killed_after_attack(&tmp,
+        !g->is_black, m, g->stones.coord[0], 0))
     {
-        cfg_board_clone(&tmp, cb);
-        just_play(&tmp, !g->is_black, m);
-        if(can_be_killed2(&tmp, g->stones.coord[0], g->is_black, 0))
-        {
-            plays[*plays_count] = m;
-            (*plays_count)++;
-        }
-        cfg_board_free(&tmp);
+        plays[*plays_count] = m;
+        (*plays_count)++;
     }
 
     m = get_next_liberty(g, m);
-    if(can_play(cb, !g->is_black, m))
+    if(can_play(cb, !g->is_black, m) && killed_after_attack(&tmp,
+        !g->is_black, m, g->stones.coord[0], 0))
     {
-        cfg_board_clone(&tmp, cb);
-        just_play(&tmp, !g->is_black, m);
-        if(can_be_killed2(&tmp, g->stones.coord[0], g->is_black, 0))
-        {
-            plays[*plays_count] = m;
-            (*plays_count)++;
-        }
-        cfg_board_free(&tmp);
+        plays[*plays_count] = m;
+        (*plays_count)++;
     }
 
     if(g->liberties == 3)
     {
         m = get_next_liberty(g, m);
-        if(can_play(cb, !g->is_black, m))
+        if(can_play(cb, !g->is_black, m) && killed_after_attack(&tmp,
+            !g->is_black, m, g->stones.coord[0], 0))
         {
-            cfg_board_clone(&tmp, cb);
-            just_play(&tmp, !g->is_black, m);
-            if(can_be_killed2(&tmp, g->stones.coord[0], g->is_black, 0))
-            {
-                plays[*plays_count] = m;
-                (*plays_count)++;
-            }
-            cfg_board_free(&tmp);
+            plays[*plays_count] = m;
+            (*plays_count)++;
         }
     }
+
+    cfg_board_free(&tmp);
+#if USE_TACTICAL_CACHE
+    cache_store(key, *plays_count - first_play, plays + first_play);
+#endif
 }
 
 
@@ -1116,7 +908,18 @@ move get_saving_play(
     const cfg_board * cb,
     const group * g
 ){
+#if USE_TACTICAL_CACHE
+    u64 key = reading_key(cb, g, READ_SAVING_PLAY);
+    move ret = NONE;
+    u16 found = 0;
+    if(cache_find(key, &found, &ret))
+        return ret;
+#else
+    move ret = NONE;
+#endif
+
     cfg_board tmp;
+    cfg_board_clone(&tmp, cb);
 
     /* try a capture if possible */
     for(u16 k = 0; k < g->neighbors_count; ++k)
@@ -1125,67 +928,49 @@ move get_saving_play(
         if(n->liberties == 1 && !groups_share_liberties(g, n))
         {
             move m = get_1st_liberty(n);
-            if(can_play(cb, g->is_black, m))
+            if(can_play(cb, g->is_black, m) && !killed_after_defense(&tmp,
+                g->is_black, m, g->stones.coord[0], 0))
             {
-                cfg_board_clone(&tmp, cb);
-                just_play(&tmp, g->is_black, m);
-                if(!can_be_killed3(&tmp, g->stones.coord[0], !g->is_black, 0))
-                {
-                    cfg_board_free(&tmp);
-                    return m;
-                }
-                cfg_board_free(&tmp);
+                ret = m;
+                goto get_saving_play_end;
             }
         }
     }
 
     /* attempt defend group */
     move m = get_1st_liberty(g);
-    if(can_play(cb, g->is_black, m))
+    if(can_play(cb, g->is_black, m) && !killed_after_defense(&tmp, g->is_black,
+        m, g->stones.coord[0], 0))
     {
-        cfg_board_clone(&tmp, cb);
-        just_play(&tmp, g->is_black, m);
-        if(!can_be_killed3(&tmp, g->stones.coord[0], !g->is_black, 0))
-        {
-            cfg_board_free(&tmp);
-            return m;
-        }
-        cfg_board_free(&tmp);
+        ret = m;
+        goto get_saving_play_end;
     }
 
     if(g->liberties > 1)
     {
         m = get_next_liberty(g, m);
-        if(can_play(cb, g->is_black, m))
+        if(can_play(cb, g->is_black, m) && !killed_after_defense(&tmp,
+            g->is_black, m, g->stones.coord[0], 0))
         {
-            cfg_board_clone(&tmp, cb);
-            just_play(&tmp, g->is_black, m);
-            if(!can_be_killed3(&tmp, g->stones.coord[0], !g->is_black, 0))
-            {
-                cfg_board_free(&tmp);
-                return m;
-            }
-            cfg_board_free(&tmp);
+            ret = m;
+            goto get_saving_play_end;
         }
 
         if(g->liberties > 2)
         {
             m = get_next_liberty(g, m);
-            if(can_play(cb, g->is_black, m))
-            {
-                cfg_board_clone(&tmp, cb);
-                just_play(&tmp, g->is_black, m);
-                if(!can_be_killed3(&tmp, g->stones.coord[0], !g->is_black, 0))
-                {
-                    cfg_board_free(&tmp);
-                    return m;
-                }
-                cfg_board_free(&tmp);
-            }
+            if(can_play(cb, g->is_black, m) && !killed_after_defense(&tmp,
+                g->is_black, m, g->stones.coord[0], 0))
+                ret = m;
         }
     }
 
-    return NONE;
+get_saving_play_end:
+    cfg_board_free(&tmp);
+#if USE_TACTICAL_CACHE
+    cache_store(key, 1, &ret);
+#endif
+    return ret;
 }
 
 /*
@@ -1217,7 +1002,15 @@ void can_be_saved_all(
     if(g->liberties > 3)
         return;
 
+#if USE_TACTICAL_CACHE
+    u64 key = reading_key(cb, g, READ_SAVING_ALL);
+    if(cache_find(key, plays_count, plays))
+        return;
+    u16 first_play = *plays_count;
+#endif
+
     cfg_board tmp;
+    cfg_board_clone(&tmp, cb);
 
     /* try a capture if possible */
     for(u16 k = 0; k < g->neighbors_count; ++k)
@@ -1226,64 +1019,59 @@ void can_be_saved_all(
         if(n->liberties == 1 && !groups_share_liberties(g, n))
         {
             move m = get_1st_liberty(n);
-            if(can_play(cb, g->is_black, m))
+            if(can_play(cb, g->is_black, m) && !killed_after_defense(&tmp,
+                g->is_black, m, g->stones.coord[0], 0))
             {
-                cfg_board_clone(&tmp, cb);
-                just_play(&tmp, g->is_black, m);
-                if(!can_be_killed3(&tmp, g->stones.coord[0], !g->is_black, 0))
-                {
-                    plays[*plays_count] = m;
-                    (*plays_count)++;
-                }
-                cfg_board_free(&tmp);
+                plays[*plays_count] = m;
+                (*plays_count)++;
             }
         }
     }
 
     /* attempt defend group */
     move m = get_1st_liberty(g);
-    if(can_play(cb, g->is_black, m))
+    if(can_play(cb, g->is_black, m) && !killed_after_defense(&tmp, g->is_black,
+        m, g->stones.coord[0], 0))
     {
-        cfg_board_clone(&tmp, cb);
-        just_play(&tmp, g->is_black, m);
-        if(!can_be_killed3(&tmp, g->stones.coord[0], !g->is_black, 0))
-        {
-            plays[*plays_count] = m;
-            (*plays_count)++;
-        }
-        cfg_board_free(&tmp);
+        plays[*plays_count] = m;
+        (*plays_count)++;
     }
 
     if(g->liberties > 1)
     {
         m = get_next_liberty(g, m);
-        if(can_play(cb, g->is_black, m))
+        if(can_play(cb, g->is_black, m) && !killed_after_defense(&tmp,
+            g->is_black, m, g->stones.coord[0], 0))
         {
-            cfg_board_clone(&tmp, cb);
-            just_play(&tmp, g->is_black, m);
-            if(!can_be_killed3(&tmp, g->stones.coord[0], !g->is_black, 0))
-            {
-                plays[*plays_count] = m;
-                (*plays_count)++;
-            }
-            cfg_board_free(&tmp);
+            plays[*plays_count] = m;
+            (*plays_count)++;
         }
 
         if(g->liberties > 2)
         {
             m = get_next_liberty(g, m);
-            if(can_play(cb, g->is_black, m))
+            if(can_play(cb, g->is_black, m) && !killed_after_defense(&tmp,
+                g->is_black, m, g->stones.coord[0], 0))
             {
-                cfg_board_clone(&tmp, cb);
-                just_play(&tmp, g->is_black, m);
-                if(!can_be_killed3(&tmp, g->stones.coord[0], !g->is_black, 0))
-                {
-                    plays[*plays_count] = m;
-                    (*plays_count)++;
-                }
-                cfg_board_free(&tmp);
+                plays[*plays_count] = m;
+                (*plays_count)++;
             }
         }
     }
+
+    cfg_board_free(&tmp);
+#if USE_TACTICAL_CACHE
+    cache_store(key, *plays_count - first_play, plays + first_play);
+#endif
 }
 
+/*
+Empties the cache of readings of the 1-2 liberty solvers of the calling thread,
+if USE_TACTICAL_CACHE.
+*/
+void tactical_cache_clear()
+{
+#if USE_TACTICAL_CACHE
+    memset(tactical_cache, 0, sizeof(tactical_cache));
+#endif
+}
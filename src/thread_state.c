@@ -0,0 +1,72 @@
+/*
+Memory for the state of each thread, allocated at runtime for the threads that
+use it instead of statically for the maximum number of threads.
+
+The state of a thread is allocated and zeroed by the thread itself, on its first
+use, so with the first-touch memory policy of the system it is placed in the
+memory node of the core running it; which only holds if the threads are bound to
+cores, for instance with OMP_PROC_BIND=true. Each state is aligned and padded to
+cache lines, so the states of different threads don't false share.
+*/
+
+/* for posix_memalign */
+#define _DEFAULT_SOURCE
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "flog.h"
+#include "mem_usage.h"
+#include "thread_state.h"
+#include "types.h"
+
+
+static size_t padded_siz(
+    const thread_states * ts
+){
+    return (ts->siz + CACHE_LINE_SIZ - 1) / CACHE_LINE_SIZ * CACHE_LINE_SIZ;
+}
+
+/*
+RETURNS the state of the calling thread, allocated by it on its first use and
+zeroed
+*/
+void * thread_state(
+    thread_states * ts
+){
+    int t = omp_get_thread_num();
+    if(ts->states[t] == NULL)
+    {
+        void * s;
+        if(posix_memalign(&s, CACHE_LINE_SIZ, padded_siz(ts)) != 0)
+            flog_crit("thrd", "system out of memory");
+        memset(s, 0, padded_siz(ts));
+        ts->states[t] = s;
+        mem_usage_add(MEM_THREAD_STATES, padded_siz(ts));
+    }
+    return ts->states[t];
+}
+
+/*
+RETURNS the state of the thread of number t, or NULL if it has never used it
+*/
+void * thread_state_of(
+    const thread_states * ts,
+    u16 t
+){
+    return ts->states[t];
+}
+
+/*
+Zeroes the states of all threads. Not thread-safe.
+*/
+void thread_states_clear(
+    thread_states * ts
+){
+    for(u16 t = 0; t < MAXIMUM_NUM_THREADS; ++t)
+        if(ts->states[t] != NULL)
+            memset(ts->states[t], 0, padded_siz(ts));
+}
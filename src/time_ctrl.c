@@ -60,6 +60,36 @@ u32 calc_time_to_play(
     return (u32)MAX(t_t, 50);
 }
 
+/*
+Calculate the maximum time that can be used in a play, if the search needs to
+be extended, based on a Canadian byo-yomi time system. Also compensates for
+network latency.
+RETURNS maximum time available in milliseconds
+*/
+u32 calc_max_time_to_play(
+    time_system * ts,
+    u16 turns_played
+){
+    u32 t = calc_time_to_play(ts, turns_played);
+    if(t == UINT32_MAX)
+        return t;
+
+    double max_t = t * TIME_EXTENSION_FACTOR;
+
+    /*
+    Don't risk the period; time of the current byo-yomi period can be spent in
+    full if only one stone is left.
+    */
+    double limit = ts->main_time_remaining;
+    if(ts->byo_yomi_stones_remaining > 0)
+        limit += ts->byo_yomi_time_remaining /
+            ((double)ts->byo_yomi_stones_remaining);
+    limit -= LATENCY_COMPENSATION;
+
+    max_t = MIN(max_t, limit);
+    return (u32)MAX(max_t, t);
+}
+
 /*
 Set the complete Canadian byo-yomi time system.
 */
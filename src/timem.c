@@ -19,14 +19,11 @@ are in milliseconds.
 
 
 /*
-Returns a current time mark with millisecond precision. Will be monotonic if
-supported by the system. Is thread-safe.
-RETURNS time in milliseconds
+Reads the system clock; monotonic if supported by the system.
 */
-u64 current_time_in_millis()
-{
-    struct timespec ts;
-
+static void read_clock(
+    struct timespec * ts
+){
 #ifdef __MACH__
     /*
     macOS
@@ -36,8 +33,8 @@ u64 current_time_in_millis()
     host_get_clock_service(mach_host_self(), CALENDAR_CLOCK, &cclock);
     clock_get_time(cclock, &mts);
     mach_port_deallocate(mach_task_self(), cclock);
-    ts.tv_sec = mts.tv_sec;
-    ts.tv_nsec = mts.tv_nsec;
+    ts->tv_sec = mts.tv_sec;
+    ts->tv_nsec = mts.tv_nsec;
 
 #else
     /*
@@ -45,17 +42,43 @@ u64 current_time_in_millis()
     */
     /* POSIX.1 conforming */
 #ifdef _POSIX_MONOTONIC_CLOCK
-    clock_gettime(CLOCK_MONOTONIC, &ts);
+    clock_gettime(CLOCK_MONOTONIC, ts);
 #else
-    clock_gettime(CLOCK_REALTIME, &ts);
+    clock_gettime(CLOCK_REALTIME, ts);
 #endif
 #endif
+}
+
+/*
+Returns a current time mark with millisecond precision. Will be monotonic if
+supported by the system. Is thread-safe.
+RETURNS time in milliseconds
+*/
+u64 current_time_in_millis()
+{
+    struct timespec ts;
+    read_clock(&ts);
 
     u64 ret = ts.tv_sec * 1000;
     ret += ts.tv_nsec / 1000000;
     return ret;
 }
 
+/*
+Returns a current time mark with nanosecond precision, for measuring short
+intervals. Will be monotonic if supported by the system. Is thread-safe.
+RETURNS time in nanoseconds
+*/
+u64 current_time_in_nanos()
+{
+    struct timespec ts;
+    read_clock(&ts);
+
+    u64 ret = ((u64)ts.tv_sec) * 1000000000;
+    ret += ts.tv_nsec;
+    return ret;
+}
+
 /*
 Returns the current nanoseconds count from the system clock. Is not monotonic.
 RETURNS nanoseconds
@@ -63,30 +86,7 @@ RETURNS nanoseconds
 u64 current_nanoseconds()
 {
     struct timespec ts;
-
-#ifdef __MACH__
-    /*
-    macOS
-    */
-    clock_serv_t cclock;
-    mach_timespec_t mts;
-    host_get_clock_service(mach_host_self(), CALENDAR_CLOCK, &cclock);
-    clock_get_time(cclock, &mts);
-    mach_port_deallocate(mach_task_self(), cclock);
-    ts.tv_sec = mts.tv_sec;
-    ts.tv_nsec = mts.tv_nsec;
-
-#else
-    /*
-    Linux, BSD
-    */
-    /* POSIX.1 conforming */
-#ifdef _POSIX_MONOTONIC_CLOCK
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-#else
-    clock_gettime(CLOCK_REALTIME, &ts);
-#endif
-#endif
+    read_clock(&ts);
 
     return ts.tv_nsec;
 }
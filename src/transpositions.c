@@ -1,8 +1,9 @@
 /*
 Transpositions table and tree implementation.
 
-Doesn't assume states are in reduced form. States contain full information and
-are compared after the hash (collisions are impossible). Zobrist hashing with 64
+Doesn't assume states are in reduced form. States contain full information, with
+the board packed in 2 bits per position, and are compared after the hash
+(collisions are impossible). Zobrist hashing with 64
 bits is used. Clean-up is available only between turns or between games.
 
 Please note there is no separate 'UCT state information' file. It is mostly
@@ -11,8 +12,18 @@ interweaved with the transpositions table.
 The table is actually two tables, one for each player. Mixing their statistics
 is illegal. The nodes statistics are from the perspective of the respective
 table color.
+
+The memory limit covers both states and their plays; since each expanded state
+only stores the plays it has, the same memory holds many more states.
+
+The states of positions with few stones, found in the descents, are stored in a
+canonical orientation so the symmetric variants of the opening share them; see
+TT_SYMMETRY_MAX_STONES.
 */
 
+/* for MAP_ANONYMOUS, MAP_HUGETLB and madvise */
+#define _DEFAULT_SOURCE
+
 #include "config.h"
 
 #include <string.h>
@@ -20,125 +31,842 @@ table color.
 #include <stdlib.h>
 #include <assert.h>
 #include <omp.h>
+#include <sys/mman.h>
 
 #include "alloc.h"
 #include "board.h"
 #include "cfg_board.h"
+#include "crc32.h"
 #include "flog.h"
+#include "matrix.h"
+#include "mem_usage.h"
+#include "move.h"
+#include "open_table.h"
 #include "primes.h"
+#include "thread_state.h"
+#include "timem.h"
 #include "transpositions.h"
 #include "types.h"
 #include "zobrist.h"
 
+extern d16 komi;
+
 u16 expansion_delay = UCT_EXPANSION_DELAY;
 u64 max_size_in_mbs = DEFAULT_UCT_MEMORY;
 
+static u64 max_memory;
 static u32 max_allocated_states;
 static u32 number_of_buckets;
 
 static u32 allocated_states = 0;
 static u32 states_in_use = 0;
 
-static omp_lock_t b_table_lock;
-static omp_lock_t w_table_lock;
-static tt_stats ** b_stats_table = NULL;
-static tt_stats ** w_stats_table = NULL;
+/*
+Play statistics are not stored inline in the states, but in blocks carved from
+large chunks. A block holds the tt_play array and the bitmap of the positions
+of the plays, followed by the arrays of hot statistics and the indexes of the
+plays by position and by prior. Blocks are sized by class, of multiples of
+TT_PLAYS_CLASS_SIZ plays, so freed blocks are kept in free lists by class,
+linked through their first bytes, and serve any state of the class. Once the
+chunks reach the memory limit blocks of larger classes are split instead of
+carving more chunks. Blocks are padded to keep the alignment of the next block.
+*/
+#define TT_PLAY_SIZ (sizeof(tt_play) + 2 * sizeof(u32) + 2 * sizeof(float) + \
+    sizeof(u16) + 2 * sizeof(move))
+#define TT_PLAYS_SET_SIZ (LIB_BITMAP_WORDS * sizeof(u64))
+#define TT_BLOCK_SIZ(count) ((((count) * TT_PLAY_SIZ) + TT_PLAYS_SET_SIZ + 7) \
+    & ~((u32)7))
+#define TT_PLAYS_CHUNK_SIZ (4 * 1048576)
+#define TT_PLAYS_CLASS_SIZ 8
+#define TT_PLAYS_CLASSES ((MAX_PLAYS_COUNT + TT_PLAYS_CLASS_SIZ - 1) / \
+    TT_PLAYS_CLASS_SIZ + 1)
+#define TT_PLAYS_CLASS(count) (((count) + TT_PLAYS_CLASS_SIZ - 1) / \
+    TT_PLAYS_CLASS_SIZ)
+#define TT_CLASS_BLOCK_SIZ(class) TT_BLOCK_SIZ((class) * TT_PLAYS_CLASS_SIZ)
+
+static omp_lock_t plays_lock;
+static u8 * plays_chunk = NULL;
+static u32 plays_chunk_left = 0; /* in bytes */
+static void * freed_plays[TT_PLAYS_CLASSES];
+static u64 allocated_plays_mem = 0;
+/* in bytes, of the blocks in use and of the blocks in the free lists */
+static u64 plays_mem_in_use = 0;
+static u64 freed_plays_mem = 0;
+
+/*
+The chunks of plays allocated, so the ones left without blocks in use can be
+released by tt_trim_plays. The chunks carved from a slab are kept as spares,
+with their pages returned to the system, and are used again before carving more.
+*/
+typedef struct __tt_plays_chunk_ {
+    u8 * mem;
+    bool spare;
+    bool in_use; /* only valid while trimming */
+} tt_plays_chunk;
+
+static tt_plays_chunk * plays_chunks = NULL;
+static u32 plays_chunks_count = 0;
+static u32 plays_chunks_capacity = 0;
+
+/*
+The slab is carved with states from the bottom and with chunks of plays from
+the top, until they meet. Raising the memory limit reserves another slab, that
+is carved once the previous ones are used up.
+*/
+#define TT_SLAB_ALIGNMENT (2 * 1048576)
+#define TT_MAX_SLABS 16
+
+/*
+Pruning starts by cutting plays with less MC visits than TT_PRUNE_MIN_VISITS,
+prior visits included, and frees at least 1/TT_PRUNE_FRACTION of the states.
+*/
+#define TT_PRUNE_MIN_VISITS 64
+#define TT_PRUNE_FRACTION 4
+
+static omp_lock_t slab_lock;
+static u8 * slabs[TT_MAX_SLABS];
+static u64 slabs_siz[TT_MAX_SLABS];
+static u16 slabs_count = 0;
+#if TT_USE_SLAB
+static u64 slabs_total_siz = 0;
+#endif
+static u16 slab_idx = 0; /* slab being carved */
+static u8 * slab_bottom = NULL;
+static u8 * slab_top = NULL;
+/* whether memory was ever allocated outside of the slab */
+static bool system_allocated = false;
+static bool slab_huge_pages = false;
+
+/*
+Bucket locks are striped: bucket i is guarded by lock i % TT_LOCK_STRIPES. Each
+lock is padded to its own cache line so threads descending different parts of
+the tree don't contend nor false share.
+*/
+typedef struct __tt_lock_stripe_ {
+    omp_lock_t lock;
+    u8 _pad[CACHE_LINE_SIZ - sizeof(omp_lock_t)];
+} tt_lock_stripe;
+
+static tt_lock_stripe b_table_locks[TT_LOCK_STRIPES];
+static tt_lock_stripe w_table_locks[TT_LOCK_STRIPES];
+
+#if TT_CLUSTER_BUCKETS
+/*
+A cluster holds the low 32 bits of the hashes of up to TT_CLUSTER_WAYS states,
+and pointers to them, the ones in use first. The home cluster of a state is
+given by the low bits of its hash. States only go to the following clusters of
+the same lock stripe when their home is full, and the home counts them in
+displaced, so lookups know when to stop looking.
+*/
+#define TT_CLUSTER_WAYS 5
+
+typedef struct __tt_cluster_ {
+    u32 tags[TT_CLUSTER_WAYS];
+    u32 displaced;
+    tt_stats * states[TT_CLUSTER_WAYS];
+} tt_cluster;
+
+typedef tt_cluster tt_bucket;
+#else
+typedef tt_stats * tt_bucket;
+#endif
+
+static tt_bucket * b_stats_table = NULL;
+static tt_bucket * w_stats_table = NULL;
 
 static omp_lock_t freed_nodes_lock;
 static tt_stats * freed_nodes = NULL;
 
+/*
+Lookup counters of each thread, in the state of the thread so they are updated
+without synchronization.
+*/
+static thread_states lookup_stats = THREAD_STATES(tt_lookup_stats);
+
 /* value used to mark items for deletion; will cycle eventually but its not a
 big deal */
 static u8 maintenance_mark = 0;
 
+/* incremental release of the states not marked */
+static bool sweep_pending = false;
+static u32 sweep_next_bucket;
+
+/* states whose subtrees are kept as well, for other games using the table */
+static board kept_roots[TT_MAX_KEPT_ROOTS];
+static bool kept_roots_is_black[TT_MAX_KEPT_ROOTS];
+static u16 kept_roots_count = 0;
+
+/* moves transformed by each reduction method, and reverted */
+static move reduced_moves[ROTFLIP270 + 1][TOTAL_BOARD_SIZ];
+static move reverted_moves[ROTFLIP270 + 1][TOTAL_BOARD_SIZ];
+
+
+#if TT_USE_SLAB
+/*
+Reserves a slab of memory for states and plays, preferably with huge pages. On
+failure the states and plays are allocated as needed instead.
+*/
+static void init_slab(
+    u64 siz
+){
+    if(slabs_count == TT_MAX_SLABS)
+        return;
+
+    siz = ((siz + TT_SLAB_ALIGNMENT - 1) / TT_SLAB_ALIGNMENT) *
+        TT_SLAB_ALIGNMENT;
+    void * mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    mem = mmap(NULL, siz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS
+        | MAP_HUGETLB, -1, 0);
+    slab_huge_pages = (mem != MAP_FAILED);
+#endif
+    if(mem == MAP_FAILED)
+    {
+        mem = mmap(NULL, siz, PROT_READ | PROT_WRITE, MAP_PRIVATE |
+            MAP_ANONYMOUS, -1, 0);
+        if(mem == MAP_FAILED)
+        {
+            flog_warn("tt", "could not reserve memory slab; allocating as "
+                "needed");
+            return;
+        }
+#ifdef MADV_HUGEPAGE
+        slab_huge_pages = (madvise(mem, siz, MADV_HUGEPAGE) == 0);
+#endif
+    }
+
+    u8 * slab = (u8 *)mem;
+    slabs[slabs_count] = slab;
+    slabs_siz[slabs_count] = siz;
+    slabs_total_siz += siz;
+    if(slabs_count == 0)
+    {
+        slab_bottom = slab;
+        slab_top = slab + siz;
+    }
+    ++slabs_count;
+
+#if TT_PREFAULT_SLAB
+    #pragma omp parallel for
+    for(u64 i = 0; i < siz / 4096; ++i)
+        slab[i * 4096] = 0;
+#endif
+}
+#endif
+
+/*
+Moves on to the next slab, if any, when the one being carved is used up.
+RETURNS true if there is a slab with at least siz bytes free
+*/
+static bool slab_has_free(
+    u64 siz
+){
+    while(slabs_count > 0 && (u64)(slab_top - slab_bottom) < siz)
+    {
+        if(slab_idx + 1 >= slabs_count)
+            return false;
+        ++slab_idx;
+        slab_bottom = slabs[slab_idx];
+        slab_top = slabs[slab_idx] + slabs_siz[slab_idx];
+    }
+    return slabs_count > 0;
+}
+
+/*
+RETURNS memory for a new state, from the slab, or NULL if unavailable
+*/
+static tt_stats * slab_alloc_state()
+{
+    tt_stats * ret = NULL;
+    omp_set_lock(&slab_lock);
+    if(slab_has_free(sizeof(tt_stats)))
+    {
+        ret = (tt_stats *)slab_bottom;
+        slab_bottom += sizeof(tt_stats);
+    }
+    omp_unset_lock(&slab_lock);
+    return ret;
+}
+
+/*
+RETURNS memory for a new chunk of plays, from the slab, or NULL if unavailable
+*/
+static u8 * slab_alloc_plays_chunk()
+{
+    u8 * ret = NULL;
+    omp_set_lock(&slab_lock);
+    if(slab_has_free(TT_PLAYS_CHUNK_SIZ))
+    {
+        slab_top -= TT_PLAYS_CHUNK_SIZ;
+        ret = slab_top;
+    }
+    omp_unset_lock(&slab_lock);
+    return ret;
+}
+
+static void set_memory_limit(
+    u64 mbs
+){
+    max_size_in_mbs = mbs;
+    max_memory = mbs * 1048576;
+    max_allocated_states = max_memory / sizeof(tt_stats);
+}
+
+/*
+RETURNS the number of buckets of each table fit for a number of states
+*/
+static u32 buckets_for_states(
+    u32 states
+){
+#if TT_CLUSTER_BUCKETS
+    /* room for at least half of the states in each table, and for a few
+    clusters in each stripe */
+    u32 ret = TT_LOCK_STRIPES * 8;
+    while(((u64)ret) * TT_CLUSTER_WAYS * 2 < states)
+        ret *= 2;
+    return ret;
+#else
+    return get_prime_near(states / 2);
+#endif
+}
+
+/*
+RETURNS a new table of empty buckets
+*/
+static tt_bucket * alloc_table(
+    u32 buckets
+){
+#if TT_CLUSTER_BUCKETS
+    /* zero pages are only backed by memory as used */
+    void * ret = mmap(NULL, ((size_t)buckets) * sizeof(tt_bucket), PROT_READ |
+        PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ret == MAP_FAILED)
+        flog_crit("tt", "system out of memory");
+#else
+    void * ret = calloc(buckets, sizeof(tt_bucket));
+    if(ret == NULL)
+        flog_crit("tt", "system out of memory");
+#endif
+    return (tt_bucket *)ret;
+}
+
+static void free_table(
+    tt_bucket * table,
+    u32 buckets
+){
+#if TT_CLUSTER_BUCKETS
+    munmap(table, ((size_t)buckets) * sizeof(tt_bucket));
+#else
+    (void)buckets;
+    free(table);
+#endif
+}
+
+/*
+Empties all buckets of a table.
+*/
+static void clear_table(
+    tt_bucket * table,
+    u32 buckets
+){
+    size_t siz = ((size_t)buckets) * sizeof(tt_bucket);
+#if TT_CLUSTER_BUCKETS
+    /* the pages are given back, to be zero filled when used again */
+    if(madvise(table, siz, MADV_DONTNEED) == 0)
+        return;
+#endif
+    memset(table, 0, siz);
+}
+
+/*
+RETURNS the bucket of a hash
+*/
+static u32 bucket_of(
+    u64 hash
+){
+#if TT_CLUSTER_BUCKETS
+    return ((u32)hash) & (number_of_buckets - 1);
+#else
+    return (u32)(hash % ((u64)number_of_buckets));
+#endif
+}
 
 /*
 Initialize the transpositions table structures.
 */
+static void init_reduction_tables()
+{
+    for(d8 r = NOREDUCE; r <= ROTFLIP270; ++r)
+        for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+        {
+            move n = reduce_move(m, r);
+            reduced_moves[r][m] = n;
+            reverted_moves[r][n] = m;
+        }
+}
+
 void tt_init()
 {
     if(b_stats_table == NULL)
     {
-        u64 mbs = max_size_in_mbs;
-        mbs *= 1048576;
+        init_reduction_tables();
 
-        max_allocated_states = mbs / sizeof(tt_stats);
-        number_of_buckets = get_prime_near(max_allocated_states / 2);
+        set_memory_limit(max_size_in_mbs);
+        number_of_buckets = buckets_for_states(max_allocated_states);
 
-        b_stats_table = (tt_stats **)calloc(number_of_buckets,
-            sizeof(tt_stats *));
-        if(b_stats_table == NULL)
-            flog_crit("tt", "system out of memory");
+        b_stats_table = alloc_table(number_of_buckets);
+        w_stats_table = alloc_table(number_of_buckets);
 
-        w_stats_table = (tt_stats **)calloc(number_of_buckets,
-            sizeof(tt_stats *));
-        if(w_stats_table == NULL)
-            flog_crit("tt", "system out of memory");
-
-        omp_init_lock(&b_table_lock);
-        omp_init_lock(&w_table_lock);
+        for(u32 i = 0; i < TT_LOCK_STRIPES; ++i)
+        {
+            omp_init_lock(&b_table_locks[i].lock);
+            omp_init_lock(&w_table_locks[i].lock);
+        }
         omp_init_lock(&freed_nodes_lock);
+        omp_init_lock(&plays_lock);
+        omp_init_lock(&slab_lock);
+
+#if TT_USE_SLAB
+        init_slab(max_memory);
+#endif
     }
 }
 
 /*
-Searches for a state by hash, in a bucket by key.
+RETURNS true if the states and plays in use have met the memory limit, or the
+memory allocated has and too little of it is free to be reused
+*/
+static bool memory_exhausted()
+{
+    return tt_memory_in_use() >= max_memory || (tt_memory_allocated() >=
+        max_memory && freed_plays_mem < TT_PLAYS_CHUNK_SIZ);
+}
+
+/*
+RETURNS the lock guarding the bucket key of the table of the player
+*/
+static omp_lock_t * bucket_lock_of(
+    u32 key,
+    bool is_black
+){
+    u32 stripe = key % TT_LOCK_STRIPES;
+    return is_black ? &b_table_locks[stripe].lock :
+        &w_table_locks[stripe].lock;
+}
+
+/*
+Sets a lock; when search statistics are enabled, counting the locks found
+already set and the time waiting for them.
+*/
+static void set_lock_counted(
+    omp_lock_t * lock
+){
+#if MCTS_SEARCH_STATS
+    if(omp_test_lock(lock))
+        return;
+
+    u64 start = current_time_in_nanos();
+    omp_set_lock(lock);
+    tt_lookup_stats * ls = thread_state(&lookup_stats);
+    ls->lock_contentions++;
+    ls->lock_wait_ns += current_time_in_nanos() - start;
+#else
+    omp_set_lock(lock);
+#endif
+}
+
+/*
+Counts a lookup of the calling thread, if search statistics are enabled.
+*/
+static void count_lookup(
+    bool hit,
+    bool memory_exhausted
+){
+#if MCTS_SEARCH_STATS
+    tt_lookup_stats * ls = thread_state(&lookup_stats);
+    ls->lookups++;
+    if(hit)
+        ls->hits++;
+    if(memory_exhausted)
+        ls->memory_exhausted++;
+#else
+    (void)hit;
+    (void)memory_exhausted;
+#endif
+}
+
+#if TT_CLUSTER_BUCKETS
+/*
+RETURNS the cluster after the one specified, in its lock stripe
+*/
+static u32 next_cluster(
+    u32 key,
+    u32 buckets
+){
+    return (key + TT_LOCK_STRIPES) & (buckets - 1);
+}
+
+/*
+Adds a state to a table of clusters; to its home cluster, or if full to the next
+cluster of the stripe with room.
+RETURNS false if all clusters of the stripe are full
+*/
+static bool cluster_insert(
+    tt_cluster * table,
+    u32 buckets,
+    tt_stats * s
+){
+    u32 tag = (u32)s->zobrist_hash;
+    u32 key = tag & (buckets - 1);
+    u32 i = key;
+    do
+    {
+        tt_cluster * c = &table[i];
+        for(u8 j = 0; j < TT_CLUSTER_WAYS; ++j)
+            if(c->states[j] == NULL)
+            {
+                c->tags[j] = tag;
+                c->states[j] = s;
+                if(i != key)
+                    table[key].displaced++;
+                return true;
+            }
+        i = next_cluster(i, buckets);
+    }
+    while(i != key);
+
+    return false;
+}
+
+/*
+Removes the state of a way of a cluster, keeping the ways in use first. Can be
+called for different clusters concurrently.
+*/
+static void cluster_remove(
+    tt_cluster * table,
+    u32 i,
+    u8 way
+){
+    tt_cluster * c = &table[i];
+    u32 key = c->tags[way] & (number_of_buckets - 1);
+    if(key != i)
+    {
+        #pragma omp atomic
+        table[key].displaced--;
+    }
+
+    u8 last = way;
+    while(last + 1 < TT_CLUSTER_WAYS && c->states[last + 1] != NULL)
+        ++last;
+    c->tags[way] = c->tags[last];
+    c->states[way] = c->states[last];
+    c->states[last] = NULL;
+}
+#endif
+
+/*
+RETURNS whether the state is of the position
+*/
+static bool state_matches(
+    const tt_stats * s,
+    u64 hash,
+    const u8 p[TOTAL_BOARD_SIZ],
+    move last_eaten_passed,
+    u8 packed_p[PACKED_BOARD_SIZ],
+    bool * packed
+){
+    if(s->zobrist_hash != hash || s->last_eaten_passed != last_eaten_passed)
+        return false;
+
+    if(!*packed)
+    {
+        pack_matrix(packed_p, p);
+        *packed = true;
+    }
+    return memcmp(s->p, packed_p, PACKED_BOARD_SIZ) == 0;
+}
+
+/*
+Searches for a state by hash, in a bucket by key. The board is only packed, to
+be compared with the states, when a hash matches.
 RETURNS state found or null.
 */
-static tt_stats * find_state(
+static tt_stats * find_state_by_matrix(
     u64 hash,
-    const board * b,
+    const u8 p[TOTAL_BOARD_SIZ],
+    move last_eaten_passed,
     bool is_black
 ){
-    u32 key = (u32)(hash % ((u64)number_of_buckets));
-    tt_stats * p;
-
-    if(is_black)
-        p = b_stats_table[key];
-    else
-        p = w_stats_table[key];
+    u32 key = bucket_of(hash);
+    const tt_bucket * table = is_black ? b_stats_table : w_stats_table;
 
-    move last_eaten_passed = (b->last_played == PASS) ? PASS : b->last_eaten;
+    u8 packed_p[PACKED_BOARD_SIZ];
+    bool packed = false;
 
-    while(p != NULL)
+#if TT_CLUSTER_BUCKETS
+    u32 tag = (u32)hash;
+    u32 displaced = table[key].displaced;
+    u32 i = key;
+    while(true)
     {
-        if(p->zobrist_hash == hash && memcmp(p->p, b->p, TOTAL_BOARD_SIZ)
-            == 0 && p->last_eaten_passed == last_eaten_passed)
-            return p;
+        const tt_cluster * c = &table[i];
+        for(u8 j = 0; j < TT_CLUSTER_WAYS && c->states[j] != NULL; ++j)
+        {
+            if(c->tags[j] == tag && state_matches(c->states[j], hash, p,
+                last_eaten_passed, packed_p, &packed))
+                return c->states[j];
+            if(i != key && (c->tags[j] & (number_of_buckets - 1)) == key)
+                --displaced;
+        }
 
-        p = p->next;
+        if(displaced == 0)
+            return NULL;
+        i = next_cluster(i, number_of_buckets);
+        assert(i != key);
     }
+#else
+    for(tt_stats * s = table[key]; s != NULL; s = s->next)
+        if(state_matches(s, hash, p, last_eaten_passed, packed_p, &packed))
+            return s;
 
     return NULL;
+#endif
+}
+
+/*
+Adds a new state to the table of the player.
+RETURNS false if there is no room for it, which is only possible with
+clusters
+*/
+static bool insert_state(
+    tt_stats * s,
+    bool is_black
+){
+    tt_bucket * table = is_black ? b_stats_table : w_stats_table;
+#if TT_CLUSTER_BUCKETS
+    return cluster_insert(table, number_of_buckets, s);
+#else
+    u32 key = bucket_of(s->zobrist_hash);
+    s->next = table[key];
+    table[key] = s;
+    return true;
+#endif
 }
 
-static tt_stats * find_state2(
+static tt_stats * find_state(
     u64 hash,
-    const cfg_board * cb,
+    const board * b,
     bool is_black
 ){
-    u32 key = (u32)(hash % ((u64)number_of_buckets));
-    tt_stats * p;
+    move last_eaten_passed = (b->last_played == PASS) ? PASS : b->last_eaten;
+    return find_state_by_matrix(hash, b->p, last_eaten_passed, is_black);
+}
 
-    if(is_black)
-        p = b_stats_table[key];
-    else
-        p = w_stats_table[key];
+/*
+RETURNS the move transformed by a reduction method; pass and none are kept
+*/
+move tt_reduce_move(
+    move m,
+    d8 reduction
+){
+    return is_board_move(m) ? reduced_moves[reduction][m] : m;
+}
+
+/*
+RETURNS the move reverted from a reduction method; pass and none are kept
+*/
+move tt_revert_move(
+    move m,
+    d8 reduction
+){
+    return is_board_move(m) ? reverted_moves[reduction][m] : m;
+}
+
+/*
+Fills a matrix with the stones of a board transformed by a reduction method.
+RETURNS Zobrist hash of the matrix
+*/
+static u64 reduce_stones(
+    u8 dst[TOTAL_BOARD_SIZ],
+    const cfg_board * cb,
+    d8 reduction
+){
+    memset(dst, EMPTY, TOTAL_BOARD_SIZ);
+    u64 hash = 0;
+    for(u8 i = 0; i < cb->unique_groups_count; ++i)
+    {
+        const group * g = cb->g[cb->unique_groups[i]];
+        u8 stone = g->is_black ? BLACK_STONE : WHITE_STONE;
+        for(move j = 0; j < g->stones.count; ++j)
+        {
+            move m = reduced_moves[reduction][g->stones.coord[j]];
+            dst[m] = stone;
+            zobrist_update_hash(&hash, m, stone);
+        }
+    }
+    return hash;
+}
+
+#if TT_SYMMETRY_MAX_STONES > 0
+/*
+Produces the codes of the stones of a board, with few stones, transformed by a
+reduction method; in increasing order.
+*/
+static void reduced_stone_codes(
+    u16 codes[TT_SYMMETRY_MAX_STONES],
+    const cfg_board * cb,
+    d8 reduction
+){
+    u8 count = 0;
+    for(u8 i = 0; i < cb->unique_groups_count; ++i)
+    {
+        const group * g = cb->g[cb->unique_groups[i]];
+        for(move j = 0; j < g->stones.count; ++j)
+        {
+            u16 code = reduced_moves[reduction][g->stones.coord[j]] * 2 +
+                (g->is_black ? 0 : 1);
+            u8 k = count;
+            for(; k > 0 && codes[k - 1] > code; --k)
+                codes[k] = codes[k - 1];
+            codes[k] = code;
+            ++count;
+        }
+    }
+}
+#endif
+
+/*
+Finds the orientation the state of a position is stored in, in a descent: the
+canonical one if it has at most TT_SYMMETRY_MAX_STONES stones, otherwise the
+one of its parent state.
+RETURNS reduction method that transforms the board into the orientation of its
+state
+*/
+d8 tt_reduction(
+    const cfg_board * cb,
+    d8 parent_reduction
+){
+#if TT_SYMMETRY_MAX_STONES > 0
+    u16 stones = TOTAL_BOARD_SIZ - cb->empty.count;
+    if(stones > TT_SYMMETRY_MAX_STONES)
+        return parent_reduction;
 
     move last_eaten_passed = (cb->last_played == PASS) ? PASS : cb->last_eaten;
 
-    while(p != NULL)
+    /*
+    The canonical orientation is the one of lowest stones, in order, and then
+    of lowest last eaten position; ties keep the first method, so a position
+    already canonical keeps its orientation. The Zobrist hash is not used
+    because symmetric positions may share it.
+    */
+    d8 best = NOREDUCE;
+    u16 best_codes[TT_SYMMETRY_MAX_STONES];
+    reduced_stone_codes(best_codes, cb, NOREDUCE);
+    move best_last_eaten = last_eaten_passed;
+    for(d8 r = ROTATE90; r <= ROTFLIP270; ++r)
     {
-        if(p->zobrist_hash == hash && memcmp(p->p, cb->p, TOTAL_BOARD_SIZ)
-            == 0 && p->last_eaten_passed == last_eaten_passed)
-            return p;
+        u16 codes[TT_SYMMETRY_MAX_STONES];
+        reduced_stone_codes(codes, cb, r);
+        move last_eaten = tt_reduce_move(last_eaten_passed, r);
+
+        d8 cmp = 0;
+        for(u16 i = 0; i < stones && cmp == 0; ++i)
+            if(codes[i] != best_codes[i])
+                cmp = codes[i] < best_codes[i] ? -1 : 1;
 
-        p = p->next;
+        if(cmp < 0 || (cmp == 0 && last_eaten < best_last_eaten))
+        {
+            best = r;
+            memcpy(best_codes, codes, stones * sizeof(u16));
+            best_last_eaten = last_eaten;
+        }
     }
+    return best;
+#else
+    (void)cb;
+    return parent_reduction;
+#endif
+}
 
+/*
+Fills a board with board b transformed by a reduction method.
+RETURNS Zobrist hash of the stones of the board filled
+*/
+static u64 reduce_board(
+    board * dst,
+    const board * b,
+    d8 reduction
+){
+    if(reduction == NOREDUCE)
+        memcpy(dst, b, sizeof(board));
+    else
+    {
+        for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+            dst->p[tt_reduce_move(m, reduction)] = b->p[m];
+        dst->last_played = tt_reduce_move(b->last_played, reduction);
+        dst->last_eaten = tt_reduce_move(b->last_eaten, reduction);
+    }
+    return zobrist_new_hash(dst);
+}
+
+/*
+Finds the state of a root position in the orientation it is stored in: the
+canonical one if it has at most TT_SYMMETRY_MAX_STONES stones; otherwise as
+played, or else the first other orientation it is found in, since the states
+reached from positions of few stones keep their orientation.
+RETURNS state found or NULL, and the orientation of the state, or the one to
+create it in if not found
+*/
+static tt_stats * find_root_state(
+    const board * b,
+    bool is_black,
+    d8 * reduction
+){
+    cfg_board cb;
+    cfg_from_board(&cb, b);
+    *reduction = tt_reduction(&cb, NOREDUCE);
+    bool few_stones = TOTAL_BOARD_SIZ - cb.empty.count <=
+        TT_SYMMETRY_MAX_STONES;
+    cfg_board_free(&cb);
+
+    board reduced;
+    u64 hash = reduce_board(&reduced, b, *reduction);
+    tt_stats * ret = find_state(hash, &reduced, is_black);
+    if(ret != NULL || few_stones)
+        return ret;
+
+#if TT_SYMMETRY_MAX_STONES > 0
+    for(d8 r = ROTATE90; r <= ROTFLIP270; ++r)
+    {
+        hash = reduce_board(&reduced, b, r);
+        ret = find_state(hash, &reduced, is_black);
+        if(ret != NULL)
+        {
+            *reduction = r;
+            return ret;
+        }
+    }
+#endif
     return NULL;
 }
 
+/*
+RETURNS the expansion delay of a new state, for the memory in use
+*/
+static d8 pressured_expansion_delay()
+{
+    u32 delay = MIN(expansion_delay, UCT_EXPANSION_DELAY_MAX);
+    u64 start = (u64)(max_memory * UCT_EXPANSION_PRESSURE_START);
+    u64 in_use = tt_memory_in_use();
+    if(in_use > start && max_memory > start)
+    {
+        u64 excess = MIN(in_use, max_memory) - start;
+        delay += ((UCT_EXPANSION_DELAY_MAX - delay) * excess) / (max_memory -
+            start);
+    }
+    return (d8)delay;
+}
+
 static tt_stats * create_state(
     u64 hash
 ){
@@ -157,7 +885,12 @@ static tt_stats * create_state(
 
     if(ret == NULL)
     {
-        ret = (tt_stats *)malloc(sizeof(tt_stats));
+        ret = slab_alloc_state();
+        if(ret == NULL)
+        {
+            ret = (tt_stats *)malloc(sizeof(tt_stats));
+            system_allocated = true;
+        }
         if(ret == NULL)
             flog_crit("tt", "create_state: system out of memory");
 
@@ -168,92 +901,745 @@ static tt_stats * create_state(
     ret->zobrist_hash = hash;
     ret->maintenance_mark = maintenance_mark;
     ret->plays_count = 0;
-    ret->expansion_delay = expansion_delay;
+    ret->widened = 0;
+    ret->visits = 0;
+    ret->wins = 0.0;
+    ret->proven = PROVEN_NONE;
+    ret->proven_plays = false;
+    ret->plays_complete = false;
+    ret->plays = NULL;
+    ret->expansion_delay = pressured_expansion_delay();
     return ret;
 }
 
-static void release_state(
+/*
+Returns a state just created, and never used, to the free states.
+*/
+static void discard_state(
     tt_stats * s
 ){
-    --states_in_use;
+    omp_set_lock(&freed_nodes_lock);
     s->next = freed_nodes;
     freed_nodes = s;
+    --states_in_use;
+    omp_unset_lock(&freed_nodes_lock);
+}
+
+/*
+Adds the memory from p, of siz bytes, to the free lists as a block of the
+largest class that fits, if any. Must hold the plays lock.
+*/
+static void free_plays_rest(
+    u8 * p,
+    u32 siz
+){
+    u32 rest = siz <= TT_PLAYS_SET_SIZ ? 0 : (siz - TT_PLAYS_SET_SIZ) /
+        TT_PLAY_SIZ / TT_PLAYS_CLASS_SIZ;
+    if(rest > 0)
+    {
+        *((void **)p) = freed_plays[rest];
+        freed_plays[rest] = p;
+        freed_plays_mem += TT_CLASS_BLOCK_SIZ(rest);
+    }
+}
+
+/*
+RETURNS a block of a larger class than c split to class c, with the rest freed,
+or NULL if there is none free. Must hold the plays lock.
+*/
+static void * split_freed_plays(
+    u16 c
+){
+    for(u16 larger = c + 1; larger < TT_PLAYS_CLASSES; ++larger)
+    {
+        u8 * ret = (u8 *)freed_plays[larger];
+        if(ret == NULL)
+            continue;
+
+        freed_plays[larger] = *((void **)ret);
+        freed_plays_mem -= TT_CLASS_BLOCK_SIZ(larger);
+        u32 siz = TT_CLASS_BLOCK_SIZ(c);
+        free_plays_rest(ret + siz, TT_CLASS_BLOCK_SIZ(larger) - siz);
+        return ret;
+    }
+    return NULL;
 }
 
-static void release_states_not_marked()
+/*
+RETURNS a new chunk of plays: a spare one, or carved from the slab, or allocated
+from the system. Must hold the plays lock.
+*/
+static u8 * new_plays_chunk()
 {
-    for(u32 i = 0; i < number_of_buckets; ++i)
+    for(u32 i = 0; i < plays_chunks_count; ++i)
+        if(plays_chunks[i].spare)
+        {
+            plays_chunks[i].spare = false;
+            return plays_chunks[i].mem;
+        }
+
+    u8 * ret = slab_alloc_plays_chunk();
+    if(ret == NULL)
+    {
+        ret = (u8 *)malloc(TT_PLAYS_CHUNK_SIZ);
+        system_allocated = true;
+    }
+    if(ret == NULL)
+        flog_crit("tt", "alloc_plays: system out of memory");
+
+    if(plays_chunks_count == plays_chunks_capacity)
+    {
+        plays_chunks_capacity = MAX(64, plays_chunks_capacity * 2);
+        plays_chunks = (tt_plays_chunk *)realloc(plays_chunks,
+            plays_chunks_capacity * sizeof(tt_plays_chunk));
+        if(plays_chunks == NULL)
+            flog_crit("tt", "alloc_plays: system out of memory");
+    }
+    plays_chunks[plays_chunks_count].mem = ret;
+    plays_chunks[plays_chunks_count].spare = false;
+    ++plays_chunks_count;
+    return ret;
+}
+
+static void * alloc_plays(
+    move count
+){
+    u16 c = TT_PLAYS_CLASS(count);
+    u32 siz = TT_CLASS_BLOCK_SIZ(c);
+    omp_set_lock(&plays_lock);
+    void * ret = freed_plays[c];
+    if(ret != NULL)
+    {
+        freed_plays[c] = *((void **)ret);
+        freed_plays_mem -= siz;
+    }
+    else if(plays_chunk_left < siz && tt_memory_allocated() +
+        TT_PLAYS_CHUNK_SIZ > max_memory)
+        ret = split_freed_plays(c);
+
+    if(ret == NULL)
+    {
+        if(plays_chunk_left < siz)
+        {
+            /* keep the rest of the chunk for smaller blocks */
+            free_plays_rest(plays_chunk, plays_chunk_left);
+
+            plays_chunk = new_plays_chunk();
+            plays_chunk_left = TT_PLAYS_CHUNK_SIZ;
+            allocated_plays_mem += TT_PLAYS_CHUNK_SIZ;
+        }
+
+        ret = plays_chunk;
+        plays_chunk += siz;
+        plays_chunk_left -= siz;
+    }
+    plays_mem_in_use += siz;
+    omp_unset_lock(&plays_lock);
+    return ret;
+}
+
+/*
+Sweeps of the tables are split between threads; each thread releases states and
+plays to its own lists, that are merged at the end of the sweep.
+*/
+typedef struct __tt_release_list_ {
+    tt_stats * nodes_first;
+    tt_stats * nodes_last;
+    u32 states;
+    u64 plays_mem;
+    void * plays_first[TT_PLAYS_CLASSES];
+    void * plays_last[TT_PLAYS_CLASSES];
+} tt_release_list;
+
+static thread_states release_lists = THREAD_STATES(tt_release_list);
+
+static void release_plays(
+    tt_stats * s,
+    tt_release_list * l
+){
+    void * block = s->plays;
+    u16 c = TT_PLAYS_CLASS(s->plays_count);
+    *((void **)block) = l->plays_first[c];
+    if(l->plays_first[c] == NULL)
+        l->plays_last[c] = block;
+    l->plays_first[c] = block;
+    l->plays_mem += TT_CLASS_BLOCK_SIZ(c);
+}
+
+/*
+Merges the states and plays released by all threads into the free lists.
+*/
+static void merge_release_lists()
+{
+    for(u16 t = 0; t < MAXIMUM_NUM_THREADS; ++t)
+    {
+        tt_release_list * l = thread_state_of(&release_lists, t);
+        if(l == NULL)
+            continue;
+        if(l->nodes_first != NULL)
+        {
+            l->nodes_last->next = freed_nodes;
+            freed_nodes = l->nodes_first;
+            l->nodes_first = NULL;
+        }
+        states_in_use -= l->states;
+        l->states = 0;
+
+        for(u16 c = 1; c < TT_PLAYS_CLASSES; ++c)
+            if(l->plays_first[c] != NULL)
+            {
+                *((void **)l->plays_last[c]) = freed_plays[c];
+                freed_plays[c] = l->plays_first[c];
+                l->plays_first[c] = NULL;
+            }
+        plays_mem_in_use -= l->plays_mem;
+        freed_plays_mem += l->plays_mem;
+        l->plays_mem = 0;
+    }
+}
+
+/*
+Allocates the block of plays of a state and points its arrays to it.
+*/
+static void set_plays_block(
+    tt_stats * stats,
+    move plays_count
+){
+    u8 * block = (u8 *)alloc_plays(plays_count);
+    stats->plays = (tt_play *)block;
+    block += plays_count * sizeof(tt_play);
+    stats->plays_set = (u64 *)block;
+    block += TT_PLAYS_SET_SIZ;
+    stats->mc_n = (u32 *)block;
+    block += plays_count * sizeof(u32);
+    stats->amaf_n = (u32 *)block;
+    block += plays_count * sizeof(u32);
+    stats->mc_q = (float *)block;
+    block += plays_count * sizeof(float);
+    stats->amaf_q = (float *)block;
+    block += plays_count * sizeof(float);
+    stats->vl_n = (u16 *)block;
+    block += plays_count * sizeof(u16);
+    stats->plays_by_position = (move *)block;
+    block += plays_count * sizeof(move);
+    stats->plays_by_prior = (move *)block;
+}
+
+/*
+Maps the positions of the plays of a state, once they are set, to their
+indexes.
+*/
+static void index_plays_by_position(
+    tt_stats * stats,
+    move plays_count
+){
+    memset(stats->plays_set, 0, TT_PLAYS_SET_SIZ);
+    for(move k = 0; k < plays_count; ++k)
+    {
+        move m = stats->plays[k].m;
+        if(m != PASS)
+            stats->plays_set[m / 64] |= LIB_BIT(m);
+    }
+
+    move rank[LIB_BITMAP_WORDS];
+    move ranked = 0;
+    for(u8 i = 0; i < LIB_BITMAP_WORDS; ++i)
+    {
+        rank[i] = ranked;
+        ranked += __builtin_popcountll(stats->plays_set[i]);
+    }
+
+    for(move k = 0; k < plays_count; ++k)
+    {
+        move m = stats->plays[k].m;
+        if(m != PASS)
+            stats->plays_by_position[rank[m / 64] + __builtin_popcountll(
+                stats->plays_set[m / 64] & (LIB_BIT(m) - 1))] = k;
+    }
+}
+
+/*
+Sets the plays of a state being expanded, from their initial statistics. The
+plays are stored in memory owned by the transpositions table, in a block of the
+size class of their number. The state must not have plays yet and must have its
+lock set.
+Thread-safe.
+*/
+void tt_set_plays(
+    tt_stats * stats,
+    const tt_prior priors[],
+    move plays_count
+){
+    assert(stats->plays_count == 0);
+    if(plays_count == 0)
+        return;
+
+    set_plays_block(stats, plays_count);
+
+    for(move k = 0; k < plays_count; ++k)
     {
-        /* black table */
-        while(b_stats_table[i] != NULL && b_stats_table[i]->maintenance_mark !=
-            maintenance_mark)
+        stats->plays[k].m = priors[k].m;
+        stats->plays[k].proven = PROVEN_NONE;
+        stats->plays[k].owner_winning = 0.5;
+        stats->plays[k].color_owning = 0.5;
+        stats->plays[k].score_mean = 0.0;
+        stats->plays[k].score_n = 0;
+        stats->plays[k].next_stats = NULL;
+        stats->plays[k].lgrf1_reply = NULL;
+        stats->mc_n[k] = priors[k].mc_n;
+        stats->mc_q[k] = priors[k].mc_q;
+        stats->amaf_n[k] = priors[k].amaf_n;
+        stats->amaf_q[k] = priors[k].amaf_q;
+        stats->vl_n[k] = 0;
+        stats->plays_by_prior[k] = k;
+    }
+    index_plays_by_position(stats, plays_count);
+    stats->plays_count = plays_count;
+}
+
+static void release_state(
+    tt_stats * s,
+    tt_release_list * l
+){
+    if(s->plays_count > 0)
+        release_plays(s, l);
+    l->states++;
+    s->next = l->nodes_first;
+    if(l->nodes_first == NULL)
+        l->nodes_last = s;
+    l->nodes_first = s;
+}
+
+/*
+Frees the states not marked of a bucket of a table.
+*/
+static void release_bucket_not_marked(
+    tt_bucket * table,
+    u32 i,
+    tt_release_list * l
+){
+#if TT_CLUSTER_BUCKETS
+    tt_cluster * c = &table[i];
+    u8 j = 0;
+    while(j < TT_CLUSTER_WAYS && c->states[j] != NULL)
+        if(c->states[j]->maintenance_mark != maintenance_mark)
         {
-            tt_stats * tmp = b_stats_table[i]->next;
-            release_state(b_stats_table[i]);
-            b_stats_table[i] = tmp;
+            release_state(c->states[j], l);
+            cluster_remove(table, i, j);
         }
-        if(b_stats_table[i] != NULL)
+        else
+            ++j;
+#else
+    while(table[i] != NULL && table[i]->maintenance_mark != maintenance_mark)
+    {
+        tt_stats * tmp = table[i]->next;
+        release_state(table[i], l);
+        table[i] = tmp;
+    }
+    if(table[i] != NULL)
+    {
+        tt_stats * prev = table[i];
+        tt_stats * curr = prev->next;
+        while(curr != NULL)
         {
-            tt_stats * prev = b_stats_table[i];
-            tt_stats * curr = prev->next;
-            while(curr != NULL)
+            if(curr->maintenance_mark != maintenance_mark)
             {
-                if(curr->maintenance_mark != maintenance_mark)
-                {
-                    tt_stats * tmp = curr->next;
-                    release_state(curr);
-                    prev->next = tmp;
-                    curr = tmp;
-                }
-                else
-                {
-                    prev = curr;
-                    curr = curr->next;
-                }
+                tt_stats * tmp = curr->next;
+                release_state(curr, l);
+                prev->next = tmp;
+                curr = tmp;
+            }
+            else
+            {
+                prev = curr;
+                curr = curr->next;
             }
         }
+    }
+#endif
+}
+
+/*
+Frees all states of a bucket of a table.
+*/
+static void release_bucket(
+    tt_bucket * table,
+    u32 i,
+    tt_release_list * l
+){
+#if TT_CLUSTER_BUCKETS
+    tt_cluster * c = &table[i];
+    for(u8 j = 0; j < TT_CLUSTER_WAYS && c->states[j] != NULL; ++j)
+        release_state(c->states[j], l);
+    memset(c, 0, sizeof(tt_cluster));
+#else
+    while(table[i] != NULL)
+    {
+        tt_stats * tmp = table[i]->next;
+        release_state(table[i], l);
+        table[i] = tmp;
+    }
+#endif
+}
+
+/*
+Frees the states not marked in buckets from the index from, inclusive, to the
+index to, exclusive. The buckets are split between threads.
+*/
+static void release_states_not_marked(
+    u32 from,
+    u32 to
+){
+    #pragma omp parallel for schedule(static, 4096)
+    for(u32 i = from; i < to; ++i)
+    {
+        tt_release_list * l = thread_state(&release_lists);
+        release_bucket_not_marked(b_stats_table, i, l);
+        release_bucket_not_marked(w_stats_table, i, l);
+    }
+
+    merge_release_lists();
+}
+
+static void mark_states_for_keeping(
+    tt_stats * s
+){
+    s->maintenance_mark = maintenance_mark;
+
+    for(move i = 0; i < s->plays_count; ++i){
+        tt_stats * ns = s->plays[i].next_stats;
+        if(ns != NULL && ns->maintenance_mark != maintenance_mark)
+            mark_states_for_keeping(ns);
+    }
+}
+
+static u32 count_states_of_subtree(
+    tt_stats * s
+){
+    s->maintenance_mark = maintenance_mark;
+
+    u32 ret = 1;
+    for(move i = 0; i < s->plays_count; ++i){
+        tt_stats * ns = s->plays[i].next_stats;
+        if(ns != NULL && ns->maintenance_mark != maintenance_mark)
+            ret += count_states_of_subtree(ns);
+    }
+    return ret;
+}
+
+/*
+Marks the states of the subtree started at s, not following plays with less
+than min_visits MC visits; their links are cut.
+*/
+static void mark_states_visited_enough(
+    tt_stats * s,
+    u32 min_visits
+){
+    s->maintenance_mark = maintenance_mark;
+
+    for(move i = 0; i < s->plays_count; ++i){
+        tt_stats * ns = s->plays[i].next_stats;
+        if(ns == NULL)
+            continue;
+
+        if(s->mc_n[i] < min_visits)
+        {
+            s->plays[i].next_stats = NULL;
+            /* points to a play of the state unlinked */
+            s->plays[i].lgrf1_reply = NULL;
+        }
+        else
+            if(ns->maintenance_mark != maintenance_mark)
+                mark_states_visited_enough(ns, min_visits);
+    }
+}
+
+/*
+Sets the states whose subtrees are also kept, besides the one specified, when
+freeing states with tt_clean_unreachable_start and tt_prune; so the table can be
+shared by the searches of several games. Not thread-safe.
+*/
+void tt_set_kept_roots(
+    const board roots[],
+    const bool is_black[],
+    u16 count
+){
+    kept_roots_count = MIN(count, TT_MAX_KEPT_ROOTS);
+    for(u16 i = 0; i < kept_roots_count; ++i)
+    {
+        memcpy(&kept_roots[i], &roots[i], sizeof(board));
+        kept_roots_is_black[i] = is_black[i];
+    }
+}
+
+/*
+RETURNS the number of states whose subtrees are also kept
+*/
+u16 tt_kept_roots()
+{
+    return kept_roots_count;
+}
+
+/*
+Marks the subtrees of the states also kept; not following plays with less than
+min_visits MC visits, unless min_visits is 0.
+*/
+static void mark_kept_roots(
+    u32 min_visits
+){
+    for(u16 i = 0; i < kept_roots_count; ++i)
+    {
+        d8 reduction;
+        tt_stats * stats = find_root_state(&kept_roots[i],
+            kept_roots_is_black[i], &reduction);
+        if(stats == NULL || stats->maintenance_mark == maintenance_mark)
+            continue;
+
+        if(min_visits == 0)
+            mark_states_for_keeping(stats);
+        else
+            mark_states_visited_enough(stats, min_visits);
+    }
+}
+
+/*
+Frees the states of the least visited branches of the subtree started at state
+b, and all states outside of it, so a search that ran out of memory can go on.
+The subtrees of the states also kept are pruned the same way. The visits
+threshold is raised until a significant part of the states in use is freed. Not
+thread-safe.
+RETURNS number of states freed.
+*/
+u32 tt_prune(
+    const board * b,
+    bool is_black
+){
+    u32 states_in_use_before = states_in_use;
+    d8 reduction;
+    tt_stats * stats = find_root_state(b, is_black, &reduction);
+    if(stats == NULL && kept_roots_count == 0)
+        return tt_clean_all();
+
+    /* a cleaning in progress is superseded */
+    sweep_pending = false;
+
+    u32 target = states_in_use_before / TT_PRUNE_FRACTION;
+    for(u32 min_visits = TT_PRUNE_MIN_VISITS; min_visits < UINT32_MAX / 2;
+        min_visits *= 2)
+    {
+        ++maintenance_mark;
+        if(stats != NULL)
+            mark_states_visited_enough(stats, min_visits);
+        mark_kept_roots(min_visits);
+        release_states_not_marked(0, number_of_buckets);
+
+        if(states_in_use_before - states_in_use >= target)
+            break;
+    }
+
+    return states_in_use_before - states_in_use;
+}
+
+static int compare_plays_chunks(
+    const void * a,
+    const void * b
+){
+    const u8 * x = ((const tt_plays_chunk *)a)->mem;
+    const u8 * y = ((const tt_plays_chunk *)b)->mem;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/*
+RETURNS the chunk, of the chunks sorted by address, that holds the memory at p
+*/
+static tt_plays_chunk * chunk_of_plays(
+    const void * p
+){
+    u32 lo = 0;
+    u32 hi = plays_chunks_count;
+    while(hi - lo > 1)
+    {
+        u32 mid = (lo + hi) / 2;
+        if((const u8 *)p < plays_chunks[mid].mem)
+            hi = mid;
+        else
+            lo = mid;
+    }
+    return &plays_chunks[lo];
+}
+
+/*
+RETURNS true if the memory at p was carved from a slab
+*/
+static bool in_slab(
+    const u8 * p
+){
+    for(u16 i = 0; i < slabs_count; ++i)
+        if(p >= slabs[i] && p < slabs[i] + slabs_siz[i])
+            return true;
+    return false;
+}
+
+static void mark_plays_chunk(
+    const tt_stats * s
+){
+    if(s->plays_count > 0)
+        chunk_of_plays(s->plays)->in_use = true;
+}
+
+/*
+Releases the chunks of plays without blocks in use, dropping their blocks from
+the free lists; the chunks carved from a slab are kept as spares, with their
+pages returned to the system. Not thread-safe.
+RETURNS the memory of plays released, in bytes
+*/
+u64 tt_trim_plays()
+{
+    if(sweep_pending)
+        release_states_not_marked(sweep_next_bucket, number_of_buckets);
+    sweep_pending = false;
+    if(plays_chunks_count == 0)
+        return 0;
+
+    qsort(plays_chunks, plays_chunks_count, sizeof(tt_plays_chunk),
+        compare_plays_chunks);
+    for(u32 i = 0; i < plays_chunks_count; ++i)
+        plays_chunks[i].in_use = plays_chunks[i].spare;
+
+    for(u32 i = 0; i < number_of_buckets; ++i)
+        for(u8 table = 0; table < 2; ++table)
+        {
+            const tt_bucket * bucket = (table == 0) ? &b_stats_table[i] :
+                &w_stats_table[i];
+#if TT_CLUSTER_BUCKETS
+            for(u8 j = 0; j < TT_CLUSTER_WAYS && bucket->states[j] != NULL;
+                ++j)
+                mark_plays_chunk(bucket->states[j]);
+#else
+            for(const tt_stats * s = *bucket; s != NULL; s = s->next)
+                mark_plays_chunk(s);
+#endif
+        }
+
+    /* the chunk being carved has a block before its next one */
+    if(plays_chunk != NULL && !chunk_of_plays(plays_chunk - 1)->in_use)
+    {
+        plays_chunk = NULL;
+        plays_chunk_left = 0;
+    }
+
+    for(u16 c = 1; c < TT_PLAYS_CLASSES; ++c)
+    {
+        void ** link = &freed_plays[c];
+        while(*link != NULL)
+            if(chunk_of_plays(*link)->in_use)
+                link = (void **)*link;
+            else
+            {
+                *link = *((void **)*link);
+                freed_plays_mem -= TT_CLASS_BLOCK_SIZ(c);
+            }
+    }
+
+    u64 released = 0;
+    u32 kept = 0;
+    for(u32 i = 0; i < plays_chunks_count; ++i)
+    {
+        tt_plays_chunk * chunk = &plays_chunks[i];
+        if(!chunk->in_use)
+        {
+            released += TT_PLAYS_CHUNK_SIZ;
+            if(!in_slab(chunk->mem))
+            {
+                free(chunk->mem);
+                continue;
+            }
+            madvise(chunk->mem, TT_PLAYS_CHUNK_SIZ, MADV_DONTNEED);
+            chunk->spare = true;
+        }
+        plays_chunks[kept++] = *chunk;
+    }
+    plays_chunks_count = kept;
+    allocated_plays_mem -= released;
+    return released;
+}
+
+/*
+Starts freeing the states outside of the subtree started at state b, and of the
+states also kept; the states are then freed by calls to
+tt_clean_unreachable_step. A cleaning already in
+progress is finished first. Not thread-safe; there must not be searches running
+until the cleaning is complete.
+*/
+void tt_clean_unreachable_start(
+    const board * b,
+    bool is_black
+){
+    if(sweep_pending)
+        release_states_not_marked(sweep_next_bucket, number_of_buckets);
+
+    d8 reduction;
+    tt_stats * stats = find_root_state(b, is_black, &reduction);
+
+    ++maintenance_mark;
+    /* if not found all states are freed */
+    if(stats != NULL)
+        mark_states_for_keeping(stats);
+    mark_kept_roots(0);
+
+    sweep_pending = true;
+    sweep_next_bucket = 0;
+}
 
-        /* white table */
-        while(w_stats_table[i] != NULL && w_stats_table[i]->maintenance_mark !=
-            maintenance_mark)
-        {
-            tt_stats * tmp = w_stats_table[i]->next;
-            release_state(w_stats_table[i]);
-            w_stats_table[i] = tmp;
-        }
-        if(w_stats_table[i] != NULL)
-        {
-            tt_stats * prev = w_stats_table[i];
-            tt_stats * curr = prev->next;
-            while(curr != NULL)
-            {
-                if(curr->maintenance_mark != maintenance_mark)
-                {
-                    tt_stats * tmp = curr->next;
-                    release_state(curr);
-                    prev->next = tmp;
-                    curr = tmp;
-                }
-                else
-                {
-                    prev = curr;
-                    curr = curr->next;
-                }
-            }
-        }
-    }
+/*
+Continues freeing the states outside of the subtree of the cleaning in progress,
+in at most the next buckets buckets of each table. Not thread-safe.
+RETURNS number of states freed.
+*/
+u32 tt_clean_unreachable_step(
+    u32 buckets
+){
+    if(!sweep_pending)
+        return 0;
+
+    u32 states_in_use_before = states_in_use;
+    u32 to = number_of_buckets - sweep_next_bucket > buckets ?
+        sweep_next_bucket + buckets : number_of_buckets;
+    release_states_not_marked(sweep_next_bucket, to);
+    sweep_next_bucket = to;
+    sweep_pending = (to < number_of_buckets);
+
+    d32 states_released = states_in_use_before - states_in_use;
+    assert(states_released >= 0);
+    return states_released;
 }
 
-static void mark_states_for_keeping(
-    tt_stats * s
+/*
+Counts the states of the subtree started at state b, the ones a cleaning from it
+would keep, without freeing any. There must not be a cleaning in progress. Not
+thread-safe.
+RETURNS number of states, or 0 if the state was not found
+*/
+u32 tt_subtree_states(
+    const board * b,
+    bool is_black
 ){
-    s->maintenance_mark = maintenance_mark;
+    assert(!sweep_pending);
+    d8 reduction;
+    tt_stats * stats = find_root_state(b, is_black, &reduction);
+    if(stats == NULL)
+        return 0;
 
-    for(move i = 0; i < s->plays_count; ++i){
-        tt_stats * ns = s->plays[i].next_stats;
-        if(ns != NULL && ns->maintenance_mark != maintenance_mark)
-            mark_states_for_keeping(ns);
-    }
+    ++maintenance_mark;
+    return count_states_of_subtree(stats);
+}
+
+/*
+RETURNS true if a cleaning of unreachable states is in progress
+*/
+bool tt_clean_unreachable_pending()
+{
+    return sweep_pending;
 }
 
 /*
@@ -264,18 +1650,9 @@ u32 tt_clean_unreachable(
     const board * b,
     bool is_black
 ){
-    u64 hash = zobrist_new_hash(b);
     u32 states_in_use_before = states_in_use;
-    tt_stats * stats = find_state(hash, b, is_black);
-    if(stats == NULL) /* free all */
-        tt_clean_all();
-    else
-    {
-        /* free outside tree */
-        ++maintenance_mark;
-        mark_states_for_keeping(stats);
-        release_states_not_marked();
-    }
+    tt_clean_unreachable_start(b, is_black);
+    tt_clean_unreachable_step(number_of_buckets);
 
     d32 states_released = states_in_use_before - states_in_use;
     assert(states_released >= 0);
@@ -283,25 +1660,32 @@ u32 tt_clean_unreachable(
 }
 
 /*
-Looks up a previously stored state, or generates a new one. No assumptions are
-made about whether the board state is in reduced form already. Never fails. If
-the memory is full it allocates a new state regardless. If the state is found
-and returned it's OpenMP lock is first set. Thread-safe.
-RETURNS the state information
+Looks up a previously stored state of a root position, or generates a new one,
+in the orientation it is stored in (see tt_reduction): the canonical one for
+few stones, otherwise the one it was reached in, if found. Never fails. If the
+memory is full it allocates a new state regardless. If the state is found and
+returned it's OpenMP lock is first set. Must not be used while searches are
+running.
+RETURNS the state information, and the reduction method that transforms the
+board into its orientation
 */
 tt_stats * tt_lookup_create(
     const board * b,
     bool is_black,
-    u64 hash
+    d8 * reduction
 ){
-    u32 key = (u32)(hash % ((u64)number_of_buckets));
-    omp_lock_t * bucket_lock = is_black ? &b_table_lock : &w_table_lock;
-    omp_set_lock(bucket_lock);
+    find_root_state(b, is_black, reduction);
+    board reduced;
+    u64 hash = reduce_board(&reduced, b, *reduction);
 
-    tt_stats * ret = find_state(hash, b, is_black);
+    u32 key = bucket_of(hash);
+    omp_lock_t * bucket_lock = bucket_lock_of(key, is_black);
+    set_lock_counted(bucket_lock);
+
+    tt_stats * ret = find_state(hash, &reduced, is_black);
     if(ret == NULL) /* doesnt exist */
     {
-        if(states_in_use >= max_allocated_states)
+        if(memory_exhausted())
         {
             /*
             It is possible in theory for a complex ko to produce a situation
@@ -316,27 +1700,20 @@ tt_stats * tt_lookup_create(
             flog_warn("tt", "memory exceeded on root lookup");
         }
 
+        count_lookup(false, false);
         ret = create_state(hash);
-        memcpy(ret->p, b->p, TOTAL_BOARD_SIZ);
+        pack_matrix(ret->p, reduced.p);
         ret->last_eaten_passed =
-            (b->last_played == PASS) ? PASS : b->last_eaten;
+            (reduced.last_played == PASS) ? PASS : reduced.last_eaten;
+        if(!insert_state(ret, is_black))
+            flog_crit("tt", "lock stripe of the table full on root lookup");
         omp_set_lock(&ret->lock);
-
-        if(is_black)
-        {
-            ret->next = b_stats_table[key];
-            b_stats_table[key] = ret;
-        }
-        else
-        {
-            ret->next = w_stats_table[key];
-            w_stats_table[key] = ret;
-        }
         omp_unset_lock(bucket_lock);
     }
     else /* update */
     {
-        omp_set_lock(&ret->lock);
+        count_lookup(true, false);
+        set_lock_counted(&ret->lock);
         omp_unset_lock(bucket_lock);
     }
 
@@ -344,57 +1721,100 @@ tt_stats * tt_lookup_create(
 }
 
 /*
-Looks up a previously stored state, or generates a new one. No assumptions are
-made about whether the board state is in reduced form already. If the limit on
-states has been met the function returns NULL. If the state is found and
-returned it's OpenMP lock is first set. Thread-safe.
+Looks up a previously stored state, or generates a new one, for the board
+transformed by a reduction method. If the limit on states has been met, or
+there is no room left for the state in its lock stripe, the function returns
+NULL. If the state is found and returned it's OpenMP lock is first set.
+Thread-safe; only lookups to buckets of the same lock stripe are serialized.
 RETURNS the state information or NULL
 */
 tt_stats * tt_lookup_null(
     const cfg_board * cb,
     bool is_black,
-    u64 hash
+    u64 hash,
+    d8 reduction
 ){
-    u32 key = (u32)(hash % ((u64)number_of_buckets));
-    omp_lock_t * bucket_lock = is_black ? &b_table_lock : &w_table_lock;
-    omp_set_lock(bucket_lock);
+    const u8 * p = cb->p;
+    move last_eaten_passed = (cb->last_played == PASS) ? PASS : cb->last_eaten;
+    u8 reduced_p[TOTAL_BOARD_SIZ];
+    if(reduction != NOREDUCE)
+    {
+        hash = reduce_stones(reduced_p, cb, reduction);
+        p = reduced_p;
+        last_eaten_passed = tt_reduce_move(last_eaten_passed, reduction);
+    }
+
+    u32 key = bucket_of(hash);
+    omp_lock_t * bucket_lock = bucket_lock_of(key, is_black);
+    set_lock_counted(bucket_lock);
 
-    tt_stats * ret = find_state2(hash, cb, is_black);
+    tt_stats * ret = find_state_by_matrix(hash, p, last_eaten_passed,
+        is_black);
     if(ret == NULL) /* doesnt exist */
     {
-        if(states_in_use >= max_allocated_states)
+        if(memory_exhausted())
         {
+            count_lookup(false, true);
             omp_unset_lock(bucket_lock);
             return NULL;
         }
 
         ret = create_state(hash);
-        memcpy(ret->p, cb->p, TOTAL_BOARD_SIZ);
-        ret->last_eaten_passed =
-            (cb->last_played == PASS) ? PASS : cb->last_eaten;
-        omp_set_lock(&ret->lock);
-
-        if(is_black)
-        {
-            ret->next = b_stats_table[key];
-            b_stats_table[key] = ret;
-        }
-        else
+        pack_matrix(ret->p, p);
+        ret->last_eaten_passed = last_eaten_passed;
+        if(!insert_state(ret, is_black))
         {
-            ret->next = w_stats_table[key];
-            w_stats_table[key] = ret;
+            /* as if out of memory */
+            discard_state(ret);
+            count_lookup(false, true);
+            omp_unset_lock(bucket_lock);
+            return NULL;
         }
+
+        count_lookup(false, false);
+        omp_set_lock(&ret->lock);
         omp_unset_lock(bucket_lock);
     }
     else /* update */
     {
-        omp_set_lock(&ret->lock);
+        count_lookup(true, false);
+        set_lock_counted(&ret->lock);
         omp_unset_lock(bucket_lock);
     }
 
     return ret;
 }
 
+/*
+Resets the slab to empty, dropping all states, plays and free lists; valid only
+if all memory in use was carved from the slab.
+*/
+static void reset_slab()
+{
+    #pragma omp parallel sections
+    {
+        #pragma omp section
+        clear_table(b_stats_table, number_of_buckets);
+        #pragma omp section
+        clear_table(w_stats_table, number_of_buckets);
+    }
+
+    slab_idx = 0;
+    slab_bottom = slabs[0];
+    slab_top = slabs[0] + slabs_siz[0];
+    freed_nodes = NULL;
+    allocated_states = 0;
+    states_in_use = 0;
+
+    memset(freed_plays, 0, sizeof(freed_plays));
+    plays_chunk = NULL;
+    plays_chunk_left = 0;
+    allocated_plays_mem = 0;
+    plays_mem_in_use = 0;
+    freed_plays_mem = 0;
+    plays_chunks_count = 0;
+}
+
 /*
 Frees all game states and resets counters.
 */
@@ -402,28 +1822,627 @@ u32 tt_clean_all()
 {
     u32 states_in_use_before = states_in_use;
     maintenance_mark = 0;
+    sweep_pending = false;
+
+    if(slabs_count > 0 && !system_allocated)
+    {
+        reset_slab();
+        return states_in_use_before;
+    }
+
+    #pragma omp parallel for schedule(static, 4096)
+    for(u32 i = 0; i < number_of_buckets; ++i)
+    {
+        tt_release_list * l = thread_state(&release_lists);
+        release_bucket(b_stats_table, i, l);
+        release_bucket(w_stats_table, i, l);
+    }
+
+    merge_release_lists();
+
+    d32 states_released = states_in_use_before - states_in_use;
+    assert(states_released >= 0);
+    return states_released;
+}
+
+/*
+Moves the states of a table to a new table of buckets, by their hash.
+*/
+static void rehash_table(
+    tt_bucket * from,
+    u32 from_buckets,
+    tt_bucket * to,
+    u32 to_buckets
+){
+#if TT_CLUSTER_BUCKETS
+    for(u32 i = 0; i < from_buckets; ++i)
+        for(u8 j = 0; j < TT_CLUSTER_WAYS && from[i].states[j] != NULL; ++j)
+            if(!cluster_insert(to, to_buckets, from[i].states[j]))
+                flog_crit("tt", "resize: lock stripe of the table full");
+#else
+    for(u32 i = 0; i < from_buckets; ++i)
+        while(from[i] != NULL)
+        {
+            tt_stats * s = from[i];
+            from[i] = s->next;
+            u32 key = (u32)(s->zobrist_hash % ((u64)to_buckets));
+            s->next = to[key];
+            to[key] = s;
+        }
+#endif
+}
+
+/*
+Changes the memory limit of the table, in MiB, keeping the states in use. The
+states are rehashed into tables with a number of buckets fit for the new limit.
+Raising the limit reserves more memory; lowering it returns the memory not yet
+used by states and plays, while the states over the limit are only freed by the
+next prunings. Not thread-safe.
+*/
+void tt_resize(
+    u64 mbs
+){
+    if(b_stats_table == NULL)
+    {
+        max_size_in_mbs = mbs;
+        return;
+    }
+
+    if(sweep_pending)
+        release_states_not_marked(sweep_next_bucket, number_of_buckets);
+    sweep_pending = false;
+
+#if TT_USE_SLAB
+    u64 old_memory = max_memory;
+#endif
+    set_memory_limit(mbs);
+
+    /* the states in use must fit as well */
+    u32 buckets = buckets_for_states(MAX(max_allocated_states, 2 *
+        states_in_use));
+    if(buckets != number_of_buckets)
+    {
+        tt_bucket * b_table = alloc_table(buckets);
+        tt_bucket * w_table = alloc_table(buckets);
+
+        rehash_table(b_stats_table, number_of_buckets, b_table, buckets);
+        rehash_table(w_stats_table, number_of_buckets, w_table, buckets);
+        free_table(b_stats_table, number_of_buckets);
+        free_table(w_stats_table, number_of_buckets);
+        b_stats_table = b_table;
+        w_stats_table = w_table;
+        number_of_buckets = buckets;
+    }
+
+#if TT_USE_SLAB
+    if(max_memory > slabs_total_siz)
+        init_slab(max_memory - slabs_total_siz);
+    else if(max_memory < old_memory && slabs_count > 0)
+    {
+        /* the space between states and plays of the slab is unused */
+        u8 * from = (u8 *)((((uintptr_t)slab_bottom) + TT_SLAB_ALIGNMENT - 1) /
+            TT_SLAB_ALIGNMENT * TT_SLAB_ALIGNMENT);
+        u8 * to = (u8 *)(((uintptr_t)slab_top) / TT_SLAB_ALIGNMENT *
+            TT_SLAB_ALIGNMENT);
+        if(to > from)
+            madvise(from, to - from, MADV_DONTNEED);
+        for(u16 i = slab_idx + 1; i < slabs_count; ++i)
+            madvise(slabs[i], slabs_siz[i], MADV_DONTNEED);
+    }
+#endif
+
+    char * s = alloc();
+    snprintf(s, MAX_PAGE_SIZ, "memory limit changed to %" PRIu64 " MiB; %u \
+buckets", mbs, number_of_buckets);
+    flog_info("tt", s);
+    release(s);
+}
+
+/*
+RETURNS the memory currently used by states and their plays, in bytes
+*/
+u64 tt_memory_in_use()
+{
+    return ((u64)states_in_use) * sizeof(tt_stats) + plays_mem_in_use;
+}
+
+/*
+RETURNS the memory used by states and allocated for the chunks of their plays,
+free blocks of plays included, in bytes
+*/
+u64 tt_memory_allocated()
+{
+    return ((u64)states_in_use) * sizeof(tt_stats) + allocated_plays_mem;
+}
+
+/*
+RETURNS the memory of the tables of buckets, besides the memory limit of the
+states and their plays, in bytes
+*/
+u64 tt_tables_memory()
+{
+    return ((u64)number_of_buckets) * sizeof(tt_bucket) * 2;
+}
+
+/*
+RETURNS the number of states currently in use
+*/
+u32 tt_states_in_use()
+{
+    return states_in_use;
+}
+
+static u64 state_fingerprint(
+    const tt_stats * s
+){
+    u64 ret = s->zobrist_hash ^ (((u64)s->plays_count) << 48);
+    if(s->plays != NULL)
+    {
+        u32 count = s->plays_count;
+        ret ^= crc32(s->mc_n, count * sizeof(u32));
+        ret ^= ((u64)crc32(s->mc_q, count * sizeof(float))) << 32;
+        ret ^= crc32(s->amaf_n, count * sizeof(u32)) * 31;
+        ret ^= ((u64)crc32(s->amaf_q, count * sizeof(float))) << 16;
+    }
+    return ret;
+}
+
+/*
+Produces a fingerprint of the contents of the transpositions table: the states
+in use, by order of bucket, and the statistics of their plays. Is meant for
+comparing the trees of reproducible searches. Not thread-safe.
+RETURNS fingerprint of the states in use
+*/
+u64 tt_fingerprint()
+{
+    u64 ret = 0;
 
     for(u32 i = 0; i < number_of_buckets; ++i)
+        for(u8 table = 0; table < 2; ++table)
+        {
+            const tt_bucket * bucket = (table == 0) ? &b_stats_table[i] :
+                &w_stats_table[i];
+#if TT_CLUSTER_BUCKETS
+            for(u8 j = 0; j < TT_CLUSTER_WAYS && bucket->states[j] != NULL;
+                ++j)
+                ret = ret * 1099511628211ULL + state_fingerprint(
+                    bucket->states[j]);
+#else
+            for(const tt_stats * s = *bucket; s != NULL; s = s->next)
+                ret = ret * 1099511628211ULL + state_fingerprint(s);
+#endif
+        }
+
+    return ret;
+}
+
+#define TT_SNAPSHOT_MAGIC "MTLDTREE"
+#define TT_SNAPSHOT_VERSION 3
+
+/*
+Snapshots of a subtree: a header, then each state, in breadth-first order from
+the root, followed by its plays. The state that follows a play is referenced by
+its position relative to that of the state of the play, or 0 if there is none.
+*/
+typedef struct __tt_snapshot_header_ {
+    char magic[8];
+    u32 version;
+    u32 board_siz;
+    u32 states;
+    d16 komi;
+    u16 unused;
+} tt_snapshot_header;
+
+typedef struct __tt_snapshot_state_ {
+    u64 zobrist_hash;
+    u8 p[PACKED_BOARD_SIZ];
+    move last_eaten_passed;
+    move plays_count;
+    move widened;
+    d8 expansion_delay;
+    bool is_black;
+    u32 visits;
+    float wins;
+} tt_snapshot_state;
+
+typedef struct __tt_snapshot_play_ {
+    d32 next_stats; /* relative position, or 0 */
+    u32 mc_n;
+    u32 amaf_n;
+    float mc_q;
+    float amaf_q;
+    float owner_winning;
+    float color_owning;
+    float score_mean;
+    u32 score_n;
+    move m;
+    move lgrf1_reply; /* index of the play of the next state, or NONE */
+    move by_prior; /* plays_by_prior at the index of the play */
+} tt_snapshot_play;
+
+typedef struct __tt_snapshot_index_ {
+    const tt_stats * s;
+    u32 position;
+} tt_snapshot_index;
+
+static u32 snapshot_index_hash(
+    const void * a
+){
+    u64 v = (u64)(size_t)((const tt_snapshot_index *)a)->s;
+    return (u32)(v >> 4) ^ (u32)(v >> 36);
+}
+
+static int snapshot_index_compare(
+    const void * a,
+    const void * b
+){
+    return ((const tt_snapshot_index *)a)->s ==
+        ((const tt_snapshot_index *)b)->s ? 0 : 1;
+}
+
+/*
+Writes the subtree started at state b to a file, as a compact snapshot that can
+be read back by tt_import_subtree, also by another process. Not thread-safe.
+RETURNS number of states written, or 0 if the state was not found or the file
+could not be written
+*/
+u32 tt_export_subtree(
+    const board * b,
+    bool is_black,
+    const char * filename
+){
+    d8 reduction;
+    tt_stats * root = find_root_state(b, is_black, &reduction);
+    if(root == NULL)
+        return 0;
+
+    /* breadth-first numbering of the states, from the root */
+    open_table * index = open_table_create(1024, sizeof(tt_snapshot_index),
+        snapshot_index_hash, snapshot_index_compare);
+    u32 capacity = 1024;
+    tt_stats ** order = (tt_stats **)malloc(capacity * sizeof(tt_stats *));
+    bool * colors = (bool *)malloc(capacity * sizeof(bool));
+    if(order == NULL || colors == NULL)
+        flog_crit("tt", "export: system out of memory");
+
+    tt_snapshot_index si;
+    si.s = root;
+    si.position = 0;
+    open_table_insert(index, &si, NULL);
+    order[0] = root;
+    colors[0] = is_black;
+    u32 states = 1;
+
+    for(u32 i = 0; i < states; ++i)
+        for(move k = 0; k < order[i]->plays_count; ++k)
+        {
+            si.s = order[i]->plays[k].next_stats;
+            if(si.s == NULL)
+                continue;
+            si.position = states;
+            bool inserted;
+            open_table_insert(index, &si, &inserted);
+            if(!inserted)
+                continue;
+
+            if(states == capacity)
+            {
+                capacity *= 2;
+                order = (tt_stats **)realloc(order, capacity *
+                    sizeof(tt_stats *));
+                colors = (bool *)realloc(colors, capacity * sizeof(bool));
+                if(order == NULL || colors == NULL)
+                    flog_crit("tt", "export: system out of memory");
+            }
+            /* the next state is of the opponent */
+            colors[states] = !colors[i];
+            order[states++] = (tt_stats *)si.s;
+        }
+
+    FILE * fp = fopen(filename, "wb");
+    bool ok = (fp != NULL);
+
+    if(ok)
+    {
+        tt_snapshot_header h;
+        memset(&h, 0, sizeof(tt_snapshot_header));
+        memcpy(h.magic, TT_SNAPSHOT_MAGIC, 8);
+        h.version = TT_SNAPSHOT_VERSION;
+        h.board_siz = BOARD_SIZ;
+        h.states = states;
+        h.komi = komi;
+        ok = fwrite(&h, sizeof(tt_snapshot_header), 1, fp) == 1;
+    }
+
+    for(u32 i = 0; ok && i < states; ++i)
+    {
+        const tt_stats * s = order[i];
+        tt_snapshot_state ss;
+        memset(&ss, 0, sizeof(tt_snapshot_state));
+        ss.zobrist_hash = s->zobrist_hash;
+        memcpy(ss.p, s->p, PACKED_BOARD_SIZ);
+        ss.last_eaten_passed = s->last_eaten_passed;
+        ss.plays_count = s->plays_count;
+        ss.widened = s->widened;
+        ss.expansion_delay = s->expansion_delay;
+        ss.is_black = colors[i];
+        ss.visits = s->visits;
+        ss.wins = s->wins;
+        ok = fwrite(&ss, sizeof(tt_snapshot_state), 1, fp) == 1;
+
+        for(move k = 0; ok && k < s->plays_count; ++k)
+        {
+            const tt_play * play = &s->plays[k];
+            tt_snapshot_play sp;
+            memset(&sp, 0, sizeof(tt_snapshot_play));
+            sp.m = play->m;
+            sp.mc_n = s->mc_n[k];
+            sp.mc_q = s->mc_q[k];
+            sp.amaf_n = s->amaf_n[k];
+            sp.amaf_q = s->amaf_q[k];
+            sp.owner_winning = play->owner_winning;
+            sp.color_owning = play->color_owning;
+            sp.score_mean = play->score_mean;
+            sp.score_n = play->score_n;
+            sp.lgrf1_reply = NONE;
+            sp.by_prior = s->plays_by_prior[k];
+
+            const tt_stats * ns = play->next_stats;
+            if(ns != NULL)
+            {
+                si.s = ns;
+                const tt_snapshot_index * found = (const tt_snapshot_index *)
+                    open_table_find(index, &si);
+                sp.next_stats = (d32)found->position - (d32)i;
+
+                const tt_play * reply = play->lgrf1_reply;
+                if(reply != NULL && reply >= ns->plays && reply < ns->plays +
+                    ns->plays_count)
+                    sp.lgrf1_reply = (move)(reply - ns->plays);
+            }
+            ok = fwrite(&sp, sizeof(tt_snapshot_play), 1, fp) == 1;
+        }
+    }
+
+    if(fp != NULL)
+        ok = (fclose(fp) == 0) && ok;
+
+    free(order);
+    free(colors);
+    open_table_destroy(index);
+    return ok ? states : 0;
+}
+
+/*
+Replaces the contents of the table with a subtree written by tt_export_subtree.
+The states are read breadth-first until the memory limit is reached, so the
+states nearest the root are kept. Not thread-safe.
+RETURNS number of states read, or 0 if the file could not be read or is for a
+different board size or komi
+*/
+u32 tt_import_subtree(
+    const char * filename
+){
+    FILE * fp = fopen(filename, "rb");
+    if(fp == NULL)
+        return 0;
+
+    tt_snapshot_header h;
+    if(fread(&h, sizeof(tt_snapshot_header), 1, fp) != 1 || memcmp(h.magic,
+        TT_SNAPSHOT_MAGIC, 8) != 0 || h.version != TT_SNAPSHOT_VERSION ||
+        h.board_siz != BOARD_SIZ || h.komi != komi || h.states == 0)
+    {
+        fclose(fp);
+        return 0;
+    }
+
+    tt_clean_all();
+
+    /* the links of each play are resolved once all states are read */
+    tt_stats ** states = (tt_stats **)calloc(h.states, sizeof(tt_stats *));
+    d32 * links = NULL;
+    move * replies = NULL;
+    u64 links_capacity = 0;
+    u64 plays_read = 0;
+    if(states == NULL)
+        flog_crit("tt", "import: system out of memory");
+
+    u32 imported = 0;
+    bool ok = true;
+    for(; imported < h.states && !memory_exhausted(); ++imported)
     {
-        /* black table */
-        while(b_stats_table[i] != NULL)
+        tt_snapshot_state ss;
+        if(fread(&ss, sizeof(tt_snapshot_state), 1, fp) != 1 ||
+            ss.plays_count > MAX_PLAYS_COUNT || ss.widened > ss.plays_count)
+        {
+            ok = false;
+            break;
+        }
+
+        tt_stats * s = create_state(ss.zobrist_hash);
+        memcpy(s->p, ss.p, PACKED_BOARD_SIZ);
+        s->last_eaten_passed = ss.last_eaten_passed;
+        s->expansion_delay = ss.expansion_delay;
+        s->visits = ss.visits;
+        s->wins = ss.wins;
+
+        if(!insert_state(s, ss.is_black))
+            flog_crit("tt", "import: lock stripe of the table full");
+        states[imported] = s;
+
+        if(ss.plays_count == 0)
+            continue;
+
+        if(plays_read + ss.plays_count > links_capacity)
+        {
+            links_capacity = MAX(links_capacity * 2, 65536);
+            links = (d32 *)realloc(links, links_capacity * sizeof(d32));
+            replies = (move *)realloc(replies, links_capacity * sizeof(move));
+            if(links == NULL || replies == NULL)
+                flog_crit("tt", "import: system out of memory");
+        }
+
+        /* the order by prior must be a permutation of the plays */
+        bool ranked[MAX_PLAYS_COUNT];
+        memset(ranked, false, ss.plays_count * sizeof(bool));
+
+        set_plays_block(s, ss.plays_count);
+        for(move k = 0; k < ss.plays_count; ++k)
         {
-            tt_stats * tmp = b_stats_table[i]->next;
-            release_state(b_stats_table[i]);
-            b_stats_table[i] = tmp;
+            tt_snapshot_play sp;
+            if(fread(&sp, sizeof(tt_snapshot_play), 1, fp) != 1)
+            {
+                ok = false;
+                sp.next_stats = 0;
+            }
+            if(!is_board_move(sp.m) && sp.m != PASS)
+            {
+                ok = false;
+                sp.m = PASS;
+            }
+            if(sp.by_prior >= ss.plays_count || ranked[sp.by_prior])
+            {
+                ok = false;
+                sp.by_prior = k;
+            }
+            ranked[sp.by_prior] = true;
+            s->plays[k].m = sp.m;
+            s->plays[k].proven = PROVEN_NONE;
+            s->plays[k].owner_winning = sp.owner_winning;
+            s->plays[k].color_owning = sp.color_owning;
+            s->plays[k].score_mean = sp.score_mean;
+            s->plays[k].score_n = sp.score_n;
+            s->plays[k].next_stats = NULL;
+            s->plays[k].lgrf1_reply = NULL;
+            s->mc_n[k] = sp.mc_n;
+            s->mc_q[k] = sp.mc_q;
+            s->amaf_n[k] = sp.amaf_n;
+            s->amaf_q[k] = sp.amaf_q;
+            s->vl_n[k] = 0;
+            s->plays_by_prior[k] = sp.by_prior;
+            links[plays_read + k] = sp.next_stats;
+            replies[plays_read + k] = sp.lgrf1_reply;
         }
-        /* white table */
-        while(w_stats_table[i] != NULL)
+        index_plays_by_position(s, ss.plays_count);
+        s->plays_count = ss.plays_count;
+        s->widened = ss.widened;
+        plays_read += ss.plays_count;
+
+        if(!ok)
         {
-            tt_stats * tmp = w_stats_table[i]->next;
-            release_state(w_stats_table[i]);
-            w_stats_table[i] = tmp;
+            ++imported;
+            break;
         }
     }
+    fclose(fp);
 
-    d32 states_released = states_in_use_before - states_in_use;
-    assert(states_released >= 0);
-    return states_released;
+    /* states beyond the memory limit are left out and not linked to */
+    plays_read = 0;
+    for(u32 i = 0; i < imported; ++i)
+    {
+        tt_stats * s = states[i];
+        for(move k = 0; k < s->plays_count; ++k)
+        {
+            d64 j = (d64)i + links[plays_read + k];
+            if(links[plays_read + k] == 0 || j < 0 || j >= imported)
+                continue;
+
+            tt_stats * ns = states[j];
+            s->plays[k].next_stats = ns;
+            move reply = replies[plays_read + k];
+            if(reply != NONE && reply < ns->plays_count)
+                s->plays[k].lgrf1_reply = &ns->plays[reply];
+        }
+        plays_read += s->plays_count;
+    }
+
+    free(states);
+    free(links);
+    free(replies);
+
+    if(!ok)
+    {
+        tt_clean_all();
+        return 0;
+    }
+    return imported;
+}
+
+/*
+Resets the counters of lookups of all threads.
+*/
+void tt_reset_lookup_stats()
+{
+    thread_states_clear(&lookup_stats);
+}
+
+/*
+Sums the counters of lookups of all threads, since they were last reset.
+*/
+void tt_get_lookup_stats(
+    tt_lookup_stats * dst
+){
+    memset(dst, 0, sizeof(tt_lookup_stats));
+    for(u16 i = 0; i < MAXIMUM_NUM_THREADS; ++i)
+    {
+        const tt_lookup_stats * ls = thread_state_of(&lookup_stats, i);
+        if(ls == NULL)
+            continue;
+        dst->lookups += ls->lookups;
+        dst->hits += ls->hits;
+        dst->memory_exhausted += ls->memory_exhausted;
+        dst->lock_contentions += ls->lock_contentions;
+        dst->lock_wait_ns += ls->lock_wait_ns;
+    }
+}
+
+/*
+Writes the occupancy of the buckets of both tables.
+RETURNS number of characters written
+*/
+static u32 bucket_occupancy_to_string(
+    char * dst,
+    u32 siz
+){
+    u64 used = 0;
+    u32 full = 0;
+    u32 longest = 0;
+#if TT_CLUSTER_BUCKETS
+    u64 displaced = 0;
+#endif
+
+    for(u8 table = 0; table < 2; ++table)
+        for(u32 i = 0; i < number_of_buckets; ++i)
+        {
+            const tt_bucket * bucket = (table == 0) ? &b_stats_table[i] :
+                &w_stats_table[i];
+            u32 count = 0;
+#if TT_CLUSTER_BUCKETS
+            while(count < TT_CLUSTER_WAYS && bucket->states[count] != NULL)
+                ++count;
+            if(count == TT_CLUSTER_WAYS)
+                ++full;
+            displaced += bucket->displaced;
+#else
+            for(const tt_stats * s = *bucket; s != NULL; s = s->next)
+                ++count;
+            if(count > 0)
+                ++full;
+#endif
+            used += count;
+            longest = MAX(longest, count);
+        }
+
+#if TT_CLUSTER_BUCKETS
+    return snprintf(dst, siz, "Cluster occupancy: %.1f%% of %u ways, %.1f%% \
+full, %" PRIu64 " states displaced\n", (100.0 * used) / (2.0 *
+        number_of_buckets * TT_CLUSTER_WAYS), TT_CLUSTER_WAYS, (100.0 * full) /
+        (2.0 * number_of_buckets), displaced);
+#else
+    return snprintf(dst, siz, "Bucket occupancy: %.1f%% in use, %.2f states \
+per bucket in use, longest chain %u\n", (100.0 * full) / (2.0 *
+        number_of_buckets), full == 0 ? 0.0 : ((double)used) / full, longest);
+#endif
 }
 
 /*
@@ -443,10 +2462,37 @@ void tt_log_status()
         allocated_states);
     idx += snprintf(buf + idx, MAX_PAGE_SIZ - idx, "States in use: %u\n",
         states_in_use);
+    idx += snprintf(buf + idx, MAX_PAGE_SIZ - idx, "Allocated plays memory: %"
+        PRIu64 " B\n", allocated_plays_mem);
+    idx += snprintf(buf + idx, MAX_PAGE_SIZ - idx, "Plays memory in use: %"
+        PRIu64 " B (%" PRIu64 " B free)\n", plays_mem_in_use, freed_plays_mem);
+    if(slabs_count > 0)
+    {
+        u64 slab_free = slab_top - slab_bottom;
+        for(u16 i = slab_idx + 1; i < slabs_count; ++i)
+            slab_free += slabs_siz[i];
+        idx += snprintf(buf + idx, MAX_PAGE_SIZ - idx, "Slab free memory: %"
+            PRIu64 " B in %u slabs%s\n", slab_free, slabs_count,
+            slab_huge_pages ? " (huge pages)" : "");
+    }
     idx += snprintf(buf + idx, MAX_PAGE_SIZ - idx, "Number of buckets: %u\n",
         number_of_buckets);
-    snprintf(buf + idx, MAX_PAGE_SIZ - idx, "Maintenance mark: %u\n",
+    idx += bucket_occupancy_to_string(buf + idx, MAX_PAGE_SIZ - idx);
+#if MCTS_SEARCH_STATS
+    tt_lookup_stats ls;
+    tt_get_lookup_stats(&ls);
+    idx += snprintf(buf + idx, MAX_PAGE_SIZ - idx, "Lookups: %" PRIu64
+        " (%" PRIu64 " hits, %" PRIu64 " out of memory)\n", ls.lookups, ls.hits,
+        ls.memory_exhausted);
+    idx += snprintf(buf + idx, MAX_PAGE_SIZ - idx, "Contended locks: %" PRIu64
+        " (%" PRIu64 " us waited)\n", ls.lock_contentions, ls.lock_wait_ns /
+        1000);
+#endif
+    idx += snprintf(buf + idx, MAX_PAGE_SIZ - idx, "Maintenance mark: %u\n",
         maintenance_mark);
+    idx += snprintf(buf + idx, MAX_PAGE_SIZ - idx, "Tables memory: %" PRIu64
+        " B\nOther memory in use:\n", tt_tables_memory());
+    mem_usage_to_string(buf + idx, MAX_PAGE_SIZ - idx);
 
     flog_warn("tt", buf);
     release(buf);
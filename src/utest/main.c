@@ -3,29 +3,62 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <omp.h>
 
 #include "alloc.h"
 #include "board.h"
 #include "cfg_board.h"
 #include "constants.h"
+#include "dragon.h"
 #include "engine.h"
 #include "flog.h"
 #include "game_record.h"
+#include "matrix.h"
 #include "mcts.h"
+#include "open_table.h"
 #include "opening_book.h"
+#include "pat12.h"
 #include "pat3.h"
 #include "pts_file.h"
 #include "randg.h"
 #include "random_play.h"
+#include "scoring.h"
+#include "sgf.h"
 #include "state_changes.h"
 #include "tactical.h"
 #include "timem.h"
+#include "transpositions.h"
 #include "types.h"
 #include "zobrist.h"
 
 
+extern u8 out_neighbors8[TOTAL_BOARD_SIZ];
+extern u8 out_neighbors4[TOTAL_BOARD_SIZ];
+extern move_seq neighbors_side[TOTAL_BOARD_SIZ];
+extern move_seq neighbors_diag[TOTAL_BOARD_SIZ];
+extern move_seq neighbors_3x3[TOTAL_BOARD_SIZ];
+extern bool border_left[TOTAL_BOARD_SIZ];
+extern bool border_right[TOTAL_BOARD_SIZ];
+extern bool border_top[TOTAL_BOARD_SIZ];
+extern bool border_bottom[TOTAL_BOARD_SIZ];
+extern u8 distances_to_border[TOTAL_BOARD_SIZ];
+extern move_seq nei_dst_3[TOTAL_BOARD_SIZ];
+extern move_seq nei_dst_4[TOTAL_BOARD_SIZ];
+extern bool black_eye[65536];
+extern bool white_eye[65536];
+extern u8 black_eye_shapes[65536];
+extern u8 white_eye_shapes[65536];
 extern u16 iv_3x3[TOTAL_BOARD_SIZ][TOTAL_BOARD_SIZ][3];
+extern u16 initial_3x3_hash[TOTAL_BOARD_SIZ];
+extern move far_neighbors[TOTAL_BOARD_SIZ][4];
+extern u8 far_shifts[TOTAL_BOARD_SIZ][4];
+extern u8 far_neighbors_count[TOTAL_BOARD_SIZ];
+extern u8 initial_far_hash[TOTAL_BOARD_SIZ];
+extern d16 dynamic_komi;
+extern d16 komi;
+extern u64 max_size_in_mbs;
+extern const u8 constant_tables_size;
 
 static char _ts[MAX_PAGE_SIZ];
 static char * _timestamp(){
@@ -45,6 +78,88 @@ static void massert(
     }
 }
 
+/*
+RETURNS true if the two boards have the same contents, including the order of
+the lists of empty positions and groups
+*/
+static bool cfg_boards_identical(
+    const cfg_board * a,
+    const cfg_board * b
+){
+    if(memcmp(a->p, b->p, TOTAL_BOARD_SIZ) != 0 || a->last_eaten !=
+        b->last_eaten || a->last_played != b->last_played ||
+        memcmp(a->hash, b->hash, TOTAL_BOARD_SIZ * sizeof(u16)) != 0 ||
+        memcmp(a->black_neighbors4, b->black_neighbors4, TOTAL_BOARD_SIZ) != 0
+        || memcmp(a->white_neighbors4, b->white_neighbors4, TOTAL_BOARD_SIZ) !=
+        0 || memcmp(a->black_neighbors8, b->black_neighbors8, TOTAL_BOARD_SIZ)
+        != 0 || memcmp(a->white_neighbors8, b->white_neighbors8,
+        TOTAL_BOARD_SIZ) != 0 || a->empty.count != b->empty.count ||
+        memcmp(a->empty.coord, b->empty.coord, a->empty.count * sizeof(move))
+        != 0 || a->unique_groups_count != b->unique_groups_count ||
+        memcmp(a->unique_groups, b->unique_groups, a->unique_groups_count *
+        sizeof(move)) != 0)
+        return false;
+
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+    {
+        const group * x = a->g[m];
+        const group * y = b->g[m];
+        if(x == NULL || y == NULL)
+        {
+            if(x != y)
+                return false;
+            continue;
+        }
+        if(x->is_black != y->is_black || x->unique_groups_idx !=
+            y->unique_groups_idx || x->liberties != y->liberties ||
+            memcmp(x->ls, y->ls, sizeof(x->ls)) != 0 ||
+            x->neighbors_count != y->neighbors_count || memcmp(x->neighbors,
+            y->neighbors, x->neighbors_count * sizeof(move)) != 0 ||
+            x->stones.count != y->stones.count || memcmp(x->stones.coord,
+            y->stones.coord, x->stones.count * sizeof(move)) != 0)
+            return false;
+    }
+    return true;
+}
+
+/*
+Tests cfg_classify_empty against the neighbor counts it is defined by, and the
+group reasoning it stands in for.
+*/
+static void test_classify_empty(
+    cfg_board * cb
+){
+    u64 safe[LIB_BITMAP_WORDS];
+    cfg_classify_empty(cb, safe);
+    move ko = get_ko_play(cb);
+
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+    {
+        bool s = (safe[m / 64] & LIB_BIT(m)) != 0;
+        if(cb->p[m] != EMPTY)
+        {
+            massert(!s, "cfg_classify_empty: occupied position");
+            continue;
+        }
+
+        u8 stones = cb->black_neighbors4[m] + cb->white_neighbors4[m];
+        massert(s == (stones + out_neighbors4[m] < 3),
+            "cfg_classify_empty: neighbor counts");
+        if(!s)
+            continue;
+
+        massert(m != ko && !is_eye(cb, true, m) && !is_eye(cb, false, m),
+            "cfg_classify_empty: eye or ko");
+        for(u8 c = 0; c < 2; ++c)
+        {
+            move caps;
+            u8 libs = libs_after_play(cb, c == 0, m, &caps);
+            massert(libs >= 2 && safe_to_play(cb, c == 0, m) == 2,
+                "cfg_classify_empty: safe position");
+        }
+    }
+}
+
 static void test_cfg_board()
 {
     fprintf(stderr, "%s: cfg_board operations...", _timestamp());
@@ -84,19 +199,37 @@ static void test_cfg_board()
                 continue;
             }
 
+            cfg_board sb4;
+            cfg_board_clone(&sb4, &sb2);
+            cfg_undo u;
+            cfg_board_journal(&sb2, is_black, m, &u);
+            just_play(&sb2, is_black, m);
+            massert(cfg_board_are_equal(&sb2, &b), "journaled just_play");
+            cfg_board_undo(&sb2, &u);
+            massert(cfg_boards_identical(&sb2, &sb4), "cfg_board_undo");
+            cfg_board_free(&sb4);
+
             just_play(&cb, is_black, m);
             massert(cfg_board_are_equal(&cb, &b), "just_play");
-
-            bool stones_cap[TOTAL_BOARD_SIZ];
-            memset(stones_cap, 0, TOTAL_BOARD_SIZ);
-            u8 tmp4[LIB_BITMAP_SIZ];
+            massert(score_stones_and_area2(&cb) == score_stones_and_area(b.p),
+                "score_stones_and_area2");
+            dynamic_komi = 2;
+            massert(score_stones_and_area2(&cb) == score_stones_and_area(b.p) -
+                2, "dynamic komi");
+            dynamic_komi = 0;
+
+            move_seq stones_cap;
+            stones_cap.count = 0;
+            u64 tmp4[LIB_BITMAP_WORDS];
             d16 stone_diff2 = 0;
-            just_play3(&sb3, is_black, m, &stone_diff2, stones_cap, tmp4);
+            just_play3(&sb3, is_black, m, &stone_diff2, &stones_cap, tmp4);
             massert(cfg_board_are_equal(&sb3, &b), "just_play3");
 
             cfg_board_free(&sb2);
             cfg_board_free(&sb3);
 
+            test_classify_empty(&cb);
+
             /*
             Test liberty counts for both players
             */
@@ -233,6 +366,15 @@ static void test_pattern(){
                 massert(hash_cfg == hash_pat3,
                     "CFG from board and pat3 patterns 2");
                 cfg_board_free(&sb2);
+
+                u32 code = PAT12_CODE(&cb, m);
+                massert(code == pat12_from_board(cb.p, m),
+                    "CFG from play and 12-point patterns");
+                massert(pat12_invert(pat12_invert(code)) == code,
+                    "12-point pattern color inversion");
+                u32 reduced = pat12_reduce_auto(code);
+                massert(reduced <= code && pat12_reduce_auto(reduced) ==
+                    reduced, "12-point pattern reduction");
             }
 
             is_black = !is_black;
@@ -376,6 +518,263 @@ static void test_ladders()
     fprintf(stderr, " passed\n");
 }
 
+/*
+Tests that the readings of the 1-2 liberty solvers found in the tactical cache
+are the same as the ones read again with it empty, for the weak groups of the
+positions of random games, with their plays and captures.
+*/
+static void test_tactical_cache()
+{
+    fprintf(stderr, "%s: tactical cache...", _timestamp());
+    board b;
+    cfg_board cb;
+    u32 readings = 0;
+
+    tactical_cache_clear();
+    for(u8 game = 0; game < 10; ++game)
+    {
+        clear_board(&b);
+        bool is_black = true;
+        for(u16 i = 0; i < TOTAL_BOARD_SIZ; ++i)
+        {
+            move m = random_play2(&b, is_black);
+            if(m == PASS)
+                break;
+            just_play_slow(&b, is_black, m);
+            is_black = !is_black;
+
+            cfg_from_board(&cb, &b);
+            for(u8 k = 0; k < cb.unique_groups_count; ++k)
+            {
+                const group * g = cb.g[cb.unique_groups[k]];
+                if(g->liberties > 3)
+                    continue;
+
+                move cached[2];
+                u16 cached_counts[2] = {0, 0};
+                move cached_plays[2][TOTAL_BOARD_SIZ];
+                for(u8 fresh = 0; fresh < 2; ++fresh)
+                {
+                    if(fresh)
+                        tactical_cache_clear();
+
+                    move killing = get_killing_play(&cb, g);
+                    move saving = get_saving_play(&cb, g);
+                    u16 killing_count = 0;
+                    move killing_plays[TOTAL_BOARD_SIZ];
+                    can_be_killed_all(&cb, g, &killing_count, killing_plays);
+                    u16 saving_count = 0;
+                    move saving_plays[TOTAL_BOARD_SIZ];
+                    can_be_saved_all(&cb, g, &saving_count, saving_plays);
+
+                    if(!fresh)
+                    {
+                        cached[0] = killing;
+                        cached[1] = saving;
+                        cached_counts[0] = killing_count;
+                        cached_counts[1] = saving_count;
+                        memcpy(cached_plays[0], killing_plays, killing_count *
+                            sizeof(move));
+                        memcpy(cached_plays[1], saving_plays, saving_count *
+                            sizeof(move));
+                        continue;
+                    }
+
+                    massert(cached[0] == killing, "killing play differs");
+                    massert(cached[1] == saving, "saving play differs");
+                    massert(cached_counts[0] == killing_count &&
+                        memcmp(cached_plays[0], killing_plays, killing_count *
+                        sizeof(move)) == 0, "killing plays differ");
+                    massert(cached_counts[1] == saving_count &&
+                        memcmp(cached_plays[1], saving_plays, saving_count *
+                        sizeof(move)) == 0, "saving plays differ");
+                }
+                ++readings;
+            }
+            cfg_board_free(&cb);
+        }
+    }
+    massert(readings > 500, "too few readings");
+
+    fprintf(stderr, " passed\n");
+}
+
+/*
+Tests that the shapes kept up to date from the intersections that changed are
+the same as the shapes found again for the whole board, for the positions of
+random games, with their plays and captures, and between games.
+*/
+static void test_dragon_shapes()
+{
+    fprintf(stderr, "%s: dragon shapes...", _timestamp());
+    board b;
+    cfg_board cb;
+    bool viable[TOTAL_BOARD_SIZ];
+    bool play_okay[TOTAL_BOARD_SIZ];
+    u8 in_nakade[TOTAL_BOARD_SIZ];
+
+    for(u8 game = 0; game < 10; ++game)
+    {
+        clear_board(&b);
+        bool is_black = true;
+        for(u16 i = 0; i < TOTAL_BOARD_SIZ; ++i)
+        {
+            move m = random_play2(&b, is_black);
+            if(m == PASS)
+                break;
+            just_play_slow(&b, is_black, m);
+            is_black = !is_black;
+
+            cfg_from_board(&cb, &b);
+            memset(viable, true, TOTAL_BOARD_SIZ);
+            memset(play_okay, true, TOTAL_BOARD_SIZ);
+            memset(in_nakade, 0, TOTAL_BOARD_SIZ);
+            estimate_eyes(&cb, is_black, viable, play_okay, in_nakade);
+            massert(verify_shapes(&cb), "shapes differ");
+            cfg_board_free(&cb);
+        }
+    }
+
+    fprintf(stderr, " passed\n");
+}
+
+/*
+Clears the board and places an eye space of stones of color c, with its cells at
+(3, 3) plus their offsets, transposed if t is 1, enclosed by a wall of width 1.
+*/
+static void place_eye_space(
+    board * b,
+    u8 c,
+    const u8 cells[][2],
+    u8 count,
+    u8 t
+){
+    clear_board(b);
+    for(u8 i = 0; i < count; ++i)
+        for(d8 dx = -1; dx <= 1; ++dx)
+            for(d8 dy = -1; dy <= 1; ++dy)
+                b->p[coord_to_move(3 + cells[i][t] + dx, 3 + cells[i][1 - t] +
+                    dy)] = c;
+    for(u8 i = 0; i < count; ++i)
+        b->p[coord_to_move(3 + cells[i][t], 3 + cells[i][1 - t])] = EMPTY;
+}
+
+/*
+Tests the eye shapes found with the tables of the 3x3 codes, for eye spaces of
+both colors and transposed: the eyes of one and two points, the square of four,
+and the nakade of the spaces of three to six points.
+*/
+static void test_eye_shapes()
+{
+    fprintf(stderr, "%s: eye shapes and nakade...", _timestamp());
+    board b;
+    cfg_board cb;
+    bool forcing;
+
+    const u8 one[1][2] = {{0, 0}};
+    const u8 two[2][2] = {{0, 0}, {1, 0}};
+    const u8 square_four[4][2] = {{0, 0}, {1, 0}, {0, 1}, {1, 1}};
+    const u8 straight_three[3][2] = {{0, 0}, {1, 0}, {2, 0}};
+    const u8 straight_four[4][2] = {{0, 0}, {1, 0}, {2, 0}, {3, 0}};
+    const u8 bent_three[3][2] = {{0, 0}, {1, 0}, {1, 1}};
+    const u8 pyramid_four[4][2] = {{0, 0}, {1, 0}, {2, 0}, {1, 1}};
+    const u8 crossed_five[5][2] = {{1, 0}, {0, 1}, {1, 1}, {2, 1}, {1, 2}};
+    const u8 bulky_five[5][2] = {{0, 0}, {1, 0}, {0, 1}, {1, 1}, {2, 1}};
+    const u8 rabbity_six[6][2] = {{0, 0}, {1, 0}, {0, 1}, {1, 1}, {2, 1},
+        {1, 2}};
+
+    for(u8 c = BLACK_STONE; c <= WHITE_STONE; ++c)
+    {
+        bool is_black = (c == BLACK_STONE);
+        for(u8 t = 0; t < 2; ++t)
+        {
+            move origin = coord_to_move(3, 3);
+            move second = t == 0 ? coord_to_move(4, 3) : coord_to_move(3, 4);
+
+            place_eye_space(&b, c, one, 1, t);
+            cfg_from_board(&cb, &b);
+            massert(is_eye(&cb, is_black, origin), "eye1");
+            massert(!is_eye(&cb, !is_black, origin), "eye2");
+            cfg_board_free(&cb);
+
+            /* a false eye, with two diagonals of the other color */
+            b.p[coord_to_move(2, 2)] = b.p[coord_to_move(4, 4)] = (c ==
+                BLACK_STONE) ? WHITE_STONE : BLACK_STONE;
+            cfg_from_board(&cb, &b);
+            massert(!is_eye(&cb, is_black, origin), "eye3");
+            cfg_board_free(&cb);
+
+            place_eye_space(&b, c, two, 2, t);
+            cfg_from_board(&cb, &b);
+            massert(is_2pt_eye(&cb, is_black, origin, &forcing) && !forcing,
+                "2pt eye1");
+            massert(!is_2pt_eye(&cb, !is_black, origin, &forcing),
+                "2pt eye2");
+            massert(!is_eye(&cb, is_black, origin), "2pt eye3");
+            massert(is_nakade(&cb, origin) == 0, "2pt eye4");
+            cfg_board_free(&cb);
+
+            place_eye_space(&b, c, square_four, 4, t);
+            cfg_from_board(&cb, &b);
+            massert(is_4pt_eye(&cb, is_black, origin, &forcing) && !forcing,
+                "4pt eye1");
+            massert(!is_4pt_eye(&cb, !is_black, origin, &forcing),
+                "4pt eye2");
+            massert(!is_2pt_eye(&cb, is_black, origin, &forcing), "4pt eye3");
+            cfg_board_free(&cb);
+
+            place_eye_space(&b, c, straight_three, 3, t);
+            cfg_from_board(&cb, &b);
+            massert(is_nakade(&cb, second) == 12, "straight three1");
+            massert(is_nakade(&cb, origin) == 0, "straight three2");
+            cfg_board_free(&cb);
+
+            place_eye_space(&b, c, straight_four, 4, t);
+            cfg_from_board(&cb, &b);
+            massert(is_nakade(&cb, second) == 0, "straight four");
+            cfg_board_free(&cb);
+
+            place_eye_space(&b, c, bent_three, 3, t);
+            cfg_from_board(&cb, &b);
+            massert(is_nakade(&cb, second) == 12, "bent three1");
+            massert(is_nakade(&cb, origin) == 0, "bent three2");
+            cfg_board_free(&cb);
+
+            place_eye_space(&b, c, pyramid_four, 4, t);
+            cfg_from_board(&cb, &b);
+            massert(is_nakade(&cb, second) == 16, "pyramid four1");
+            massert(is_nakade(&cb, origin) == 0, "pyramid four2");
+            cfg_board_free(&cb);
+
+            place_eye_space(&b, c, crossed_five, 5, t);
+            cfg_from_board(&cb, &b);
+            massert(is_nakade(&cb, coord_to_move(4, 4)) == 20,
+                "crossed five1");
+            massert(is_nakade(&cb, second) == 0, "crossed five2");
+            cfg_board_free(&cb);
+
+            /*
+            As with the old neighbor counts, the corners of the bulky five are
+            not solid enough to be read as a nakade; only the rabbity six is
+            */
+            place_eye_space(&b, c, bulky_five, 5, t);
+            cfg_from_board(&cb, &b);
+            massert(is_nakade(&cb, coord_to_move(4, 4)) == 0, "bulky five1");
+            massert(is_nakade(&cb, origin) == 0, "bulky five2");
+            cfg_board_free(&cb);
+
+            place_eye_space(&b, c, rabbity_six, 6, t);
+            cfg_from_board(&cb, &b);
+            massert(is_nakade(&cb, coord_to_move(4, 4)) == 25,
+                "rabbity six1");
+            massert(is_nakade(&cb, origin) == 0, "rabbity six2");
+            cfg_board_free(&cb);
+        }
+    }
+
+    fprintf(stderr, " passed\n");
+}
+
 static void test_board()
 {
     fprintf(stderr, "%s: board reduction and operations...", _timestamp());
@@ -565,6 +964,57 @@ static void test_time_keeping()
     fprintf(stderr, " passed\n");
 }
 
+static void test_constant_tables()
+{
+    fprintf(stderr, "%s: constant tables...", _timestamp());
+
+    if(constant_tables_size != BOARD_SIZ)
+    {
+        /* without compiled in tables there is nothing to compare */
+        fprintf(stderr, " NOT COMPILED IN for %ux%u, run make constant_tables"
+            " to test them\n", BOARD_SIZ, BOARD_SIZ);
+        return;
+    }
+
+    /* every table written by gen_constant_tables */
+    void * tables[] = {out_neighbors8, out_neighbors4, neighbors_side,
+        neighbors_diag, neighbors_3x3, border_left, border_right, border_top,
+        border_bottom, distances_to_border, nei_dst_3, nei_dst_4, black_eye,
+        white_eye, black_eye_shapes, white_eye_shapes, iv_3x3,
+        initial_3x3_hash, far_neighbors, far_shifts, far_neighbors_count,
+        initial_far_hash};
+    const size_t sizes[] = {sizeof(out_neighbors8), sizeof(out_neighbors4),
+        sizeof(neighbors_side), sizeof(neighbors_diag), sizeof(neighbors_3x3),
+        sizeof(border_left), sizeof(border_right), sizeof(border_top),
+        sizeof(border_bottom), sizeof(distances_to_border), sizeof(nei_dst_3),
+        sizeof(nei_dst_4), sizeof(black_eye), sizeof(white_eye),
+        sizeof(black_eye_shapes), sizeof(white_eye_shapes), sizeof(iv_3x3),
+        sizeof(initial_3x3_hash), sizeof(far_neighbors), sizeof(far_shifts),
+        sizeof(far_neighbors_count), sizeof(initial_far_hash)};
+    const u8 count = sizeof(sizes) / sizeof(sizes[0]);
+
+    /* the tables compiled in against computed ones */
+    void * compiled_in[sizeof(sizes) / sizeof(sizes[0])];
+    for(u8 i = 0; i < count; ++i)
+    {
+        compiled_in[i] = malloc(sizes[i]);
+        massert(compiled_in[i] != NULL, "constant tables memory");
+        memcpy(compiled_in[i], tables[i], sizes[i]);
+    }
+
+    board_constants_compute();
+    zobrist_tables_compute();
+
+    for(u8 i = 0; i < count; ++i)
+    {
+        massert(memcmp(compiled_in[i], tables[i], sizes[i]) == 0,
+            "constant tables differ");
+        free(compiled_in[i]);
+    }
+
+    fprintf(stderr, " passed\n");
+}
+
 static void test_zobrist_hashing()
 {
     fprintf(stderr, "%s: zobrist hashing...", _timestamp());
@@ -592,6 +1042,601 @@ static void test_zobrist_hashing()
     fprintf(stderr, " passed\n");
 }
 
+static u32 u32_pair_hash(
+    const void * a
+){
+    return ((const u32 *)a)[0];
+}
+
+static int u32_pair_compare(
+    const void * a,
+    const void * b
+){
+    return ((const u32 *)a)[0] == ((const u32 *)b)[0] ? 0 : 1;
+}
+
+static void test_open_table()
+{
+    fprintf(stderr, "%s: open addressing table...", _timestamp());
+
+    open_table * ot = open_table_create(0, 2 * sizeof(u32), u32_pair_hash,
+        u32_pair_compare);
+
+    /* keys multiple of 1024, so all hashes share the lower bits */
+    for(u32 i = 0; i < 20000; ++i)
+    {
+        u32 pair[2] = { i * 1024, i };
+        bool inserted;
+        open_table_insert(ot, pair, &inserted);
+        massert(inserted, "new element not inserted");
+    }
+    massert(ot->elements == 20000, "wrong number of elements");
+
+    for(u32 i = 0; i < 20000; ++i)
+    {
+        u32 pair[2] = { i * 1024, 0 };
+        bool inserted;
+        u32 * found = (u32 *)open_table_insert(ot, pair, &inserted);
+        massert(!inserted && found[1] == i, "element lost on growth");
+    }
+
+    u32 missing[2] = { 20000 * 1024, 0 };
+    massert(open_table_find(ot, missing) == NULL, "element found wrongly");
+    massert(ot->elements == 20000, "repeated element inserted");
+
+    open_table_destroy(ot);
+
+    fprintf(stderr, " passed\n");
+}
+
+static void test_positional_superko()
+{
+    fprintf(stderr, "%s: positional superko...", _timestamp());
+
+    game_record * gr = malloc(sizeof(game_record));
+    clear_game_record(gr);
+
+    /* a ko in the corner, taken by black */
+    const u8 xy[][2] = { { 1, 0 }, { 2, 0 }, { 0, 1 }, { 3, 1 }, { 1, 2 },
+        { 2, 2 }, { 5, 5 }, { 1, 1 }, { 2, 1 } };
+    for(u8 i = 0; i < 9; ++i)
+        add_play(gr, coord_to_move(xy[i][0], xy[i][1]));
+
+    move retake = coord_to_move(1, 1);
+    massert(test_superko(gr, false, retake), "ko retaken");
+    massert(!test_superko(gr, false, coord_to_move(6, 6)), "wrong superko");
+
+    add_play(gr, coord_to_move(6, 6));
+    add_play(gr, coord_to_move(7, 7));
+    massert(!test_superko(gr, false, retake), "ko threat ignored");
+
+    undo_last_play(gr);
+    undo_last_play(gr);
+    massert(test_superko(gr, false, retake), "ko retaken after undo");
+
+    board b;
+    current_game_state(&b, gr);
+    u64 hash = zobrist_new_hash(&b);
+    massert(position_in_game_record(gr, hash, b.p), "position missing");
+    b.p[coord_to_move(BOARD_SIZ - 1, 0)] = BLACK_STONE;
+    massert(!position_in_game_record(gr, hash, b.p), "hash collision");
+    b.p[coord_to_move(BOARD_SIZ - 1, 0)] = EMPTY;
+    massert(current_game_hash(gr) == zobrist_new_hash(&b), "wrong hash");
+
+    free(gr);
+
+    fprintf(stderr, " passed\n");
+}
+
+static void test_sgf_collection()
+{
+    fprintf(stderr, "%s: SGF collection...", _timestamp());
+
+    const char * sgf = "(;GM[1]FF[4]SZ[" BOARD_SIZ_AS_STR "]KM[6.5]RE[W+2.5]"
+        "C[a \\] (b];B[aa];W[bb](;B[cc];W[]C[x])(;B[dd]))\n"
+        "(;GM[1]SZ[7];B[aa])\n"
+        "(;GM[1]SZ[" BOARD_SIZ_AS_STR "]HA[2]AB[cc][gg];W[dd])\n";
+
+    char filename[] = "/tmp/matilda_utest_XXXXXX";
+    int fd = mkstemp(filename);
+    massert(fd != -1, "could not create temporary file");
+    massert(write(fd, sgf, strlen(sgf)) == (ssize_t)strlen(sgf),
+        "could not write temporary file");
+    close(fd);
+
+    d16 komi_before = komi;
+    game_record gr;
+    sgf_collection sc;
+    massert(open_sgf_collection(&sc, filename), "could not open collection");
+
+    massert(import_next_game_from_sgf(&gr, &sc), "first game not read");
+    massert(gr.turns == 4, "main line not followed");
+    massert(gr.moves[2] == coord_to_move(2, 2), "wrong variation followed");
+    massert(gr.moves[3] == PASS, "pass not read");
+    massert(gr.finished && gr.final_score == -5, "result not read");
+    massert(komi == 13, "komi not read");
+
+    massert(import_next_game_from_sgf(&gr, &sc), "third game not read");
+    massert(sc.games_skipped == 1, "wrong board size not skipped");
+    massert(gr.handicap_stones.count == 2, "handicap stones not read");
+    massert(gr.turns == 1, "play after handicap not read");
+
+    massert(!import_next_game_from_sgf(&gr, &sc), "end of file not found");
+    close_sgf_collection(&sc);
+    unlink(filename);
+    komi = komi_before;
+
+    fprintf(stderr, " passed\n");
+}
+
+static bool files_identical(
+    const char * filename1,
+    const char * filename2
+){
+    FILE * fp1 = fopen(filename1, "rb");
+    FILE * fp2 = fopen(filename2, "rb");
+    bool ret = (fp1 != NULL && fp2 != NULL);
+    while(ret)
+    {
+        int c = fgetc(fp1);
+        ret = (c == fgetc(fp2));
+        if(c == EOF)
+            break;
+    }
+    if(fp1 != NULL)
+        fclose(fp1);
+    if(fp2 != NULL)
+        fclose(fp2);
+    return ret;
+}
+
+static void test_search_tree_snapshot()
+{
+    fprintf(stderr, "%s: search tree snapshot...", _timestamp());
+
+    out_board out_b;
+    board b;
+    clear_board(&b);
+    just_play_slow(&b,  true, coord_to_move(2, 2));
+
+    tt_clean_all();
+    mcts_start_sims(&out_b, &b, false, 1000, 0);
+    tt_clean_unreachable(&b, false);
+    u32 in_use = tt_states_in_use();
+
+    char filename1[] = "/tmp/matilda_utest_XXXXXX";
+    char filename2[] = "/tmp/matilda_utest_XXXXXX";
+    close(mkstemp(filename1));
+    close(mkstemp(filename2));
+
+    u32 saved = tt_export_subtree(&b, false, filename1);
+    massert(saved == in_use, "wrong number of states saved");
+    massert(tt_import_subtree(filename1) == saved, "states not loaded");
+    massert(tt_states_in_use() == saved, "wrong number of states loaded");
+    massert(tt_export_subtree(&b, false, filename2) == saved,
+        "loaded tree not saved");
+    massert(files_identical(filename1, filename2), "loaded tree differs");
+
+    unlink(filename1);
+    unlink(filename2);
+    tt_clean_all();
+
+    fprintf(stderr, " passed\n");
+}
+
+static void test_table_resize()
+{
+    fprintf(stderr, "%s: transpositions table resize...", _timestamp());
+
+    out_board out_b;
+    board b;
+    clear_board(&b);
+    just_play_slow(&b,  true, coord_to_move(3, 2));
+
+    tt_clean_all();
+    mcts_start_sims(&out_b, &b, false, 1000, 0);
+    tt_clean_unreachable(&b, false);
+    u32 in_use = tt_states_in_use();
+
+    char filename1[] = "/tmp/matilda_utest_XXXXXX";
+    char filename2[] = "/tmp/matilda_utest_XXXXXX";
+    close(mkstemp(filename1));
+    close(mkstemp(filename2));
+
+    u64 mbs = max_size_in_mbs;
+    tt_export_subtree(&b, false, filename1);
+    tt_resize(mbs * 2);
+    massert(tt_states_in_use() == in_use, "states lost growing");
+    tt_resize(mbs);
+    massert(tt_states_in_use() == in_use, "states lost shrinking");
+    tt_export_subtree(&b, false, filename2);
+    massert(files_identical(filename1, filename2), "tree differs");
+
+    unlink(filename1);
+    unlink(filename2);
+
+    /* the chunks of plays left unused are released, and used again */
+    board other;
+    clear_board(&other);
+    tt_clean_unreachable(&other, true);
+    massert(tt_states_in_use() == 0, "states kept");
+    massert(tt_trim_plays() > 0 && tt_memory_allocated() == 0,
+        "chunks of plays kept");
+    mcts_start_sims(&out_b, &b, false, 1000, 0);
+    massert(tt_memory_allocated() >= tt_memory_in_use() &&
+        tt_memory_in_use() > 0, "chunks of plays not used again");
+    tt_prune(&b, false);
+    tt_trim_plays();
+    massert(tt_memory_allocated() >= tt_memory_in_use(), "plays in use lost");
+    mcts_start_sims(&out_b, &b, false, 1000, 0);
+    tt_clean_all();
+
+    fprintf(stderr, " passed\n");
+}
+
+static void test_symmetric_states()
+{
+    fprintf(stderr, "%s: symmetric transpositions...", _timestamp());
+
+    for(d8 r = NOREDUCE; r <= ROTFLIP270; ++r)
+        for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+            massert(tt_revert_move(tt_reduce_move(m, r), r) == m,
+                "reduction not reverted");
+
+    tt_clean_all();
+    tt_stats * stats[2];
+    move reduced[2];
+    board b[2];
+    for(u8 i = 0; i < 2; ++i)
+    {
+        clear_board(&b[i]);
+        move m = i == 0 ? coord_to_move(3, 2) : coord_to_move(BOARD_SIZ - 3,
+            BOARD_SIZ - 4);
+        just_play_slow(&b[i], true, m);
+
+        cfg_board cb;
+        cfg_from_board(&cb, &b[i]);
+        d8 reduction = tt_reduction(&cb, NOREDUCE);
+        stats[i] = tt_lookup_null(&cb, false, zobrist_new_hash(&b[i]),
+            reduction);
+        omp_unset_lock(&stats[i]->lock);
+        reduced[i] = tt_reduce_move(m, reduction);
+        cfg_board_free(&cb);
+    }
+#if TT_SYMMETRY_MAX_STONES > 0
+    massert(stats[0] == stats[1], "symmetric positions not shared");
+    massert(reduced[0] == reduced[1], "orientations differ");
+#else
+    massert(stats[0] != stats[1], "positions shared");
+#endif
+
+    /* the state reached in a descent is the one of the root */
+    d8 reduction;
+    tt_stats * root = tt_lookup_create(&b[1], false, &reduction);
+    omp_unset_lock(&root->lock);
+    massert(root == stats[1], "root not found in its orientation");
+    tt_clean_all();
+
+    fprintf(stderr, " passed\n");
+}
+
+static void test_dead_stones()
+{
+    fprintf(stderr, "%s: dead stones and final score...", _timestamp());
+
+    /* walls splitting the board, with a white stone dead in black's area */
+    board b;
+    clear_board(&b);
+    for(u8 y = 0; y < BOARD_SIZ; ++y)
+    {
+        b.p[coord_to_move(3, y)] = BLACK_STONE;
+        b.p[coord_to_move(4, y)] = WHITE_STONE;
+    }
+    move dead_white = coord_to_move(1, BOARD_SIZ / 2);
+    b.p[dead_white] = WHITE_STONE;
+
+    u8 settled[TOTAL_BOARD_SIZ];
+    memcpy(settled, b.p, TOTAL_BOARD_SIZ);
+    settled[dead_white] = EMPTY;
+
+    tt_clean_all();
+    bool dead[TOTAL_BOARD_SIZ];
+    estimate_dead_stones(&b, true, dead);
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+        massert(dead[m] == (m == dead_white), "dead stones");
+
+    massert(estimate_final_score(&b, true) == score_stones_and_area(settled),
+        "final score");
+    tt_clean_all();
+
+    fprintf(stderr, " passed\n");
+}
+
+static void test_deterministic_search()
+{
+    fprintf(stderr, "%s: deterministic search...", _timestamp());
+
+    out_board out_b;
+    board b;
+    clear_board(&b);
+    just_play_slow(&b,  true, coord_to_move(3, 3));
+    just_play_slow(&b, false, coord_to_move(BOARD_SIZ - 4, BOARD_SIZ - 4));
+
+    mcts_set_deterministic(true, 1);
+    u64 fingerprints[2];
+    for(u8 i = 0; i < 2; ++i)
+    {
+        tt_clean_all();
+        mcts_start_sims(&out_b, &b, true, 1000, 0);
+        fingerprints[i] = tt_fingerprint();
+    }
+    mcts_set_deterministic(false, 0);
+    tt_clean_all();
+
+    massert(fingerprints[0] == fingerprints[1], "trees differ");
+
+    fprintf(stderr, " passed\n");
+}
+
+/*
+Tests that the plays evaluated of a widened root are the ones it considers; the
+root is widened when it was first reached in the search of the previous turn.
+*/
+static void test_widened_root()
+{
+    fprintf(stderr, "%s: widened root...", _timestamp());
+
+    out_board out_b;
+    board b;
+    clear_board(&b);
+    just_play_slow(&b,  true, coord_to_move(3, 3));
+
+    tt_clean_all();
+    mcts_start_sims(&out_b, &b, false, 2000, 0);
+    just_play_slow(&b, false, select_play_fast(&out_b));
+    mcts_start_sims(&out_b, &b, true, 1000, 0);
+
+    d8 reduction;
+    tt_stats * root = tt_lookup_create(&b, true, &reduction);
+    omp_unset_lock(&root->lock);
+    massert(root->widened > 0 && root->widened < root->plays_count,
+        "root not widened");
+
+    bool considered[TOTAL_BOARD_SIZ];
+    memset(considered, false, sizeof(considered));
+    for(move i = 0; i < root->widened; ++i)
+    {
+        move m = tt_revert_move(root->plays[root->plays_by_prior[i]].m,
+            reduction);
+        if(m != PASS)
+            considered[m] = true;
+    }
+
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+        massert(!out_b.tested[m] || considered[m], "play not considered");
+    tt_clean_all();
+
+    fprintf(stderr, " passed\n");
+}
+
+/*
+Fills the board with stones of a color, leaving the positions given empty.
+*/
+static void fill_board(
+    board * b,
+    bool is_black,
+    u8 empty_count,
+    const move * empty
+){
+    clear_board(b);
+    memset(b->p, is_black ? BLACK_STONE : WHITE_STONE, TOTAL_BOARD_SIZ);
+    for(u8 i = 0; i < empty_count; ++i)
+        b->p[empty[i]] = EMPTY;
+}
+
+/*
+Tests the solver on a corner tsumego: the two white stones must be captured for
+black to win by komi, and the search proves it.
+*/
+static void test_solver()
+{
+    fprintf(stderr, "%s: solver...", _timestamp());
+
+    /* black everywhere with two eyes, white in the corner with two liberties */
+    move empty[] = { coord_to_move(2, 0), coord_to_move(0, 1),
+        coord_to_move(10, 10), coord_to_move(14, 14) };
+    board b;
+    fill_board(&b, true, 4, empty);
+    b.p[coord_to_move(0, 0)] = WHITE_STONE;
+    b.p[coord_to_move(1, 0)] = WHITE_STONE;
+
+    d16 komi_before = komi;
+    komi = TOTAL_BOARD_SIZ * 2 - 3;
+
+    out_board out_b;
+    tt_clean_all();
+    mcts_start_sims(&out_b, &b, true, 4000, 0);
+
+    d8 reduction;
+    tt_stats * root = tt_lookup_create(&b, true, &reduction);
+    omp_unset_lock(&root->lock);
+    massert(root->proven == PROVEN_WIN, "tsumego not proven");
+    move m = select_play_fast(&out_b);
+    massert(m == coord_to_move(2, 0) || m == coord_to_move(0, 1),
+        "tsumego play");
+    massert(out_b.value[m] == 1.0, "tsumego play not proven");
+    tt_clean_all();
+
+    komi = komi_before;
+
+    fprintf(stderr, " passed\n");
+}
+
+/*
+Tests that the solver does not prove a loss from plays that leave out legal
+ones: passing loses by komi, and filling its own eyes is the only other play of
+black, so it is not proven lost.
+*/
+static void test_solver_excluded_play()
+{
+    fprintf(stderr, "%s: solver with plays left out...", _timestamp());
+
+    /* black and white halves, each with two eyes */
+    move empty[] = { coord_to_move(3, 3), coord_to_move(3, 15),
+        coord_to_move(15, 3), coord_to_move(15, 15) };
+    board b;
+    fill_board(&b, true, 4, empty);
+    for(u8 x = 10; x < BOARD_SIZ; ++x)
+        for(u8 y = 0; y < BOARD_SIZ; ++y)
+            if(b.p[coord_to_move(x, y)] != EMPTY)
+                b.p[coord_to_move(x, y)] = WHITE_STONE;
+
+    d16 komi_before = komi;
+    /* black leads by a column, half a point short of komi */
+    komi = BOARD_SIZ * 2 + 1;
+
+    out_board out_b;
+    tt_clean_all();
+    mcts_start_sims(&out_b, &b, true, 1000, 0);
+
+    d8 reduction;
+    tt_stats * root = tt_lookup_create(&b, true, &reduction);
+    omp_unset_lock(&root->lock);
+    massert(!root->plays_complete, "own eyes in the plays");
+    massert(root->proven == PROVEN_NONE, "loss proven from plays left out");
+    tt_clean_all();
+
+    komi = komi_before;
+
+    fprintf(stderr, " passed\n");
+}
+
+/*
+Tests the searches with the deferred priors computed in batches: the priors
+queued are added to the states by the end of the search, and a search by many
+threads, completing batches, grows the same kind of tree.
+*/
+static void test_batched_priors()
+{
+    fprintf(stderr, "%s: batched priors...", _timestamp());
+
+    board b;
+    clear_board(&b);
+    just_play_slow(&b, true, coord_to_move(3, 3));
+    just_play_slow(&b, false, coord_to_move(15, 15));
+    just_play_slow(&b, true, coord_to_move(15, 3));
+    just_play_slow(&b, false, coord_to_move(3, 15));
+
+    set_use_of_opening_book(false);
+    mcts_set_deterministic(true, 1);
+
+    /* the root after one simulation, with the priors computed right away */
+    out_board out_b;
+    d8 reduction;
+    tt_clean_all();
+    mcts_start_sims(&out_b, &b, true, 1, 0);
+    tt_stats * root = tt_lookup_create(&b, true, &reduction);
+    omp_unset_lock(&root->lock);
+    move plays_count = root->plays_count;
+    u32 mc_n[MAX_PLAYS_COUNT];
+    u32 amaf_n[MAX_PLAYS_COUNT];
+    u64 prior_n = 0;
+    for(move k = 0; k < plays_count; ++k)
+    {
+        mc_n[k] = root->mc_n[k];
+        amaf_n[k] = root->amaf_n[k];
+        prior_n += root->mc_n[k];
+    }
+    massert(plays_count > 0 && prior_n > 1, "priors not computed");
+
+    /* the same, with the priors queued and computed at the end of the search */
+    mcts_set_batched_priors(true);
+    tt_clean_all();
+    mcts_start_sims(&out_b, &b, true, 1, 0);
+    root = tt_lookup_create(&b, true, &reduction);
+    omp_unset_lock(&root->lock);
+    massert(root->plays_count == plays_count, "batched priors plays");
+    for(move k = 0; k < plays_count; ++k)
+        massert(root->mc_n[k] == mc_n[k] && root->amaf_n[k] == amaf_n[k],
+            "batched priors not added");
+
+    /* many threads completing batches */
+    mcts_set_deterministic(false, 0);
+    tt_clean_all();
+    mcts_start_sims(&out_b, &b, true, UCT_PRIOR_BATCH_SIZE * 256, 0);
+    root = tt_lookup_create(&b, true, &reduction);
+    omp_unset_lock(&root->lock);
+    massert(tt_subtree_states(&b, true) > UCT_PRIOR_BATCH_SIZE * 2,
+        "batched priors tree");
+    u64 n = 0;
+    for(move k = 0; k < root->plays_count; ++k)
+        n += root->mc_n[k];
+    massert(n >= prior_n + UCT_PRIOR_BATCH_SIZE * 128, "batched priors visits");
+    massert(is_board_move(select_play_fast(&out_b)), "batched priors play");
+    tt_clean_all();
+
+    mcts_set_batched_priors(false);
+    set_use_of_opening_book(true);
+
+    fprintf(stderr, " passed\n");
+}
+
+static void test_batch_evaluation()
+{
+    fprintf(stderr, "%s: batch evaluation...", _timestamp());
+
+    board b[3];
+    bool is_black[3];
+    u32 simulations[3] = { 1000, 200, 100 };
+    out_board out_b[3];
+    bool has_play[3];
+    clear_board(&b[0]);
+    just_play_slow(&b[0],  true, coord_to_move(3, 3));
+    just_play_slow(&b[0], false, coord_to_move(BOARD_SIZ - 4, BOARD_SIZ - 4));
+    is_black[0] = true;
+    for(u8 i = 1; i < 3; ++i)
+    {
+        memcpy(&b[i], &b[i - 1], sizeof(board));
+        just_play_slow(&b[i], is_black[i - 1], coord_to_move(BOARD_SIZ - 4 *
+            i, 3));
+        is_black[i] = !is_black[i - 1];
+    }
+
+    /* the trees of the positions are kept for the following ones */
+    set_use_of_opening_book(false);
+    mcts_set_deterministic(true, 1);
+    tt_clean_all();
+    evaluate_positions_sims(3, b, is_black, simulations, out_b, has_play);
+    for(u8 i = 0; i < 3; ++i)
+        massert(has_play[i], "position not evaluated");
+    massert(tt_subtree_states(&b[0], is_black[0]) > 0, "tree not kept");
+
+    /*
+    With the table half full after the first position, the states not reachable
+    from the next one are freed
+    */
+    tt_clean_all();
+    evaluate_position_sims(&b[0], is_black[0], &out_b[0], simulations[0]);
+    u64 used = tt_memory_in_use();
+    u64 mbs = max_size_in_mbs;
+    tt_clean_all();
+    tt_resize(used * 2 / 1048576);
+    massert(tt_memory_in_use() == 0 && used >= max_size_in_mbs * 1048576 / 2,
+        "table not half full");
+    memset(has_play, false, sizeof(has_play));
+    evaluate_positions_sims(3, b, is_black, simulations, out_b, has_play);
+    for(u8 i = 0; i < 3; ++i)
+        massert(has_play[i], "position not evaluated");
+    massert(tt_subtree_states(&b[0], is_black[0]) == 0, "tree not freed");
+    massert(tt_subtree_states(&b[2], is_black[2]) > 0, "tree freed");
+    tt_resize(mbs);
+    mcts_set_deterministic(false, 0);
+    set_use_of_opening_book(true);
+    tt_clean_all();
+
+    fprintf(stderr, " passed\n");
+}
+
 static void test_whole_game()
 {
     fprintf(stderr, "%s: game record and MCTS...\n", _timestamp());
@@ -613,7 +1658,7 @@ static void test_whole_game()
         u64 early_stop_time = curr_time + 250;
 
         bool has_play = evaluate_position_timed(&b, is_black, &out_b, stop_time,
-            early_stop_time);
+            early_stop_time, stop_time);
         if(!has_play)
             break;
         move m = select_play(&out_b, is_black, &gr);
@@ -658,9 +1703,26 @@ int main()
         test_board();
         test_cfg_board();
         test_ladders();
+        test_eye_shapes();
+        test_tactical_cache();
+        test_dragon_shapes();
         test_rand_gen();
         test_time_keeping();
+        test_constant_tables();
         test_zobrist_hashing();
+        test_open_table();
+        test_positional_superko();
+        test_sgf_collection();
+        test_search_tree_snapshot();
+        test_table_resize();
+        test_symmetric_states();
+        test_dead_stones();
+        test_deterministic_search();
+        test_widened_root();
+        test_solver();
+        test_solver_excluded_play();
+        test_batched_priors();
+        test_batch_evaluation();
         test_whole_game();
     }else
         while(1)
@@ -1,6 +1,7 @@
 /*
 For creating and updating Zobrist hashes on board states, both for full board
-hashes and position invariant 3x3 hashes.
+hashes and position invariant 3x3 hashes; and the codification of the outer
+intersections of 12-point patterns.
 */
 
 #include "config.h"
@@ -12,20 +13,47 @@ hashes and position invariant 3x3 hashes.
 
 #include "alloc.h"
 #include "board.h"
+#include "constant_tables.h"
+#include "data_pack.h"
 #include "engine.h"
 #include "file_io.h"
 #include "flog.h"
+#include "pat12.h"
 #include "randg.h"
 #include "types.h"
 
 static bool _zobrist_inited = false;
 
-static u64 iv[TOTAL_BOARD_SIZ][2];
+static u64 iv_read[TOTAL_BOARD_SIZ][2];
+/* either iv_read or the data pack section */
+static const u64 * iv = &iv_read[0][0];
 
+#if CONSTANT_TABLES_SIZ != BOARD_SIZ
 /* for 3x3 neighborhood Zobrist hashing */
 u16 iv_3x3[TOTAL_BOARD_SIZ][TOTAL_BOARD_SIZ][3];
 u16 initial_3x3_hash[TOTAL_BOARD_SIZ];
 
+/*
+For the four outer intersections of 12-point patterns: the intersections whose
+pattern includes each intersection, and the shift of its codification in them.
+*/
+move far_neighbors[TOTAL_BOARD_SIZ][4];
+u8 far_shifts[TOTAL_BOARD_SIZ][4];
+u8 far_neighbors_count[TOTAL_BOARD_SIZ];
+u8 initial_far_hash[TOTAL_BOARD_SIZ];
+#else
+/* generated by gen_constant_tables, in gen/constant_tables.c */
+extern u16 iv_3x3[TOTAL_BOARD_SIZ][TOTAL_BOARD_SIZ][3];
+extern u16 initial_3x3_hash[TOTAL_BOARD_SIZ];
+extern move far_neighbors[TOTAL_BOARD_SIZ][4];
+extern u8 far_shifts[TOTAL_BOARD_SIZ][4];
+extern u8 far_neighbors_count[TOTAL_BOARD_SIZ];
+extern u8 initial_far_hash[TOTAL_BOARD_SIZ];
+#endif
+
+/* from pat12 */
+extern const d8 pat12_offsets[PAT12_POINTS][2];
+
 static u16 get_border_hash_slow(
     move m
 ){
@@ -48,31 +76,11 @@ static u16 get_border_hash_slow(
 }
 
 /*
-Initiate the internal Zobrist table from an external file.
+Computes the tables of 3x3 and 12-point pattern hashing, even if they were
+compiled in already.
 */
-void zobrist_init()
+void zobrist_tables_compute()
 {
-    if(_zobrist_inited)
-        return;
-
-    alloc_init();
-
-    assert(EMPTY == 0);
-    assert(BLACK_STONE < 3);
-    assert(WHITE_STONE < 3);
-    rand_init();
-
-    char * filename = alloc();
-    snprintf(filename, MAX_PAGE_SIZ, "%s%ux%u.zt", data_folder(), BOARD_SIZ,
-        BOARD_SIZ);
-    if(read_binary_file(iv, sizeof(u64) * TOTAL_BOARD_SIZ * 2, filename) == -1)
-    {
-        char * s = alloc();
-        snprintf(s, MAX_PAGE_SIZ, "could not read %s", filename);
-        flog_crit("zbst", s);
-        release(s);
-    }
-
     for(move pos = 0; pos < TOTAL_BOARD_SIZ; ++pos)
     {
         u16 shift = 14;
@@ -100,6 +108,76 @@ void zobrist_init()
     for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
         initial_3x3_hash[m] = get_border_hash_slow(m);
 
+    for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
+    {
+        u8 x;
+        u8 y;
+        move_to_coord(m, &x, &y);
+        far_neighbors_count[m] = 0;
+        initial_far_hash[m] = 0;
+        for(u8 k = 8; k < PAT12_POINTS; ++k)
+        {
+            u8 shift = PAT12_BITS - 2 - 2 * k;
+            d8 i = x + pat12_offsets[k][0];
+            d8 j = y + pat12_offsets[k][1];
+            if(i < 0 || j < 0 || i >= BOARD_SIZ || j >= BOARD_SIZ)
+                initial_far_hash[m] |= ILLEGAL << shift;
+
+            /* the intersection that has m in this position */
+            i = x - pat12_offsets[k][0];
+            j = y - pat12_offsets[k][1];
+            if(i >= 0 && j >= 0 && i < BOARD_SIZ && j < BOARD_SIZ)
+            {
+                far_neighbors[m][far_neighbors_count[m]] = coord_to_move(i, j);
+                far_shifts[m][far_neighbors_count[m]] = shift;
+                far_neighbors_count[m]++;
+            }
+        }
+    }
+}
+
+/*
+Initiate the internal Zobrist table from an external file.
+*/
+void zobrist_init()
+{
+    if(_zobrist_inited)
+        return;
+
+    alloc_init();
+
+    assert(EMPTY == 0);
+    assert(BLACK_STONE < 3);
+    assert(WHITE_STONE < 3);
+    rand_init();
+
+    char * filename = alloc();
+    snprintf(filename, MAX_PAGE_SIZ, "%s%ux%u.zt", data_folder(), BOARD_SIZ,
+        BOARD_SIZ);
+
+    u64 packed_size;
+    const void * packed = data_pack_section(DATA_PACK_ZOBRIST,
+        file_fingerprint(filename), &packed_size);
+    if(packed != NULL && packed_size == sizeof(iv_read))
+    {
+        iv = (const u64 *)packed;
+        snprintf(filename, MAX_PAGE_SIZ, "data pack");
+    }
+    else
+    {
+        if(read_binary_file(iv_read, sizeof(iv_read), filename) == -1)
+        {
+            char * s = alloc();
+            snprintf(s, MAX_PAGE_SIZ, "could not read %s", filename);
+            flog_crit("zbst", s);
+            release(s);
+        }
+    }
+
+#if CONSTANT_TABLES_SIZ != BOARD_SIZ
+    zobrist_tables_compute();
+#endif
+
     _zobrist_inited = true;
 
     char * s = alloc();
@@ -109,6 +187,29 @@ void zobrist_init()
     release(filename);
 }
 
+/*
+Contents of the Zobrist section of a data pack, after zobrist_init; and the
+fingerprint of the file read.
+RETURNS newly allocated section contents
+*/
+void * zobrist_pack_section(
+    u64 * size,
+    u32 * fingerprint
+){
+    void * ret = malloc(sizeof(iv_read));
+    if(ret == NULL)
+        flog_crit("zbst", "system out of memory");
+    memcpy(ret, iv, sizeof(iv_read));
+    *size = sizeof(iv_read);
+
+    char * filename = alloc();
+    snprintf(filename, MAX_PAGE_SIZ, "%s%ux%u.zt", data_folder(), BOARD_SIZ,
+        BOARD_SIZ);
+    *fingerprint = file_fingerprint(filename);
+    release(filename);
+    return ret;
+}
+
 /*
 Generate the Zobrist hash of a board state from scratch.
 RETURNS Zobrist hash
@@ -119,7 +220,7 @@ u64 zobrist_new_hash(
     u64 ret = 0;
     for(move m = 0; m < TOTAL_BOARD_SIZ; ++m)
         if(src->p[m] != EMPTY)
-            ret ^= iv[m][src->p[m] - 1];
+            ret ^= iv[m * 2 + src->p[m] - 1];
     return ret;
 }
 
@@ -134,5 +235,5 @@ void zobrist_update_hash(
     move m,
     u8 change
 ){
-    *old_hash ^= iv[m][change - 1];
+    *old_hash ^= iv[m * 2 + change - 1];
 }